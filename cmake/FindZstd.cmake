@@ -0,0 +1,32 @@
+# - Find Zstd
+# Find the native zstd includes and library
+#
+#  Zstd_INCLUDE_DIR - where to find zstd.h, etc.
+#  Zstd_LIBRARIES   - List of libraries when using zstd.
+#  Zstd_FOUND       - True if zstd found.
+
+find_path(Zstd_INCLUDE_DIR zstd.h)
+
+find_library(Zstd_LIBRARY NAMES zstd)
+
+if (Zstd_INCLUDE_DIR AND Zstd_LIBRARY)
+  set(Zstd_FOUND TRUE)
+  set( Zstd_LIBRARIES ${Zstd_LIBRARY} )
+else ()
+  set(Zstd_FOUND FALSE)
+  set( Zstd_LIBRARIES )
+endif ()
+
+if (Zstd_FOUND)
+  message(STATUS "Found zstd: ${Zstd_LIBRARY}")
+else ()
+  message(STATUS "Not Found zstd")
+  if (Zstd_FIND_REQUIRED)
+    message(FATAL_ERROR "Could NOT find zstd library")
+  endif ()
+endif ()
+
+mark_as_advanced(
+  Zstd_LIBRARY
+  Zstd_INCLUDE_DIR
+  )
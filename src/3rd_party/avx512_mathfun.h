@@ -0,0 +1,140 @@
+/*
+   AVX512 implementation of exp and log
+
+   Port of exp256_ps and log256_ps from "avx_mathfun.h" by Giovanni Garberoglio, which is based on
+   "sse_mathfun.h" by Julien Pommier, http://gruntthepeon.free.fr/ssemath/
+   It evaluates the same cephes polynomials on 16 floats at once.
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  (this is the zlib license)
+*/
+
+#pragma once
+
+#include <immintrin.h>
+
+/* Needs AVX512F, either from the compiler flags or from a target attribute or pragma around the
+   inclusion of this file */
+static inline __m512 exp512_ps(__m512 x) {
+  const __m512 one = _mm512_set1_ps(1.f);
+
+  x = _mm512_min_ps(x, _mm512_set1_ps(88.3762626647949f));
+  x = _mm512_max_ps(x, _mm512_set1_ps(-88.3762626647949f));
+
+  /* express exp(x) as exp(g + n*log(2)) */
+  __m512 fx = _mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f));
+  fx = _mm512_add_ps(fx, _mm512_set1_ps(0.5f));
+  fx = _mm512_roundscale_ps(fx, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+
+  __m512 tmp = _mm512_mul_ps(fx, _mm512_set1_ps(0.693359375f));
+  __m512 z = _mm512_mul_ps(fx, _mm512_set1_ps(-2.12194440e-4f));
+  x = _mm512_sub_ps(x, tmp);
+  x = _mm512_sub_ps(x, z);
+
+  z = _mm512_mul_ps(x, x);
+
+  __m512 y = _mm512_set1_ps(1.9875691500E-4f);
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(1.3981999507E-3f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(8.3334519073E-3f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(4.1665795894E-2f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(1.6666665459E-1f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(5.0000001201E-1f));
+  y = _mm512_mul_ps(y, z);
+  y = _mm512_add_ps(y, x);
+  y = _mm512_add_ps(y, one);
+
+  /* build 2^n */
+  __m512i imm0 = _mm512_cvttps_epi32(fx);
+  imm0 = _mm512_add_epi32(imm0, _mm512_set1_epi32(0x7f));
+  imm0 = _mm512_slli_epi32(imm0, 23);
+  __m512 pow2n = _mm512_castsi512_ps(imm0);
+  y = _mm512_mul_ps(y, pow2n);
+  return y;
+}
+
+/* natural logarithm computed for 16 simultaneous floats, returns NaN for x <= 0 */
+static inline __m512 log512_ps(__m512 x) {
+  const __m512 one = _mm512_set1_ps(1.f);
+
+  __mmask16 invalid_mask = _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LE_OS);
+
+  x = _mm512_max_ps(x, _mm512_castsi512_ps(_mm512_set1_epi32(0x00800000)));  /* cut off denormalized stuff */
+
+  __m512i imm0 = _mm512_srli_epi32(_mm512_castps_si512(x), 23);
+
+  /* keep only the fractional part */
+  __m512i xi = _mm512_and_si512(_mm512_castps_si512(x), _mm512_set1_epi32(~0x7f800000));
+  x = _mm512_castsi512_ps(_mm512_or_si512(xi, _mm512_castps_si512(_mm512_set1_ps(0.5f))));
+
+  imm0 = _mm512_sub_epi32(imm0, _mm512_set1_epi32(0x7f));
+  __m512 e = _mm512_cvtepi32_ps(imm0);
+
+  e = _mm512_add_ps(e, one);
+
+  /* part2:
+     if( x < SQRTHF ) {
+       e -= 1;
+       x = x + x - 1.0;
+     } else { x = x - 1.0; }
+  */
+  __mmask16 mask = _mm512_cmp_ps_mask(x, _mm512_set1_ps(0.707106781186547524f), _CMP_LT_OS);
+  __m512 tmp = _mm512_maskz_mov_ps(mask, x);
+  x = _mm512_sub_ps(x, one);
+  e = _mm512_mask_sub_ps(e, mask, e, one);
+  x = _mm512_add_ps(x, tmp);
+
+  __m512 z = _mm512_mul_ps(x, x);
+
+  __m512 y = _mm512_set1_ps(7.0376836292E-2f);
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(-1.1514610310E-1f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(1.1676998740E-1f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(-1.2420140846E-1f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(1.4249322787E-1f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(-1.6668057665E-1f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(2.0000714765E-1f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(-2.4999993993E-1f));
+  y = _mm512_mul_ps(y, x);
+  y = _mm512_add_ps(y, _mm512_set1_ps(3.3333331174E-1f));
+  y = _mm512_mul_ps(y, x);
+
+  y = _mm512_mul_ps(y, z);
+
+  tmp = _mm512_mul_ps(e, _mm512_set1_ps(-2.12194440e-4f));
+  y = _mm512_add_ps(y, tmp);
+
+  tmp = _mm512_mul_ps(z, _mm512_set1_ps(0.5f));
+  y = _mm512_sub_ps(y, tmp);
+
+  tmp = _mm512_mul_ps(e, _mm512_set1_ps(0.693359375f));
+  x = _mm512_add_ps(x, y);
+  x = _mm512_add_ps(x, tmp);
+  x = _mm512_mask_mov_ps(x, invalid_mask, _mm512_castsi512_ps(_mm512_set1_epi32(-1))); // negative arg will be NAN
+  return x;
+}
@@ -60,14 +60,8 @@ template<> std::vector<char>& cnpy::operator+=(std::vector<char>& lhs, const cha
     return lhs;
 }
 
-void cnpy::parse_npy_header(FILE* fp, unsigned int& word_size, unsigned int*& shape, unsigned int& ndims, bool& fortran_order) {
-    char buffer[256];
-    size_t res = fread(buffer,sizeof(char),11,fp);
-    if(res != 11)
-        throw std::runtime_error("parse_npy_header: failed fread");
-    std::string header = fgets(buffer,256,fp);
-    assert(header[header.size()-1] == '\n');
-
+// parses the dictionary of an .npy header, e.g. "{'descr': '<f4', 'fortran_order': False, 'shape': (2, 3), }"
+static void parse_npy_dict(const std::string& header, unsigned int& word_size, std::vector<unsigned int>& shape, bool& fortran_order) {
     int loc1, loc2;
 
     //fortran order
@@ -78,10 +72,11 @@ void cnpy::parse_npy_header(FILE* fp, unsigned int& word_size, unsigned int*& sh
     loc1 = (int)header.find("(");
     loc2 = (int)header.find(")");
     std::string str_shape = header.substr(loc1+1,loc2-loc1-1);
+    unsigned int ndims;
     if(str_shape.length() == 0) ndims = 0;
     else if(str_shape[str_shape.size()-1] == ',') ndims = 1;
     else ndims = (unsigned int)std::count(str_shape.begin(),str_shape.end(),',')+1;
-    shape = new unsigned int[ndims];
+    shape.resize(ndims);
     for(unsigned int i = 0;i < ndims;i++) {
         loc1 = (int)str_shape.find(",");
         shape[i] = atoi(str_shape.substr(0,loc1).c_str());
@@ -103,6 +98,57 @@ void cnpy::parse_npy_header(FILE* fp, unsigned int& word_size, unsigned int*& sh
     word_size = atoi(str_ws.substr(0,loc2).c_str());
 }
 
+void cnpy::parse_npy_header(FILE* fp, unsigned int& word_size, unsigned int*& shape, unsigned int& ndims, bool& fortran_order) {
+    char buffer[256];
+    size_t res = fread(buffer,sizeof(char),11,fp);
+    if(res != 11)
+        throw std::runtime_error("parse_npy_header: failed fread");
+    std::string header = fgets(buffer,256,fp);
+    assert(header[header.size()-1] == '\n');
+
+    std::vector<unsigned int> shapeVector;
+    parse_npy_dict(header, word_size, shapeVector, fortran_order);
+    ndims = (unsigned int)shapeVector.size();
+    shape = new unsigned int[ndims];
+    std::copy(shapeVector.begin(), shapeVector.end(), shape);
+}
+
+std::vector<cnpy::NpzEntry> cnpy::npz_map(const char* data, size_t size) {
+    std::vector<NpzEntry> entries;
+    size_t pos = 0;
+    while(pos + 30 <= size) {
+        const char* local_header = data + pos;
+        //if we've reached the global header, stop reading
+        if(local_header[0] != 'P' || local_header[1] != 'K' || local_header[2] != 0x03 || local_header[3] != 0x04) break;
+
+        unsigned short flags = *(const unsigned short*) &local_header[6];
+        unsigned short compression = *(const unsigned short*) &local_header[8];
+        if(compression != 0 || (flags & 0x08) != 0)
+            throw std::runtime_error("npz_map: only stored (uncompressed) entries can be mapped");
+        unsigned int entry_size = *(const unsigned int*) &local_header[18];
+        unsigned short name_len = *(const unsigned short*) &local_header[26];
+        unsigned short extra_field_len = *(const unsigned short*) &local_header[28];
+
+        const char* npy = local_header + 30 + name_len + extra_field_len;
+        if(npy + entry_size > data + size || entry_size < 10)
+            throw std::runtime_error("npz_map: truncated file");
+
+        NpzEntry entry;
+        entry.name.assign(local_header + 30, name_len);
+        entry.name.erase(entry.name.end()-4, entry.name.end()); //erase the lagging .npy
+
+        // magic string, version, header length, then the dictionary
+        unsigned short header_len = *(const unsigned short*) &npy[8];
+        parse_npy_dict(std::string(npy + 10, header_len), entry.word_size, entry.shape, entry.fortran_order);
+        entry.data = npy + 10 + header_len;
+        entry.bytes = entry_size - 10 - header_len;
+        entries.push_back(std::move(entry));
+
+        pos = (npy - data) + entry_size;
+    }
+    return entries;
+}
+
 // make compiler happy, otherwise warns with "variable set but not used"
 #define _unused(x) ((void)(x))
 
@@ -60,6 +60,19 @@ namespace cnpy {
     void parse_zip_footer(FILE* fp, unsigned short& nrecs, unsigned int& global_header_size, unsigned int& global_header_offset);
     npz_t npz_load(std::string fname);
     NpyArrayPtr npz_load(std::string fname, std::string varname);
+
+    // An array of a memory-mapped .npz file, see npz_map()
+    struct NpzEntry {
+        std::string name;
+        std::vector<unsigned int> shape;
+        unsigned int word_size{1};
+        bool fortran_order{0};
+        const char* data{nullptr}; // points into the mapped file
+        size_t bytes{0};
+    };
+    // Lists the arrays of an .npz file in memory without copying them. All entries have to be stored
+    // uncompressed, as npz_save() writes them.
+    std::vector<NpzEntry> npz_map(const char* data, size_t size);
     NpyArrayPtr npy_load(std::string fname);
 
     template<typename T> std::vector<char>& operator+=(std::vector<char>& lhs, const T rhs) {
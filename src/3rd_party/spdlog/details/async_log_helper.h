@@ -21,6 +21,7 @@
 #include <spdlog/details/os.h>
 #include <spdlog/formatter.h>
 
+#include <atomic>
 #include <chrono>
 #include <exception>
 #include <functional>
@@ -144,6 +145,10 @@ private:
 
     bool _terminate_requested;
 
+    // flush() waits until the worker has processed its flush message (modified for Marian)
+    std::atomic<size_t> _flush_requests{0};
+    std::atomic<size_t> _flushes_done{0};
+
 
     // last exception thrown from the worker thread
     std::shared_ptr<spdlog_ex> _last_workerthread_ex;
@@ -160,7 +165,8 @@ private:
     // worker thread
     std::thread _worker_thread;
 
-    void push_msg(async_msg&& new_msg);
+    // always: block until there is space even with discard_log_msg, for flush and terminate messages
+    void push_msg(async_msg&& new_msg, bool always = false);
     // throw last worker thread exception or if worker thread is not active
 
     void throw_if_bad_worker();
@@ -208,7 +214,7 @@ inline spdlog::details::async_log_helper::~async_log_helper()
 {
     try
     {
-        push_msg(async_msg(async_msg_type::terminate));
+        push_msg(async_msg(async_msg_type::terminate), /*always=*/true);
         _worker_thread.join();
     }
     catch (...) // don't crash in destructor
@@ -225,10 +231,10 @@ inline void spdlog::details::async_log_helper::log(const details::log_msg& msg)
 }
 
 //Try to push and block until succeeded
-inline void spdlog::details::async_log_helper::push_msg(details::async_log_helper::async_msg&& new_msg)
+inline void spdlog::details::async_log_helper::push_msg(details::async_log_helper::async_msg&& new_msg, bool always)
 {
     throw_if_bad_worker();
-    if (!_q.enqueue(std::move(new_msg)) && _overflow_policy != async_overflow_policy::discard_log_msg)
+    if (!_q.enqueue(std::move(new_msg)) && (always || _overflow_policy != async_overflow_policy::discard_log_msg))
     {
         auto last_op_time = details::os::now();
         auto now = last_op_time;
@@ -242,9 +248,13 @@ inline void spdlog::details::async_log_helper::push_msg(details::async_log_helpe
 
 }
 
+// waits until all messages logged before have been written and the sinks are flushed
 inline void spdlog::details::async_log_helper::flush()
 {
-    push_msg(async_msg(async_msg_type::flush));
+    size_t request = ++_flush_requests;
+    push_msg(async_msg(async_msg_type::flush), /*always=*/true);
+    while (_flushes_done < request && !_last_workerthread_ex)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
 }
 
 inline void spdlog::details::async_log_helper::worker_loop()
@@ -280,7 +290,9 @@ inline bool spdlog::details::async_log_helper::process_next_msg(log_clock::time_
         switch (incoming_async_msg.msg_type)
         {
         case async_msg_type::flush:
-            _flush_requested = true;
+            for (auto &s : _sinks)
+                s->flush();
+            _flushes_done++;
             break;
 
         case async_msg_type::terminate:
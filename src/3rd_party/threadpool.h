@@ -22,38 +22,71 @@ freely, subject to the following restrictions:
    distribution.
 
 
-This source code has been modified to have optional bounded size.
+This source code has been modified to have optional bounded size, and to distribute the tasks over
+per-worker queues from which idle workers steal, by their estimated cost if given.
 */
 
 #pragma once
 
 #include <iostream>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <type_traits>
+#include <cstddef>
 
 #include "common/logging.h"
+#include "common/utils.h"
 
 namespace marian {
 
+// Every worker has its own queue of tasks. Tasks enqueued by a worker go to its own queue, all others
+// are distributed round-robin, or with enqueueWithCost() to the worker with the least estimated cost
+// of queued and running tasks, so that a slow worker, e.g. on a throttled GPU, gets fewer. A worker takes
+// the oldest task of its own queue, and if that is empty steals the newest one of another queue, so
+// that workers rarely contend for the same lock.
 class ThreadPool {
  public:
-    explicit ThreadPool(size_t threads = 0, size_t bound /* bound on size, or 0 for unbounded */ = 0);
+    // pinThreads: pin worker i to a core with utils::pinThreadToCore(i), see --cpu-pin-threads
+    explicit ThreadPool(size_t threads = 0, size_t bound /* bound on size, or 0 for unbounded */ = 0, bool pinThreads = false);
     void reserve(size_t threads);
 
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
+
+    // As enqueue(), with the cost of the task in any unit common to all tasks, e.g. words times beam size
+    template<class F, class... Args>
+    auto enqueueWithCost(size_t cost, F&& f, Args&&... args)
+        -> std::future<typename std::result_of<F(Args...)>::type>;
+
+    // Calls f(begin, end) on consecutive ranges that cover [0, items), at most one per worker plus one
+    // for the calling thread, and returns when all of them are done. While it waits, the calling thread
+    // runs other tasks of the pool, so that this may be called from inside tasks as well.
+    template<class F>
+    void parallelFor(size_t items, const F& f);
+
     ~ThreadPool();
 
     size_t getNumTasks() const {
-      return tasks.size();
+      return queued;
+    }
+
+    size_t getNumThreads() const {
+      return workers.size();
+    }
+
+    // index of the worker of a ThreadPool that runs the calling thread, or (size_t)-1 for other threads
+    static size_t currentWorker() {
+      return current().index;
     }
 
     void wait_for_one(std::unique_lock<std::mutex>& lock) {
@@ -88,10 +121,125 @@ class ThreadPool {
     }
 
  private:
+    // A callable without arguments that is stored inline if it is small, unlike std::function, which
+    // allocates for all but the smallest ones. Can hold move-only callables like std::packaged_task.
+    class Task {
+     public:
+        Task() {}
+
+        template<class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value>::type>
+        Task(F&& f) {
+          using T = typename std::decay<F>::type;
+          if(sizeof(T) <= sizeof(storage) && alignof(T) <= alignof(Storage) && std::is_nothrow_move_constructible<T>::value) {
+            callable = new(&storage) T(std::forward<F>(f));
+            ops = inlineOps<T>();
+          } else {
+            callable = new T(std::forward<F>(f));
+            ops = heapOps<T>();
+          }
+        }
+
+        Task(Task&& other) { moveFrom(other); }
+        Task& operator=(Task&& other) {
+          if(this != &other) {
+            reset();
+            moveFrom(other);
+          }
+          return *this;
+        }
+        ~Task() { reset(); }
+
+        void operator()() { ops->call(callable); }
+
+        size_t cost{0}; // see enqueueWithCost()
+
+     private:
+        struct Ops {
+          void (*call)(void*);
+          void (*move)(void* from, void* to); // nullptr for callables on the heap, which are not moved
+          void (*destroy)(void*);
+        };
+
+        typedef typename std::aligned_storage<64, alignof(std::max_align_t)>::type Storage;
+        Storage storage;
+        void* callable{nullptr};
+        const Ops* ops{nullptr};
+
+        template<class T> static void callT(void* p) { (*static_cast<T*>(p))(); }
+        template<class T> static void moveT(void* from, void* to) {
+          new(to) T(std::move(*static_cast<T*>(from)));
+          static_cast<T*>(from)->~T();
+        }
+        template<class T> static void destroyInline(void* p) { static_cast<T*>(p)->~T(); }
+        template<class T> static void destroyHeap(void* p) { delete static_cast<T*>(p); }
+
+        template<class T> static const Ops* inlineOps() {
+          static const Ops inlined = {&callT<T>, &moveT<T>, &destroyInline<T>};
+          return &inlined;
+        }
+        template<class T> static const Ops* heapOps() {
+          static const Ops allocated = {&callT<T>, nullptr, &destroyHeap<T>};
+          return &allocated;
+        }
+
+        void moveFrom(Task& other) {
+          cost = other.cost;
+          ops = other.ops;
+          if(ops && ops->move) {
+            ops->move(other.callable, &storage);
+            callable = &storage;
+          } else {
+            callable = other.callable;
+          }
+          other.ops = nullptr;
+          other.callable = nullptr;
+        }
+
+        void reset() {
+          if(ops)
+            ops->destroy(callable);
+          ops = nullptr;
+          callable = nullptr;
+        }
+    };
+
+    template<class R>
+    struct PackagedTask { // a move-only callable for Task
+      std::packaged_task<R()> task;
+      void operator()() { task(); }
+    };
+
+    struct WorkerQueue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+      std::atomic<size_t> cost{0}; // of the queued tasks and the ones the worker runs
+    };
+
+    struct Current {
+      const ThreadPool* pool{nullptr};
+      size_t index{(size_t)-1};
+    };
+    static Current& current() {
+      static thread_local Current worker;
+      return worker;
+    }
+
+    void work(size_t index);
+    void push(Task&& task, bool bounded);
+    bool pop(Task& task);
+    void run(Task& task);
+
     // need to keep track of threads so we can join them
     std::vector<std::thread> workers;
-    // the queue of pending tasks
-    std::queue< std::function<void()> > tasks;
+    // the queues of pending tasks, one per worker. reserve() replaces the list while workers may read it,
+    // hence lists are only ever added
+    std::vector<std::unique_ptr<WorkerQueue>> owned_queues;
+    std::vector<std::unique_ptr<std::vector<WorkerQueue*>>> queue_lists;
+    std::atomic<std::vector<WorkerQueue*>*> queues{nullptr};
+    std::atomic<size_t> queued{0};   // tasks in all queues
+    std::atomic<size_t> sleeping{0}; // workers waiting for tasks
+    std::atomic<size_t> next_queue{0};
+    bool pin_threads;
 
     // synchronization
     std::mutex queue_mutex;
@@ -105,34 +253,134 @@ class ThreadPool {
 };
 
 // the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads, size_t in_bound)
-  : bound(in_bound), stop(false) {
+inline ThreadPool::ThreadPool(size_t threads, size_t in_bound, bool pinThreads)
+  : pin_threads(pinThreads), bound(in_bound), stop(false) {
     ABORT_IF(getThrowExceptionOnAbort(), "Throwing of MarianRuntimeException not presently supported in threads");
     reserve(threads);
 }
 
 // allow callers to increase the number of threads after the fact
 inline void ThreadPool::reserve(size_t threads) {
-    while (workers.size() < threads)
-      workers.emplace_back(
-          [this] {
-              for(;;) {
-                  std::function<void()> task;
-                  {
-                    std::unique_lock<std::mutex> lock(this->queue_mutex);
-                    this->condition.wait(lock,
-                        [this]{ return this->stop || !this->tasks.empty(); });
-                    if (this->stop && this->tasks.empty()) {
-                        return;
-                    }
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
-                  }
-                  this->bounded_condition.notify_one();
-                  task();
-              }
-          }
-      );
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if (workers.size() >= threads)
+      return;
+
+    auto list = std::unique_ptr<std::vector<WorkerQueue*>>(new std::vector<WorkerQueue*>());
+    while (owned_queues.size() < threads)
+      owned_queues.emplace_back(new WorkerQueue());
+    for (auto& queue : owned_queues)
+      list->push_back(queue.get());
+    queues = list.get();
+    queue_lists.push_back(std::move(list));
+
+    while (workers.size() < threads) {
+      size_t index = workers.size();
+      workers.emplace_back([this, index] { work(index); });
+    }
+}
+
+inline void ThreadPool::work(size_t index) {
+    current().pool = this;
+    current().index = index;
+    if (pin_threads) {
+      int node = -1;
+      int cpu = utils::pinThreadToCore(index, &node);
+      if (cpu < 0)
+        LOG(warn, "Could not pin worker thread {} to a core", index);
+      else
+        LOG(info, "Pinned worker thread {} to core {} of NUMA node {}", index, cpu, node);
+    }
+
+    for(;;) {
+      Task task;
+      if (pop(task)) {
+        if (bound > 0) {
+          std::unique_lock<std::mutex> lock(queue_mutex);
+          bounded_condition.notify_one();
+        }
+        run(task);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      sleeping++;
+      condition.wait(lock, [this]{ return stop || queued > 0; });
+      sleeping--;
+      if (stop && queued == 0) {
+        return;
+      }
+    }
+}
+
+// the own queue of a worker first, then the other queues from the next one on
+inline bool ThreadPool::pop(Task& task) {
+    auto& list = *queues.load();
+    size_t own = current().pool == this ? current().index : 0;
+    for (size_t i = 0; i < list.size(); ++i) {
+      auto& queue = *list[(own + i) % list.size()];
+      std::unique_lock<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty())
+        continue;
+      if (i == 0 && current().pool == this) {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      } else {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      queued--;
+      // the cost moves with a stolen task to the worker that runs it, until run() is done
+      if (task.cost > 0 && (i != 0 || current().pool != this)) {
+        queue.cost -= task.cost;
+        if (current().pool == this)
+          list[own]->cost += task.cost;
+      }
+      return true;
+    }
+    return false;
+}
+
+inline void ThreadPool::run(Task& task) {
+    task();
+    if (task.cost > 0 && current().pool == this)
+      (*queues.load())[current().index]->cost -= task.cost;
+}
+
+inline void ThreadPool::push(Task&& task, bool bounded) {
+    bool inside = current().pool == this;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      // tasks of the workers themselves are not bounded, those would wait for themselves
+      if (bounded && !inside)
+        bounded_condition.wait(lock, [this] { return queued < bound || bound == 0 || stop; });
+      // don't allow enqueueing after stopping the pool
+      if (stop) {
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+      }
+      ABORT_IF(workers.empty(), "Tasks enqueued on a ThreadPool without threads");
+    }
+
+    auto& list = *queues.load();
+    size_t index = inside ? current().index : next_queue++ % list.size();
+    if (!inside && task.cost > 0) {
+      // the least loaded queue, starting from the round-robin one to spread ties
+      for (size_t i = 1; i < list.size(); ++i) {
+        size_t other = (index + i) % list.size();
+        if (list[other]->cost < list[index]->cost)
+          index = other;
+      }
+    }
+    auto& queue = *list[index];
+    queue.cost += task.cost;
+    {
+      std::unique_lock<std::mutex> lock(queue.mutex);
+      queue.tasks.emplace_back(std::move(task));
+      queued++;
+    }
+    if (sleeping > 0) {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      condition.notify_one();
+    }
 }
 
 // add new work item to the pool
@@ -155,23 +403,84 @@ inline auto ThreadPool::enqueue(F&& f, Args&&... args)
     }
   };
 
-  auto task = std::make_shared<std::packaged_task<return_type()>>(outer_task);
+  PackagedTask<return_type> task{std::packaged_task<return_type()>(outer_task)};
+  std::future<return_type> res = task.task.get_future();
+  push(Task(std::move(task)), /*bounded=*/true);
+  return res;
+}
 
-  std::future<return_type> res = task->get_future();
-  {
-      std::unique_lock<std::mutex> lock(queue_mutex);
-      this->bounded_condition.wait(lock, [this] { return this->tasks.size() < this->bound || this->bound == 0 || this->stop; });
-      // don't allow enqueueing after stopping the pool
-      if (stop) {
-        throw std::runtime_error("enqueue on stopped ThreadPool");
+template<class F, class... Args>
+inline auto ThreadPool::enqueueWithCost(size_t cost, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type>
+{
+  using return_type = typename std::result_of<F(Args...)>::type;
+
+  auto inner_task = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+  auto outer_task = [inner_task]() -> return_type {
+    try {
+      return inner_task();
+    }
+    catch(const std::exception& e) {
+      ABORT("Caught std::exception in sub-thread: {}", e.what());
+    }
+    catch(...) {
+      ABORT("Caught unknown exception in sub-thread");
+    }
+  };
+
+  PackagedTask<return_type> packaged{std::packaged_task<return_type()>(outer_task)};
+  std::future<return_type> res = packaged.task.get_future();
+  Task task(std::move(packaged));
+  task.cost = cost;
+  push(std::move(task), /*bounded=*/true);
+  return res;
+}
+
+template<class F>
+inline void ThreadPool::parallelFor(size_t items, const F& f) {
+  size_t chunks = std::min(workers.size() + 1, items);
+  if (chunks <= 1) {
+    f((size_t)0, items);
+    return;
+  }
+
+  struct Pending {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t chunks;
+  } pending;
+  pending.chunks = chunks - 1;
+
+  for (size_t chunk = 1; chunk < chunks; ++chunk) {
+    size_t begin = items * chunk / chunks, end = items * (chunk + 1) / chunks;
+    push(Task([&pending, &f, begin, end]() {
+      try {
+        f(begin, end);
+      }
+      catch(const std::exception& e) {
+        ABORT("Caught std::exception in sub-thread: {}", e.what());
       }
+      std::unique_lock<std::mutex> lock(pending.mutex);
+      if (--pending.chunks == 0)
+        pending.done.notify_one();
+    }), /*bounded=*/false);
+  }
+  f((size_t)0, items / chunks);
 
-      tasks.emplace([task](){
-          (*task)();
-      });
+  for(;;) {
+    {
+      std::unique_lock<std::mutex> lock(pending.mutex);
+      if (pending.chunks == 0)
+        return;
+    }
+    Task task;
+    if (pop(task)) {
+      run(task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(pending.mutex);
+    pending.done.wait_for(lock, std::chrono::milliseconds(1), [&pending] { return pending.chunks == 0; });
   }
-  condition.notify_one();
-  return res;
 }
 
 // the destructor joins all threads
@@ -0,0 +1,148 @@
+#include "marian.h"
+#include "translator/beam_search.h"
+#include "translator/translator.h"
+#include "common/file_stream.h"
+#include "common/timer.h"
+#include "common/utils.h"
+
+#include <algorithm>
+
+// Benchmarks the decoding of a model: the time to load it, the throughput for several beam and
+// mini-batch sizes, the latency of single sentences and the memory used, for each of the given
+// precisions. The devices are those of the usual options, e.g. --cpu-threads or --devices. The
+// results are written as JSON, e.g. for comparing releases.
+
+namespace marian {
+
+static size_t countWords(const std::vector<std::string>& lines) {
+  size_t words = 0;
+  for(const auto& line : lines)
+    words += utils::split(line, " ").size();
+  return words;
+}
+
+// the first n lines of the input, repeated if it is shorter
+static std::vector<std::string> readSentences(Ptr<Options> options, size_t n) {
+  // read once, the input is used for every run
+  static std::vector<std::string> input;
+  if(input.empty()) {
+    auto path = options->get<std::vector<std::string>>("input").front();
+    UPtr<std::istream> in(path == "stdin" ? new std::istream(std::cin.rdbuf()) : new io::InputFileStream(path));
+    std::string line;
+    while(io::getline(*in, line))
+      input.push_back(line);
+    ABORT_IF(input.empty(), "No sentences to benchmark in {}", path);
+  }
+
+  std::vector<std::string> lines(input.begin(), input.begin() + std::min(n, input.size()));
+  for(size_t i = 0; lines.size() < n; ++i)
+    lines.push_back(lines[i]);
+  return lines;
+}
+
+static std::string benchmarkPrecision(Ptr<Options> options, const std::string& precision) {
+  options = New<Options>(options->clone());
+  options->set("precision", std::vector<std::string>({precision}));
+  options->set("quiet-translation", true);
+  options->set("n-best", false);
+
+  timer::Timer timer;
+  auto task = New<TranslateService<BeamSearch>>(options);
+  double loadSeconds = timer.elapsed();
+  LOG(info, "[bench] {}: loading took {:.2f}s", precision, loadSeconds);
+
+  auto sentences = readSentences(options, options->get<size_t>("bench-sentences"));
+  auto input = utils::join(sentences, "\n");
+  size_t sourceWords = countWords(sentences);
+
+  // the first translation pays for the lazy initialization of the graphs and kernels
+  task->run(utils::join(readSentences(options, 16), "\n"));
+
+  std::vector<std::string> throughput;
+  for(auto beamSize : options->get<std::vector<size_t>>("bench-beam-sizes")) {
+    for(auto miniBatch : options->get<std::vector<size_t>>("bench-mini-batches")) {
+      task->setOption("beam-size", beamSize);
+      task->setOption("mini-batch", miniBatch);
+      task->setOption("mini-batch-words", (size_t)0);
+      task->setOption("maxi-batch", (size_t)100);
+      task->setOption("maxi-batch-sort", std::string("src"));
+
+      timer.start();
+      auto output = task->run(input);
+      double seconds = timer.elapsed();
+      size_t targetWords = countWords(utils::split(output, "\n"));
+
+      LOG(info, "[bench] {}: beam size {}, mini-batch {}: {:.1f} sentences/s, {:.1f} target words/s",
+          precision, beamSize, miniBatch, sentences.size() / seconds, targetWords / seconds);
+      throughput.push_back(fmt::format(
+          "{{\"beam_size\": {}, \"mini_batch\": {}, \"sentences\": {}, \"source_words\": {}, \"target_words\": {}, "
+          "\"seconds\": {:.4f}, \"sentences_per_second\": {:.2f}, \"target_words_per_second\": {:.2f}}}",
+          beamSize, miniBatch, sentences.size(), sourceWords, targetWords,
+          seconds, sentences.size() / seconds, targetWords / seconds));
+    }
+  }
+
+  // single sentences with the default beam size, one request at a time
+  task->setOption("beam-size", options->get<size_t>("beam-size"));
+  task->setOption("mini-batch", (size_t)1);
+  task->setOption("maxi-batch", (size_t)1);
+  task->setOption("maxi-batch-sort", std::string("none"));
+  std::vector<double> latencies;
+  for(const auto& sentence : readSentences(options, options->get<size_t>("bench-latency-sentences"))) {
+    timer.start();
+    task->run(sentence);
+    latencies.push_back(timer.elapsed() * 1e3);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[std::min(latencies.size() - 1, (size_t)(p / 100. * latencies.size()))];
+  };
+  double mean = 0;
+  for(double latency : latencies)
+    mean += latency / latencies.size();
+  LOG(info, "[bench] {}: latency of single sentences p50 {:.2f} ms, p99 {:.2f} ms", precision, percentile(50), percentile(99));
+
+  return fmt::format(
+      "    {{\n"
+      "      \"precision\": \"{}\",\n"
+      "      \"load_seconds\": {:.4f},\n"
+      "      \"throughput\": [\n        {}\n      ],\n"
+      "      \"latency\": {{\"beam_size\": {}, \"sentences\": {}, \"mean_ms\": {:.3f}, \"p50_ms\": {:.3f}, "
+      "\"p99_ms\": {:.3f}, \"max_ms\": {:.3f}}},\n"
+      "      \"workspace_high_water_bytes\": [{}]\n"
+      "    }}",
+      precision, loadSeconds, utils::join(throughput, ",\n        "),
+      options->get<size_t>("beam-size"), latencies.size(), mean, percentile(50), percentile(99), latencies.back(),
+      utils::join(task->getWorkspaceHighWater(), ", "));
+}
+
+}  // namespace marian
+
+int main(int argc, char** argv) {
+  using namespace marian;
+  auto options = parseOptions(argc, argv, cli::mode::benchmark);
+
+  std::vector<std::string> runs;
+  for(const auto& precision : options->get<std::vector<std::string>>("bench-precisions"))
+    runs.push_back(benchmarkPrecision(options, precision));
+
+  std::vector<std::string> devices;
+  for(auto device : Config::getDevices(options))
+    devices.push_back("\"" + std::string(device) + "\"");
+  std::vector<std::string> models;
+  for(const auto& model : options->get<std::vector<std::string>>("models"))
+    models.push_back("\"" + model + "\"");
+
+  auto path = options->get<std::string>("bench-output");
+  UPtr<std::ostream> stream(path == "stdout" ? new std::ostream(std::cout.rdbuf()) : new io::OutputFileStream(path));
+  auto& out = *stream;
+  out << "{\n";
+  out << "  \"version\": \"" << buildVersion() << "\",\n";
+  out << "  \"models\": [" << utils::join(models, ", ") << "],\n";
+  out << "  \"devices\": [" << utils::join(devices, ", ") << "],\n";
+  out << "  \"peak_resident_bytes\": " << utils::peakResidentMemory() << ",\n";
+  out << "  \"runs\": [\n" << utils::join(runs, ",\n") << "\n  ]\n";
+  out << "}\n";
+
+  return 0;
+}
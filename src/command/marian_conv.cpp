@@ -3,7 +3,128 @@
 #include "tensors/cpu/expression_graph_packable.h"
 #include "onnx/expression_graph_onnx_exporter.h"
 
+#include "3rd_party/mio/mio.hpp"
+
+#include <atomic>
+#include <map>
 #include <sstream>
+#include <thread>
+
+namespace marian {
+
+// adds the elements of a mapped parameter to the float32 sums, or scales the sums if from is null
+template <typename From>
+static void accumulate(float* sums, const char* from, size_t begin, size_t end, float scale) {
+  if(!from) {
+#pragma omp simd
+    for(size_t i = begin; i < end; ++i)
+      sums[i] *= scale;
+    return;
+  }
+  const From* in = (const From*)from;
+#pragma omp simd
+  for(size_t i = begin; i < end; ++i)
+    sums[i] += (float)in[i];
+}
+
+// Averages the parameters of the models, .npz or .bin files of the same architecture, e.g. the last
+// checkpoints of a training. The models are memory-mapped one at a time and added to float32 sums
+// in ranges of elements on `threads` threads, so that at most the sums and the pages of one model
+// are in memory. Returns the averaged float32 parameters, and the other items of the first model.
+static std::vector<io::Item> averageModels(const std::vector<std::string>& models, size_t threads) {
+  const size_t chunkElements = 1 << 20;
+
+  std::vector<io::Item> sums;
+  std::map<std::string, size_t> indices; // name -> position in sums
+  for(size_t m = 0; m < models.size() + 1; ++m) {
+    // the last pass divides the sums by the number of models
+    bool scale = m == models.size();
+    Ptr<mio::mmap_source> mapping;
+    std::vector<io::Item> items;
+    if(!scale) {
+      LOG(info, "Adding model {} to the average", models[m]);
+      mapping = New<mio::mmap_source>(models[m]);
+      items = io::isNpz(models[m]) ? io::mmapItemsNpz(mapping->data(), mapping->size())
+                                   : io::mmapItems(mapping->data());
+    }
+
+    if(m == 0) {
+      for(auto& item : items) {
+        // special items like the model configuration are not needed, that is read by getYamlFromModel()
+        if(item.name.substr(0, 8) == "special:")
+          continue;
+        ABORT_IF(!isFloat(item.type),
+                 "Only models of float parameters can be averaged, {} of {} is {}", item.name, models[m], item.type);
+        indices[item.name] = sums.size();
+        io::Item sum;
+        sum.name = item.name;
+        sum.shape = item.shape;
+        sum.type = Type::float32;
+        sum.bytes.resize(sum.size(), 0);
+        sums.push_back(std::move(sum));
+      }
+    } else if(!scale) {
+      size_t parameters = 0;
+      for(const auto& item : items) {
+        if(item.name.substr(0, 8) == "special:")
+          continue;
+        auto it = indices.find(item.name);
+        ABORT_IF(it == indices.end(), "Parameter {} of {} is not in {}", item.name, models[m], models[0]);
+        ABORT_IF(item.shape != sums[it->second].shape,
+                 "Parameter {} has shape {} in {}, but {} in {}", item.name, item.shape, models[m], sums[it->second].shape, models[0]);
+        ABORT_IF(!isFloat(item.type),
+                 "Only models of float parameters can be averaged, {} of {} is {}", item.name, models[m], item.type);
+        ++parameters;
+      }
+      ABORT_IF(parameters != sums.size(), "{} has {} parameters, {} has {}", models[m], parameters, models[0], sums.size());
+    }
+
+    // the work: ranges of elements of every parameter, taken by the threads in turn
+    struct Chunk {
+      float* sums;
+      const char* from;
+      Type type;
+      size_t begin, end;
+    };
+    std::vector<Chunk> chunks;
+    auto addChunks = [&](io::Item& sum, const char* from, Type type) {
+      size_t elements = sum.shape.elements();
+      for(size_t begin = 0; begin < elements; begin += chunkElements)
+        chunks.push_back({(float*)sum.bytes.data(), from, type, begin, std::min(begin + chunkElements, elements)});
+    };
+    if(scale) {
+      for(auto& sum : sums)
+        addChunks(sum, nullptr, Type::float32);
+    } else {
+      for(const auto& item : items)
+        if(item.name.substr(0, 8) != "special:")
+          addChunks(sums[indices[item.name]], item.data(), item.type);
+    }
+
+    std::atomic<size_t> next(0);
+    float invModels = 1.f / models.size();
+    auto work = [&]() {
+      for(size_t c = next++; c < chunks.size(); c = next++) {
+        const auto& chunk = chunks[c];
+        if(chunk.type == Type::float16)
+          accumulate<HalfFloat>(chunk.sums, chunk.from, chunk.begin, chunk.end, invModels);
+        else if(chunk.type == Type::bfloat16)
+          accumulate<bfloat16>(chunk.sums, chunk.from, chunk.begin, chunk.end, invModels);
+        else
+          accumulate<float>(chunk.sums, chunk.from, chunk.begin, chunk.end, invModels);
+      }
+    };
+    std::vector<std::thread> workers;
+    for(size_t t = 1; t < threads; ++t)
+      workers.emplace_back(work);
+    work();
+    for(auto& worker : workers)
+      worker.join();
+  }
+  return sums;
+}
+
+}  // namespace marian
 
 int main(int argc, char** argv) {
   using namespace marian;
@@ -18,18 +139,45 @@ int main(int argc, char** argv) {
         "Convert a model in the .npz format and normal memory layout to a mmap-able binary model which could be in normal memory layout or packed memory layout",
         "Allowed options",
         "Examples:\n"
-        "  ./marian-conv -f model.npz -t model.bin --gemm-type packed16");
+        "  ./marian-conv -f model.npz -t model.bin --gemm-type packed16\n"
+        "  ./marian-conv --average model.iter9000.npz model.iter10000.npz -t model.avg.npz");
     cli->add<std::string>("--from,-f", "Input model", "model.npz");
+    cli->add<std::vector<std::string>>("--average", "Convert the average of the parameters of these models (.npz or .bin, "
+                                       "e.g. the last checkpoints of a training) instead of --from. They are read one at a "
+                                       "time from memory-mapped files, the model configuration is that of the first");
     cli->add<std::string>("--to,-t", "Output model", "model.bin");
     cli->add<std::string>("--export-as", "Kind of conversion: marian-bin or onnx-{encode,decoder-step,decoder-init,decoder-stop}", "marian-bin");
     cli->add<std::string>("--gemm-type,-g", "GEMM Type to be used: float32, packed16, packed8avx2, packed8avx512, "
-                          "intgemm8, intgemm8ssse3, intgemm8avx2, intgemm8avx512, intgemm16, intgemm16sse2, intgemm16avx2, intgemm16avx512", 
+                          "intgemm8, intgemm8ssse3, intgemm8avx2, intgemm8avx512, intgemm8amx, intgemm16, intgemm16sse2, intgemm16avx2, intgemm16avx512, "
+                          "or int8cols for the int8 tensor-core GEMM of the GPU (requires a .bin output)",
                           "float32");
+    cli->add<std::string>("--save-precision", "Type to save the parameters in that are not packed: float32, float16, bfloat16", "float32");
+    cli->add<std::vector<std::string>>("--gemm-pack",
+                          "Rules which parameters to pack with --gemm-type, tried in order: a regular expression searched in "
+                          "the parameter name, or with a leading ! to keep matching parameters unpacked. "
+                          "Parameters no rule matches are packed if their name ends in _W or _W?");
+    cli->add<bool>("--quantize-embeddings", "Save the embedding matrices that are not tied to the output layer with "
+                   "8 bits per value and a float32 scale per row, which are only dequantized when looked up. "
+                   "Requires a .bin output");
+    cli->add<std::string>("--quantize-statistics", "Save the parameters packed with an 8-bit --gemm-type together with the "
+                          "quantization multipliers of the activations they are multiplied with, computed from the "
+                          "statistics that marian-decoder --quantize-statistics collected on a sample corpus, so that "
+                          "they are not computed for every product when decoding");
+    cli->add<std::vector<int>>("--block-sparse", "Rows and columns of the blocks of pruned parameters, e.g. 1 16. Parameters "
+                               "selected by --gemm-pack that are not packed and whose blocks are mostly zero are saved "
+                               "additionally in block-CSR form, which CPU inference multiplies with");
+    cli->add<float>("--block-sparse-min-zeros", "Fraction of the blocks of a parameter that have to be zero for --block-sparse", 0.5f);
+    cli->add<size_t>("--threads", "Number of threads converting the parameters in parallel, 0 for one per CPU core", 0);
     cli->add<std::vector<std::string>>("--vocabs,-V", "Vocabulary file, required for ONNX export");
+    cli->add<bool>("--onnx-fused-layer-norm", "ONNX export: emit layer normalization as single LayerNormalization nodes "
+                   "(ONNX opset 17 or ONNX Runtime) instead of InstanceNormalization with reshapes");
     cli->parse(argc, argv);
     options->merge(config);
   }
   auto modelFrom = options->get<std::string>("from");
+  auto averaged = options->get<std::vector<std::string>>("average", {});
+  if(!averaged.empty())
+    modelFrom = averaged.front();
   auto modelTo = options->get<std::string>("to");
 
   auto exportAs = options->get<std::string>("export-as");
@@ -38,31 +186,61 @@ int main(int argc, char** argv) {
   // We accept any type here and will later croak during packAndSave if the type cannot be used for conversion
   Type saveGemmType = typeFromString(options->get<std::string>("gemm-type", "float32"));
 
-  LOG(info, "Outputting {}, precision: {}", modelTo, saveGemmType);
+  Type saveElementType = typeFromString(options->get<std::string>("save-precision", "float32"));
+
+  LOG(info, "Outputting {}, precision: {}, unpacked parameters as {}", modelTo, saveGemmType, saveElementType);
 
   YAML::Node config;
   std::stringstream configStr;
   marian::io::getYamlFromModel(config, "special:model.yml", modelFrom);
   configStr << config;
 
+  size_t threads = options->get<size_t>("threads");
+  if(threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+
   auto load = [&](Ptr<ExpressionGraph> graph) {
     graph->setDevice(CPU0);
-    graph->load(modelFrom);
+    if(!averaged.empty()) {
+      auto items = averageModels(averaged, threads);
+      graph->load(items);
+    } else {
+      graph->load(modelFrom);
+    }
     graph->forward();  // run the initializers
   };
 
 
   if (exportAs == "marian-bin") {
     auto graph = New<ExpressionGraphPackable>();
+    graph->setPackingRules(options->get<std::vector<std::string>>("gemm-pack", {}));
+    graph->setBlockSparse(options->get<std::vector<int>>("block-sparse", {}), options->get<float>("block-sparse-min-zeros"));
+    if(options->get<bool>("quantize-embeddings")) {
+      ABORT_IF(!io::isBin(modelTo), "--quantize-embeddings requires a .bin output, not {}", modelTo);
+      // the decoder embeddings are multiplied with in the output layer if tied to it
+      auto get = [&](const std::string& key) { return config[key] && config[key].as<bool>(); };
+      std::string outputEmbeddings;
+      if(get("tied-embeddings") || get("tied-embeddings-all"))
+        outputEmbeddings = get("tied-embeddings-src") || get("tied-embeddings-all") ? "Wemb" : "decoder_Wemb";
+      graph->setQuantizeEmbeddings(true, outputEmbeddings);
+    }
+    ABORT_IF(isColQuantized(saveGemmType) && !io::isBin(modelTo), "--gemm-type {} requires a .bin output, not {}", saveGemmType, modelTo);
+    auto statistics = options->get<std::string>("quantize-statistics");
+    if(!statistics.empty()) {
+      ABORT_IF(!isIntgemm(saveGemmType) || sizeOf(saveGemmType) != 1,
+               "--quantize-statistics requires an 8-bit intgemm --gemm-type, not {}", saveGemmType);
+      graph->setActivationStatistics(cpu::integer::ActivationStatistics::load(statistics));
+    }
     load(graph);
     // added a flag if the weights needs to be packed or not
-    graph->packAndSave(modelTo, configStr.str(), /* --gemm-type */ saveGemmType, Type::float32);
+    graph->packAndSave(modelTo, configStr.str(), /* --gemm-type */ saveGemmType, /* --save-precision */ saveElementType, threads);
   }
   else if (exportAs == "onnx-encode") {
 #ifdef USE_ONNX
     auto graph = New<ExpressionGraphONNXExporter>();
     load(graph);
-    auto modelOptions = New<Options>(config)->with("vocabs", vocabPaths, "inference", true);
+    auto modelOptions = New<Options>(config)->with("vocabs", vocabPaths, "inference", true,
+                                                   "onnx-fused-layer-norm", options->get<bool>("onnx-fused-layer-norm"));
 
     graph->exportToONNX(modelTo, modelOptions, vocabPaths);
 #else
@@ -1,45 +1,208 @@
 #include "marian.h"
 #include "translator/beam_search.h"
+#include "translator/model_registry.h"
 #include "translator/translator.h"
 #include "common/timer.h"
 #include "common/utils.h"
 
 #include "3rd_party/simple-websocket-server/server_ws.hpp"
 
+#include <boost/asio.hpp>
+
 typedef SimpleWeb::SocketServer<SimpleWeb::WS> WSServer;
 
+namespace marian {
+
+// Answers HTTP requests for /metrics with the metrics of the translation services, one connection at a
+// time, which is sufficient for being scraped every few seconds
+static void serveMetrics(std::function<std::string()> metrics, unsigned short port) {
+  using boost::asio::ip::tcp;
+  boost::asio::io_service io;
+  tcp::acceptor acceptor(io, tcp::endpoint(tcp::v4(), port));
+  LOG(info, "Serving metrics on port {} at /metrics", port);
+
+  for(;;) {
+    tcp::socket socket(io);
+    boost::asio::streambuf buffer;
+    boost::system::error_code ec;
+    acceptor.accept(socket, ec);
+    if(!ec)
+      boost::asio::read_until(socket, buffer, "\r\n\r\n", ec);
+    if(ec) {
+      LOG(warn, "Metrics request failed: ({}) {}", ec.value(), ec.message());
+      continue;
+    }
+
+    // the request line, e.g. "GET /metrics HTTP/1.1"
+    std::istream request(&buffer);
+    std::string method, path;
+    request >> method >> path;
+
+    std::string status = "200 OK";
+    std::string body;
+    if(method != "GET")
+      status = "405 Method Not Allowed";
+    else if(path != "/metrics" && path.compare(0, 9, "/metrics?") != 0)
+      status = "404 Not Found";
+    else
+      body = metrics();
+
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+    boost::asio::write(socket, boost::asio::buffer(response), ec);
+  }
+}
+
+// Sends a text message on the connection
+template <class Connection>
+static void sendMessage(Ptr<Connection> connection, const std::string& text) {
+  auto sendStream = std::make_shared<WSServer::OutMessage>();
+  *sendStream << text << std::endl;
+  connection->send(sendStream, [](const SimpleWeb::error_code &ec) {
+    if(ec)
+      LOG(error, "Error sending message: ({}) {}", ec.value(), ec.message());
+  });
+}
+
+// How a request is to be translated, from the query of its URL, e.g.
+// /translate?priority=interactive&deadline-ms=200&stream=1
+struct RequestQuery {
+  RequestBatcher::Priority priority{RequestBatcher::Priority::Normal};
+  size_t deadlineMs{0};
+  bool stream{false};
+
+  // Returns an error message, empty on success
+  std::string parse(const std::string& query) {
+    for(const auto& param : utils::split(query, "&")) {
+      auto pos = param.find('=');
+      auto key = param.substr(0, pos);
+      auto value = pos == std::string::npos ? std::string() : param.substr(pos + 1);
+      if(key == "priority") {
+        if(value == "interactive")
+          priority = RequestBatcher::Priority::Interactive;
+        else if(value == "normal")
+          priority = RequestBatcher::Priority::Normal;
+        else if(value == "bulk")
+          priority = RequestBatcher::Priority::Bulk;
+        else
+          return "Unknown priority '" + value + "', expected interactive, normal or bulk";
+      } else if(key == "deadline-ms") {
+        if(value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+          return "Invalid deadline-ms '" + value + "'";
+        deadlineMs = std::stoul(value);
+      } else if(key == "stream") {
+        if(value != "0" && value != "1")
+          return "Invalid stream '" + value + "', expected 0 or 1";
+        stream = value == "1";
+      } else {
+        return "Unknown query parameter '" + key + "'";
+      }
+    }
+    return "";
+  }
+};
+
+// Translates the message with the service and sends the translation back on the connection. With
+// stream=1 in the query, the translation of each line is sent as soon as it is done as a message
+// "LINE<tab>TRANSLATION", with LINE counting from 0, possibly out of order. A message with just an
+// empty line then ends the request.
+template <class Connection, class Service>
+static void translateMessage(Ptr<Service> task,
+                             Ptr<Connection> connection,
+                             const std::string& inputText,
+                             bool quiet) {
+  RequestQuery query;
+  auto error = query.parse(connection->query_string);
+  if(!error.empty()) {
+    LOG(warn, "Invalid request: {}", error);
+    connection->send_close(1008, error);
+    return;
+  }
+
+  RequestBatcher::LineCallback onLine;
+  if(query.stream)
+    onLine = [connection](size_t line, const std::string& output) {
+      sendMessage(connection, std::to_string(line) + "\t" + output);
+    };
+
+  // Translate, with request batching enabled this returns immediately and the callback is
+  // executed once the batch that contains this request has been translated
+  auto timer = New<timer::Timer>();
+  bool stream = query.stream;
+  task->runAsync(inputText, [connection, timer, quiet, stream](const std::string &outputText) {
+    if(!quiet)
+      LOG(info, "Translation took: {:.5f}s", timer->elapsed());
+
+    // Send translation back, or the end of the streamed translations
+    sendMessage(connection, stream ? std::string() : outputText);
+  }, query.priority, query.deadlineMs, onLine);
+}
+
+}  // namespace marian
+
 int main(int argc, char **argv) {
   using namespace marian;
 
-  // Initialize translation task
+  // Initialize translation task, or with --server-models the registry of the tasks of all models
   auto options = parseOptions(argc, argv, cli::mode::server, true);
-  auto task = New<TranslateService<BeamSearch>>(options);
   auto quiet = options->get<bool>("quiet-translation");
+  Ptr<TranslateService<BeamSearch>> task;
+  Ptr<ModelRegistry> registry;
+  if(options->get<std::vector<std::string>>("server-models", {}).empty())
+    task = New<TranslateService<BeamSearch>>(options);
+  else
+    registry = New<ModelRegistry>(options);
 
   // Initialize web server
   WSServer server;
   server.config.port = (short)options->get<size_t>("port", 8080);
 
-  auto &translate = server.endpoint["^/translate/?$"];
+  auto &translate = server.endpoint[registry ? "^/translate/([^/]+)/?$" : "^/translate/?$"];
 
-  translate.on_message = [&task, quiet](Ptr<WSServer::Connection> connection,
-                                        Ptr<WSServer::InMessage> message) {
+  translate.on_message = [task, registry, quiet](Ptr<WSServer::Connection> connection,
+                                                 Ptr<WSServer::InMessage> message) {
     // Get input text
     auto inputText = message->string();
-    auto sendStream = std::make_shared<WSServer::OutMessage>();
+    if(!registry) {
+      translateMessage(task, connection, inputText, quiet);
+      return;
+    }
 
-    // Translate
-    timer::Timer timer;
-    auto outputText = task->run(inputText);
-    *sendStream << outputText << std::endl;
-    if(!quiet)
-      LOG(info, "Translation took: {:.5f}s", timer.elapsed());
+    auto name = connection->path_match[1].str();
+    auto modelTask = registry->get(name);
+    if(modelTask) {
+      translateMessage(modelTask, connection, inputText, quiet);
+    } else {
+      LOG(warn, "Request for unknown model {}", name);
+      connection->send_close(1008, "Unknown model " + name);
+    }
+  };
 
-    // Send translation back
-    connection->send(sendStream, [](const SimpleWeb::error_code &ec) {
-      if(ec)
-        LOG(error, "Error sending message: ({}) {}", ec.value(), ec.message());
-    });
+  // Reloads the model(s) without interrupting translations, the message holds the changed options as
+  // YAML, e.g. "models: [new.npz]", or is empty to load the model files again. Answers "OK" once the
+  // new models translate, or the error.
+  auto &reload = server.endpoint[registry ? "^/reload/([^/]+)/?$" : "^/reload/?$"];
+
+  reload.on_message = [task, registry](Ptr<WSServer::Connection> connection,
+                                       Ptr<WSServer::InMessage> message) {
+    auto name = registry ? connection->path_match[1].str() : std::string();
+    auto updateText = message->string();
+    // loading takes a while, so it must not block the server thread
+    std::thread([task, registry, connection, name, updateText]() {
+      std::string error;
+      try {
+        auto update = YAML::Load(updateText);
+        error = registry ? registry->reload(name, update) : task->reload(update);
+      } catch(const YAML::Exception& e) {
+        error = std::string("Invalid reload options: ") + e.what();
+      }
+      if(!error.empty())
+        LOG(warn, "Reload failed: {}", error);
+
+      sendMessage(connection, error.empty() ? "OK" : error);
+    }).detach();
   };
 
   // Error Codes for error code meanings
@@ -49,6 +212,14 @@ int main(int argc, char **argv) {
     LOG(error, "Connection error: ({}) {}", ec.value(), ec.message());
   };
 
+  // Start metrics thread, it runs as long as the server
+  auto metricsPort = options->get<size_t>("metrics-port", 0);
+  if(metricsPort > 0)
+    std::thread([task, registry, metricsPort]() {
+      serveMetrics([task, registry]() { return registry ? registry->metrics() : task->metrics(); },
+                   (unsigned short)metricsPort);
+    }).detach();
+
   // Start server thread
   std::thread serverThread([&server]() {
     server.start([](unsigned short port) {
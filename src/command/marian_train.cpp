@@ -3,6 +3,7 @@
 
 #include "common/signal_handling.h"
 #include "training/graph_group_async.h"
+#include "training/graph_group_pipeline.h"
 #include "training/graph_group_singleton.h"
 #include "training/graph_group_sync.h"
 #include "training/training.h"
@@ -24,6 +25,11 @@ int main(int argc, char** argv) {
     LOG(warn, "[experimental] Using old multi-node training implementations that are not up-to-date");
     ABORT("Old multi-node training code disabled");
   }
+  // --pipeline-parallel splits the model across two devices instead of the batches
+  else if(options->get<size_t>("pipeline-parallel") > 0) {
+    LOG(info, "Using pipeline-parallel training");
+    New<Train<PipelineGraphGroup>>(options)->run();
+  }
   // --sync-sgd always selects SyncGraphGroup
   //
   // If given, then this implementation is used for all combinations of (single, multiple) MPI
@@ -14,12 +14,22 @@ int main(int argc, char** argv) {
     YAML::Node config; // @TODO: get rid of YAML::Node here entirely to avoid the pattern. Currently not fixing as it requires more changes to the Options object.
     auto cli = New<cli::CLIWrapper>(
         config,
-        "Create a vocabulary from text corpora given on STDIN",
+        "Create a vocabulary from text corpora given on STDIN or as files",
         "Allowed options",
         "Examples:\n"
         "  ./marian-vocab < text.src > vocab.yml\n"
-        "  cat text.src text.trg | ./marian-vocab > vocab.yml");
+        "  cat text.src text.trg | ./marian-vocab > vocab.yml\n"
+        "  ./marian-vocab -i text.src.gz text.trg.gz --data-threads 16 > vocab.yml");
     cli->add<size_t>("--max-size,-m", "Generate only UINT most common vocabulary items", 0);
+    cli->add<std::vector<std::string>>("--input,-i",
+        "Paths to the text corpora, compressed files are decompressed, 'stdin' reads STDIN",
+        std::vector<std::string>({"stdin"}));
+    cli->add<size_t>("--data-threads",
+        "Number of threads counting the words of chunks of the input, into a counter each", 1);
+    cli->add<size_t>("--min-count", "Generate only items that occur at least UINT times", 0);
+    cli->add<size_t>("--count-sketch-size",
+        "With --min-count, read the input files twice: first into a count-min sketch of UINT MB, then count "
+        "only the items it estimates to occur often enough. Bounds the memory for corpora with many rare items", 0);
     cli->parse(argc, argv);
     options->merge(config);
   }
@@ -27,7 +37,7 @@ int main(int argc, char** argv) {
   LOG(info, "Creating vocabulary...");
 
   auto vocab = New<Vocab>(options, 0);
-  vocab->create("stdout", "stdin", options->get<size_t>("max-size"));
+  vocab->create("stdout", options->get<std::vector<std::string>>("input"), options->get<size_t>("max-size"));
 
   LOG(info, "Finished");
 
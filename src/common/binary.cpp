@@ -3,8 +3,13 @@
 #include "common/file_stream.h"
 #include "common/io_item.h"
 #include "common/types.h"
+#include "tensors/cpu/aligned.h"
 #include "tensors/cpu/integer_common.h"
 
+#include "3rd_party/mio/mio.hpp"
+
+#include <cstring>
+
 #include <string>
 
 namespace marian {
@@ -27,7 +32,9 @@ const T* get(const void*& current, size_t num = 1) {
   return ptr;
 }
 
-void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
+// Reads the index of the items, i.e. their headers, names, types and shapes, and returns the headers.
+// Moves current to the data of the first item.
+static const Header* loadIndex(const void*& current, std::vector<io::Item>& items, bool mapped) {
   size_t binaryFileVersion = *get<size_t>(current);
   ABORT_IF(binaryFileVersion != BINARY_FILE_VERSION,
            "Binary file versions do not match: {} (file) != {} (expected)",
@@ -56,37 +63,45 @@ void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
   // move by offset bytes, aligned to 256-bytes boundary
   size_t offset = *get<size_t>(current);
   get<char>(current, offset);
+  return headers;
+}
 
-  for(int i = 0; i < numHeaders; ++i) {
-    // For intgemm AVX512 and AVX512VNNI have the same arangement, but the VNNI algorithm is faster.
-    // Change the type to the fastest one supported.
-    if (items[i].type == Type::intgemm8avx512) {
-      items[i].type = cpu::integer::getIntgemmType(Type::intgemm8);
-    }
-    if(items[i].mapped) { // memory-mapped, hence only set pointer
-      // @TOOD: verify this actually works for the hardware-specific ones like intgemm8avx2
-      ABORT_IF(items[i].type == Type::intgemm8 || items[i].type == Type::intgemm16, "mmap format not supported for hardware non-specific intgemm matrices");
-      items[i].ptr = get<char>(current, headers[i].dataLength);
-    } else { // reading into item data
-      size_t len = headers[i].dataLength;
-      items[i].bytes.resize(len);
-      const char* ptr = get<char>(current, len);
-      // Intgemm8/16 matrices in binary model are just quantized, however they also need to be reordered
-      // Reordering depends on the architecture (SSE/AVX2/AVX512) so we read in the quantized matrices and
-      // then reorder them before adding them as a parameter in the graph.
-      if (matchType<intgemm8>(items[i].type)) {
-        items[i].type = cpu::integer::getIntgemmType(Type::intgemm8);
-        cpu::integer::prepareAndTransposeB<Type::intgemm8>(items[i], ptr);
-      } else if (matchType<intgemm16>(items[i].type)) {
-        items[i].type = cpu::integer::getIntgemmType(Type::intgemm16);
-        cpu::integer::prepareAndTransposeB<Type::intgemm16>(items[i], ptr);
-      } else {
-        std::copy(ptr, ptr + len, items[i].bytes.begin());
-      }
+// Sets or copies the data of the item at ptr, dataLength bytes
+static void loadData(io::Item& item, const char* ptr, size_t dataLength) {
+  // For intgemm AVX512 and AVX512VNNI have the same arangement, but the VNNI algorithm is faster.
+  // Change the type to VNNI if it is supported, which all CPUs with AMX do, whose layout differs.
+  if (item.type == Type::intgemm8avx512) {
+    Type fastest = cpu::integer::getIntgemmType(Type::intgemm8);
+    if(fastest == Type::intgemm8avx512vnni || fastest == Type::intgemm8amx)
+      item.type = Type::intgemm8avx512vnni;
+  }
+  if(item.mapped) { // memory-mapped, hence only set pointer
+    // @TOOD: verify this actually works for the hardware-specific ones like intgemm8avx2
+    ABORT_IF(item.type == Type::intgemm8 || item.type == Type::intgemm16, "mmap format not supported for hardware non-specific intgemm matrices");
+    item.ptr = ptr;
+  } else { // reading into item data
+    item.bytes.resize(dataLength);
+    // Intgemm8/16 matrices in binary model are just quantized, however they also need to be reordered
+    // Reordering depends on the architecture (SSE/AVX2/AVX512) so we read in the quantized matrices and
+    // then reorder them before adding them as a parameter in the graph.
+    if (matchType<intgemm8>(item.type)) {
+      item.type = cpu::integer::getIntgemmType(Type::intgemm8);
+      cpu::integer::prepareAndTransposeB<Type::intgemm8>(item, ptr);
+    } else if (matchType<intgemm16>(item.type)) {
+      item.type = cpu::integer::getIntgemmType(Type::intgemm16);
+      cpu::integer::prepareAndTransposeB<Type::intgemm16>(item, ptr);
+    } else {
+      std::copy(ptr, ptr + dataLength, item.bytes.begin());
     }
   }
 }
 
+void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
+  const Header* headers = loadIndex(current, items, mapped);
+  for(int i = 0; i < items.size(); ++i)
+    loadData(items[i], get<char>(current, headers[i].dataLength), headers[i].dataLength);
+}
+
 void loadItems(const std::string& fileName, std::vector<io::Item>& items) {
   // Read file into buffer
   size_t fileSize = filesystem::fileSize(fileName);
@@ -107,31 +122,42 @@ void loadItems(const std::string& fileName, std::vector<io::Item>& items) {
   loadItems(buf.data(), items, false);
 }
 
+// Only the data of the requested item is read and copied, the other items are skipped
 io::Item getItem(const void* current, const std::string& varName) {
   std::vector<io::Item> items;
-  loadItems(current, items);
+  const Header* headers = loadIndex(current, items, /*mapped=*/false);
 
-  for(auto& item : items)
-    if(item.name == varName)
-      return item;
+  for(int i = 0; i < items.size(); ++i) {
+    const char* ptr = get<char>(current, headers[i].dataLength);
+    if(items[i].name == varName) {
+      loadData(items[i], ptr, headers[i].dataLength);
+      return items[i];
+    }
+  }
 
   return io::Item();
 }
 
+// The file is memory-mapped, so reading e.g. the model config (special:model.yml) touches only the
+// pages of the index and of that item instead of reading the whole model
 io::Item getItem(const std::string& fileName, const std::string& varName) {
-  std::vector<io::Item> items;
-  loadItems(fileName, items);
-
-  for(auto& item : items)
-    if(item.name == varName)
-      return item;
-
-  return io::Item();
+  std::error_code error;
+  mio::mmap_source mmap;
+  mmap.map(fileName, error);
+  ABORT_IF(error, "Error {} ('{}') mapping file '{}'", error.value(), error.message(), fileName);
+  return getItem(mmap.data(), varName);
 }
 
-void saveItems(const std::string& fileName,
-               const std::vector<io::Item>& items) {
-  io::OutputFileStream out(fileName);
+// Writes items in the binary format with any writer providing OutputFileStream::write().
+// If alignItems is set, each item is padded to the 256-byte boundary, which is otherwise only
+// the case for items that already carry their padding.
+template <class Writer>
+static void writeItems(Writer& out, const std::vector<io::Item>& items, bool alignItems) {
+  auto dataLength = [alignItems](const io::Item& item) {
+    size_t len = item.mapped ? item.size() : item.bytes.size();
+    return alignItems ? (len + 255) / 256 * 256 : len;
+  };
+
   size_t pos = 0;
 
   size_t binaryFileVersion = BINARY_FILE_VERSION;
@@ -142,7 +168,7 @@ void saveItems(const std::string& fileName,
     headers.push_back(Header{item.name.size() + 1,
                              (size_t)item.type,
                              item.shape.size(),
-                             item.bytes.size()}); // binary item size with padding, will be 256-byte-aligned
+                             dataLength(item)}); // binary item size with padding, will be 256-byte-aligned
   }
 
   size_t headerSize = headers.size();
@@ -169,11 +195,54 @@ void saveItems(const std::string& fileName,
   }
 
   // Write out all values
-  for(const auto& item : items)
-    pos += out.write(item.data(), item.bytes.size()); // writes out data with padding, keeps 256-byte boundary. 
-                                                      // Amazingly this is binary-compatible with V1 and aligned and 
-                                                      // non-aligned models can be read with the same procedure.
-                                                      // No version-bump required. Gets 5-8% of speed back when mmapped.
+  for(const auto& item : items) {
+    size_t len = item.mapped ? item.size() : item.bytes.size();
+    pos += out.write(item.data(), len); // writes out data with padding, keeps 256-byte boundary. 
+                                        // Amazingly this is binary-compatible with V1 and aligned and 
+                                        // non-aligned models can be read with the same procedure.
+                                        // No version-bump required. Gets 5-8% of speed back when mmapped.
+    for(size_t i = len; i < dataLength(item); i++) {
+      char padding = 0;
+      pos += out.write(&padding);
+    }
+  }
+}
+
+void saveItems(const std::string& fileName,
+               const std::vector<io::Item>& items) {
+  io::OutputFileStream out(fileName);
+  writeItems(out, items, /*alignItems=*/false);
+}
+
+// Writer for MemoryImage, only counts the bytes if there is no buffer
+struct MemoryWriter {
+  char* current{nullptr};
+  size_t written{0};
+
+  template <typename T>
+  size_t write(const T* ptr, size_t num = 1) {
+    size_t bytes = num * sizeof(T);
+    if(current) {
+      std::memcpy(current + written, ptr, bytes);
+    }
+    written += bytes;
+    return bytes;
+  }
+};
+
+MemoryImage::MemoryImage(const std::vector<io::Item>& items) {
+  MemoryWriter counter;
+  writeItems(counter, items, /*alignItems=*/true);
+  size_ = counter.written;
+
+  data_ = (char*)cpu::genericMalloc(256, (size_ + 255) / 256 * 256);
+  MemoryWriter writer;
+  writer.current = data_;
+  writeItems(writer, items, /*alignItems=*/true);
+}
+
+MemoryImage::~MemoryImage() {
+  cpu::genericFree(data_);
 }
 
 }  // namespace binary
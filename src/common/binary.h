@@ -22,6 +22,23 @@ io::Item getItem(const std::string& fileName, const std::string& vName);
 
 void saveItems(const std::string& fileName, const std::vector<io::Item>& items);
 
+// Binary-format image of items in 256-byte aligned memory. It can be mapped read-only by any number of
+// graphs via ExpressionGraph::mmap(data()) exactly like a memory-mapped *.bin file, e.g. to share one
+// copy of the (possibly packed) model weights between all CPU worker threads.
+class MemoryImage {
+private:
+  char* data_{nullptr};
+  size_t size_{0};
+
+public:
+  MemoryImage(const std::vector<io::Item>& items);
+  MemoryImage(const MemoryImage&) = delete;
+  ~MemoryImage();
+
+  const void* data() const { return data_; }
+  size_t size() const { return size_; }
+};
+
 }  // namespace binary
 }  // namespace io
 }  // namespace marian
@@ -4,8 +4,12 @@
 #include "common/logging.h"
 #include "common/options.h"
 #include "common/regex.h"
+#include "common/tracer.h"
 #include "common/utils.h"
 #include "common/version.h"
+#include "graph/auto_tuner.h"
+#include "graph/op_profiler.h"
+#include "tensors/device.h"
 
 #include <algorithm>
 #include <set>
@@ -48,6 +52,34 @@ void Config::initialize(ConfigParser const& cp) {
     seed = get<size_t>("seed");
   }
 
+  // kernel tuning is process-wide, see graph/auto_tuner.h
+  if(has("autotune") && (get<bool>("autotune") || !get<std::string>("autotune-cache").empty()))
+    AutoTunerCache::instance().enable(get<std::string>("autotune-cache"));
+
+  // operator timing is process-wide and reported at exit, see graph/op_profiler.h
+  if(has("profile-ops") && get<bool>("profile-ops"))
+    OpProfiler::instance().enable();
+
+  // the timeline is process-wide and written at exit, see common/tracer.h
+  if(has("trace") && !get<std::string>("trace").empty())
+    tracing::Tracer::instance().enable(get<std::string>("trace"), get<size_t>("trace-max-events"), get<bool>("trace-sync"));
+
+  // the allocation of CPU memory is process-wide, see tensors/device.h
+  if(has("cpu-huge-pages") || has("cpu-numa-memory")) {
+    auto hugePages = has("cpu-huge-pages") ? get<std::string>("cpu-huge-pages") : "off";
+    ABORT_IF(hugePages != "off" && hugePages != "transparent" && hugePages != "explicit",
+             "Unknown value '{}' of --cpu-huge-pages, use off, transparent or explicit", hugePages);
+    cpu::setMemoryPolicy(hugePages == "explicit"      ? cpu::HugePages::hugetlb
+                         : hugePages == "transparent" ? cpu::HugePages::transparent
+                                                      : cpu::HugePages::off,
+                         has("cpu-numa-memory") && get<bool>("cpu-numa-memory"));
+  }
+
+#ifdef CUDA_FOUND
+  if(has("gpu-memory-pool"))
+    gpu::setMemoryPool(get<bool>("gpu-memory-pool"));
+#endif
+
   // load model parameters
   bool loaded = false;
   if(mode == cli::mode::translation || mode == cli::mode::server) {
@@ -72,11 +72,13 @@ std::string const& ConfigParser::cmdLine() const {
 ConfigParser::ConfigParser(cli::mode mode)
   : cli_(config_,"Marian: Fast Neural Machine Translation in C++",
          "General options", "", 40),
-    mode_(mode == cli::mode::server ? cli::mode::translation : mode) {
+    mode_(mode == cli::mode::server || mode == cli::mode::benchmark ? cli::mode::translation : mode) {
 
   addOptionsGeneral(cli_);
   if (mode == cli::mode::server)
     addOptionsServer(cli_);
+  if (mode == cli::mode::benchmark)
+    addOptionsBenchmark(cli_);
   addOptionsModel(cli_);
 
   // clang-format off
@@ -118,20 +120,56 @@ void ConfigParser::addOptionsGeneral(cli::CLIWrapper& cli) {
     ->implicit_val("basic");
   cli.add<std::vector<std::string>>("--config,-c",
     "Configuration file(s). If multiple, later overrides earlier");
-  cli.add<size_t>("--workspace,-w",
-    "Preallocate  arg  MB of work space",
-    defaultWorkspace);
+  if(mode_ == cli::mode::translation || mode_ == cli::mode::server) {
+    cli.add<std::string>("--workspace,-w",
+      "Preallocate  arg  MB of work space. With 'auto' a worst-case batch is decoded at startup, "
+      "see --workspace-probe-length, and the measured work space plus 10% is reserved",
+      std::to_string(defaultWorkspace));
+    cli.add<size_t>("--workspace-probe-length",
+      "Source length of the worst-case batch for --workspace auto, cropped to --max-length",
+      128);
+  } else {
+    cli.add<size_t>("--workspace,-w",
+      "Preallocate  arg  MB of work space",
+      defaultWorkspace);
+  }
+  cli.add<size_t>("--workspace-limit",
+      "Largest size in MB to which the work space of a decoding graph grows for batches that do not fit "
+      "into --workspace, 0 for no limit",
+      0);
+  cli.add<bool>("--gpu-memory-pool",
+      "Allocate the work spaces and parameters of all graphs on a GPU from its stream-ordered memory pool. "
+      "Decoding returns the memory a work space has grown by to the pool after each batch, so that "
+      "models on the same GPU share the memory they do not use. Requires CUDA 11.2");
   cli.add<std::string>("--log",
     "Log training process information to file given by  arg");
   cli.add<std::string>("--log-level",
     "Set verbosity level of logging: trace, debug, info, warn, err(or), critical, off",
     "info");
+  cli.add<size_t>("--log-async",
+    "Write log messages from a queue of this many messages on a background thread instead of on the "
+    "logging thread, 0 writes them right away. Messages are written out before aborting");
+  cli.add<std::string>("--log-async-overflow",
+    "What to do when the queue of --log-async is full: block until there is space or discard the message",
+    "block");
   cli.add<std::string>("--log-time-zone",
     "Set time zone for the date shown on logging");
   cli.add<bool>("--quiet",
     "Suppress all logging to stderr. Logging to files still works");
   cli.add<bool>("--quiet-translation",
     "Suppress logging for translation");
+  cli.add<bool>("--profile-ops",
+    "Time the forward and backward step of every graph node, waiting for the device around each, and log "
+    "a table of the time, estimated GFLOP/s, GB/s and arithmetic intensity per operator and shape at exit");
+  cli.add<std::string>("--trace",
+    "Record a timeline of the graph nodes by type, communicator calls, batch generation and validation "
+    "and write it as a Chrome trace JSON file  arg  at exit, for chrome://tracing or ui.perfetto.dev");
+  cli.add<size_t>("--trace-max-events",
+    "Stop recording the timeline of --trace after  arg  events",
+    1000000);
+  cli.add<bool>("--trace-sync",
+    "Wait for the device after each graph node with --trace, so that node events measure the kernel "
+    "execution instead of the launch. Slows down GPUs");
   cli.add<size_t>("--seed",
     "Seed for all random number generators. 0 means initialize randomly");
   cli.add<bool>("--interpolate-env-vars",
@@ -159,6 +197,55 @@ void ConfigParser::addOptionsServer(cli::CLIWrapper& cli) {
   cli.add<size_t>("--port,-p",
       "Port number for web socket server",
       8080);
+  cli.add<size_t>("--server-batch-wait-ms",
+      "Wait up to  arg  milliseconds for concurrent requests which are then translated together in shared "
+      "batches. 0 translates each request separately as soon as it arrives",
+      0);
+  cli.add<size_t>("--server-batch-words",
+      "Stop waiting for concurrent requests if they contain at least  arg  source words in total. "
+      "Use --mini-batch-words to control the size of the actual mini-batches",
+      0);
+  cli.add<size_t>("--metrics-port",
+      "Serve metrics of the requests, batches, phases, workspaces and translation cache in the Prometheus "
+      "text format over HTTP at /metrics on port  arg. 0 disables the metrics",
+      0);
+  cli.add<std::vector<std::string>>("--server-models",
+      "Host several models as NAME=CONFIG at /translate/NAME, each loaded when first requested. CONFIG is "
+      "a decoder configuration file giving at least the models and vocabularies, its options override "
+      "those of the server. Replaces --models and the /translate endpoint");
+  cli.add<size_t>("--server-memory-budget",
+      "With --server-models, release the least recently used models when the estimated memory of the "
+      "loaded models (model files per device and work spaces) would exceed  arg  MB. 0 is unlimited",
+      0);
+  cli.add<std::vector<std::string>>("--warmup",
+      "Decode synthetic batches of random words of these shapes SENTENCESxLENGTH, e.g. 1x16 32x64, on every "
+      "worker before accepting requests, so that the first requests do not pay for lazy initializations");
+  cli.switchGroup(previous_group);
+  // clang-format on
+}
+
+void ConfigParser::addOptionsBenchmark(cli::CLIWrapper& cli) {
+  // clang-format off
+  auto previous_group = cli.switchGroup("Benchmark options");
+  cli.add<std::vector<std::string>>("--bench-precisions",
+      "Precisions to benchmark, the models are loaded once for each",
+      {"float32"});
+  cli.add<std::vector<size_t>>("--bench-beam-sizes",
+      "Beam sizes to measure the decoding throughput with",
+      {1, 4});
+  cli.add<std::vector<size_t>>("--bench-mini-batches",
+      "Mini-batch sizes in sentences to measure the decoding throughput with",
+      {1, 16, 64});
+  cli.add<size_t>("--bench-sentences",
+      "Translate  arg  sentences from --input for each beam and mini-batch size, repeating the input if "
+      "it is shorter",
+      1000);
+  cli.add<size_t>("--bench-latency-sentences",
+      "Translate  arg  sentences one at a time to measure the latency of single sentences",
+      100);
+  cli.add<std::string>("--bench-output",
+      "Write the results as JSON to file  arg",
+      "stdout");
   cli.switchGroup(previous_group);
   // clang-format on
 }
@@ -275,6 +362,9 @@ void ConfigParser::addOptionsModel(cli::CLIWrapper& cli) {
       "self-attention");
   cli.add<std::vector<size_t>>("--transformer-tied-layers",
       "List of tied decoder layers (transformer)");
+  cli.add<std::vector<size_t>>("--transformer-early-exit-layers",
+      "List of decoder layers (1-based) after which the output layer is applied as well, for early exits "
+      "when decoding with --transformer-early-exit-threshold (transformer)");
   cli.add<std::string>("--transformer-guided-alignment-layer",
       "Last or number of layer to use for guided alignment training in transformer",
       "last");
@@ -293,6 +383,23 @@ void ConfigParser::addOptionsModel(cli::CLIWrapper& cli) {
       "Train positional embeddings instead of using static sinusoidal embeddings");
   cli.add<bool>("--transformer-depth-scaling",
       "Scale down weight initialization in transformer layers by 1 / sqrt(depth)");
+  cli.add<std::string>("--transformer-attention-precision",
+      "Precision of the products of queries and keys and of attention weights and values when "
+      "decoding on the CPU: float32, int8 (quantized at runtime with intgemm)",
+      "float32");
+  cli.add<bool>("--transformer-fused-attention",
+      "Compute attention in a single operator that never stores the attention weights, "
+      "not used with attention dropout, int8 attention or when alignments are returned");
+  cli.add<bool>("--transformer-fold-parameters",
+      "For inference, fold computations that only depend on parameters once into memoized weights: "
+      "the key and value projections of the same input become a single product on the concatenated weights");
+  cli.add<bool>("--transformer-packed-inference",
+      "Pack the sentences of a batch into fewer rows with block-diagonal attention masks for inference "
+      "with the transformer encoder, e.g. of classifiers, which avoids computation on padding");
+  cli.add<bool>("--transformer-packed-training",
+      "Pack the sentence pairs of a training batch into fewer rows, with attention masked to the words "
+      "of the same sentence and positions counted per sentence, which avoids computation on padding. "
+      "For --type transformer with self-attention in the decoder");
 
   cli.add<std::string>("--bert-mask-symbol", "Masking symbol for BERT masked-LM training", "[MASK]");
   cli.add<std::string>("--bert-sep-symbol", "Sentence separator symbol for BERT next sentence prediction training", "[SEP]");
@@ -391,11 +498,17 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
   cli.add<bool>("--disp-label-counts",
       "Display label counts when logging loss progress",
       true);
+  cli.add<bool>("--disp-time-breakdown",
+      "Display the time spent in the phases of the updates, the achieved TFLOPs and the peak workspace "
+      "when logging loss progress. Synchronizes the devices after each phase");
 //   cli.add<int>("--disp-label-index",
 //       "Display label counts based on i-th input stream (-1 is last)", -1);
   cli.add<std::string/*SchedulerPeriod*/>("--save-freq",
       "Save model file every  arg  updates (append 't' for every  arg  target labels)",
       "10000u");
+  cli.add<bool>("--async-save",
+      "With --sync-sgd, copy checkpoints to CPU memory and write them on a background thread while "
+      "training continues. The files of a checkpoint are replaced together once all are written");
   cli.add<std::vector<std::string>>("--logical-epoch",
       "Redefine logical epoch counter as multiple of data epochs (e.g. 1e), updates (e.g. 100Ku) or labels (e.g. 1Gt). "
       "Second parameter defines width of fractional display, 0 by default.",
@@ -433,6 +546,17 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
   cli.add<std::vector<float>>("--optimizer-params",
      "Parameters for optimization algorithm, e.g. betas for Adam. "
      "Auto-adjusted to --mini-batch-words-ref if given");
+  cli.add<std::string>("--optimizer-state-precision",
+     "Element type of the Adam moments: float32, float16, bfloat16. "
+     "They are computed in float32 and saved as float32 in checkpoints",
+     "float32");
+  cli.add<bool>("--optimizer-lazy",
+     "Lazy Adam: only update parameters with a non-zero gradient and their moments, "
+     "e.g. only the embeddings of the words in the batch");
+  cli.add<size_t>("--optimizer-offload",
+     "Keep the Adam moments of GPU training in host memory and update the parameters on the CPU "
+     "with arg threads per GPU, overlapped with the copies of the gradients and parameters. 0 disables",
+     0);
   cli.add<float>("--optimizer-delay",
      "SGD update delay (#batches between updates). 1 = no delay. "
      "Can be fractional, e.g. 0.1 to use only 10% of each batch",
@@ -440,6 +564,36 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
 
   cli.add<bool>("--sync-sgd",
      "Use synchronous SGD instead of asynchronous for multi-gpu training");
+  cli.add<size_t>("--pipeline-parallel",
+     "Train the encoders on the first and the decoder on the second of two devices, which only hold the "
+     "parameters and optimizer state of their own part, and split each batch into arg micro-batches whose "
+     "encoder and decoder passes overlap. 0 disables",
+     0);
+  cli.add<bool>("--elastic",
+     "Synchronous training: allow resuming a checkpoint on fewer or more devices or MPI processes, e.g. after "
+     "preemptible nodes were lost. --optimizer-delay is rescaled so that updates keep the batch size of the "
+     "first run, whose number of devices is recorded in the training progress");
+  cli.add<bool>("--sharded-optimizer-state",
+     "Synchronous training: every MPI process saves the optimizer state of its own devices into a memory-"
+     "mappable file model.npz.optimizer.RANK-of-PROCESSES.bin at the same time, instead of gathering it on "
+     "the main process. Resuming such a checkpoint needs the same number of devices and processes");
+  cli.add<size_t>("--local-sgd-steps",
+     "Synchronous training with several MPI processes: every process updates its own model with the "
+     "gradients of its devices, and the models are averaged across processes every arg updates (local SGD). "
+     "1 reduces the gradients of all processes in every update",
+     1);
+  cli.add<float>("--local-sgd-momentum",
+     "With --local-sgd-steps, move the models towards each average with this outer momentum, 0 for plain averaging",
+     0.f);
+  cli.add<bool>("--local-sgd-average-optimizer",
+     "With --local-sgd-steps, also average the optimizer state across processes");
+  cli.add<bool>("--cpu-pin-threads",
+     "Synchronous training on the CPU: pin the thread of each graph (see --cpu-threads) to its own core, "
+     "spreading the graphs over the NUMA nodes. Linux only");
+  cli.add<size_t>("--async-max-staleness",
+     "Asynchronous training: drop the gradients for a shard of the parameters that was updated more than "
+     "this many times since they were fetched. 0 for no bound",
+     0);
 
   // learning rate options
   cli.add<float>("--learn-rate,-l",
@@ -483,6 +637,21 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
      "Epsilon for label smoothing (0 to disable)");
   cli.add<double>("--factor-weight",
      "Weight for loss function for factors (factored vocab only) (1 to disable)", 1.0f);
+  cli.add<int>("--output-loss-chunk",
+     "Compute the output layer and its cross-entropy for this many target labels at a time, so that the "
+     "logits of the whole batch are never held in memory. Costs one more output-layer product in the "
+     "backward pass. 0 to disable",
+     0);
+  cli.add<int>("--output-loss-vocab-chunk",
+     "Compute the output layer and its cross-entropy for this many words of the vocabulary at a time, "
+     "accumulating the softmax over them, so that only --output-loss-chunk labels x this many logits exist "
+     "at once. Costs one more output-layer product in the backward pass. 0 to disable",
+     0);
+  cli.add<int>("--output-sampled-softmax",
+     "Train the output layer with a sampled softmax over the target words of the batch and this many words "
+     "drawn from a log-uniform distribution, which assumes a vocabulary sorted by frequency. Validation and "
+     "translation use the full softmax. 0 to disable",
+     0);
   cli.add<float>("--clip-norm",
      "Clip gradient norm to  arg  (0 to disable)",
      1.f); // @TODO: this is currently wrong with ce-sum and should rather be disabled or fixed by multiplying with labels
@@ -490,6 +659,13 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
      "Maintain smoothed version of parameters for validation and saving with smoothing factor. 0 to disable. "
       "Auto-adjusted to --mini-batch-words-ref if given.",
      0.f)->implicit_val("1e-4");
+  cli.add<size_t>("--exponential-smoothing-interval",
+     "Update the smoothed parameters only every  arg  updates, with the decay of all of them, "
+     "which saves a pass over the parameters on the other updates",
+     1);
+  cli.add<bool>("--exponential-smoothing-on-cpu",
+     "Keep the smoothed parameters in CPU memory and average them there in the background, "
+     "which saves their device memory. Only with synchronous training (--sync-sgd)");
   cli.add<std::string>("--guided-alignment",
      "Path to a file with word alignments. Use guided alignment to guide attention or 'none'. "
      "If --tsv it specifies the index of a TSV field that contains the alignments (0-based)",
@@ -500,6 +676,9 @@ void ConfigParser::addOptionsTraining(cli::CLIWrapper& cli) {
   cli.add<double>("--guided-alignment-weight",
      "Weight for guided alignment cost",
      0.1);
+  cli.add<float>("--transformer-early-exit-weight",
+     "Weight for the cross-entropy costs of the output layer applied to --transformer-early-exit-layers",
+     1.f);
   cli.add<std::string>("--data-weighting",
      "Path to a file with sentence or word weights. "
      "If --tsv it specifies the index of a TSV field that contains the weights (0-based)");
@@ -570,6 +749,11 @@ void ConfigParser::addOptionsValidation(cli::CLIWrapper& cli) {
       "translation, bleu, bleu-detok (deprecated, same as bleu), bleu-segmented, chrf. "
       "Multiple metrics can be specified",
       {"cross-entropy"});
+  cli.add<std::string>("--valid-tokenize",
+      "Tokenization of translations and references for the bleu and chrf metrics: auto (13a for "
+      "SentencePiece and factored vocabularies, the vocabulary segments otherwise), 13a, none (split "
+      "the detokenized text on whitespace)",
+      "auto");
   cli.add<bool>("--valid-reset-stalled",
      "Reset all stalled validation metrics when the training is restarted");
   cli.add<size_t>("--early-stopping",
@@ -603,6 +787,11 @@ void ConfigParser::addOptionsValidation(cli::CLIWrapper& cli) {
       "Maximum length of a sentence in a validating sentence pair. "
       "Sentences longer than valid-max-length are cropped to valid-max-length",
       1000);
+  cli.add<bool>("--valid-async",
+      "Validate a copy of the parameters in the background while training continues. The results are "
+      "reported, and count for early stopping, once the validation has finished");
+  cli.add<std::vector<size_t>>("--valid-devices",
+      "Devices for --valid-async, e.g. a GPU not used for training. Default: the first training device");
 
   // options for validation script
   cli.add<std::string>("--valid-script-path",
@@ -636,6 +825,27 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
   cli.add<std::string>("--output,-o",
       "Path to output file, stdout by default",
       "stdout");
+  cli.add<bool>("--output-unordered",
+      "Write translations as soon as they are finished, prefixed by the line number and a tab, "
+      "instead of in the order of the input");
+  cli.add<size_t>("--output-buffer",
+      "Stop reading input while more than  arg  translations are waiting for earlier lines to be "
+      "written. 0 means unlimited");
+  if(mode_ == cli::mode::translation) {
+    cli.add<size_t>("--output-threads",
+        "Number of threads that format the translations, including their detokenization, while the "
+        "translation workers go on with the next batches. 0 formats them on the translation workers",
+        0);
+    cli.add<size_t>("--input-idle-flush",
+        "When reading from stdin, translate the lines read so far as soon as no new line arrives for  arg  "
+        "milliseconds, instead of waiting for full maxi-batches. 0 disables this",
+        0);
+    cli.add<bool>("--mpi-split",
+        "Split the input over the MPI processes, each translating every N-th line of the --input files. "
+        "The first process writes all translations in order");
+    cli.add<bool>("--mpi-output-shards",
+        "With --mpi-split, every process writes its translations to --output with the suffix .RANK instead");
+  }
   cli.add<std::vector<std::string>>("--vocabs,-v",
       "Paths to vocabulary files have to correspond to --input");
   // decoding options
@@ -648,17 +858,44 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
   cli.add<float>("--max-length-factor",
       "Maximum target length as source length times factor",
       3);
+  cli.add<bool>("--max-length-per-sentence",
+      "Apply --max-length-factor to the length of each source sentence instead of the longest sentence in "
+      "the batch and purge sentences from the batch as soon as they reach their limit");
+  cli.add<bool>("--beam-early-stop",
+      "Finish a sentence as soon as none of its active hypotheses can reach the score of its best finished "
+      "translation. Exact for the best translation with --normalize and --word-penalty of at least 0, "
+      "ignored otherwise and with --n-best");
+  cli.add<float>("--beam-threshold",
+      "Drop active hypotheses whose path score is more than arg below the best hypothesis of their "
+      "sentence in the same step, which shrinks the beam. 0 to disable",
+      0.f);
+  cli.add<size_t>("--device-search-sync",
+      "With beam size 1, keep the best words, path scores and finished flags on the device and check "
+      "for finished sentences only every  arg  steps instead of copying the best words to the host "
+      "after every step. 0 to disable",
+      0);
+  cli.add<float>("--transformer-early-exit-threshold",
+      "Skip the remaining decoder layers after one of --transformer-early-exit-layers if the most probable "
+      "word of every hypothesis has at least this probability, 0 to always compute all layers",
+      0.f);
   cli.add<float>("--word-penalty",
       "Subtract (arg * translation length) from translation score");
   cli.add<bool>("--allow-unk",
       "Allow unknown words to appear in output");
   cli.add<bool>("--n-best",
       "Generate n-best list");
+  cli.add<std::string>("--n-best-format",
+      "Format of n-best lists: text, binary (token ids and scores, readable by marian-scorer --n-best)",
+      "text");
   cli.add<std::string>("--alignment",
      "Return word alignment. Possible values: 0.0-1.0, hard, soft")
     ->implicit_val("1");
   cli.add<bool>("--word-scores",
       "Print word-level scores. One score per subword unit, not normalized even if --normalize");
+  cli.add<std::string>("--decoder-profile",
+      "Collect timing histograms of the beam search phases and log them at exit, or write them as "
+      "JSON to file  arg. Requires compiling with -DCOMPILE_DECODER_PROFILING=on")
+    ->implicit_val("log");
 #ifdef USE_SENTENCEPIECE
   cli.add<bool>("--no-spm-decode",
       "Keep the output segmented into SentencePiece subwords");
@@ -676,17 +913,56 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
       {"float32"});
   cli.add<bool>("--skip-cost",
     "Ignore model cost during translation, not recommended for beam-size > 1");
+  cli.add<bool>("--fused-softmax-topk",
+    "Fuse the output log-softmax into the beam search on the CPU, so that normalized scores are never "
+    "computed for the whole vocabulary. Only used for a single model without --n-best");
+  cli.add<std::string>("--quantize-statistics",
+    "Collect the largest absolute values of the activations multiplied with the parameters of intgemm8 "
+    "models on the CPU and write them to file  arg  when done, for calibrating a model with "
+    "marian-conv --quantize-statistics");
 
   cli.add<std::vector<std::string>>("--shortlist",
-     "Use softmax shortlist: path first best prune");
+     "Use softmax shortlist: path first best prune [dump]. "
+     "A dump path ending in .bin creates a binary shortlist, which is memory-mapped when given as path");
+  cli.add<size_t>("--shortlist-cache",
+     "Keep the output parameters selected by the shortlists of the last  arg  distinct shortlists, so that "
+     "batches with a recent shortlist do not gather them again",
+     0);
   cli.add<std::vector<float>>("--weights",
       "Scorer weights");
+  cli.add<bool>("--parallel-ensemble",
+      "Place each model of an ensemble on its own device (or CPU thread) and step the models "
+      "concurrently. The number of devices must be a multiple of the number of models");
+  cli.add<size_t>("--speculative-tokens",
+      "With beam size 1, the last model of --models drafts up to arg tokens greedily, "
+      "which the other models verify in one decoder step. The output is that of the other models alone",
+      0);
   cli.add<bool>("--output-sampling",
      "Noise output layer with gumbel noise",
       false);
+  cli.add<float>("--output-sampling-temperature",
+     "Divide the logits by  arg  before sampling with --output-sampling, lower values are closer to greedy decoding",
+      1.f);
+  cli.add<size_t>("--output-sampling-topk",
+     "Sample with --output-sampling only from the  arg  best words, 0 for all. Requires a beam size of 1",
+      0);
+  cli.add<float>("--output-sampling-nucleus",
+     "Sample with --output-sampling only from the smallest set of best words whose probability adds up to  arg  "
+     "(nucleus sampling), 1 for all. Requires a beam size of 1",
+      1.f);
   cli.add<std::vector<int>>("--output-approx-knn",
      "Use approximate knn search in output layer (currently only in transformer)")
      ->implicit_val("100 1024");
+  cli.add<std::string>("--output-approx-knn-index",
+     "Load the LSH index for --output-approx-knn from this file, or build it and save it there if "
+     "the file does not exist or was built for different output embeddings");
+  cli.add<size_t>("--translation-cache",
+     "Cache translations of up to  arg  MB of source sentences in memory and reuse them for repeated "
+     "inputs. 0 disables the cache",
+     0);
+  cli.add<size_t>("--translation-cache-shards",
+     "Number of independently locked shards of the translation cache",
+     8);
 
 #if 0 // @TODO: Ask Hany if there are any decoding-time options
   // add ULR settings
@@ -717,6 +993,10 @@ void ConfigParser::addOptionsScoring(cli::CLIWrapper& cli) {
       "Score n-best list instead of plain text corpus");
   cli.add<std::string>("--n-best-feature",
       "Feature name to be inserted into n-best list", "Score");
+  cli.add<std::string>("--n-best-format",
+      "Format of the n-best list, text or binary as written by marian-decoder --n-best-format binary. "
+      "Scores of binary n-best lists are appended to the score breakdown and written in the same format",
+      "text");
   cli.add<bool>("--normalize,-n",
       "Divide translation score by translation length");
   cli.add<std::string>("--summary",
@@ -727,6 +1007,10 @@ void ConfigParser::addOptionsScoring(cli::CLIWrapper& cli) {
      ->implicit_val("1"),
   cli.add<bool>("--word-scores",
       "Print word-level scores. One score per subword unit, not normalized even if --normalize");
+  cli.add<bool>("--skip-softmax",
+      "Report sums of the raw output logits of the target words instead of log probabilities. Skips the "
+      "softmax normalization over the vocabulary, hence only useful if relative scores suffice, e.g. for "
+      "self-normalized models");
 
   addSuboptionsInputLength(cli);
   addSuboptionsTSV(cli);
@@ -764,6 +1048,13 @@ void ConfigParser::addOptionsEmbedding(cli::CLIWrapper& cli) {
       "Expect two inputs and compute cosine similarity instead of outputting embedding vector");
   cli.add<bool>("--binary",
       "Output vectors as binary floats");
+  cli.add<std::string>("--output-format",
+      "Format of the output vectors: text, binary (raw matrix of --output-precision values, same as --binary) "
+      "or npy (a NumPy array with shape sentences x dimension, e.g. for memory-mapping; needs an uncompressed output file)",
+      "text");
+  cli.add<std::string>("--output-precision",
+      "Precision of binary and npy output vectors: float32 or float16",
+      "float32");
 
   addSuboptionsInputLength(cli);
   addSuboptionsTSV(cli);
@@ -788,9 +1079,27 @@ void ConfigParser::addSuboptionsDevices(cli::CLIWrapper& cli) {
   cli.add<size_t>("--num-devices",
       "Number of GPUs to use for this process. Defaults to length(devices) or 1");
 #ifdef USE_NCCL
-  if(mode_ == cli::mode::training)
+  if(mode_ == cli::mode::training) {
     cli.add<bool>("--no-nccl",
       "Disable inter-GPU communication via NCCL");
+    cli.add<bool>("--overlap-gradient-reduction",
+      "With --sync-sgd, reduce the gradients of the last layers via NCCL while the backward pass "
+      "of the first layers is still running");
+    cli.add<size_t>("--gradient-bucket-mb",
+      "Size of the buckets of gradients that --overlap-gradient-reduction reduces at once, in MB",
+      25);
+    cli.add<bool>("--nccl-hierarchical",
+      "With several MPI processes, reduce gradients among the GPUs of each process first and then "
+      "across processes on shards, and gather parameters the opposite way; logs the time of each phase");
+    cli.add<std::string>("--gradient-compression",
+      "Send gradients via NCCL compressed to: none, fp16, 8bit, 4bit, or topk to send only the largest "
+      "gradients as indices and values (gradient dropping). What the compression loses is "
+      "added to the gradients of the next update (error feedback)",
+      "none");
+    cli.add<float>("--gradient-dropping-rate",
+      "With --gradient-compression topk, the fraction of the gradients of each GPU that is not sent",
+      0.99f);
+  }
 #endif
 #ifdef CUDA_FOUND
   cli.add<size_t>("--cpu-threads",
@@ -802,6 +1111,66 @@ void ConfigParser::addSuboptionsDevices(cli::CLIWrapper& cli) {
       "Use CPU-based computation with this many independent threads, 0 means GPU-based computation",
       1);
 #endif
+  cli.add<std::string>("--cpu-huge-pages",
+      "Back the workspaces and parameters of CPU graphs with huge pages: off, transparent, or explicit "
+      "for huge pages reserved by the system, falling back to transparent ones. Linux only",
+      "off")
+    ->implicit_val("transparent");
+  cli.add<bool>("--cpu-numa-memory",
+      "Bind the workspaces and parameters of each CPU graph to the NUMA node of the thread that uses it, "
+      "for decoding the node of its worker with --cpu-pin-threads. Linux only");
+  if(mode_ == cli::mode::translation || mode_ == cli::mode::server) {
+    cli.add<bool>("--cpu-shared-weights",
+        "Load each model only once and share its (possibly packed) weights read-only between all "
+        "CPU threads, only the workspaces are per thread");
+    cli.add<bool>("--cpu-mmap-weights",
+        "Memory-map binary models (.bin) read-only and share them between all CPU threads instead of "
+        "loading them, so that their pages are read when used and can be dropped again by the system");
+    cli.add<std::vector<std::string>>("--output-vocab-subset",
+        "Restrict the target vocabulary to the words in these files, lists of tokens or text in the target "
+        "languages, and trim the output layer and target embeddings to them when loading the models");
+    cli.add<bool>("--cpu-float16-weights",
+        "Store the float32 weight matrices of CPU graphs as float16, halving their memory, and convert them "
+        "back in panels within the matrix products. Not applied to weights shared with --cpu-shared-weights "
+        "or --cpu-mmap-weights");
+    cli.add<bool>("--cpu-pin-threads",
+        "Pin the thread of each CPU graph (see --cpu-threads) to its own core, spreading the graphs over "
+        "the NUMA nodes. Linux only");
+    cli.add<bool>("--share-parameters",
+        "Hold identical parameters of models loaded in the same process, e.g. common encoders or "
+        "embeddings, only once per device");
+    cli.add<bool>("--offload-parameters",
+        "Keep the parameters of GPU graphs in host memory and stream them to the GPU layer by layer, "
+        "prefetching the next layer during the computation of the current one, for models that do not "
+        "fit into GPU memory");
+    cli.add<size_t>("--cpu-threads-per-graph",
+        "Split single operations of each CPU graph (matrix products, softmax, layer normalization, "
+        "element-wise operations) across this many threads; --cpu-threads sets the number of graphs",
+        1);
+    if(mode_ == cli::mode::translation) {
+      cli.add<size_t>("--hybrid-cpu-threads",
+          "Decode on this many CPU threads in addition to the GPUs of --devices, which take batches from "
+          "the same input. The CPU threads use float32 graphs and require models that run on the CPU",
+          0);
+      cli.add<size_t>("--hybrid-cpu-mini-batch",
+          "With --hybrid-cpu-threads, split the batches given to the CPU threads into batches of at most "
+          "this many sentences",
+          8);
+      cli.add<size_t>("--hybrid-cpu-max-length",
+          "With --hybrid-cpu-threads, only give batches whose longest source sentence has at most this "
+          "many tokens to the CPU threads, 0 for any length",
+          0);
+    }
+    cli.add<bool>("--plan-memory",
+        "Place the intermediate results of each decoding step at offsets planned from their lifetimes, "
+        "cached per step shape, instead of allocating them one by one");
+    cli.add<bool>("--fuse-elementwise",
+        "Compute chains of element-wise operations in single passes over memory when decoding on the CPU");
+  }
+  cli.add<bool>("--autotune",
+      "Time alternative kernels of some operations during their first calls per shape and use the fastest");
+  cli.add<std::string>("--autotune-cache",
+      "Load kernel choices of --autotune from this file and append new ones to it, implies --autotune");
   // clang-format on
 }
 
@@ -828,8 +1197,16 @@ void ConfigParser::addSuboptionsBatching(cli::CLIWrapper& cli) {
     cli.add<size_t>("--mini-batch-fit-step",
       "Step size for mini-batch-fit statistics",
       10);
+    cli.add<std::string>("--mini-batch-fit-cache",
+      "Directory in which mini-batch-fit statistics are cached and reused by later runs with the same "
+      "options; the directory of --model if empty, 'none' to disable");
     cli.add<bool>("--gradient-checkpointing",
       "Enable gradient-checkpointing to minimize memory usage");
+    cli.add<size_t>("--gradient-checkpointing-budget",
+      "With --gradient-checkpointing, keep up to this many MB of outputs per device that would be recomputed, "
+      "those that take the longest to recompute per byte as measured in the first backward passes. "
+      "0 keeps only the manual checkpoints",
+      0);
   }
 
   cli.add<int>("--maxi-batch",
@@ -838,10 +1215,57 @@ void ConfigParser::addSuboptionsBatching(cli::CLIWrapper& cli) {
   cli.add<std::string>("--maxi-batch-sort",
       "Sorting strategy for maxi-batch: none, src, trg (not available for decoder)",
       defaultMaxiBatchSort);
+  cli.add<size_t>("--data-threads",
+      "Number of threads for splitting and encoding the input text into word ids. The order of the "
+      "sentences does not depend on the number of threads",
+      1);
+  cli.add<size_t>("--data-chunk-size",
+      "Number of lines encoded as one unit of work by the data threads",
+      1000);
+  cli.add<size_t>("--data-queue-size",
+      "Maximum number of chunks read ahead for the data threads, 0 for twice the number of threads",
+      0);
+  cli.add<size_t>("--data-decompress-threads",
+      "Number of threads for decompressing each input file. BGZF files (created with bgzip) are "
+      "decompressed block-parallel, other .gz and .zst files on a background thread",
+      1);
+  cli.add<size_t>("--data-prefetch",
+      "Number of maxi-batches read, sorted and batched ahead in the background. Training logs show "
+      "how often and how long the training waited for data",
+      1);
+  if(mode_ == cli::mode::translation) {
+    cli.add<size_t>("--length-bucket-width",
+        "Group sentences of a maxi-batch into source length buckets of arg words and cut mini-batches "
+        "from each bucket separately, --mini-batch-words then counts padded words. Overrides --maxi-batch-sort. "
+        "0 to disable",
+        0);
+  }
 
   if(mode_ == cli::mode::training) {
     cli.add<bool>("--shuffle-in-ram",
         "Keep shuffled corpus in RAM, do not write to temp file");
+    cli.add<size_t>("--shuffle-buckets",
+        "Shuffle the corpus out of core: distribute sentences randomly over  arg  temporary files and read "
+        "them back one at a time, shuffled in RAM. Bounds memory by the size of a bucket. 0 reads the whole corpus "
+        "into RAM for shuffling",
+        0);
+    cli.add<std::string>("--binary-corpus",
+        "Read the training data from this pre-tokenized, memory-mapped binary corpus. It is created "
+        "from --train-sets with the given vocabularies if it does not exist. Shuffling only permutes "
+        "sentence indices then");
+    cli.add<std::vector<std::string>>("--mix-corpora",
+        "Mix these corpora into the training data of --train-sets while streaming, without concatenating "
+        "or shuffling them. Each is a comma-separated list of files, one per stream of --train-sets, "
+        "e.g. 'corpus.de,corpus.en'");
+    cli.add<std::vector<float>>("--mix-weights",
+        "Sampling weights of --train-sets followed by those of --mix-corpora, all 1 by default");
+    cli.add<float>("--mix-temperature",
+        "Sample from corpus i with probability proportional to weight_i^(1/arg), larger values flatten the mix",
+        1.f);
+    cli.add<size_t>("--mix-shuffle-buffer",
+        "Shuffle each mixed corpus with a buffer of  arg  sentences of its own instead of shuffling the files. "
+        "0 reads each one in order",
+        10000);
     // @TODO: Consider making the next two options options of the vocab instead, to make it more local in scope.
     cli.add<size_t>("--all-caps-every",
         "When forming minibatches, preprocess every Nth line on the fly to all-caps. Assumes UTF-8");
@@ -857,6 +1281,14 @@ void ConfigParser::addSuboptionsBatching(cli::CLIWrapper& cli) {
         {"0"});
     cli.add<bool>("--mini-batch-track-lr",
         "Dynamically track mini-batch size inverse to actual learning rate (not considering lr-warmup)");
+    cli.add<size_t>("--length-curriculum",
+        "Short-first curriculum over the first  arg  batches of the first epoch: the batches of each maxi-batch "
+        "are sorted by length, and the shortest fraction sqrt(t (1 - c^2) / arg + c^2) of them after t batches, "
+        "with c from --length-curriculum-start, is shuffled and trained on first. 0 to disable",
+        0);
+    cli.add<float>("--length-curriculum-start",
+        "Fraction of the shortest batches of a maxi-batch trained on first at the start of --length-curriculum",
+        0.1f);
   }
   // clang-format on
 }
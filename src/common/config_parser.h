@@ -14,7 +14,7 @@
 namespace marian {
 
 namespace cli {
-enum struct mode { training, translation, scoring, server, embedding };
+enum struct mode { training, translation, scoring, server, embedding, benchmark };
 }  // namespace cli
 
 /**
@@ -124,6 +124,7 @@ private:
 
   void addOptionsGeneral(cli::CLIWrapper&);
   void addOptionsServer(cli::CLIWrapper&);
+  void addOptionsBenchmark(cli::CLIWrapper&);
   void addOptionsModel(cli::CLIWrapper&);
   void addOptionsTraining(cli::CLIWrapper&);
   void addOptionsValidation(cli::CLIWrapper&);
@@ -46,6 +46,10 @@ void ConfigValidator::validateOptions(cli::mode mode) const {
 }
 
 void ConfigValidator::validateOptionsTranslation() const {
+  // marian-server checks the models and vocabularies of each configuration of --server-models
+  if(has("server-models") && !get<std::vector<std::string>>("server-models").empty())
+    return;
+
   auto models = get<std::vector<std::string>>("models");
   auto configs = get<std::vector<std::string>>("config");
 
@@ -64,6 +68,18 @@ void ConfigValidator::validateOptionsTranslation() const {
     filesystem::Path vocabPath(vocabFile);
     ABORT_IF(!filesystem::exists(vocabPath), "Vocabulary file does not exist: " + vocabFile);
   }
+
+  auto nbestFormat = has("n-best-format") ? get<std::string>("n-best-format") : "text";
+  ABORT_IF(nbestFormat != "text" && nbestFormat != "binary",
+           "Unknown n-best list format '{}', use text or binary",
+           nbestFormat);
+
+  if(has("speculative-tokens") && get<size_t>("speculative-tokens") > 0) {
+    ABORT_IF(models.size() < 2,
+             "--speculative-tokens needs at least two models, the last of which is the draft model");
+    ABORT_IF(has("parallel-ensemble") && get<bool>("parallel-ensemble"),
+             "--speculative-tokens cannot be combined with --parallel-ensemble");
+  }
 }
 
 void ConfigValidator::validateOptionsParallelData() const {
@@ -101,6 +117,11 @@ void ConfigValidator::validateOptionsScoring() const {
     filesystem::Path vocabPath(vocabFile);
     ABORT_IF(!filesystem::exists(vocabPath), "Vocabulary file does not exist: " + vocabFile);
   }
+
+  auto nbestFormat = has("n-best-format") ? get<std::string>("n-best-format") : "text";
+  ABORT_IF(nbestFormat != "text" && nbestFormat != "binary",
+           "Unknown n-best list format '{}', use text or binary",
+           nbestFormat);
 }
 
 void ConfigValidator::validateOptionsTraining() const {
@@ -153,6 +174,9 @@ void ConfigValidator::validateOptionsTraining() const {
   ABORT_IF(bits > 32, "Invalid quantization bits. Must be from 0 to 32 bits");
 
   ABORT_IF(bits > 0 && !get<bool>("sync-sgd"), "Model quantization only works with synchronous training (--sync-sgd)");
+  ABORT_IF(get<bool>("elastic") && !get<bool>("sync-sgd"), "Elastic training only works with synchronous training (--sync-sgd)");
+  ABORT_IF(get<bool>("exponential-smoothing-on-cpu") && !get<bool>("sync-sgd"),
+           "Exponential smoothing in CPU memory only works with synchronous training (--sync-sgd)");
 }
 
 void ConfigValidator::validateModelExtension(cli::mode mode) const {
@@ -33,6 +33,15 @@ inline constexpr uint64_t crc(const char* const str) noexcept {
   return hash_64_fnv1a_const(str);
 }
 
+// Run-time hashing of a string of given length, e.g. a token inside a line. Same as crc(str) for
+// strings without '\0' characters.
+inline uint64_t crc(const char* const str, size_t length) noexcept {
+  uint64_t value = val_64_const;
+  for(size_t i = 0; i < length; ++i)
+    value = (value ^ uint64_t(str[i])) * prime_64_const;
+  return value;
+}
+
 }
 
 /*****************************************************************************/
@@ -1,10 +1,17 @@
 #include "common/file_stream.h"
 #include "common/utils.h"
+#include "3rd_party/threadpool.h"
 
+#include <atomic>
+#include <deque>
 #include <streambuf>
 #include <string>
 #include <vector>
 #include <cstdio>
+#include <zlib.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 #ifdef _MSC_VER
 #include <io.h>
 #include <windows.h>
@@ -19,7 +26,208 @@ namespace marian {
 namespace io {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
-InputFileStream::InputFileStream(const std::string &file)
+// Input buffer that serves blocks of data produced asynchronously, in the order they were requested.
+// Derived classes request the next block by adding a future to blocks_; empty blocks are skipped.
+class AsyncBlockStreamBuf : public std::streambuf {
+protected:
+  std::deque<std::future<std::vector<char>>> blocks_;
+  size_t depth_; // number of blocks requested ahead of the consumer
+
+  // adds the future of the next block to blocks_, returns false at the end of the input
+  virtual bool requestBlock() = 0;
+
+  int_type underflow() override {
+    while(gptr() == egptr()) {
+      while(blocks_.size() < depth_ && requestBlock())
+        ;
+      if(blocks_.empty())
+        return traits_type::eof();
+      current_ = blocks_.front().get();
+      blocks_.pop_front();
+      setg(current_.data(), current_.data(), current_.data() + current_.size());
+    }
+    return traits_type::to_int_type(*gptr());
+  }
+
+public:
+  AsyncBlockStreamBuf(size_t depth) : depth_(depth) {}
+
+private:
+  std::vector<char> current_;
+};
+
+// Reads a source buffer, e.g. a gzip decompressor, on a background thread while the consumer
+// processes the previous blocks, so that decompression and parsing run in parallel.
+class ReadAheadStreamBuf : public AsyncBlockStreamBuf {
+private:
+  std::streambuf* source_;
+  size_t blockSize_;
+  std::atomic<bool> sourceEnded_{false};
+  ThreadPool pool_{1}; // a single thread reads the blocks in order; destroyed first
+
+  bool requestBlock() override {
+    if(sourceEnded_)
+      return false;
+    blocks_.push_back(pool_.enqueue([this]() {
+      std::vector<char> block(blockSize_);
+      block.resize((size_t)source_->sgetn(block.data(), block.size()));
+      if(block.empty())
+        sourceEnded_ = true;
+      return block;
+    }));
+    return true;
+  }
+
+public:
+  ReadAheadStreamBuf(std::streambuf* source, size_t blockSize, size_t depth)
+      : AsyncBlockStreamBuf(depth), source_(source), blockSize_(blockSize) {}
+};
+
+// Decompresses BGZF files, i.e. gzip files made of independent members of at most 64 KB as
+// written by bgzip, on several threads. The members are read in order and inflated on a pool.
+class BgzfStreamBuf : public AsyncBlockStreamBuf {
+private:
+  static const size_t HEADER_SIZE = 12; // gzip header up to and including XLEN
+  static const size_t FOOTER_SIZE = 8;  // CRC32 and ISIZE
+
+  std::streambuf* source_;
+  std::string fileName_;
+  ThreadPool pool_;
+
+  static uint16_t getUInt16(const char* p) { return (uint16_t)((uint8_t)p[0] | ((uint8_t)p[1] << 8)); }
+  static uint32_t getUInt32(const char* p) { return getUInt16(p) | ((uint32_t)getUInt16(p + 2) << 16); }
+
+  // reads the next gzip member into block, returns false at the end of the file
+  bool readMember(std::vector<char>& block) {
+    char header[HEADER_SIZE];
+    std::streamsize n = source_->sgetn(header, HEADER_SIZE);
+    if(n == 0)
+      return false;
+    ABORT_IF(n != (std::streamsize)HEADER_SIZE || !isHeader(header),
+             "Invalid or truncated BGZF block in {}",
+             fileName_);
+
+    size_t extraSize = getUInt16(header + 10);
+    std::vector<char> extra(extraSize);
+    ABORT_IF(source_->sgetn(extra.data(), extraSize) != (std::streamsize)extraSize,
+             "Truncated BGZF block in {}",
+             fileName_);
+    size_t blockSize = 0; // BSIZE + 1, the size of the whole member
+    for(size_t i = 0; i + 4 <= extraSize; i += 4 + getUInt16(&extra[i + 2]))
+      if(extra[i] == 'B' && extra[i + 1] == 'C' && getUInt16(&extra[i + 2]) == 2 && i + 6 <= extraSize)
+        blockSize = getUInt16(&extra[i + 4]) + 1;
+    ABORT_IF(blockSize < HEADER_SIZE + extraSize + FOOTER_SIZE,
+             "gzip member without BGZF block size in {}, which is not a BGZF file",
+             fileName_);
+
+    block.resize(blockSize);
+    std::copy(header, header + HEADER_SIZE, block.begin());
+    std::copy(extra.begin(), extra.end(), block.begin() + HEADER_SIZE);
+    size_t rest = blockSize - HEADER_SIZE - extraSize;
+    ABORT_IF(source_->sgetn(block.data() + HEADER_SIZE + extraSize, rest) != (std::streamsize)rest,
+             "Truncated BGZF block in {}",
+             fileName_);
+    return true;
+  }
+
+  static std::vector<char> inflateMember(const std::vector<char>& block, const std::string& fileName) {
+    size_t dataBegin = HEADER_SIZE + getUInt16(&block[10]);
+    size_t dataSize = block.size() - dataBegin - FOOTER_SIZE;
+    uint32_t crc = getUInt32(&block[block.size() - 8]);
+    std::vector<char> out(getUInt32(&block[block.size() - 4]));
+
+    z_stream zs = {};
+    ABORT_IF(inflateInit2(&zs, -15) != Z_OK, "Cannot initialize zlib for {}", fileName); // raw deflate data
+    zs.next_in = (Bytef*)&block[dataBegin];
+    zs.avail_in = (uInt)dataSize;
+    char empty; // zlib needs an output buffer even for the empty end-of-file block
+    zs.next_out = out.empty() ? (Bytef*)&empty : (Bytef*)out.data();
+    zs.avail_out = (uInt)out.size();
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    ABORT_IF(ret != Z_STREAM_END || zs.avail_out != 0, "Corrupted BGZF block in {}", fileName);
+    ABORT_IF(crc32(crc32(0L, Z_NULL, 0), (const Bytef*)out.data(), (uInt)out.size()) != crc,
+             "CRC error in BGZF block in {}",
+             fileName);
+    return out;
+  }
+
+  bool requestBlock() override {
+    auto block = New<std::vector<char>>();
+    if(!readMember(*block))
+      return false;
+    std::string fileName = fileName_;
+    blocks_.push_back(pool_.enqueue([block, fileName]() { return inflateMember(*block, fileName); }));
+    return true;
+  }
+
+public:
+  BgzfStreamBuf(std::streambuf* source, const std::string& fileName, size_t threads)
+      : AsyncBlockStreamBuf(4 * threads), source_(source), fileName_(fileName), pool_(threads) {}
+
+  static bool isHeader(const char* header) {
+    // gzip magic, deflate, FEXTRA flag and the extra field holding the block size
+    return (uint8_t)header[0] == 0x1f && (uint8_t)header[1] == 0x8b && header[2] == 8 && (header[3] & 4) != 0;
+  }
+
+  // true if the file starts with a BGZF block header
+  static bool isBgzf(const std::string& fileName) {
+    std::ifstream in(fileName, std::ios::binary);
+    char header[HEADER_SIZE + 4];
+    if(!in.read(header, sizeof(header)))
+      return false;
+    return isHeader(header) && header[12] == 'B' && header[13] == 'C';
+  }
+};
+
+#ifdef USE_ZSTD
+// Decompresses zstd files, which may consist of several frames
+class ZstdStreamBuf : public std::streambuf {
+private:
+  std::streambuf* source_;
+  std::string fileName_;
+  ZSTD_DStream* stream_;
+  std::vector<char> in_;
+  std::vector<char> out_;
+  ZSTD_inBuffer input_{nullptr, 0, 0};
+  size_t lastRet_{0}; // 0 after a complete frame
+
+protected:
+  int_type underflow() override {
+    while(gptr() == egptr()) {
+      if(input_.pos == input_.size) {
+        size_t n = (size_t)source_->sgetn(in_.data(), in_.size());
+        if(n == 0) {
+          ABORT_IF(lastRet_ != 0, "Truncated zstd file {}", fileName_);
+          return traits_type::eof();
+        }
+        input_ = {in_.data(), n, 0};
+      }
+      ZSTD_outBuffer output = {out_.data(), out_.size(), 0};
+      lastRet_ = ZSTD_decompressStream(stream_, &output, &input_);
+      ABORT_IF(ZSTD_isError(lastRet_), "Error decompressing {}: {}", fileName_, ZSTD_getErrorName(lastRet_));
+      setg(out_.data(), out_.data(), out_.data() + output.pos);
+    }
+    return traits_type::to_int_type(*gptr());
+  }
+
+public:
+  ZstdStreamBuf(std::streambuf* source, const std::string& fileName)
+      : source_(source),
+        fileName_(fileName),
+        stream_(ZSTD_createDStream()),
+        in_(ZSTD_DStreamInSize()),
+        out_(ZSTD_DStreamOutSize()) {
+    ABORT_IF(!stream_, "Cannot create zstd decompression stream for {}", fileName);
+    ZSTD_initDStream(stream_);
+  }
+
+  ~ZstdStreamBuf() { ZSTD_freeDStream(stream_); }
+};
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+InputFileStream::InputFileStream(const std::string &file, size_t threads /*= 1*/)
     : std::istream(NULL) {
   // the special syntax "command |" starts command in a sh shell and reads out its result
   if (marian::utils::endsWith(file, "|")) {
@@ -43,17 +251,34 @@ InputFileStream::InputFileStream(const std::string &file)
   ABORT_IF(!ret, "Error opening file ({}): {}", errno, file_.string());
   ABORT_IF(ret != streamBuf1_.get(), "Return value is not equal to streambuf pointer, that is weird");
 
-  // insert .gz decompression
+  // insert .gz or .zst decompression
   if(marian::utils::endsWith(file, ".gz")) {
     streamBuf2_ = std::move(streamBuf1_);
-    streamBuf1_.reset(new zstr::istreambuf(streamBuf2_.get()));
+    if(threads > 1 && !pipe_ && BgzfStreamBuf::isBgzf(file_.string())) {
+      streamBuf1_.reset(new BgzfStreamBuf(streamBuf2_.get(), file, threads));
+      threads = 1; // already decompressed in parallel
+    } else {
+      streamBuf1_.reset(new zstr::istreambuf(streamBuf2_.get()));
+    }
+  } else if(marian::utils::endsWith(file, ".zst")) {
+#ifdef USE_ZSTD
+    streamBuf2_ = std::move(streamBuf1_);
+    streamBuf1_.reset(new ZstdStreamBuf(streamBuf2_.get(), file));
+#else
+    ABORT("Reading zstd files requires Marian compiled with -DUSE_ZSTD=on: {}", file);
+#endif
   }
 
+  // decompress other compressed files on a background thread ahead of reading
+  if(threads > 1 && streamBuf2_)
+    readAhead_.reset(new ReadAheadStreamBuf(streamBuf1_.get(), /*blockSize=*/1 << 20, /*depth=*/4));
+
   // initialize the underlying istream
-  this->init(streamBuf1_.get());
+  this->init(readAhead_ ? readAhead_.get() : streamBuf1_.get());
 }
 
 InputFileStream::~InputFileStream() {
+  readAhead_.reset(); // stops reading before the pipe is closed
 #ifdef __unix__  // (pipe syntax is only supported on UNIX-like OS)
   if (pipe_)
     pclose(pipe_);  // non-NULL if pipe syntax was used
@@ -65,9 +290,11 @@ bool InputFileStream::empty() {
 }
 
 void InputFileStream::setbufsize(size_t size) {
-  rdbuf()->pubsetbuf(0, 0);
+  // the buffer is set for reading the file, which holds compressed data for compressed files
+  std::streambuf* fileBuf = streamBuf2_ ? streamBuf2_.get() : streamBuf1_.get();
+  fileBuf->pubsetbuf(0, 0);
   readBuf_.resize(size);
-  rdbuf()->pubsetbuf(readBuf_.data(), readBuf_.size());
+  fileBuf->pubsetbuf(readBuf_.data(), readBuf_.size());
 }
 
 std::string InputFileStream::getFileName() const {
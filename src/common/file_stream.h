@@ -40,7 +40,9 @@ namespace io {
 //////////////////////////////////////////////////////////////////////////////////////////////
 class InputFileStream : public std::istream {
 public:
-  explicit InputFileStream(const std::string& file);
+  // Files ending in .gz or .zst are decompressed. With several threads, BGZF files (written by
+  // bgzip) are decompressed block-parallel and other compressed files on a background thread.
+  explicit InputFileStream(const std::string& file, size_t threads = 1);
   virtual ~InputFileStream();
 
   bool empty();
@@ -49,10 +51,11 @@ public:
 
 protected:
   marian::filesystem::Path file_;
+  std::vector<char> readBuf_;                   // declared first, used by the streambufs below
   std::unique_ptr<std::streambuf> streamBuf1_;  // main streambuf
-  std::unique_ptr<std::streambuf> streamBuf2_;  // in case of a .gz file
+  std::unique_ptr<std::streambuf> streamBuf2_;  // in case of a .gz or .zst file
+  std::unique_ptr<std::streambuf> readAhead_;   // in case of decompressing on a background thread
   FILE* pipe_{};                                // in case of pipe syntax
-  std::vector<char> readBuf_;
 };
 
 std::istream& getline(std::istream& in, std::string& line);
@@ -7,6 +7,8 @@
 #include "common/binary.h"
 #include "common/io_item.h"
 
+#include <algorithm>
+
 namespace marian {
 namespace io {
 
@@ -75,28 +77,51 @@ void addMetaToItems(const std::string& meta,
   items.push_back(item);
 }
 
+// 1-dimensional arrays become a row
+static Shape shapeFromNpz(const std::vector<unsigned int>& npzShape) {
+  Shape shape;
+  if(npzShape.size() == 1) {
+    shape.resize(2);
+    shape.set(0, 1);
+    shape.set(1, (size_t)npzShape[0]);
+  } else {
+    shape.resize(npzShape.size());
+    for(size_t i = 0; i < npzShape.size(); ++i)
+      shape.set(i, (size_t)npzShape[i]);
+  }
+  return shape;
+}
+
 void loadItemsFromNpz(const std::string& fileName, std::vector<Item>& items) {
   auto numpy = cnpy::npz_load(fileName);
   for(auto it : numpy) {
-    Shape shape;
-    if(it.second->shape.size() == 1) {
-      shape.resize(2);
-      shape.set(0, 1);
-      shape.set(1, (size_t)it.second->shape[0]);
-    } else {
-      shape.resize(it.second->shape.size());
-      for(size_t i = 0; i < it.second->shape.size(); ++i)
-        shape.set(i, (size_t)it.second->shape[i]);
-    }
-
     Item item;
     item.name = it.first;
-    item.shape = shape;
+    item.shape = shapeFromNpz(it.second->shape);
     item.bytes.swap(it.second->bytes);
     items.emplace_back(std::move(item));
   }
 }
 
+std::vector<Item> mmapItemsNpz(const char* data, size_t size) {
+  std::vector<Item> items;
+  for(const auto& entry : cnpy::npz_map(data, size)) {
+    Item item;
+    item.name = entry.name;
+    item.shape = shapeFromNpz(entry.shape);
+    if(entry.bytes == item.size()) { // float32, like all items of loadItemsFromNpz()
+      item.mapped = true;
+      item.ptr = entry.data;
+    } else { // e.g. the model configuration, as is
+      item.bytes.assign(entry.data, entry.data + entry.bytes);
+    }
+    items.emplace_back(std::move(item));
+  }
+  // in the order of loadItemsFromNpz()
+  std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.name < b.name; });
+  return items;
+}
+
 std::vector<Item> loadItems(const std::string& fileName) {
   std::vector<Item> items;
   if(isNpz(fileName)) {
@@ -148,8 +173,21 @@ void saveItemsNpz(const std::string& fileName, const std::vector<Item>& items) {
   cnpy::npz_save(fileName, npzItems);
 }
 
+static thread_local const DeferredSaveItems::SaveFunc* deferredSave = nullptr;
+
+DeferredSaveItems::DeferredSaveItems(const SaveFunc& save) : save_(save) {
+  ABORT_IF(deferredSave, "Saving items is already deferred in this thread");
+  deferredSave = &save_;
+}
+
+DeferredSaveItems::~DeferredSaveItems() {
+  deferredSave = nullptr;
+}
+
 void saveItems(const std::string& fileName, const std::vector<Item>& items) {
-  if(isNpz(fileName)) {
+  if(deferredSave) {
+    (*deferredSave)(fileName, items);
+  } else if(isNpz(fileName)) {
     saveItemsNpz(fileName, items);
   } else if(isBin(fileName)) {
     binary::saveItems(fileName, items);
@@ -3,6 +3,7 @@
 #include "3rd_party/yaml-cpp/yaml.h"
 #include "common/io_item.h"
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -30,8 +31,23 @@ std::vector<Item> loadItems(const std::string& fileName);
 std::vector<Item> loadItems(const void* ptr);
 
 std::vector<Item> mmapItems(const void* ptr);
+// Items of a memory-mapped .npz file, which point into the mapping
+std::vector<Item> mmapItemsNpz(const char* data, size_t size);
 
 void saveItems(const std::string& fileName, const std::vector<Item>& items);
 
+// While an object of this class exists, saveItems() in the same thread does not write the file but
+// passes its name and items to `save`, e.g. to write them later on a background thread. Not nested.
+class DeferredSaveItems {
+public:
+  typedef std::function<void(const std::string& fileName, const std::vector<Item>& items)> SaveFunc;
+
+  DeferredSaveItems(const SaveFunc& save);
+  ~DeferredSaveItems();
+
+private:
+  SaveFunc save_;
+};
+
 }  // namespace io
 }  // namespace marian
@@ -72,6 +72,8 @@ struct Item {
       convertFromTo<float, T>();
     else if(type == Type::float16)
       convertFromTo<HalfFloat, T>();
+    else if(type == Type::bfloat16)
+      convertFromTo<bfloat16, T>();
     else 
       ABORT("convert from type {} not implemented", type);
   }
@@ -84,6 +86,8 @@ struct Item {
       convertTo<float>();
     else if(toType == Type::float16)
       convertTo<float16>();
+    else if(toType == Type::bfloat16)
+      convertTo<bfloat16>();
     else
       ABORT("convert to type {} not implemented", toType);
 
@@ -1,5 +1,6 @@
 #include "logging.h"
 #include "common/config.h"
+#include "spdlog/async_logger.h"
 #include "spdlog/sinks/null_sink.h"
 #include "3rd_party/ExceptionWithCallStack.h"
 #include <time.h>
@@ -23,7 +24,9 @@ namespace marian {
 std::shared_ptr<spdlog::logger> createStderrLogger(const std::string& name,
                                                    const std::string& pattern,
                                                    const std::vector<std::string>& files,
-                                                   bool quiet) {
+                                                   bool quiet,
+                                                   size_t asyncQueueSize,
+                                                   bool asyncDiscard) {
   std::vector<spdlog::sink_ptr> sinks;
 
   auto stderr_sink = spdlog::sinks::stderr_sink_mt::instance();
@@ -35,7 +38,16 @@ std::shared_ptr<spdlog::logger> createStderrLogger(const std::string& name,
     sinks.push_back(file_sink);
   }
 
-  auto logger = std::make_shared<spdlog::logger>(name, begin(sinks), end(sinks));
+  std::shared_ptr<spdlog::logger> logger;
+  if(asyncQueueSize > 0) {
+    // a full queue blocks the logging thread or drops the message; the sinks are flushed every second
+    auto overflow = asyncDiscard ? spdlog::async_overflow_policy::discard_log_msg
+                                 : spdlog::async_overflow_policy::block_retry;
+    logger = std::make_shared<spdlog::async_logger>(name, begin(sinks), end(sinks), asyncQueueSize, overflow,
+                                                    nullptr, std::chrono::milliseconds(1000));
+  } else {
+    logger = std::make_shared<spdlog::logger>(name, begin(sinks), end(sinks));
+  }
 
   spdlog::register_logger(logger);
   logger->set_pattern(pattern);
@@ -64,6 +76,14 @@ bool setLoggingLevel(spdlog::logger& logger, std::string const level) {
   return true;
 }
 
+void flushLoggers() {
+  for(auto name : {"general", "valid"}) {
+    auto logger = spdlog::get(name);
+    if(logger)
+      logger->flush();
+  }
+}
+
 static void setErrorHandlers();
 void createLoggers(const marian::Config* config) {
   std::vector<std::string> generalLogs;
@@ -83,8 +103,20 @@ void createLoggers(const marian::Config* config) {
   }
 
   bool quiet = config && config->get<bool>("quiet");
-  Logger general{createStderrLogger("general", "[%Y-%m-%d %T] %v", generalLogs, quiet)};
-  Logger valid{createStderrLogger("valid", "[%Y-%m-%d %T] [valid] %v", validLogs, quiet)};
+
+  size_t asyncQueueSize = 0;
+  bool asyncDiscard = false;
+  if(config && config->has("log-async") && config->get<size_t>("log-async") > 0) {
+    asyncQueueSize = 1; // the queue needs a power of two
+    while(asyncQueueSize < config->get<size_t>("log-async"))
+      asyncQueueSize *= 2;
+    auto overflow = config->get<std::string>("log-async-overflow");
+    ABORT_IF(overflow != "block" && overflow != "discard", "Unknown --log-async-overflow {}", overflow);
+    asyncDiscard = overflow == "discard";
+  }
+
+  Logger general{createStderrLogger("general", "[%Y-%m-%d %T] %v", generalLogs, quiet, asyncQueueSize, asyncDiscard)};
+  Logger valid{createStderrLogger("valid", "[%Y-%m-%d %T] [valid] %v", validLogs, quiet, asyncQueueSize, asyncDiscard)};
 
   if(config && config->has("log-level")) {
     std::string loglevel = config->get<std::string>("log-level");
@@ -100,14 +100,18 @@ namespace marian {
     auto logger = spdlog::get("general");                                        \
     if(logger == nullptr)                                                        \
       logger = createStderrLogger("general", "[%Y-%m-%d %T] Error: %v");         \
-    else                                                                         \
+    else {                                                                       \
+      logger->flush(); /* see --log-async, the pattern applies to queued ones */ \
       logger->set_pattern("[%Y-%m-%d %T] Error: %v");                            \
+    }                                                                            \
     checkedLog("general", "critical", __VA_ARGS__);                              \
     checkedLog("general", "critical", "Aborted from {} in {}:{}",                \
                FUNCTION_NAME, __FILE__, __LINE__);                               \
+    logger->flush();                                                             \
     logger->set_pattern("%v");                                                   \
     auto callStack = marian::getCallStack(/*skipLevels=*/0);                     \
     checkedLog("general", "critical", callStack);                                \
+    flushLoggers();                                                              \
     if(marian::getThrowExceptionOnAbort())                                       \
       throw marian::MarianRuntimeException(fmt::format(__VA_ARGS__), callStack); \
     else                                                                         \
@@ -138,10 +142,16 @@ namespace marian {
   } while(0)
 
 typedef std::shared_ptr<spdlog::logger> Logger;
+// With asyncQueueSize > 0, messages are queued and written by a background thread, see --log-async
 Logger createStderrLogger(const std::string&,
                           const std::string&,
                           const std::vector<std::string>& = {},
-                          bool quiet = false);
+                          bool quiet = false,
+                          size_t asyncQueueSize = 0,
+                          bool asyncDiscard = false);
+
+// Writes all queued messages of all loggers and flushes their files
+void flushLoggers();
 
 namespace marian {
 class Config;
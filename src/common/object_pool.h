@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Recycling allocator for the small objects that are created and destroyed in large numbers while
+// graphs are built, i.e. graph nodes, tensors and memory pieces.
+
+// Freed objects are kept on free lists of the freeing thread by size class, from which the next
+// objects of the same size class are taken. Decoding rebuilds the same graph in every step, so after
+// the first steps nodes and tensors no longer reach the system allocator. Reference counting is
+// unchanged: objects that outlive the graph, e.g. memoized nodes or tensors of a search, just return
+// to the lists later, of whichever thread frees them. Lists are bounded, and released when their
+// thread exits.
+
+// Add ENABLE_POOLED_NEW into the body of a class (public section) to allocate it and all derived
+// classes from the pool. The class needs a virtual destructor if it is deleted through a base.
+#define ENABLE_POOLED_NEW                                                           \
+  static void* operator new(size_t bytes) { return marian::ObjectPool::allocate(bytes); } \
+  static void operator delete(void* p, size_t bytes) { marian::ObjectPool::deallocate(p, bytes); }
+
+namespace marian {
+
+class ObjectPool {
+private:
+  static const size_t GRANULE = 16;     // size classes are multiples of this, also the alignment of new
+  static const size_t CLASSES = 48;     // objects of up to GRANULE * CLASSES bytes are pooled
+  static const size_t MAX_FREE = 8192;  // free objects kept per size class and thread
+
+  struct FreeObject {
+    FreeObject* next;
+  };
+
+  struct Lists {
+    FreeObject* heads[CLASSES] = {nullptr};
+    size_t counts[CLASSES] = {0};
+
+    ~Lists() {
+      exited() = true;
+      for(size_t c = 0; c < CLASSES; ++c) {
+        while(heads[c]) {
+          auto next = heads[c]->next;
+          ::operator delete(heads[c]);
+          heads[c] = next;
+        }
+      }
+    }
+  };
+
+  // objects freed by destructors of other thread-local objects after the lists are gone bypass them
+  static bool& exited() {
+    static thread_local bool exited = false;
+    return exited;
+  }
+
+  static Lists& lists() {
+    static thread_local Lists lists;
+    return lists;
+  }
+
+  static size_t sizeClass(size_t bytes) { return (bytes + GRANULE - 1) / GRANULE - 1; }
+
+public:
+  static void* allocate(size_t bytes) {
+    size_t c = sizeClass(bytes);
+    if(c >= CLASSES || exited())
+      return ::operator new(bytes);
+    auto& l = lists();
+    if(auto object = l.heads[c]) {
+      l.heads[c] = object->next;
+      --l.counts[c];
+      return object;
+    }
+    return ::operator new((c + 1) * GRANULE);
+  }
+
+  static void deallocate(void* p, size_t bytes) {
+    if(!p)
+      return;
+    size_t c = sizeClass(bytes);
+    if(c >= CLASSES || exited()) {
+      ::operator delete(p);
+      return;
+    }
+    auto& l = lists();
+    if(l.counts[c] >= MAX_FREE) {
+      ::operator delete(p);
+      return;
+    }
+    auto object = static_cast<FreeObject*>(p);
+    object->next = l.heads[c];
+    l.heads[c] = object;
+    ++l.counts[c];
+  }
+};
+
+}  // namespace marian
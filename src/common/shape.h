@@ -1,8 +1,10 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -28,30 +30,47 @@ struct Slice // Python-like slice/index descriptor
 };
 typedef std::vector<Slice> Slices;
 
+// The dimensions are stored inline, as shapes are created for every node and tensor of a graph
 struct Shape {
+public:
+  static const size_t MAX_DIMS = 8;
+
 private:
-  std::vector<int> shape_;
+  std::array<int, MAX_DIMS> shape_;
+  size_t size_;
 
 public:
-  Shape() : shape_({1}) {}
+  Shape() : size_(1) { shape_[0] = 1; }
 
   Shape(std::initializer_list<int> il) : Shape() {
-    shape_.resize(il.size());
+    resize(il.size());
     std::copy(il.begin(), il.end(), begin());
   }
 
-  Shape(std::vector<int>&& shape) : shape_(std::move(shape)) {}
+  Shape(const std::vector<int>& shape) : Shape() {
+    resize(shape.size());
+    std::copy(shape.begin(), shape.end(), begin());
+  }
 
   Shape(const Shape& shape) : Shape() {
-    shape_.resize(shape.size());
+    resize(shape.size());
     std::copy(shape.begin(), shape.end(), begin());
   }
 
-  Shape& operator=(const Shape& p) = default;
+  Shape& operator=(const Shape& shape) {
+    resize(shape.size());
+    std::copy(shape.begin(), shape.end(), begin());
+    return *this;
+  }
 
-  inline size_t size() const { return shape_.size(); }
+  inline size_t size() const { return size_; }
 
-  void resize(size_t n) { shape_.resize(n, 1); }
+  void resize(size_t n) {
+    ABORT_IF(n > MAX_DIMS, "Shapes have at most {} dimensions, requested {}", (size_t)MAX_DIMS, n); // a copy, MAX_DIMS has no definition to bind a reference to
+    for(size_t i = size_; i < n; ++i)
+      shape_[i] = 1;
+    size_ = n;
+  }
 
   const int* data() const { return shape_.data(); }
   int* data() { return shape_.data(); }
@@ -86,50 +105,43 @@ public:
   inline int operator[](size_t i) const { return dim(i); }
   inline int operator[](size_t i)       { return dim(i); }
 
-  inline int back() const { return shape_.back(); }
-  inline int& back() { return shape_.back(); }
+  inline int back() const { return shape_[size_ - 1]; }
+  inline int& back() { return shape_[size_ - 1]; }
 
   inline int stride(int i) const {
-    std::vector<int> stride(shape_.size(), 1);
-    for(int j = (int)shape_.size() - 2; j >= 0; --j)
-      stride[j] = stride[j + 1] * shape_[j + 1];
-
-    if(i >= 0)
-      return stride[i];
-    else
-      return stride[size() + i];
+    int stride = 1;
+    for(int j = (int)size_ - 1; j > axis(i); --j)
+      stride *= shape_[j];
+    return stride;
   }
 
   template<typename T = int> // using a template so that FactoredSegmenter, which uses this as well, can pass size_t
   inline T elements() const {
     T el = 1;
-    for(auto s : shape_)
+    for(auto s : *this)
       el *= (T)s;
     return el;
   }
 
   inline void dims(int i, std::vector<int>& d) const {
-    d.resize(shape_.size());
-
-    std::vector<int> stride(shape_.size(), 1);
-    for(int j = (int)shape_.size() - 2; j >= 0; --j)
-      stride[j] = stride[j + 1] * shape_[j + 1];
-
-    for(size_t j = 0; j < d.size(); ++j)
-      d[j] = (i / stride[j]) % shape_[j];
+    d.resize(size_);
+    for(int j = (int)size_ - 1; j >= 0; --j) {
+      d[j] = i % shape_[j];
+      i /= shape_[j];
+    }
   }
 
-  auto begin() -> decltype(shape_.begin()) { return shape_.begin(); }
-  auto begin() const -> decltype(shape_.begin()) { return shape_.begin(); }
+  int* begin() { return shape_.data(); }
+  const int* begin() const { return shape_.data(); }
 
-  auto end() -> decltype(shape_.end()) { return shape_.end(); }
-  auto end() const -> decltype(shape_.end()) { return shape_.end(); }
+  int* end() { return shape_.data() + size_; }
+  const int* end() const { return shape_.data() + size_; }
 
-  auto rbegin() -> decltype(shape_.rbegin()) { return shape_.rbegin(); }
-  auto rbegin() const -> decltype(shape_.rbegin()) { return shape_.rbegin(); }
+  std::reverse_iterator<int*> rbegin() { return std::reverse_iterator<int*>(end()); }
+  std::reverse_iterator<const int*> rbegin() const { return std::reverse_iterator<const int*>(end()); }
 
-  auto rend() -> decltype(shape_.rend()) { return shape_.rend(); }
-  auto rend() const -> decltype(shape_.rend()) { return shape_.rend(); }
+  std::reverse_iterator<int*> rend() { return std::reverse_iterator<int*>(begin()); }
+  std::reverse_iterator<const int*> rend() const { return std::reverse_iterator<const int*>(begin()); }
 
   bool operator==(const Shape& other) const {
     return size() == other.size() && std::equal(begin(), end(), other.begin());
@@ -226,7 +238,7 @@ public:
 
   size_t hash() const {
     size_t seed = util::hash<int>()(shape_[0]);
-    for(size_t i = 1; i < shape_.size(); ++i)
+    for(size_t i = 1; i < size_; ++i)
       util::hash_combine(seed, shape_[i]);
     return seed;
   }
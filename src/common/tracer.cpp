@@ -0,0 +1,91 @@
+#include "common/tracer.h"
+#include "common/file_stream.h"
+#include "common/logging.h"
+
+namespace marian {
+namespace tracing {
+
+Tracer& Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::enable(const std::string& path, size_t maxEvents, bool sync) {
+  path_ = path;
+  maxEvents_ = maxEvents;
+  sync_ = sync;
+  start_ = std::chrono::steady_clock::now();
+  enabled_ = true;
+  LOG(info, "[tracing] Recording a timeline of up to {} events into {}", maxEvents_, path_);
+}
+
+Tracer::Buffer& Tracer::buffer() {
+  thread_local Buffer* buffer = nullptr;
+  if(!buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.emplace_back(new Buffer());
+    buffer = buffers_.back().get();
+    buffer->threadIdx = buffers_.size() - 1;
+  }
+  return *buffer;
+}
+
+void Tracer::record(const char* category, std::string&& name, double begin, double end) {
+  if(!enabled_)
+    return;
+  size_t idx = numEvents_++;
+  if(idx >= maxEvents_) {
+    if(idx == maxEvents_) {
+      enabled_ = false;
+      LOG(warn, "[tracing] Recorded {} events, stopped recording, see --trace-max-events", maxEvents_);
+    }
+    return;
+  }
+  auto& buffer = this->buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.events.push_back({category, std::move(name), begin, end - begin});
+}
+
+static std::string escape(const std::string& s) {
+  std::string escaped;
+  for(char c : s) {
+    if(c == '"' || c == '\\')
+      escaped += '\\';
+    if((unsigned char)c >= 0x20)
+      escaped += c;
+  }
+  return escaped;
+}
+
+void Tracer::write() {
+  if(path_.empty())
+    return;
+  enabled_ = false;
+
+  io::OutputFileStream out(path_);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  bool first = true;
+  size_t written = 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for(auto& buffer : buffers_) {
+    std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+    // metadata event naming the thread in the timeline
+    out << (first ? "" : ",\n")
+        << fmt::format("{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": {}, \"args\": {{\"name\": \"thread {}\"}}}}",
+                       buffer->threadIdx, buffer->threadIdx);
+    first = false;
+    for(const auto& event : buffer->events) {
+      out << ",\n"
+          << fmt::format("{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"X\", \"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": 0, \"tid\": {}}}",
+                         escape(event.name), event.category, event.begin, event.duration, buffer->threadIdx);
+    }
+    written += buffer->events.size();
+    buffer->events.clear();
+  }
+  out << "\n]}\n";
+  LOG(info, "[tracing] Wrote {} events into {}", written, path_);
+  path_.clear();
+}
+
+}  // namespace tracing
+}  // namespace marian
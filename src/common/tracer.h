@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace marian {
+namespace tracing {
+
+// Records a timeline of what all threads are doing, e.g. the nodes of the forward and backward
+// passes by type, communicator calls, batch generation and validation, and writes it as a Chrome
+// trace JSON file at exit, see --trace. The file can be opened in chrome://tracing or
+// https://ui.perfetto.dev. Events are buffered per thread, so recording does not contend between
+// threads; when the tracer is disabled, a Span costs a single check of a flag.
+class Tracer {
+public:
+  struct Event {
+    const char* category; // static string
+    std::string name;
+    double begin; // us since the tracer was enabled
+    double duration; // us
+  };
+
+private:
+  struct Buffer {
+    std::mutex mutex; // only contended while the trace is written
+    size_t threadIdx;
+    std::vector<Event> events;
+  };
+
+  std::atomic<bool> enabled_{false};
+  bool sync_{false};
+  std::string path_;
+  size_t maxEvents_{0};
+  std::atomic<size_t> numEvents_{0};
+  std::chrono::steady_clock::time_point start_;
+
+  std::mutex mutex_; // guards buffers_
+  std::vector<std::unique_ptr<Buffer>> buffers_; // [thread index]
+
+  Tracer() {}
+  ~Tracer() { write(); }
+
+  Buffer& buffer();
+
+public:
+  static Tracer& instance();
+
+  // Starts recording up to maxEvents events, to be written to path. With sync, the graphs wait for
+  // the device at the end of each node, so that node events measure the kernels instead of their launch.
+  void enable(const std::string& path, size_t maxEvents, bool sync);
+  static bool enabled() { return instance().enabled_.load(std::memory_order_relaxed); }
+  bool sync() const { return sync_; }
+
+  double now() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+  void record(const char* category, std::string&& name, double begin, double end);
+
+  // Writes all events recorded so far, called at exit
+  void write();
+};
+
+// An event from construction, or from begin(), to destruction
+class Span {
+private:
+  const char* category_{nullptr};
+  std::string name_;
+  double begin_{0};
+
+public:
+  Span() {}
+  Span(const char* category, const std::string& name) {
+    if(Tracer::enabled())
+      begin(category, name);
+  }
+
+  Span(const Span&) = delete;
+
+  bool active() const { return category_ != nullptr; }
+
+  // for names that are costly to build, only call this if Tracer::enabled()
+  void begin(const char* category, const std::string& name) {
+    category_ = category;
+    name_ = name;
+    begin_ = Tracer::instance().now();
+  }
+
+  ~Span() {
+    if(category_)
+      Tracer::instance().record(category_, std::move(name_), begin_, Tracer::instance().now());
+  }
+};
+
+}  // namespace tracing
+}  // namespace marian
@@ -32,6 +32,12 @@ size_t requiredBytes(const Shape& shape, Type type) {
   if (isIntgemm(type)) {
     /* Intgemm tensors have an extra float at the back that stores the quantization multiplier */
     return shape.elements() * sizeOf(type) + sizeOf(Type::float32);
+  } else if (isRowQuantized(type)) {
+    /* followed by the scale of every row */
+    return shape.elements() * sizeOf(type) + (shape.elements() / shape[-1]) * sizeOf(Type::float32);
+  } else if (isColQuantized(type)) {
+    /* followed by the scale of every column */
+    return shape.elements() * sizeOf(type) + shape[-1] * sizeOf(Type::float32);
   } else {
     return shape.elements() * sizeOf(type);
   }
@@ -11,14 +11,20 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <functional>
 #include <type_traits>
 
 #ifndef __CUDACC__ // NVCC is very unreliable when it comes to CPU intrinsics, we hide them completely from NVCC-compiled code
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define USE_NEON 1 // ARM, float32x4 is a NEON vector and there is no float32x8
+#else
 #include <immintrin.h>
 #endif
+#endif
 
 #ifdef __CUDACC__ // nvcc is compiling this code
 #include <cuda.h> // required to see CUDA_VERSION
@@ -154,12 +160,51 @@ struct intgemm8ssse3       { int8_t x;  };
 struct intgemm8avx2        { int8_t x;  };
 struct intgemm8avx512      { int8_t x;  };
 struct intgemm8avx512vnni  { int8_t x;  };
+struct intgemm8amx         { int8_t x;  };
+
+// bfloat16, the upper half of a float32: the exponent range of float32 with 8 bits of mantissa.
+// For now a storage type of models, converted to and from float with rounding to nearest even.
+struct bfloat16 {
+  uint16_t x;
+
+  bfloat16() {}
+  bfloat16(float f) : x(fromFloat(f)) {}
+
+  operator float() const {
+    uint32_t bits = (uint32_t)x << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+
+private:
+  static uint16_t fromFloat(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    if((bits & 0x7fffffff) > 0x7f800000) // NaN, keep it one when truncating the mantissa
+      return (uint16_t)((bits >> 16) | 0x0040);
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return (uint16_t)(bits >> 16);
+  }
+};
 
 
 #ifndef __CUDACC__ // vectorized types not available from .cu files
 
 // @TODO: check what intrinsics are actually available.
 struct float32x4 {
+#if USE_NEON
+private:
+  float32x4_t f_;
+
+public:
+  float32x4() {}
+  float32x4(const float32x4_t& f) : f_(f) {}
+  float32x4(const float& f) : f_(vdupq_n_f32(f)) {}
+
+  operator const float32x4_t&() const { return f_; }
+  operator float32x4_t&() { return f_; }
+#else
 private:
   __m128 f_;
 
@@ -170,6 +215,7 @@ public:
 
   operator const __m128&() const { return f_; }
   operator __m128&() { return f_; }
+#endif
 
   float operator[] (size_t i) const {
     return *(((float*)&f_) + i); // potentially undefined, but efficient. In practice __m128 is an array of floats
@@ -217,6 +263,38 @@ public:
 struct float32x8 {
 };
 #endif
+
+#ifdef __AVX512F__
+struct float32x16 {
+private:
+  __m512 f_;
+
+public:
+  float32x16() {}
+  float32x16(const __m512& f) : f_(f) {}
+  float32x16(const float& f) : f_(_mm512_set1_ps(f)) {} // __m512 _mm512_set1_ps(float) copies value into all slots
+
+  operator const __m512&() const { return f_; }
+  operator __m512&() { return f_; }
+
+  float operator[] (size_t i) const {
+    return *(((float*)&f_) + i); // potentially undefined, but efficient. In practice __m512 is an array of floats
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, float32x16 f16) {
+    float* a = (float*)&f16;
+    out << "[" << a[0];
+    for(int i = 1; i < 16; i++)
+      out << " " << a[i];
+    out << "]";
+    return out;
+  }
+};
+#else
+//Dummy version to get things to compile on CPUs without AVX512
+struct float32x16 {
+};
+#endif
 #endif
 
 // Internal to types.h, don't use. Use test functions below.
@@ -233,9 +311,13 @@ enum class TypeClass : size_t { // size_type has 8 bytes, so we can have 16 fiel
 
   packed_type   = 0x00800, // special packed (CPU cache friendly) type class, used in FBGEMM. Annoyingly we need to keep 0x800 for back-compat, would be nicer to align with intgemm
   intgemm_type  = 0x10000, // intgemm quantized architecture agnostic models
+  bfloat_type   = 0x20000, // bfloat16 layout of a float_type, to tell it from float16 of the same size
+  rowscale_type = 0x40000, // quantized rows with a float32 scale per row stored behind the matrix
+  amx_type      = 0x80000, // processor-specific layout for the AMX tiles, currently used for Intgemm only
+  colscale_type = 0x100000, // quantized columns with a float32 scale per column, see tensors/gpu/int8_gemm.h
 
-  size_mask     = 0x000FF, // maximum allowed size is 256 bytes right now; if more are required, extend the size field
-  class_mask    = 0xFFF00, // three fields for different type classes, if more classes are added we need to increase the number of fields here
+  size_mask     = 0x000FF,  // maximum allowed size is 256 bytes right now; if more are required, extend the size field
+  class_mask    = 0xFFFF00, // four fields for different type classes, if more classes are added we need to increase the number of fields here
 };
 
 constexpr inline size_t operator+(TypeClass typeClass, size_t val) {
@@ -262,6 +344,10 @@ enum class Type : size_t {
   float32  = TypeClass::float_type + 4u,
   float64  = TypeClass::float_type + 8u,
 
+  bfloat16 = TypeClass::float_type + 2u + TypeClass::bfloat_type, // storage type only, not dispatched to kernels
+  int8rows = TypeClass::signed_type + 1u + TypeClass::rowscale_type, // int8 matrix [rows, cols] followed by one float32 scale per row, storage type of embeddings read by rows() only
+  int8cols = TypeClass::signed_type + 1u + TypeClass::colscale_type, // int8 matrix [rows, cols] stored transposed and followed by one float32 scale per column, weights of the int8 GEMM on the GPU
+
   packed16            = TypeClass::packed_type + 2u,                                   // special type for FBGEMM, not meant to be used anywhere else, not meant to be accessed invidually. Internal actual type (uint16) is meaningless.
   packed8avx2         = TypeClass::packed_type + 1u + TypeClass::avx2_type,            // special type for FBGEMM with AVX2, not meant to be used anywhere else, not meant to be accessed invidually. Internal actual type (uint8) is meaningless.
   packed8avx512       = TypeClass::packed_type + 1u + TypeClass::avx512_type,          // special type for FBGEMM with AVX512, not meant to be used anywhere else, not meant to be accessed invidually. Internal actual type (uint8) is meaningless.
@@ -273,6 +359,7 @@ enum class Type : size_t {
   intgemm8avx2        = TypeClass::intgemm_type + 1u + TypeClass::avx2_type,           // Int8 quantized and packed (avx2) matrices for intgemm
   intgemm8avx512      = TypeClass::intgemm_type + 1u + TypeClass::avx512_type,         // Int8 quantized and packed (avx512) matrices for intgemm
   intgemm8avx512vnni  = TypeClass::intgemm_type + 1u + TypeClass::avx512_type + 4096u, // Int8 quantized and packed (avx512) matrices for intgemm. VNNI algorithm
+  intgemm8amx         = TypeClass::intgemm_type + 1u + TypeClass::amx_type,            // Int8 quantized and packed (AMX tiles) matrices, see tensors/cpu/amx_gemm.h
 
   intgemm16sse2       = TypeClass::intgemm_type + 2u + TypeClass::sse2_type,           // Int16 quantized and packed (sse2) matrices for intgemm
   intgemm16avx2       = TypeClass::intgemm_type + 2u + TypeClass::avx2_type,           // Int16 quantized and packed (avx2) matrices for intgemm
@@ -327,10 +414,22 @@ static inline bool isAvx512(Type type) {
   return (TypeClass::avx512_type & type) != 0;
 }
 
+static inline bool isAmx(Type type) {
+  return (TypeClass::amx_type & type) != 0;
+}
+
 static inline bool isIntgemm(Type type) {
   return (TypeClass::intgemm_type & type) != 0;
 }
 
+static inline bool isRowQuantized(Type type) {
+  return (TypeClass::rowscale_type & type) != 0;
+}
+
+static inline bool isColQuantized(Type type) {
+  return (TypeClass::colscale_type & type) != 0;
+}
+
 size_t requiredBytes(const Shape& shape, Type type); // towards Frank's vision of joint Shape/Type
 
 template <typename T>
@@ -351,6 +450,7 @@ template <> inline bool matchType<uint64_t>(Type type) { return type == Type::ui
 template <> inline bool matchType<float16>(Type type)              { return type == Type::float16;             }
 template <> inline bool matchType<float>(Type type)                { return type == Type::float32;             }
 template <> inline bool matchType<double>(Type type)               { return type == Type::float64;             }
+template <> inline bool matchType<bfloat16>(Type type)             { return type == Type::bfloat16;            }
 
 template <> inline bool matchType<packed16>(Type type)             { return type == Type::packed16;            }
 template <> inline bool matchType<packed8avx2>(Type type)          { return type == Type::packed8avx2;         }
@@ -361,6 +461,7 @@ template <> inline bool matchType<intgemm8ssse3>(Type type)        { return type
 template <> inline bool matchType<intgemm8avx2>(Type type)         { return type == Type::intgemm8avx2;        }
 template <> inline bool matchType<intgemm8avx512>(Type type)       { return type == Type::intgemm8avx512;      }
 template <> inline bool matchType<intgemm8avx512vnni>(Type type)   { return type == Type::intgemm8avx512vnni;  }
+template <> inline bool matchType<intgemm8amx>(Type type)          { return type == Type::intgemm8amx;         }
 
 template <> inline bool matchType<intgemm16>(Type type)            { return type == Type::intgemm16;           }
 template <> inline bool matchType<intgemm16sse2>(Type type)        { return type == Type::intgemm16sse2;       }
@@ -383,6 +484,9 @@ static inline std::ostream& operator<<(std::ostream& out, Type type) {
     case Type::float16 : out << "float16"; break;
     case Type::float32 : out << "float32"; break;
     case Type::float64 : out << "float64"; break;
+    case Type::bfloat16: out << "bfloat16"; break;
+    case Type::int8rows: out << "int8rows"; break;
+    case Type::int8cols: out << "int8cols"; break;
 
     case Type::packed16      : out << "packed16"; break;
     case Type::packed8avx2   : out << "packed8avx2"; break;
@@ -393,6 +497,7 @@ static inline std::ostream& operator<<(std::ostream& out, Type type) {
     case Type::intgemm8avx2        : out << "intgemm8avx2"; break;
     case Type::intgemm8avx512      : out << "intgemm8avx512"; break;
     case Type::intgemm8avx512vnni  : out << "intgemm8avx512vnni"; break;
+    case Type::intgemm8amx         : out << "intgemm8amx"; break;
     case Type::intgemm16           : out << "intgemm16"; break;
     case Type::intgemm16sse2       : out << "intgemm16sse2"; break;
     case Type::intgemm16avx2       : out << "intgemm16avx2"; break;
@@ -418,6 +523,7 @@ template <> inline std::string request<uint64_t>() { return "uint64"; }
 template <> inline std::string request<float16>()  { return "float16"; }
 template <> inline std::string request<float>()    { return "float32"; }
 template <> inline std::string request<double>()   { return "float64"; }
+template <> inline std::string request<bfloat16>() { return "bfloat16"; }
 
 template <> inline std::string request<packed16>()      { return "packed16";      }
 template <> inline std::string request<packed8avx2>()   { return "packed8avx2";   }
@@ -428,6 +534,7 @@ template <> inline std::string request<intgemm8ssse3>()       { return "intgemm8
 template <> inline std::string request<intgemm8avx2>()        { return "intgemm8avx2";    }
 template <> inline std::string request<intgemm8avx512>()      { return "intgemm8avx512";  }
 template <> inline std::string request<intgemm8avx512vnni>()  { return "intgemm8avx512vnni";  }
+template <> inline std::string request<intgemm8amx>()         { return "intgemm8amx";     }
 template <> inline std::string request<intgemm16>()           { return "intgemm16";       }
 template <> inline std::string request<intgemm16sse2>()       { return "intgemm16sse2";   }
 template <> inline std::string request<intgemm16avx2>()       { return "intgemm16avx2";   }
@@ -459,6 +566,12 @@ static Type inline typeFromString(const std::string& str) {
     return Type::float32;
   if(str == "float64")
     return Type::float64;
+  if(str == "bfloat16")
+    return Type::bfloat16;
+  if(str == "int8rows")
+    return Type::int8rows;
+  if(str == "int8cols")
+    return Type::int8cols;
 
   if(str == "packed16")
     return Type::packed16;
@@ -477,6 +590,8 @@ static Type inline typeFromString(const std::string& str) {
     return Type::intgemm8avx512;
   if(str == "intgemm8avx512vnni")
     return Type::intgemm8avx512vnni;
+  if(str == "intgemm8amx")
+    return Type::intgemm8amx;
 
   if(str == "intgemm16")
     return Type::intgemm16;
@@ -506,6 +621,7 @@ template <> inline Type typeId<uint64_t>() { return Type::uint64; }
 template <> inline Type typeId<float16>()  { return Type::float16; }
 template <> inline Type typeId<float>()    { return Type::float32; }
 template <> inline Type typeId<double>()   { return Type::float64; }
+template <> inline Type typeId<bfloat16>() { return Type::bfloat16; }
 
 template <> inline Type typeId<packed16>()      { return Type::packed16;      }
 template <> inline Type typeId<packed8avx2>()   { return Type::packed8avx2;   }
@@ -516,6 +632,7 @@ template <> inline Type typeId<intgemm8ssse3>()       { return Type::intgemm8sss
 template <> inline Type typeId<intgemm8avx2>()        { return Type::intgemm8avx2;        }
 template <> inline Type typeId<intgemm8avx512>()      { return Type::intgemm8avx512;      }
 template <> inline Type typeId<intgemm8avx512vnni>()  { return Type::intgemm8avx512vnni;  }
+template <> inline Type typeId<intgemm8amx>()         { return Type::intgemm8amx;         }
 template <> inline Type typeId<intgemm16>()           { return Type::intgemm16;           }
 template <> inline Type typeId<intgemm16sse2>()       { return Type::intgemm16sse2;       }
 template <> inline Type typeId<intgemm16avx2>()       { return Type::intgemm16avx2;       }
@@ -3,14 +3,29 @@
 #include "CLI/StringTools.hpp"
 
 #include <stdio.h>
+#include <cstring>
 #include <array>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <set>
+#include <fstream>
+#include <thread>
 #if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
 #include <unistd.h>
 #endif
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <psapi.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include <codecvt>
 #include <cwctype>
 
@@ -89,6 +104,28 @@ void splitTsv(const std::string& line, std::vector<std::string>& fields, size_t
   ABORT_IF(pos != std::string::npos, "Excessive field(s) in the tab-separated line: '{}'", line);
 }
 
+void splitTsv(const std::string& line, std::vector<StringRange>& fields, size_t numFields) {
+  fields.clear();
+
+  const char* begin = line.data();
+  const char* end = line.data() + line.size();
+  const char* pos = nullptr;
+  for(size_t i = 0; i < numFields; ++i) {
+    pos = (const char*)memchr(begin, '\t', end - begin);
+    if(!pos) {
+      fields.emplace_back(begin, end - begin);
+      break;
+    }
+    fields.emplace_back(begin, pos - begin);
+    begin = pos + 1;
+  }
+
+  if(fields.size() < numFields)  // make sure there is as many elements as requested
+    fields.resize(numFields);
+
+  ABORT_IF(pos != nullptr, "Excessive field(s) in the tab-separated line: '{}'", line);
+}
+
 std::vector<std::string> split(const std::string& line,
                                const std::string& del /*= " "*/,
                                bool keepEmpty /*= false*/,
@@ -195,6 +232,82 @@ std::pair<std::string, int> hostnameAndProcessId() {  // helper to get hostname:
   return {hostname, processId};
 }
 
+size_t peakResidentMemory() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return counters.PeakWorkingSetSize;
+  return 0;
+#else
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return (size_t)usage.ru_maxrss; // bytes
+#else
+  return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+std::vector<std::vector<int>> numaNodeCpus() {
+  std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+  // lists like "0-15,32-47" in sysfs
+  for(int node = 0;; ++node) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if(!std::getline(in, list))
+      break;
+    std::vector<int> cpus;
+    for(const auto& range : split(list, ",")) {
+      auto bounds = split(range, "-");
+      if(bounds.empty())
+        continue;
+      int first = std::stoi(bounds[0]), last = std::stoi(bounds.back());
+      for(int cpu = first; cpu <= last; ++cpu)
+        cpus.push_back(cpu);
+    }
+    if(!cpus.empty())
+      nodes.push_back(cpus);
+  }
+#endif
+  if(nodes.empty()) {
+    nodes.emplace_back();
+    for(int cpu = 0; cpu < (int)std::thread::hardware_concurrency(); ++cpu)
+      nodes.back().push_back(cpu);
+  }
+  return nodes;
+}
+
+int pinThreadToCore(size_t idx, int* node) {
+#ifdef __linux__
+  static const auto nodes = numaNodeCpus();
+  size_t n = idx % nodes.size();
+  const auto& cpus = nodes[n];
+  if(cpus.empty())
+    return -1;
+  int cpu = cpus[(idx / nodes.size()) % cpus.size()];
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    return -1;
+  if(node)
+    *node = (int)n;
+  return cpu;
+#else
+  idx; node;
+  return -1;
+#endif
+}
+
+int numaNodeOfCore(size_t idx) {
+  static const auto nodes = numaNodeCpus();
+  return (int)(idx % nodes.size());
+}
+
 // format a long number with comma separators
 std::string withCommas(size_t n) {
   std::string res = std::to_string(n);
@@ -20,8 +20,23 @@ void splitAny(const std::string& line,
               const std::string& del = " ",
               bool keepEmpty = false);
 
+// Non-owning reference to a range of characters, e.g. a field of a line. The referenced string
+// must outlive it.
+struct StringRange {
+  const char* data{nullptr};
+  size_t size{0};
+
+  StringRange() {}
+  StringRange(const char* data, size_t size) : data(data), size(size) {}
+  StringRange(const std::string& s) : data(s.data()), size(s.size()) {}
+
+  std::string str() const { return std::string(data, size); }
+};
+
 // Split tab-separated line into the specified number of fields
 void splitTsv(const std::string& line, std::vector<std::string>& fields, size_t numFields);
+// Same as above, but the fields refer to the characters of the line instead of copying them
+void splitTsv(const std::string& line, std::vector<StringRange>& fields, size_t numFields);
 
 std::vector<std::string> split(const std::string& line,
                                const std::string& del = " ",
@@ -42,6 +57,18 @@ std::string exec(const std::string& cmd, const std::vector<std::string>& args =
 
 std::pair<std::string, int> hostnameAndProcessId();
 
+// Largest resident host memory of this process so far in bytes, 0 if unknown
+size_t peakResidentMemory();
+
+// CPUs of each NUMA node, a single node with all CPUs if unknown
+std::vector<std::vector<int>> numaNodeCpus();
+// Pins the calling thread to the core for index idx: consecutive indices are spread round-robin over
+// the NUMA nodes and then over the cores of each node. Returns the core and sets node, or returns -1
+// if the thread could not be pinned, e.g. on other systems than Linux.
+int pinThreadToCore(size_t idx, int* node = nullptr);
+// NUMA node of the core that pinThreadToCore(idx) pins to
+int numaNodeOfCore(size_t idx);
+
 std::string withCommas(size_t n);
 bool beginsWith(const std::string& text, const std::string& prefix);
 bool endsWith(const std::string& text, const std::string& suffix);
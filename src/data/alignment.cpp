@@ -1,4 +1,5 @@
 #include "data/alignment.h"
+#include "common/logging.h"
 #include "common/utils.h"
 
 #include <algorithm>
@@ -10,10 +11,38 @@ WordAlignment::WordAlignment() {}
 
 WordAlignment::WordAlignment(const std::vector<Point>& align) : data_(align) {}
 
-WordAlignment::WordAlignment(const std::string& line) {
-  std::vector<std::string> atok = utils::splitAny(line, " -");
-  for(size_t i = 0; i < atok.size(); i += 2)
-    data_.emplace_back(Point{ (size_t)std::stoi(atok[i]), (size_t)std::stoi(atok[i + 1]), 1.f });
+WordAlignment::WordAlignment(const std::string& line) : WordAlignment(line.data(), line.size()) {}
+
+static inline bool isAlignmentSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// parses the decimal position at p and advances p behind it
+static inline size_t parseAlignmentPosition(const char*& p, const char* end, const char* line, size_t size) {
+  const char* begin = p;
+  size_t pos = 0;
+  for(; p != end && *p >= '0' && *p <= '9'; ++p)
+    pos = pos * 10 + (size_t)(*p - '0');
+  ABORT_IF(p == begin, "Invalid alignment '{}', expected pairs like 0-0", std::string(line, size));
+  return pos;
+}
+
+WordAlignment::WordAlignment(const char* line, size_t size) {
+  const char* p = line;
+  const char* end = line + size;
+  data_.reserve(size / 4); // "s-t " is at least 4 characters per point
+  for(;;) {
+    while(p != end && isAlignmentSpace(*p))
+      ++p;
+    if(p == end)
+      break;
+    size_t srcPos = parseAlignmentPosition(p, end, line, size);
+    ABORT_IF(p == end || *p != '-', "Invalid alignment '{}', expected pairs like 0-0", std::string(line, size));
+    ++p;
+    size_t tgtPos = parseAlignmentPosition(p, end, line, size);
+    ABORT_IF(p != end && !isAlignmentSpace(*p), "Invalid alignment '{}', expected pairs like 0-0", std::string(line, size));
+    data_.emplace_back(Point{ srcPos, tgtPos, 1.f });
+  }
 }
 
 void WordAlignment::sort() {
@@ -22,17 +51,31 @@ void WordAlignment::sort() {
   });
 }
 
+// appends the decimal digits of pos
+static inline void appendAlignmentPosition(std::string& str, size_t pos) {
+  char digits[20];
+  char* p = digits + sizeof(digits);
+  do {
+    *--p = (char)('0' + pos % 10);
+    pos /= 10;
+  } while(pos > 0);
+  str.append(p, digits + sizeof(digits));
+}
+
 std::string WordAlignment::toString() const {
-  std::stringstream str;
+  std::string str;
+  str.reserve(data_.size() * 6);
   for(auto p = begin(); p != end(); ++p) {
     if(p != begin())
-      str << " ";
-    str << p->srcPos << "-" << p->tgtPos;
+      str.push_back(' ');
+    appendAlignmentPosition(str, p->srcPos);
+    str.push_back('-');
+    appendAlignmentPosition(str, p->tgtPos);
   }
-  return str.str();
+  return str;
 }
 
-WordAlignment ConvertSoftAlignToHardAlign(SoftAlignment alignSoft,
+WordAlignment ConvertSoftAlignToHardAlign(const SoftAlignment& alignSoft,
                                           float threshold /*= 1.f*/) {
   WordAlignment align;
   // Alignments by maximum value
@@ -65,7 +108,7 @@ WordAlignment ConvertSoftAlignToHardAlign(SoftAlignment alignSoft,
   return align;
 }
 
-std::string SoftAlignToString(SoftAlignment align) {
+std::string SoftAlignToString(const SoftAlignment& align) {
   std::stringstream str;
   bool first = true;
   for(size_t t = 0; t < align.size(); ++t) {
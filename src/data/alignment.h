@@ -32,7 +32,13 @@ public:
    *
    * @param line String in the form of "0-0 1-1 1-2", etc.
    */
-  WordAlignment(const std::string& line);
+  explicit WordAlignment(const std::string& line);
+
+  /**
+   * @brief Constructs word alignments from textual representation in a character range,
+   * parsed in a single pass without intermediate strings. Aborts on malformed input.
+   */
+  WordAlignment(const char* line, size_t size);
 
   auto begin() const -> decltype(data_.begin()) { return data_.begin(); }
   auto end()   const -> decltype(data_.end())   { return data_.end(); }
@@ -56,10 +62,10 @@ public:
 // Also used on QuickSAND boundary where beam and batch size is 1. Then it is simply [t][s] -> P(s|t)
 typedef std::vector<std::vector<float>> SoftAlignment; // [trg pos][beam depth * max src length * batch size]
 
-WordAlignment ConvertSoftAlignToHardAlign(SoftAlignment alignSoft,
+WordAlignment ConvertSoftAlignToHardAlign(const SoftAlignment& alignSoft,
                                           float threshold = 1.f);
 
-std::string SoftAlignToString(SoftAlignment align);
+std::string SoftAlignToString(const SoftAlignment& align);
 
 }  // namespace data
 }  // namespace marian
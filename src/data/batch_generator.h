@@ -2,6 +2,9 @@
 
 #include "common/options.h"
 #include "common/signal_handling.h"
+#include "common/timer.h"
+#include "common/tracer.h"
+#include "common/utils.h"
 #include "data/batch_stats.h"
 #include "data/rng_engine.h"
 #include "training/training_state.h"
@@ -12,6 +15,7 @@
 #include <deque>
 #include <functional>
 #include <mutex>
+#include <numeric>
 #include <queue>
 
 namespace marian {
@@ -86,12 +90,132 @@ private:
   typename DataSet::iterator current_;
   bool newlyPrepared_{ true }; // prepare() was just called: we need to reset current_  --@TODO: can we just reset it directly?
 
+  // for resuming training at the current swath instead of replaying the whole epoch
+  struct SwathState {
+    size_t batches{0};  // batches returned by next() in this epoch before this swath
+    size_t position{0}; // position of the dataset before reading this swath
+    std::string seed;   // state of eng_ before the batches of this swath were shuffled
+  };
+
   // variables for multi-threaded pre-fetching
-  mutable UPtr<ThreadPool> threadPool_; // (we only use one thread, but keep it around)
-  std::future<std::deque<BatchPtr>> futureBufferedBatches_; // next swath of batches is returned via this
+  // Swaths are read one after another from the same dataset iterator, so a single thread fetches
+  // them in order; up to prefetch_ swaths are queued ahead of the one next() reads from.
+  typedef std::pair<std::deque<BatchPtr>, SwathState> FetchedSwath;
+  mutable UPtr<ThreadPool> threadPool_;
+  std::deque<std::future<FetchedSwath>> futureBufferedBatches_; // next swaths of batches, oldest first
+  size_t prefetch_{1};
+
+  // how often and for how long next() had to wait for the background thread
+  size_t dataWaits_{0};
+  double dataWaitSeconds_{0};
+  SwathState fetchedSwath_;     // of the swath produced by the last fetchBatches()
+  std::deque<SwathState> swaths_; // swaths that may be in training, oldest first
+  size_t batchesEpoch_{0};      // batches returned by next() in this epoch
+  std::mutex swathMutex_;
+
+  // source tokens in all batches so far, without and with padding
+  size_t realWords_{0};
+  size_t paddedWords_{0};
+
+  // --length-curriculum: short-first curriculum over the first batches of the first epoch
+  size_t curriculumBatches_{0};
+  float curriculumStart_{0.1f};
+  size_t epochsPrepared_{0};       // epoch that prepare() or restore() last started
+  size_t fetchedBatchesEpoch_{0};  // batches fetched in this epoch before the current swath
+
+  // batching options, read once by the constructor instead of on the background thread for every swath
+  size_t miniBatch_{0};
+  size_t maxiBatch_{0};
+  size_t miniBatchWords_{0};       // 0 if not given
+  bool miniBatchFit_{false};
+  std::string maxiBatchSort_;      // "none" if not given
+  size_t idleFlush_{0};            // milliseconds, 0 waits for full maxi-batches
+  size_t lengthBucketWidth_{0};
+
+  // The fraction of the shortest batches of a swath that the model is ready for, with the square-root
+  // competence of Platanios et al. (2019): it grows from curriculumStart_ to 1 over curriculumBatches_
+  float curriculumCompetence() const {
+    if(curriculumBatches_ == 0 || epochsPrepared_ > 1 || fetchedBatchesEpoch_ >= curriculumBatches_)
+      return 1.f;
+    double c0 = curriculumStart_;
+    return (float)std::min(1., std::sqrt((double)fetchedBatchesEpoch_ * (1. - c0 * c0) / curriculumBatches_ + c0 * c0));
+  }
+
+  // Orders the batches of a swath for the curriculum: the shortest competence fraction of them come
+  // first, shuffled if batches are shuffled, then the others by increasing average source length.
+  // All batches of the swath are still trained on.
+  void orderForCurriculum(std::deque<BatchPtr>& batches, float competence) {
+    auto length = [](const BatchPtr& batch) { return (double)batch->words() / std::max(batch->size(), (size_t)1); };
+    std::stable_sort(batches.begin(), batches.end(), [&](const BatchPtr& a, const BatchPtr& b) {
+      return length(a) < length(b);
+    });
+    size_t ready = std::max((size_t)std::ceil(competence * batches.size()), (size_t)1);
+    if(shuffleBatches_)
+      std::shuffle(batches.begin(), batches.begin() + std::min(ready, batches.size()), eng_);
+  }
+
+  void addBatch(const Samples& batchVector, std::deque<BatchPtr>& batches) {
+    size_t maxLength = 0;
+    for(const auto& sample : batchVector) {
+      realWords_ += sample[0].size();
+      maxLength = std::max(maxLength, sample[0].size());
+    }
+    paddedWords_ += maxLength * batchVector.size();
+    batches.push_back(data_->toBatch(batchVector));
+  }
+
+  // Inference only: groups the sentences of a maxi-batch by source length into buckets of
+  // bucketWidth words, e.g. lengths 1-7, 8-15, 16-23, ... for a width of 8, and cuts batches from each
+  // bucket separately, so that sentences of very different lengths never share a batch. A batch
+  // holds at most --mini-batch sentences and, with --mini-batch-words, at most that many source
+  // words including padding. Sentences keep their reading order within a bucket.
+  void fetchBucketedBatches(const Samples& samples, size_t bucketWidth, std::deque<BatchPtr>& batches) {
+    size_t maxLength = 0;
+    for(const auto& sample : samples)
+      maxLength = std::max(maxLength, sample[0].size());
+
+    // counting sort into buckets, linear in the number of sentences
+    size_t numBuckets = maxLength / bucketWidth + 1;
+    std::vector<size_t> offsets(numBuckets + 1, 0);
+    for(const auto& sample : samples)
+      offsets[sample[0].size() / bucketWidth + 1]++;
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<const Sample*> sorted(samples.size());
+    auto pos = offsets;
+    for(const auto& sample : samples)
+      sorted[pos[sample[0].size() / bucketWidth]++] = &sample;
+
+    const size_t maxBatchSize = miniBatch_;
+    const size_t mbWords = miniBatchWords_;
+
+    Samples batchVector;
+    size_t batchLength = 0; // longest source in batchVector
+    for(size_t bucket = 0; bucket < numBuckets; ++bucket) {
+      for(size_t i = offsets[bucket]; i < offsets[bucket + 1]; ++i) {
+        const auto& sample = *sorted[i];
+        size_t length = std::max(batchLength, sample[0].size());
+        bool full = batchVector.size() >= maxBatchSize
+                    || (mbWords > 0 && length * (batchVector.size() + 1) > mbWords);
+        if(full && !batchVector.empty()) {
+          addBatch(batchVector, batches);
+          batchVector.clear();
+          length = sample[0].size();
+        }
+        batchVector.push_back(sample);
+        batchLength = length;
+      }
+      // never carry sentences over into the batches of the next bucket
+      if(!batchVector.empty()) {
+        addBatch(batchVector, batches);
+        batchVector.clear();
+        batchLength = 0;
+      }
+    }
+  }
 
   // this runs on a bg thread; sequencing is handled by caller, but locking is done in here
   std::deque<BatchPtr> fetchBatches() {
+    tracing::Span span("data", "fetchBatches");
     typedef typename Sample::value_type Item;
     auto itemCmp = [](const Item& sa, const Item& sb) { return sa.size() < sb.size(); }; // sort by element length, not content
 
@@ -112,19 +236,19 @@ private:
 
     std::unique_ptr<sample_queue> maxiBatch; // priority queue, shortest first
 
-    if(options_->has("maxi-batch-sort")) {
-      if(options_->get<std::string>("maxi-batch-sort") == "src")
-        maxiBatch.reset(new sample_queue(cmpSrc));
-      else if(options_->get<std::string>("maxi-batch-sort") == "none")
-        maxiBatch.reset(new sample_queue(cmpNone));
-      else
-        maxiBatch.reset(new sample_queue(cmpTrg));
-    } else {
+    if(maxiBatchSort_ == "src")
+      maxiBatch.reset(new sample_queue(cmpSrc));
+    else if(maxiBatchSort_ == "none")
       maxiBatch.reset(new sample_queue(cmpNone));
-    }
+    else
+      maxiBatch.reset(new sample_queue(cmpTrg));
+
+    size_t maxBatchSize = miniBatch_;
+    size_t maxSize = maxBatchSize * maxiBatch_;
 
-    size_t maxBatchSize = options_->get<int>("mini-batch");
-    size_t maxSize = maxBatchSize * options_->get<int>("maxi-batch");
+    // remember where this swath starts, before anything is read or shuffled
+    fetchedSwath_.position = data_->getPosition();
+    fetchedSwath_.seed = shuffleBatches_ ? getRNGState() : "";
 
     // consume data from corpus into maxi-batch (single sentences)
     // sorted into specified order (due to queue)
@@ -135,19 +259,30 @@ private:
       if(current_ != data_->end())
         ++current_;
     }
+    // with length buckets, sentences are read in order and bucketed without sorting
+    const size_t bucketWidth = lengthBucketWidth_;
+    Samples bucketSamples;
+
     size_t sets = 0;
-    while(current_ != data_->end() && maxiBatch->size() < maxSize) { // loop over data
+    size_t numSentencesRead = 0;
+    while(current_ != data_->end() && numSentencesRead < maxSize) { // loop over data
       if (saveAndExitRequested()) // stop generating batches
         return std::deque<BatchPtr>();
-      maxiBatch->push(*current_);
+      if(bucketWidth > 0)
+        bucketSamples.push_back(*current_);
+      else
+        maxiBatch->push(*current_);
+      numSentencesRead++;
       sets = current_->size();
       // do not consume more than required for the maxi batch as this causes
       // that line-by-line translation is delayed by one sentence
-      bool last = maxiBatch->size() == maxSize;
+      bool last = numSentencesRead == maxSize;
+      // with --input-idle-flush, what has been read is translated when the input pauses
+      if(!last && idleFlush_ > 0 && !data_->waitForInput(idleFlush_))
+        break;
       if(!last)
         ++current_; // this actually reads the next line and pre-processes it
     }
-    size_t numSentencesRead = maxiBatch->size();
 
     // construct the actual batches and place them in the queue
     Samples batchVector;
@@ -156,10 +291,13 @@ private:
 
     std::deque<BatchPtr> tempBatches;
 
+    if(bucketWidth > 0)
+      fetchBucketedBatches(bucketSamples, bucketWidth, tempBatches);
+
     // process all loaded sentences in order of increasing length
     // @TODO: we could just use a vector and do a sort() here; would make the cost more explicit
-    const size_t mbWords = options_->get<size_t>("mini-batch-words", 0);
-    const bool useDynamicBatching = options_->has("mini-batch-fit");
+    const size_t mbWords = miniBatchWords_;
+    const bool useDynamicBatching = miniBatchFit_;
     BatchStats::const_iterator cachedStatsIter;
     if (stats_)
       cachedStatsIter = stats_->begin();
@@ -200,7 +338,7 @@ private:
 
       // if we reached the desired batch size then create a real batch
       if(makeBatch) {
-        tempBatches.push_back(data_->toBatch(batchVector));
+        addBatch(batchVector, tempBatches);
 
         // prepare for next batch
         batchVector.clear();
@@ -216,12 +354,17 @@ private:
     // inflate the contribution of the sames in the batch, causing instability.
     // I think a good alternative would be to carry over the left-over sentences into the next round.
     if(!batchVector.empty())
-      tempBatches.push_back(data_->toBatch(batchVector));
+      addBatch(batchVector, tempBatches);
 
     // Shuffle the batches
-    if(shuffleBatches_) {
+    float competence = curriculumCompetence();
+    if(competence < 1.f) {
+      LOG(debug, "[data] Curriculum competence {:.3f} after {} batches", competence, fetchedBatchesEpoch_);
+      orderForCurriculum(tempBatches, competence);
+    } else if(shuffleBatches_) {
       std::shuffle(tempBatches.begin(), tempBatches.end(), eng_);
     }
+    fetchedBatchesEpoch_ += tempBatches.size();
     double totalSent{}, totalLabels{};
     for (auto& b : tempBatches) {
       totalSent += (double)b->size();
@@ -231,17 +374,35 @@ private:
     LOG(debug, "[data] fetched {} batches with {} sentences. Per batch: {} sentences, {} labels.",
         tempBatches.size(), numSentencesRead,
         (double)totalSent / (double)totalDenom, (double)totalLabels / (double)totalDenom);
+    if(current_ == data_->end() && !tempBatches.empty()) { // summary after the last swath
+      if(bucketWidth > 0)
+        LOG(info, "[data] Padding efficiency: {:.2f}% ({} of {} source positions are words)",
+            100.0 * realWords_ / paddedWords_, realWords_, paddedWords_);
+      else
+        LOG(debug, "[data] Padding efficiency: {:.2f}% ({} of {} source positions are words)",
+            100.0 * realWords_ / paddedWords_, realWords_, paddedWords_);
+    }
     return tempBatches;
   }
 
-  // this starts fillBatches() as a background operation
+  // this starts fetchBatches() as background operations until prefetch_ swaths are pending
   void fetchBatchesAsync() {
-    ABORT_IF(futureBufferedBatches_.valid(), "Attempted to restart futureBufferedBatches_ while still running");
     ABORT_IF(!runAsync_, "Trying to run fetchBatchesAsync() but runAsync_ is false??");
     ABORT_IF(!threadPool_, "Trying to run fetchBatchesAsync() without initialized threadPool_??");
-    futureBufferedBatches_ = threadPool_->enqueue([this]() {
-      return fetchBatches();
-    });
+    while(futureBufferedBatches_.size() < prefetch_) {
+      futureBufferedBatches_.push_back(threadPool_->enqueue([this]() {
+        // fetchedSwath_ is only written by fetchBatches() on this thread
+        auto batches = fetchBatches();
+        return FetchedSwath(std::move(batches), fetchedSwath_);
+      }));
+    }
+  }
+
+  // waits for all pending background operations and discards their batches
+  void discardPrefetched() {
+    for(auto& future : futureBufferedBatches_)
+      future.wait();
+    futureBufferedBatches_.clear();
   }
 
   BatchPtr next() {
@@ -249,14 +410,26 @@ private:
       if(runAsync_) { // by default we will run in asynchronous mode
         // out of data: need to get next batch from background thread
         // We only get here if the future has been scheduled to run; it must be valid.
-        ABORT_IF(!futureBufferedBatches_.valid(), "Attempted to wait for futureBufferedBatches_ when none pending.\n"
+        ABORT_IF(futureBufferedBatches_.empty(), "Attempted to wait for futureBufferedBatches_ when none pending.\n"
             "This error often occurs when Marian tries to restore the training data iterator, but the corpus has been changed or replaced.\n"
             "If you have changed the training corpus, add --no-restore-corpus to the training command and run it again.");
-        bufferedBatches_ = std::move(futureBufferedBatches_.get());
+        auto& future = futureBufferedBatches_.front();
+        if(future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+          timer::Timer timer;
+          tracing::Span span("data", "waitForBatches");
+          future.wait();
+          dataWaits_++;
+          dataWaitSeconds_ += timer.elapsed();
+        }
+        auto fetched = future.get();
+        futureBufferedBatches_.pop_front();
+        bufferedBatches_ = std::move(fetched.first);
         // if bg thread returns an empty swath, we hit the end of the epoch
         if (bufferedBatches_.empty() || saveAndExitRequested()) {
+          discardPrefetched(); // swaths fetched after the end are empty as well
           return nullptr;
         }
+        beginSwath(fetched.second);
         // and kick off the next bg operation
         fetchBatchesAsync();
       } else { // don't spawn any threads, i.e. batch fetching is blocking.
@@ -265,14 +438,62 @@ private:
         if (bufferedBatches_.empty() || saveAndExitRequested()) {
           return nullptr;
         }
+        beginSwath(fetchedSwath_);
       }
     }
     
     auto batch = bufferedBatches_.front();
     bufferedBatches_.pop_front();
+    batchesEpoch_++;
     return batch;
   }
 
+  // called when next() starts to return the batches of the given swath
+  void beginSwath(SwathState swath) {
+    std::lock_guard<std::mutex> lock(swathMutex_);
+    swath.batches = batchesEpoch_;
+    swaths_.push_back(std::move(swath));
+  }
+
+  // shuffles or resets the data for a new epoch
+  void prepareData() {
+    discardPrefetched(); // background operations must not read while the data is reset
+    if(shuffleData_)
+      data_->shuffle();
+    else
+      data_->reset();
+    newlyPrepared_ = true;
+    fetchedBatchesEpoch_ = 0;
+
+    std::lock_guard<std::mutex> lock(swathMutex_);
+    swaths_.clear();
+    batchesEpoch_ = 0;
+  }
+
+protected:
+  // Stores the swath the batch number state.batchesEpoch belongs to in the training state.
+  // Swaths before it are no longer needed.
+  void saveSwath(TrainingState& state) {
+    std::lock_guard<std::mutex> lock(swathMutex_);
+    while(swaths_.size() > 1 && swaths_[1].batches <= state.batchesEpoch)
+      swaths_.pop_front();
+    if(swaths_.empty() || swaths_.front().batches > state.batchesEpoch)
+      return;
+    state.swathSaved    = true;
+    state.swathBatches  = swaths_.front().batches;
+    state.swathPosition = swaths_.front().position;
+    if(state.swathSeed != swaths_.front().seed)
+      state.swathSeed = swaths_.front().seed;
+  }
+
+  // Adds the waits for data since the last call to the display counters of the training state
+  void reportDataWaits(TrainingState& state) {
+    state.dataWaitsDisp       += dataWaits_;
+    state.dataWaitSecondsDisp += dataWaitSeconds_;
+    dataWaits_       = 0;
+    dataWaitSeconds_ = 0;
+  }
+
 public:
 
   BatchGenerator(Ptr<DataSet> data,
@@ -281,14 +502,24 @@ public:
                  bool runAsync = true)
       : data_(data), options_(options), stats_(stats), 
         runAsync_(runAsync), threadPool_(runAsync ? new ThreadPool(1) : nullptr) {
+    prefetch_ = std::max(options_->get<size_t>("data-prefetch", 1), (size_t)1);
     auto shuffle = options_->get<std::string>("shuffle", "none");
     shuffleData_ = shuffle == "data";
     shuffleBatches_ = shuffleData_ || shuffle == "batches";
+    curriculumBatches_ = options_->get<size_t>("length-curriculum", 0);
+    curriculumStart_ = options_->get<float>("length-curriculum-start", 0.1f);
+
+    miniBatch_ = options_->get<int>("mini-batch");
+    maxiBatch_ = options_->get<int>("maxi-batch");
+    miniBatchWords_ = options_->get<size_t>("mini-batch-words", 0);
+    miniBatchFit_ = options_->has("mini-batch-fit");
+    maxiBatchSort_ = options_->get<std::string>("maxi-batch-sort", "none");
+    lengthBucketWidth_ = options_->get<size_t>("length-bucket-width", 0);
+    idleFlush_ = options_->get<size_t>("input-idle-flush", 0);
   }
 
   ~BatchGenerator() {
-    if (futureBufferedBatches_.valid()) // bg thread holds a reference to 'this',
-      futureBufferedBatches_.get();     // so must wait for it to complete
+    discardPrefetched(); // bg thread holds a reference to 'this', so must wait for it to complete
   }
 
   iterator begin() {
@@ -301,11 +532,8 @@ public:
 
   // @TODO: get rid of this function, begin() or constructor should figure this out
   void prepare() {
-    if(shuffleData_)
-      data_->shuffle();
-    else
-      data_->reset();
-    newlyPrepared_ = true;
+    epochsPrepared_++;
+    prepareData();
 
     // start the background pre-fetch operation when running in asynchronous mode, otherwise we will fetch on demand.
     if(runAsync_)
@@ -328,8 +556,28 @@ public:
       setRNGState(state->seedBatch);
     }
 
-    prepare();
-    for(size_t i = 0; i < state->batchesEpoch; ++i)
+    epochsPrepared_ = state->epochs;
+    prepareData();
+
+    // continue reading at the beginning of the current swath if the data supports seeking,
+    // otherwise replay all batches of the epoch
+    size_t skipBatches = state->batchesEpoch;
+    if(state->swathSaved && state->swathBatches <= state->batchesEpoch
+       && data_->seek(state->swathPosition)) {
+      if(!state->swathSeed.empty())
+        setRNGState(state->swathSeed);
+      batchesEpoch_ = state->swathBatches;
+      fetchedBatchesEpoch_ = state->swathBatches; // swaths are fetched in the order they are trained on
+      skipBatches = state->batchesEpoch - state->swathBatches;
+      LOG(info,
+          "[data] Continuing after {} input records, skipping {} batches",
+          utils::withCommas(state->swathPosition),
+          skipBatches);
+    }
+
+    if(runAsync_)
+      fetchBatchesAsync();
+    for(size_t i = 0; i < skipBatches; ++i)
       next();
 
     return true;
@@ -337,8 +585,8 @@ public:
 
   // this is needed for dynamic MB scaling. Returns 0 if size is not known in words.
   size_t estimateTypicalTrgBatchWords() const {
-    const size_t mbWords = options_->get<size_t>("mini-batch-words", 0);
-    const bool useDynamicBatching = options_->has("mini-batch-fit");
+    const size_t mbWords = miniBatchWords_;
+    const bool useDynamicBatching = miniBatchFit_;
     if (useDynamicBatching && stats_)
       return stats_->estimateTypicalTrgWords();
     else if (mbWords)
@@ -360,6 +608,11 @@ public:
     state.seedBatch = getRNGState();
     state.seedCorpus = data_->getRNGState();
   }
+
+  void actAfterBatches(TrainingState& state) override {
+    saveSwath(state);
+    reportDataWaits(state);
+  }
 };
 }  // namespace data
 }  // namespace marian
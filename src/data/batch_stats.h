@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdio>
 #include <deque>
 #include <queue>
+#include <random>
 
 #include "data/corpus.h"
 #include "data/vocab.h"
@@ -49,6 +51,12 @@ public:
       map_[lengths] = batchSize;
   }
 
+  // scales all batch sizes, e.g. from one device to all devices
+  void multiply(double multiplier) {
+    for(auto& entry : map_)
+      entry.second = (size_t)ceil((double)entry.second * multiplier);
+  }
+
   // return a rough minibatch size in labels
   // We average over all (batch sizes * max trg length).
   size_t estimateTypicalTrgWords() const {
@@ -99,6 +107,29 @@ public:
     //dump();
   }
 
+  // Saves the statistics as a single line of their flattened form. The file is written under a
+  // temporary name and renamed, so that concurrent processes never read a partial file.
+  void save(const std::string& path) const {
+    std::string tempPath = path + ".tmp" + std::to_string(std::random_device()());
+    {
+      io::OutputFileStream out(tempPath);
+      for(auto value : flatten())
+        out << value << " ";
+      out << std::endl;
+    }
+    ABORT_IF(std::rename(tempPath.c_str(), path.c_str()) != 0, "Could not rename {} to {}", tempPath, path);
+  }
+
+  static Ptr<BatchStats> load(const std::string& path) {
+    io::InputFileStream in(path);
+    std::vector<size_t> flattened;
+    size_t value;
+    while(in >> value)
+      flattened.push_back(value);
+    ABORT_IF(flattened.empty(), "Empty batch statistics in {}", path);
+    return New<BatchStats>(flattened);
+  }
+
   void dump() { // (for debugging)
     for (const auto& entry : map_) {
       for (auto streamLen : entry.first)
@@ -0,0 +1,142 @@
+#include "data/binary_corpus.h"
+
+#include "common/logging.h"
+#include "common/utils.h"
+
+namespace marian {
+namespace data {
+
+static_assert(sizeof(Word) == sizeof(uint32_t), "Word ids are stored as uint32");
+
+// "MRNCRBIN" when read as little-endian bytes
+const uint64_t BinaryCorpus::MAGIC = 0x4e494252434e524dULL;
+
+BinaryCorpus::BinaryCorpus(const std::string& fileName) {
+  mmap_ = mio::mmap_source(fileName);
+  ABORT_IF(mmap_.size() < sizeof(Header), "Binary corpus {} is truncated", fileName);
+  header_ = *(const Header*)mmap_.data();
+  ABORT_IF(header_.magic != MAGIC, "File {} is not a binary corpus", fileName);
+
+  size_t headerSize = sizeof(Header) + header_.numStreams * sizeof(uint64_t);
+  ABORT_IF(header_.indexOffset < headerSize
+               || mmap_.size() != header_.indexOffset + header_.numSentences * sizeof(uint64_t),
+           "Binary corpus {} is truncated or corrupted",
+           fileName);
+
+  const uint64_t* vocabSizes = (const uint64_t*)(mmap_.data() + sizeof(Header));
+  vocabSizes_.assign(vocabSizes, vocabSizes + header_.numStreams);
+  offsets_ = (const uint64_t*)(mmap_.data() + header_.indexOffset);
+}
+
+bool BinaryCorpus::isBinary(const std::string& fileName) {
+  std::ifstream in(fileName, std::ios::binary);
+  uint64_t magic = 0;
+  in.read((char*)&magic, sizeof(magic));
+  return in && magic == MAGIC;
+}
+
+void BinaryCorpus::get(size_t id, std::vector<Field>& fields) const {
+  ABORT_IF(id >= size(), "Sentence {} is out of range of the binary corpus with {} sentences", id, size());
+  size_t numFields = header_.numStreams + (hasAlignment() ? 1 : 0) + (hasWeights() ? 1 : 0);
+
+  const uint32_t* pos = (const uint32_t*)(mmap_.data() + offsets_[id]);
+  fields.resize(numFields);
+  for(size_t i = 0; i < numFields; ++i) {
+    size_t size = *pos++;
+    if(hasAlignment() && i == header_.numStreams) // alignment points are pairs
+      size *= 2;
+    fields[i] = {pos, size};
+    pos += size;
+  }
+}
+
+WordAlignment BinaryCorpus::toAlignment(const Field& field) {
+  WordAlignment alignment;
+  for(size_t i = 0; i + 1 < field.size; i += 2)
+    alignment.push_back(field.data[i], field.data[i + 1], 1.f);
+  return alignment;
+}
+
+std::vector<float> BinaryCorpus::toWeights(const Field& field) {
+  const float* weights = (const float*)field.data;
+  return std::vector<float>(weights, weights + field.size);
+}
+
+BinaryCorpusWriter::BinaryCorpusWriter(const std::string& fileName,
+                                       const std::vector<size_t>& vocabSizes,
+                                       bool hasAlignment,
+                                       bool hasWeights,
+                                       const std::string& tempDir)
+    : fileName_(fileName),
+      out_(fileName, std::ios::binary),
+      offsets_(new io::TemporaryFile(tempDir)) {
+  ABORT_IF(!out_, "Cannot open {} for writing", fileName);
+
+  header_.magic        = BinaryCorpus::MAGIC;
+  header_.numSentences = 0;
+  header_.numStreams   = vocabSizes.size();
+  header_.hasAlignment = hasAlignment;
+  header_.hasWeights   = hasWeights;
+  header_.indexOffset  = 0; // set in finish()
+
+  out_.write((const char*)&header_, sizeof(header_));
+  for(uint64_t vocabSize : vocabSizes)
+    out_.write((const char*)&vocabSize, sizeof(vocabSize));
+  pos_ = sizeof(header_) + vocabSizes.size() * sizeof(uint64_t);
+}
+
+void BinaryCorpusWriter::writeField(const uint32_t* data, size_t size, size_t factor) {
+  uint32_t length = (uint32_t)size;
+  out_.write((const char*)&length, sizeof(length));
+  out_.write((const char*)data, size * factor * sizeof(uint32_t));
+  pos_ += (1 + size * factor) * sizeof(uint32_t);
+}
+
+void BinaryCorpusWriter::add(const std::vector<Words>& words,
+                             const WordAlignment& alignment /*= {}*/,
+                             const std::vector<float>& weights /*= {}*/) {
+  ABORT_IF(words.size() != header_.numStreams,
+           "Expected {} streams for the binary corpus, got {}",
+           header_.numStreams,
+           words.size());
+
+  offsets_->write((const char*)&pos_, sizeof(pos_));
+
+  for(const auto& w : words)
+    writeField((const uint32_t*)w.data(), w.size());
+
+  if(header_.hasAlignment) {
+    std::vector<uint32_t> points;
+    for(const auto& p : alignment) {
+      points.push_back((uint32_t)p.srcPos);
+      points.push_back((uint32_t)p.tgtPos);
+    }
+    writeField(points.data(), alignment.size(), /*factor=*/2);
+  }
+
+  if(header_.hasWeights)
+    writeField((const uint32_t*)weights.data(), weights.size());
+
+  header_.numSentences++;
+}
+
+void BinaryCorpusWriter::finish() {
+  header_.indexOffset = pos_;
+
+  // append the record offsets
+  offsets_->flush();
+  auto in = offsets_->getInputStream();
+  std::vector<char> buffer(1 << 20);
+  while(in->read(buffer.data(), buffer.size()) || in->gcount() > 0)
+    out_.write(buffer.data(), in->gcount());
+
+  out_.seekp(0);
+  out_.write((const char*)&header_, sizeof(header_));
+  out_.close();
+  ABORT_IF(!out_, "Error writing binary corpus to {}", fileName_);
+
+  LOG(info, "[data] Wrote {} sentences to binary corpus {}", utils::withCommas(header_.numSentences), fileName_);
+}
+
+}  // namespace data
+}  // namespace marian
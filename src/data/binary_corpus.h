@@ -0,0 +1,98 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/file_stream.h"
+#include "data/alignment.h"
+#include "data/types.h"
+
+#include "3rd_party/mio/mio.hpp"
+
+#include <fstream>
+#include <vector>
+
+namespace marian {
+namespace data {
+
+// Pre-tokenized training corpus for --binary-corpus. It stores the token ids of all input streams
+// and optionally word alignments and weights, so that training does not need to read, split and
+// encode the text in every epoch. The file is memory-mapped and sentences are accessed by index,
+// hence shuffling only permutes the indices.
+//
+// Layout: Header, uint64 vocabulary sizes [numStreams], records, uint64 record offsets [numSentences].
+// A record holds one field per input stream, then the word alignment and the weights if present.
+// Each field is a uint32 length followed by that many uint32 word ids or float weights, or twice as
+// many uint32 values for the source and target positions of the alignment points. Word ids are
+// stored without EOS, before any cropping or reversing.
+class BinaryCorpus {
+public:
+  struct Header {
+    uint64_t magic;         // BinaryCorpus::MAGIC
+    uint64_t numSentences;
+    uint64_t numStreams;    // number of streams with word ids
+    uint64_t hasAlignment;
+    uint64_t hasWeights;
+    uint64_t indexOffset;   // byte offset of the record offsets
+  };
+
+  // Contiguous uint32 values of a field inside the memory-mapped file
+  struct Field {
+    const uint32_t* data;
+    size_t size;
+  };
+
+  static const uint64_t MAGIC;
+
+private:
+  mio::mmap_source mmap_;
+  Header header_;
+  std::vector<size_t> vocabSizes_;
+  const uint64_t* offsets_;
+
+public:
+  BinaryCorpus(const std::string& fileName);
+
+  static bool isBinary(const std::string& fileName);
+
+  size_t size() const { return header_.numSentences; }
+  size_t numStreams() const { return header_.numStreams; }
+  bool hasAlignment() const { return header_.hasAlignment != 0; }
+  bool hasWeights() const { return header_.hasWeights != 0; }
+  const std::vector<size_t>& vocabSizes() const { return vocabSizes_; }
+
+  // Returns the fields of the id-th sentence: one per stream, then alignment and weights if present
+  void get(size_t id, std::vector<Field>& fields) const;
+
+  static WordAlignment toAlignment(const Field& field);
+  static std::vector<float> toWeights(const Field& field);
+};
+
+// Writes a BinaryCorpus sentence by sentence. The record offsets are collected in a temporary file
+// and appended when the writer is finished, so that memory usage does not depend on the corpus size.
+class BinaryCorpusWriter {
+private:
+  std::string fileName_;
+  std::ofstream out_;
+  BinaryCorpus::Header header_;
+  UPtr<io::TemporaryFile> offsets_;
+  uint64_t pos_;
+
+  void writeField(const uint32_t* data, size_t size, size_t factor = 1);
+
+public:
+  BinaryCorpusWriter(const std::string& fileName,
+                     const std::vector<size_t>& vocabSizes,
+                     bool hasAlignment,
+                     bool hasWeights,
+                     const std::string& tempDir);
+
+  // Adds a sentence, words without EOS. Alignment and weights are ignored if the corpus has none.
+  void add(const std::vector<Words>& words,
+           const WordAlignment& alignment = {},
+           const std::vector<float>& weights = {});
+
+  // Appends the record offsets and completes the header
+  void finish();
+};
+
+}  // namespace data
+}  // namespace marian
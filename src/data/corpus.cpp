@@ -2,6 +2,7 @@
 
 #include <numeric>
 #include <random>
+#include <thread>
 
 #include "common/utils.h"
 #include "common/filesystem.h"
@@ -14,8 +15,15 @@ namespace data {
 Corpus::Corpus(Ptr<Options> options, bool translate /*= false*/)
     : CorpusBase(options, translate),
         shuffleInRAM_(options_->get<bool>("shuffle-in-ram", false)),
+        shuffleBuckets_(options_->get<size_t>("shuffle-buckets", 0)),
         allCapsEvery_(options_->get<size_t>("all-caps-every", 0)),
-        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {}
+        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {
+  initInputLines();
+  initDataThreads();
+  auto binaryPath = options_->get<std::string>("binary-corpus", "");
+  if(!translate && !binaryPath.empty())
+    initBinary(binaryPath);
+}
 
 Corpus::Corpus(std::vector<std::string> paths,
                std::vector<Ptr<Vocab>> vocabs,
@@ -23,17 +31,89 @@ Corpus::Corpus(std::vector<std::string> paths,
     : CorpusBase(paths, vocabs, options),
         shuffleInRAM_(options_->get<bool>("shuffle-in-ram", false)),
         allCapsEvery_(options_->get<size_t>("all-caps-every", 0)),
-        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {}
+        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {
+  initDataThreads();
+}
+
+void Corpus::initInputLines() {
+  if(!inference_ || options_->get<size_t>("input-idle-flush", 0) == 0)
+    return;
+  if(paths_.size() != 1 || (paths_[0] != "stdin" && paths_[0] != "-"))
+    return;
+  // The thread is detached, as it may block on stdin until the process exits. It shares nothing
+  // with the corpus but the lines, and std::cin lives as long as the process.
+  inputLines_ = New<InputLines>();
+  auto inputLines = inputLines_;
+  std::thread([inputLines]() {
+    std::istream in(std::cin.rdbuf());
+    std::string line;
+    while(io::getline(in, line)) {
+      std::lock_guard<std::mutex> lock(inputLines->mutex);
+      inputLines->lines.push_back(std::move(line));
+      inputLines->ready.notify_all();
+    }
+    std::lock_guard<std::mutex> lock(inputLines->mutex);
+    inputLines->eof = true;
+    inputLines->ready.notify_all();
+  }).detach();
+}
+
+bool Corpus::nextInputLine(std::string& line) {
+  std::unique_lock<std::mutex> lock(inputLines_->mutex);
+  inputLines_->ready.wait(lock, [&]() { return !inputLines_->lines.empty() || inputLines_->eof; });
+  if(inputLines_->lines.empty())
+    return false;
+  line = std::move(inputLines_->lines.front());
+  inputLines_->lines.pop_front();
+  return true;
+}
+
+bool Corpus::waitForInput(size_t milliseconds) {
+  if(!inputLines_)
+    return true;
+  std::unique_lock<std::mutex> lock(inputLines_->mutex);
+  return inputLines_->ready.wait_for(lock, std::chrono::milliseconds(milliseconds), [&]() {
+    return !inputLines_->lines.empty() || inputLines_->eof;
+  });
+}
+
+Corpus::~Corpus() {
+  clearPending();
+}
+
+void Corpus::initDataThreads() {
+  dataThreads_   = options_->get<size_t>("data-threads", 1);
+  dataChunkSize_ = options_->get<size_t>("data-chunk-size", 1000);
+  dataQueueSize_ = options_->get<size_t>("data-queue-size", 0);
+  if(inputLines_) // streamed lines are encoded one at a time as they arrive, not in chunks
+    dataThreads_ = 1;
+  if(dataThreads_ <= 1)
+    return;
+
+  ABORT_IF(dataChunkSize_ == 0, "--data-chunk-size must be positive");
+  if(dataQueueSize_ == 0) // enough chunks to keep all threads busy while one is being consumed
+    dataQueueSize_ = 2 * dataThreads_;
+
+  if(!inference_ && options_->has("sentencepiece-alphas"))
+    LOG(warn,
+        "[data] SentencePiece subword sampling draws from a RNG of SentencePiece; with --data-threads "
+        "the sampled segmentations are not reproducible");
+
+  dataPool_.reset(new ThreadPool(dataThreads_, dataQueueSize_));
+  LOG(info,
+      "[data] Encoding input with {} threads in chunks of {} lines, at most {} chunks ahead",
+      dataThreads_, dataChunkSize_, dataQueueSize_);
+}
 
-void Corpus::preprocessLine(std::string& line, size_t streamId) {
-  if (allCapsEvery_ != 0 && pos_ % allCapsEvery_ == 0 && !inference_) {
+void Corpus::preprocessLine(std::string& line, size_t streamId, size_t pos) const {
+  if (allCapsEvery_ != 0 && pos % allCapsEvery_ == 0 && !inference_) {
     line = vocabs_[streamId]->toUpper(line);
     if (streamId == 0)
       LOG_ONCE(info, "[data] Source all-caps'ed line to: {}", line);
     else
       LOG_ONCE(info, "[data] Target all-caps'ed line to: {}", line);
   }
-  else if (titleCaseEvery_ != 0 && pos_ % titleCaseEvery_ == 1 && !inference_ && streamId == 0) {
+  else if (titleCaseEvery_ != 0 && pos % titleCaseEvery_ == 1 && !inference_ && streamId == 0) {
     // Only applied to stream 0 (source) since this feature is aimed at robustness against
     // title case in the source (and not at translating into title case).
     // Note: It is user's responsibility to not enable this if the source language is not English.
@@ -45,7 +125,170 @@ void Corpus::preprocessLine(std::string& line, size_t streamId) {
   }
 }
 
-SentenceTuple Corpus::next() {
+bool Corpus::needsPreprocessing(size_t streamId, size_t pos) const {
+  if(inference_)
+    return false;
+  return (allCapsEvery_ != 0 && pos % allCapsEvery_ == 0)
+         || (titleCaseEvery_ != 0 && pos % titleCaseEvery_ == 1 && streamId == 0);
+}
+
+void Corpus::initBinary(const std::string& path) {
+  ABORT_IF(allCapsEvery_ != 0 || titleCaseEvery_ != 0,
+           "--all-caps-every and --english-title-case-every cannot be used with --binary-corpus");
+
+  if(!filesystem::exists(path))
+    writeBinary(path);
+  else
+    LOG(info, "[data] Using binary corpus {}", path);
+  binary_.reset(new BinaryCorpus(path));
+
+  ABORT_IF(binary_->numStreams() != vocabs_.size(),
+           "Binary corpus {} has {} streams, but {} vocabularies are given",
+           path, binary_->numStreams(), vocabs_.size());
+  for(size_t i = 0; i < vocabs_.size(); ++i)
+    ABORT_IF(binary_->vocabSizes()[i] != vocabs_[i]->size(),
+             "Binary corpus {} was created with a vocabulary of size {} for stream {}, but the given one has size {}",
+             path, binary_->vocabSizes()[i], i, vocabs_[i]->size());
+  ABORT_IF(alignFileIdx_ > -1 && !binary_->hasAlignment(),
+           "Binary corpus {} was created without word alignments",
+           path);
+  ABORT_IF(weightFileIdx_ > -1 && !binary_->hasWeights(),
+           "Binary corpus {} was created without weights",
+           path);
+
+  files_.clear(); // all data is read from the binary corpus
+}
+
+void Corpus::writeBinary(const std::string& path) {
+  LOG(info, "[data] Creating binary corpus {} from {}", path, utils::join(paths_, ", "));
+
+  std::vector<size_t> vocabSizes;
+  for(const auto& vocab : vocabs_)
+    vocabSizes.push_back(vocab->size());
+  BinaryCorpusWriter writer(path,
+                            vocabSizes,
+                            alignFileIdx_ > -1,
+                            weightFileIdx_ > -1,
+                            options_->get<std::string>("tempdir"));
+
+  // fields are lines of the input files or the fields of a TSV line, in the same order
+  size_t numFields = tsv_ ? tsvNumInputFields_ + (alignFileIdx_ > -1) + (weightFileIdx_ > -1) : files_.size();
+  std::vector<std::string> fields(numFields);
+  for(;;) {
+    if(tsv_) {
+      std::string line;
+      if(!io::getline(*files_[0], line))
+        break;
+      utils::splitTsv(line, fields, numFields);
+    } else {
+      size_t eofsHit = 0;
+      for(size_t i = 0; i < numFields; ++i)
+        if(!io::getline(*files_[i], fields[i]))
+          eofsHit++;
+      if(eofsHit == numFields)
+        break;
+      ABORT_IF(eofsHit != 0, "Not all input files have the same number of lines");
+    }
+
+    std::vector<Words> words;
+    WordAlignment alignment;
+    std::vector<float> weights;
+    for(size_t j = 0; j < numFields; ++j) {
+      if((int)j == alignFileIdx_) {
+        alignment = WordAlignment(fields[j]);
+      } else if((int)j == weightFileIdx_) {
+        for(const auto& e : utils::split(fields[j], " "))
+          weights.push_back(std::stof(e));
+      } else {
+        // EOS is added and the words are cropped or reversed when reading the binary corpus
+        words.push_back(vocabs_[words.size()]->encode(fields[j], /*addEOS =*/ false, inference_));
+      }
+    }
+    writer.add(words, alignment, weights);
+  }
+  writer.finish();
+}
+
+SentenceTuple Corpus::nextFromBinary() {
+  std::vector<BinaryCorpus::Field> fields;
+  while(pos_ < binary_->size()) {
+    // if corpus has been shuffled, ids_ contains sentence indexes
+    size_t curId = pos_ < ids_.size() ? ids_[pos_] : pos_;
+    pos_++;
+
+    binary_->get(curId, fields);
+    SentenceTuple tup(curId);
+    for(size_t i = 0; i < binary_->numStreams(); ++i)
+      addWordsToSentenceTuple((const Word*)fields[i].data, fields[i].size, i, tup);
+
+    size_t f = binary_->numStreams();
+    if(binary_->hasAlignment() && alignFileIdx_ > -1)
+      addAlignmentToSentenceTuple(BinaryCorpus::toAlignment(fields[f]), tup);
+    if(binary_->hasAlignment())
+      f++;
+    if(binary_->hasWeights() && weightFileIdx_ > -1)
+      addWeightsToSentenceTuple(BinaryCorpus::toWeights(fields[f]), tup);
+
+    // check if all streams are valid, that is, non-empty and no longer than maximum allowed length
+    if(std::all_of(tup.begin(), tup.end(), [=](const WordsSpan& words) {
+         return words.size() > 0 && words.size() <= maxLength_;
+       }))
+      return tup;
+  }
+  return SentenceTuple(0);
+}
+
+bool Corpus::readLines(size_t& curId, size_t& pos, std::vector<std::string>& lines) {
+  do {
+    if(!readNextLines(curId, pos, lines))
+      return false;
+  } while(numStripes_ > 1 && curId % numStripes_ != stripe_);
+  return true;
+}
+
+bool Corpus::readNextLines(size_t& curId, size_t& pos, std::vector<std::string>& lines) {
+  // get index of the current sentence
+  curId = pos_; // note: at end, pos_  == total size
+  // if corpus has been shuffled, ids_ contains sentence indexes
+  if(pos_ < ids_.size())
+    curId = ids_[pos_];
+  pos_++;
+  pos = pos_;
+
+  // when shuffled externally, the lines and sentence index come from the current bucket
+  if(!bucketSeeds_.empty())
+    return nextFromBuckets(curId, lines);
+
+  // fetch lines from all input files, from cached copy in RAM or actual files
+  size_t eofsHit = 0;
+  size_t numStreams = corpusInRAM_.empty() ? files_.size() : corpusInRAM_.size();
+  lines.resize(numStreams);
+  for(size_t i = 0; i < numStreams; ++i) {
+    if (!corpusInRAM_.empty()) {
+      if (curId < corpusInRAM_[i].size())
+        lines[i] = corpusInRAM_[i][curId];
+      else
+        eofsHit++;
+    }
+    else {
+      bool gotLine = inputLines_ ? nextInputLine(lines[i]) : io::getline(*files_[i], lines[i]).good();
+      if(!gotLine)
+        eofsHit++;
+    }
+  }
+
+  if (eofsHit == numStreams)
+    return false;
+  ABORT_IF(eofsHit != 0, "not all input files have the same number of lines");
+  return true;
+}
+
+void Corpus::splitLines(size_t pos,
+                        const std::vector<std::string>& lines,
+                        std::vector<utils::StringRange>& texts,
+                        utils::StringRange& alignment,
+                        utils::StringRange& weights,
+                        std::deque<std::string>& preprocessed) const {
   // Used for handling TSV inputs
   // Determine the total number of fields including alignments or weights
   auto tsvNumAllFields = tsvNumInputFields_;
@@ -53,94 +296,241 @@ SentenceTuple Corpus::next() {
     ++tsvNumAllFields;
   if(weightFileIdx_ > -1)
     ++tsvNumAllFields;
-  std::vector<std::string> fields(tsvNumAllFields);
+  std::vector<utils::StringRange> fields;
+
+  // texts refer to the lines, unless they are changed by pre-processing. The deque does not move
+  // the strings it already holds when a new one is added, so the references to them stay valid.
+  auto addText = [&](const utils::StringRange& text) {
+    size_t streamId = texts.size();
+    if(needsPreprocessing(streamId, pos)) {
+      preprocessed.push_back(text.str());
+      preprocessLine(preprocessed.back(), streamId, pos);
+      texts.emplace_back(preprocessed.back());
+    } else {
+      texts.push_back(text);
+    }
+  };
+
+  texts.clear();
+  for(size_t i = 0; i < lines.size(); ++i) {
+    const std::string& line = lines[i];
+
+    if(i > 0 && i == alignFileIdx_) {
+      alignment = line;
+    } else if(i > 0 && i == weightFileIdx_) {
+      weights = line;
+    } else {
+      if(tsv_) {  // split TSV input into the texts of the streams, alignments and weights
+        utils::splitTsv(line, fields, tsvNumAllFields);
+        for(size_t j = 0; j < tsvNumAllFields; ++j) {
+          // guided-alignment or data-weighting may precede source or target sequences in TSV input
+          if(j == alignFileIdx_) {
+            alignment = fields[j];
+          } else if(j == weightFileIdx_) {
+            weights = fields[j];
+          } else {
+            addText(fields[j]);
+          }
+        }
+      } else {
+        addText(line);
+      }
+    }
+  }
+}
 
-  for(;;) { // (this is a retry loop for skipping invalid sentences)
-    // get index of the current sentence
-    size_t curId = pos_; // note: at end, pos_  == total size
-    // if corpus has been shuffled, ids_ contains sentence indexes
-    if(pos_ < ids_.size())
-      curId = ids_[pos_];
-    pos_++;
+void Corpus::addAlignmentAndWeights(const utils::StringRange& alignment,
+                                    const utils::StringRange& weights,
+                                    SentenceTuple& tup) const {
+  // weights are added last to the sentence tuple, because this runs a validation that needs
+  // length of the target sequence
+  if(alignFileIdx_ > -1)
+    addAlignmentToSentenceTuple(alignment, tup);
+  if(weightFileIdx_ > -1)
+    addWeightsToSentenceTuple(weights.str(), tup);
+}
 
-    // fill up the sentence tuple with sentences from all input files
-    SentenceTuple tup(curId);
-    size_t eofsHit = 0;
-    size_t numStreams = corpusInRAM_.empty() ? files_.size() : corpusInRAM_.size();
-    for(size_t i = 0; i < numStreams; ++i) {
-      std::string line;
+SentenceTuple Corpus::encodeLines(size_t curId, size_t pos, std::vector<std::string>& lines) const {
+  std::vector<utils::StringRange> texts;
+  utils::StringRange alignment, weights;
+  std::deque<std::string> preprocessed;
+  splitLines(pos, lines, texts, alignment, weights, preprocessed);
+
+  // fill up the sentence tuple with sentences from all input files
+  SentenceTuple tup(curId);
+  Words words;
+  std::vector<size_t> offsets;
+  for(size_t i = 0; i < texts.size(); ++i) {
+    vocabs_[i]->encode(std::vector<utils::StringRange>(1, texts[i]), words, offsets, /*addEOS =*/ false, inference_);
+    addWordsToSentenceTuple(words, i, tup);
+  }
+  addAlignmentAndWeights(alignment, weights, tup);
+  return tup;
+}
 
-      // fetch line, from cached copy in RAM or actual file
-      if (!corpusInRAM_.empty()) {
-        if (curId < corpusInRAM_[i].size())
-          line = corpusInRAM_[i][curId];
-        else {
-          eofsHit++;
-          continue;
-        }
-      }
-      else {
-        bool gotLine = io::getline(*files_[i], line).good();
-        if(!gotLine) {
-          eofsHit++;
-          continue;
-        }
-      }
+Corpus::EncodedChunk Corpus::encodeChunk(Chunk& chunk) const {
+  // collect the texts of each stream, so that a whole stream is encoded into one buffer at once.
+  // The texts refer to the lines of the chunk or to their pre-processed copies.
+  std::vector<std::vector<utils::StringRange>> texts(vocabs_.size(), std::vector<utils::StringRange>(chunk.size())); // [stream][line]
+  std::vector<utils::StringRange> alignments(chunk.size()), weights(chunk.size());
+  std::vector<utils::StringRange> lineTexts;
+  std::deque<std::string> preprocessed;
+  for(size_t k = 0; k < chunk.size(); ++k) {
+    splitLines(std::get<1>(chunk[k]), std::get<2>(chunk[k]), lineTexts, alignments[k], weights[k], preprocessed);
+    ABORT_IF(lineTexts.size() != vocabs_.size(),
+             "Expected {} input streams, got {}", vocabs_.size(), lineTexts.size());
+    for(size_t i = 0; i < lineTexts.size(); ++i)
+      texts[i][k] = lineTexts[i];
+  }
 
-      if(i > 0 && i == alignFileIdx_) {
-        addAlignmentToSentenceTuple(line, tup);
-      } else if(i > 0 && i == weightFileIdx_) {
-        addWeightsToSentenceTuple(line, tup);
-      } else {
-        if(tsv_) {  // split TSV input and add each field into the sentence tuple
-          utils::splitTsv(line, fields, tsvNumAllFields);
-          size_t shift = 0;
-          for(size_t j = 0; j < tsvNumAllFields; ++j) {
-            // index j needs to be shifted to get the proper vocab index if guided-alignment or
-            // data-weighting are preceding source or target sequences in TSV input
-            if(j == alignFileIdx_ || j == weightFileIdx_) {
-              ++shift;
-            } else {
-              size_t vocabId = j - shift;
-              preprocessLine(fields[j], vocabId);
-              addWordsToSentenceTuple(fields[j], vocabId, tup);
-            }
-          }
+  std::vector<Words> words(vocabs_.size());
+  std::vector<std::vector<size_t>> offsets(vocabs_.size());
+  for(size_t i = 0; i < vocabs_.size(); ++i)
+    vocabs_[i]->encode(texts[i], words[i], offsets[i], /*addEOS =*/ false, inference_);
+
+  EncodedChunk tuples;
+  for(size_t k = 0; k < chunk.size(); ++k) {
+    SentenceTuple tup(std::get<0>(chunk[k]));
+    size_t length = vocabs_.size(); // room for EOS
+    for(size_t i = 0; i < vocabs_.size(); ++i)
+      length += offsets[i][k + 1] - offsets[i][k];
+    tup.reserve(length);
+    for(size_t i = 0; i < vocabs_.size(); ++i)
+      addWordsToSentenceTuple(words[i].data() + offsets[i][k], offsets[i][k + 1] - offsets[i][k], i, tup);
+    addAlignmentAndWeights(alignments[k], weights[k], tup);
+    if(isValid(tup))
+      tuples.emplace_back(std::get<1>(chunk[k]), std::move(tup));
+  }
+  return tuples;
+}
 
-          // weights are added last to the sentence tuple, because this runs a validation that needs
-          // length of the target sequence
-          if(alignFileIdx_ > -1)
-            addAlignmentToSentenceTuple(fields[alignFileIdx_], tup);
-          if(weightFileIdx_ > -1)
-            addWeightsToSentenceTuple(fields[weightFileIdx_], tup);
+bool Corpus::isValid(const SentenceTuple& tup) const {
+  // check if all streams are valid, that is, non-empty and no longer than maximum allowed length
+  return std::all_of(tup.begin(), tup.end(), [=](const WordsSpan& words) {
+    return words.size() > 0 && words.size() <= maxLength_;
+  });
+}
 
-        } else {
-          preprocessLine(line, i);
-          addWordsToSentenceTuple(line, i, tup);
-        }
-      }
-    }
+SentenceTuple Corpus::next() {
+  if(binary_)
+    return nextFromBinary();
+  if(dataThreads_ > 1)
+    return nextParallel();
 
-    if (eofsHit == numStreams)
+  size_t curId, pos;
+  std::vector<std::string> lines;
+  for(;;) { // (this is a retry loop for skipping invalid sentences)
+    if(!readLines(curId, pos, lines))
       return SentenceTuple(0);
-    ABORT_IF(eofsHit != 0, "not all input files have the same number of lines");
 
-    // check if all streams are valid, that is, non-empty and no longer than maximum allowed length
-    if(std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
-         return words.size() > 0 && words.size() <= maxLength_;
-       }))
+    auto tup = encodeLines(curId, pos, lines);
+    if(isValid(tup))
       return tup;
 
     // otherwise skip this sentence and try the next one
-    // @TODO: tail recursion?
   }
 }
 
+SentenceTuple Corpus::nextParallel() {
+  while(encoded_.empty()) {
+    // keep the workers busy with chunks of lines read in order
+    while(!endOfLines_ && pending_.size() < dataQueueSize_) {
+      auto chunk = New<Chunk>();
+      size_t curId, pos;
+      std::vector<std::string> lines;
+      while(chunk->size() < dataChunkSize_ && readLines(curId, pos, lines))
+        chunk->emplace_back(curId, pos, std::move(lines));
+      endOfLines_ = chunk->size() < dataChunkSize_;
+
+      if(!chunk->empty()) {
+        pending_.push_back(dataPool_->enqueue([this, chunk]() { return encodeChunk(*chunk); }));
+      }
+    }
+
+    if(pending_.empty())
+      return SentenceTuple(0);
+
+    // chunks are consumed in the order they have been read, hence the order does not depend on the threads
+    for(auto& tup : pending_.front().get())
+      encoded_.push_back(std::move(tup));
+    pending_.pop_front();
+  }
+
+  returnedPos_ = encoded_.front().first;
+  auto tup = std::move(encoded_.front().second);
+  encoded_.pop_front();
+  return tup;
+}
+
+void Corpus::clearPending() {
+  for(auto& chunk : pending_)
+    chunk.wait();
+  pending_.clear();
+  encoded_.clear();
+  endOfLines_ = false;
+  returnedPos_ = 0;
+}
+
+size_t Corpus::getPosition() const {
+  // with data threads, pos_ is ahead of the returned sentences
+  return dataThreads_ > 1 && !binary_ ? returnedPos_ : pos_;
+}
+
+bool Corpus::seek(size_t position) {
+  if(!binary_ && !paths_.empty() && (paths_[0] == "stdin" || paths_[0] == "-"))
+    return false;
+
+  clearPending();
+  if(binary_ || !corpusInRAM_.empty()) {
+    size_t size = binary_ ? binary_->size() : corpusInRAM_[0].size();
+    ABORT_IF(position > size, "Cannot continue after {} sentences in a corpus of {} sentences", position, size);
+  } else if(!bucketSeeds_.empty()) {
+    // shuffle() has started loading the first bucket; if it is skipped entirely, drop it and the
+    // following skipped buckets without reading them and continue with loading the next one
+    size_t skipped = 0;
+    if(position >= bucketSizes_[0]) {
+      nextBucketData_.wait();
+      nextBucketData_ = std::future<ShuffleBucket>();
+      skipped = bucketSizes_[0];
+      while(nextBucket_ < bucketSizes_.size() && skipped + bucketSizes_[nextBucket_] <= position) {
+        skipped += bucketSizes_[nextBucket_];
+        bucketFiles_[nextBucket_++].reset();
+      }
+      prefetchBucket();
+    }
+
+    size_t id;
+    std::vector<std::string> lines;
+    for(; skipped < position; ++skipped)
+      ABORT_IF(!nextFromBuckets(id, lines), "Cannot continue after {} sentences, the corpus is shorter", position);
+  } else {
+    std::string line;
+    for(size_t i = 0; i < position; ++i)
+      for(auto& file : files_)
+        ABORT_IF(!io::getline(*file, line), "Cannot continue after {} sentences, the corpus is shorter", position);
+  }
+  pos_ = position;
+  returnedPos_ = position;
+  return true;
+}
+
 // reset and initialize shuffled reading
 // Call either reset() or shuffle().
 // @TODO: merge with reset() below to clarify mutual exclusiveness with reset()
 void Corpus::shuffle() {
-  shuffleData(paths_);
+  clearPending();
+  if(binary_) { // only the order of the sentence ids changes
+    ids_.resize(binary_->size());
+    std::iota(ids_.begin(), ids_.end(), 0);
+    std::shuffle(ids_.begin(), ids_.end(), eng_);
+    pos_ = 0;
+    LOG(info, "[data] Shuffled {} sentences of the binary corpus", utils::withCommas(ids_.size()));
+    return;
+  }
+  if(shuffleBuckets_ > 0 && !shuffleInRAM_)
+    shuffleDataExternally(paths_);
+  else
+    shuffleData(paths_);
 }
 
 // reset to regular, non-shuffled reading
@@ -148,11 +538,17 @@ void Corpus::shuffle() {
 // @TODO: make shuffle() private, instad pass a shuffle() flag to reset(), to clarify mutual
 // exclusiveness with shuffle()
 void Corpus::reset() {
+  clearPending();
   corpusInRAM_.clear();
   ids_.clear();
-  if (pos_ == 0) // no data read yet
+  bool bucketed = !bucketSeeds_.empty();
+  clearBuckets();
+  if (pos_ == 0 && !bucketed) // no data read yet
     return;
   pos_ = 0;
+  if(binary_)
+    return;
+  files_.resize(paths_.size()); // files_ may have been released when shuffling
   for (size_t i = 0; i < paths_.size(); ++i) {
       if(paths_[i] == "stdin" || paths_[i] == "-") {
         files_[i].reset(new std::istream(std::cin.rdbuf()));
@@ -165,7 +561,7 @@ void Corpus::reset() {
         // Do NOT reset named pipes; that closes them and triggers a SIGPIPE
         // (lost pipe) at the writing end, which may do whatever it wants
         // in this situation.
-        files_[i].reset(new io::InputFileStream(paths_[i]));
+        files_[i].reset(new io::InputFileStream(paths_[i], decompressThreads_));
       }
     }
 }
@@ -192,7 +588,7 @@ void Corpus::shuffleData(const std::vector<std::string>& paths) {
   else {
     files_.resize(numStreams);
     for(size_t i = 0; i < numStreams; ++i) {
-      UPtr<io::InputFileStream> strm(new io::InputFileStream(paths[i]));
+      UPtr<io::InputFileStream> strm(new io::InputFileStream(paths[i], decompressThreads_));
       strm->setbufsize(10000000);  // huge read-ahead buffer to avoid network round-trips
       files_[i] = std::move(strm);
     }
@@ -251,6 +647,125 @@ void Corpus::shuffleData(const std::vector<std::string>& paths) {
   pos_ = 0;
 }
 
+void Corpus::shuffleDataExternally(const std::vector<std::string>& paths) {
+  LOG(info, "[data] Shuffling data with {} temporary buckets", shuffleBuckets_);
+
+  ABORT_IF(paths[0] == "stdin" || paths[0] == "-",
+           "Shuffling training data from STDIN is not supported. Add --no-shuffle or provide "
+           "training sets with --train-sets");
+
+  clearBuckets();
+  size_t numStreams = paths.size();
+
+  files_.resize(numStreams);
+  for(size_t i = 0; i < numStreams; ++i) {
+    UPtr<io::InputFileStream> strm(new io::InputFileStream(paths[i], decompressThreads_));
+    strm->setbufsize(10000000);  // huge read-ahead buffer to avoid network round-trips
+    files_[i] = std::move(strm);
+  }
+
+  bucketFiles_.resize(shuffleBuckets_);
+  bucketSizes_.assign(shuffleBuckets_, 0);
+  for(auto& bucketFile : bucketFiles_)
+    bucketFile.reset(new io::TemporaryFile(options_->get<std::string>("tempdir")));
+
+  // distribute the sentences uniformly over the buckets, each one as its id followed by its lines
+  std::uniform_int_distribution<size_t> pickBucket(0, shuffleBuckets_ - 1);
+  std::vector<std::string> lines(numStreams);
+  size_t numSentences = 0;
+  for(;; ++numSentences) {
+    size_t eofsHit = 0;
+    for(size_t i = 0; i < numStreams; ++i)
+      if(!io::getline(*files_[i], lines[i]))
+        eofsHit++;
+    if(eofsHit == numStreams)
+      break;
+    ABORT_IF(eofsHit != 0, "Not all input files have the same number of lines");
+
+    size_t bucketIdx = pickBucket(eng_);
+    bucketSizes_[bucketIdx]++;
+    auto& out = *bucketFiles_[bucketIdx];
+    out << numSentences << "\n";
+    for(const auto& line : lines)
+      out << line << "\n";
+  }
+  files_.clear();
+
+  for(auto& bucketFile : bucketFiles_) {
+    bucketFile->flush();
+    bucketSeeds_.push_back(eng_());
+  }
+
+  LOG(info, "[data] Done distributing {} sentences to temporary buckets", utils::withCommas(numSentences));
+  // each bucket is shuffled when it is loaded, the next one is always loaded in the background
+  prefetchBucket();
+  pos_ = 0;
+}
+
+Corpus::ShuffleBucket Corpus::loadBucket(size_t bucketIdx) {
+  auto in = bucketFiles_[bucketIdx]->getInputStream();
+  in->setbufsize(10000000);
+
+  ShuffleBucket loaded;
+  size_t numStreams = paths_.size();
+  std::string line;
+  while(io::getline(*in, line)) {
+    loaded.ids.push_back(std::stoull(line));
+    loaded.lines.emplace_back(numStreams);
+    for(auto& streamLine : loaded.lines.back())
+      ABORT_IF(!io::getline(*in, streamLine), "Temporary shuffle bucket {} is truncated", bucketIdx);
+  }
+  in.reset();
+  bucketFiles_[bucketIdx].reset(); // releases the disk space
+
+  std::vector<size_t> order(loaded.ids.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::mt19937 rng((std::mt19937::result_type)bucketSeeds_[bucketIdx]);
+  std::shuffle(order.begin(), order.end(), rng);
+
+  ShuffleBucket shuffled;
+  shuffled.ids.reserve(order.size());
+  shuffled.lines.reserve(order.size());
+  for(auto k : order) {
+    shuffled.ids.push_back(loaded.ids[k]);
+    shuffled.lines.push_back(std::move(loaded.lines[k]));
+  }
+  return shuffled;
+}
+
+void Corpus::prefetchBucket() {
+  if(nextBucket_ < bucketFiles_.size()) {
+    size_t bucketIdx = nextBucket_++;
+    nextBucketData_ = std::async(std::launch::async, [this, bucketIdx]() { return loadBucket(bucketIdx); });
+  }
+}
+
+bool Corpus::nextFromBuckets(size_t& id, std::vector<std::string>& lines) {
+  while(bucketPos_ >= bucket_.ids.size()) {
+    if(!nextBucketData_.valid()) // all buckets have been read
+      return false;
+    bucket_ = nextBucketData_.get();
+    bucketPos_ = 0;
+    prefetchBucket();
+  }
+  id = bucket_.ids[bucketPos_];
+  lines = std::move(bucket_.lines[bucketPos_]);
+  bucketPos_++;
+  return true;
+}
+
+void Corpus::clearBuckets() {
+  if(nextBucketData_.valid())
+    nextBucketData_.wait();
+  nextBucketData_ = std::future<ShuffleBucket>();
+  bucketFiles_.clear();
+  bucketSizes_.clear();
+  bucketSeeds_.clear();
+  bucket_ = ShuffleBucket();
+  bucketPos_ = 0;
+  nextBucket_ = 0;
+}
+
 CorpusBase::batch_ptr Corpus::toBatch(const std::vector<Sample>& batchVector) {
   size_t batchSize = batchVector.size();
 
@@ -1,18 +1,26 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <random>
+#include <tuple>
 
 #include "common/definitions.h"
 #include "common/file_stream.h"
 #include "common/options.h"
 #include "data/alignment.h"
 #include "data/batch.h"
+#include "data/binary_corpus.h"
 #include "data/corpus_base.h"
 #include "data/dataset.h"
 #include "data/vocab.h"
 
+#include "3rd_party/threadpool.h"
+
 namespace marian {
 namespace data {
 
@@ -27,19 +35,111 @@ private:
 
   void shuffleData(const std::vector<std::string>& paths);
 
+  // for --shuffle-buckets: sentences are distributed randomly over temporary bucket files, which
+  // are read back and shuffled in RAM one at a time while the next one is loaded in the background
+  struct ShuffleBucket {
+    std::vector<size_t> ids;                      // [index in bucket] original sentence ids
+    std::vector<std::vector<std::string>> lines;  // [index in bucket][stream]
+  };
+  size_t shuffleBuckets_{0};
+  std::vector<UPtr<io::TemporaryFile>> bucketFiles_;
+  std::vector<size_t> bucketSizes_;               // number of sentences in each bucket
+  std::vector<size_t> bucketSeeds_;               // drawn up-front, so the order is deterministic
+  size_t nextBucket_{0};
+  std::future<ShuffleBucket> nextBucketData_;
+  ShuffleBucket bucket_;
+  size_t bucketPos_{0};
+
+  void shuffleDataExternally(const std::vector<std::string>& paths);
+  ShuffleBucket loadBucket(size_t bucketIdx);
+  void prefetchBucket();
+  bool nextFromBuckets(size_t& id, std::vector<std::string>& lines);
+  void clearBuckets();
+
+  // for --binary-corpus, replaces reading from files_
+  UPtr<BinaryCorpus> binary_;
+  void initBinary(const std::string& path);
+  void writeBinary(const std::string& path);
+  Sample nextFromBinary();
+
   // for pre-processing
   size_t allCapsEvery_{0};   // if set, convert every N-th input sentence (after randomization) to all-caps (source and target)
   size_t titleCaseEvery_{0}; // ditto for title case (source only)
-  void preprocessLine(std::string& line, size_t streamId);
+  void preprocessLine(std::string& line, size_t streamId, size_t pos) const;
+  bool needsPreprocessing(size_t streamId, size_t pos) const; // whether preprocessLine() changes the line
+
+  // reading is split into fetching the raw lines in corpus order and turning them into a sentence tuple,
+  // the latter only depends on its arguments and may run on the data threads
+  bool readLines(size_t& curId, size_t& pos, std::vector<std::string>& lines);
+  bool readNextLines(size_t& curId, size_t& pos, std::vector<std::string>& lines);
+
+  // with setStripe(), only the sentences with ids that are stripe_ modulo numStripes_ are read
+  size_t stripe_{0};
+  size_t numStripes_{1};
+  // the texts, alignment and weights refer to the lines and to the pre-processed lines that are
+  // added to the deque, and are valid as long as these are
+  void splitLines(size_t pos,
+                  const std::vector<std::string>& lines,
+                  std::vector<utils::StringRange>& texts,
+                  utils::StringRange& alignment,
+                  utils::StringRange& weights,
+                  std::deque<std::string>& preprocessed) const;
+  void addAlignmentAndWeights(const utils::StringRange& alignment,
+                              const utils::StringRange& weights,
+                              SentenceTuple& tup) const;
+  SentenceTuple encodeLines(size_t curId, size_t pos, std::vector<std::string>& lines) const;
+  bool isValid(const SentenceTuple& tup) const;
+
+  // for --data-threads: chunks of lines are encoded by a thread pool, but consumed in the order they
+  // were read, so the sequence of sentence tuples is the same as with a single thread
+  typedef std::vector<std::tuple<size_t, size_t, std::vector<std::string>>> Chunk; // [(curId, pos, lines)]
+  typedef std::vector<std::pair<size_t, SentenceTuple>> EncodedChunk;              // [(pos, tuple)]
+  EncodedChunk encodeChunk(Chunk& chunk) const; // encodes each stream of the chunk into one buffer
+  size_t dataThreads_{1};
+  size_t dataChunkSize_{1000};
+  size_t dataQueueSize_{2};
+  std::deque<std::future<EncodedChunk>> pending_;
+  std::deque<std::pair<size_t, SentenceTuple>> encoded_;
+  bool endOfLines_{false};
+  size_t returnedPos_{0}; // value of pos_ after reading the line of the last returned tuple
+
+  void initDataThreads();
+  Sample nextParallel();
+  void clearPending();
+
+  // for --input-idle-flush: the lines of stdin are read by a thread of their own, so that
+  // waitForInput() can tell whether the next one arrives in time without blocking on it
+  struct InputLines {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::string> lines;
+    bool eof{false};
+  };
+  Ptr<InputLines> inputLines_;
+  void initInputLines();
+  bool nextInputLine(std::string& line);
+
+  // declared last, so that the workers are joined before any data they use is destroyed
+  UPtr<ThreadPool> dataPool_;
 
 public:
   // @TODO: check if translate can be replaced by an option in options
   Corpus(Ptr<Options> options, bool translate = false);
 
+  // Reads only every numStripes-th sentence starting from the stripe-th, e.g. the part of the input
+  // of one of several MPI processes, see --mpi-split. The sentences keep their ids in the full input.
+  void setStripe(size_t stripe, size_t numStripes) {
+    ABORT_IF(binary_, "A binary corpus cannot be split into stripes");
+    stripe_ = stripe;
+    numStripes_ = numStripes;
+  }
+
   Corpus(std::vector<std::string> paths,
          std::vector<Ptr<Vocab>> vocabs,
          Ptr<Options> options);
 
+  ~Corpus();
+
   /**
    * @brief Iterates sentence tuples in the corpus.
    *
@@ -57,6 +157,18 @@ public:
 
   void restore(Ptr<TrainingState>) override;
 
+  size_t getPosition() const override;
+
+  /**
+   * @brief Skips the first lines of the current epoch without encoding them.
+   *
+   * Constant time for --binary-corpus and --shuffle-in-ram; with --shuffle-buckets whole buckets
+   * are skipped without reading them, otherwise the lines are read from the (shuffled) files.
+   */
+  bool seek(size_t position) override;
+
+  bool waitForInput(size_t milliseconds) override;
+
   iterator begin() override { return iterator(this); }
 
   iterator end() override { return iterator(); }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <random>
 
 #include "common/file_utils.h"
@@ -42,6 +43,7 @@ CorpusBase::CorpusBase(const std::vector<std::string>& paths,
       maxLengthCrop_(options_->get<bool>("max-length-crop")),
       rightLeft_(options_->get<bool>("right-left")),
       tsv_(options_->get<bool>("tsv", false)),
+      decompressThreads_(options_->get<size_t>("data-decompress-threads", 1)),
       tsvNumInputFields_(getNumberOfTSVInputFields(options)) {
   // TODO: support passing only one vocab file if we have fully-tied embeddings
   if(tsv_) {
@@ -53,7 +55,7 @@ CorpusBase::CorpusBase(const std::vector<std::string>& paths,
   }
 
   for(auto path : paths_) {
-    UPtr<io::InputFileStream> strm(new io::InputFileStream(path));
+    UPtr<io::InputFileStream> strm(new io::InputFileStream(path, decompressThreads_));
     ABORT_IF(strm->empty(), "File '{}' is empty", path);
     files_.emplace_back(std::move(strm));
   }
@@ -61,12 +63,23 @@ CorpusBase::CorpusBase(const std::vector<std::string>& paths,
   initEOS(/*training=*/true);
 }
 
+CorpusBase::CorpusBase(const std::vector<Ptr<Vocab>>& vocabs, Ptr<Options> options)
+    : DatasetBase(options),
+      vocabs_(vocabs),
+      maxLength_(options_->get<size_t>("max-length")),
+      maxLengthCrop_(options_->get<bool>("max-length-crop")),
+      rightLeft_(options_->get<bool>("right-left")),
+      tsv_(options_->get<bool>("tsv", false)),
+      decompressThreads_(options_->get<size_t>("data-decompress-threads", 1)),
+      tsvNumInputFields_(getNumberOfTSVInputFields(options)) {}
+
 CorpusBase::CorpusBase(Ptr<Options> options, bool translate)
     : DatasetBase(options),
       maxLength_(options_->get<size_t>("max-length")),
       maxLengthCrop_(options_->get<bool>("max-length-crop")),
       rightLeft_(options_->get<bool>("right-left")),
       tsv_(options_->get<bool>("tsv", false)),
+      decompressThreads_(options_->get<size_t>("data-decompress-threads", 1)),
       tsvNumInputFields_(getNumberOfTSVInputFields(options)) {
   bool training = !translate;
 
@@ -344,7 +357,7 @@ CorpusBase::CorpusBase(Ptr<Options> options, bool translate)
     if(path == "stdin" || path == "-")
       files_.emplace_back(new std::istream(std::cin.rdbuf()));
     else {
-      io::InputFileStream *strm = new io::InputFileStream(path);
+      io::InputFileStream *strm = new io::InputFileStream(path, decompressThreads_);
       ABORT_IF(strm->empty(), "File '{}' is empty", path);
       files_.emplace_back(strm);
     }
@@ -367,7 +380,7 @@ CorpusBase::CorpusBase(Ptr<Options> options, bool translate)
 
       alignFileIdx_ = (int)paths_.size();
       paths_.emplace_back(path);
-      io::InputFileStream* strm = new io::InputFileStream(path);
+      io::InputFileStream* strm = new io::InputFileStream(path, decompressThreads_);
       ABORT_IF(strm->empty(), "File with alignments '{}' is empty", path);
       files_.emplace_back(strm);
     }
@@ -380,7 +393,7 @@ CorpusBase::CorpusBase(Ptr<Options> options, bool translate)
 
       weightFileIdx_ = (int)paths_.size();
       paths_.emplace_back(path);
-      io::InputFileStream* strm = new io::InputFileStream(path);
+      io::InputFileStream* strm = new io::InputFileStream(path, decompressThreads_);
       ABORT_IF(strm->empty(), "File with weights '{}' is empty", path);
       files_.emplace_back(strm);
     }
@@ -393,42 +406,68 @@ void CorpusBase::addWordsToSentenceTuple(const std::string& line,
   // This turns a string in to a sequence of numerical word ids. Depending
   // on the vocabulary type, this can be non-trivial, e.g. when SentencePiece
   // is used.
-  Words words = vocabs_[batchIndex]->encode(line, /*addEOS =*/ addEOS_[batchIndex], inference_);
+  Words words = vocabs_[batchIndex]->encode(line, /*addEOS =*/ false, inference_);
+  addWordsToSentenceTuple(words, batchIndex, tup);
+}
 
-  ABORT_IF(words.empty(), "Empty input sequences are presently untested");
+void CorpusBase::addWordsToSentenceTuple(const Words& words,
+                                         size_t batchIndex,
+                                         SentenceTuple& tup) const {
+  addWordsToSentenceTuple(words.data(), words.size(), batchIndex, tup);
+}
 
-  if(maxLengthCrop_ && words.size() > maxLength_) {
-    words.resize(maxLength_);
-    if(addEOS_[batchIndex])
-      words.back() = vocabs_[batchIndex]->getEosId();
-  }
+void CorpusBase::addWordsToSentenceTuple(const Word* words,
+                                         size_t size,
+                                         size_t batchIndex,
+                                         SentenceTuple& tup) const {
+  bool addEOS = addEOS_[batchIndex];
+  size_t length = size + (addEOS ? 1 : 0);
+
+  ABORT_IF(length == 0, "Empty input sequences are presently untested");
+
+  if(maxLengthCrop_ && length > maxLength_)
+    length = std::max(maxLength_, (size_t)addEOS);
+
+  // the words are written into the tuple directly, cropped to keep the EOS
+  Word* out = tup.push_back(length);
+  std::copy(words, words + (addEOS ? length - 1 : length), out);
+  if(addEOS)
+    out[length - 1] = vocabs_[batchIndex]->getEosId();
 
   if(rightLeft_)
-    std::reverse(words.begin(), words.end() - 1);
+    std::reverse(out, out + length - 1);
+}
 
-  tup.push_back(words);
+void CorpusBase::addAlignmentToSentenceTuple(const utils::StringRange& line,
+                                             SentenceTuple& tup) const {
+  addAlignmentToSentenceTuple(WordAlignment(line.data, line.size), tup);
 }
 
-void CorpusBase::addAlignmentToSentenceTuple(const std::string& line,
+void CorpusBase::addAlignmentToSentenceTuple(WordAlignment align,
                                              SentenceTuple& tup) const {
   ABORT_IF(rightLeft_,
            "Guided alignment and right-left model cannot be used "
            "together at the moment");
 
-  auto align = WordAlignment(line);
-  tup.setAlignment(align);
+  tup.setAlignment(std::move(align));
 }
 
 void CorpusBase::addWeightsToSentenceTuple(const std::string& line, SentenceTuple& tup) const {
   auto elements = utils::split(line, " ");
 
-  if(!elements.empty()) {
-    std::vector<float> weights;
-    for(auto& e : elements) {                             // Iterate weights as strings
-      if(maxLengthCrop_ && weights.size() >= maxLength_)  // Cut if the input is going to be cut
-        break;
-      weights.emplace_back(std::stof(e));                 // Add a weight converted into float
-    }
+  std::vector<float> weights;
+  for(auto& e : elements) {                             // Iterate weights as strings
+    if(maxLengthCrop_ && weights.size() >= maxLength_)  // Cut if the input is going to be cut
+      break;
+    weights.emplace_back(std::stof(e));                 // Add a weight converted into float
+  }
+  addWeightsToSentenceTuple(std::move(weights), tup);
+}
+
+void CorpusBase::addWeightsToSentenceTuple(std::vector<float> weights, SentenceTuple& tup) const {
+  if(!weights.empty()) {
+    if(maxLengthCrop_ && weights.size() > maxLength_)   // Cut if the input is going to be cut
+      weights.resize(maxLength_);
 
     if(rightLeft_)
       std::reverse(weights.begin(), weights.end());
@@ -443,14 +482,19 @@ void CorpusBase::addAlignmentsToBatch(Ptr<CorpusBatch> batch,
   int trgWords = (int)batch->back()->batchWidth();
   int dimBatch = (int)batch->getSentenceIds().size();
 
-  std::vector<float> aligns(srcWords * dimBatch * trgWords, 0.f);
-
+  // only the aligned positions, instead of a dense [srcWords, dimBatch, trgWords] matrix of 0 and 1
+  std::vector<IndexType> aligns;
   for(int b = 0; b < dimBatch; ++b) {
     for(auto p : batchVector[b].getAlignment()) {
+      ABORT_IF((int)p.srcPos >= srcWords || (int)p.tgtPos >= trgWords,
+               "Alignment point {}-{} of sentence {} is outside of the batch of {} source and {} target words",
+               p.srcPos, p.tgtPos, batchVector[b].getId(), srcWords, trgWords);
       size_t idx = p.srcPos * dimBatch * trgWords + b * trgWords + p.tgtPos;
-      aligns[idx] = 1.f;
+      aligns.push_back((IndexType)idx);
     }
   }
+  std::sort(aligns.begin(), aligns.end());
+  aligns.erase(std::unique(aligns.begin(), aligns.end()), aligns.end());
   batch->setGuidedAlignment(std::move(aligns));
 }
 
@@ -11,9 +11,39 @@
 #include "data/rng_engine.h"
 #include "data/vocab.h"
 
+#include <map>
+
 namespace marian {
 namespace data {
 
+/**
+ * @brief Read-only view of the words of one sentence in a SentenceTuple.
+ */
+class WordsSpan {
+private:
+  const Word* data_;
+  size_t size_;
+
+public:
+  typedef Word value_type;
+  typedef const Word* const_iterator;
+
+  WordsSpan(const Word* data, size_t size) : data_(data), size_(size) {}
+
+  const Word* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const Word& operator[](size_t i) const { return data_[i]; }
+  const Word& front() const { return data_[0]; }
+  const Word& back() const { return data_[size_ - 1]; }
+
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+  Words toWords() const { return Words(begin(), end()); }
+};
+
 /**
  * @brief A sentence tuple that stores all sources and target sentences for a
  * specific "line" from a parallel corpus.
@@ -21,66 +51,121 @@ namespace data {
  * Sentence tuples store sentences from external files and a basis for
  * construction of marian::data::CorpusBatch objects. They are not a part of
  * marian::data::CorpusBatch.
+ *
+ * The words of all sentences are stored one after another in a single buffer, and the end offsets
+ * of the first few sentences inline, so that creating or copying a tuple needs one allocation
+ * instead of one per sentence.
  */
 class SentenceTuple {
 private:
+  static const size_t INLINE_SENTENCES = 4;
+
   size_t id_;
-  std::vector<Words> tuple_;    // [stream index][step index]
-  std::vector<float> weights_;  // [stream index]
+  Words words_;                        // words of all sentences, [stream index][step index] flattened
+  size_t size_{0};                     // number of sentences
+  size_t ends_[INLINE_SENTENCES];      // end offsets in words_ of the first sentences
+  std::vector<size_t> moreEnds_;       // and of the remaining ones
+  std::vector<float> weights_;         // [stream index]
   WordAlignment alignment_;
 
+  size_t endOf(size_t i) const { return i < INLINE_SENTENCES ? ends_[i] : moreEnds_[i - INLINE_SENTENCES]; }
+  size_t beginOf(size_t i) const { return i == 0 ? 0 : endOf(i - 1); }
+
 public:
-  typedef Words value_type;
+  typedef WordsSpan value_type;
+
+  // Iterates over the sentences of the tuple, dereferences to a WordsSpan
+  class const_iterator {
+  private:
+    const SentenceTuple* tup_;
+    size_t i_;
+
+  public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef WordsSpan value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const WordsSpan* pointer;
+    typedef WordsSpan reference;
+
+    const_iterator(const SentenceTuple* tup, size_t i) : tup_(tup), i_(i) {}
+
+    WordsSpan operator*() const { return (*tup_)[i_]; }
+    const_iterator& operator++() { ++i_; return *this; }
+    const_iterator& operator--() { --i_; return *this; }
+    const_iterator operator++(int) { const_iterator it = *this; ++i_; return it; }
+    const_iterator operator--(int) { const_iterator it = *this; --i_; return it; }
+    bool operator==(const const_iterator& other) const { return i_ == other.i_; }
+    bool operator!=(const const_iterator& other) const { return i_ != other.i_; }
+  };
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
 
   /**
    * @brief Creates an empty tuple with the given Id.
    */
   SentenceTuple(size_t id) : id_(id) {}
 
-  ~SentenceTuple() { tuple_.clear(); }
-
   /**
    * @brief Returns the sentence's ID.
    */
   size_t getId() const { return id_; }
 
+  /**
+   * @brief Reserves space for the given total number of words of all sentences.
+   */
+  void reserve(size_t words) { words_.reserve(words); }
+
+  /**
+   * @brief Adds a new sentence of the given length at the end of the tuple.
+   *
+   * @return Pointer to the words of the new sentence, which are to be filled in by the caller.
+   * It is valid until the next sentence is added.
+   */
+  Word* push_back(size_t length) {
+    words_.resize(words_.size() + length);
+    if(size_ < INLINE_SENTENCES)
+      ends_[size_] = words_.size();
+    else
+      moreEnds_.push_back(words_.size());
+    size_++;
+    return words_.data() + words_.size() - length;
+  }
+
   /**
    * @brief Adds a new sentence at the end of the tuple.
    *
    * @param words A vector of word indices.
    */
-  void push_back(const Words& words) { tuple_.push_back(words); }
+  void push_back(const Words& words) { std::copy(words.begin(), words.end(), push_back(words.size())); }
+  void push_back(const WordsSpan& words) { std::copy(words.begin(), words.end(), push_back(words.size())); }
 
   /**
    * @brief The size of the tuple, e.g. two for parallel data with a source and
    * target sentences.
    */
-  size_t size() const { return tuple_.size(); }
+  size_t size() const { return size_; }
 
   /**
    * @brief The i-th tuple sentence.
    *
    * @param i Tuple's index.
    */
-  Words& operator[](size_t i) { return tuple_[i]; }
-  const Words& operator[](size_t i) const { return tuple_[i]; }
+  WordsSpan operator[](size_t i) const { return WordsSpan(words_.data() + beginOf(i), endOf(i) - beginOf(i)); }
 
   /**
    * @brief The last tuple sentence, i.e. the target sentence.
    */
-  Words& back() { return tuple_.back(); }
-  const Words& back() const { return tuple_.back(); }
+  WordsSpan back() const { return (*this)[size_ - 1]; }
 
   /**
    * @brief Checks whether the tuple is empty.
    */
-  bool empty() const { return tuple_.empty(); }
+  bool empty() const { return size_ == 0; }
 
-  auto begin() const -> decltype(tuple_.begin()) { return tuple_.begin(); }
-  auto end() const -> decltype(tuple_.end()) { return tuple_.end(); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size_); }
 
-  auto rbegin() const -> decltype(tuple_.rbegin()) { return tuple_.rbegin(); }
-  auto rend() const -> decltype(tuple_.rend()) { return tuple_.rend(); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
 
   /**
    * @brief Get sentence weights.
@@ -100,6 +185,7 @@ public:
 
   const WordAlignment& getAlignment() const { return alignment_; }
   void setAlignment(const WordAlignment& alignment) { alignment_ = alignment; }
+  void setAlignment(WordAlignment&& alignment) { alignment_ = std::move(alignment); }
 };
 
 /**
@@ -223,6 +309,39 @@ public:
     return splits;
   }
 
+  /**
+   * @brief Creates a new sub-batch from the given subset of sentences.
+   *
+   * @param batchIndices Indices of the sentences to keep, in the order in which they should appear
+   *
+   * @return Pointer to a new sub-batch which has the width of the longest selected sentence
+   */
+  Ptr<SubBatch> select(const std::vector<size_t>& batchIndices) const {
+    size_t subSize = batchIndices.size();
+
+    // determine actual width (=max length) of the selection
+    size_t subWidth = 0;
+    for(size_t s = 0; s < width_; ++s)
+      for(auto b : batchIndices)
+        if(mask_[locate(/*batchIdx=*/b, /*wordPos=*/s)] != 0)
+          subWidth = s + 1;
+
+    auto sb = New<SubBatch>(subSize, subWidth, vocab_);
+
+    size_t words = 0;
+    for(size_t s = 0; s < subWidth; ++s) {
+      for(size_t i = 0; i < subSize; ++i) {
+        auto origIdx = locate(/*batchIdx=*/batchIndices[i], /*wordPos=*/s);
+        sb->data()[locate(/*batchIdx=*/i, /*wordPos=*/s, /*batchSize=*/subSize)] = indices_[origIdx];
+        sb->mask()[locate(/*batchIdx=*/i, /*wordPos=*/s, /*batchSize=*/subSize)] = mask_[origIdx];
+        if(mask_[origIdx] != 0)
+          words++;
+      }
+    }
+    sb->setWords(words);
+    return sb;
+  }
+
   void setWords(size_t words) { words_ = words; }
 
   // experimental: hide inline-fix source tokens from cross attention
@@ -236,7 +355,7 @@ public:
 class CorpusBatch : public Batch {
 protected:
   std::vector<Ptr<SubBatch>> subBatches_;
-  std::vector<float> guidedAlignment_; // [max source len, batch size, max target len] flattened
+  std::vector<IndexType> guidedAlignment_; // aligned positions in [max source len, batch size, max target len] flattened, ascending
   std::vector<float> dataWeights_;
 
 public:
@@ -342,8 +461,13 @@ public:
 
     if(options->get("guided-alignment", std::string("none")) != "none") {
       // @TODO: if > 1 encoder, verify that all encoders have the same sentence lengths
-      std::vector<float> alignment(batchSize * lengths.front() * lengths.back(),
-          0.f);
+      // about one aligned source position per target position, like a typical alignment
+      size_t srcWords = lengths.front(), trgWords = lengths.back();
+      std::vector<IndexType> alignment;
+      for(size_t s = 0; s < srcWords; ++s)
+        for(size_t b = 0; b < batchSize; ++b)
+          for(size_t t = s; t < trgWords; t += srcWords)
+            alignment.push_back((IndexType)((s * batchSize + b) * trgWords + t));
       batch->setGuidedAlignment(std::move(alignment));
     }
 
@@ -409,17 +533,15 @@ public:
         size_t trgWords = cb->back()->batchWidth();
         size_t dimBatch = cb->size();
 
-        std::vector<float> aligns(srcWords * dimBatch * trgWords, 0.f);
-
-        for(size_t i = 0; i < dimBatch; ++i) {
-          size_t bi = i + pos;
-          for(size_t sid = 0; sid < srcWords; ++sid) {
-            for(size_t tid = 0; tid < trgWords; ++tid) {
-              size_t bidx = sid * oldSize  * oldTrgWords + bi * oldTrgWords + tid; // [sid, bi, tid]
-              size_t idx  = sid * dimBatch *    trgWords +  i *    trgWords + tid;
-              aligns[idx] = guidedAlignment_[bidx];
-            }
-          }
+        // the order of [sid, bi, tid] is kept, so the positions stay ascending
+        std::vector<IndexType> aligns;
+        for(auto bidx : guidedAlignment_) {
+          size_t tid = bidx % oldTrgWords;
+          size_t bi  = bidx / oldTrgWords % oldSize;
+          size_t sid = bidx / oldTrgWords / oldSize;
+          if(bi < pos || bi >= pos + dimBatch || sid >= srcWords || tid >= trgWords)
+            continue;
+          aligns.push_back((IndexType)(sid * dimBatch * trgWords + (bi - pos) * trgWords + tid));
         }
         cb->setGuidedAlignment(std::move(aligns));
         pos += dimBatch;
@@ -454,8 +576,10 @@ public:
     return splits;
   }
 
-  const std::vector<float>& getGuidedAlignment() const { return guidedAlignment_; }  // [dimSrcWords, dimBatch, dimTrgWords] flattened
-  void setGuidedAlignment(std::vector<float>&& aln) override {
+  // The aligned positions in [dimSrcWords, dimBatch, dimTrgWords] flattened, see locateInGuidedAlignments(), in
+  // ascending order without duplicates. All other positions are not aligned.
+  const std::vector<IndexType>& getGuidedAlignment() const { return guidedAlignment_; }
+  void setGuidedAlignment(std::vector<IndexType>&& aln) override {
     guidedAlignment_ = std::move(aln);
   }
 
@@ -468,6 +592,62 @@ public:
     dataWeights_ = weights;
   }
 
+  /**
+   * @brief Creates a new batch from the given subset of sentences, e.g. to remove sentences that do
+   * not need to be processed. Only supports batches without guided alignment or data weights, i.e.
+   * batches used for inference.
+   *
+   * @param batchIndices Indices of the sentences to keep
+   *
+   * @return Pointer to a new batch with the selected sentences across all streams
+   */
+  Ptr<CorpusBatch> select(const std::vector<size_t>& batchIndices) const {
+    ABORT_IF(!guidedAlignment_.empty() || !dataWeights_.empty(),
+             "Selecting sentences from batches with guided alignment or data weights is not supported");
+
+    std::vector<Ptr<SubBatch>> subBatches;
+    for(auto subBatch : subBatches_)
+      subBatches.push_back(subBatch->select(batchIndices));
+    auto batch = New<CorpusBatch>(subBatches);
+
+    if(!sentenceIds_.empty()) {
+      std::vector<size_t> sentenceIds;
+      for(auto b : batchIndices)
+        sentenceIds.push_back(sentenceIds_[b]);
+      batch->setSentenceIds(sentenceIds);
+    }
+    return batch;
+  }
+
+  /**
+   * @brief Finds the sentences whose sources are identical in all streams but the last, e.g. the
+   * candidates of one source sentence when rescoring an n-best list.
+   *
+   * @param firstIndices Filled with the index of the first sentence of each distinct source, in
+   * the order of the batch
+   *
+   * @return For every sentence the index of its source in firstIndices
+   */
+  std::vector<IndexType> distinctSources(std::vector<size_t>& firstIndices) const {
+    std::map<std::vector<WordIndex>, IndexType> distinct;
+    std::vector<IndexType> sourceIndices;
+    firstIndices.clear();
+    for(size_t b = 0; b < size(); ++b) {
+      std::vector<WordIndex> key;
+      for(size_t j = 0; j + 1 < subBatches_.size(); ++j) {
+        const auto& sb = subBatches_[j];
+        for(size_t s = 0; s < sb->batchWidth() && sb->mask()[sb->locate(b, s)] != 0; ++s)
+          key.push_back(sb->data()[sb->locate(b, s)].toWordIndex());
+        key.push_back((WordIndex)-1); // separates the streams
+      }
+      auto it = distinct.emplace(std::move(key), (IndexType)firstIndices.size()).first;
+      if(it->second == firstIndices.size())
+        firstIndices.push_back(b);
+      sourceIndices.push_back(it->second);
+    }
+    return sourceIndices;
+  }
+
   /**
    * @brief Prints the batch in a readable form on stderr for debugging.
    */
@@ -520,6 +700,9 @@ public:
       const std::vector<Ptr<Vocab>>& vocabs,
       Ptr<Options> options);
 
+  // for datasets that read through other corpora with these vocabularies, opens no files
+  CorpusBase(const std::vector<Ptr<Vocab>>& vocabs, Ptr<Options> options);
+
   virtual ~CorpusBase() {}
   virtual std::vector<Ptr<Vocab>>& getVocabs() = 0;
 
@@ -541,6 +724,7 @@ protected:
   bool rightLeft_{false};
 
   bool tsv_{false};  // true if the input is a single file with tab-separated values
+  size_t decompressThreads_{1}; // threads for decompressing each input file, see --data-decompress-threads
   size_t tsvNumInputFields_{0};  // number of fields from the TSV input that are associated
                                   // with vocabs, i.e. excluding fields with alignment or
                                   // weights, only if --tsv
@@ -572,16 +756,33 @@ protected:
    * vocabulary and adding them to the sentence tuple.
    */
   void addWordsToSentenceTuple(const std::string& line, size_t batchIndex, SentenceTuple& tup) const;
+  /**
+   * @brief Helper function adding already encoded words without EOS, e.g. from a binary n-best
+   * list, to the sentence tuple. EOS is appended if required for the i-th input stream.
+   */
+  void addWordsToSentenceTuple(const Words& words, size_t batchIndex, SentenceTuple& tup) const;
+  /**
+   * @brief Same as above for words in a buffer, e.g. in an encoded chunk of lines or a binary corpus.
+   */
+  void addWordsToSentenceTuple(const Word* words, size_t size, size_t batchIndex, SentenceTuple& tup) const;
   /**
    * @brief Helper function parsing a line with word alignments and adding them
    * to the sentence tuple.
    */
-  void addAlignmentToSentenceTuple(const std::string& line, SentenceTuple& tup) const;
+  void addAlignmentToSentenceTuple(const utils::StringRange& line, SentenceTuple& tup) const;
+  /**
+   * @brief Helper function adding already parsed word alignments to the sentence tuple.
+   */
+  void addAlignmentToSentenceTuple(WordAlignment align, SentenceTuple& tup) const;
   /**
    * @brief Helper function parsing a line of weights and adding them to the
    * sentence tuple.
    */
   void addWeightsToSentenceTuple(const std::string& line, SentenceTuple& tup) const;
+  /**
+   * @brief Helper function adding already parsed weights to the sentence tuple.
+   */
+  void addWeightsToSentenceTuple(std::vector<float> weights, SentenceTuple& tup) const;
 
   void addAlignmentsToBatch(Ptr<CorpusBatch> batch, const std::vector<Sample>& batchVector);
 
@@ -0,0 +1,119 @@
+#include "data/corpus_mixed.h"
+
+#include <cmath>
+
+#include "common/utils.h"
+
+namespace marian {
+namespace data {
+
+MixedCorpus::MixedCorpus(Ptr<Options> options) : MixedCorpus(New<Corpus>(options), options) {}
+
+MixedCorpus::MixedCorpus(Ptr<Corpus> first, Ptr<Options> options)
+    : CorpusBase(first->getVocabs(), options),
+      bufferSize_(options_->get<size_t>("mix-shuffle-buffer", 10000)) {
+  ABORT_IF(options_->get("guided-alignment", std::string("none")) != "none"
+               || options_->hasAndNotEmpty("data-weighting"),
+           "Mixing corpora with --mix-corpora does not support guided alignment or data weighting");
+
+  sources_.push_back({first, options_->get<std::vector<std::string>>("train-sets"), {}, false});
+  size_t numStreams = sources_.front().paths.size();
+  for(auto& corpus : options_->get<std::vector<std::string>>("mix-corpora")) {
+    auto paths = utils::split(corpus, ",");
+    ABORT_IF(paths.size() != numStreams,
+             "Mixed corpus '{}' has {} files, but --train-sets has {} streams",
+             corpus, paths.size(), numStreams);
+    sources_.push_back({New<Corpus>(paths, vocabs_, options_), paths, {}, false});
+  }
+
+  auto weights = options_->get<std::vector<float>>("mix-weights", {});
+  if(weights.empty())
+    weights.resize(sources_.size(), 1.f);
+  ABORT_IF(weights.size() != sources_.size(),
+           "--mix-weights needs one weight for --train-sets and one for each of --mix-corpora, {} given for {} corpora",
+           weights.size(), sources_.size());
+  auto temperature = options_->get<float>("mix-temperature", 1.f);
+  ABORT_IF(temperature <= 0.f, "--mix-temperature has to be positive, not {}", temperature);
+
+  std::vector<double> probs;
+  double sum = 0;
+  for(auto w : weights) {
+    ABORT_IF(w < 0.f, "Weights of mixed corpora cannot be negative, {} given", w);
+    probs.push_back(std::pow((double)w, 1.0 / temperature));
+    sum += probs.back();
+  }
+  ABORT_IF(sum == 0, "At least one of the mixed corpora needs a positive weight");
+  choice_ = std::discrete_distribution<size_t>(probs.begin(), probs.end());
+
+  for(size_t i = 0; i < sources_.size(); ++i)
+    LOG(info, "[data] Mixing corpus {} with probability {:.4f}: {}",
+        i, probs[i] / sum, utils::join(sources_[i].paths, ", "));
+}
+
+SentenceTuple MixedCorpus::read(Source& source) {
+  auto tup = source.corpus->next();
+  if(!tup.empty())
+    return tup;
+
+  if(!source.finished) {
+    source.finished = true;
+    ++finished_;
+  }
+  source.corpus->reset();
+  tup = source.corpus->next();
+  ABORT_IF(tup.empty(), "Mixed corpus {} has no valid sentences", utils::join(source.paths, ", "));
+  return tup;
+}
+
+SentenceTuple MixedCorpus::next() {
+  // corpora with weight 0 are never drawn and do not hold up the end of the epoch
+  size_t active = 0;
+  for(auto p : choice_.probabilities())
+    active += p > 0;
+  if(finished_ >= active)
+    return SentenceTuple(0);
+
+  auto& source = sources_[choice_(eng_)];
+  ++returned_;
+  if(!shuffle_ || bufferSize_ == 0) { // sentences left in the buffer by a shuffled epoch come first
+    if(source.buffer.empty())
+      return read(source);
+    auto tup = std::move(source.buffer.back());
+    source.buffer.pop_back();
+    return tup;
+  }
+
+  if(source.buffer.empty()) {
+    source.buffer.reserve(bufferSize_);
+    while(source.buffer.size() < bufferSize_)
+      source.buffer.push_back(read(source));
+  }
+  // take a random sentence of the buffer and replace it with the next one of the corpus
+  size_t slot = std::uniform_int_distribution<size_t>(0, source.buffer.size() - 1)(eng_);
+  auto tup = std::move(source.buffer[slot]);
+  source.buffer[slot] = read(source);
+  return tup;
+}
+
+void MixedCorpus::startEpoch(bool shuffle) {
+  shuffle_ = shuffle;
+  for(auto& source : sources_)
+    source.finished = false;
+  finished_ = 0;
+  returned_ = 0;
+}
+
+void MixedCorpus::shuffle() {
+  startEpoch(/*shuffle=*/true);
+}
+
+void MixedCorpus::reset() {
+  startEpoch(/*shuffle=*/false);
+}
+
+void MixedCorpus::restore(Ptr<TrainingState> ts) {
+  setRNGState(ts->seedCorpus);
+}
+
+}  // namespace data
+}  // namespace marian
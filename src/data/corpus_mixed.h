@@ -0,0 +1,69 @@
+#pragma once
+
+#include <random>
+
+#include "common/definitions.h"
+#include "common/options.h"
+#include "data/corpus.h"
+#include "data/corpus_base.h"
+#include "data/vocab.h"
+
+namespace marian {
+namespace data {
+
+/**
+ * @brief Training data mixed from several corpora, see --mix-corpora.
+ *
+ * Each corpus is streamed in order through a shuffle buffer of its own, so that neither the files are
+ * shuffled nor the corpora concatenated, and an epoch starts right away. Every sentence comes from
+ * corpus i with probability proportional to w_i^(1/T), with the weights w from --mix-weights and the
+ * temperature T from --mix-temperature. A corpus that reaches its end starts over; the epoch ends once
+ * every corpus has been read to its end at least once since it began. The corpora keep their positions
+ * and buffers across epochs.
+ */
+class MixedCorpus : public CorpusBase {
+private:
+  struct Source {
+    Ptr<Corpus> corpus;
+    std::vector<std::string> paths;
+    std::vector<SentenceTuple> buffer; // the shuffle buffer, filled on the first read
+    bool finished;                     // read to the end in this epoch
+  };
+  std::vector<Source> sources_;
+  std::discrete_distribution<size_t> choice_; // of the source of the next sentence
+  size_t bufferSize_{0};
+  bool shuffle_{true};                        // take the sentences through the shuffle buffers
+  size_t finished_{0};                        // sources finished in this epoch
+  size_t returned_{0};                        // sentences returned in this epoch
+
+  MixedCorpus(Ptr<Corpus> first, Ptr<Options> options);
+
+  // the next sentence of the corpus of the source, starting the corpus over at its end
+  SentenceTuple read(Source& source);
+  void startEpoch(bool shuffle);
+
+public:
+  MixedCorpus(Ptr<Options> options);
+
+  Sample next() override;
+
+  // the corpora are mixed either way; without shuffling, the sentences of each corpus come in order
+  void shuffle() override;
+  void reset() override;
+
+  void restore(Ptr<TrainingState>) override;
+
+  size_t getPosition() const override { return returned_; }
+
+  iterator begin() override { return iterator(this); }
+  iterator end() override { return iterator(); }
+
+  std::vector<Ptr<Vocab>>& getVocabs() override { return vocabs_; }
+
+  batch_ptr toBatch(const std::vector<Sample>& batchVector) override {
+    return sources_.front().corpus->toBatch(batchVector);
+  }
+};
+
+}  // namespace data
+}  // namespace marian
@@ -2,17 +2,20 @@
 
 #include "common/utils.h"
 #include "data/corpus_nbest.h"
+#include "data/nbest_binary.h"
 
 namespace marian {
 namespace data {
 
 CorpusNBest::CorpusNBest(Ptr<Options> options, bool translate /*= false*/)
-    : CorpusBase(options, translate) {}
+    : CorpusBase(options, translate),
+      binary_(options->get<std::string>("n-best-format", "text") == "binary") {}
 
 CorpusNBest::CorpusNBest(std::vector<std::string> paths,
                          std::vector<Ptr<Vocab>> vocabs,
                          Ptr<Options> options)
-    : CorpusBase(paths, vocabs, options) {}
+    : CorpusBase(paths, vocabs, options),
+      binary_(options->get<std::string>("n-best-format", "text") == "binary") {}
 
 int numFromNbest(const std::string& line) {
   auto fields = utils::split(line, " ||| ", true);
@@ -45,14 +48,14 @@ SentenceTuple CorpusNBest::next() {
     // fill up the sentence tuple with sentences from all input files
     SentenceTuple tup(curId);
 
-    std::string line;
     lastLines_.resize(files_.size() - 1);
     size_t last = files_.size() - 1;
 
-    if(io::getline(*files_[last], line)) {
-      int curr_num = numFromNbest(line);
-      std::string curr_text = lineFromNbest(line);
-
+    // the hypothesis is read first to know whether the source sentences have to be advanced, but
+    // added to the tuple last
+    SentenceTuple hypTup(curId);
+    int curr_num = readNBest(*files_[last], hypTup);
+    if(curr_num >= 0) {
       for(size_t i = 0; i < last; ++i) {
         if(curr_num > lastNum_) {
           ABORT_IF(!std::getline(*files_[i], lastLines_[i]),
@@ -61,7 +64,7 @@ SentenceTuple CorpusNBest::next() {
         }
         addWordsToSentenceTuple(lastLines_[i], i, tup);
       }
-      addWordsToSentenceTuple(curr_text, last, tup);
+      tup.push_back(hypTup[0]);
       lastNum_ = curr_num;
     }
 
@@ -71,7 +74,7 @@ SentenceTuple CorpusNBest::next() {
     cont = tup.size() == expectedSize;
 
     // continue if all sentences are no longer than maximum allowed length
-    if(cont && std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
+    if(cont && std::all_of(tup.begin(), tup.end(), [=](const WordsSpan& words) {
          return words.size() > 0 && words.size() <= maxLength_;
        }))
       return tup;
@@ -79,6 +82,23 @@ SentenceTuple CorpusNBest::next() {
   return SentenceTuple(0);
 }
 
+int CorpusNBest::readNBest(std::istream& in, SentenceTuple& tup) {
+  size_t last = files_.size() - 1;
+  if(binary_) {
+    NBestEntry entry;
+    if(!readNBestEntry(in, entry))
+      return -1;
+    addWordsToSentenceTuple(std::move(entry.words), last, tup);
+    return (int)entry.lineNum;
+  }
+
+  std::string line;
+  if(!io::getline(in, line))
+    return -1;
+  addWordsToSentenceTuple(lineFromNbest(line), last, tup);
+  return numFromNbest(line);
+}
+
 void CorpusNBest::reset() {
   files_.clear();
   ids_.clear();
@@ -21,6 +21,10 @@ private:
   std::vector<size_t> ids_;
   int lastNum_{-1};
   std::vector<std::string> lastLines_;
+  bool binary_{false}; // the n-best list is in the binary format, see data/nbest_binary.h
+
+  // Reads the next entry of the n-best list, returns the sentence number or -1 at the end of the list
+  int readNBest(std::istream& in, SentenceTuple& tup);
 
 public:
   // @TODO: check if translate can be replaced by an option in options
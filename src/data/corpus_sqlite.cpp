@@ -1,3 +1,4 @@
+#include <numeric>
 #include <random>
 
 #include "data/corpus_sqlite.h"
@@ -6,14 +7,14 @@ namespace marian {
 namespace data {
 
 CorpusSQLite::CorpusSQLite(Ptr<Options> options, bool translate /*= false*/)
-    : CorpusBase(options, translate), seed_(Config::seed) {
+    : CorpusBase(options, translate) {
   fillSQLite();
 }
 
 CorpusSQLite::CorpusSQLite(const std::vector<std::string>& paths,
                            const std::vector<Ptr<Vocab>>& vocabs,
                            Ptr<Options> options)
-    : CorpusBase(paths, vocabs, options), seed_(Config::seed) {
+    : CorpusBase(paths, vocabs, options) {
   fillSQLite();
 }
 
@@ -55,7 +56,16 @@ void CorpusSQLite::fillSQLite() {
 
   // populate tables with lines from text files
   if(fill) {
-    std::string createStr = "create table lines (_id integer";
+    // Bulk import without a rollback journal and without syncing to disk in a single transaction.
+    // An interrupted import leaves a corrupted database, which has to be dropped with --sqlite-drop.
+    // The page size only applies to new database files.
+    db_->exec("PRAGMA page_size = 65536;");
+    db_->exec("PRAGMA journal_mode = OFF;");
+    db_->exec("PRAGMA synchronous = OFF;");
+    db_->exec("PRAGMA cache_size = -262144;"); // in KiB
+
+    // _id is an alias of the rowid, so lines are stored and looked up by their line number
+    std::string createStr = "create table lines (_id integer primary key";
     std::string insertStr = "insert into lines values (?";
     for(size_t i = 0; i < files_.size(); ++i) {
       createStr += ", line" + std::to_string(i) + " text";
@@ -68,51 +78,104 @@ void CorpusSQLite::fillSQLite() {
 
     SQLite::Statement ps(*db_, insertStr);
 
-    int lines = 0;
-    int report = 1000000;
-    bool cont = true;
+    size_t lines = 0;
+    size_t report = 1000000;
+    std::vector<std::string> texts(files_.size());
 
     db_->exec("begin;");
-    while(cont) {
-      ps.bind(1, (int)lines);
-
-      std::string line;
-      for(size_t i = 0; i < files_.size(); ++i) {
-        cont = cont && io::getline(*files_[i], line);
-        if(cont)
-          ps.bind((int)(i + 2), line);
-      }
-
-      if(cont) {
-        ps.exec();
-        ps.reset();
-      }
-      lines++;
-
-      if(lines % report == 0) {
-        LOG(info, "[sqlite] Inserted {} lines", lines);
-        db_->exec("commit;");
-        db_->exec("begin;");
+    for(;;) {
+      size_t eofsHit = 0;
+      for(size_t i = 0; i < files_.size(); ++i)
+        if(!io::getline(*files_[i], texts[i]))
+          eofsHit++;
+      if(eofsHit == files_.size())
+        break;
+      ABORT_IF(eofsHit != 0, "Not all input files have the same number of lines");
+
+      ps.bind(1, (long long)lines);
+      for(size_t i = 0; i < files_.size(); ++i)
+        ps.bindNoCopy((int)(i + 2), texts[i]); // texts outlive the execution of the statement
+      ps.exec();
+      ps.reset();
+
+      if(++lines % report == 0) {
+        LOG(info, "[sqlite] Inserted {} lines", utils::withCommas(lines));
         report *= 2;
       }
     }
     db_->exec("commit;");
-    LOG(info, "[sqlite] Inserted {} lines", lines - 1);
-    LOG(info, "[sqlite] Creating primary index");
-    db_->exec("create unique index idx_line on lines (_id);");
+    LOG(info, "[sqlite] Inserted {} lines", utils::withCommas(lines));
+
+    // regular journaling and syncing when reading and for later reuse of a persistent database
+    if(options_->get<std::string>("sqlite") != "temporary")
+      db_->exec("PRAGMA journal_mode = WAL;");
+    db_->exec("PRAGMA synchronous = NORMAL;");
+  }
+
+  SQLite::Statement count(*db_, "select count(*) from lines;");
+  count.executeStep();
+  numLines_ = (size_t)count.getColumn(0).getInt64();
+
+  std::string chunkStr = "select * from lines where _id in (?";
+  for(size_t i = 1; i < CHUNK_SIZE; ++i)
+    chunkStr += ", ?";
+  chunkStr += ");";
+  selectChunk_.reset(new SQLite::Statement(*db_, chunkStr));
+}
+
+void CorpusSQLite::fetchChunk() {
+  chunk_.clear();
+  chunkEnd_ = std::min(pos_ + CHUNK_SIZE, ids_.size());
+
+  // a full chunk uses the prepared statement, the last one of an epoch binds NULL to the rest
+  for(size_t i = 0; i < CHUNK_SIZE; ++i) {
+    if(pos_ + i < chunkEnd_)
+      selectChunk_->bind((int)(i + 1), (long long)ids_[pos_ + i]);
+    else
+      selectChunk_->bind((int)(i + 1));
   }
 
-  createRandomFunction();
+  while(selectChunk_->executeStep()) {
+    size_t id = (size_t)selectChunk_->getColumn(0).getInt64();
+    auto& lines = chunk_[id];
+    lines.resize(files_.size());
+    for(size_t i = 0; i < files_.size(); ++i)
+      lines[i] = selectChunk_->getColumn((int)(i + 1)).getString();
+  }
+  selectChunk_->reset();
+}
+
+bool CorpusSQLite::readLines(size_t& curId, std::vector<std::string>& lines) {
+  if(ids_.empty()) { // in corpus order
+    if(!select_ || !select_->executeStep())
+      return false;
+    curId = (size_t)select_->getColumn(0).getInt64();
+    for(size_t i = 0; i < files_.size(); ++i)
+      lines[i] = select_->getColumn((int)(i + 1)).getString();
+    ++pos_;
+    return true;
+  }
+
+  if(pos_ >= ids_.size())
+    return false;
+  if(pos_ >= chunkEnd_)
+    fetchChunk();
+  curId = ids_[pos_++];
+  auto it = chunk_.find(curId);
+  ABORT_IF(it == chunk_.end(), "Line {} is missing in the SQLite database", curId);
+  lines = std::move(it->second);
+  return true;
 }
 
 SentenceTuple CorpusSQLite::next() {
-  while(select_->executeStep()) {
+  size_t curId;
+  std::vector<std::string> lines(files_.size());
+  while(readLines(curId, lines)) {
     // fill up the sentence tuple with sentences from all input files
-    size_t curId = select_->getColumn(0).getInt();
     SentenceTuple tup(curId);
 
     for(size_t i = 0; i < files_.size(); ++i) {
-      auto line = select_->getColumn((int)(i + 1));
+      const auto& line = lines[i];
 
       if(i > 0 && i == alignFileIdx_) {
         addAlignmentToSentenceTuple(line, tup);
@@ -123,7 +186,7 @@ SentenceTuple CorpusSQLite::next() {
       }
     }
 
-    if(std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
+    if(std::all_of(tup.begin(), tup.end(), [=](const WordsSpan& words) {
          return words.size() > 0 && words.size() <= maxLength_;
        }))
       return tup;
@@ -132,23 +195,36 @@ SentenceTuple CorpusSQLite::next() {
 }
 
 void CorpusSQLite::shuffle() {
-  LOG(info, "[sqlite] Selecting shuffled data");
-  select_.reset(new SQLite::Statement(
-      *db_, "select * from lines order by random_seed(" + std::to_string(seed_) + ");"));
+  LOG(info, "[sqlite] Shuffling {} lines", utils::withCommas(numLines_));
+  select_.reset();
+  ids_.resize(numLines_);
+  std::iota(ids_.begin(), ids_.end(), 0);
+  std::shuffle(ids_.begin(), ids_.end(), eng_);
+  pos_ = 0;
+  chunkEnd_ = 0;
 }
 
 void CorpusSQLite::reset() {
+  ids_.clear();
+  chunk_.clear();
+  pos_ = 0;
+  chunkEnd_ = 0;
   select_.reset(
       new SQLite::Statement(*db_, "select * from lines order by _id;"));
 }
 
 void CorpusSQLite::restore(Ptr<TrainingState> ts) {
-  for(size_t i = 0; i < ts->epochs - 1; ++i) {
-    select_.reset(new SQLite::Statement(
-        *db_, "select _id from lines order by random_seed(" + std::to_string(seed_) + ");"));
-    select_->executeStep();
-    reset();
+  setRNGState(ts->seedCorpus);
+}
+
+bool CorpusSQLite::seek(size_t position) {
+  if(ids_.empty()) { // in corpus order, continue after the given number of lines
+    select_.reset(new SQLite::Statement(*db_, "select * from lines where _id >= ? order by _id;"));
+    select_->bind(1, (long long)position);
   }
+  pos_ = position;
+  chunkEnd_ = 0;
+  return true;
 }
 }  // namespace data
 }  // namespace marian
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <iostream>
 #include <random>
+#include <unordered_map>
 
 #include "common/definitions.h"
 #include "common/file_stream.h"
@@ -16,31 +17,29 @@
 #include <SQLiteCpp/SQLiteCpp.h>
 #include <SQLiteCpp/sqlite3/sqlite3.h>
 
-static void SQLiteRandomSeed(sqlite3_context* context,
-                             int argc,
-                             sqlite3_value** argv) {
-  if(argc == 1 && sqlite3_value_type(argv[0]) == SQLITE_INTEGER) {
-    const int seed = sqlite3_value_int(argv[0]);
-    static std::default_random_engine eng(seed);
-    std::uniform_int_distribution<> unif;
-    const int result = unif(eng);
-    sqlite3_result_int(context, result);
-  } else {
-    sqlite3_result_error(context, "Invalid", 0);
-  }
-}
-
 namespace marian {
 namespace data {
 
+// Training corpus stored in an SQLite database, which allows shuffling corpora larger than RAM.
+// The lines are bulk-imported into a table keyed by the line number. Shuffling permutes the line
+// numbers in memory, and the lines are then read in chunks of consecutive permuted line numbers,
+// each with a single query.
 class CorpusSQLite : public CorpusBase {
 private:
+  static const size_t CHUNK_SIZE = 500; // lines per query, below SQLite's limit of 999 parameters
+
   UPtr<SQLite::Database> db_;
-  UPtr<SQLite::Statement> select_;
+  UPtr<SQLite::Statement> select_;      // lines in corpus order, if not shuffled
+  UPtr<SQLite::Statement> selectChunk_; // lines of CHUNK_SIZE line numbers
 
-  void fillSQLite();
+  size_t numLines_{0};
+  std::vector<size_t> ids_;   // permuted line numbers, empty if not shuffled
+  size_t chunkEnd_{0};        // end of the lines in chunk_ in ids_
+  std::unordered_map<size_t, std::vector<std::string>> chunk_; // [line number] lines of all streams
 
-  size_t seed_;
+  void fillSQLite();
+  void fetchChunk();
+  bool readLines(size_t& curId, std::vector<std::string>& lines);
 
 public:
   // @TODO: check if translate can be replaced by an option in options
@@ -58,6 +57,9 @@ public:
 
   void restore(Ptr<TrainingState>) override;
 
+  size_t getPosition() const override { return pos_; }
+  bool seek(size_t position) override;
+
   iterator begin() override { return iterator(this); }
 
   iterator end() override { return iterator(); }
@@ -110,17 +112,6 @@ public:
     return batch;
   }
 
-private:
-  void createRandomFunction() {
-    sqlite3_create_function(db_->getHandle(),
-                            "random_seed",
-                            1,
-                            SQLITE_UTF8,
-                            NULL,
-                            &SQLiteRandomSeed,
-                            NULL,
-                            NULL);
-  }
 };
 }  // namespace data
 }  // namespace marian
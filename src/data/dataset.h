@@ -44,6 +44,16 @@ public:
   virtual void prepare() {}
   virtual void restore(Ptr<TrainingState>) {}
 
+  // Number of input records consumed in this epoch, and continuing to read after that many records
+  // right after reset() or shuffle(). Allows resuming training without re-reading the epoch;
+  // seek() returns false if the dataset does not support this.
+  virtual size_t getPosition() const { return 0; }
+  virtual bool seek(size_t /*position*/) { return false; }
+
+  // Whether the next record can be read within the given time, or the end has been reached. Only
+  // streamed input may have to wait, see --input-idle-flush, all other datasets return true.
+  virtual bool waitForInput(size_t /*milliseconds*/) { return true; }
+
   // @TODO: remove after cleaning traininig/training.h
   virtual Ptr<Options> options() { return options_; }
 };
@@ -1,12 +1,18 @@
 #include "data/vocab_base.h"
 
+#include "3rd_party/threadpool.h"
 #include "3rd_party/yaml-cpp/yaml.h"
+#include "common/fastopt.h"
 #include "common/logging.h"
+#include "common/options.h"
 #include "common/regex.h"
 #include "common/utils.h"
 #include "common/filesystem.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -17,12 +23,23 @@ namespace marian {
 
 class DefaultVocab : public IVocab {
 protected:
+  Ptr<Options> options_; // for creating vocabularies, may be null
+
   typedef std::map<std::string, Word> Str2Id;
-  Str2Id str2id_;
+  Str2Id str2id_; // used while the vocabulary is built, cleared when the index below is frozen
 
   typedef std::vector<std::string> Id2Str;
   Id2Str id2str_;
 
+  // Frozen string-to-id index, built once the vocabulary is complete: a perfect hash of the token
+  // hashes selects a slot with the only candidate id, which is verified against the token stored in
+  // a single contiguous arena. Lookups touch two small arrays and the arena instead of a tree of
+  // heap-allocated strings.
+  UPtr<PerfectHash> hash_;
+  std::vector<WordIndex> slots_;    // [hash slot] word index of the token in this slot
+  std::string arena_;               // all tokens, concatenated
+  std::vector<size_t> arenaOffsets_; // [word index] position of the token in arena_, one extra at the end
+
   Word eosId_ = Word::NONE;
   Word unkId_ = Word::NONE;
 
@@ -44,22 +61,39 @@ protected:
   };
 
 public:
+  DefaultVocab(Ptr<Options> options = nullptr) : options_(options) {}
+
   // @TODO: choose between 'virtual' and 'final'. Can we derive from this class?
   virtual ~DefaultVocab() {};
   virtual const std::string& canonicalExtension() const override { return suffixes_[0]; }
   virtual const std::vector<std::string>& suffixes() const override { return suffixes_; }
 
   virtual Word operator[](const std::string& word) const override {
-    auto it = str2id_.find(word);
-    if(it != str2id_.end())
-      return it->second;
-    else
-      return unkId_;
+    return lookup(word.data(), word.size());
+  }
+
+  Words encode(const std::string& line, bool addEOS, bool inference) const override {
+    Words words;
+    encodeAppend(utils::StringRange(line), words, addEOS, inference);
+    return words;
   }
 
-  Words encode(const std::string& line, bool addEOS, bool /*inference*/) const override {
-    auto lineTokens = utils::split(line, " ");
-    return (*this)(lineTokens, addEOS);
+  // Tokens are looked up in place without copying them, splitting like utils::split(line, " ")
+  void encodeAppend(const utils::StringRange& line, Words& words, bool addEOS, bool /*inference*/) const override {
+    const char* begin = line.data;
+    const char* end = line.data + line.size;
+    for(;;) {
+      const char* pos = (const char*)memchr(begin, ' ', end - begin);
+      if(!pos)
+        pos = end;
+      if(pos > begin)
+        words.push_back(lookup(begin, pos - begin));
+      if(pos == end)
+        break;
+      begin = pos + 1;
+    }
+    if(addEOS)
+      words.push_back(eosId_);
   }
 
   std::string decode(const Words& sentence, bool ignoreEOS) const override {
@@ -131,6 +165,7 @@ public:
     ABORT_IF(id2str_.empty(), "Empty vocabulary: ", vocabPath);
 
     addRequiredVocabulary(vocabPath, isJson);
+    freezeIndex();
 
     return std::max(id2str_.size(), maxSize);
   }
@@ -139,6 +174,7 @@ public:
   virtual void createFake() override {
     eosId_ = insertWord(Word::DEFAULT_EOS_ID, DEFAULT_EOS_STR);
     unkId_ = insertWord(Word::DEFAULT_UNK_ID, DEFAULT_UNK_STR);
+    freezeIndex();
   }
 
   virtual void create(const std::string& vocabPath,
@@ -164,10 +200,7 @@ public:
               path.string());
     }
 
-    std::unordered_map<std::string, size_t> counter;
-    for(const auto& trainPath : trainPaths)
-      addCounts(counter, trainPath);
-    create(vocabPath, counter, maxSize);
+    create(vocabPath, countWords(trainPaths), maxSize);
   }
 
 private:
@@ -206,24 +239,139 @@ private:
     unkId_ = getRequiredWordId(DEFAULT_UNK_STR, NEMATUS_UNK_STR, Word::DEFAULT_UNK_ID);
   }
 
-  void addCounts(std::unordered_map<std::string, size_t>& counter,
-                 const std::string& trainPath) {
-    std::unique_ptr<std::istream> trainStrm(
-      trainPath == "stdin" ? new std::istream(std::cin.rdbuf())
-                           : new io::InputFileStream(trainPath)
-    );
+  typedef std::unordered_map<std::string, size_t> Counter;
+
+  // Count-min sketch of the token counts in a fixed amount of memory: a token increments one counter in each
+  // row, the smallest of them is an upper bound of its count. Updated from several threads at once.
+  class CountSketch {
+    static const size_t ROWS = 4;
+    size_t cols_;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts_; // [ROWS, cols_]
+
+    // column of the row, from two hashes of the token (Kirsch and Mitzenmacher)
+    size_t col(size_t row, size_t hash) const {
+      size_t second = (hash >> 32 | hash << 32) * 0x9E3779B97F4A7C15ull | 1;
+      return (hash + row * second) % cols_;
+    }
+
+  public:
+    CountSketch(size_t bytes)
+        : cols_(std::max<size_t>(1, bytes / (ROWS * sizeof(uint64_t)))), counts_(new std::atomic<uint64_t>[ROWS * cols_]) {
+      for(size_t i = 0; i < ROWS * cols_; ++i)
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+
+    void add(const std::string& token) {
+      size_t hash = std::hash<std::string>()(token);
+      for(size_t row = 0; row < ROWS; ++row)
+        counts_[row * cols_ + col(row, hash)].fetch_add(1, std::memory_order_relaxed);
+    }
 
-    std::string line;
-    while(getline(*trainStrm, line)) {
-      auto toks = utils::split(line, " ");
+    uint64_t estimate(const std::string& token) const {
+      size_t hash = std::hash<std::string>()(token);
+      uint64_t count = UINT64_MAX;
+      for(size_t row = 0; row < ROWS; ++row)
+        count = std::min(count, counts_[row * cols_ + col(row, hash)].load(std::memory_order_relaxed));
+      return count;
+    }
+  };
+
+  // Calls fn(tokens, thread) for the tokens of every line of the files, from `threads` threads. A thread
+  // gets chunks of lines and its index in [0, threads).
+  template <class F>
+  static void forEachLine(const std::vector<std::string>& trainPaths, size_t threads, const F& fn) {
+    const size_t chunkLines = 16384;
+    auto countChunk = [&](const std::vector<std::string>& lines, size_t thread) {
+      for(const auto& line : lines)
+        fn(utils::split(line, " "), thread);
+    };
+
+    // at most two chunks per thread wait for a thread, which bounds the memory of the lines read ahead
+    UPtr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads, 2 * threads) : nullptr);
+    std::deque<std::future<void>> pending; // the chunks that may still be counted, oldest first
+    for(const auto& trainPath : trainPaths) {
+      std::unique_ptr<std::istream> trainStrm(
+        trainPath == "stdin" ? new std::istream(std::cin.rdbuf())
+                             : new io::InputFileStream(trainPath) // also decompresses
+      );
+
+      std::vector<std::string> lines;
+      auto submit = [&]() {
+        if(pool) {
+          pending.push_back(pool->enqueue([&countChunk](const std::vector<std::string>& chunk) {
+            countChunk(chunk, ThreadPool::currentWorker());
+          }, std::move(lines)));
+          for(; pending.size() > 4 * threads; pending.pop_front())
+            pending.front().get();
+        } else
+          countChunk(lines, 0);
+        lines.clear();
+      };
+      std::string line;
+      while(getline(*trainStrm, line)) {
+        lines.push_back(std::move(line));
+        if(lines.size() == chunkLines)
+          submit();
+      }
+      if(!lines.empty())
+        submit();
+    }
+    for(auto& done : pending)
+      done.get();
+  }
+
+  // The count of every token in the files, counted by --data-threads threads into a counter each, which are
+  // merged at the end. Tokens that occur fewer than --min-count times are left out. With --count-sketch-size,
+  // a first pass over the files fills a count-min sketch, and the second pass only counts the tokens that
+  // may occur often enough, which bounds the memory of the counters for corpora with many rare tokens.
+  Counter countWords(const std::vector<std::string>& trainPaths) const {
+    size_t threads  = std::max<size_t>(1, options_ ? options_->get<size_t>("data-threads", 1) : 1);
+    size_t minCount = options_ ? options_->get<size_t>("min-count", 0) : 0;
+    size_t sketchMB = options_ ? options_->get<size_t>("count-sketch-size", 0) : 0;
+
+    UPtr<CountSketch> sketch;
+    if(sketchMB > 0 && minCount > 1) {
+      ABORT_IF(std::find(trainPaths.begin(), trainPaths.end(), "stdin") != trainPaths.end(),
+               "--count-sketch-size reads the input twice, it needs files instead of stdin");
+      LOG(info, "[data] Filling a count sketch of {} MB", sketchMB);
+      sketch.reset(new CountSketch(sketchMB * 1024 * 1024));
+      forEachLine(trainPaths, threads, [&](const std::vector<std::string>& toks, size_t /*thread*/) {
+        for(const std::string& tok : toks)
+          sketch->add(tok);
+      });
+    } else if(sketchMB > 0) {
+      LOG(warn, "[data] --count-sketch-size has no effect without a --min-count of at least 2");
+    }
+
+    std::vector<Counter> counters(threads); // [thread]
+    forEachLine(trainPaths, threads, [&](const std::vector<std::string>& toks, size_t thread) {
+      auto& counter = counters[thread];
       for(const std::string& tok : toks) {
+        if(sketch && sketch->estimate(tok) < minCount)
+          continue;
         auto iter = counter.find(tok);
         if(iter == counter.end())
           counter[tok] = 1;
         else
           iter->second++;
       }
+    });
+
+    Counter counter = std::move(counters[0]);
+    for(size_t i = 1; i < counters.size(); ++i) {
+      for(auto& p : counters[i])
+        counter[p.first] += p.second;
+      Counter().swap(counters[i]);
+    }
+    if(minCount > 1) {
+      for(auto iter = counter.begin(); iter != counter.end();) {
+        if(iter->second < minCount)
+          iter = counter.erase(iter);
+        else
+          ++iter;
+      }
     }
+    return counter;
   }
 
   virtual void create(const std::string& vocabPath,
@@ -278,8 +426,59 @@ private:
     return decoded;
   }
 
+  Word lookup(const char* str, size_t length) const {
+    if(!hash_) {
+      auto it = str2id_.find(std::string(str, length));
+      return it != str2id_.end() ? it->second : unkId_;
+    }
+    // tokens outside the vocabulary are hashed to an arbitrary slot, hence the comparison
+    WordIndex id = slots_[(*hash_)[crc::crc(str, length)]];
+    if(id < id2str_.size()
+       && arenaOffsets_[id + 1] - arenaOffsets_[id] == length
+       && std::equal(str, str + length, arena_.data() + arenaOffsets_[id]))
+      return Word::fromWordIndex(id);
+    return unkId_;
+  }
+
+  // builds the perfect-hash index from id2str_[] and releases str2id_[]
+  void freezeIndex() {
+    arena_.clear();
+    arenaOffsets_.assign(1, 0);
+    std::vector<uint64_t> keys;
+    std::vector<WordIndex> ids;
+    for(size_t id = 0; id < id2str_.size(); ++id) {
+      const auto& str = id2str_[id];
+      arena_ += str;
+      arenaOffsets_.push_back(arena_.size());
+      if(!str.empty()) { // unused ids of Yaml vocabularies
+        keys.push_back(crc::crc(str.data(), str.size()));
+        ids.push_back((WordIndex)id);
+      }
+    }
+
+    // the perfect hash requires distinct keys, keep the map in the very unlikely case of a collision
+    auto sortedKeys = keys;
+    std::sort(sortedKeys.begin(), sortedKeys.end());
+    if(std::adjacent_find(sortedKeys.begin(), sortedKeys.end()) != sortedKeys.end()) {
+      LOG(warn, "[data] Hash collision between vocabulary entries, not using a perfect-hash index");
+      return;
+    }
+
+    hash_.reset(new PerfectHash(keys));
+    slots_.assign(hash_->size(), (WordIndex)id2str_.size()); // empty slots hold an invalid id
+    for(size_t i = 0; i < keys.size(); ++i)
+      slots_[(*hash_)[keys[i]]] = ids[i];
+    str2id_.clear();
+  }
+
   // helper to insert a word into str2id_[] and id2str_[]
   Word insertWord(Word word, const std::string& str) {
+    if(hash_) { // the vocabulary is modified again, go back to the map until it is frozen again
+      for(size_t id = 0; id < id2str_.size(); ++id)
+        if(!id2str_[id].empty())
+          str2id_[id2str_[id]] = Word::fromWordIndex(id);
+      hash_.reset();
+    }
     str2id_[str] = word;
     auto id = word.toWordIndex();
     if(id >= id2str_.size())
@@ -292,6 +491,9 @@ private:
 // This is a vocabulary class that does not enforce </s> or <unk>.
 // This is used for class lists in a classifier.
 class ClassVocab : public DefaultVocab {
+public:
+  using DefaultVocab::DefaultVocab;
+
 private:
   // Do nothing.
   virtual void addRequiredVocabulary(const std::string& /*vocabPath*/, bool /*isJson*/) override {}
@@ -322,12 +524,12 @@ private:
   }
 };
 
-Ptr<IVocab> createDefaultVocab() {
-  return New<DefaultVocab>();
+Ptr<IVocab> createDefaultVocab(Ptr<Options> options) {
+  return New<DefaultVocab>(options);
 }
 
-Ptr<IVocab> createClassVocab() {
-  return New<ClassVocab>();
+Ptr<IVocab> createClassVocab(Ptr<Options> options) {
+  return New<ClassVocab>(options);
 }
 
 }
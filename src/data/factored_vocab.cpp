@@ -6,6 +6,7 @@
 #include "data/types.h"
 #include "common/regex.h"
 #include "data/factored_vocab.h"
+#include <algorithm>
 #include <set>
 
 // @TODO: review all comments and clarify nomenclature:
@@ -153,7 +154,9 @@ namespace marian {
   //  - result of Output layer is nevertheless logits, not a normalized probability, due to the sigmoid entries
   // For every lemma, the factor map contains one example. At the end of this loop, we have a vocabulary
   // vocab_ that contains those examples, but not all possible combinations
-  lemmaHasFactorGroup_.resize(groupRanges_[0].second - groupRanges_[0].first); // group 0 is the lemmas; this difference is the number of lemma symbols
+  size_t numLemmas = groupRanges_[0].second - groupRanges_[0].first; // group 0 is the lemmas; this difference is the number of lemma symbols
+  lemmaHasFactorGroup_.assign((numLemmas + 1) * getNumGroups(), 0); // +1 for the sentinel of an unspecified lemma
+  std::vector<bool> lemmaSeen(numLemmas, false);
   size_t numTotalFactors = 0;
   for (WordIndex v = 0; v < factorMapTokenized.size(); v++) {
     const auto& tokens = factorMapTokenized[v];
@@ -170,18 +173,20 @@ namespace marian {
     // convert to fully unrolled factors representation
     auto na = FACTOR_NOT_APPLICABLE; // (gcc compiler bug: sometimes it cannot find this if passed directly)
     std::vector<size_t> factorIndices(groupRanges_.size(), na); // default for unused factors
-    std::vector<bool> hasFactorGroupFlags(groupRanges_.size(), false);
+    std::vector<uint8_t> hasFactorGroupFlags(groupRanges_.size(), 0);
     for (auto u : factorUnits) {
       factorIndices[factorGroups_[u]] = factorUnit2FactorIndex(u);
-      hasFactorGroupFlags[factorGroups_[u]] = true;
+      hasFactorGroupFlags[factorGroups_[u]] = 1;
     }
     // record which lemma has what factor groups
     ABORT_IF(!hasFactorGroupFlags[0], "Factor map does not specify a lemma (factor of first group) for word {}", tokens.front());
-    auto& lemmaFlags = lemmaHasFactorGroup_[factorIndices[0]];
-    if (lemmaFlags.empty())
-      lemmaFlags = std::move(hasFactorGroupFlags);
+    auto lemmaFlags = lemmaHasFactorGroup_.begin() + factorIndices[0] * getNumGroups();
+    if (!lemmaSeen[factorIndices[0]]) {
+      std::copy(hasFactorGroupFlags.begin(), hasFactorGroupFlags.end(), lemmaFlags);
+      lemmaSeen[factorIndices[0]] = true;
+    }
     else
-      ABORT_IF(lemmaFlags != hasFactorGroupFlags, "Inconsistent factor groups used for word {}", tokens.front());
+      ABORT_IF(!std::equal(hasFactorGroupFlags.begin(), hasFactorGroupFlags.end(), lemmaFlags), "Inconsistent factor groups used for word {}", tokens.front());
     // map factors to non-dense integer
     auto word = factors2word(factorIndices);
     // add to vocab (the wordIndex are not dense, so the vocab will have holes)
@@ -293,6 +298,13 @@ void FactoredVocab::constructFactorIndexConversion() {
   factorStrides_.resize(factorShape_.size(), 1);
   for (size_t g = factorStrides_.size() - 1; g --> 0; )
     factorStrides_[g] = factorStrides_[g + 1] * (size_t)factorShape_[g + 1];
+  factorSentinels_.resize(factorShape_.size());
+  lemmaOnlyOffset_ = 0;
+  for (size_t g = 0; g < factorShape_.size(); g++) {
+    factorSentinels_[g] = (size_t)factorShape_[g] - 1;
+    if (g > 0)
+      lemmaOnlyOffset_ += factorSentinels_[g] * factorStrides_[g];
+  }
   ABORT_IF((WordIndex)virtualVocabSize() != virtualVocabSize(),
       "Too many factors, virtual index space {} exceeds the bit limit of WordIndex type", utils::withCommas(virtualVocabSize()));
 }
@@ -331,15 +343,9 @@ Word FactoredVocab::factors2word(const std::vector<size_t>& factorIndices /* [nu
 // Those are encoded as the value FACTOR_NOT_SPECIFIED. This function is used during beam search,
 // which starts with lemma scores, and then adds factors one by one to the path score.
 Word FactoredVocab::lemma2Word(size_t factor0Index) const {
-  size_t numGroups = getNumGroups();
-  std::vector<size_t> factorIndices;
-  factorIndices.reserve(numGroups);
-  factorIndices.push_back(factor0Index);
-  for (size_t g = 1; g < numGroups; g++) {
-    auto index = lemmaHasFactorGroup(factor0Index, g) ? FACTOR_NOT_SPECIFIED : FACTOR_NOT_APPLICABLE;
-    factorIndices.push_back(index);
-  }
-  return factors2word(factorIndices);
+  // all other factors are either not specified or not applicable, which are both encoded as the sentinel
+  ABORT_IF(factor0Index >= factorSentinels_[0], "Lemma index {} out of range", factor0Index);
+  return Word::fromWordIndex(factor0Index * factorStrides_[0] + lemmaOnlyOffset_);
 }
 
 // replace a factor that is FACTOR_NOT_SPECIFIED by a specified one
@@ -348,16 +354,16 @@ Word FactoredVocab::expandFactoredWord(Word word, size_t groupIndex, size_t fact
   //LOG(info, "expand {} + [{}]={}", word2string(word), groupIndex, factorIndex);
   ABORT_IF(groupIndex == 0, "Cannot add or change lemma in a partial Word");
   ABORT_IF(!isFactorValid(factorIndex), "Cannot add unspecified or n/a factor to a partial Word");
-  std::vector<size_t> factorIndices;
-  word2factors(word, factorIndices);
-  auto factor0Index = factorIndices[0];
-  ABORT_IF(!isFactorValid(factor0Index), "Cannot add factor to a partial Word without lemma");
-  ABORT_IF(factorIndices[groupIndex] == FACTOR_NOT_APPLICABLE, "Cannot add a factor that the lemma does not have");
-  ABORT_IF(factorIndices[groupIndex] != FACTOR_NOT_SPECIFIED, "Cannot modify a specified factor in a partial Word");
-  factorIndices[groupIndex] = factorIndex;
-  word = factors2word(factorIndices);
-  //LOG(info, "to {}", word2string(word));
-  return word;
+  ABORT_IF(factorIndex >= factorSentinels_[groupIndex], "Factor index out of range");
+  size_t index = word.toWordIndex();
+  size_t factor0Index = index / factorStrides_[0];
+  ABORT_IF(factor0Index >= factorSentinels_[0], "Cannot add factor to a partial Word without lemma");
+  ABORT_IF(!lemmaHasFactorGroup(factor0Index, groupIndex), "Cannot add a factor that the lemma does not have");
+  ABORT_IF((index / factorStrides_[groupIndex]) % (size_t)factorShape_[groupIndex] != factorSentinels_[groupIndex],
+           "Cannot modify a specified factor in a partial Word");
+  // the unspecified factor is the sentinel, so replacing it only changes the digit of this group
+  index -= (factorSentinels_[groupIndex] - factorIndex) * factorStrides_[groupIndex];
+  return Word::fromWordIndex(index);
 }
 
 // factor unit: index of factor name in the joint factor vocabulary
@@ -371,17 +377,34 @@ size_t FactoredVocab::factorUnit2FactorIndex(WordIndex u) const {
 // split the 'Word' representation, which is really a single big integer, into the individual
 // factor indices for all factor types
 void FactoredVocab::word2factors(Word word, std::vector<size_t>& factorIndices /* [numGroups] */) const {
+  factorIndices.resize(getNumGroups());
+  word2factors(word, factorIndices.data());
+}
+
+// Same as getFactor() for all groups, but peels off the factor indices from the last group to the
+// first one with a single division each, and looks up the lemma's factor groups in one table row.
+void FactoredVocab::word2factors(Word word, size_t* factorIndices /* [numGroups] */) const {
   size_t numGroups = getNumGroups();
-  factorIndices.resize(numGroups);
-  for (size_t g = 0; g < numGroups; g++) {
-    auto factorIndex = getFactor(word, g);
-    factorIndices[g] = factorIndex;
+  size_t index = word.toWordIndex();
+  for (size_t g = numGroups; g --> 1; ) {
+    size_t size = (size_t)factorShape_[g];
+    factorIndices[g] = index % size;
+    index /= size;
+  }
+  size_t factor0Index = index;
+  ABORT_IF(factor0Index > factorSentinels_[0], "Word index {} out of range", word.toWordIndex());
+  const uint8_t* hasFactorGroup = lemmaHasFactorGroup_.data() + factor0Index * numGroups;
+  bool hasLemma = factor0Index != factorSentinels_[0];
+  factorIndices[0] = hasLemma ? factor0Index : FACTOR_NOT_SPECIFIED;
+  for (size_t g = 1; g < numGroups; g++) {
+    if (factorIndices[g] == factorSentinels_[g]) // special sentinel value for unspecified or not-applicable
+      factorIndices[g] = hasFactorGroup[g] ? FACTOR_NOT_SPECIFIED : FACTOR_NOT_APPLICABLE;
+    else {
+      ABORT_IF(!hasLemma, "Word has specified factor but no lemma??");
+      if (!hasFactorGroup[g])
+        factorIndices[g] = FACTOR_NOT_SPECIFIED; // same as getFactor()
+    }
   }
-#if 1
-  auto test = factors2word(factorIndices);
-  ABORT_IF(test != word, "Word <-> factor conversion broken?? {} vs{}, '{}' vs. '{}'",
-           test.toWordIndex(), word.toWordIndex(), word2string(test), word2string(word));
-#endif
 }
 
 // serialize 'Word' representation into its string form
@@ -545,9 +568,7 @@ void FactoredVocab::constructNormalizationInfoForVocab() {
 // This strange pointer-based interface is for ease of interaction with our production environment.
 /*virtual*/ void FactoredVocab::transcodeToShortlistInPlace(WordIndex* ptr, size_t num) const {
   for (; num-- > 0; ptr++) {
-    auto word = Word::fromWordIndex(*ptr);
-    auto wordString = word2string(word);
-    auto lemmaIndex = getFactor(word, 0) + groupRanges_[0].first;
+    auto lemmaIndex = *ptr / factorStrides_[0] + groupRanges_[0].first;
     *ptr = (WordIndex)lemmaIndex;
   }
 }
@@ -672,10 +693,10 @@ FactoredVocab::CSRData FactoredVocab::csr_rows(const Words& words) const {
   indices.reserve(words.size()); // (at least this many)
   // loop over all input words, and select the corresponding set of unit indices into CSR format
   offsets.push_back((IndexType)indices.size());
-  std::vector<size_t> factorIndices;
+  std::vector<size_t> factorIndices(numGroups);
   for (auto word : words) {
     if (vocab_.contains(word.toWordIndex())) { // skip invalid combinations in the space (can only happen during initialization)  --@TODO: add a check?
-      word2factors(word, factorIndices);
+      word2factors(word, factorIndices.data());
       for (size_t g = 0; g < numGroups; g++) { // @TODO: make this faster by having a list of all factors to consider for a lemma?
         auto factorIndex = factorIndices[g];
         ABORT_IF(factorIndex == FACTOR_NOT_SPECIFIED, "Attempted to embed a word with a factor not specified");
@@ -743,9 +764,14 @@ size_t FactoredVocab::WordLUT::load(const std::string& path) {
 }
 
 void FactoredVocab::WordLUT::dumpToFile(const std::string& path) {
+  std::vector<std::pair<WordIndex, const std::string*>> entries;
+  entries.reserve(index2str_.size());
+  for (const auto& kvp : index2str_)
+    entries.emplace_back(kvp.first, &kvp.second);
+  std::sort(entries.begin(), entries.end());
   io::OutputFileStream out(path);
-  for (auto kvp : index2str_)
-    out << kvp.second << "\t" << utils::withCommas(kvp.first) << "\n";
+  for (const auto& entry : entries)
+    out << *entry.second << "\t" << utils::withCommas(entry.first) << "\n";
 }
 
 const static std::vector<std::string> exts{ ".fsv", ".fm"/*legacy*/ }; // @TODO: delete the legacy one
@@ -9,6 +9,8 @@
 #include "data/types.h"
 #include "data/vocab_base.h"
 
+#include <unordered_map>
+
 #undef FACTOR_FULL_EXPANSION // define this to get full expansion. @TODO: infeasible for many factors; just delete this
 
 namespace marian {
@@ -61,11 +63,12 @@ public:
   // convert representations
   Word factors2word(const std::vector<size_t>& factors) const;
   void word2factors(Word word, std::vector<size_t>& factors) const;
+  void word2factors(Word word, size_t* factors) const; // [numGroups], same as above without allocating
   Word lemma2Word(size_t factor0Index) const;
   Word expandFactoredWord(Word word, size_t groupIndex, size_t factorIndex) const;
-  bool canExpandFactoredWord(Word word, size_t groupIndex) const { return lemmaHasFactorGroup(getFactor(word, 0), groupIndex); }
+  bool canExpandFactoredWord(Word word, size_t groupIndex) const { return lemmaHasFactorGroup(word.toWordIndex() / factorStrides_[0], groupIndex); }
   size_t getFactor(Word word, size_t groupIndex) const;
-  bool lemmaHasFactorGroup(size_t factor0Index, size_t g) const { return lemmaHasFactorGroup_[factor0Index][g]; }
+  bool lemmaHasFactorGroup(size_t factor0Index, size_t g) const { return lemmaHasFactorGroup_[factor0Index * groupRanges_.size() + g] != 0; }
   const std::string& getFactorGroupPrefix(size_t groupIndex) const { return groupPrefixes_[groupIndex]; } // for diagnostics only
   const std::string& getFactorName(size_t groupIndex, size_t factorIndex) const { return factorVocab_[(WordIndex)(factorIndex + groupRanges_[groupIndex].first)]; }
   std::string decodeForDiagnostics(const Words& sentence) const;
@@ -99,8 +102,8 @@ private:
 private:
   // @TODO: Should we move WordLUT to utils?
   class WordLUT { // map between strings and WordIndex
-    std::map<std::string, WordIndex> str2index_;
-    std::map<WordIndex, std::string> index2str_;
+    std::unordered_map<std::string, WordIndex> str2index_;
+    std::unordered_map<WordIndex, std::string> index2str_;
   public:
     WordIndex add(const std::string& word, WordIndex index);
     const std::string& operator[](WordIndex index) const;
@@ -126,9 +129,11 @@ private:
 #endif
   std::vector<size_t> factorGroups_;                   // [u] -> group id of factor u
   std::vector<std::pair<size_t, size_t>> groupRanges_; // [group id g] -> (u_begin,u_end) index range of factors u for this group. These don't overlap.
-  std::vector<std::vector<bool>> lemmaHasFactorGroup_; // [factor 0 index][g] -> true if lemma has factor group
+  std::vector<uint8_t> lemmaHasFactorGroup_;           // [factor 0 index * numGroups + g] -> 1 if lemma has factor group; the last row (no lemma) is all 0
   Shape factorShape_;                                  // [g] number of factors in each factor group
   std::vector<size_t> factorStrides_;                  // [g] stride for factor dimension
+  std::vector<size_t> factorSentinels_;                // [g] factor index reserved for "not specified" or "not applicable" (factorShape_[g] - 1)
+  size_t lemmaOnlyOffset_{0};                          // WordIndex of a lemma-only word minus its lemma part: sentinels in all other groups
 #ifdef FACTOR_FULL_EXPANSION
   std::vector<float> gapLogMask_;                      // [v] -1e8 if this is a gap, else 0
 #endif
@@ -0,0 +1,78 @@
+#include "data/nbest_binary.h"
+
+#include "common/logging.h"
+
+#include <cstdint>
+
+namespace marian {
+namespace data {
+
+static const uint32_t NBEST_MAGIC = 0x5453424e; // "NBST" in little-endian
+
+static_assert(sizeof(Word) == sizeof(WordIndex), "Words are written as plain word indices");
+
+template <typename T>
+static void writeArray(std::ostream& out, const T* data, size_t size) {
+  out.write(reinterpret_cast<const char*>(data), size * sizeof(T));
+}
+
+template <typename T>
+static void readArray(std::istream& in, T* data, size_t size) {
+  in.read(reinterpret_cast<char*>(data), size * sizeof(T));
+  ABORT_IF(!in, "Unexpected end of binary n-best list");
+}
+
+void writeNBestEntry(std::ostream& out, const NBestEntry& entry) {
+  uint32_t rows = (uint32_t)entry.alignment.size();
+  uint32_t cols = rows > 0 ? (uint32_t)entry.alignment[0].size() : 0;
+
+  uint64_t lineNum = entry.lineNum;
+  uint32_t header[] = {(uint32_t)entry.words.size(),
+                       (uint32_t)entry.scores.size(),
+                       (uint32_t)entry.wordScores.size(),
+                       rows,
+                       cols};
+
+  writeArray(out, &NBEST_MAGIC, 1);
+  writeArray(out, &lineNum, 1);
+  writeArray(out, header, 5);
+  writeArray(out, entry.words.data(), entry.words.size());
+  writeArray(out, entry.scores.data(), entry.scores.size());
+  writeArray(out, &entry.score, 1);
+  writeArray(out, entry.wordScores.data(), entry.wordScores.size());
+  for(const auto& row : entry.alignment) {
+    ABORT_IF(row.size() != cols, "Alignment rows of an n-best entry differ in length");
+    writeArray(out, row.data(), row.size());
+  }
+}
+
+bool readNBestEntry(std::istream& in, NBestEntry& entry) {
+  uint32_t magic;
+  if(!in.read(reinterpret_cast<char*>(&magic), sizeof(magic)))
+    return false;
+  ABORT_IF(magic != NBEST_MAGIC, "Invalid entry in binary n-best list, is this a binary n-best list?");
+
+  uint64_t lineNum;
+  uint32_t header[5];
+  readArray(in, &lineNum, 1);
+  readArray(in, header, 5);
+
+  entry.lineNum = (size_t)lineNum;
+  entry.words.resize(header[0]);
+  entry.scores.resize(header[1]);
+  entry.wordScores.resize(header[2]);
+  entry.alignment.resize(header[3]);
+
+  readArray(in, entry.words.data(), entry.words.size());
+  readArray(in, entry.scores.data(), entry.scores.size());
+  readArray(in, &entry.score, 1);
+  readArray(in, entry.wordScores.data(), entry.wordScores.size());
+  for(auto& row : entry.alignment) {
+    row.resize(header[4]);
+    readArray(in, row.data(), row.size());
+  }
+  return true;
+}
+
+}  // namespace data
+}  // namespace marian
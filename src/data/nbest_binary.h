@@ -0,0 +1,35 @@
+#pragma once
+
+#include "data/alignment.h"
+#include "data/types.h"
+
+#include <iostream>
+#include <vector>
+
+namespace marian {
+namespace data {
+
+// A single entry of an n-best list as written by `marian-decoder --n-best --n-best-format binary`
+// and read by `marian-scorer --n-best --n-best-format binary`. The binary format avoids formatting
+// translations, scores and alignments as text and parsing them again during rescoring.
+struct NBestEntry {
+  size_t lineNum{0};             // index of the source sentence
+  Words words;                   // target token ids in left-to-right order, without the final EOS
+  std::vector<float> scores;     // score breakdown F0, F1, ..., extended by each rescoring
+  float score{0.f};              // final (normalized) score used for ranking
+  std::vector<float> wordScores; // optional word-level scores
+  SoftAlignment alignment;       // optional soft alignment [trg pos][src pos]
+};
+
+// Each entry is stored as a fixed-size header followed by the arrays, all in host byte order:
+//   uint32 magic, uint64 lineNum,
+//   uint32 #words, uint32 #scores, uint32 #wordScores, uint32 #alignment rows, uint32 #alignment columns,
+//   uint32 words[], float scores[], float score, float wordScores[], float alignment[rows * columns]
+// The token ids are only meaningful with the target vocabulary used for decoding.
+void writeNBestEntry(std::ostream& out, const NBestEntry& entry);
+
+// Reads the next entry, returns false at the end of the stream. Aborts on malformed input.
+bool readNBestEntry(std::istream& in, NBestEntry& entry);
+
+}  // namespace data
+}  // namespace marian
@@ -207,19 +207,26 @@ public:
   }
 
   Words encode(const std::string& line, bool addEOS, bool inference) const override {
+    Words words;
+    encodeAppend(utils::StringRange(line), words, addEOS, inference);
+    return words;
+  }
+
+  // Encoding with the processor is const and may run on several threads at once. The random
+  // generator SentencePiece uses for sampling is thread-local, so no state is shared between threads.
+  void encodeAppend(const utils::StringRange& range, Words& words, bool addEOS, bool inference) const override {
+    std::string line = range.str();
     std::vector<int> spmIds;
     if(inference || alpha_ == 0)
       spm_->Encode(line, &spmIds);
     else
       spm_->SampleEncode(line, -1, alpha_, &spmIds);
 
-    Words words; words.reserve(spmIds.size() + addEOS);
     for (auto&& spmId : spmIds)
       words.push_back(Word::fromWordIndex(spmId));
 
     if(addEOS)
       words.push_back(getEosId());
-    return words;
   }
 
   std::string decode(const Words& sentence, bool /*ignoreEOS*/) const override {
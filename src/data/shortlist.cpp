@@ -0,0 +1,234 @@
+#include "data/shortlist.h"
+
+#include <fstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace marian {
+namespace data {
+
+static inline size_t popcount64(uint64_t bits) {
+#ifdef _MSC_VER
+  return (size_t)__popcnt64(bits);
+#else
+  return (size_t)__builtin_popcountll(bits);
+#endif
+}
+
+// index of the lowest set bit, bits must not be 0
+static inline size_t lowestBit64(uint64_t bits) {
+#ifdef _MSC_VER
+  unsigned long idx;
+  _BitScanForward64(&idx, bits);
+  return (size_t)idx;
+#else
+  return (size_t)__builtin_ctzll(bits);
+#endif
+}
+
+ShortlistBuilder& ShortlistBuilder::forThisThread() {
+  static thread_local ShortlistBuilder builder;
+  return builder;
+}
+
+const std::vector<WordIndex>& ShortlistBuilder::start(Ptr<SubBatch> srcBatch,
+                                                      size_t trgVocabSize,
+                                                      size_t firstNum,
+                                                      bool shared) {
+  trgVocabSize_ = trgVocabSize;
+  firstNum_ = std::min(firstNum, trgVocabSize);
+  trgBits_.assign((trgVocabSize + 63) / 64, 0); // keeps the capacity of the previous batch
+
+  // add firstNum most frequent words
+  std::fill(trgBits_.begin(), trgBits_.begin() + firstNum_ / 64, ~(uint64_t)0);
+  for(WordIndex i = (WordIndex)(firstNum_ / 64 * 64); i < firstNum_; ++i)
+    set(trgBits_, i);
+
+  // collect unique words from source
+  WordIndex maxSrcWord = 0;
+  for(auto w : srcBatch->data())
+    maxSrcWord = std::max(maxSrcWord, w.toWordIndex());
+  srcBits_.assign(maxSrcWord / 64 + 1, 0);
+  srcWords_.clear();
+  for(auto w : srcBatch->data()) {
+    auto i = w.toWordIndex();
+    uint64_t mask = (uint64_t)1 << (i % 64);
+    if(srcBits_[i / 64] & mask)
+      continue;
+    srcBits_[i / 64] |= mask;
+    srcWords_.push_back(i);
+    if(shared)
+      insert(i);
+  }
+  return srcWords_;
+}
+
+Ptr<Shortlist> ShortlistBuilder::finish() {
+  size_t count = 0;
+  for(auto bits : trgBits_)
+    count += popcount64(bits);
+
+  // Ensure that the generated vocabulary items from a shortlist are a multiple-of-eight
+  // This is necessary until intgemm supports non-multiple-of-eight matrices.
+  for(WordIndex i = (WordIndex)firstNum_; count % 8 != 0 && i < trgVocabSize_; ++i) {
+    uint64_t mask = (uint64_t)1 << (i % 64);
+    if(!(trgBits_[i / 64] & mask)) {
+      trgBits_[i / 64] |= mask;
+      count++;
+    }
+  }
+
+  // reuse a shortlist which is not referenced by any decoder anymore
+  Ptr<Shortlist> shortlist;
+  for(auto& s : pool_) {
+    if(s.use_count() == 1) {
+      shortlist = s;
+      break;
+    }
+  }
+  if(!shortlist) {
+    shortlist = New<Shortlist>(std::vector<WordIndex>());
+    if(pool_.size() < 4)
+      pool_.push_back(shortlist);
+  }
+
+  // turn into sorted indices, iterating over the set bits of each 64-bit word
+  auto& indices = shortlist->mutableIndices();
+  indices.clear();
+  indices.reserve(count);
+  for(size_t k = 0; k < trgBits_.size(); ++k) {
+    for(uint64_t bits = trgBits_[k]; bits != 0; bits &= bits - 1)
+      indices.push_back((WordIndex)(k * 64 + lowestBit64(bits)));
+  }
+  return shortlist;
+}
+
+// "MRNSLBIN" when read as little-endian bytes
+const uint64_t BinaryShortlistGenerator::MAGIC = 0x4e49424c534e524dULL;
+
+void LexicalShortlistGenerator::dumpBinary(const std::string& fileName) const {
+  LOG(info, "[data] Saving binary shortlist to {}", fileName);
+
+  std::vector<uint64_t> offsets(1, 0);
+  std::vector<WordIndex> indices;
+  for(const auto& probs : data_) {
+    // keep the best candidates first so that fewer of them can be used when loading
+    std::vector<std::pair<float, WordIndex>> sorter;
+    for(const auto& it : probs)
+      sorter.emplace_back(it.second, it.first);
+    std::sort(sorter.begin(), sorter.end(), [](const std::pair<float, WordIndex>& a,
+                                               const std::pair<float, WordIndex>& b) {
+      return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+    for(const auto& it : sorter)
+      indices.push_back(it.second);
+    offsets.push_back(indices.size());
+  }
+
+  BinaryShortlistGenerator::Header header;
+  header.magic        = BinaryShortlistGenerator::MAGIC;
+  header.firstNum     = firstNum_;
+  header.bestNum      = bestNum_;
+  header.srcVocabSize = srcVocab_->size();
+  header.trgVocabSize = trgVocab_->size();
+  header.offsetsSize  = offsets.size();
+  header.indicesSize  = indices.size();
+
+  std::ofstream out(fileName, std::ios::binary);
+  ABORT_IF(!out, "Cannot open {} for writing", fileName);
+  out.write((const char*)&header, sizeof(header));
+  out.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+  out.write((const char*)indices.data(), indices.size() * sizeof(WordIndex));
+  ABORT_IF(!out, "Error writing binary shortlist to {}", fileName);
+}
+
+bool BinaryShortlistGenerator::isBinary(const std::string& fileName) {
+  std::ifstream in(fileName, std::ios::binary);
+  uint64_t magic = 0;
+  in.read((char*)&magic, sizeof(magic));
+  return in && magic == MAGIC;
+}
+
+BinaryShortlistGenerator::BinaryShortlistGenerator(Ptr<Options> options,
+                                                   Ptr<const Vocab> srcVocab,
+                                                   Ptr<const Vocab> trgVocab,
+                                                   size_t srcIdx,
+                                                   size_t /*trgIdx*/,
+                                                   bool shared)
+    : trgVocab_(trgVocab), srcIdx_(srcIdx), shared_(shared) {
+  std::vector<std::string> vals = options->get<std::vector<std::string>>("shortlist");
+  ABORT_IF(vals.empty(), "No path to filter path given");
+  std::string fname = vals[0];
+
+  mmap_ = mio::mmap_source(fname);
+  ABORT_IF(mmap_.size() < sizeof(Header), "Binary shortlist {} is truncated", fname);
+  const Header& header = *(const Header*)mmap_.data();
+  ABORT_IF(header.magic != MAGIC, "File {} is not a binary shortlist", fname);
+  ABORT_IF(header.offsetsSize == 0
+               || mmap_.size() != sizeof(Header) + header.offsetsSize * sizeof(uint64_t)
+                                      + header.indicesSize * sizeof(WordIndex),
+           "Binary shortlist {} is truncated or corrupted",
+           fname);
+  ABORT_IF(header.srcVocabSize != srcVocab->size() || header.trgVocabSize != trgVocab->size(),
+           "Binary shortlist {} was created for vocabularies of size {} and {}, but the given ones "
+           "have sizes {} and {}",
+           fname, header.srcVocabSize, header.trgVocabSize, srcVocab->size(), trgVocab->size());
+
+  offsets_ = (const uint64_t*)(mmap_.data() + sizeof(Header));
+  indices_ = (const WordIndex*)(offsets_ + header.offsetsSize);
+  numSrcWords_ = header.offsetsSize - 1;
+  ABORT_IF(offsets_[numSrcWords_] != header.indicesSize, "Binary shortlist {} is corrupted", fname);
+
+  firstNum_ = vals.size() > 1 ? std::stoi(vals[1]) : 100;
+  bestNum_ = vals.size() > 2 ? std::stoi(vals[2]) : 100;
+  if(bestNum_ > header.bestNum) {
+    LOG(warn,
+        "[data] Binary shortlist {} has at most {} candidates per word, ignoring the requested {}",
+        fname, header.bestNum, bestNum_);
+    bestNum_ = header.bestNum;
+  }
+  if(vals.size() > 3)
+    LOG(warn, "[data] Pruning threshold and dump path are ignored for binary shortlists");
+
+  LOG(info,
+      "[data] Memory-mapped binary shortlist {} {} {} with {} entries",
+      fname,
+      firstNum_,
+      bestNum_,
+      header.indicesSize);
+}
+
+Ptr<Shortlist> BinaryShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
+  auto& builder = ShortlistBuilder::forThisThread();
+
+  // add firstNum most frequent words and aligned target words of all unique source words
+  for(auto i : builder.start((*batch)[srcIdx_], trgVocab_->size(), firstNum_, shared_)) {
+    if(i >= numSrcWords_)
+      continue;
+    uint64_t begin = offsets_[i];
+    uint64_t end = std::min(offsets_[i + 1], begin + bestNum_);
+    for(uint64_t j = begin; j < end; ++j)
+      builder.insert(indices_[j]);
+  }
+
+  return builder.finish();
+}
+
+Ptr<ShortlistGenerator> createShortlistGenerator(Ptr<Options> options,
+                                                 Ptr<const Vocab> srcVocab,
+                                                 Ptr<const Vocab> trgVocab,
+                                                 size_t srcIdx,
+                                                 size_t trgIdx,
+                                                 bool shared) {
+  std::vector<std::string> vals = options->get<std::vector<std::string>>("shortlist");
+  ABORT_IF(vals.empty(), "No path to filter path given");
+  if(BinaryShortlistGenerator::isBinary(vals[0]))
+    return New<BinaryShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+  else
+    return New<LexicalShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+}
+
+}  // namespace data
+}  // namespace marian
@@ -3,15 +3,19 @@
 #include "common/config.h"
 #include "common/definitions.h"
 #include "common/file_stream.h"
+#include "common/utils.h"
 #include "data/corpus_base.h"
 #include "data/types.h"
 
+#include "3rd_party/mio/mio.hpp"
+
 #include <random>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <functional>
 
 namespace marian {
 namespace data {
@@ -25,6 +29,8 @@ public:
     : indices_(indices) {}
 
   const std::vector<WordIndex>& indices() const { return indices_; }
+  // Allows a generator to refill a shortlist which is not referenced anymore instead of allocating a new one
+  std::vector<WordIndex>& mutableIndices() { return indices_; }
   WordIndex reverseMap(int idx) { return indices_[idx]; }
 
   int tryForwardMap(WordIndex wIdx) {
@@ -37,6 +43,43 @@ public:
 
 };
 
+// Collects the union of target words for the shortlist of a batch in a bitmap over the target
+// vocabulary and compacts it into sorted indices with bit scans. Each thread has its own builder, so
+// that the bitmaps and the Shortlist objects, which are refilled once they are not referenced by a
+// decoder anymore, are reused across batches instead of being allocated for every batch.
+class ShortlistBuilder {
+private:
+  std::vector<uint64_t> trgBits_;
+  std::vector<uint64_t> srcBits_;
+  std::vector<WordIndex> srcWords_;
+  size_t trgVocabSize_{0};
+  size_t firstNum_{0};
+  std::vector<Ptr<Shortlist>> pool_;
+
+  static void set(std::vector<uint64_t>& bits, WordIndex i) {
+    bits[i / 64] |= (uint64_t)1 << (i % 64);
+  }
+
+public:
+  static ShortlistBuilder& forThisThread();
+
+  // Starts the shortlist of a new batch with the firstNum most frequent target words and, if the
+  // vocabularies are shared, the source words themselves. Returns the distinct source words.
+  const std::vector<WordIndex>& start(Ptr<SubBatch> srcBatch,
+                                      size_t trgVocabSize,
+                                      size_t firstNum,
+                                      bool shared);
+
+  // Adds a target word, words outside of the target vocabulary are ignored
+  void insert(WordIndex i) {
+    if(i < trgVocabSize_)
+      set(trgBits_, i);
+  }
+
+  // Returns the sorted shortlist, padded to a multiple of eight words
+  Ptr<Shortlist> finish();
+};
+
 class ShortlistGenerator {
 public:
   virtual ~ShortlistGenerator() {}
@@ -215,10 +258,16 @@ public:
     load(fname);
     prune(threshold);
 
-    if(!dumpPath.empty())
+    // a dump path ending in .bin produces a binary shortlist for BinaryShortlistGenerator
+    if(utils::endsWith(dumpPath, ".bin"))
+      dumpBinary(dumpPath);
+    else if(!dumpPath.empty())
       dump(dumpPath);
   }
 
+  // Writes the pruned short list in the binary format that is memory-mapped by BinaryShortlistGenerator
+  void dumpBinary(const std::string& fileName) const;
+
   virtual void dump(const std::string& prefix) const override {
     // Dump top most frequent words from target vocabulary
     LOG(info, "[data] Saving shortlist dump to {}", prefix + ".{top,dic}");
@@ -237,46 +286,77 @@ public:
   }
 
   virtual Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const override {
-    auto srcBatch = (*batch)[srcIdx_];
-
-    // add firstNum most frequent words
-    std::unordered_set<WordIndex> indexSet;
-    for(WordIndex i = 0; i < firstNum_ && i < trgVocab_->size(); ++i)
-      indexSet.insert(i);
+    auto& builder = ShortlistBuilder::forThisThread();
 
-    // add all words from ground truth
-    // for(auto i : trgBatch->data())
-    //  indexSet.insert(i.toWordIndex());
-
-    // collect unique words form source
-    std::unordered_set<WordIndex> srcSet;
-    for(auto i : srcBatch->data())
-      srcSet.insert(i.toWordIndex());
-
-    // add aligned target words
-    for(auto i : srcSet) {
-      if(shared_)
-        indexSet.insert(i);
+    // add firstNum most frequent words and aligned target words of all unique source words
+    for(auto i : builder.start((*batch)[srcIdx_], trgVocab_->size(), firstNum_, shared_)) {
+      if(i >= data_.size())
+        continue;
       for(auto& it : data_[i])
-        indexSet.insert(it.first);
-    }
-    // Ensure that the generated vocabulary items from a shortlist are a multiple-of-eight
-    // This is necessary until intgemm supports non-multiple-of-eight matrices.
-    // TODO better solution here? This could potentially be slow.
-    WordIndex i = static_cast<WordIndex>(firstNum_);
-    while (indexSet.size() % 8 != 0) {
-      indexSet.insert(i);
-      i++;
+        builder.insert(it.first);
     }
 
-    // turn into vector and sort (selected indices)
-    std::vector<WordIndex> indices(indexSet.begin(), indexSet.end());
-    std::sort(indices.begin(), indices.end());
-
-    return New<Shortlist>(indices);
+    return builder.finish();
   }
 };
 
+// Lexical shortlist in a binary CSR layout, which is memory-mapped instead of parsed, so that loading
+// is instantaneous and the pages are shared by all processes on the same host using the same file.
+// The file is written by LexicalShortlistGenerator::dumpBinary, i.e. by passing a dump path ending
+// in .bin as the fifth element of --shortlist. The candidates of each source word are stored ordered
+// by decreasing translation probability, so --shortlist can still lower (but not raise) the number of
+// best candidates; the probability threshold is applied when the binary file is created.
+class BinaryShortlistGenerator : public ShortlistGenerator {
+public:
+  struct Header {
+    uint64_t magic;        // BinaryShortlistGenerator::MAGIC
+    uint64_t firstNum;     // number of most frequent target words used when the file was created
+    uint64_t bestNum;      // maximum number of candidates per source word
+    uint64_t srcVocabSize;
+    uint64_t trgVocabSize;
+    uint64_t offsetsSize;  // number of source words + 1
+    uint64_t indicesSize;  // total number of candidates
+  };
+
+  static const uint64_t MAGIC;
+
+private:
+  Ptr<const Vocab> trgVocab_;
+
+  size_t srcIdx_;
+  bool shared_{false};
+
+  size_t firstNum_{100};
+  size_t bestNum_{100};
+
+  mio::mmap_source mmap_;
+  const uint64_t* offsets_{nullptr};   // [WordIndex src] -> start of candidates in indices_
+  const WordIndex* indices_{nullptr};  // candidate target words for all source words
+  size_t numSrcWords_{0};
+
+public:
+  BinaryShortlistGenerator(Ptr<Options> options,
+                           Ptr<const Vocab> srcVocab,
+                           Ptr<const Vocab> trgVocab,
+                           size_t srcIdx = 0,
+                           size_t /*trgIdx*/ = 1,
+                           bool shared = false);
+
+  // Checks if the file starts with the binary shortlist header
+  static bool isBinary(const std::string& fileName);
+
+  virtual Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const override;
+};
+
+// Creates a BinaryShortlistGenerator if the file given by --shortlist is a binary shortlist,
+// otherwise a LexicalShortlistGenerator that loads the text lexical table
+Ptr<ShortlistGenerator> createShortlistGenerator(Ptr<Options> options,
+                                                 Ptr<const Vocab> srcVocab,
+                                                 Ptr<const Vocab> trgVocab,
+                                                 size_t srcIdx = 0,
+                                                 size_t trgIdx = 1,
+                                                 bool shared = false);
+
 class FakeShortlistGenerator : public ShortlistGenerator {
 private:
   std::vector<WordIndex> indices_;
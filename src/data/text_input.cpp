@@ -29,8 +29,32 @@ TextInput::TextInput(std::vector<std::string> inputs,
       maxLengthCrop_(options_->get<bool>("max-length-crop")) {
   // Note: inputs are automatically stored in the inherited variable named paths_, but these are
   // texts not paths!
-  for(const auto& text : paths_)
-    files_.emplace_back(new std::istringstream(text));
+  std::vector<std::vector<std::string>> lines(paths_.size());
+  for(size_t i = 0; i < paths_.size(); ++i) {
+    std::istringstream text(paths_[i]);
+    std::string line;
+    while(io::getline(text, line))
+      lines[i].push_back(line);
+  }
+  encode(lines, nullptr);
+}
+
+TextInput::TextInput(const std::vector<std::vector<std::string>>& lines,
+                     std::vector<Ptr<Vocab>> vocabs,
+                     Ptr<Options> options,
+                     ThreadPool* pool /*= nullptr*/)
+    : DatasetBase(options),
+      vocabs_(vocabs),
+      maxLength_(options_->get<size_t>("max-length")),
+      maxLengthCrop_(options_->get<bool>("max-length-crop")) {
+  encode(lines, pool);
+}
+
+void TextInput::encode(const std::vector<std::vector<std::string>>& lines, ThreadPool* pool) {
+  words_.resize(lines.size());
+  offsets_.resize(lines.size());
+  for(size_t i = 0; i < lines.size(); ++i)
+    vocabs_[i]->encode(lines[i], words_[i], offsets_[i], /*addEOS=*/true, /*inference=*/inference_, pool);
 }
 
 // TextInput is mainly used for inference in the server mode, not for training, so skipping too long
@@ -41,10 +65,9 @@ SentenceTuple TextInput::next() {
 
   // fill up the sentence tuple with source and/or target sentences
   SentenceTuple tup(curId);
-  for(size_t i = 0; i < files_.size(); ++i) {
-    std::string line;
-    if(io::getline(*files_[i], line)) {
-      Words words = vocabs_[i]->encode(line, /*addEOS=*/true, /*inference=*/inference_);
+  for(size_t i = 0; i < words_.size(); ++i) {
+    if(curId + 1 < offsets_[i].size()) {
+      Words words(words_[i].begin() + offsets_[i][curId], words_[i].begin() + offsets_[i][curId + 1]);
       if(this->maxLengthCrop_ && words.size() > this->maxLength_) {
         words.resize(maxLength_);
         words.back() = vocabs_.back()->getEosId();  // note: this will not work with class-labels
@@ -56,7 +79,7 @@ SentenceTuple TextInput::next() {
     }
   }
 
-  if(tup.size() == files_.size()) // check if each input file provided an example
+  if(tup.size() == words_.size()) // check if each input file provided an example
     return tup;
   else if(tup.size() == 0) // if no file provided examples we are done
     return SentenceTuple(0);
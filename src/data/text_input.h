@@ -28,18 +28,31 @@ private:
 
 class TextInput : public DatasetBase<SentenceTuple, TextIterator, CorpusBatch> {
 private:
-  std::vector<UPtr<std::istringstream>> files_;
   std::vector<Ptr<Vocab>> vocabs_;
 
+  // all lines are encoded up-front, the words of line k of stream i are
+  // words_[i][offsets_[i][k]] up to words_[i][offsets_[i][k + 1]]
+  std::vector<Words> words_;
+  std::vector<std::vector<size_t>> offsets_;
+
   size_t pos_{0};
 
   size_t maxLength_{0};
   bool maxLengthCrop_{false};
 
+  void encode(const std::vector<std::vector<std::string>>& lines, ThreadPool* pool);
+
 public:
   typedef SentenceTuple Sample;
 
   TextInput(std::vector<std::string> inputs, std::vector<Ptr<Vocab>> vocabs, Ptr<Options> options);
+
+  // Takes the input already split into lines [stream][line]. With a thread pool, the lines
+  // of each stream are encoded in parallel.
+  TextInput(const std::vector<std::vector<std::string>>& lines,
+            std::vector<Ptr<Vocab>> vocabs,
+            Ptr<Options> options,
+            ThreadPool* pool = nullptr);
   virtual ~TextInput() {}
 
   Sample next() override;
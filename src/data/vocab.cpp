@@ -2,6 +2,8 @@
 #include "data/vocab.h"
 #include "data/vocab_base.h"
 
+#include "3rd_party/threadpool.h"
+
 namespace marian {
 
 Word Word::NONE = Word();
@@ -23,7 +25,62 @@ Ptr<IVocab> createVocab(const std::string& vocabPath, Ptr<Options> options, size
   // check type of input, if not given, assume "sequence"
   auto inputTypes = options->get<std::vector<std::string>>("input-types", {});
   std::string inputType = inputTypes.size() > batchIndex ? inputTypes[batchIndex] : "sequence";
-  return inputType == "class" ? createClassVocab() : createDefaultVocab();
+  return inputType == "class" ? createClassVocab(options) : createDefaultVocab(options);
+}
+
+void IVocab::encode(const std::vector<std::string>& lines,
+                    Words& words,
+                    std::vector<size_t>& offsets,
+                    bool addEOS,
+                    bool inference,
+                    ThreadPool* pool) const {
+  encode(std::vector<utils::StringRange>(lines.begin(), lines.end()), words, offsets, addEOS, inference, pool);
+}
+
+void IVocab::encode(const std::vector<utils::StringRange>& lines,
+                    Words& words,
+                    std::vector<size_t>& offsets,
+                    bool addEOS,
+                    bool inference,
+                    ThreadPool* pool) const {
+  words.clear();
+  offsets.assign(1, 0);
+  offsets.reserve(lines.size() + 1);
+
+  size_t numRanges = pool ? std::min(pool->getNumThreads(), lines.size()) : 1;
+  if(numRanges <= 1) {
+    for(const auto& line : lines) {
+      encodeAppend(line, words, addEOS, inference);
+      offsets.push_back(words.size());
+    }
+    return;
+  }
+
+  // each range is encoded into a buffer of its own, which are concatenated in order
+  struct Range {
+    Words words;
+    std::vector<size_t> ends; // [line in range] end of the line in words
+  };
+  auto encodeRange = [&](size_t begin, size_t end) {
+    Range range;
+    for(size_t i = begin; i < end; ++i) {
+      encodeAppend(lines[i], range.words, addEOS, inference);
+      range.ends.push_back(range.words.size());
+    }
+    return range;
+  };
+
+  std::vector<std::future<Range>> ranges;
+  size_t rangeSize = (lines.size() + numRanges - 1) / numRanges;
+  for(size_t begin = 0; begin < lines.size(); begin += rangeSize)
+    ranges.push_back(pool->enqueue(encodeRange, begin, std::min(begin + rangeSize, lines.size())));
+
+  for(auto& future : ranges) {
+    auto range = future.get();
+    for(auto end : range.ends)
+      offsets.push_back(words.size() + end);
+    words.insert(words.end(), range.words.begin(), range.words.end());
+  }
 }
 
 size_t Vocab::loadOrCreate(const std::string& vocabPath,
@@ -41,7 +98,7 @@ size_t Vocab::loadOrCreate(const std::string& vocabPath,
         "trying to find default vocabulary based on data path {}",
         trainPaths[0]);
 
-    vImpl_ = createDefaultVocab();
+    vImpl_ = createDefaultVocab(options_);
     size = vImpl_->findAndLoad(trainPaths[0], maxSize);
 
     if(size == 0) {
@@ -92,6 +149,10 @@ void Vocab::createFake() {
   vImpl_->createFake();
 }
 
+void Vocab::restrict(const std::vector<WordIndex>& words) {
+  vImpl_ = createSubsetVocab(vImpl_, words);
+}
+
 Word Vocab::randWord() {
   return vImpl_->randWord();
 }
@@ -113,6 +174,24 @@ Words Vocab::encode(const std::string& line,
   return vImpl_->encode(line, addEOS, inference);
 }
 
+void Vocab::encode(const std::vector<std::string>& lines,
+                   Words& words,
+                   std::vector<size_t>& offsets,
+                   bool addEOS,
+                   bool inference,
+                   ThreadPool* pool) const {
+  vImpl_->encode(lines, words, offsets, addEOS, inference, pool);
+}
+
+void Vocab::encode(const std::vector<utils::StringRange>& lines,
+                   Words& words,
+                   std::vector<size_t>& offsets,
+                   bool addEOS,
+                   bool inference,
+                   ThreadPool* pool) const {
+  vImpl_->encode(lines, words, offsets, addEOS, inference, pool);
+}
+
 // convert sequence of token ids to single line, can perform detokenization
 std::string Vocab::decode(const Words& sentence,
                     bool ignoreEOS) const {
@@ -4,10 +4,12 @@
 #include "data/types.h"
 #include "common/options.h"
 #include "common/file_stream.h"
+#include "common/utils.h"
 
 namespace marian {
 
 class IVocab;
+class ThreadPool;
 
 // Wrapper around vocabulary types. Can choose underlying
 // vocabulary implementation (vImpl_) based on speficied path
@@ -50,6 +52,20 @@ public:
                bool addEOS = true,
                bool inference = false) const;
 
+  // many lines of text to one contiguous buffer of token ids, see IVocab::encode()
+  void encode(const std::vector<std::string>& lines,
+              Words& words,
+              std::vector<size_t>& offsets,
+              bool addEOS = true,
+              bool inference = false,
+              ThreadPool* pool = nullptr) const;
+  void encode(const std::vector<utils::StringRange>& lines,
+              Words& words,
+              std::vector<size_t>& offsets,
+              bool addEOS = true,
+              bool inference = false,
+              ThreadPool* pool = nullptr) const;
+
   // convert sequence of token ids to single line, can perform detokenization
   std::string decode(const Words& sentence,
                      bool ignoreEOS = true) const;
@@ -84,6 +100,10 @@ public:
   // create fake vocabulary for collecting batch statistics
   void createFake();
 
+  // restrict to the words with the given sorted indices, which become the indices 0, 1, ... of
+  // this vocabulary, see data::VocabSubset
+  void restrict(const std::vector<WordIndex>& words);
+
   // generate a fake word (using rand())
   Word randWord();
 
@@ -7,6 +7,8 @@
 
 namespace marian {
 
+class ThreadPool;
+
 class IVocab {
 public:
   virtual size_t load(const std::string& vocabPath, size_t maxSize = 0) = 0;
@@ -32,6 +34,30 @@ public:
                        bool addEOS = true,
                        bool inference = false) const = 0;
 
+  // Encodes many lines into one contiguous buffer, the words of line i are words[offsets[i]] up to
+  // words[offsets[i + 1]]. With a thread pool, consecutive ranges of lines are encoded in parallel.
+  void encode(const std::vector<std::string>& lines,
+              Words& words,
+              std::vector<size_t>& offsets,
+              bool addEOS = true,
+              bool inference = false,
+              ThreadPool* pool = nullptr) const;
+
+  // Same as above for lines that refer to a larger buffer, e.g. the fields of TSV lines
+  void encode(const std::vector<utils::StringRange>& lines,
+              Words& words,
+              std::vector<size_t>& offsets,
+              bool addEOS = true,
+              bool inference = false,
+              ThreadPool* pool = nullptr) const;
+
+  // Appends the words of a line to a buffer, used by the functions above. Vocabularies can override
+  // this to avoid copying the line and creating a temporary Words object per line.
+  virtual void encodeAppend(const utils::StringRange& line, Words& words, bool addEOS, bool inference) const {
+    Words lineWords = encode(line.str(), addEOS, inference);
+    words.insert(words.end(), lineWords.begin(), lineWords.end());
+  }
+
   virtual std::string decode(const Words& sentence,
                              bool ignoreEos = true) const = 0;
   virtual std::string surfaceForm(const Words& sentence) const = 0;
@@ -61,9 +87,11 @@ public:
 };
 
 class Options;
-Ptr<IVocab> createDefaultVocab();
-Ptr<IVocab> createClassVocab();
+// options configure the counting of the words by create(), see DefaultVocab::countWords(), and may be null
+Ptr<IVocab> createDefaultVocab(Ptr<Options> options = nullptr);
+Ptr<IVocab> createClassVocab(Ptr<Options> options = nullptr);
 Ptr<IVocab> createSentencePieceVocab(const std::string& vocabPath, Ptr<Options>, size_t batchIndex);
 Ptr<IVocab> createFactoredVocab(const std::string& vocabPath);
+Ptr<IVocab> createSubsetVocab(Ptr<IVocab> vocab, const std::vector<WordIndex>& words);
 
 }
@@ -0,0 +1,194 @@
+#include "data/vocab_subset.h"
+
+#include "common/file_stream.h"
+#include "common/logging.h"
+#include "common/utils.h"
+#include "data/vocab_base.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace marian {
+
+// The vocabulary of the words of a subset, given by their sorted indices in the wrapped vocabulary.
+// Words outside of the subset become UNK.
+class SubsetVocab : public IVocab {
+private:
+  Ptr<IVocab> vocab_;
+  std::vector<WordIndex> words_;      // [subset index] -> index in vocab_
+  std::vector<WordIndex> subsetIds_;  // [index in vocab_] -> subset index or UNK
+
+  Word toSubset(Word word) const {
+    auto id = word.toWordIndex();
+    return Word::fromWordIndex(id < subsetIds_.size() ? subsetIds_[id] : subsetIds_[vocab_->getUnkId().toWordIndex()]);
+  }
+
+  Word fromSubset(Word word) const {
+    auto id = word.toWordIndex();
+    ABORT_IF(id >= words_.size(), "Unknown word id: {}", id);
+    return Word::fromWordIndex(words_[id]);
+  }
+
+  Words fromSubset(const Words& sentence) const {
+    Words words;
+    words.reserve(sentence.size());
+    for(auto word : sentence)
+      words.push_back(fromSubset(word));
+    return words;
+  }
+
+public:
+  SubsetVocab(Ptr<IVocab> vocab, const std::vector<WordIndex>& words)
+      : vocab_(vocab), words_(words), subsetIds_(vocab->size()) {
+    auto unk = std::lower_bound(words_.begin(), words_.end(), vocab_->getUnkId().toWordIndex());
+    ABORT_IF(unk == words_.end() || *unk != vocab_->getUnkId().toWordIndex(), "The vocabulary subset has to contain UNK");
+    std::fill(subsetIds_.begin(), subsetIds_.end(), (WordIndex)(unk - words_.begin()));
+    for(size_t i = 0; i < words_.size(); ++i)
+      subsetIds_[words_[i]] = (WordIndex)i;
+  }
+
+  size_t load(const std::string& /*vocabPath*/, size_t /*maxSize*/) override {
+    ABORT("A vocabulary subset cannot be loaded");
+  }
+
+  void create(const std::string& /*vocabPath*/,
+              const std::vector<std::string>& /*trainPaths*/,
+              size_t /*maxSize*/) override {
+    ABORT("A vocabulary subset cannot be created");
+  }
+
+  const std::string& canonicalExtension() const override { return vocab_->canonicalExtension(); }
+  const std::vector<std::string>& suffixes() const override { return vocab_->suffixes(); }
+
+  Word operator[](const std::string& word) const override { return toSubset((*vocab_)[word]); }
+
+  Words encode(const std::string& line, bool addEOS, bool inference) const override {
+    Words words = vocab_->encode(line, addEOS, inference);
+    for(auto& word : words)
+      word = toSubset(word);
+    return words;
+  }
+
+  std::string decode(const Words& sentence, bool ignoreEos) const override {
+    return vocab_->decode(fromSubset(sentence), ignoreEos);
+  }
+
+  std::string surfaceForm(const Words& sentence) const override {
+    return vocab_->surfaceForm(fromSubset(sentence));
+  }
+
+  const std::string& operator[](Word id) const override { return (*vocab_)[fromSubset(id)]; }
+
+  size_t size() const override { return words_.size(); }
+  std::string type() const override { return vocab_->type(); }
+
+  Word getEosId() const override { return toSubset(vocab_->getEosId()); }
+  Word getUnkId() const override { return toSubset(vocab_->getUnkId()); }
+
+  std::string toUpper(const std::string& line) const override { return vocab_->toUpper(line); }
+  std::string toEnglishTitleCase(const std::string& line) const override { return vocab_->toEnglishTitleCase(line); }
+
+  void createFake() override { ABORT("A vocabulary subset cannot be faked"); }
+};
+
+Ptr<IVocab> createSubsetVocab(Ptr<IVocab> vocab, const std::vector<WordIndex>& words) {
+  return New<SubsetVocab>(vocab, words);
+}
+
+namespace data {
+
+VocabSubset::VocabSubset(const std::vector<std::string>& paths, Ptr<const Vocab> vocab)
+    : vocabSize_(vocab->size()) {
+  ABORT_IF(vocab->type() == "FactoredVocab", "--output-vocab-subset does not support factored vocabularies");
+  std::vector<bool> inSubset(vocabSize_, false);
+  inSubset[vocab->getEosId().toWordIndex()] = true;
+  inSubset[vocab->getUnkId().toWordIndex()] = true;
+  Word unk = vocab->getUnkId();
+  for(const auto& path : paths) {
+    io::InputFileStream in(path);
+    std::string line;
+    while(io::getline(in, line)) {
+      for(auto word : vocab->encode(line, /*addEOS=*/false, /*inference=*/true))
+        inSubset[word.toWordIndex()] = true;
+      for(const auto& token : utils::split(line, " ")) {
+        Word word = (*vocab)[token];
+        if(word != unk)
+          inSubset[word.toWordIndex()] = true;
+      }
+    }
+  }
+  for(size_t i = 0; i < vocabSize_; ++i)
+    if(inSubset[i])
+      words_.push_back((WordIndex)i);
+  LOG(info, "[data] Restricted the target vocabulary from {} to {} words", vocabSize_, words_.size());
+}
+
+void VocabSubset::restrictOptions(Ptr<Options> modelOptions) const {
+  auto type = modelOptions->get<std::string>("type");
+  ABORT_IF(type == "lm" || type == "lm-transformer", "--output-vocab-subset does not support language models");
+  auto dimVocabs = modelOptions->get<std::vector<int>>("dim-vocabs");
+  ABORT_IF(dimVocabs.size() != 2, "--output-vocab-subset only supports models with one source, not {}", dimVocabs.size() - 1);
+  ABORT_IF(dimVocabs.back() != (int)vocabSize_,
+           "The target vocabulary has {} words, the model {}", vocabSize_, dimVocabs.back());
+  dimVocabs.back() = (int)words_.size();
+
+  // the encoder keeps the full embeddings as encoder_Wemb, the decoder gets decoder_Wemb of the subset
+  bool tiedAll = modelOptions->get<bool>("tied-embeddings-all", false);
+  modelOptions->set("dim-vocabs", dimVocabs,
+                    "tied-embeddings", tiedAll || modelOptions->get<bool>("tied-embeddings", false),
+                    "tied-embeddings-all", false,
+                    "tied-embeddings-src", false);
+}
+
+// the rows (axis 0) or columns (axis 1) of the words of the subset
+io::Item VocabSubset::trim(const io::Item& item, int axis) const {
+  ABORT_IF(!isFloat(item.type), "Restricting the target vocabulary needs float parameters, {} is {}", item.name, item.type);
+  ABORT_IF(item.shape.size() != 2 || item.shape[axis] != (int)vocabSize_,
+           "Parameter {} of shape {} does not match the target vocabulary of {} words", item.name, item.shape, vocabSize_);
+  io::Item trimmed;
+  trimmed.name = item.name;
+  trimmed.type = item.type;
+  trimmed.shape = item.shape;
+  trimmed.shape.set(axis, (int)words_.size());
+  trimmed.bytes.resize(trimmed.size());
+
+  size_t element = sizeOf(item.type);
+  size_t cols = item.shape[1];
+  const char* in = item.data();
+  char* out = trimmed.bytes.data();
+  if(axis == 0) {
+    for(size_t j = 0; j < words_.size(); ++j)
+      std::memcpy(out + j * cols * element, in + words_[j] * cols * element, cols * element);
+  } else {
+    for(size_t r = 0; r < (size_t)item.shape[0]; ++r)
+      for(size_t j = 0; j < words_.size(); ++j)
+        std::memcpy(out + (r * words_.size() + j) * element, in + (r * cols + words_[j]) * element, element);
+  }
+  return trimmed;
+}
+
+void VocabSubset::restrictItems(std::vector<io::Item>& items) const {
+  bool trimmedEmbeddings = false;
+  std::vector<io::Item> split;
+  for(auto& item : items) {
+    if(item.name == "Wemb") { // shared with the encoder, see restrictOptions()
+      split.push_back(trim(item, 0));
+      split.back().name = "decoder_Wemb";
+      item.name = "encoder_Wemb";
+      trimmedEmbeddings = true;
+    } else if(item.name == "decoder_Wemb") {
+      item = trim(item, 0);
+      trimmedEmbeddings = true;
+    } else if(item.name == "decoder_ff_logit_out_W") { // [vocab, dim], or [dim, vocab] in older models
+      item = trim(item, item.shape[0] == (int)vocabSize_ ? 0 : 1);
+    } else if(item.name == "decoder_ff_logit_out_b") {
+      item = trim(item, 1);
+    }
+  }
+  ABORT_IF(!trimmedEmbeddings, "Found no target embeddings to restrict to the vocabulary subset");
+  for(auto& item : split)
+    items.push_back(std::move(item));
+}
+
+}  // namespace data
+}  // namespace marian
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/io_item.h"
+#include "common/options.h"
+#include "data/types.h"
+#include "data/vocab.h"
+
+#include <string>
+#include <vector>
+
+namespace marian {
+namespace data {
+
+// A static restriction of the target vocabulary to the words that a deployment can produce, see
+// --output-vocab-subset. Unlike a shortlist, which selects the output words for every batch, the
+// target embeddings, the output layer and its bias are trimmed to the subset once when the model is
+// loaded, and the target vocabulary maps the ids of the subset back to the words of the full one.
+class VocabSubset {
+private:
+  std::vector<WordIndex> words_; // sorted indices of the words of the subset in the full vocabulary
+  size_t vocabSize_;             // size of the full vocabulary
+
+  io::Item trim(const io::Item& item, int axis) const;
+
+public:
+  // Collects the words of the files, each line encoded with the target vocabulary plus every
+  // space-separated token of it that is itself a word of the vocabulary, so that the files can be
+  // lists of tokens or text in the target languages. EOS and UNK are always included.
+  VocabSubset(const std::vector<std::string>& paths, Ptr<const Vocab> vocab);
+
+  const std::vector<WordIndex>& words() const { return words_; }
+  size_t size() const { return words_.size(); }
+
+  // Changes the options of a model to the subset: the target vocabulary size, and target embeddings
+  // that are shared with the source become separate ones, which restrictItems() splits off.
+  void restrictOptions(Ptr<Options> modelOptions) const;
+
+  // Trims the target embeddings, the output layer and its bias to the rows or columns of the words
+  void restrictItems(std::vector<io::Item>& items) const;
+};
+
+}  // namespace data
+}  // namespace marian
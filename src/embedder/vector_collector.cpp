@@ -13,13 +13,38 @@ namespace marian {
 // on its binary_ flag.
 
 VectorCollector::VectorCollector(const Ptr<Options>& options)
-    : nextId_(0), binary_{options->get<bool>("binary", false)} {
-    if(options->get<std::string>("output") == "stdout")
+    : nextId_(0) {
+    auto format = options->get<std::string>("output-format", "text");
+    ABORT_IF(format != "text" && format != "binary" && format != "npy", "Unknown output format {}", format);
+    binary_ = format != "text" || options->get<bool>("binary", false);
+    npy_ = format == "npy";
+
+    precision_ = typeFromString(options->get<std::string>("output-precision", "float32"));
+    ABORT_IF(precision_ != Type::float32 && precision_ != Type::float16,
+             "Output vectors can only be float32 or float16, not {}", precision_);
+
+    auto output = options->get<std::string>("output");
+    if(output == "stdout")
       outStrm_.reset(new std::ostream(std::cout.rdbuf()));
     else
-      outStrm_.reset(new io::OutputFileStream(options->get<std::string>("output")));
+      outStrm_.reset(new io::OutputFileStream(output));
+
+    // the number of vectors is known at the end only, the header is then written again
+    ABORT_IF(npy_ && (output == "stdout" || utils::endsWith(output, ".gz")),
+             "The npy output format needs an uncompressed output file, not {}", output);
+    if(npy_)
+      writeNpyHeader();
   }
 
+VectorCollector::~VectorCollector() {
+  flushBuffer();
+  if(npy_) {
+    outStrm_->seekp(0);
+    writeNpyHeader();
+  }
+  outStrm_->flush();
+}
+
 void VectorCollector::Write(long id, const std::vector<float>& vec) {
   std::lock_guard<std::mutex> lock(mutex_);
   if(id == nextId_) {
@@ -58,14 +83,55 @@ void VectorCollector::Write(long id, const std::vector<float>& vec) {
 
 void VectorCollector::WriteVector(const std::vector<float>& vec) {
   if(binary_) {
-    outStrm_->write((char*)vec.data(), vec.size() * sizeof(float));
+    ABORT_IF(rows_ > 0 && vec.size() != dim_, "Binary output vectors differ in size: {} and {}", dim_, vec.size());
+    dim_ = vec.size();
+    rows_++;
+
+    size_t offset = buffer_.size();
+    buffer_.resize(offset + vec.size() * sizeOf(precision_));
+    if(precision_ == Type::float16) {
+      auto out = (float16*)(buffer_.data() + offset);
+      for(size_t i = 0; i < vec.size(); ++i)
+        out[i] = float16(vec[i]);
+    } else {
+      std::copy(vec.begin(), vec.end(), (float*)(buffer_.data() + offset));
+    }
+
+    const size_t maxBufferBytes = 64 * 1024 * 1024; // write in large chunks
+    if(buffer_.size() >= maxBufferBytes)
+      flushBuffer();
   } else {
     std::stringstream ss;
     ss << std::fixed << std::setprecision(8);
     for(auto v : vec)
       *outStrm_ << v << " ";
-    *outStrm_ << std::endl;
+    *outStrm_ << "\n";
   }
 }
 
+void VectorCollector::flushBuffer() {
+  if(buffer_.empty())
+    return;
+  outStrm_->write(buffer_.data(), buffer_.size());
+  ABORT_IF(outStrm_->fail(), "Error writing output vectors");
+  buffer_.clear();
+}
+
+// NumPy format 1.0: magic string, version, header length and a dictionary padded with spaces.
+// The header has a fixed size of 128 bytes, so that it can be rewritten once the shape is known.
+void VectorCollector::writeNpyHeader() {
+  const size_t headerBytes = 128;
+  std::string dict = "{'descr': '<" + std::string(precision_ == Type::float16 ? "f2" : "f4")
+                     + "', 'fortran_order': False, 'shape': (" + std::to_string(rows_) + ", "
+                     + std::to_string(dim_) + "), }";
+  std::string header = std::string("\x93NUMPY\x01\x00", 8) + "  "; // the length follows
+  ABORT_IF(header.size() + dict.size() + 1 > headerBytes, "Shape too large for the npy header: {}", dict);
+  header += dict + std::string(headerBytes - header.size() - dict.size() - 1, ' ') + "\n";
+
+  uint16_t dictBytes = (uint16_t)(headerBytes - 10); // little-endian, as the data
+  header[8] = (char)(dictBytes & 0xff);
+  header[9] = (char)(dictBytes >> 8);
+  outStrm_->write(header.data(), header.size());
+}
+
 }  // namespace marian
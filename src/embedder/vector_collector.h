@@ -3,6 +3,7 @@
 #include "common/options.h"
 #include "common/definitions.h"
 #include "common/file_stream.h"
+#include "common/types.h"
 
 #include <map>
 #include <mutex>
@@ -11,11 +12,13 @@ namespace marian {
 
 // This class manages multi-threaded writing of embedded vectors to stdout or an output file.
 // It will either output string versions of float vectors or binary equal length versions depending
-// on its binary_ flag.
+// on --output-format: text, binary (a raw row-major matrix) or npy (the same matrix behind a NumPy
+// header). Binary vectors are float32 or float16 (--output-precision) and collected in a large buffer
+// before they are written.
 class VectorCollector {
 public:
   VectorCollector(const Ptr<Options>& options);
-  virtual ~VectorCollector() {}
+  virtual ~VectorCollector();
   
   virtual void Write(long id, const std::vector<float>& vec);
 
@@ -23,6 +26,12 @@ protected:
   long nextId_{0};
   UPtr<std::ostream> outStrm_;
   bool binary_; // output binary floating point vectors if set
+  bool npy_;    // precede the binary vectors by a NumPy header, rewritten with the final shape at the end
+  Type precision_{Type::float32};
+
+  std::vector<char> buffer_; // binary vectors not written yet
+  size_t rows_{0};
+  size_t dim_{0};
 
   std::mutex mutex_;
 
@@ -30,5 +39,7 @@ protected:
   Outputs outputs_;
 
   virtual void WriteVector(const std::vector<float>& vec);
+  void flushBuffer();
+  void writeNpyHeader();
 };
 }  // namespace marian
@@ -213,12 +213,57 @@ struct Ops<double> {
 // __CUDA_ARCH__ is defined when compiling device (GPU) code
 #ifndef __CUDACC__
 
+#if USE_NEON
+#include "3rd_party/neon_mathfun.h"
+#else
 #include "3rd_party/sse_mathfun.h"
+#endif
 
 namespace marian {
 namespace functional {
 
-// Specialization for float32x8 (=__m128, CPU SSE intrisics)
+// Activation functions of the vector types below, written with the operations of Ops<T> so that
+// float32x4, float32x8 and float32x16 compute the same approximations on all instruction sets
+template <typename T>
+struct VectorOps {
+  typedef Ops<T> O;
+
+  // Rational approximation p(x) / q(x) of tanh with odd p of degree 13 and even q of degree 6 on
+  // [-7.9, 7.9], outside of which tanh is +-1 in float. It is accurate to a few ulp, exact for small |x|
+  // unlike (e^2x - 1) / (e^2x + 1), and needs no exp().
+  static inline T tanh(const T& x) {
+    T xc = O::min(O::max(x, -7.90531110763549805f), 7.90531110763549805f);
+    T x2 = O::mul(xc, xc);
+
+    T p = -2.76076847742355e-16f;
+    p = O::add(O::mul(p, x2), 2.00018790482477e-13f);
+    p = O::add(O::mul(p, x2), -8.60467152213735e-11f);
+    p = O::add(O::mul(p, x2), 5.12229709037114e-08f);
+    p = O::add(O::mul(p, x2), 1.48572235717979e-05f);
+    p = O::add(O::mul(p, x2), 6.37261928875436e-04f);
+    p = O::add(O::mul(p, x2), 4.89352455891786e-03f);
+    p = O::mul(p, xc);
+
+    T q = 1.19825839466702e-06f;
+    q = O::add(O::mul(q, x2), 1.18534705686654e-04f);
+    q = O::add(O::mul(q, x2), 2.26843463243900e-03f);
+    q = O::add(O::mul(q, x2), 4.89352518554385e-03f);
+    return O::div(p, q);
+  }
+
+  // 1 / (1 + e^-x) is safe for all x, as exp() clamps its argument to [-88.38, 88.38]
+  static inline T sigmoid(const T& x) {
+    return O::div(1.f, O::add(1.f, O::exp(O::neg(x))));
+  }
+
+  // max(x, y) + log(1 + e^-|x - y|)
+  static inline T logaddexp(const T& x, const T& y) {
+    T d = O::exp(O::neg(O::abs(O::sub(x, y))));
+    return O::add(O::max(x, y), O::log(O::add(1.f, d)));
+  }
+};
+
+// Specialization for float32x4 (=__m128, CPU SSE intrisics, or float32x4_t, ARM NEON intrinsics)
 template <>
 struct Ops<float32x4> {
   typedef float Single;
@@ -244,12 +289,7 @@ struct Ops<float32x4> {
     return out;
   }
 
-  // @TODO: why is this slow?
-  static inline float32x4 tanh(const float32x4& x) {
-    // ( e^x - e^-x )/( e^x + e^-x ) = (e^2x - 1) / (e^2x + 1)
-    float32x4 e2x = exp(mul(2.f, x));
-    return div(sub(e2x, 1.f), add(e2x, 1.f));
-  }
+  static inline float32x4 tanh(const float32x4& x) { return VectorOps<float32x4>::tanh(x); }
 
   static inline float32x4 sin(const float32x4& x) { return sin_ps(x); }
   static inline float32x4 cos(const float32x4& x) { return cos_ps(x); }
@@ -258,14 +298,37 @@ struct Ops<float32x4> {
   static inline float32x4 exp(const float32x4& x) { return exp_ps(x); }
 
   // @TODO: get rid of loop4 with proper intrisics
-  static inline float32x4 abs(const float32x4& x)  { return loop4(Ops<float>::abs, x); }
+#if USE_NEON
+  static inline float32x4 abs(const float32x4& x)  { return vabsq_f32(x); }
+  static inline float32x4 sqr(const float32x4& x)  { return vmulq_f32(x, x); }
+  static inline float32x4 sqrt(const float32x4& x) { return vsqrtq_f32(x); }
+#else
+  static inline float32x4 abs(const float32x4& x)  { return _mm_andnot_ps(_mm_set1_ps(-0.f), x); }
   static inline float32x4 sqr(const float32x4& x)  { return _mm_mul_ps(x, x); }
   static inline float32x4 sqrt(const float32x4& x) { return _mm_sqrt_ps(x); }
+#endif
   static inline float32x4 neg(const float32x4& x)  { return sub(0.f, x); }
 
   // @TODO: get rid of loop4 with proper intrisics
+#if USE_NEON
   static inline float32x4 sgn(const float32x4& x)  { return loop4(Ops<float>::sgn, x); }
+#else
+  static inline float32x4 sgn(const float32x4& x)  { return sub(gt(x, 0.f), lt(x, 0.f)); }
+#endif
 
+#if USE_NEON
+  static inline float32x4 round(const float32x4& x)  { return vrndnq_f32(x); }
+  static inline float32x4 floor(const float32x4& x)  { return vrndmq_f32(x); }
+  static inline float32x4 ceil(const float32x4& x)   { return vrndpq_f32(x); }
+
+  static inline float32x4 add(const float32x4& x, const float32x4& y) { return vaddq_f32(x, y); }
+  static inline float32x4 sub(const float32x4& x, const float32x4& y) { return vsubq_f32(x, y); }
+  static inline float32x4 mul(const float32x4& x, const float32x4& y) { return vmulq_f32(x, y); }
+  static inline float32x4 div(const float32x4& x, const float32x4& y) { return vdivq_f32(x, y); }
+
+  static inline float32x4 max(const float32x4& x, const float32x4& y) { return vmaxq_f32(x, y); }
+  static inline float32x4 min(const float32x4& x, const float32x4& y) { return vminq_f32(x, y); }
+#else
   static inline float32x4 round(const float32x4& x)  { return _mm_round_ps(x, _MM_FROUND_TO_NEAREST_INT); }
   static inline float32x4 floor(const float32x4& x)  { return _mm_floor_ps(x); }
   static inline float32x4 ceil(const float32x4& x)   { return _mm_ceil_ps(x); }
@@ -277,8 +340,12 @@ struct Ops<float32x4> {
 
   static inline float32x4 max(const float32x4& x, const float32x4& y) { return _mm_max_ps(x, y); }
   static inline float32x4 min(const float32x4& x, const float32x4& y) { return _mm_min_ps(x, y); }
+#endif
   static inline float32x4 pow(const float32x4& x, const float32x4& y) { return exp(mul(y, log(x))); }
 
+  // The comparisons below return 1 or 0 in each lane like Ops<float>, the SSE versions by masking 1.f
+  // with the result of the comparison
+#if USE_NEON
   // @TODO: get rid of loop4 with proper intrisics
   static inline float32x4 negate(float32x4& x)  { return loop4(Ops<float>::negate, x); }
 
@@ -290,31 +357,54 @@ struct Ops<float32x4> {
   static inline float32x4 leq(const float32x4& x, const float32x4& y)  { return loop4(Ops<float>::leq, x, y); }
   static inline float32x4 and_(const float32x4& x, const float32x4& y) { return loop4(Ops<float>::and_, x, y); } // 'and' is used by gcc
   static inline float32x4 or_(const float32x4& x, const float32x4& y)  { return loop4(Ops<float>::or_, x, y); } // 'or' is used by gcc
+#else
+  static inline float32x4 one(const __m128& mask) { return _mm_and_ps(mask, _mm_set1_ps(1.f)); }
+
+  static inline float32x4 negate(float32x4& x)  { return eq(x, 0.f); }
+
+  static inline float32x4 eq(const float32x4& x, const float32x4& y)   { return one(_mm_cmpeq_ps(x, y)); }
+  static inline float32x4 neq(const float32x4& x, const float32x4& y)  { return one(_mm_cmpneq_ps(x, y)); }
+  static inline float32x4 gt(const float32x4& x, const float32x4& y)   { return one(_mm_cmpgt_ps(x, y)); }
+  static inline float32x4 lt(const float32x4& x, const float32x4& y)   { return one(_mm_cmplt_ps(x, y)); }
+  static inline float32x4 geq(const float32x4& x, const float32x4& y)  { return one(_mm_cmpge_ps(x, y)); }
+  static inline float32x4 leq(const float32x4& x, const float32x4& y)  { return one(_mm_cmple_ps(x, y)); }
+  static inline float32x4 and_(const float32x4& x, const float32x4& y) { // 'and' is used by gcc
+    return one(_mm_and_ps(_mm_cmpneq_ps(x, _mm_setzero_ps()), _mm_cmpneq_ps(y, _mm_setzero_ps())));
+  }
+  static inline float32x4 or_(const float32x4& x, const float32x4& y)  { // 'or' is used by gcc
+    return one(_mm_or_ps(_mm_cmpneq_ps(x, _mm_setzero_ps()), _mm_cmpneq_ps(y, _mm_setzero_ps())));
+  }
+#endif
 
   // Neural Networks specific functions
-  // @TODO: this is unsafe
-  static inline float32x4 sigmoid(const float32x4& x) {
-    float32x4 e = exp(x);
-    return div(e, add(1.f, e));
-  }
+  static inline float32x4 sigmoid(const float32x4& x) { return VectorOps<float32x4>::sigmoid(x); }
 
-  // // Neural Networks specific functions
-  // static HOST_DEVICE_INLINE float sigmoid(const float& x) {
-  //   return x > 0 ? (1.f / (1.f + exp(-x))) : (exp(x) / (1.f + exp(x)));
-  // }
+  static inline float32x4 logaddexp(const float32x4& x, const float32x4& y)  { return VectorOps<float32x4>::logaddexp(x, y); }
 
-  static inline float32x4 logaddexp(const float32x4& x, const float32x4& y)  { return loop4(Ops<float>::logaddexp, x, y); }
+  static inline float32x4 relu(const float32x4& x)  { return max(0.f, x); }
 
+  // @TODO: get rid of loop4 with proper intrisics
+#if USE_NEON
   static inline float32x4 clip(const float32x4& x, const float32x4& y)  { return loop4(Ops<float>::clip, x, y); }
   static inline float32x4 bump(const float32x4& x, const float32x4& y)  { return loop4(Ops<float>::bump, x, y); }
 
-  static inline float32x4 relu(const float32x4& x)  { return max(0.f, x); }
-
   static inline float32x4 reluBack(const float32x4& x)  { return loop4(Ops<float>::reluBack, x); }
   static inline float32x4 prelu(const float32x4& x, const float32x4& y)  { return loop4(Ops<float>::prelu, x, y); }
   static inline float32x4 preluBack(const float32x4& x, const float32x4& y)  { return loop4(Ops<float>::preluBack, x, y); }
 
   static inline float32x4 if_then_else(const float32x4& x, const float32x4& y, const float32x4& z) { return loop4(Ops<float>::if_then_else, x, y, z);  }
+#else
+  static inline float32x4 clip(const float32x4& x, const float32x4& y)  {
+    return _mm_blendv_ps(x, mul(sgn(x), y), _mm_cmpge_ps(abs(x), y));
+  }
+  static inline float32x4 bump(const float32x4& x, const float32x4& y)  { return one(_mm_cmpnge_ps(abs(x), y)); }
+
+  static inline float32x4 reluBack(const float32x4& x)  { return gt(x, 0.f); }
+  static inline float32x4 prelu(const float32x4& x, const float32x4& y)  { return _mm_blendv_ps(mul(x, y), x, _mm_cmpgt_ps(x, _mm_setzero_ps())); }
+  static inline float32x4 preluBack(const float32x4& x, const float32x4& y)  { return _mm_blendv_ps(y, _mm_set1_ps(1.f), _mm_cmpgt_ps(x, _mm_setzero_ps())); }
+
+  static inline float32x4 if_then_else(const float32x4& x, const float32x4& y, const float32x4& z) { return _mm_blendv_ps(z, y, _mm_cmpneq_ps(x, _mm_setzero_ps())); }
+#endif
 
   static inline Single sumReduce(const float32x4& x) {
     Single sum = 0;
@@ -376,10 +466,7 @@ struct Ops<float32x8> {
     return out;
   }
 
-  static inline float32x8 tanh(const float32x8& x) { // ( e^x - e^-x )/( e^x + e^-x )
-    float32x8 e2x = exp(mul(2.f, x));
-    return div(sub(e2x, 1.f), add(e2x, 1.f));
-  }
+  static inline float32x8 tanh(const float32x8& x) { return VectorOps<float32x8>::tanh(x); }
 
   static inline float32x8 sin(const float32x8& x) { return sin256_ps(x); }
   static inline float32x8 cos(const float32x8& x) { return cos256_ps(x); }
@@ -387,14 +474,12 @@ struct Ops<float32x8> {
   static inline float32x8 log(const float32x8& x) { return log256_ps(x); }
   static inline float32x8 exp(const float32x8& x) { return exp256_ps(x); }
 
-  // @TODO: get rid of loop8 with proper intrisics
-  static inline float32x8 abs(const float32x8& x)  { return loop8(Ops<float>::abs, x); }
+  static inline float32x8 abs(const float32x8& x)  { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), x); }
   static inline float32x8 sqr(const float32x8& x)  { return _mm256_mul_ps(x, x); }
   static inline float32x8 sqrt(const float32x8& x) { return _mm256_sqrt_ps(x); }
   static inline float32x8 neg(const float32x8& x)  { return sub(0.f, x); }
 
-  // @TODO: get rid of loop8 with proper intrisics
-  static inline float32x8 sgn(const float32x8& x)  { return loop8(Ops<float>::sgn, x); }
+  static inline float32x8 sgn(const float32x8& x)  { return sub(gt(x, 0.f), lt(x, 0.f)); }
 
   static inline float32x8 round(const float32x8& x)  { return _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT); }
   static inline float32x8 floor(const float32x8& x)  { return _mm256_floor_ps(x); }
@@ -409,38 +494,47 @@ struct Ops<float32x8> {
   static inline float32x8 min(const float32x8& x, const float32x8& y) { return _mm256_min_ps(x, y); }
   static inline float32x8 pow(const float32x8& x, const float32x8& y) { return exp(mul(y, log(x))); }
 
-  // @TODO: get rid of loop8 with proper intrisics
-  static inline float32x8 negate(float32x8& x)  { return loop8(Ops<float>::negate, x); }
+  // The comparisons below return 1 or 0 in each lane like Ops<float>, by masking 1.f with the result
+  // of the comparison
+  template <int Predicate>
+  static inline float32x8 cmp(const float32x8& x, const float32x8& y) {
+    return _mm256_and_ps(_mm256_cmp_ps(x, y, Predicate), _mm256_set1_ps(1.f));
+  }
 
-  static inline float32x8 eq(const float32x8& x, const float32x8& y)   { return loop8(Ops<float>::eq, x, y); }
-  static inline float32x8 neq(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::neq, x, y); }
-  static inline float32x8 gt(const float32x8& x, const float32x8& y)   { return loop8(Ops<float>::gt, x, y); }
-  static inline float32x8 lt(const float32x8& x, const float32x8& y)   { return loop8(Ops<float>::lt, x, y); }
-  static inline float32x8 geq(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::geq, x, y); }
-  static inline float32x8 leq(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::leq, x, y); }
-  static inline float32x8 and_(const float32x8& x, const float32x8& y) { return loop8(Ops<float>::and_, x, y); } // 'and' is used by gcc
-  static inline float32x8 or_(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::or_, x, y); } // 'or' is used by gcc
+  static inline float32x8 negate(float32x8& x)  { return eq(x, 0.f); }
 
+  static inline float32x8 eq(const float32x8& x, const float32x8& y)   { return cmp<_CMP_EQ_OQ>(x, y); }
+  static inline float32x8 neq(const float32x8& x, const float32x8& y)  { return cmp<_CMP_NEQ_UQ>(x, y); }
+  static inline float32x8 gt(const float32x8& x, const float32x8& y)   { return cmp<_CMP_GT_OQ>(x, y); }
+  static inline float32x8 lt(const float32x8& x, const float32x8& y)   { return cmp<_CMP_LT_OQ>(x, y); }
+  static inline float32x8 geq(const float32x8& x, const float32x8& y)  { return cmp<_CMP_GE_OQ>(x, y); }
+  static inline float32x8 leq(const float32x8& x, const float32x8& y)  { return cmp<_CMP_LE_OQ>(x, y); }
+  static inline float32x8 and_(const float32x8& x, const float32x8& y) { return mul(neq(x, 0.f), neq(y, 0.f)); } // 'and' is used by gcc
+  static inline float32x8 or_(const float32x8& x, const float32x8& y)  { return max(neq(x, 0.f), neq(y, 0.f)); } // 'or' is used by gcc
 
   // Neural Networks specific functions
-  // @TODO: this is unsafe
-  static inline float32x8 sigmoid(const float32x8& x) {
-    float32x8 e = exp(x);
-    return div(e, add(1.f, e));
-  }
+  static inline float32x8 sigmoid(const float32x8& x) { return VectorOps<float32x8>::sigmoid(x); }
 
-  static inline float32x8 logaddexp(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::logaddexp, x, y); }
+  static inline float32x8 logaddexp(const float32x8& x, const float32x8& y)  { return VectorOps<float32x8>::logaddexp(x, y); }
 
-  static inline float32x8 clip(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::clip, x, y); }
-  static inline float32x8 bump(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::bump, x, y); }
+  static inline float32x8 clip(const float32x8& x, const float32x8& y)  {
+    return _mm256_blendv_ps(x, mul(sgn(x), y), _mm256_cmp_ps(abs(x), y, _CMP_GE_OQ));
+  }
+  static inline float32x8 bump(const float32x8& x, const float32x8& y)  { return cmp<_CMP_NGE_UQ>(abs(x), y); }
 
   static inline float32x8 relu(const float32x8& x)  { return max(0.f, x); }
 
-  static inline float32x8 reluBack(const float32x8& x)  { return loop8(Ops<float>::reluBack, x); }
-  static inline float32x8 prelu(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::prelu, x, y); }
-  static inline float32x8 preluBack(const float32x8& x, const float32x8& y)  { return loop8(Ops<float>::preluBack, x, y); }
+  static inline float32x8 reluBack(const float32x8& x)  { return gt(x, 0.f); }
+  static inline float32x8 prelu(const float32x8& x, const float32x8& y)  {
+    return _mm256_blendv_ps(mul(x, y), x, _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ));
+  }
+  static inline float32x8 preluBack(const float32x8& x, const float32x8& y)  {
+    return _mm256_blendv_ps(y, _mm256_set1_ps(1.f), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ));
+  }
 
-  static inline float32x8 if_then_else(const float32x8& x, const float32x8& y, const float32x8& z) { return loop8(Ops<float>::if_then_else, x, y, z);  }
+  static inline float32x8 if_then_else(const float32x8& x, const float32x8& y, const float32x8& z) {
+    return _mm256_blendv_ps(z, y, _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_NEQ_UQ));
+  }
 
   static inline Single sumReduce(const float32x8& x) {
     Single sum = 0;
@@ -467,6 +561,136 @@ struct Ops<float32x8> {
 } // end namespace functional
 } // end namespace marian
 #endif
+
+#ifdef __AVX512F__
+// false uninitialized warnings of gcc 12.1/12.2 in inlined AVX512 intrinsics, see tensors/cpu/softmax.cpp
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include "3rd_party/avx512_mathfun.h"
+
+namespace marian {
+namespace functional {
+
+//*******************************************************************************************
+// Specialization for float32x16 (=__m512, CPU AVX512F intrisics)
+template <>
+struct Ops<float32x16> {
+  typedef float Single;
+
+  static inline float32x16 loop16(const std::function<float(const float&)>& f, const float32x16& x) {
+    float32x16 out;
+    for(int i = 0; i < 16; i++)
+      ((float*)&out)[i] = f(((const float*)&x)[i]);
+    return out;
+  }
+
+  static inline float32x16 tanh(const float32x16& x) { return VectorOps<float32x16>::tanh(x); }
+
+  // @TODO: port sin256_ps and cos256_ps
+  static inline float32x16 sin(const float32x16& x) { return loop16(Ops<float>::sin, x); }
+  static inline float32x16 cos(const float32x16& x) { return loop16(Ops<float>::cos, x); }
+  static inline float32x16 tan(const float32x16& x) { return div(sin(x), cos(x)); }
+  static inline float32x16 log(const float32x16& x) { return log512_ps(x); }
+  static inline float32x16 exp(const float32x16& x) { return exp512_ps(x); }
+
+  static inline float32x16 abs(const float32x16& x)  { return _mm512_abs_ps(x); }
+  static inline float32x16 sqr(const float32x16& x)  { return _mm512_mul_ps(x, x); }
+  static inline float32x16 sqrt(const float32x16& x) { return _mm512_sqrt_ps(x); }
+  static inline float32x16 neg(const float32x16& x)  { return sub(0.f, x); }
+
+  static inline float32x16 sgn(const float32x16& x)  { return sub(gt(x, 0.f), lt(x, 0.f)); }
+
+  static inline float32x16 round(const float32x16& x)  { return _mm512_roundscale_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static inline float32x16 floor(const float32x16& x)  { return _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+  static inline float32x16 ceil(const float32x16& x)   { return _mm512_roundscale_ps(x, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+
+  static inline float32x16 add(const float32x16& x, const float32x16& y) { return _mm512_add_ps(x, y); }
+  static inline float32x16 sub(const float32x16& x, const float32x16& y) { return _mm512_sub_ps(x, y); }
+  static inline float32x16 mul(const float32x16& x, const float32x16& y) { return _mm512_mul_ps(x, y); }
+  static inline float32x16 div(const float32x16& x, const float32x16& y) { return _mm512_div_ps(x, y); }
+
+  static inline float32x16 max(const float32x16& x, const float32x16& y) { return _mm512_max_ps(x, y); }
+  static inline float32x16 min(const float32x16& x, const float32x16& y) { return _mm512_min_ps(x, y); }
+  static inline float32x16 pow(const float32x16& x, const float32x16& y) { return exp(mul(y, log(x))); }
+
+  // The comparisons below return 1 or 0 in each lane like Ops<float>, 1.f where the mask of the
+  // comparison is set
+  template <int Predicate>
+  static inline __mmask16 mask(const float32x16& x, const float32x16& y) {
+    return _mm512_cmp_ps_mask(x, y, Predicate);
+  }
+  static inline float32x16 one(__mmask16 m) { return _mm512_maskz_mov_ps(m, _mm512_set1_ps(1.f)); }
+
+  static inline float32x16 negate(float32x16& x)  { return eq(x, 0.f); }
+
+  static inline float32x16 eq(const float32x16& x, const float32x16& y)   { return one(mask<_CMP_EQ_OQ>(x, y)); }
+  static inline float32x16 neq(const float32x16& x, const float32x16& y)  { return one(mask<_CMP_NEQ_UQ>(x, y)); }
+  static inline float32x16 gt(const float32x16& x, const float32x16& y)   { return one(mask<_CMP_GT_OQ>(x, y)); }
+  static inline float32x16 lt(const float32x16& x, const float32x16& y)   { return one(mask<_CMP_LT_OQ>(x, y)); }
+  static inline float32x16 geq(const float32x16& x, const float32x16& y)  { return one(mask<_CMP_GE_OQ>(x, y)); }
+  static inline float32x16 leq(const float32x16& x, const float32x16& y)  { return one(mask<_CMP_LE_OQ>(x, y)); }
+  static inline float32x16 and_(const float32x16& x, const float32x16& y) { // 'and' is used by gcc
+    return one(mask<_CMP_NEQ_UQ>(x, 0.f) & mask<_CMP_NEQ_UQ>(y, 0.f));
+  }
+  static inline float32x16 or_(const float32x16& x, const float32x16& y)  { // 'or' is used by gcc
+    return one(mask<_CMP_NEQ_UQ>(x, 0.f) | mask<_CMP_NEQ_UQ>(y, 0.f));
+  }
+
+  // Neural Networks specific functions
+  static inline float32x16 sigmoid(const float32x16& x) { return VectorOps<float32x16>::sigmoid(x); }
+
+  static inline float32x16 logaddexp(const float32x16& x, const float32x16& y)  { return VectorOps<float32x16>::logaddexp(x, y); }
+
+  static inline float32x16 clip(const float32x16& x, const float32x16& y)  {
+    return _mm512_mask_blend_ps(mask<_CMP_GE_OQ>(abs(x), y), x, mul(sgn(x), y));
+  }
+  static inline float32x16 bump(const float32x16& x, const float32x16& y)  { return one(mask<_CMP_NGE_UQ>(abs(x), y)); }
+
+  static inline float32x16 relu(const float32x16& x)  { return max(0.f, x); }
+
+  static inline float32x16 reluBack(const float32x16& x)  { return gt(x, 0.f); }
+  static inline float32x16 prelu(const float32x16& x, const float32x16& y)  {
+    return _mm512_mask_blend_ps(mask<_CMP_GT_OQ>(x, 0.f), mul(x, y), x);
+  }
+  static inline float32x16 preluBack(const float32x16& x, const float32x16& y)  {
+    return _mm512_mask_blend_ps(mask<_CMP_GT_OQ>(x, 0.f), y, _mm512_set1_ps(1.f));
+  }
+
+  static inline float32x16 if_then_else(const float32x16& x, const float32x16& y, const float32x16& z) {
+    return _mm512_mask_blend_ps(mask<_CMP_NEQ_UQ>(x, 0.f), z, y);
+  }
+
+  static inline Single sumReduce(const float32x16& x) {
+    Single sum = 0;
+    for(int i = 0; i < 16; ++i)
+      sum = Ops<Single>::add(sum, x[i]);
+    return sum;
+  }
+
+  static inline Single maxReduce(const float32x16& x) {
+    Single maxs = x[0];
+    for(int i = 1; i < 16; ++i)
+      maxs = Ops<Single>::max(maxs, x[i]);
+    return maxs;
+  }
+
+  static inline Single minReduce(const float32x16& x) {
+    Single mins = x[0];
+    for(int i = 1; i < 16; ++i)
+      mins = Ops<Single>::min(mins, x[i]);
+    return mins;
+  }
+};
+
+} // end namespace functional
+} // end namespace marian
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
 #endif // of "#ifndef __CUDACC__"
 
 #ifdef __CUDACC__
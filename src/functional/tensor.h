@@ -43,6 +43,18 @@ inline marian::Shape adapt<float32x8>(const marian::Shape& shape) {
   return x8Shape;
 }
 #endif
+#ifdef __AVX512F__
+template <>
+inline marian::Shape adapt<float32x16>(const marian::Shape& shape) {
+  ABORT_IF(shape[-1] % 16 != 0,
+           "Last dim ({}) is not a multiple of 16 while converting to Tensor<float32x16>",
+           shape[-1]);
+
+  marian::Shape x16Shape = shape;
+  x16Shape.set(-1, shape[-1] / 16);
+  return x16Shape;
+}
+#endif
 #endif
 
 template <typename T, const int D>
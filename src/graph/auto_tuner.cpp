@@ -0,0 +1,138 @@
+#include "graph/auto_tuner.h"
+#include "common/logging.h"
+
+#include <fstream>
+#include <limits>
+
+namespace marian {
+
+AutoTunerCache& AutoTunerCache::instance() {
+  static AutoTunerCache cache;
+  return cache;
+}
+
+void AutoTunerCache::enable(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  enabled_ = true;
+  path_ = path;
+  if(path_.empty())
+    return;
+
+  // later lines override earlier ones, e.g. after re-tuning with a cache file shared by several runs
+  std::ifstream in(path_);
+  std::string line;
+  size_t lines = 0;
+  while(std::getline(in, line)) {
+    auto tab = line.rfind('\t');
+    if(tab == std::string::npos || tab == 0 || tab + 1 == line.size()) {
+      LOG(warn, "[autotune] Ignoring malformed line '{}' in {}", line, path_);
+      continue;
+    }
+    decisions_[line.substr(0, tab)] = line.substr(tab + 1);
+    lines++;
+  }
+  LOG(info, "[autotune] Loaded {} decisions from {}", lines, path_);
+}
+
+std::string AutoTunerCache::lookup(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = decisions_.find(key);
+  return it != decisions_.end() ? it->second : std::string();
+}
+
+void AutoTunerCache::store(const std::string& key, const std::string& alternative) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  decisions_[key] = alternative;
+  if(path_.empty())
+    return;
+
+  std::ofstream out(path_, std::ios::app);
+  out << key << '\t' << alternative << std::endl;
+  if(!out)
+    LOG(warn, "[autotune] Could not write decision for '{}' to {}", key, path_);
+}
+
+size_t AutoTuner::choose(const std::string& key, bool& timed) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  timed = false;
+
+  auto it = tunings_.find(key);
+  if(it == tunings_.end()) {
+    Tuning tuning;
+    tuning.seconds.resize(names_.size(), 0.0);
+    tuning.runs.resize(names_.size(), 0);
+
+    // a decision of an earlier process
+    auto cached = AutoTunerCache::instance().lookup(op_ + " " + key);
+    for(size_t i = 0; i < names_.size(); ++i)
+      if(names_[i] == cached)
+        tuning.chosen = (int)i;
+
+    it = tunings_.emplace(key, tuning).first;
+  }
+
+  auto& tuning = it->second;
+  if(tuning.chosen >= 0)
+    return (size_t)tuning.chosen;
+
+  // round-robin over the alternatives, so that they see similar conditions
+  size_t alternative = tuning.next;
+  tuning.next = (tuning.next + 1) % names_.size();
+  timed = true;
+  return alternative;
+}
+
+void AutoTuner::record(const std::string& key, size_t alternative, double seconds) {
+  std::string best;
+  double bestTime = std::numeric_limits<double>::max();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& tuning = tunings_[key];
+    if(tuning.chosen >= 0) // decided by another thread meanwhile
+      return;
+
+    // the first run of each alternative warms up caches and allocations and is not counted
+    if(tuning.runs[alternative]++ > 0)
+      tuning.seconds[alternative] += seconds;
+
+    for(size_t i = 0; i < names_.size(); ++i)
+      if(tuning.runs[i] <= runs_)
+        return; // collect more timings
+
+    for(size_t i = 0; i < names_.size(); ++i) {
+      if(tuning.seconds[i] < bestTime) {
+        bestTime = tuning.seconds[i];
+        tuning.chosen = (int)i;
+      }
+    }
+    best = names_[tuning.chosen];
+  }
+
+  LOG(info, "[autotune] {} {}: {} ({:.2f} us per call)", op_, key, best, bestTime / runs_ * 1e6);
+  AutoTunerCache::instance().store(op_ + " " + key, best);
+}
+
+void AutoTuner::run(const std::string& key,
+                    const std::vector<Algorithm>& algorithms,
+                    const std::function<void()>& synchronize) {
+  ABORT_IF(algorithms.size() != names_.size(),
+           "AutoTuner for {} has {} alternatives, but {} were passed",
+           op_, names_.size(), algorithms.size());
+
+  bool timed;
+  size_t alternative = choose(key, timed);
+  if(!timed) {
+    algorithms[alternative]();
+    return;
+  }
+
+  if(synchronize)
+    synchronize();
+  timer::Timer timer;
+  algorithms[alternative]();
+  if(synchronize)
+    synchronize();
+  record(key, alternative, timer.elapsed());
+}
+
+}  // namespace marian
@@ -5,113 +5,89 @@
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace marian {
 
+// Interface of graph nodes to time their execution, see Node::record()
 class AutoTunerRecorder {
 public:
   virtual void start(size_t hash) = 0;
   virtual void stop(size_t hash, bool) = 0;
 };
 
-template <typename Return, typename... Args>
-class AutoTuner : public AutoTunerRecorder {
+// Process-wide store of tuning decisions, the name of the fastest alternative by operation and
+// problem key, e.g. "cpu.ProdBatched m64n64k32b8 NT" -> "small". If a cache file is set, the decisions
+// in it are loaded up front and new ones are appended to it, one "key<TAB>alternative" line each, so later
+// processes skip the benchmarking. Decisions depend on the hardware, a cache file is meant for one kind
+// of machine. Tuning is off unless enabled, see --autotune and --autotune-cache.
+class AutoTunerCache {
 private:
-  typedef std::function<Return(Args...)> Algorithm;
-
-  // When the autotuner decides the fastest algorithm for a specific tensor operation (e.g. GEMM),
-  // the autotuner runs each algorithm at least this 'collectStatMax' number of times and
-  // collects the statistics.
-  const size_t collectStatMax = 50;
-  UPtr<timer::CPUTimer> timer_;
-
-  // This structure holds a hash key an algorithm function (e.g. int16, packed gemm, mkl gemm)
-  // for a specific operation size
-  // hash: a unique hash key for each operation size
-  //      (e.g. m, n, k, transpose A, transpose B, bias size for GEMM)
-  // algorithm: a function that holds an algorithm
-  struct HashedAlgorithm {
-    size_t hash;
-    Algorithm algorithm;
-  };
-
-  // This structure represents the collected statistics.
-  // time: total accumulated time of this operator execution with the given algorithm
-  // runs: total time this algorithm was executed
-  struct Stat {
-    double time;
-    size_t runs;
-  };
-
-  std::unordered_map<size_t, Stat> stats_;
-  std::unordered_map<size_t, size_t> done_;
-
-  std::vector<HashedAlgorithm> algorithms_;
-
-  size_t choose() {
-    size_t best = 0;
-    double bestTime = std::numeric_limits<double>::max();
-
-    for(size_t i = 0; i < algorithms_.size(); ++i) {
-      auto doneIt = done_.find(algorithms_[i].hash);
-      if(doneIt != done_.end())
-        return doneIt->second;
-
-      auto it = stats_.find(algorithms_[i].hash);
-      if(it != stats_.end()) {
-        auto& stat = it->second;
-
-        // collect more stats
-        if(stat.runs < collectStatMax)
-          return i;
-
-        if(stat.time < bestTime) {
-          bestTime = stat.time;
-          best = i;
-        }
-      } else {
-        // collect more stats
-        return i;
-      }
-    }
-
-    for(auto& a : algorithms_)
-      done_[a.hash] = best;
-
-    return best;
-  }
+  std::mutex mutex_;
+  bool enabled_{false};
+  std::string path_;
+  std::unordered_map<std::string, std::string> decisions_;
 
 public:
-  void insert(const HashedAlgorithm& ha) { algorithms_.push_back(ha); }
+  static AutoTunerCache& instance();
 
-  void clear() { algorithms_.clear(); }
+  // Turn tuning on, with decisions persisted in `path` if it is not empty
+  void enable(const std::string& path);
+  bool enabled() const { return enabled_; }
 
-  Return run(Args... args) { return algorithms_[choose()].algorithm(args...); }
+  // The stored alternative for `key`, empty if there is none
+  std::string lookup(const std::string& key);
+  void store(const std::string& key, const std::string& alternative);
+};
 
-  void start(size_t hash) override {
-    if(!timer_ && done_.count(hash) == 0)
-      timer_.reset(new timer::CPUTimer());
-  }
+// Chooses the fastest of several implementations of one operation per problem key. The caller builds
+// the key from its shapes, usually rounded with shapeBucket() so that similar problems share a decision,
+// and passes the alternatives in the order of the names given at construction. The first calls for a key
+// run each alternative in turn and time it; after `runs` timed calls of each, the fastest is used for
+// that key from then on and stored in the AutoTunerCache. All alternatives must compute the same result.
+// Thread-safe, one tuner is usually a static of the operation it tunes.
+class AutoTuner {
+public:
+  typedef std::function<void()> Algorithm;
 
-  void stop(size_t hash, bool stop) override {
-    if(stop && done_.count(hash) == 0) {
-      timer_->stop();
+private:
+  std::string op_;
+  std::vector<std::string> names_;
+  size_t runs_;
+
+  // timings of a key while tuning, the chosen alternative once done
+  struct Tuning {
+    std::vector<double> seconds; // total time per alternative
+    std::vector<size_t> runs;    // timed runs per alternative, the first run of each is not timed
+    size_t next{0};              // the alternative to run next
+    int chosen{-1};
+  };
 
-      auto seconds = timer_->elapsed();
+  std::mutex mutex_;
+  std::unordered_map<std::string, Tuning> tunings_;
 
-      auto it = stats_.find(hash);
-      if(it != stats_.end()) {
-        if(it->second.runs < collectStatMax) {
-          it->second.time += seconds;
-          it->second.runs += 1;
-        }
-      } else {
-        stats_.emplace(hash, Stat({seconds, 1}));
-      }
+  size_t choose(const std::string& key, bool& timed);
+  void record(const std::string& key, size_t alternative, double seconds);
 
-      timer_.reset(nullptr);
-    }
+public:
+  AutoTuner(const std::string& op, const std::vector<std::string>& names, size_t runs = 10)
+      : op_(op), names_(names), runs_(runs) {}
+
+  // Runs one of `algorithms` for `key`. `synchronize` is called around timed runs if the algorithms
+  // are asynchronous, e.g. GPU kernels.
+  void run(const std::string& key,
+           const std::vector<Algorithm>& algorithms,
+           const std::function<void()>& synchronize = nullptr);
+
+  // Smallest power of two that is at least `dim`, to group problems of similar size
+  static size_t shapeBucket(size_t dim) {
+    size_t bucket = 1;
+    while(bucket < dim)
+      bucket *= 2;
+    return bucket;
   }
 };
 
@@ -75,6 +75,9 @@ public:
   virtual bool memoize() = 0;
   virtual void setMemoize(bool) = 0;
 
+  // false for views that reuse the memory of another node, e.g. reshape()
+  virtual bool ownsMemory() = 0;
+
   virtual void setId(size_t) = 0;
   virtual size_t getId() = 0;
 
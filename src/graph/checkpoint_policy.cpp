@@ -0,0 +1,90 @@
+#include "graph/checkpoint_policy.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace marian {
+
+double CheckpointPolicy::secondsPerElement(const std::string& type) const {
+  auto it = costs_.find(type);
+  if(it != costs_.end() && it->second.elements > 0)
+    return it->second.seconds / it->second.elements;
+
+  // not recomputed yet, e.g. before the first backward pass: the average of all types
+  double seconds = 0;
+  size_t elements = 0;
+  for(const auto& cost : costs_) {
+    seconds += cost.second.seconds;
+    elements += cost.second.elements;
+  }
+  return elements > 0 ? seconds / elements : 1e-9;
+}
+
+void CheckpointPolicy::record(const std::string& type, size_t elements, double seconds) {
+  auto& cost = costs_[type];
+  cost.seconds += seconds;
+  cost.elements += elements;
+}
+
+void CheckpointPolicy::finishTimedPass() {
+  if(timing())
+    timedPasses_++;
+}
+
+CheckpointPolicy::Stats CheckpointPolicy::select(const std::list<Expr>& backwardTape) {
+  struct Candidate {
+    Expr node;
+    size_t bytes;
+    double seconds;
+  };
+  std::vector<Candidate> candidates;
+  for(const auto& v : backwardTape) {
+    auto subtape = v->getSubtape();
+    if(!subtape)
+      continue;
+    for(const auto& node : *subtape) {
+      if(!node->ownsMemory() || !node->trainable()) // views are not freed, subtapes only start at trainable nodes
+        continue;
+      size_t elements = node->shape().elements();
+      candidates.push_back({node, elements * sizeOf(node->value_type()), elements * secondsPerElement(node->type())});
+    }
+  }
+
+  // the most recomputation per byte first, ties in tape order
+  std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+    return a.seconds * b.bytes > b.seconds * a.bytes;
+  });
+
+  Stats stats;
+  for(const auto& candidate : candidates) {
+    if(stats.keptBytes + candidate.bytes <= budget_) {
+      candidate.node->markCheckpoint();
+      stats.kept++;
+      stats.keptBytes += candidate.bytes;
+      stats.savedSeconds += candidate.seconds;
+    } else {
+      stats.recomputed++;
+      stats.recomputedBytes += candidate.bytes;
+      stats.recomputeSeconds += candidate.seconds;
+    }
+  }
+  return stats;
+}
+
+void CheckpointPolicy::report(const Stats& stats) {
+  auto message = fmt::format("Keeping {} outputs ({:.1f} MB), recomputing {} outputs ({:.1f} MB)",
+                             stats.kept, stats.keptBytes / 1048576.0, stats.recomputed, stats.recomputedBytes / 1048576.0);
+  if(!costs_.empty()) // else nothing was recomputed yet
+    message += fmt::format(" per backward pass: an estimated {:.2f} ms of recomputation saved, {:.2f} ms left",
+                           stats.savedSeconds * 1e3, stats.recomputeSeconds * 1e3);
+
+  if(!reported_ && !timing()) {
+    LOG(info, "[checkpointing] {}", message);
+    reported_ = true;
+  } else {
+    LOG(debug, "[checkpointing] {}", message);
+  }
+}
+
+}  // namespace marian
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common/types.h"
+#include "graph/chainable.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace marian {
+
+// Automatic choice of additional checkpoints for gradient checkpointing, see
+// --gradient-checkpointing-budget. Without it, all outputs between two manual checkpoints, e.g. the
+// layers of a transformer, are freed after the forward pass and recomputed in the backward pass.
+// The policy keeps some of them instead, up to a budget of memory: those that cost the most time to
+// recompute per byte. The time per element of each node type is measured while recomputing during
+// the first backward passes; until then, all node types are assumed to cost the same.
+class CheckpointPolicy {
+public:
+  struct Stats {
+    size_t kept{0};              // outputs kept by the policy
+    size_t keptBytes{0};
+    size_t recomputed{0};        // outputs still freed and recomputed
+    size_t recomputedBytes{0};   // memory that checkpointing saves
+    double savedSeconds{0};      // estimated recomputation avoided by the kept outputs
+    double recomputeSeconds{0};  // estimated recomputation that remains
+  };
+
+private:
+  struct Cost {
+    double seconds{0};
+    size_t elements{0};
+  };
+  std::unordered_map<std::string, Cost> costs_; // [node type] measured recomputations
+
+  size_t budget_;          // bytes
+  size_t timedPasses_{0};
+  size_t maxTimedPasses_;
+  bool reported_{false};
+
+  double secondsPerElement(const std::string& type) const;
+
+public:
+  CheckpointPolicy(size_t budgetBytes, size_t maxTimedPasses = 3)
+      : budget_(budgetBytes), maxTimedPasses_(maxTimedPasses) {}
+
+  size_t budget() const { return budget_; }
+
+  // true while the recomputation of backward passes should be timed with record()
+  bool timing() const { return timedPasses_ < maxTimedPasses_; }
+  void record(const std::string& type, size_t elements, double seconds);
+  void finishTimedPass();
+
+  // Marks checkpoints among the nodes that the subtapes of the nodes of backwardTape would recompute.
+  // The subtapes have to be recreated afterwards.
+  Stats select(const std::list<Expr>& backwardTape);
+
+  // Logs the stats of select(), the first time after the timings are complete at info level
+  void report(const Stats& stats);
+};
+
+}  // namespace marian
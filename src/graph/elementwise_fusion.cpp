@@ -0,0 +1,159 @@
+#include "graph/elementwise_fusion.h"
+
+#include "graph/expression_graph.h"
+#include "graph/node_operators_binary.h"
+#include "graph/node_operators_unary.h"
+
+#include <functional>
+#include <numeric>
+
+namespace marian {
+
+typedef cpu::FusedElementProgram::Op Op;
+typedef cpu::FusedElementProgram::Instruction Instruction;
+
+// The element-wise operation of a node
+struct ElementwiseFusion::Operation {
+  Op op;
+  float scalar{0.f};
+};
+
+bool ElementwiseFusion::operation(Chainable<Tensor>* node, Operation& operation) {
+  if(node->value_type() != Type::float32)
+    return false;
+
+  if(dynamic_cast<PlusNodeOp*>(node))
+    operation.op = Op::Add;
+  else if(dynamic_cast<MinusNodeOp*>(node))
+    operation.op = Op::Sub;
+  else if(dynamic_cast<MultNodeOp*>(node))
+    operation.op = Op::Mul;
+  else if(dynamic_cast<DivNodeOp*>(node))
+    operation.op = Op::Div;
+  else if(dynamic_cast<MaximumNodeOp*>(node))
+    operation.op = Op::Max;
+  else if(dynamic_cast<MinimumNodeOp*>(node))
+    operation.op = Op::Min;
+  else if(auto scalarAdd = dynamic_cast<ScalarAddNodeOp*>(node)) {
+    operation.op = Op::AddScalar;
+    operation.scalar = scalarAdd->scalar_;
+  } else if(auto scalarMult = dynamic_cast<ScalarMultNodeOp*>(node)) {
+    operation.op = Op::MulScalar;
+    operation.scalar = scalarMult->scalar_;
+  } else if(dynamic_cast<NegNodeOp*>(node))
+    operation.op = Op::Neg;
+  else if(dynamic_cast<AbsNodeOp*>(node))
+    operation.op = Op::Abs;
+  else if(dynamic_cast<ReLUNodeOp*>(node))
+    operation.op = Op::ReLU;
+  else if(dynamic_cast<SigmoidNodeOp*>(node))
+    operation.op = Op::Sigmoid;
+  else if(dynamic_cast<ExpNodeOp*>(node))
+    operation.op = Op::Exp;
+  else if(dynamic_cast<LogNodeOp*>(node))
+    operation.op = Op::Log;
+  else if(dynamic_cast<TanhNodeOp*>(node) && node->children().size() <= 3) // more are summed up in place
+    operation.op = Op::Tanh;
+  else
+    return false;
+  return true;
+}
+
+void ElementwiseFusion::analyze(const std::list<Expr>& forwardTape) {
+  groups_.clear();
+
+  std::vector<Chainable<Tensor>*> nodes;
+  std::unordered_map<Chainable<Tensor>*, size_t> steps;
+  nodes.reserve(forwardTape.size());
+  for(const auto& node : forwardTape) {
+    steps[node.get()] = nodes.size();
+    nodes.push_back(node.get());
+  }
+  size_t numSteps = nodes.size();
+
+  std::vector<size_t> tapeRefs(numSteps, 1); // [step] -> references from the tape
+  std::vector<Operation> operations(numSteps);
+  std::vector<int> widths(numSteps, 0);      // [step] -> vector width, 0 if not element-wise
+  for(size_t step = 0; step < numSteps; ++step) {
+    auto node = nodes[step];
+    for(auto& child : node->children()) {
+      auto it = steps.find(child.get());
+      if(it != steps.end())
+        tapeRefs[it->second]++;
+    }
+    if(operation(node, operations[step])) {
+      std::vector<Shape> shapes = {node->shape()};
+      for(auto& child : node->children())
+        shapes.push_back(child->shape());
+      widths[step] = cpu::elementWidth(shapes);
+    }
+  }
+
+  readSteps_.resize(numSteps);
+  std::iota(readSteps_.begin(), readSteps_.end(), 0);
+
+  // grow chains backwards from their last node
+  for(size_t root = numSteps; root-- > 0;) {
+    if(!widths[root] || isFused(root))
+      continue;
+
+    Group group;
+    auto& instructions = group.program.instructions;
+    std::vector<size_t> fused;
+    std::unordered_map<Chainable<Tensor>*, uint16_t> inputRegisters;
+
+    std::function<uint16_t(size_t)> emit = [&](size_t step) -> uint16_t {
+      std::vector<uint16_t> args;
+      for(auto& child : nodes[step]->children()) {
+        auto it = steps.find(child.get());
+        size_t c = it != steps.end() ? it->second : numSteps;
+        if(c < numSteps && widths[c] == widths[root] && !isFused(c)
+           && child->shape() == nodes[root]->shape()
+           && tapeRefs[c] == 2 && references(child.get()) == 2 // only read by this node
+           && !child->val() && !child->memoize() && !child->marked_for_debug()) {
+          readSteps_[c] = root;
+          fused.push_back(c);
+          args.push_back(emit(c));
+        } else {
+          auto input = inputRegisters.find(child.get());
+          if(input == inputRegisters.end()) {
+            input = inputRegisters.emplace(child.get(), (uint16_t)instructions.size()).first;
+            instructions.push_back({Op::Input, (uint16_t)group.inputs.size(), 0, 0.f});
+            group.inputs.push_back(child.get());
+          }
+          args.push_back(input->second);
+        }
+      }
+
+      const auto& operation = operations[step];
+      if(operation.op == Op::Tanh) { // tanh of the sum of all children
+        for(size_t i = 1; i < args.size(); ++i) {
+          instructions.push_back({Op::Add, args[0], args[i], 0.f});
+          args[0] = (uint16_t)(instructions.size() - 1);
+        }
+      }
+      instructions.push_back({operation.op, args[0], args.size() > 1 ? args[1] : (uint16_t)0, operation.scalar});
+      return (uint16_t)(instructions.size() - 1);
+    };
+    emit(root);
+
+    if(!fused.empty() && instructions.size() <= cpu::FusedElementProgram::MAX_INSTRUCTIONS)
+      groups_[root] = std::move(group);
+    else // nothing to fuse or too long, compute the nodes on their own
+      for(size_t step : fused)
+        readSteps_[step] = step;
+  }
+}
+
+void ElementwiseFusion::forward(const Group& group, Chainable<Tensor>* node) {
+  std::vector<Tensor> inputs;
+  inputs.reserve(group.inputs.size());
+  for(auto input : group.inputs) {
+    ABORT_IF(!input->val(), "De-allocated input {} {} of fused node {} {}",
+             input->getId(), input->type(), node->getId(), node->type());
+    inputs.push_back(input->val());
+  }
+  cpu::FusedElement(group.program, node->val(), inputs);
+}
+
+}  // namespace marian
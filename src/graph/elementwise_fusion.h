@@ -0,0 +1,50 @@
+#pragma once
+
+#include "tensors/cpu/fused_element.h"
+#include "graph/chainable.h"
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace marian {
+
+// Fuses chains of element-wise nodes of an inference tape, e.g. x * mask + bias or relu(x + b), into
+// single passes over memory on the CPU. A node is fused into its consumer if that is its only
+// reader, both have the same shape, and cpu::Element would process both with the same vector width,
+// so that the results do not change. Fused nodes are neither allocated nor computed, the last node
+// of a chain evaluates the whole chain with cpu::FusedElement.
+class ElementwiseFusion {
+public:
+  struct Group {
+    std::vector<Chainable<Tensor>*> inputs; // inputs of the chain, they outlive the fused nodes
+    cpu::FusedElementProgram program;
+  };
+
+private:
+  std::unordered_map<size_t, Group> groups_; // [step of the last node of a chain] -> chain
+  std::vector<size_t> readSteps_;            // [step] -> step at which the children of the node are read
+
+  struct Operation;
+  static bool operation(Chainable<Tensor>* node, Operation& op);
+
+public:
+  // Finds the chains of the tape, replacing those of an earlier tape
+  void analyze(const std::list<Expr>& forwardTape);
+
+  // true if the node at this step is computed by a later node of its chain
+  bool isFused(size_t step) const { return readSteps_[step] != step; }
+
+  // The chain that ends at this step, nullptr if the node at this step is computed on its own
+  const Group* group(size_t step) const {
+    auto it = groups_.find(step);
+    return it != groups_.end() ? &it->second : nullptr;
+  }
+
+  const std::vector<size_t>& readSteps() const { return readSteps_; }
+
+  // Computes the value of node, the last node of the chain
+  static void forward(const Group& group, Chainable<Tensor>* node);
+};
+
+}  // namespace marian
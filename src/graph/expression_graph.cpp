@@ -1,6 +1,16 @@
 #include "graph/expression_graph.h"
 #include "tensors/tensor_operators.h"
+#include "common/timer.h"
+#include "common/tracer.h"
+#include "graph/op_profiler.h"
+#include "3rd_party/mio/mio.hpp"
+#include "3rd_party/threadpool.h"
 
+#ifdef CUDA_FOUND
+#include "tensors/gpu/algorithm.h"
+#endif
+
+#include <cstring>
 #include <sstream>
 
 namespace marian {
@@ -23,6 +33,22 @@ void ExpressionGraph::setDevice(DeviceId deviceId, Ptr<Device> device) {
   }
 }
 
+void ExpressionGraph::setParameterOffloading(bool offload) {
+  if(!offload) {
+    offloader_.reset();
+    return;
+  }
+  ABORT_IF(!backend_ || backend_->getDeviceId().type != DeviceType::gpu,
+           "Parameter offloading is only supported for GPU graphs");
+  ABORT_IF(!inferenceOnly_, "Parameter offloading is only supported for inference");
+  for(auto& kvParams : paramsByElementType_) {
+    ABORT_IF(kvParams.second->size() > 0, "Parameters cannot be offloaded once they have been created");
+    kvParams.second->init(backend_, DispatchDevice(backend_->getDeviceId(), 256, /*managed=*/true));
+  }
+  offloader_.reset(new ParameterOffloader(backend_->getDeviceId()));
+  LOG(info, "[memory] Offloading the parameters of device {} to host memory", backend_->getDeviceId());
+}
+
 Expr ExpressionGraph::add(Expr node) {
   auto found = tensors_->findOrRemember(node);
   if(found) {
@@ -96,22 +122,170 @@ void ExpressionGraph::forwardNext() {
         top->getSubtape()->clear();
       }
     }
+
+    // Additional checkpoints split the subtapes, which are therefore created again
+    if(checkpointPolicy_) {
+      checkpointPolicy_->report(checkpointPolicy_->select(nodesBackward_));
+      for(auto& v : nodesForward_)
+        v->setSubtape(nullptr);
+      for(auto it = nodesBackward_.rbegin(); it != nodesBackward_.rend(); it++)
+        if((*it)->isCheckpoint())
+          createSubtape(*it);
+    }
   }
 
   forward(nodesForward_, /*finalPass=*/!checkpointing_); // if checkPointing, this is not final
 }
 
+// Places the outputs that are only referenced from within the tape, i.e. by the tape itself and as
+// children of later nodes, by a static memory plan. Outputs with other references, e.g. decoder
+// states or the result of the pass, may outlive the pass and are allocated as usual. Returns the
+// block that holds the planned outputs, it is freed after the pass. With element-wise fusion,
+// readSteps gives the step at which the children of a node are read.
+MemoryPiece::PtrType ExpressionGraph::planForward(const std::list<Expr>& forwardTape,
+                                                  const std::vector<size_t>* readSteps) {
+  typedef MemoryPlanner::Lifetime Lifetime;
+
+  std::vector<Chainable<Tensor>*> nodes;
+  std::unordered_map<Chainable<Tensor>*, size_t> steps;
+  nodes.reserve(forwardTape.size());
+  for(const auto& node : forwardTape) {
+    steps[node.get()] = nodes.size();
+    nodes.push_back(node.get());
+  }
+
+  std::vector<size_t> lastUse(nodes.size());   // [step] -> last step that reads the output
+  std::vector<size_t> tapeRefs(nodes.size(), 1); // [step] -> references from the tape
+  std::vector<Chainable<Tensor>*> read;
+  for(size_t step = 0; step < nodes.size(); ++step) {
+    lastUse[step] = step;
+    size_t reader = readSteps ? (*readSteps)[step] : step;
+    for(auto& child : nodes[step]->children()) {
+      auto it = steps.find(child.get());
+      if(it != steps.end())
+        tapeRefs[it->second]++;
+
+      // a view is read through to the memory of the viewed nodes, so they live as long
+      read.assign(1, child.get());
+      while(!read.empty()) {
+        auto node = read.back();
+        read.pop_back();
+        auto found = steps.find(node);
+        if(found != steps.end())
+          lastUse[found->second] = std::max(lastUse[found->second], reader);
+        if(!node->ownsMemory())
+          for(auto& viewed : node->children())
+            read.push_back(viewed.get());
+      }
+    }
+  }
+
+  auto allocator = tensors_->getAllocator();
+  std::vector<size_t> planned;
+  std::vector<Lifetime> lifetimes;
+  for(size_t step = 0; step < nodes.size(); ++step) {
+    auto node = nodes[step];
+    if(node->val() || !node->ownsMemory() || node->memoize() || references(node) != tapeRefs[step])
+      continue;
+    if(readSteps && (*readSteps)[step] != step) // fused, computed by a later node
+      continue;
+    size_t bytes = allocator->alignedSize(requiredBytes(node->shape(), node->value_type()));
+    if(bytes == 0)
+      continue;
+    planned.push_back(step);
+    // constants are initialized before the tape runs, see forward()
+    size_t begin = node->type() == "const" ? 0 : step;
+    lifetimes.push_back({begin, lastUse[step], bytes});
+  }
+
+  if(planned.empty())
+    return nullptr;
+
+  const auto& plan = memoryPlanner_->plan(lifetimes);
+  auto block = allocator->alloc(plan.bytes);
+  for(size_t i = 0; i < planned.size(); ++i) {
+    auto node = nodes[planned[i]];
+    auto memory = allocator->view(block, plan.offsets[i], lifetimes[i].bytes);
+    node->val() = TensorBase::New(memory, node->shape(), node->value_type(), backend_);
+  }
+  return block;
+}
+
 void ExpressionGraph::forward(std::list<Expr>& forwardTape, bool finalPass) {
-  while(!forwardTape.empty()) {
+  tracing::Span pass("graph", "forward");
+  MemoryPiece::PtrType plannedMemory;
+  const ElementwiseFusion* fusion = nullptr;
+  if(inferenceOnly_ && !checkpointing_) {
+    if(fuseElementwise_ && backend_->getDeviceId().type == DeviceType::cpu) {
+      fusion_->analyze(forwardTape);
+      fusion = fusion_.get();
+    }
+    if(planMemory_)
+      plannedMemory = planForward(forwardTape, fusion ? &fusion->readSteps() : nullptr);
+
+    // Initialize all constants before the first kernel. Their values are staged for asynchronous
+    // copies to a GPU, only values larger than the staging segments are copied synchronously and
+    // wait for all kernels queued before them, so that the device would run dry at every such
+    // constant while the host issues the rest of the pass.
+    for(auto& node : forwardTape) {
+      if(node->type() == "const") {
+        node->allocate();
+        node->init();
+      }
+    }
+  }
+
+  if(offloader_)
+    offloader_->beginPass(forwardTape);
+
+  for(size_t step = 0; !forwardTape.empty(); ++step) {
     auto v = forwardTape.front();
+    if(offloader_)
+      offloader_->beforeStep(step);
+
+    if(fusion && fusion->isFused(step)) { // computed with the last node of its chain
+      forwardTape.pop_front();
+      continue;
+    }
 
     v->allocate();
     v->init();
 
-    for(auto& child : v->children())
-      ABORT_IF(!child->val(), "De-allocated child {} {} of {} {}", child->getId(), child->type(), v->getId(), v->type());
+    tracing::Span span; // of this node, including its fused chain
+    if(tracing::Tracer::enabled())
+      span.begin("forward", v->type());
 
-    v->forward();
+    bool profileOp = OpProfiler::enabled();
+    std::chrono::steady_clock::time_point opStart;
+    if(profileOp) {
+      backend_->synchronize();
+      opStart = std::chrono::steady_clock::now();
+    }
+
+    auto group = fusion ? fusion->group(step) : nullptr;
+    if(group) {
+      ElementwiseFusion::forward(*group, v.get());
+    } else {
+      for(auto& child : v->children())
+        ABORT_IF(!child->val(), "De-allocated child {} {} of {} {}", child->getId(), child->type(), v->getId(), v->type());
+
+      if(timeRecompute_) {
+        backend_->synchronize();
+        timer::Timer timer;
+        v->forward();
+        backend_->synchronize();
+        checkpointPolicy_->record(v->type(), v->shape().elements(), timer.elapsed());
+      } else {
+        v->forward();
+      }
+    }
+    if(span.active() && tracing::Tracer::instance().sync())
+      backend_->synchronize();
+    if(profileOp) {
+      backend_->synchronize();
+      OpProfiler::instance().record(v.get(), /*backward=*/false,
+                                    std::chrono::duration<double>(std::chrono::steady_clock::now() - opStart).count());
+    }
 
     if(v->trainable() && throwNaN_) {
       bool isNaN = false, isInf = false;
@@ -154,6 +328,10 @@ void ExpressionGraph::forward(std::list<Expr>& forwardTape, bool finalPass) {
 
     forwardTape.pop_front();
   }
+
+  // all planned outputs have been released with the tape
+  if(plannedMemory)
+    tensors_->getAllocator()->free(plannedMemory);
 }
 
 void ExpressionGraph::backward(bool reset, float clipValue) {
@@ -184,6 +362,15 @@ void ExpressionGraph::backward(bool reset, float clipValue) {
 
   tensors_->clearShorttermMemory();
 
+  // number of backward steps that still add to the gradient of each parameter
+  std::unordered_map<Chainable<Tensor>*, size_t> pendingUses;
+  if(gradientReady_)
+    for(auto&& v : nodesBackward_)
+      for(auto&& child : v->children())
+        if(child->type() == "param" && child->trainable())
+          pendingUses[child.get()]++;
+
+  tracing::Span pass("graph", "backward");
   bool firstNaN = true;
   while(!nodesBackward_.empty()) {
     auto v = nodesBackward_.back();
@@ -194,7 +381,9 @@ void ExpressionGraph::backward(bool reset, float clipValue) {
         child->set_zero_adjoint();
 
     if(checkpointing_ && v->getSubtape()) {
+      timeRecompute_ = checkpointPolicy_ && checkpointPolicy_->timing();
       forward(*v->getSubtape(), /*finalPass=*/true);
+      timeRecompute_ = false;
     }
 
     if(v->trainable() && v->marked_for_debug()) {
@@ -207,9 +396,29 @@ void ExpressionGraph::backward(bool reset, float clipValue) {
       Element(_1 = clip(_1, clipValue), v->grad());
     }
 
-    if(v->trainable())
+    if(v->trainable()) {
+      tracing::Span span;
+      if(tracing::Tracer::enabled())
+        span.begin("backward", v->type());
+
+      bool profileOp = OpProfiler::enabled();
+      std::chrono::steady_clock::time_point opStart;
+      if(profileOp) {
+        backend_->synchronize();
+        opStart = std::chrono::steady_clock::now();
+      }
+
       v->backward();
 
+      if(span.active() && tracing::Tracer::instance().sync())
+        backend_->synchronize();
+      if(profileOp) {
+        backend_->synchronize();
+        OpProfiler::instance().record(v.get(), /*backward=*/true,
+                                      std::chrono::duration<double>(std::chrono::steady_clock::now() - opStart).count());
+      }
+    }
+
     if(throwNaN_ && firstNaN) {
       for(auto&& child : v->children()) {
         if(child->trainable()) {
@@ -227,8 +436,16 @@ void ExpressionGraph::backward(bool reset, float clipValue) {
       }
     }
 
+    if(gradientReady_)
+      for(auto&& child : v->children())
+        if(child->type() == "param" && child->trainable() && --pendingUses[child.get()] == 0)
+          gradientReady_(child);
+
     v->children().clear();
   }
+
+  if(checkpointing_ && checkpointPolicy_)
+    checkpointPolicy_->finishTimedPass();
 }
 
 Expr ExpressionGraph::dropoutMask(float prob, const Shape& shape, Type valueType) {
@@ -243,6 +460,113 @@ void ExpressionGraph::checkNaN(Tensor t, bool& isNaN, bool& isInf) {
   IsNaN(t, allocator(), isNaN, isInf);
 }
 
+// Loads an .npz model, or a .bin model onto a GPU, without reading the file into host memory first: it is
+// memory-mapped, and the parameters are copied from the mapping once they are allocated, in parallel on
+// the CPU and in large staged transfers to a GPU. Parameters that are converted to another type on
+// loading are read as usual.
+void ExpressionGraph::loadMapped(const std::string& name, bool markReloaded) {
+  LOG(info, "Loading model from {} (memory-mapped)", name);
+  auto mapping = New<mio::mmap_source>(name);
+  auto items = io::isNpz(name) ? io::mmapItemsNpz(mapping->data(), mapping->size()) : io::mmapItems(mapping->data());
+
+  setReloaded(false);
+  std::vector<io::Item> converted;
+  for(auto& item : items) {
+    if(item.name.substr(0, 8) == "special:")
+      continue;
+
+    auto loadElementType = getLoadElementType(item, /*copyMapped=*/true);
+    if(!item.mapped) {
+      converted.push_back(std::move(item));
+      continue;
+    } else if(loadElementType != item.type) {
+      io::Item copy = item;
+      copy.mapped = false;
+      copy.bytes.assign(item.ptr, item.ptr + item.size());
+      converted.push_back(std::move(copy));
+      continue;
+    } else if(shareParameters_ && loadShared(item)) {
+      continue;
+    }
+
+    const char* src = item.ptr;
+    size_t bytes = item.size();
+    Ptr<void> keepMapped = mapping;
+    param(item.name, item.shape, inits::fromLambda([this, src, bytes, keepMapped](Tensor tensor) {
+      mappedUploads_.push_back({tensor, src, bytes, keepMapped});
+    }), item.type, /*fixed=*/false);
+    uploadPending_ = true;
+  }
+  load(converted, /*markReloaded=*/false);
+  if(markReloaded)
+    setReloaded(true);
+}
+
+bool ExpressionGraph::loadShared(const io::Item& item) {
+  std::string name = namespace_.empty() ? item.name : namespace_ + "::" + item.name;
+  Expr p; Ptr<Parameters> params;
+  std::tie(p, params) = findParams(name, item.type, /*typeSpecified=*/true);
+  if(p || std::dynamic_pointer_cast<MappedParameters>(params)) // an existing parameter keeps its initializer
+    return false;
+
+  bool shared = false;
+  auto value = ParameterStore::instance().acquire(backend_, item, shared);
+  p = param(item.name, item.shape, inits::fromLambda([](Tensor) {}), item.type, /*fixed=*/false);
+  std::get<1>(findParams(name, item.type, /*typeSpecified=*/true))->share(p, value);
+  if(shared) {
+    sharedParams_++;
+    sharedBytes_ += item.size();
+  }
+  return true;
+}
+
+void ExpressionGraph::reportShared() {
+  if(sharedParams_ > 0)
+    LOG(info, "[memory] Sharing {} parameters ({:.1f} MB) with other models on device {}",
+        sharedParams_, sharedBytes_ / 1048576.0, backend_->getDeviceId());
+  sharedParams_ = 0;
+  sharedBytes_ = 0;
+}
+
+void ExpressionGraph::uploadMappedParams() {
+  uploadPending_ = false;
+  // the initializers of the mapped parameters only collect their copies, all others run as usual
+  for(auto kvParams : paramsByElementType_)
+    for(auto p : *kvParams.second)
+      p->init();
+
+  timer::Timer timer;
+  size_t bytes = 0;
+  for(const auto& upload : mappedUploads_) {
+    ABORT_IF(upload.bytes != upload.tensor->size() * sizeOf(upload.tensor->type()),
+             "Size of memory-mapped parameter does not match its tensor");
+    bytes += upload.bytes;
+  }
+
+  if(backend_->getDeviceId().type == DeviceType::cpu) {
+    // the pages of the file are read by several threads at the same time, each copies every n-th parameter
+    size_t numThreads = std::max(std::min((size_t)std::thread::hardware_concurrency(), mappedUploads_.size()), (size_t)1);
+    ThreadPool threadPool(numThreads - 1); // the calling thread copies as well
+    threadPool.parallelFor(numThreads, [this, numThreads](size_t begin, size_t end) {
+      for(size_t t = begin; t < end; ++t)
+        for(size_t i = t; i < mappedUploads_.size(); i += numThreads)
+          std::memcpy(mappedUploads_[i].tensor->memory()->data(), mappedUploads_[i].src, mappedUploads_[i].bytes);
+    });
+  } else {
+#ifdef CUDA_FOUND
+    std::vector<gpu::HostToDeviceCopy> copies;
+    for(const auto& upload : mappedUploads_)
+      copies.push_back({upload.src, upload.tensor->memory()->data(), upload.bytes});
+    gpu::copyToDeviceStaged(backend_, copies, /*chunkBytes=*/64 * 1024 * 1024);
+#else
+    ABORT("Memory-mapped parameters can only be copied to a GPU in builds with CUDA");
+#endif
+  }
+  LOG(info, "[memory] Copied {} parameters ({:.1f} MB) from the memory-mapped model in {:.2f}s",
+      mappedUploads_.size(), bytes / 1048576.0, timer.elapsed());
+  mappedUploads_.clear(); // unmaps the file
+}
+
 void ExpressionGraph::save(std::vector<io::Item>& ioItems, Type saveElementType) {
   // sorted by type in std::map
   for(auto kvParams : paramsByElementType_) {
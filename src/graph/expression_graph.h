@@ -7,11 +7,17 @@
 #include "tensors/tensor_allocator.h"
 
 #include "graph/chainable.h"
+#include "graph/checkpoint_policy.h"
+#include "graph/elementwise_fusion.h"
+#include "graph/memory_plan.h"
 #include "graph/node_initializers.h"
 #include "graph/node_operators.h"
+#include "graph/parameter_offloader.h"
 #include "graph/parameters.h"
 
+#include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace marian {
@@ -24,7 +30,9 @@ private:
   Ptr<TensorAllocator> tensors_;
   Ptr<TensorAllocator> cache_;
 
-  typedef std::unordered_map<size_t, std::vector<WExpr>> WeakMemory;
+  // Nodes of the graph under construction by hash, one map entry per node. The buckets are kept
+  // when the memory is cleared after each forward pass, so decoder steps do not rebuild them.
+  typedef std::unordered_multimap<size_t, WExpr> WeakMemory;
   typedef std::unordered_map<size_t, std::vector<Expr>> Memory;
 
   Ptr<WeakMemory> shortterm_;
@@ -45,6 +53,19 @@ public:
 
   void reserve(size_t bytes) { tensors_->reserve(bytes); }
 
+  // Computes in the workspace of other, but keeps the memoized nodes of this graph: their hashes
+  // are built from parameter names, which are the same in both graphs while the values may differ.
+  void shareWorkspace(const Tensors& other) { tensors_ = other.tensors_; }
+
+  // Replaces the workspace by a new one of exactly the given size. Only valid after clear(), as
+  // tensors in the old workspace become invalid.
+  void resetWorkspace(size_t bytes) {
+    auto limit = tensors_->allocator()->getLimit();
+    tensors_ = New<TensorAllocator>(tensors_->getBackend());
+    tensors_->allocator()->setLimit(limit);
+    tensors_->reserveExact(bytes);
+  }
+
   void throwAtReallocation(bool throwAtRealloc) {
     tensors_->throwAtReallocation(throwAtRealloc);
   }
@@ -72,11 +93,13 @@ public:
     size_t hash = node->hash();
     // memoize constant nodes that are not parameters
     // parameters are already memoized in the graph itself
-    if(node->type() != "param" && node->memoize()) {
+    if(node->memoize() && node->type() != "param") {
       auto it = longterm_->find(hash);
       if(it != longterm_->end()) {
         for(auto found : it->second) {
-          return found;
+          // keyed by hash, type and shape, as the hashes of most nodes do not include the shape
+          if(found->type() == node->type() && found->shape() == node->shape() && found->value_type() == node->value_type())
+            return found;
           // @TODO: check why below code does not work for certain nodes and
           // autotuning.
           // if(node->equal(found)) {
@@ -88,15 +111,11 @@ public:
       (*longterm_)[hash].push_back(node);
     }
 
-    auto it = shortterm_->find(hash);
-    if(it != shortterm_->end()) {
-      for(auto found : it->second) {
-        if(node->equal(found)) {
-          return found;
-        }
-      }
-    }
-    (*shortterm_)[hash].push_back(node.get()); // weakPtr
+    auto range = shortterm_->equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it)
+      if(node->equal(it->second))
+        return it->second;
+    shortterm_->emplace_hint(range.second, hash, node.get()); // weakPtr
     return nullptr;
   }
 
@@ -108,6 +127,22 @@ public:
   void clearShorttermMemory() { shortterm_->clear(); }
 
   void clearLongtermMemory() { longterm_->clear(); }
+
+  // Drops a memoized node from the long-term memory and releases its value, for users that keep a
+  // limited number of memoized values themselves. Does not descend into the children of the node.
+  void forget(Expr node) {
+    auto it = longterm_->find(node->hash());
+    if(it != longterm_->end()) {
+      auto& nodes = it->second;
+      nodes.erase(std::remove(nodes.begin(), nodes.end(), node), nodes.end());
+      if(nodes.empty())
+        longterm_->erase(it);
+    }
+    if(node->val()) {
+      cache_->free(node->val());
+      node->val() = nullptr;
+    }
+  }
 };
 
 typedef std::map<Type, Ptr<Parameters>> ElementTypeParamsMap; // keep it sorted, hence map not unordered map
@@ -132,12 +167,49 @@ private:
 
   bool inferenceOnly_{false};
 
+  bool float16Weights_{false}; // store the float32 weight matrices of a CPU graph as float16, see setFloat16Weights()
+
   bool checkpointing_{false}; // use gradient checkpointing if true
+  UPtr<CheckpointPolicy> checkpointPolicy_; // chooses checkpoints in addition to the manual ones if set
+  bool timeRecompute_{false};               // time the nodes of the current recomputation for checkpointPolicy_
 
   bool reloaded_{false};
 
   bool throwNaN_{false};
 
+  std::function<void(Expr)> gradientReady_; // see setGradientReadyCallback()
+
+  bool planMemory_{false}; // place the outputs of inference forward passes by a static memory plan
+  UPtr<MemoryPlanner> memoryPlanner_;
+
+  bool fuseElementwise_{false}; // fuse chains of element-wise nodes of inference forward passes on the CPU
+  UPtr<ElementwiseFusion> fusion_;
+
+  bool shareParameters_{false}; // see setParameterSharing()
+  size_t reservedWorkspace_{0}; // bytes of the workspace as reserved or reset, see trimWorkspace()
+  UPtr<ParameterOffloader> offloader_; // see setParameterOffloading()
+  size_t sharedParams_{0};      // parameters of the current load() that another graph already uses
+  size_t sharedBytes_{0};
+
+  bool loadShared(const io::Item& item);
+  void reportShared();
+
+  MemoryPiece::PtrType planForward(const std::list<Expr>& forwardTape, const std::vector<size_t>* readSteps);
+
+  // Parameters of a model loaded by loadMapped(). Their initializers only collect the copies from the
+  // memory-mapped file, which forward() runs together once the parameters are allocated.
+  struct MappedUpload {
+    Tensor tensor;
+    const char* src;
+    size_t bytes;
+    Ptr<void> mapping; // keeps the file mapped until the upload
+  };
+  std::vector<MappedUpload> mappedUploads_;
+  bool uploadPending_{false};
+
+  void loadMapped(const std::string& name, bool markReloaded);
+  void uploadMappedParams();
+
 protected:
   // Delete, copy and move constructors
   ExpressionGraph(const ExpressionGraph&) = delete;
@@ -177,9 +249,56 @@ public:
   void setInference(bool inference) { inferenceOnly_ = inference; }
   bool isInference() { return inferenceOnly_; }
 
+  // Loads the float32 weight matrices of a CPU inference graph as float16, which halves the memory the
+  // model takes and the bandwidth of the matrix products. The products convert panels of the weights
+  // to float32 right before multiplying them, see cpu::Prod().
+  void setFloat16Weights(bool float16Weights) {
+    ABORT_IF(float16Weights && (backend_->getDeviceId().type != DeviceType::cpu || !inferenceOnly_),
+             "float16 weights are only supported for CPU inference");
+    float16Weights_ = float16Weights;
+  }
+
   void setCheckpointing(bool checkpointing) { checkpointing_ = checkpointing; }
   bool isCheckpointing() { return checkpointing_; }
 
+  // With gradient checkpointing, keeps up to budgetMB of outputs that would otherwise be recomputed,
+  // chosen by their measured recomputation cost, see CheckpointPolicy. 0 keeps only the manual checkpoints.
+  void setCheckpointingBudget(size_t budgetMB) {
+    if(budgetMB > 0)
+      checkpointPolicy_.reset(new CheckpointPolicy(budgetMB * 1024 * 1024));
+    else
+      checkpointPolicy_.reset();
+  }
+
+  // Assigns the outputs of inference forward passes to fixed offsets of one workspace block, planned
+  // from their lifetimes on the tape and cached per tape, instead of allocating them node by node
+  void setMemoryPlanning(bool planMemory) {
+    planMemory_ = planMemory;
+    if(planMemory_ && !memoryPlanner_)
+      memoryPlanner_.reset(new MemoryPlanner());
+  }
+  bool isMemoryPlanning() { return planMemory_; }
+
+  // Computes chains of element-wise nodes of inference forward passes in single passes over memory
+  // where the results stay the same, see ElementwiseFusion. Only effective on the CPU.
+  void setElementwiseFusion(bool fuse) {
+    fuseElementwise_ = fuse;
+    if(fuseElementwise_ && !fusion_)
+      fusion_.reset(new ElementwiseFusion());
+  }
+  bool isElementwiseFusion() { return fuseElementwise_; }
+
+  // Loads parameters whose content equals that of a parameter already loaded by another graph on the
+  // same device as that one's value instead of an own copy, see ParameterStore. The values are copied
+  // once the parameters are trained.
+  void setParameterSharing(bool share) { shareParameters_ = share; }
+
+  // Keeps the parameters of a GPU graph in managed host memory and streams them to the GPU layer by
+  // layer during the forward passes, see ParameterOffloader, for models larger than the GPU memory.
+  // Inference only, to be called after setDevice() and before any parameter is created.
+  void setParameterOffloading(bool offload);
+  bool isParameterSharing() { return shareParameters_; }
+
   void switchParams(const std::string& newNamespace) {
     namespace_ = newNamespace;
   }
@@ -193,10 +312,33 @@ public:
   void reserveWorkspaceMB(size_t num) {
     size_t bytes = num * 1024 * 1024 - 1;
     tensors_->reserve(bytes);
+    reservedWorkspace_ = tensors_->getAllocator()->size();
+  }
+
+  // Replaces the workspace by one of exactly the given size, e.g. after measuring the required
+  // size with getWorkspaceHighWater(). Clears the graph.
+  void resetWorkspace(size_t bytes) {
+    clear();
+    tensors_->resetWorkspace(bytes);
+    reservedWorkspace_ = tensors_->getAllocator()->size();
+  }
+
+  // Limits the size to which the workspace grows on demand for larger batches, 0 for no limit
+  void setWorkspaceLimitMB(size_t num) { tensors_->getAllocator()->setLimit(num * 1024 * 1024); }
+
+  // Shrinks a workspace that has grown on demand back to its reserved size, so that with
+  // --gpu-memory-pool the other graphs on the GPU can use the memory. Clears the graph if it does.
+  void trimWorkspace() {
+    if(reservedWorkspace_ > 0 && tensors_->getAllocator()->size() > reservedWorkspace_)
+      resetWorkspace(reservedWorkspace_);
   }
 
+  // Workspace memory needed for the computations since the last resetWorkspaceHighWater()
+  size_t getWorkspaceHighWater() { return tensors_->getAllocator()->highWater(); }
+  void resetWorkspaceHighWater() { tensors_->getAllocator()->resetHighWater(); }
+
   void reuseWorkspace(Ptr<ExpressionGraph> graph) {
-    tensors_ = graph->tensors_;
+    tensors_->shareWorkspace(*graph->tensors_);
   }
 
   /**
@@ -228,6 +370,8 @@ public:
   void forward() {
     for(auto kvParams : paramsByElementType_)
       kvParams.second->allocateForward();
+    if(uploadPending_)
+      uploadMappedParams();
     forwardNext();
   }
 
@@ -236,6 +380,12 @@ public:
 
   void backward(bool reset = true, float clipValue = 0.f);
 
+  // Called during backward() with every parameter whose gradient is complete, i.e. once the backward
+  // steps of all nodes that use it have run. Parameters that no node uses are not reported. This lets
+  // the gradients of the last layers be communicated while the backward pass of the first is still
+  // running. nullptr to disable.
+  void setGradientReadyCallback(const std::function<void(Expr)>& gradientReady) { gradientReady_ = gradientReady; }
+
   std::string graphviz() {
     std::stringstream ss;
     ss << "digraph ExpressionGraph {" << std::endl;
@@ -275,7 +425,7 @@ private:
         p = params->get(name);
       }
     } else { // type has not been specified, so we take any type as long as the name matches
-      for(auto kvParams : paramsByElementType_) {
+      for(const auto& kvParams : paramsByElementType_) {
         p = kvParams.second->get(name);
         
         if(p) { // p has been found, return with matching params object
@@ -306,7 +456,10 @@ private:
     
     if(!params) { 
       params = New<Parameters>(elementType);
-      params->init(backend_);
+      if(offloader_)
+        params->init(backend_, DispatchDevice(backend_->getDeviceId(), 256, /*managed=*/true));
+      else
+        params->init(backend_);
       paramsByElementType_.insert({elementType, params});
     } else {
       if(p) {
@@ -441,6 +594,8 @@ public:
     return it->second;
   }
 
+  Type getDefaultElementType() const { return defaultElementType_; }
+
   void setDefaultElementType(Type defaultElementType) {
     ABORT_IF(!paramsByElementType_.empty() && defaultElementType != defaultElementType_, 
              "Parameter objects already exist, cannot change default type from {} to {}", 
@@ -471,6 +626,12 @@ public:
   // Returns the tensor allocator of the graph workspace, different from above as proper tensor objects are allocated
   Ptr<TensorAllocator> getTensorAllocator() { return tensors_->getTensorAllocator(); }
 
+  // Releases a memoized node which is not going to be used anymore, see Tensors::forget()
+  void forgetMemoized(Expr node) {
+    if(node && node->memoize() && node->type() != "param")
+      tensors_->forget(node);
+  }
+
   void clear() {
     // clear everything apart from parameters and memoized nodes
     count_ = 0;
@@ -487,6 +648,19 @@ public:
   void setThrowNaN(bool throwNaN) { throwNaN_ = throwNaN; }
   bool getThrowNaN() { return throwNaN_; }
 
+  // if during loading the loaded type is of the same type class as the default element type, allow conversion;
+  // otherwise keep the loaded type. This is used when e.g. loading a float32 model as a float16 model as both
+  // have type class TypeClass::float_type. With float16 weights, weight matrices named like "W", "Wemb" or
+  // "decoder_ff_logit_out_W" are loaded as float16, unless they are memory-mapped and cannot be copied.
+  Type getLoadElementType(const io::Item& item, bool copyMapped = false) const {
+    if(float16Weights_ && item.type == Type::float32 && (!item.mapped || copyMapped) && item.shape.size() == 2) {
+      auto pos = item.name.rfind('_');
+      if(item.name[pos == std::string::npos ? 0 : pos + 1] == 'W')
+        return Type::float16;
+    }
+    return isSameTypeClass(item.type, defaultElementType_) ? defaultElementType_ : item.type;
+  }
+
 public:
   // loading from array of io::Items
   void load(std::vector<io::Item>& ioItems, bool markReloaded = true) {
@@ -496,18 +670,29 @@ public:
       // skip over special parameters starting with "special:"
       if(pName.substr(0, 8) == "special:")
         continue;
+
+      // bfloat16 is a storage type, parameters are converted to the default element type on loading
+      if(item.type == Type::bfloat16) {
+        ABORT_IF(item.mapped, "Parameter {} of type bfloat16 cannot be memory-mapped", pName);
+        item.convert(isFloat(defaultElementType_) ? defaultElementType_ : Type::float32);
+      }
       
-      // if during loading the loaded type is of the same type class as the default element type, allow conversion;
-      // otherwise keep the loaded type. This is used when e.g. loading a float32 model as a float16 model as both
-      // have type class TypeClass::float_type.
-      auto loadElementType = isSameTypeClass(item.type, defaultElementType_) ? defaultElementType_ : item.type;
+      auto loadElementType = getLoadElementType(item);
+      if(shareParameters_ && !item.mapped && loadElementType == item.type && loadShared(item))
+        continue;
       param(pName, item.shape, inits::fromItem(item), loadElementType, /*fixed=*/false);
     }
+    reportShared();
     if(markReloaded)
       setReloaded(true);
   }
 
   void load(const std::string& name, bool markReloaded = true) {
+    bool gpu = backend_->getDeviceId().type == DeviceType::gpu;
+    if(io::isNpz(name) || (gpu && io::isBin(name))) {
+      loadMapped(name, markReloaded);
+      return;
+    }
     LOG(info, "Loading model from {}", name);
     auto items = io::loadItems(name);
     load(items, markReloaded);
@@ -7,8 +7,10 @@
 #include "graph/node_operators_tuple.h"
 
 #include "graph/auto_tuner.h"
+#include "tensors/cpu/block_sparse.h"
 #include "tensors/cpu/intgemm_interface.h"
 #include "tensors/cpu/fbgemm/expanded_gemm.h"
+#include "tensors/gpu/int8_interface.h"
 
 #if USE_FBGEMM
 #include "fbgemm/Utils.h"
@@ -352,8 +354,17 @@ Expr gather(Expr a, int axis, Expr indices) {
 // This function has the same semantics as PyTorch operation of the same name.
 Expr index_select(Expr a, int axis, Expr indices) {
   ABORT_IF(indices->shape().size() != 1, "Indices must be a 1D tensor");
+  ABORT_IF(isPacked(a->value_type()) || isIntgemm(a->value_type()),
+           "Cannot select from {} matrix {}, e.g. to look up embeddings. Convert the model without packing it: marian-conv --gemm-pack '!{}'",
+           a->value_type(), a->name(), a->name());
   // We have specialized kernels for non-batched indexing of first or last axis of a 2D tensor.
   auto rank = a->shape().size();
+  ABORT_IF(isRowQuantized(a->value_type()) && (rank != 2 || (axis != 0 && axis != -2)),
+           "Only rows can be selected from the quantized matrix {}", a->name());
+  if(isColQuantized(a->value_type())) { // the shortlist of an untransposed output layer
+    ABORT_IF(rank != 2 || (axis != 1 && axis != -1), "Only columns can be selected from the int8 matrix {}", a->name());
+    return gpu::int8::selectColumnsB(a, indices);
+  }
   if (rank == 2) {
     if (axis == 0 || axis == -2)
       return Expression<RowsNodeOp>(a, indices);
@@ -369,6 +380,9 @@ Expr index_select(Expr a, int axis, Expr indices) {
 }
 
 Expr index_select(Expr a, int axis, const std::vector<IndexType>& indices) {
+  // columns of a packed intgemm matrix, e.g. the shortlist of the output layer, are selected in packed form
+  if(isIntgemm(a->value_type()))
+    return cpu::integer::selectColumnsB(a, axis, indices);
   auto indexExpr = a->graph()->indices(indices);
   return index_select(a, axis, indexExpr);
 }
@@ -411,6 +425,12 @@ Expr sum(Expr a, int ax) {
   return Expression<ReduceNodeOp>(a, ax, ReduceNodeOpCode::sum);
 }
 
+Expr cumsum(Expr a, int ax) {
+  if(a->shape()[ax] == 1) // nothing to accumulate
+    return a;
+  return Expression<CumSumNodeOp>(a, ax);
+}
+
 Expr mean(Expr a, int ax) {
   if(a->shape()[ax] == 1) // nothing to reduce, mean of itself is a
     return a;
@@ -464,6 +484,32 @@ Expr weighted_average(Expr in, Expr weights, int ax) {
   return p / s;
 }
 
+// a * b (+ bias) with the block-CSR form of the parameter b that marian-conv --block-sparse saved next
+// to it, see tensors/cpu/block_sparse.h, or nullptr if there is none
+static Expr blockSparseAffine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+  auto graph = a->graph();
+  if(transB || b->type() != "param" || !graph->isInference() || a->value_type() != Type::float32)
+    return nullptr;
+  auto packed = graph->get(cpu::blocksparse::packedName(b->name()), Type::float32);
+  if(!packed)
+    return nullptr;
+  if(transA)
+    a = transpose(a);
+  ABORT_IF(a->shape()[-1] != b->shape()[0],
+           "Matrix product requires inner dimensions to match in {} * {}", a->shape(), b->shape());
+
+  Shape outShape = a->shape();
+  outShape.set(-1, b->shape()[-1]);
+  auto nodeOp = [scale](Expr out, const std::vector<Expr>& children) {
+    Tensor biasVal = children.size() > 2 ? children[2]->val() : nullptr;
+    cpu::blocksparse::prod(out->val(), children[0]->val(), children[1]->val(), biasVal, scale);
+  };
+  std::vector<Expr> children = {a, packed};
+  if(bias)
+    children.push_back(bias);
+  return lambda(children, outShape, Type::float32, nodeOp);
+}
+
 Expr dot(Expr a, Expr b, bool transA, bool transB, float scale) {
   auto device = a->graph()->getDeviceId().type;
   // added support for packed GEMM API (fp16, int8)
@@ -474,6 +520,8 @@ Expr dot(Expr a, Expr b, bool transA, bool transB, float scale) {
   // --optimize --cpu-thread=N with N > 0 are set.
   if(device == DeviceType::cpu) {
     if(isFloat(aElementType) && isFloat(bElementType)) {
+      if(auto sparse = blockSparseAffine(a, b, nullptr, transA, transB, scale))
+        return sparse;
       return Expression<DotNodeOp>(a, b, transA, transB, scale);
     } else if(isFloat(aElementType) && isIntgemm(bElementType)) {
       return cpu::integer::affineOrDot(a, b, nullptr, transA, transB, scale);
@@ -501,6 +549,8 @@ Expr dot(Expr a, Expr b, bool transA, bool transB, float scale) {
     } else {
       ABORT("Combination of types A: {} B: {} not supported", aElementType, bElementType);
     }
+  } else if(isFloat(aElementType) && isColQuantized(bElementType)) {
+    return gpu::int8::affineOrDot(a, b, nullptr, transA, transB, scale);
   } else {
     return Expression<DotNodeOp>(a, b, transA, transB, scale);
   }
@@ -510,6 +560,18 @@ Expr bdot(Expr a, Expr b, bool transA, bool transB, float scale) {
   return Expression<DotBatchedNodeOp>(a, b, transA, transB, scale);
 }
 
+Expr bdotInt8(Expr a, Expr b, bool transA, bool transB, float scale) {
+  ABORT_IF(a->graph()->getDeviceId().type != DeviceType::cpu, "8-bit batched matrix products are only implemented for the CPU");
+  return cpu::integer::bdotInt8(a, b, transA, transB, scale);
+}
+
+Expr fusedAttention(Expr q, Expr k, Expr v, Expr mask, float scale) {
+  std::vector<Expr> nodes = {q, k, v};
+  if(mask)
+    nodes.push_back(mask);
+  return Expression<FusedAttentionNodeOp>(nodes, scale);
+}
+
 static Expr affineDefault(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
   // general version, MKL, CBlas or CUDA
 
@@ -532,6 +594,8 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
 
   if(device == DeviceType::cpu) {
     if(isFloat(aElementType) && isFloat(bElementType)) {
+      if(auto sparse = blockSparseAffine(a, b, bias, transA, transB, scale))
+        return sparse;
       return affineDefault(a, b, bias, transA, transB, scale);
     } else if(isFloat(aElementType) && isIntgemm(bElementType)) {
       return cpu::integer::affineOrDot(a, b, bias, transA, transB, scale);
@@ -560,6 +624,8 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
     } else {
       ABORT("Combination of types A: {} B: {} not supported", aElementType, bElementType);
     }
+  } else if(isFloat(aElementType) && isColQuantized(bElementType)) {
+    return gpu::int8::affineOrDot(a, b, bias, transA, transB, scale);
   } else {
     // Default GEMM
     ABORT_IF(!isFloat(aElementType) || !isFloat(bElementType), 
@@ -569,6 +635,21 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
   }
 }
 
+Expr affineWithRelu(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+  auto graph = a->graph();
+
+  if(isColQuantized(b->value_type())) {
+    return gpu::int8::affineOrDot(a, b, bias, transA, transB, scale, /*relu=*/true);
+  } else if(graph->isInference() && graph->getDeviceId().type == DeviceType::gpu) {
+    int rows = a->shape().elements() / a->shape()[-1];
+    Expr ones = graph->ones({ rows, 1 });
+    std::vector<Expr> nodes = { a, b, bias, ones };
+    return Expression<AffineWithReluNodeOp>(nodes, transA, transB, scale);
+  } else {
+    return relu(affine(a, b, bias, transA, transB, scale));
+  }
+}
+
 // multiply a CSR matrix A with a matrix B
 // A[i,j] is at A_values[A_offsets[i]+k], where k is position of j in A_indices[A_offsets[i]:A_offsets[i+1]]
 // @TODO: Define a proper sparse tensor type.
@@ -641,6 +722,11 @@ Expr cross_entropy(Expr logits, Expr indices, float labelSmoothingAlpha, Type ou
   return Expression<CrossEntropyNodeOp>(logits, indices, labelSmoothingAlpha, outputType);
 }
 
+Expr affine_cross_entropy(Expr x, Expr W, Expr b, Expr indices, bool transB, float labelSmoothingAlpha, int chunkRows, int chunkVocab) {
+  std::vector<Expr> nodes = b ? std::vector<Expr>({x, W, b, indices}) : std::vector<Expr>({x, W, indices});
+  return Expression<AffineCrossEntropyNodeOp>(nodes, transB, labelSmoothingAlpha, chunkRows, chunkVocab);
+}
+
 // Unlikelihood loss based on https://arxiv.org/abs/1908.04319
 Expr unlikelihood(Expr logits, Expr indices) {
   int dimBatch = logits->shape()[-2];
@@ -709,11 +795,49 @@ Expr layerNorm(Expr x,
   return Expression<LayerNormalizationOp>(nodes, eps);
 }
 
+Expr dropout(Expr x, float dropProb, Shape shape) {
+  if(dropProb == 0)
+    return x;
+  return Expression<DropoutNodeOp>(x, dropProb, shape);
+}
+
+Expr residualLayerNorm(Expr x,
+                       Expr mask,
+                       Expr residual,
+                       Expr gamma,
+                       Expr beta /*= nullptr*/,
+                       float eps /*= 1e-9*/) {
+  // the fused kernel does not broadcast the residual or the mask
+  if(residual->shape() != x->shape() || (mask && mask->shape() != x->shape()))
+    return layerNorm(dropout(x, mask) + residual, gamma, beta, eps);
+
+  std::vector<Expr> nodes = {x, residual, gamma};
+  if(beta)
+    nodes.push_back(beta);
+  if(mask)
+    nodes.push_back(mask);
+  return Expression<ResidualLayerNormalizationOp>(nodes, (bool)beta, (bool)mask, eps);
+}
+
 Expr highway(Expr y, Expr x, Expr t) {
   std::vector<Expr> nodes = {y, x, t};
   return Expression<HighwayNodeOp>(nodes);
 }
 
+Expr ssruCell(Expr cellState, Expr x, Expr f, Expr mask) {
+  std::vector<Expr> nodes = {cellState, x, f};
+  if(mask)
+    nodes.push_back(mask);
+  return Expression<SSRUCellNodeOp>(nodes);
+}
+
+Expr ssruScan(Expr cellState, Expr x, Expr f, Expr mask, bool reverse) {
+  std::vector<Expr> nodes = {x, f, cellState};
+  if(mask)
+    nodes.push_back(mask);
+  return Expression<SSRUScanNodeOp>(nodes, reverse);
+}
+
 Expr highway(const std::string prefix, Expr x) {
   // clang-format off
   size_t outDim = x->shape()[-1];
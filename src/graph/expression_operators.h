@@ -142,6 +142,18 @@ Expr bdot(Expr a,
           bool transB = false,
           float scalar = 1.f);
 
+// bdot() of float activations that are quantized to 8 bits at runtime, CPU inference only
+Expr bdotInt8(Expr a,
+              Expr b,
+              bool transA = false,
+              bool transB = false,
+              float scalar = 1.f);
+
+// softmax(bdot(q, k, false, true, scale) + mask) * v in a single node that never materializes the
+// attention weights, k and v are broadcast over the batch of q as in bdot(), the additive mask may
+// be nullptr
+Expr fusedAttention(Expr q, Expr k, Expr v, Expr mask, float scale);
+
 Expr affine(Expr a,
             Expr b,
             Expr c,
@@ -149,6 +161,14 @@ Expr affine(Expr a,
             bool transB = false,
             float scalar = 1.f);
 
+// relu(affine(a, b, c)), fused into a single cuBLASLt product for inference on the GPU
+Expr affineWithRelu(Expr a,
+                    Expr b,
+                    Expr c,
+                    bool transA = false,
+                    bool transB = false,
+                    float scalar = 1.f);
+
 Expr csr_dot(const Shape& A_shape, Expr Avalues, Expr Aindices, Expr Aoffsets, Expr B, bool transA = false);
 Expr dot_csr(Expr A, const Shape& B_shape, Expr B_values, Expr B_indices, Expr B_offsets, bool transB = false);
 
@@ -256,6 +276,9 @@ Expr min(Expr a, int ax);
 Expr prod(Expr a, int ax);
 Expr logsumexp(Expr a, int ax);
 
+// cumulative sum along axis ax, i.e. the sum of the elements up to and including each position
+Expr cumsum(Expr a, int ax = 0);
+
 Expr softmax(Expr x, int axis = -1);
 
 // @TODO: maybe get rid of this entirely to not obfuscate, what's going on inside.
@@ -266,6 +289,11 @@ Expr logsoftmax(Expr a);
 
 Expr cross_entropy(Expr a, Expr b, float labelSmoothingAlpha = 0.f, Type outputType = Type::float32);
 
+// cross_entropy(affine(x, W, b, false, transB), indices, labelSmoothingAlpha) in float32, computing the
+// logits for chunkRows rows (0 for all) and, if transB, chunkVocab words (0 for all) at a time so that they
+// are never held for all rows and words; b may be null
+Expr affine_cross_entropy(Expr x, Expr W, Expr b, Expr indices, bool transB, float labelSmoothingAlpha, int chunkRows, int chunkVocab = 0);
+
 Expr unlikelihood(Expr a, Expr b);
 
 Expr scalar_product(Expr a, Expr b, int ax = 0);
@@ -277,9 +305,21 @@ Expr square(Expr a);
 
 Expr layerNorm(Expr x, Expr gamma, Expr beta = nullptr, float eps = 1e-9);
 
+// layerNorm(x * mask + residual, gamma, beta, eps) in a single pass, mask is a dropout mask or nullptr
+Expr residualLayerNorm(Expr x, Expr mask, Expr residual, Expr gamma, Expr beta = nullptr, float eps = 1e-9);
+
 Expr highway(Expr y, Expr x, Expr t);
 Expr highway(const std::string prefix, Expr x);
 
+// One step of the SSRU recurrence, mask * (sigmoid(f) * cellState + (1 - sigmoid(f)) * x) as a
+// single node, mask may be nullptr
+Expr ssruCell(Expr cellState, Expr x, Expr f, Expr mask = nullptr);
+
+// The cell states of all time steps (axis -3) of the SSRU recurrence, i.e. ssruCell() applied to
+// the steps of x, f and mask in order, or in reverse order, starting from cellState, in a single
+// scan. x and f are [..., dimTime, dimBatch, dimState], the mask [..., dimTime, dimBatch, 1].
+Expr ssruScan(Expr cellState, Expr x, Expr f, Expr mask = nullptr, bool reverse = false);
+
 static inline Expr dropout(Expr x, Expr mask) {
   if (mask)
     return x * mask;
@@ -287,13 +327,9 @@ static inline Expr dropout(Expr x, Expr mask) {
     return x;
 }
 
-static inline Expr dropout(Expr x, float dropProb, Shape shape) {
-  if(dropProb == 0)
-    return x;
-  auto graph = x->graph();
-  auto mask = graph->dropoutMask(dropProb, shape);
-  return dropout(x, mask);
-}
+// Dropout with a mask of the given shape, which broadcasts to the shape of x. The mask is computed on
+// the fly in the forward and the backward step instead of being stored, see DropoutNodeOp.
+Expr dropout(Expr x, float dropProb, Shape shape);
 
 static inline Expr dropout(Expr x, float dropProb) {
   if(dropProb == 0)
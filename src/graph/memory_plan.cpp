@@ -0,0 +1,73 @@
+#include "graph/memory_plan.h"
+
+#include "common/hash.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace marian {
+
+size_t MemoryPlanner::hash(const std::vector<Lifetime>& lifetimes) {
+  size_t seed = lifetimes.size();
+  for(const auto& lifetime : lifetimes) {
+    util::hash_combine(seed, lifetime.begin);
+    util::hash_combine(seed, lifetime.end);
+    util::hash_combine(seed, lifetime.bytes);
+  }
+  return seed;
+}
+
+void MemoryPlanner::place(Plan& plan) {
+  const auto& lifetimes = plan.lifetimes;
+  size_t num = lifetimes.size();
+
+  std::vector<size_t> order(num);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return lifetimes[a].bytes > lifetimes[b].bytes;
+  });
+
+  plan.offsets.assign(num, 0);
+  plan.bytes = 0;
+
+  std::vector<size_t> placed;
+  std::vector<std::pair<size_t, size_t>> used; // [begin, end) of placed outputs that overlap in time
+  for(size_t i : order) {
+    const auto& lifetime = lifetimes[i];
+
+    used.clear();
+    for(size_t j : placed)
+      if(lifetimes[j].begin <= lifetime.end && lifetime.begin <= lifetimes[j].end)
+        used.push_back({plan.offsets[j], plan.offsets[j] + lifetimes[j].bytes});
+    std::sort(used.begin(), used.end());
+
+    // lowest offset where the output fits between the used ranges
+    size_t offset = 0;
+    for(const auto& range : used) {
+      if(range.first >= offset + lifetime.bytes)
+        break;
+      offset = std::max(offset, range.second);
+    }
+
+    plan.offsets[i] = offset;
+    plan.bytes = std::max(plan.bytes, offset + lifetime.bytes);
+    placed.push_back(i);
+  }
+}
+
+const MemoryPlanner::Plan& MemoryPlanner::plan(const std::vector<Lifetime>& lifetimes) {
+  size_t key = hash(lifetimes);
+  auto it = plans_.find(key);
+  if(it != plans_.end() && it->second.lifetimes == lifetimes)
+    return it->second;
+
+  if(plans_.size() >= maxPlans_) // many different shapes, start over
+    plans_.clear();
+
+  Plan& plan = plans_[key]; // replaces a plan with colliding hash
+  plan.lifetimes = lifetimes;
+  place(plan);
+  return plan;
+}
+
+}  // namespace marian
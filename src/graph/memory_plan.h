@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace marian {
+
+// Static memory plan for the outputs of an inference forward pass. An output is live from the step
+// of the tape that computes it up to the last step that reads it, outputs with disjoint lifetimes
+// may share memory. The plan places all outputs at fixed offsets of a single block, largest output
+// first at the lowest offset that is not used by an output that is live at the same time. A plan
+// only depends on lifetimes and sizes, so it is cached for tapes that repeat, e.g. decoder steps.
+class MemoryPlanner {
+public:
+  struct Lifetime {
+    size_t begin; // step that computes the output
+    size_t end;   // last step that reads the output, >= begin
+    size_t bytes; // aligned size of the output
+
+    bool operator==(const Lifetime& other) const {
+      return begin == other.begin && end == other.end && bytes == other.bytes;
+    }
+  };
+
+  struct Plan {
+    std::vector<Lifetime> lifetimes; // the lifetimes the plan was made for
+    std::vector<size_t> offsets;     // [output] -> byte offset inside of the block
+    size_t bytes{0};                 // size of the block
+  };
+
+private:
+  std::unordered_map<size_t, Plan> plans_; // [hash of lifetimes] -> plan
+  size_t maxPlans_;
+
+  static size_t hash(const std::vector<Lifetime>& lifetimes);
+  static void place(Plan& plan);
+
+public:
+  MemoryPlanner(size_t maxPlans = 1024) : maxPlans_(maxPlans) {}
+
+  // Returns the plan for the given lifetimes, the reference is valid until the next call
+  const Plan& plan(const std::vector<Lifetime>& lifetimes);
+
+  size_t size() const { return plans_.size(); }
+  void clear() { plans_.clear(); }
+};
+
+}  // namespace marian
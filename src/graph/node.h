@@ -5,6 +5,7 @@
 #include <thread>
 
 #include "common/hash.h"
+#include "common/object_pool.h"
 #include "tensors/backend.h"
 #include "tensors/tensor.h"
 
@@ -47,6 +48,8 @@ protected:
   bool recorderStop_;
 
 public:
+  ENABLE_POOLED_NEW
+
   Node(Ptr<ExpressionGraph> graph, const Shape& shape, const Type& valueType = Type::float32)
     : graph_(graph), shape_(shape), valueType_(valueType) {}
 
@@ -82,6 +85,8 @@ public:
   virtual bool memoize() override { return memoize_; };
   virtual void setMemoize(bool memoize) override { memoize_ = memoize; };
 
+  virtual bool ownsMemory() override { return destroy_; }
+
   virtual void setId(size_t id) override { id_ = id; }
 
   virtual size_t getId() override { return id_; }
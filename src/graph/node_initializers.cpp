@@ -62,8 +62,23 @@ Ptr<NodeInitializer> fromLambda(std::function<void(Tensor)>&& func, Type interme
   return New<LambdaInitConvert>(std::move(func), intermediateType);
 }
 
+// content hash of an initializer of the given kind and arguments, never 0
+template <typename... Args>
+static size_t contentHash(const std::string& kind, Args... args) {
+  size_t seed = util::hash<std::string>()(kind);
+  int unpack[] = {0, (util::hash_combine(seed, args), 0)...};
+  (void)unpack;
+  return seed ? seed : 1;
+}
+
+template <typename... Args>
+static Ptr<NodeInitializer> withContentHash(Ptr<NodeInitializer> init, const std::string& kind, Args... args) {
+  init->setContentHash(contentHash(kind, args...));
+  return init;
+}
+
 Ptr<NodeInitializer> fromValue(float v) {
-  return fromLambda([v](Tensor t){ t->set(v); });
+  return withContentHash(fromLambda([v](Tensor t){ t->set(v); }), "fromValue", v);
 }
 
 // diagonal matrix with value val along diagonal
@@ -81,7 +96,7 @@ Ptr<NodeInitializer> eye(float val) {
     t->set(vec);
   };
 
-  return fromLambda(eyeLambda, Type::float32);
+  return withContentHash(fromLambda(eyeLambda, Type::float32), "eye", val);
 }
 
 Ptr<NodeInitializer> uniform(float a, float b) {
@@ -213,7 +228,7 @@ Ptr<NodeInitializer> fromTensor(Tensor externalTensor) {
 
 // Computes Google's sinusoidal position embeddings
 Ptr<NodeInitializer> sinusoidalPositionEmbeddings(int start) {
-  return fromLambda([start](Tensor t) {
+  return withContentHash(fromLambda([start](Tensor t) {
     int dimEmb   = t->shape()[-1];
     int dimWords = (int)t->size() / dimEmb;
 
@@ -230,20 +245,25 @@ Ptr<NodeInitializer> sinusoidalPositionEmbeddings(int start) {
     }
 
     t->set(vPos);
-  }, Type::float32);
+  }, Type::float32), "sinusoidalPositionEmbeddings", start);
 }
 
+// the values of range() as hashed, float16 has no std::hash and converts to float without loss
+template <typename T>
+static T hashedValue(T v) { return v; }
+static float hashedValue(float16 v) { return (float)v; }
+
 // computes the equivalent of Python's range()
 template <typename T>
 Ptr<NodeInitializer> range(T begin, T end, T step) {
-  return fromLambda([begin, end, step](Tensor t) {
+  return withContentHash(fromLambda([begin, end, step](Tensor t) {
     auto nElem = t->shape().elements();
     std::vector<T> v; v.reserve(nElem);
     for (T i = begin; i < end; i += step)
       v.push_back(i);
     ABORT_IF(nElem != v.size(), "range does not match constant shape");
     t->set(v);
-  }, typeId<T>());
+  }, typeId<T>()), "range", (int)typeId<T>(), hashedValue(begin), hashedValue(end), hashedValue(step));
 }
 
 template Ptr<NodeInitializer> range<float16>  (float16   begin, float16   end, float16   step);
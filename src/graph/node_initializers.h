@@ -27,10 +27,18 @@ namespace inits {
 class NodeInitializer {
 protected:
   Weak<Allocator> allocator_;
+  size_t contentHash_{0};
 
 public:
   virtual void apply(Tensor t) = 0;
   void setAllocator(Ptr<Allocator> allocator) { allocator_ = allocator; }
+
+  // Identifies the values the initializer produces for a given shape and type, 0 if they are not
+  // known from its arguments. During inference, constants with a content hash are memoized across
+  // graph builds like parameters, see ConstantNode. Do not set it for values that come from data.
+  size_t getContentHash() const { return contentHash_; }
+  void setContentHash(size_t contentHash) { contentHash_ = contentHash; }
+
   virtual ~NodeInitializer() {}
 };
 
@@ -11,9 +11,16 @@ ConstantNode::ConstantNode(Ptr<ExpressionGraph> graph,
                           Type valueType)
     : Node(graph, shape, valueType),
       init_(init),
-      initialized_(false) {
+      initialized_(false),
+      contentHash_(init->getContentHash()) {
   init_->setAllocator(graph->allocator());
   setTrainable(false);
+  // kept across graph builds like parameters, and so are the nodes computed from them only, e.g.
+  // position embeddings or masks of common lengths
+  if(contentHash_ && graph->isInference() && (size_t)shape.elements() <= MAX_MEMOIZED_ELEMENTS)
+    setMemoize(true);
+  else
+    contentHash_ = 0;
 }
 
 void ConstantNode::allocate() {
@@ -23,17 +23,34 @@ struct ConstantNode : public Node {
 
   const std::string color() override { return "white"; }
 
+  // constants of known content are the same node if they have the same shape and type, see
+  // inits::NodeInitializer::getContentHash(), all others are unique
   virtual size_t hash() override {
-    size_t seed = util::hash<size_t>()((size_t)this);
+    if(!contentHash_)
+      return util::hash<size_t>()((size_t)this);
+    size_t seed = contentHash_;
+    util::hash_combine(seed, type());
+    util::hash_combine(seed, (size_t)value_type());
+    util::hash_combine(seed, shape().hash());
     return seed;
   }
 
-  virtual bool equal(Expr node) override { return this == node.get(); }
+  virtual bool equal(Expr node) override {
+    if(this == node.get())
+      return true;
+    auto cnode = std::dynamic_pointer_cast<ConstantNode>(node);
+    return cnode && contentHash_ && contentHash_ == cnode->contentHash_
+           && shape() == cnode->shape() && value_type() == cnode->value_type();
+  }
   virtual void record(Ptr<AutoTunerRecorder>, size_t, bool) override{};
 
 private:
+  // constants of known content with at most this many elements are memoized during inference
+  static const size_t MAX_MEMOIZED_ELEMENTS = 1 << 16;
+
   Ptr<inits::NodeInitializer> init_;
   bool initialized_;
+  size_t contentHash_;
 };
 
 struct ParamNode : public Node {
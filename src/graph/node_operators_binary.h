@@ -7,6 +7,10 @@
 #include "graph/node.h"
 #include "tensors/tensor_operators.h"
 
+#ifdef CUDA_FOUND
+#include "tensors/gpu/prod.h"
+#endif
+
 #ifdef CUDNN
 #include "tensors/gpu/cudnn_wrappers.h"
 #endif
@@ -213,7 +217,7 @@ public:
 };
 
 class AffineNodeOp : public NaryNodeOp {
-private:
+protected:
   friend class SerializationHelpers;
   bool transA_;
   bool transB_;
@@ -249,11 +253,23 @@ public:
     return outShape;
   }
 
+  // On the GPU cuBLASLt adds the bias, and optionally a ReLU, in the epilogue of the product instead
+  // of a second product with the ones vector. Returns false if this has not been done.
+  bool forwardFused(bool relu) {
+#ifdef CUDA_FOUND
+    if(val_->getBackend()->getDeviceId().type == DeviceType::gpu)
+      return gpu::ProdWithBias(val_, child(0)->val(), child(1)->val(), child(2)->val(), transA_, transB_, scalar_, relu);
+#endif
+    relu; // fool warnings
+    return false;
+  }
+
   NodeOps forwardOps() override {
     using namespace functional;
 
     return {
       NodeOp(
+        if(!forwardFused(/*relu=*/false)) {
           Prod(val_,
                child(0)->val(),
                child(1)->val(),
@@ -261,7 +277,8 @@ public:
                transB_,
                0.f,
                scalar_);
-          Prod(val_, child(3)->val(), child(2)->val(), false, false, 1.f, 1.f))
+          Prod(val_, child(3)->val(), child(2)->val(), false, false, 1.f, 1.f);
+        })
     };
   }
 
@@ -380,6 +397,38 @@ public:
 
 };
 
+// relu(affine(A, B, bias)) for inference, on the GPU in a single cuBLASLt call
+class AffineWithReluNodeOp : public AffineNodeOp {
+public:
+  AffineWithReluNodeOp(const std::vector<Expr>& nodes, bool transA, bool transB, float scalar)
+      : AffineNodeOp(nodes, transA, transB, scalar) {}
+
+  NodeOps forwardOps() override {
+    using namespace functional;
+
+    return {
+      NodeOp(
+        if(!forwardFused(/*relu=*/true)) {
+          Prod(val_,
+               child(0)->val(),
+               child(1)->val(),
+               transA_,
+               transB_,
+               0.f,
+               scalar_);
+          Prod(val_, child(3)->val(), child(2)->val(), false, false, 1.f, 1.f);
+          Element(_1 = ReLU(_2), val_, val_); // instantiated for the GPU already, see element.inc
+        })
+    };
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("affineWithRelu is only implemented for inference");
+  }
+
+  const std::string type() override { return "affineWithRelu"; }
+};
+
 class DotBatchedNodeOp : public NaryNodeOp {
 private:
   friend class SerializationHelpers;
@@ -664,7 +713,7 @@ struct ScalarProductNodeOp : public NaryNodeOp {
 
 struct RowsNodeOp : public NaryNodeOp {
   RowsNodeOp(Expr a, Expr indices)
-    : NaryNodeOp({a, indices}, newShape(a, indices), a->value_type()) {
+    : NaryNodeOp({a, indices}, newShape(a, indices), newType(a)) {
       matchOrAbort<IndexType>(indices->value_type());
   }
 
@@ -674,9 +723,21 @@ struct RowsNodeOp : public NaryNodeOp {
   }
 
   NodeOps backwardOps() override {
+    ABORT_IF(isRowQuantized(child(0)->value_type()), "Quantized matrix {} cannot be trained", child(0)->name());
     return {NodeOp(PasteRows(child(0)->grad(), adj_, child(1)->val()))};
   }
 
+  // rows of a quantized matrix are dequantized into the type of the other parameters, as are those
+  // of float16 weights on the CPU
+  static Type newType(Expr a) {
+    return isRowQuantized(a->value_type()) || isCpuFloat16(a) ? a->graph()->getDefaultElementType() : a->value_type();
+  }
+
+  // a float16 weight matrix of a CPU graph, see ExpressionGraph::setFloat16Weights()
+  static bool isCpuFloat16(Expr a) {
+    return a->value_type() == Type::float16 && a->graph()->getDeviceId().type == DeviceType::cpu;
+  }
+
   Shape newShape(Expr a, Expr indices) {
     Shape shape = a->shape();
     ABORT_IF(shape.size() != 2,
@@ -788,7 +849,7 @@ private:
 
 struct ColsNodeOp : public NaryNodeOp {
   ColsNodeOp(Expr a, Expr indices)
-    : NaryNodeOp({a, indices}, newShape(a, indices), a->value_type()) {
+    : NaryNodeOp({a, indices}, newShape(a, indices), newType(a)) {
     matchOrAbort<IndexType>(indices->value_type());
   }
 
@@ -806,6 +867,11 @@ struct ColsNodeOp : public NaryNodeOp {
     return shape;
   }
 
+  // columns of float16 weights on the CPU are converted into the type of the other parameters
+  static Type newType(Expr a) {
+    return RowsNodeOp::isCpuFloat16(a) ? a->graph()->getDefaultElementType() : a->value_type();
+  }
+
   const std::string type() override { return "cols"; }
 
   const std::string color() override { return "orange"; }
@@ -1121,6 +1187,219 @@ public:
   const std::string type() override { return "x-ent"; }
 };
 
+// Cross-entropy of the logits affine(x, W, b, transA=false, transB) for the labels in indices, like
+// cross_entropy(affine(...), indices, labelSmoothingAlpha). The logits are computed for chunkRows rows of
+// x at a time in temporary memory, in the forward pass and once more in the backward pass, so that the
+// [rows x vocab] logits and their gradient are never held for the whole batch. Children are {x, W, b,
+// indices}, or {x, W, indices} without a bias. chunkRows 0 means all rows.
+//
+// With chunkVocab > 0 and transB, the logits are also computed for chunkVocab words of the vocabulary at a
+// time, so that only [chunkRows x chunkVocab] of them exist. The softmax is then accumulated tile by tile
+// in four values per row, see CrossEntropyTileStats(). The backward pass needs them before the first
+// gradient, so it computes the logits twice: once for the statistics and once for the gradients.
+class AffineCrossEntropyNodeOp : public NaryNodeOp {
+private:
+  bool transB_;
+  float labelSmoothingAlpha_;
+  int chunkRows_;
+  int chunkVocab_;
+
+  bool hasBias() { return children().size() == 4; }
+  int dimModel() { return child(0)->shape()[-1]; }
+  int dimVocab() { return child(1)->shape()[transB_ ? -2 : -1]; }
+  int numRows()  { return child(0)->shape().elements() / dimModel(); }
+  Expr indices() { return children().back(); }
+
+  // the elements [offset, offset + shape.elements()) of t as a tensor of this shape
+  static Tensor view(Tensor t, size_t offset, const Shape& shape) {
+    auto mem = MemoryPiece::New(t->memory()->data() + sizeOf(t->type()) * offset,
+                                sizeOf(t->type()) * shape.elements());
+    return TensorBase::New(mem, shape, t->type(), t->getBackend());
+  }
+
+  // rows [begin, begin + n) of t as a [n x cols] matrix
+  static Tensor rows(Tensor t, int begin, int n, int cols) {
+    return view(t, (size_t)begin * cols, Shape{n, cols});
+  }
+
+  // a [n x cols] matrix of the element type of x at offset (in elements) of the temporary memory mem
+  Tensor temporary(MemoryPiece::PtrType mem, size_t offset, int n, int cols) {
+    Type type = child(0)->value_type();
+    auto piece = MemoryPiece::New(mem->data() + offset * sizeOf(type), (size_t)n * cols * sizeOf(type));
+    return TensorBase::New(piece, Shape{n, cols}, type, val_->getBackend());
+  }
+
+  int rowChunk() { return chunkRows_ > 0 ? std::min(chunkRows_, numRows()) : numRows(); }
+  bool tiled() { return transB_ && chunkVocab_ > 0 && chunkVocab_ < dimVocab(); }
+
+  void computeLogits(Tensor logits, int begin, int n) {
+    using namespace functional;
+    Prod(logits, rows(child(0)->val(), begin, n, dimModel()), child(1)->val(), false, transB_, 0.f, 1.f);
+    if(hasBias())
+      Element(_1 += _2, logits, child(2)->val());
+  }
+
+  // the logits of rows [begin, begin + n) and words [first, first + logits->shape()[-1]), W is transposed
+  void computeTileLogits(Tensor logits, int begin, int n, int first) {
+    using namespace functional;
+    int words = logits->shape()[-1];
+    Prod(logits, rows(child(0)->val(), begin, n, dimModel()), rows(child(1)->val(), first, words, dimModel()), false, true, 0.f, 1.f);
+    if(hasBias())
+      Element(_1 += _2, logits, view(child(2)->val(), first, marian::Shape{1, words}));
+  }
+
+  // Computes the stats [rows x 4] of all tiles, for rows [begin, begin + n) at a time, and writes the
+  // cross-entropy to out unless it is null; logitsMem holds [rowChunk() x chunkVocab_] logits
+  void tileStats(Tensor out, Tensor stats, MemoryPiece::PtrType logitsMem) {
+    for(int first = 0; first < dimVocab(); first += chunkVocab_) {
+      int words = std::min(chunkVocab_, dimVocab() - first);
+      for(int begin = 0; begin < numRows(); begin += rowChunk()) {
+        int n = std::min(rowChunk(), numRows() - begin);
+        auto logits = temporary(logitsMem, 0, n, words);
+        computeTileLogits(logits, begin, n, first);
+        CrossEntropyTileStats(out ? rows(out, begin, n, 1) : nullptr, rows(stats, begin, n, 4), logits,
+                              rows(indices()->val(), begin, n, 1), first, dimVocab(), labelSmoothingAlpha_);
+      }
+    }
+  }
+
+  // a [numRows() x 4] float32 tensor in mem
+  Tensor statsTensor(MemoryPiece::PtrType mem) {
+    return TensorBase::New(mem, Shape{numRows(), 4}, Type::float32, val_->getBackend());
+  }
+
+  void forwardTiles() {
+    auto statsMem = graph()->allocator()->alloc((size_t)numRows() * 4 * sizeof(float));
+    auto logitsMem = graph()->allocator()->alloc((size_t)rowChunk() * chunkVocab_ * sizeOf(child(0)->value_type()));
+    tileStats(val_, statsTensor(statsMem), logitsMem);
+    graph()->allocator()->free(logitsMem);
+    graph()->allocator()->free(statsMem);
+  }
+
+  void backwardTiles() {
+    using namespace functional;
+    auto statsMem = graph()->allocator()->alloc((size_t)numRows() * 4 * sizeof(float));
+    size_t tileElements = (size_t)rowChunk() * chunkVocab_;
+    auto mem = graph()->allocator()->alloc(2 * tileElements * sizeOf(child(0)->value_type()));
+    auto stats = statsTensor(statsMem);
+    tileStats(nullptr, stats, mem);
+
+    for(int first = 0; first < dimVocab(); first += chunkVocab_) {
+      int words = std::min(chunkVocab_, dimVocab() - first);
+      for(int begin = 0; begin < numRows(); begin += rowChunk()) {
+        int n = std::min(rowChunk(), numRows() - begin);
+        auto logits  = temporary(mem, 0, n, words);
+        auto dlogits = temporary(mem, tileElements, n, words);
+        computeTileLogits(logits, begin, n, first);
+        CrossEntropyTileBackward(dlogits, rows(adj_, begin, n, 1), logits, rows(stats, begin, n, 4),
+                                 rows(indices()->val(), begin, n, 1), first, dimVocab(), labelSmoothingAlpha_);
+
+        auto x = rows(child(0)->val(), begin, n, dimModel());
+        if(child(0)->trainable()) // dx += dlogits * W[first:first+words]
+          Prod(rows(child(0)->grad(), begin, n, dimModel()), dlogits, rows(child(1)->val(), first, words, dimModel()), false, false, 1.f, 1.f);
+        if(child(1)->trainable()) // dW[first:first+words] += dlogits^T * x
+          Prod(rows(child(1)->grad(), first, words, dimModel()), dlogits, x, true, false, 1.f, 1.f);
+        if(hasBias() && child(2)->trainable())
+          Add(_1, view(child(2)->grad(), first, marian::Shape{1, words}), dlogits);
+      }
+    }
+    graph()->allocator()->free(mem);
+    graph()->allocator()->free(statsMem);
+  }
+
+  void forwardChunks() {
+    if(tiled())
+      return forwardTiles();
+    int chunk = rowChunk();
+    auto mem = graph()->allocator()->alloc((size_t)chunk * dimVocab() * sizeOf(child(0)->value_type()));
+    for(int begin = 0; begin < numRows(); begin += chunk) {
+      int n = std::min(chunk, numRows() - begin);
+      auto logits = temporary(mem, 0, n, dimVocab());
+      computeLogits(logits, begin, n);
+      CrossEntropyPick(rows(val_, begin, n, 1), logits, rows(indices()->val(), begin, n, 1), labelSmoothingAlpha_);
+    }
+    graph()->allocator()->free(mem);
+  }
+
+  void backwardChunks() {
+    using namespace functional;
+    if(tiled())
+      return backwardTiles();
+    int chunk = rowChunk();
+    auto mem = graph()->allocator()->alloc(2 * (size_t)chunk * dimVocab() * sizeOf(child(0)->value_type()));
+    for(int begin = 0; begin < numRows(); begin += chunk) {
+      int n = std::min(chunk, numRows() - begin);
+      auto logits  = temporary(mem, 0, n, dimVocab());
+      auto dlogits = temporary(mem, (size_t)chunk * dimVocab(), n, dimVocab());
+      computeLogits(logits, begin, n);
+      dlogits->set(0.f);
+      CrossEntropyPickBackward(dlogits, rows(adj_, begin, n, 1), logits, rows(indices()->val(), begin, n, 1), labelSmoothingAlpha_);
+
+      auto x = rows(child(0)->val(), begin, n, dimModel());
+      if(child(0)->trainable()) // dx += dlogits * op(W)^T
+        Prod(rows(child(0)->grad(), begin, n, dimModel()), dlogits, child(1)->val(), false, !transB_, 1.f, 1.f);
+      if(child(1)->trainable()) { // dW += dlogits^T * x, or x^T * dlogits if W is not transposed
+        if(transB_)
+          Prod(child(1)->grad(), dlogits, x, true, false, 1.f, 1.f);
+        else
+          Prod(child(1)->grad(), x, dlogits, true, false, 1.f, 1.f);
+      }
+      if(hasBias() && child(2)->trainable())
+        Add(_1, child(2)->grad(), dlogits);
+    }
+    graph()->allocator()->free(mem);
+  }
+
+public:
+  AffineCrossEntropyNodeOp(const std::vector<Expr>& nodes, bool transB, float labelSmoothingAlpha, int chunkRows, int chunkVocab)
+    : NaryNodeOp(nodes, newShape(nodes.front()), Type::float32),
+      transB_(transB), labelSmoothingAlpha_(labelSmoothingAlpha), chunkRows_(chunkRows), chunkVocab_(chunkVocab) {
+    ABORT_IF(nodes.size() != 3 && nodes.size() != 4, "affine_cross_entropy needs x, W, an optional bias and the labels");
+    matchOrAbort<IndexType>(indices()->value_type());
+    ABORT_IF(chunkRows_ < 0 || chunkVocab_ < 0, "affine_cross_entropy needs non-negative chunk sizes");
+    ABORT_IF(chunkVocab_ > 0 && !transB_, "affine_cross_entropy can only split the vocabulary of a transposed output matrix");
+    ABORT_IF(dimModel() != child(1)->shape()[transB_ ? -1 : -2],
+             "Input dimension {} does not match the output matrix {}", dimModel(), child(1)->shape());
+    ABORT_IF(numRows() != (int)indices()->shape().elements(),
+             "Number of examples and labels does not match: {} != {}", numRows(), indices()->shape().elements());
+  }
+
+  Shape newShape(Expr x) {
+    Shape shape = x->shape();
+    shape.set(shape.size() - 1, 1);
+    return shape;
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(forwardChunks())};
+  }
+
+  NodeOps backwardOps() override {
+    return {NodeOp(backwardChunks())};
+  }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, transB_);
+    util::hash_combine(seed, labelSmoothingAlpha_);
+    util::hash_combine(seed, chunkRows_);
+    util::hash_combine(seed, chunkVocab_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<AffineCrossEntropyNodeOp>(node);
+    if(!cnode)
+      return false;
+    return transB_ == cnode->transB_ && labelSmoothingAlpha_ == cnode->labelSmoothingAlpha_
+           && chunkRows_ == cnode->chunkRows_ && chunkVocab_ == cnode->chunkVocab_;
+  }
+
+  const std::string type() override { return "affine-x-ent"; }
+};
+
 struct ConcatenateNodeOp : public NaryNodeOp {
   ConcatenateNodeOp(const std::vector<Expr>& nodes, int axis)
       : NaryNodeOp(nodes, newShape(nodes, axis)) {
@@ -1245,6 +1524,74 @@ private:
   float eps_;
 };
 
+// layer norm of dropout(x) + residual along last axis, children are x, residual, gamma and
+// optionally beta and a dropout mask of the shape of x
+struct ResidualLayerNormalizationOp : public NaryNodeOp {
+public:
+  ResidualLayerNormalizationOp(const std::vector<Expr>& nodes, bool hasBeta, bool hasMask, float eps = 1e-9)
+      : NaryNodeOp(nodes), hasBeta_(hasBeta), hasMask_(hasMask), eps_(eps) {
+    ABORT_IF(child(1)->shape() != child(0)->shape(), "Residual of layer normalization must have the shape of its input");
+    ABORT_IF(hasMask_ && mask()->shape() != child(0)->shape(), "Dropout mask of layer normalization must have the shape of its input");
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(
+        ResidualLayerNormalization(val_,
+                                   child(0)->val(),
+                                   hasMask_ ? mask()->val() : nullptr,
+                                   child(1)->val(),
+                                   child(2)->val(),
+                                   hasBeta_ ? child(3)->val() : nullptr,
+                                   eps_))};
+  }
+
+  NodeOps backwardOps() override {
+    return {NodeOp(
+      ResidualLayerNormalizationGrad(
+        graph()->allocator(),
+        child(0)->trainable() ? child(0)->grad() : nullptr,
+        child(1)->trainable() ? child(1)->grad() : nullptr,
+        child(2)->grad(),
+        hasBeta_ ? child(3)->grad() : nullptr,
+        adj_,
+        val_,
+        child(0)->val(),
+        hasMask_ ? mask()->val() : nullptr,
+        child(1)->val(),
+        child(2)->val(),
+        hasBeta_ ? child(3)->val() : nullptr,
+        eps_))};
+  }
+
+  const std::string type() override { return "residual_layer_normalization"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, hasBeta_);
+    util::hash_combine(seed, hasMask_);
+    util::hash_combine(seed, eps_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<ResidualLayerNormalizationOp>(node);
+    if(!cnode)
+      return false;
+    if(hasBeta_ != cnode->hasBeta_ || hasMask_ != cnode->hasMask_ || eps_ != cnode->eps_)
+      return false;
+    return true;
+  }
+
+private:
+  Expr mask() { return children_.back(); }
+
+  bool hasBeta_;
+  bool hasMask_;
+  float eps_;
+};
+
 struct HighwayNodeOp : public NaryNodeOp {
   HighwayNodeOp(const std::vector<Expr>& nodes) : NaryNodeOp(nodes) {}
 
@@ -1266,6 +1613,159 @@ struct HighwayNodeOp : public NaryNodeOp {
   const std::string type() override { return "highway"; }
 };
 
+// One step of the SSRU recurrence, mask * (sigmoid(f) * c + (1 - sigmoid(f)) * x), in a single
+// elementwise kernel instead of a highway node and a mask multiplication. The children are the
+// previous cell state c, the projected input x, the forget gate logits f and an optional mask.
+struct SSRUCellNodeOp : public NaryNodeOp {
+  SSRUCellNodeOp(const std::vector<Expr>& nodes) : NaryNodeOp(nodes, newShape(nodes)) {}
+
+  Shape newShape(const std::vector<Expr>& nodes) {
+    std::vector<Shape> shapes;
+    for(auto& node : nodes)
+      shapes.push_back(node->shape());
+    return Shape::broadcast(shapes);
+  }
+
+  NodeOps forwardOps() override {
+    using namespace functional;
+    if(children_.size() == 4)
+      return {NodeOp(Element(_1 = _5 * (sigmoid(_4) * _2 + (1.f - sigmoid(_4)) * _3),
+                             val_, child(0)->val(), child(1)->val(), child(2)->val(), child(3)->val()))};
+    return {NodeOp(Element(_1 = sigmoid(_4) * _2 + (1.f - sigmoid(_4)) * _3,
+                           val_, child(0)->val(), child(1)->val(), child(2)->val()))};
+  }
+
+  NodeOps backwardOps() override {
+    using namespace functional;
+    if(children_.size() == 4)
+      return {NodeOp(Add(_1 * _3 * sigmoid(_2), child(0)->grad(), adj_, child(2)->val(), child(3)->val())),
+              NodeOp(Add(_1 * _3 * (1.f - sigmoid(_2)), child(1)->grad(), adj_, child(2)->val(), child(3)->val())),
+              NodeOp(Add(_1 * _5 * (_2 - _3) * sigmoid(_4) * (1.f - sigmoid(_4)),
+                         child(2)->grad(), adj_, child(0)->val(), child(1)->val(), child(2)->val(), child(3)->val())),
+              NodeOp(Add(_1 * (sigmoid(_4) * _2 + (1.f - sigmoid(_4)) * _3),
+                         child(3)->grad(), adj_, child(0)->val(), child(1)->val(), child(2)->val()))};
+    return {NodeOp(Add(_1 * sigmoid(_2), child(0)->grad(), adj_, child(2)->val())),
+            NodeOp(Add(_1 * (1.f - sigmoid(_2)), child(1)->grad(), adj_, child(2)->val())),
+            NodeOp(Add(_1 * (_2 - _3) * sigmoid(_4) * (1.f - sigmoid(_4)),
+                       child(2)->grad(), adj_, child(0)->val(), child(1)->val(), child(2)->val()))};
+  }
+
+  const std::string type() override { return "ssru"; }
+};
+
+// The SSRU recurrence over all time steps, see ssruScan(). The time steps are sequential, all
+// batch entries and dimensions of a time step are independent, so a single kernel scans the time
+// axis for all of them in parallel, and its backward step scans it in the opposite direction. The
+// children are x, f, the initial cell state and optionally the mask.
+struct SSRUScanNodeOp : public NaryNodeOp {
+private:
+  bool reverse_;
+
+public:
+  SSRUScanNodeOp(const std::vector<Expr>& nodes, bool reverse)
+      : NaryNodeOp(nodes, nodes[0]->shape()), reverse_(reverse) {
+    ABORT_IF(child(1)->shape() != child(0)->shape(), "SSRU gates must have the shape of the input");
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(SSRUScanForward(val_,
+                                   child(2)->val(),
+                                   child(0)->val(),
+                                   child(1)->val(),
+                                   children_.size() == 4 ? child(3)->val() : nullptr,
+                                   reverse_))};
+  }
+
+  // a single step for all gradients, run if x is trainable
+  NodeOps backwardOps() override {
+    return {NodeOp(SSRUScanBackward(child(2)->trainable() ? child(2)->grad() : nullptr,
+                                    child(0)->grad(),
+                                    child(1)->trainable() ? child(1)->grad() : nullptr,
+                                    adj_,
+                                    val_,
+                                    child(2)->val(),
+                                    child(0)->val(),
+                                    child(1)->val(),
+                                    children_.size() == 4 ? child(3)->val() : nullptr,
+                                    reverse_))};
+  }
+
+  const std::string type() override { return "ssru_scan"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, reverse_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<SSRUScanNodeOp>(node);
+    if(!cnode)
+      return false;
+    return reverse_ == cnode->reverse_;
+  }
+};
+
+// softmax(scale * q * k^T + mask) * v in one node, see FusedAttention(). The children are q, k, v
+// and optionally the additive mask, which gets no gradient. Neither the scores nor the attention
+// weights are stored; the backward step recomputes them.
+struct FusedAttentionNodeOp : public NaryNodeOp {
+private:
+  friend class SerializationHelpers;
+  float scale_;
+
+  static Shape newShape(const std::vector<Expr>& nodes) {
+    Shape shape = nodes[0]->shape();
+    shape.set(-1, nodes[2]->shape()[-1]);
+    return shape;
+  }
+
+public:
+  FusedAttentionNodeOp(const std::vector<Expr>& nodes, float scale)
+      : NaryNodeOp(nodes, newShape(nodes)), scale_(scale) {
+    ABORT_IF(nodes.size() < 3 || nodes.size() > 4, "Fused attention expects q, k, v and an optional mask");
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(FusedAttention(val_, child(0)->val(), child(1)->val(), child(2)->val(), mask(), scale_))};
+  }
+
+  NodeOps backwardOps() override {
+    return {NodeOp(FusedAttentionBackward(child(0)->trainable() ? child(0)->grad() : nullptr,
+                                          child(1)->trainable() ? child(1)->grad() : nullptr,
+                                          child(2)->trainable() ? child(2)->grad() : nullptr,
+                                          adj_,
+                                          val_,
+                                          child(0)->val(),
+                                          child(1)->val(),
+                                          child(2)->val(),
+                                          mask(),
+                                          scale_))};
+  }
+
+  const std::string type() override { return "fused_attention"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, scale_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<FusedAttentionNodeOp>(node);
+    if(!cnode)
+      return false;
+    return scale_ == cnode->scale_;
+  }
+
+private:
+  Tensor mask() { return children_.size() > 3 ? child(3)->val() : nullptr; }
+};
+
 #ifdef CUDNN
 
 class ConvolutionOp : public NaryNodeOp {
@@ -32,6 +32,7 @@ struct UnaryNodeOp : public NaryNodeOp {
 struct ScalarAddNodeOp : public UnaryNodeOp {
 private:
   friend class SerializationHelpers;
+  friend class ElementwiseFusion;
   float scalar_{0};
 
 public:
@@ -90,6 +91,7 @@ public:
 struct ScalarMultNodeOp : public UnaryNodeOp {
 private:
   friend class SerializationHelpers;
+  friend class ElementwiseFusion;
   float scalar_{0};
 
 public:
@@ -583,6 +585,40 @@ struct ReduceNodeOp : public UnaryNodeOp {
   }
 };
 
+// cumulative sum along an axis, the gradient is the cumulative sum of the adjoint in reverse order
+struct CumSumNodeOp : public UnaryNodeOp {
+  int axis_;
+
+  CumSumNodeOp(Expr a, int axis) : UnaryNodeOp(a), axis_(a->shape().axis(axis)) {}
+
+  NodeOps forwardOps() override {
+    return {NodeOp(CumSum(val_, child(0)->val(), axis_, /*reverse=*/false, /*add=*/false))};
+  }
+
+  NodeOps backwardOps() override {
+    return {NodeOp(CumSum(child(0)->grad(), adj_, axis_, /*reverse=*/true, /*add=*/true))};
+  }
+
+  const std::string type() override { return "cumsum"; }
+
+  virtual size_t hash() override {
+    if(!hash_) {
+      hash_ = NaryNodeOp::hash();
+      util::hash_combine(hash_, axis_);
+    }
+    return hash_;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<CumSumNodeOp>(node);
+    if(!cnode)
+      return false;
+    return axis_ == cnode->axis_;
+  }
+};
+
 struct LogNodeOp : public UnaryNodeOp {
   LogNodeOp(Expr a) : UnaryNodeOp(a) {}
 
@@ -1063,6 +1099,61 @@ private:
   float padValue_;  // what value to shift in
 };
 
+// Dropout with a mask of maskShape that is computed in the kernels from a counter-based random stream
+// (see DropoutMask) instead of being stored: the forward step drops and scales the elements in one
+// pass, the backward step computes the same mask again. Every node reserves its own part of the
+// stream of the backend, so the masks differ between nodes and steps.
+struct DropoutNodeOp : public UnaryNodeOp {
+  DropoutNodeOp(Expr a, float dropProb, Shape maskShape)
+      : UnaryNodeOp(a, a->shape()),
+        maskShape_(maskShape),
+        mask_(0, 0, dropProb) {
+    ABORT_IF(Shape::broadcast({a->shape(), maskShape}) != a->shape(),
+             "Dropout mask of shape {} does not broadcast to the shape {} of the input",
+             std::string(maskShape), std::string(a->shape()));
+    auto backend = a->graph()->getBackend();
+    auto generator = backend->getRandomGenerator();
+    // the graphs of several devices share the seed, but should not share their masks
+    uint64_t seed = (uint64_t)generator->seed() ^ ((uint64_t)backend->getDeviceId().no << 32);
+    mask_ = DropoutMask(seed, generator->reserve(maskShape.elements()), dropProb);
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(DropoutForward(val_, child(0)->val(), maskShape_, mask_))};
+  }
+
+  NodeOps backwardOps() override {
+    return {NodeOp(DropoutBackward(child(0)->grad(), adj_, maskShape_, mask_))};
+  }
+
+  const std::string type() override { return "dropout"; }
+
+  virtual size_t hash() override {
+    if(!hash_) {
+      size_t seed = NaryNodeOp::hash();
+      util::hash_combine(seed, mask_.offset);
+      util::hash_combine(seed, mask_.keepProb);
+      hash_ = seed;
+    }
+    return hash_;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<DropoutNodeOp>(node);
+    if(!cnode)
+      return false;
+    return mask_.offset == cnode->mask_.offset && mask_.keepProb == cnode->mask_.keepProb
+           && mask_.philox.key0 == cnode->mask_.philox.key0 && mask_.philox.key1 == cnode->mask_.philox.key1
+           && maskShape_ == cnode->maskShape_;
+  }
+
+private:
+  Shape maskShape_;
+  DropoutMask mask_;
+};
+
 struct AbsNodeOp : public UnaryNodeOp {
   AbsNodeOp(Expr a) : UnaryNodeOp(a) {}
 
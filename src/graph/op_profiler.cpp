@@ -0,0 +1,138 @@
+#include "graph/op_profiler.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace marian {
+
+OpProfiler& OpProfiler::instance() {
+  static OpProfiler profiler;
+  return profiler;
+}
+
+double OpProfiler::flops(Chainable<Tensor>* node) {
+  const auto& type = node->type();
+  const auto& shape = node->shape();
+  auto& children = node->children();
+  double elements = (double)shape.elements();
+
+  // views and copies do not compute anything
+  if(type == "reshape" || type == "sliceView" || type == "tupleView"
+     || type == "transpose" || type == "concat" || type == "rows" || type == "cols" || type == "gather"
+     || type == "cast" || type == "shift")
+    return 0;
+
+  // C = A * B with k the inner dimension, B is a matrix for dot and affine, a batch of matrices for bdot
+  if((type == "dot" || type == "affine" || type == "affineWithRelu" || type == "bdot") && children.size() >= 2) {
+    int rank = shape.size();
+    double n = shape[-1];
+    double batches = type == "bdot" && rank >= 2 ? elements / (shape[-2] * n) : 1;
+    double k = children[1]->shape().elements() / (batches * n);
+    return 2 * elements * k + (type == "dot" || type == "bdot" ? 0 : elements);
+  }
+
+  // two batched products and a softmax over the scores
+  if(type == "fused_attention" && children.size() >= 3) {
+    double scores = elements / shape[-1] * children[1]->shape()[-2];
+    return 2 * scores * (children[0]->shape()[-1] + shape[-1]) + 5 * scores;
+  }
+
+  if(type == "softmax" || type == "logsoftmax")
+    return 5 * elements; // max, subtract, exp, sum, divide
+  if(type == "layer_normalization" || type == "residual_layer_normalization")
+    return 8 * elements; // mean, variance, normalize, scale and shift
+
+  // elementwise operations and reductions: one operation per element of the largest operand
+  for(auto& child : children)
+    elements = std::max(elements, (double)child->shape().elements());
+  return elements;
+}
+
+double OpProfiler::bytes(Chainable<Tensor>* node) {
+  if(!node->ownsMemory())
+    return 0;
+  double bytes = (double)node->shape().elements() * sizeOf(node->value_type());
+  for(auto& child : node->children())
+    bytes += (double)child->shape().elements() * sizeOf(child->value_type());
+  return bytes;
+}
+
+void OpProfiler::record(Chainable<Tensor>* node, bool backward, double seconds) {
+  auto type = node->type();
+  if(type == "param" || type == "const") // nothing computed, only initialized
+    return;
+
+  std::string shape;
+  for(int dim : node->shape())
+    shape += (shape.empty() ? "" : "x") + std::to_string(dim);
+  Key key(type, backward, shape);
+  double flops = OpProfiler::flops(node);
+  double bytes = OpProfiler::bytes(node);
+  if(backward) { // the gradients of the children as well as the values
+    flops *= 2;
+    bytes *= 2;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& stats = stats_[key];
+  stats.calls++;
+  stats.seconds += seconds;
+  stats.flops += flops;
+  stats.bytes += bytes;
+}
+
+static void logStats(const std::string& op, const std::string& shape, const OpProfiler::Stats& stats, double total) {
+  double gflops = stats.seconds > 0 ? stats.flops / stats.seconds * 1e-9 : 0;
+  double gbytes = stats.seconds > 0 ? stats.bytes / stats.seconds * 1e-9 : 0;
+  double intensity = stats.bytes > 0 ? stats.flops / stats.bytes : 0;
+  LOG(info, "[profile-ops] {:<32} {:<28} {:>9} {:>11.2f} {:>6.1f}% {:>9.2f} {:>9.2f} {:>8.2f}",
+      op, shape, stats.calls, stats.seconds * 1e3, total > 0 ? 100 * stats.seconds / total : 0, gflops, gbytes, intensity);
+}
+
+void OpProfiler::report() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(stats_.empty())
+    return;
+
+  // totals per operator and pass
+  std::map<std::pair<std::string, bool>, Stats> byOp;
+  double total = 0;
+  for(const auto& kv : stats_) {
+    auto& stats = byOp[{std::get<0>(kv.first), std::get<1>(kv.first)}];
+    stats.calls += kv.second.calls;
+    stats.seconds += kv.second.seconds;
+    stats.flops += kv.second.flops;
+    stats.bytes += kv.second.bytes;
+    total += kv.second.seconds;
+  }
+
+  auto header = [](const std::string& title) {
+    LOG(info, "[profile-ops] {}", title);
+    LOG(info, "[profile-ops] {:<32} {:<28} {:>9} {:>11} {:>7} {:>9} {:>9} {:>8}",
+        "Operator", "Shape", "Calls", "Total ms", "Share", "GFLOP/s", "GB/s", "FLOP/B");
+  };
+  auto name = [](const std::string& type, bool backward) { return backward ? type + " (backward)" : type; };
+
+  std::vector<std::pair<std::pair<std::string, bool>, Stats>> ops(byOp.begin(), byOp.end());
+  std::sort(ops.begin(), ops.end(), [](const decltype(ops[0])& a, const decltype(ops[0])& b) {
+    return a.second.seconds > b.second.seconds;
+  });
+  header(fmt::format("Operators by total time, {:.1f} ms in {} operators", total * 1e3, ops.size()));
+  for(const auto& op : ops)
+    logStats(name(op.first.first, op.first.second), "", op.second, total);
+
+  // the most expensive shapes, the others are only part of the totals above
+  const size_t maxShapes = 50;
+  std::vector<std::pair<Key, Stats>> shapes(stats_.begin(), stats_.end());
+  std::sort(shapes.begin(), shapes.end(), [](const decltype(shapes[0])& a, const decltype(shapes[0])& b) {
+    return a.second.seconds > b.second.seconds;
+  });
+  header(fmt::format("Operators and shapes by total time, top {} of {}", std::min(maxShapes, shapes.size()), shapes.size()));
+  for(size_t i = 0; i < shapes.size() && i < maxShapes; ++i)
+    logStats(name(std::get<0>(shapes[i].first), std::get<1>(shapes[i].first)), std::get<2>(shapes[i].first), shapes[i].second, total);
+
+  stats_.clear();
+}
+
+}  // namespace marian
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "tensors/tensor.h"
+#include "graph/chainable.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+namespace marian {
+
+// Times the forward and backward step of every node of all graphs and aggregates them by operator
+// type and output shape, see --profile-ops. The graphs wait for the device before and after each
+// node, so the times are those of the kernels, at the cost of running much slower. At exit a
+// roofline-style table is logged with the estimated FLOPs and bytes moved per operator, i.e. the
+// achieved GFLOP/s, GB/s and arithmetic intensity. The estimates are rough: matrix products count
+// 2*m*n*k, known non-elementwise operators a few operations per element, everything else one
+// operation per element of its largest operand; the bytes are those of the children and the result,
+// twice as many for a backward step. A fused elementwise chain is counted as its last node.
+class OpProfiler {
+public:
+  struct Stats {
+    size_t calls{0};
+    double seconds{0};
+    double flops{0};
+    double bytes{0};
+  };
+
+private:
+  typedef std::tuple<std::string, bool, std::string> Key; // type, backward, shape
+
+  std::atomic<bool> enabled_{false};
+  std::mutex mutex_;
+  std::map<Key, Stats> stats_;
+
+  OpProfiler() {}
+  ~OpProfiler() { report(); }
+
+public:
+  static OpProfiler& instance();
+
+  void enable() { enabled_ = true; }
+  static bool enabled() { return instance().enabled_.load(std::memory_order_relaxed); }
+
+  // estimated work of the forward step of node
+  static double flops(Chainable<Tensor>* node);
+  static double bytes(Chainable<Tensor>* node);
+
+  // records a forward or backward step of node that took the given time, call before the children
+  // of the node are cleared
+  void record(Chainable<Tensor>* node, bool backward, double seconds);
+
+  // Logs the table of all recorded steps, called at exit
+  void report();
+};
+
+}  // namespace marian
@@ -0,0 +1,75 @@
+#include "graph/parameter_offloader.h"
+#include "tensors/device.h"
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+
+namespace marian {
+
+std::string ParameterOffloader::layerName(const std::string& paramName) {
+  // encoder_l3_self_Wq -> encoder_l3, possibly behind a namespace like "F0::"
+  for(size_t pos = paramName.find("_l"); pos != std::string::npos; pos = paramName.find("_l", pos + 1)) {
+    size_t end = pos + 2;
+    while(end < paramName.size() && std::isdigit((unsigned char)paramName[end]))
+      end++;
+    if(end > pos + 2 && (end == paramName.size() || paramName[end] == '_'))
+      return paramName.substr(0, end);
+  }
+  return paramName;
+}
+
+size_t ParameterOffloader::layerOf(Chainable<Tensor>* param) {
+  auto it = params_.find(param);
+  if(it != params_.end())
+    return it->second;
+
+  auto name = layerName(param->name());
+  auto found = layerIds_.find(name);
+  size_t id = found != layerIds_.end() ? found->second : layers_.size();
+  if(id == layers_.size()) {
+    layerIds_[name] = id;
+    layers_.emplace_back();
+  }
+  auto memory = param->val()->memory();
+  auto& layer = layers_[id];
+  layer.begin = layer.begin ? std::min(layer.begin, memory->data()) : memory->data();
+  layer.end = std::max(layer.end, memory->data() + memory->size());
+  params_[param] = id;
+  return id;
+}
+
+void ParameterOffloader::prefetch(size_t layer) {
+#ifdef CUDA_FOUND
+  const auto& range = layers_[layer];
+  gpu::prefetchManaged(deviceId_, range.begin, range.end - range.begin);
+#else
+  layer;
+#endif
+}
+
+void ParameterOffloader::beginPass(const std::list<Expr>& forwardTape) {
+  // the layers in the order in which the tape first reads them
+  std::vector<std::pair<size_t, size_t>> firstReads; // (step, layer)
+  std::unordered_set<size_t> seen;
+  size_t step = 0;
+  for(const auto& node : forwardTape) {
+    for(const auto& child : node->children())
+      if(child->type() == "param" && child->val() && child->val()->memory()) {
+        size_t layer = layerOf(child.get());
+        if(seen.insert(layer).second)
+          firstReads.push_back({step, layer});
+      }
+    step++;
+  }
+
+  schedule_.clear();
+  next_ = 0;
+  if(firstReads.empty())
+    return;
+  prefetch(firstReads.front().second);
+  for(size_t i = 0; i + 1 < firstReads.size(); ++i)
+    schedule_.push_back({firstReads[i].first, firstReads[i + 1].second});
+}
+
+}  // namespace marian
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "tensors/tensor.h"
+#include "graph/chainable.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace marian {
+
+// Streams the parameters of a GPU graph that live in managed host memory, see
+// ExpressionGraph::setParameterOffloading(), layer by layer to the GPU. Whenever a forward pass starts
+// to read the parameters of one layer, those of the layer the pass reads next are prefetched on a copy
+// stream, so that their transfer overlaps with the computation of the current layer. The driver
+// evicts the layers that were used longest ago when the GPU memory is full. Layers are recognized by
+// the transformer naming, e.g. encoder_l3_... or decoder_l1_..., every other parameter is a layer of
+// its own. Parameters are allocated sorted by name, so the parameters of a layer are one range.
+class ParameterOffloader {
+private:
+  struct Layer {
+    uint8_t* begin{nullptr};
+    uint8_t* end{nullptr};
+  };
+
+  DeviceId deviceId_;
+  std::vector<Layer> layers_;
+  std::unordered_map<std::string, size_t> layerIds_;      // [layer name] -> index into layers_
+  std::unordered_map<Chainable<Tensor>*, size_t> params_; // [parameter node] -> index into layers_
+  std::vector<std::pair<size_t, size_t>> schedule_;        // (step, layer to prefetch) of this pass
+  size_t next_{0};                                         // next entry of schedule_
+
+  static std::string layerName(const std::string& paramName);
+  size_t layerOf(Chainable<Tensor>* param);
+  void prefetch(size_t layer);
+
+public:
+  ParameterOffloader(DeviceId deviceId) : deviceId_(deviceId) {}
+
+  // Plans the prefetches of a forward pass over the tape and prefetches the first layer it reads
+  void beginPass(const std::list<Expr>& forwardTape);
+  // Called before the node at this step of the tape is computed
+  void beforeStep(size_t step) {
+    while(next_ < schedule_.size() && schedule_[next_].first <= step)
+      prefetch(schedule_[next_++].second);
+  }
+};
+
+}  // namespace marian
@@ -0,0 +1,77 @@
+#include "graph/parameter_store.h"
+#include "common/hash.h"
+#include "tensors/tensor_operators.h"
+
+#include <cstring>
+
+namespace marian {
+
+ParameterStore& ParameterStore::instance() {
+  static ParameterStore store;
+  return store;
+}
+
+size_t ParameterStore::hash(const io::Item& item) {
+  size_t seed = 0;
+  util::hash_combine(seed, (size_t)item.type);
+  for(int dim : item.shape)
+    util::hash_combine(seed, dim);
+
+  const char* data = item.data();
+  size_t bytes = item.size();
+  size_t i = 0;
+  for(; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    util::hash_combine(seed, word);
+  }
+  for(; i < bytes; ++i)
+    util::hash_combine(seed, data[i]);
+  return seed;
+}
+
+// a hash collision must not mix up parameters, hence the contents are compared as well
+bool ParameterStore::equal(Tensor tensor, const io::Item& item) {
+  if(tensor->type() != item.type || tensor->shape() != item.shape)
+    return false;
+  if(tensor->getBackend()->getDeviceId().type == DeviceType::cpu)
+    return std::memcmp(tensor->memory()->data(), item.data(), item.size()) == 0;
+
+  io::Item stored;
+  tensor->get(stored, item.name);
+  return std::memcmp(stored.bytes.data(), item.data(), item.size()) == 0;
+}
+
+Ptr<ParameterStore::Value> ParameterStore::acquire(Ptr<Backend> backend, const io::Item& item, bool& shared) {
+  auto deviceId = backend->getDeviceId();
+  size_t key = hash(item);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto range = values_.equal_range(key);
+  for(auto it = range.first; it != range.second;) {
+    auto value = it->second.lock();
+    if(!value) { // freed by the last graph that used it
+      it = values_.erase(it);
+      continue;
+    }
+    if(value->deviceId == deviceId && equal(value->tensor, item)) {
+      shared = true;
+      return value;
+    }
+    ++it;
+  }
+
+  auto value = New<Value>();
+  value->deviceId = deviceId;
+  value->device = DispatchDevice(deviceId);
+  value->device->reserve(item.size());
+  auto memory = MemoryPiece::New(value->device->data(), item.size());
+  value->tensor = TensorBase::New(memory, item.shape, item.type, backend);
+  copy(backend, item.data(), item.data() + item.size(), memory->data<char>());
+
+  values_.insert({key, value});
+  shared = false;
+  return value;
+}
+
+}  // namespace marian
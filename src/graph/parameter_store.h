@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/io_item.h"
+#include "tensors/device.h"
+#include "tensors/tensor.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace marian {
+
+// Process-wide store of the parameter values that graphs share, see --share-parameters. Values are
+// found by a hash of their content, type and shape, so that identical parameters of different models
+// loaded on the same device, e.g. a common encoder or common embeddings, are held only once. A value is
+// freed when the last graph that uses it lets go of it. Shared values must not be written to: the
+// Parameters of a graph replace them by own copies before training, see Parameters::unshare().
+class ParameterStore {
+public:
+  struct Value {
+    DeviceId deviceId;
+    Ptr<Device> device; // holds the memory of tensor
+    Tensor tensor;
+  };
+
+private:
+  std::mutex mutex_;
+  std::unordered_multimap<size_t, std::weak_ptr<Value>> values_; // [content hash]
+
+  static size_t hash(const io::Item& item);
+  static bool equal(Tensor tensor, const io::Item& item);
+
+  ParameterStore() {}
+
+public:
+  static ParameterStore& instance();
+
+  // Returns a value with the content, type and shape of item on the device of backend, stored from item if
+  // there is none yet. shared tells whether the value was already used by another graph.
+  Ptr<Value> acquire(Ptr<Backend> backend, const io::Item& item, /*out*/ bool& shared);
+};
+
+}  // namespace marian
@@ -6,6 +6,7 @@
 
 #include "common/definitions.h"
 #include "graph/chainable.h"
+#include "graph/parameter_store.h"
 #include "tensors/tensor_allocator.h"
 
 namespace marian {
@@ -26,15 +27,42 @@ protected:
 
   Ptr<TensorAllocator> vals_;
   Ptr<TensorAllocator> grads_;
+  Ptr<Backend> backend_;
+
+  // [name] values of the ParameterStore, i.e. held outside of vals_ and possibly used by other graphs
+  std::map<std::string, Ptr<ParameterStore::Value>> shared_;
 
   size_t totalCapacity(Ptr<TensorAllocator> alloc) {
     size_t sum = 0;
     for(auto p : params_) {
-      sum += alloc->capacity(p->shape(), p->value_type());
+      if(!shared_.count(p->name()))
+        sum += alloc->capacity(p->shape(), p->value_type());
     }
     return sum;
   }
 
+  // Copy-on-write: replaces the shared values by own copies, so that all parameters are in vals_ again
+  // and can be written to
+  void unshare() {
+    if(shared_.empty())
+      return;
+    auto shared = std::move(shared_); // keeps the shared values alive while they are copied
+    shared_.clear();
+
+    std::sort(params_.begin(), params_.end(), [](Expr n1, Expr n2){ return n1->name() < n2->name(); });
+    auto vals = New<TensorAllocator>(backend_);
+    vals->reserveExact(totalCapacity(vals));
+    for(auto p : params_) {
+      Tensor own;
+      vals->allocate(own, p->shape(), p->value_type());
+      if(p->val())
+        own->copyFrom(p->val());
+      p->val() = own;
+    }
+    vals_ = vals;
+    LOG(info, "[memory] Copied {} shared parameters to write to them", shared.size());
+  }
+
 public:
   Parameters(Type acceptedType) : acceptedElementType_(acceptedType) {
     LOG(debug, "Created parameter object of type {}", acceptedElementType_);
@@ -72,19 +100,31 @@ public:
     named_[name] = p;
   }
 
+  // Uses a value of the ParameterStore for parameter p instead of allocating one
+  void share(Expr p, Ptr<ParameterStore::Value> value) {
+    ABORT_IF(vals_->size() > 0, "Parameter '{}' cannot be shared after the parameters have been allocated", p->name());
+    p->val() = value->tensor;
+    shared_[p->name()] = value;
+  }
+
   virtual void init(Ptr<Backend> backend) {
+    backend_ = backend;
     vals_ = New<TensorAllocator>(backend);
     grads_ = New<TensorAllocator>(backend);
   }
 
   virtual void init(Ptr<Backend> backend, Ptr<Device> device) {
+    backend_ = backend;
     vals_ = New<TensorAllocator>(backend, device);
     grads_ = New<TensorAllocator>(backend, device);
   }
 
   virtual void allocateForward() {
     if(!params_.empty() && vals_->size() == 0) {
-      vals_->reserveExact(totalCapacity(vals_));
+      size_t capacity = totalCapacity(vals_);
+      if(capacity == 0) // all parameters are shared
+        return;
+      vals_->reserveExact(capacity);
 
       // sort parameters by name before allocation to make sure the memory layout after allocation is always the same
       std::sort(params_.begin(), params_.end(), [](Expr n1, Expr n2){ return n1->name() < n2->name(); });
@@ -98,6 +138,7 @@ public:
   }
 
   virtual void allocateBackward() {
+    unshare(); // parameters with gradients get updated
     if(!params_.empty() && grads_->size() == 0) {
 
       // sort parameters by name before allocation to make sure the memory layout after allocation is always the same
@@ -112,13 +153,17 @@ public:
 
   virtual void set_zero_adjoint() { grads()->set(0.f); }
 
-  virtual Tensor vals() { return vals_->asTensor(acceptedElementType_); }
+  virtual Tensor vals() {
+    unshare();
+    return vals_->asTensor(acceptedElementType_);
+  }
 
   virtual Tensor grads() { return grads_->asTensor(acceptedElementType_); }
 
   virtual void clear() {
     params_.clear();
     named_.clear();
+    shared_.clear();
 
     vals_->clear();
     grads_->clear();
@@ -126,9 +171,6 @@ public:
 };
 
 class MappedParameters : public Parameters {
-private:
-  Ptr<Backend> backend_;
-
 public:
   MappedParameters(Type acceptedElementType) : Parameters(acceptedElementType) {
     LOG(debug, "Created mapped parameter object of type {}", acceptedElementType);
@@ -12,13 +12,109 @@ namespace marian {
   Logits::Logits(Expr logits) : Logits(New<RationalLoss>(logits, nullptr)) {} // single-output constructor from Expr only (RationalLoss has no count)
 
   Ptr<ExpressionGraph> Logits::graph() const {
+    if(projection_)
+      return projection_->x->graph();
     ABORT_IF(logits_.empty(), "Empty logits object??");
     return logits_.front()->loss()->graph();
   }
 
+  void Logits::materialize() const {
+    if(!projection_ || !logits_.empty())
+      return;
+    const auto& p = *projection_;
+    for(size_t g = 0; g < p.W.size(); g++) {
+      if(!p.W[g]) { // empty factor group
+        logits_.push_back(nullptr);
+        continue;
+      }
+      auto logits = p.b[g] ? affine(p.x, p.W[g], p.b[g], false, p.transB) : dot(p.x, p.W[g], false, p.transB);
+      logits_.push_back(New<RationalLoss>(logits, nullptr));
+    }
+  }
+
+  // Like applyLossFunction() with cross_entropy() as in CrossEntropyLoss
+  Expr Logits::applyCrossEntropy(const Words& labels, float labelSmoothing, float factorWeight) const {
+    ABORT_IF(!projection_, "applyCrossEntropy() needs deferred logits");
+    const auto& p = *projection_;
+    int chunkVocab = p.chunkVocab;
+    if(chunkVocab > 0 && !p.transB) {
+      LOG_ONCE(warn, "[logits] The vocabulary of an untransposed output matrix is not split, ignoring --output-loss-vocab-chunk");
+      chunkVocab = 0;
+    }
+    LOG_ONCE(info, "[logits] Computing the cross-entropy in chunks of {} labels and {} words (0 for all)", p.chunkRows, chunkVocab);
+    auto x = atleast_3d(p.x); // the loss has a time and batch dimension, like for the logits
+
+    if(!factoredVocab_ && p.sampled > 0)
+      return applySampledCrossEntropy(labels, labelSmoothing, chunkVocab);
+    if(!factoredVocab_)
+      return affine_cross_entropy(x, p.W[0], p.b[0], indices(toWordIndexVector(labels)), p.transB, labelSmoothing, p.chunkRows, chunkVocab);
+
+    auto allMaskedFactoredLabels = factorizeWords(labels); // [numGroups][labels.size()]
+    Expr loss;
+    for(size_t g = 0; g < p.W.size(); g++) {
+      if(!p.W[g])
+        continue; // empty factor
+      const auto& maskedFactoredLabels = allMaskedFactoredLabels[g];
+      auto factorIndices = indices(maskedFactoredLabels.indices);
+      auto factorMask    = constant(maskedFactoredLabels.masks);
+      // label smoothing only applies to the lemmas, the factors get the extra weight
+      auto factorLoss = affine_cross_entropy(x, p.W[g], p.b[g], factorIndices, p.transB, g == 0 ? labelSmoothing : 0.f, p.chunkRows, chunkVocab);
+      if(g > 0 && factorWeight != 1.0f) {
+        LOG_ONCE(info, "scaling factor losses with weight {}", factorWeight);
+        factorLoss = factorLoss * factorWeight;
+      }
+      factorLoss = factorLoss * reshape(factorMask, factorLoss->shape()); // mask out factor for words that do not have that factor
+      loss = loss ? (loss + factorLoss) : factorLoss;
+    }
+    return loss;
+  }
+
+  // Sampled softmax: the softmax only runs over the words of the labels of the batch and p.sampled words
+  // drawn from a log-uniform (Zipfian) distribution, P(k) = log((k + 2) / (k + 1)) / log(V + 1), which fits
+  // vocabularies sorted by frequency as created by SentencePiece or marian-vocab. The logits of the sampled
+  // words are corrected by the log of their expected number of samples, so that the gradient estimates that
+  // of the full softmax. The labels of the batch stay uncorrected: every one of them is a candidate.
+  Expr Logits::applySampledCrossEntropy(const Words& labels, float labelSmoothing, int chunkVocab) const {
+    const auto& p = *projection_;
+    int dimVocab = p.W[0]->shape()[p.transB ? -2 : -1];
+    LOG_ONCE(info, "[logits] Computing a sampled softmax over the labels of the batch and {} sampled words", p.sampled);
+
+    std::vector<IndexType> candidates;              // vocabulary entries the softmax runs over
+    std::unordered_map<IndexType, IndexType> where; // [word] position in candidates
+    std::vector<WordIndex> candidateLabels;         // the labels as positions in candidates
+    candidateLabels.reserve(labels.size());
+    for(const auto& label : labels) {
+      auto inserted = where.emplace(label.toWordIndex(), (IndexType)candidates.size());
+      if(inserted.second)
+        candidates.push_back(label.toWordIndex());
+      candidateLabels.push_back(inserted.first->second);
+    }
+    std::vector<float> corrections(candidates.size(), 0.f);
+
+    static thread_local std::mt19937 engine((unsigned int)Config::seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double logRange = std::log((double)dimVocab + 1.0);
+    for(int i = 0; i < p.sampled; i++) {
+      auto word = (IndexType)std::min((double)dimVocab - 1.0, std::floor(std::exp(uniform(engine) * logRange)) - 1.0);
+      if(!where.emplace(word, (IndexType)candidates.size()).second)
+        continue; // a label, or sampled before
+      double expectedCount = p.sampled * std::log((word + 2.0) / (word + 1.0)) / logRange;
+      candidates.push_back(word);
+      corrections.push_back(-(float)std::log(std::min(1.0, expectedCount)));
+    }
+
+    auto candidateIndices = indices(candidates);
+    auto W = index_select(p.W[0], p.transB ? 0 : -1, candidateIndices);
+    auto b = constant(Shape{1, (int)candidates.size()}, corrections);
+    if(p.b[0])
+      b = index_select(p.b[0], -1, candidateIndices) + b;
+    return affine_cross_entropy(atleast_3d(p.x), W, b, indices(candidateLabels), p.transB, labelSmoothing, p.chunkRows, chunkVocab);
+  }
+
   // This function assumes that the object holds one or more factor logits.
   // It applies the supplied loss function to each, and then returns the aggregate loss over all factors.
   Expr Logits::applyLossFunction(const Words& labels, const std::function<Expr(Expr/*logits*/, Expr/*indices*/)>& lossFn) const {
+    materialize();
     LOG_ONCE(info, "[logits] Applying loss function for {} factor(s)", logits_.size());
     ABORT_IF(empty(), "Attempted to read out logits on empty Logits object");
 
@@ -69,6 +165,7 @@ namespace marian {
   // get logits for one factor group
   // For groupIndex == 0, the function also requires the shortlist if there is one.
   Expr Logits::getFactoredLogits(size_t groupIndex, Ptr<data::Shortlist> shortlist /*= nullptr*/, const std::vector<IndexType>& hypIndices /*= {}*/, size_t beamSize /*= 0*/) const {
+    materialize();
     ABORT_IF(empty(), "Attempted to read out logits on empty Logits object");
     auto sel = logits_[groupIndex]->loss(); // [localBeamSize, 1, dimBatch, dimFactorVocab]
 
@@ -78,13 +175,21 @@ namespace marian {
     if (groupIndex > 0) {
       sel = sel - max(sel, -1);
     }
-    else {
+    else if (getNumFactorGroups() > 1) {
+      // The maxima of all groups are added in one product with the [numGroups - 1, lemmas] masks, instead
+      // of a masked addition per group that creates two tensors of the size of the lemma logits each.
       auto numGroups = getNumFactorGroups();
+      const auto& indices = shortlist ? shortlist->indices() : std::vector<WordIndex>();
+      std::vector<Expr> factorMaxima;  // [numGroups - 1][localBeamSize, 1, dimBatch, 1]
+      std::vector<float> factorMasks;  // [numGroups - 1, lemmas]
       for (size_t g = 1; g < numGroups; g++) {
-        auto factorMaxima = max(logits_[g]->loss(), -1);
-        auto factorMasks = constant(getFactorMasks(g, shortlist ? shortlist->indices() : std::vector<WordIndex>()));
-        sel = sel + factorMaxima * factorMasks; // those lemmas that don't have a factor get multiplied with 0
+        factorMaxima.push_back(max(logits_[g]->loss(), -1));
+        auto masks = getFactorMasks(g, indices);
+        factorMasks.insert(factorMasks.end(), masks.begin(), masks.end());
       }
+      int numLemmas = sel->shape()[-1];
+      auto masks = constant({(int)numGroups - 1, numLemmas}, factorMasks);
+      sel = sel + dot(concatenate(factorMaxima, /*axis=*/-1), masks); // those lemmas that don't have a factor get multiplied with 0
     }
 
     // if selIdx are given, then we must reshuffle accordingly
@@ -96,6 +201,7 @@ namespace marian {
   // used for breakDown() only
   // Index is flattened
   Tensor Logits::getFactoredLogitsTensor(size_t groupIndex) const {
+    materialize();
     ABORT_IF(empty(), "Attempted to read out logits on empty Logits object");
     return logits_[groupIndex]->loss()->val();
   }
@@ -105,6 +211,7 @@ namespace marian {
   // This is infeasible for realistic factor sets, and therefore only implemented for 1 factor.
   // @TODO: remove altogether
   Expr Logits::getLogits() const {
+    materialize();
     ABORT_IF(empty(), "Attempted to read out logits on empty Logits object");
     if (!factoredVocab_) {
       ABORT_IF(logits_.size() != 1, "Factors without factor mappings??");
@@ -147,16 +254,18 @@ namespace marian {
 
   std::vector<Logits::MaskedFactorIndices> Logits::factorizeWords(const Words& words) const { // [numGroups][words.size()] -> breaks encoded Word into individual factor indices
     if (!factoredVocab_) {
-      ABORT_IF(logits_.size() != 1, "Factors without factor mappings??");
+      ABORT_IF(getNumFactorGroups() != 1, "Factors without factor mappings??");
       return {MaskedFactorIndices(words)};
     }
     auto numGroups = factoredVocab_->getNumGroups();
     std::vector<MaskedFactorIndices> res(numGroups);
-    for (size_t g = 0; g < numGroups; g++) {
-      auto& resg = res[g];
+    for (auto& resg : res)
       resg.reserve(words.size());
-      for (const auto& word : words)
-        resg.push_back(factoredVocab_->getFactor(word, g));
+    std::vector<size_t> factorIndices(numGroups);
+    for (const auto& word : words) { // decode each word once for all groups
+      factoredVocab_->word2factors(word, factorIndices.data());
+      for (size_t g = 0; g < numGroups; g++)
+        res[g].push_back(factorIndices[g]);
     }
     return res;
   }
@@ -187,6 +296,7 @@ namespace marian {
   }
 
   Logits Logits::applyUnaryFunction(const std::function<Expr(Expr)>& f) const { // clone this but apply f to all loss values
+    materialize();
     std::vector<Ptr<RationalLoss>> newLogits;
     for (const auto& l : logits_)
       newLogits.emplace_back(New<RationalLoss>(f(l->loss()), l->count()));
@@ -194,6 +304,7 @@ namespace marian {
   }
 
   Logits Logits::applyUnaryFunctions(const std::function<Expr(Expr)>& f1, const std::function<Expr(Expr)>& fother) const {
+      materialize();
       std::vector<Ptr<RationalLoss>> newLogits;
       bool first = true;
       for (const auto& l : logits_) {
@@ -205,6 +316,7 @@ namespace marian {
 
   // @TODO: code dup with above; we can merge it into applyToRationalLoss()
   Logits Logits::withCounts(const Expr& count) const { // create new Logits with 'count' implanted into all logits_
+    materialize();
     std::vector<Ptr<RationalLoss>> newLogits;
     for (const auto& l : logits_)
       newLogits.emplace_back(New<RationalLoss>(l->loss(), count));
@@ -221,7 +333,7 @@ namespace marian {
       if(!lsh_ && options_->hasAndNotEmpty("output-approx-knn")) {
         auto k     = opt<std::vector<int>>("output-approx-knn")[0];
         auto nbits = opt<std::vector<int>>("output-approx-knn")[1];
-        lsh_ = New<LSH>(k, nbits);
+        lsh_ = New<LSH>(k, nbits, opt<std::string>("output-approx-knn-index", ""));
       }
 
       auto name = options_->get<std::string>("prefix");
@@ -261,6 +373,47 @@ namespace marian {
       }
     }
 
+    // Sets cachedShortWt_ and cachedShortb_ from the cache of the short-listed parameters of earlier
+    // batches, or gathers them with indices of known content, which makes the graph memoize them,
+    // and evicts the least recently used entry if the cache is full
+    void Output::lookupShortlistCache() {
+      const auto& indices = shortlist_->indices();
+      auto it = std::find_if(shortlistCache_.begin(), shortlistCache_.end(),
+                             [&](const ShortlistCacheEntry& entry) { return entry.indices == indices; });
+      if(it == shortlistCache_.end()) {
+        size_t capacity = options_->get<size_t>("shortlist-cache");
+        while(shortlistCache_.size() >= capacity) {
+          for(auto expr : {shortlistCache_.back().Wt, shortlistCache_.back().b, shortlistCache_.back().indicesExpr})
+            graph_->forgetMemoized(expr);
+          shortlistCache_.pop_back();
+        }
+
+        size_t contentHash = util::hash<std::string>()("shortlist");
+        for(auto i : indices)
+          util::hash_combine(contentHash, i);
+        auto init = inits::fromVector(indices);
+        init->setContentHash(contentHash); // memoized in inference
+        auto indicesExpr = graph_->constant({(int)indices.size()}, init, Type::uint32);
+
+        ShortlistCacheEntry entry;
+        entry.indices = indices;
+        entry.indicesExpr = indicesExpr;
+        entry.Wt = index_select(Wt_, isLegacyUntransposedW ? -1 : 0, indicesExpr);
+        if(hasBias_)
+          entry.b = index_select(b_, -1, indicesExpr);
+        if(!entry.Wt->memoize() || (entry.b && !entry.b->memoize())) { // too large to be memoized
+          cachedShortWt_ = entry.Wt;
+          cachedShortb_  = entry.b;
+          return;
+        }
+        shortlistCache_.push_front(std::move(entry));
+      } else {
+        shortlistCache_.splice(shortlistCache_.begin(), shortlistCache_, it);
+      }
+      cachedShortWt_ = shortlistCache_.front().Wt;
+      cachedShortb_  = shortlistCache_.front().b;
+    }
+
     Logits Output::applyAsLogits(Expr input) /*override final*/ {
       lazyConstruct(input->shape()[-1]);
 
@@ -281,13 +434,38 @@ namespace marian {
         }
       };
 
+      if (shortlist_ && !cachedShortWt_ && graph_->isInference() && options_->get<size_t>("shortlist-cache", 0) > 0
+          && !isIntgemm(Wt_->value_type()) && !isPacked(Wt_->value_type()) && !isColQuantized(Wt_->value_type()))
+        lookupShortlistCache();
       if (shortlist_ && !cachedShortWt_) { // shortlisted versions of parameters are cached within one batch, then clear()ed
         cachedShortWt_  = index_select(Wt_, isLegacyUntransposedW ? -1 : 0, shortlist_->indices());
         if(hasBias_)
           cachedShortb_ = index_select(b_ ,                             -1, shortlist_->indices());
       }
 
-      if (factoredVocab_) {
+      // training with --output-loss-chunk or --output-loss-vocab-chunk: the cross-entropy is computed
+      // without the logits of the whole batch; with --output-sampled-softmax, only over some of the words
+      int chunkRows  = options_->get<int>("output-loss-chunk", 0);
+      int chunkVocab = options_->get<int>("output-loss-vocab-chunk", 0);
+      int sampled    = options_->get<int>("output-sampled-softmax", 0);
+      bool deferred = !lsh_ && !graph_->isInference() && (chunkRows > 0 || chunkVocab > 0 || sampled > 0);
+      if (sampled > 0 && deferred && factoredVocab_)
+        LOG_ONCE(warn, "[logits] A sampled softmax is not supported for factored vocabularies, ignoring --output-sampled-softmax");
+
+      if (factoredVocab_ && deferred && !shortlist_ && options_->get<int>("lemma-dim-emb", 0) == 0) {
+        // the factor groups are independent projections of the input
+        auto numGroups = factoredVocab_->getNumGroups();
+        std::vector<Expr> factorWts(numGroups), factorBs(numGroups);
+        for (size_t g = 0; g < numGroups; g++) {
+          auto range = factoredVocab_->getGroupRange(g);
+          if (g > 0 && range.first == range.second) // empty entry
+            continue;
+          factorWts[g] = slice(Wt_, isLegacyUntransposedW ? -1 : 0, Slice((int)range.first, (int)range.second));
+          if(hasBias_)
+            factorBs[g] = slice(b_, -1, Slice((int)range.first, (int)range.second));
+        }
+        return Logits(input, factorWts, factorBs, /*transB=*/isLegacyUntransposedW ? false : true, chunkRows, chunkVocab, factoredVocab_);
+      } else if (factoredVocab_) {
         auto graph = input->graph();
 
         // project each factor separately
@@ -429,6 +607,8 @@ namespace marian {
         return Logits(std::move(allLogits), factoredVocab_);
       } else if (shortlist_) {
         return Logits(affineOrLSH(input, cachedShortWt_, cachedShortb_, false, /*transB=*/isLegacyUntransposedW ? false : true));
+      } else if (deferred) {
+        return Logits(input, {Wt_}, {b_}, /*transB=*/isLegacyUntransposedW ? false : true, chunkRows, chunkVocab, nullptr, sampled);
       } else {
         return Logits(affineOrLSH(input, Wt_, b_, false, /*transB=*/isLegacyUntransposedW ? false : true));
       }
@@ -461,6 +641,7 @@ namespace marian {
     }
 
     E_ = graph_->param(name, {dimVoc, dimEmb}, initFunc, fixed);
+    ABORT_IF(factoredVocab_ && isRowQuantized(E_->value_type()), "Factored embeddings {} cannot be quantized", name);
   }
 
   // helper to embed a sequence of words (given as indices) via factored embeddings
@@ -546,7 +727,14 @@ namespace marian {
     ABORT_IF(factoredVocab_, "Embedding: applyIndices must not be used with a factored vocabulary");
     auto embIdxExpr = E_->graph()->indices(embIdx);
     embIdxExpr->set_name("data_" + std::to_string(/*batchIndex_=*/0));  // @TODO: how to know the batch index?
-    auto selectedEmbs = rows(E_, embIdxExpr);     // [(B*W) x E]
+    return applyIndices(embIdxExpr, shape);
+  }
+
+  Expr Embedding::applyIndices(Expr embIdx, const Shape& shape) const /*override final*/ {
+    ABORT_IF(factoredVocab_, "Embedding: applyIndices must not be used with a factored vocabulary");
+    if(embIdx->shape().size() != 1) // e.g. [dimBeam, 1, dimBatch, 1] from argmax()
+      embIdx = reshape(embIdx, {(int)embIdx->shape().elements()});
+    auto selectedEmbs = rows(E_, embIdx);         // [(B*W) x E]
     selectedEmbs = reshape(selectedEmbs, shape);  // [W, B, E]
     // @BUGBUG: We should not broadcast along dimBatch=[-2]. Then we can also dropout before reshape() (test that separately)
     selectedEmbs = dropout(selectedEmbs, options_->get<float>("dropout", 0.0f), { selectedEmbs->shape()[-3], 1, 1 });
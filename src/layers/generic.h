@@ -5,6 +5,8 @@
 #include "data/shortlist.h"
 #include "layers/factory.h"
 
+#include <list>
+
 namespace marian { namespace mlp {
   /**
    * @brief Activation functions
@@ -26,15 +28,26 @@ public:
   LayerBase(Ptr<ExpressionGraph> graph, Ptr<Options> options)
       : graph_(graph), options_(options) {}
 
+  // string literals are looked up directly, without constructing a std::string in every step
   template <typename T>
-  T opt(const std::string key) const {
+  T opt(const char* const key) const {
     return options_->get<T>(key);
   }
 
   template <typename T>
-  T opt(const std::string key, const T& defaultValue) const {
+  T opt(const char* const key, const T& defaultValue) const {
     return options_->get<T>(key, defaultValue);
   }
+
+  template <typename T>
+  T opt(const std::string& key) const {
+    return options_->get<T>(key.c_str());
+  }
+
+  template <typename T>
+  T opt(const std::string& key, const T& defaultValue) const {
+    return options_->get<T>(key.c_str(), defaultValue);
+  }
 };
 
 // Simplest layer interface: Unary function
@@ -60,6 +73,9 @@ struct IEmbeddingLayer {
 
   // alternative from indices directly
   virtual Expr applyIndices(const std::vector<WordIndex>& embIdx, const Shape& shape) const = 0;
+
+  // alternative from indices that are already on the device, e.g. the output of argmax()
+  virtual Expr applyIndices(Expr embIdx, const Shape& shape) const = 0;
   virtual ~IEmbeddingLayer() {}
 };
 
@@ -114,12 +130,21 @@ public:
     explicit Logits(Expr logits); // single-output constructor from Expr only (RationalLoss has no count)
     Logits(std::vector<Ptr<RationalLoss>>&& logits, Ptr<FactoredVocab> embeddingFactorMapping) // factored-output constructor
       : logits_(std::move(logits)), factoredVocab_(embeddingFactorMapping) {}
+    // logits affine(x, W[g], b[g], false, transB) of each factor group g that are only created when they are
+    // read out; applyCrossEntropy() computes the cross-entropy from x directly, chunkRows rows and chunkVocab
+    // words at a time (0 for all). W[g] is null for empty factor groups, factoredVocab null for a single output.
+    // With sampled > 0, the cross-entropy of a single output is a sampled softmax, see --output-sampled-softmax.
+    Logits(Expr x, const std::vector<Expr>& W, const std::vector<Expr>& b, bool transB, int chunkRows, int chunkVocab,
+           Ptr<FactoredVocab> factoredVocab = nullptr, int sampled = 0)
+      : factoredVocab_(factoredVocab), projection_(New<Projection>(Projection{x, W, b, transB, chunkRows, chunkVocab, sampled})) {}
     Expr getLogits() const; // assume it holds logits: get them, possibly aggregating over factors
     Expr getFactoredLogits(size_t groupIndex, Ptr<data::Shortlist> shortlist = nullptr, const std::vector<IndexType>& hypIndices = {}, size_t beamSize = 0) const; // get logits for only one factor group, with optional reshuffle
     //Ptr<RationalLoss> getRationalLoss() const; // assume it holds a loss: get that
     Expr applyLossFunction(const Words& labels, const std::function<Expr(Expr/*logits*/,Expr/*indices*/)>& lossFn) const;
     Logits applyUnaryFunction(const std::function<Expr(Expr)>& f) const; // clone this but apply f to all loss values
     Logits applyUnaryFunctions(const std::function<Expr(Expr)>& f1, const std::function<Expr(Expr)>& fother) const; // clone this but apply f1 to first and fother to to all other values
+    bool isDeferred() const { return projection_ != nullptr; } // see the (x, W, b) constructor
+    Expr applyCrossEntropy(const Words& labels, float labelSmoothing, float factorWeight) const; // cross-entropy of deferred logits, see affine_cross_entropy()
 
     struct MaskedFactorIndices {
       std::vector<WordIndex> indices; // factor index, or 0 if masked
@@ -131,8 +156,8 @@ public:
     };
     std::vector<MaskedFactorIndices> factorizeWords(const Words& words) const; // breaks encoded Word into individual factor indices
     Tensor getFactoredLogitsTensor(size_t factorGroup) const; // used for breakDown() only
-    size_t getNumFactorGroups() const { return logits_.size(); }
-    bool empty() const { return logits_.empty(); }
+    size_t getNumFactorGroups() const { return projection_ ? projection_->W.size() : logits_.size(); }
+    bool empty() const { return !projection_ && logits_.empty(); }
     Logits withCounts(const Expr& count) const; // create new Logits with 'count' implanted into all logits_
 private:
     // helper functions
@@ -142,11 +167,21 @@ private:
     template<typename T> Expr constant(const std::vector<T>& data) const { return constant(Shape{(int)data.size()}, data); } // same as constant() but assuming vector
     Expr indices(const std::vector<uint32_t>& data) const { return graph()->indices(data); } // actually the same as constant(data) for this data type
     std::vector<float> getFactorMasks(size_t factorGroup, const std::vector<WordIndex>& indices) const;
+    void materialize() const; // creates the logits of a projection_
+    Expr applySampledCrossEntropy(const Words& labels, float labelSmoothing, int chunkVocab) const; // see --output-sampled-softmax
 private:
     // members
     // @TODO: we don't use the RationalLoss component anymore, can be removed again, and replaced just by the Expr
-    std::vector<Ptr<RationalLoss>> logits_; // [group id][B..., num factors in group]
+    mutable std::vector<Ptr<RationalLoss>> logits_; // [group id][B..., num factors in group]
     Ptr<FactoredVocab> factoredVocab_;
+    struct Projection {
+      Expr x;
+      std::vector<Expr> W, b; // [group id]
+      bool transB;
+      int chunkRows, chunkVocab;
+      int sampled; // number of sampled negative words, 0 for the full softmax
+    };
+    Ptr<Projection> projection_; // deferred logits, created by materialize() once they are read out
 };
 
 // Unary function that returns a Logits object
@@ -250,6 +285,18 @@ private:
   Expr cachedShortb_;   // these match the current value of shortlist_
   Expr cachedShortLemmaEt_;
   Ptr<FactoredVocab> factoredVocab_;
+
+  // Short-listed parameters kept across batches in inference with --shortlist-cache, most recently
+  // used first. They are memoized by the graph until they are evicted.
+  struct ShortlistCacheEntry {
+    std::vector<WordIndex> indices;
+    Expr indicesExpr;
+    Expr Wt;
+    Expr b;
+  };
+  std::list<ShortlistCacheEntry> shortlistCache_;
+
+  void lookupShortlistCache();
   
   // optional parameters set/updated after construction
   Expr tiedParam_;
@@ -313,6 +360,8 @@ public:
   Expr apply(const Words& words, const Shape& shape) const override final;
 
   Expr applyIndices(const std::vector<WordIndex>& embIdx, const Shape& shape) const override final;
+
+  Expr applyIndices(Expr embIdx, const Shape& shape) const override final;
 };
 
 class ULREmbedding : public LayerBase, public IEmbeddingLayer {
@@ -381,15 +430,33 @@ public:
   }
 
   std::tuple<Expr/*embeddings*/, Expr/*mask*/> apply(Ptr<data::SubBatch> subBatch) const override final {
+    int dimBatch = (int)subBatch->batchSize();
+    int dimEmb = ulrEmbeddings_[2]->shape()[-1];
+    int dimWords = (int)subBatch->batchWidth();
+    auto batchEmbeddings = applyIndices(toWordIndexVector(subBatch->data()), { dimWords, dimBatch, dimEmb });
+    auto graph = ulrEmbeddings_.front()->graph();
+    auto batchMask = graph->constant({ dimWords, dimBatch, 1 },
+                                     inits::fromVector(subBatch->mask()));
+    if(!inference_)
+      batchEmbeddings = dropout(batchEmbeddings, options_->get<float>("dropout-embeddings", 0.0f), {batchEmbeddings->shape()[-3], 1, 1});
+    return std::make_tuple(batchEmbeddings, batchMask);
+  }
+
+  Expr apply(const Words& words, const Shape& shape) const override final {
+    return applyIndices(toWordIndexVector(words), shape);
+  }
+
+  Expr applyIndices(const std::vector<WordIndex>& embIdx, const Shape& shape) const override final {
+    return applyIndices(ulrEmbeddings_.front()->graph()->indices(embIdx), shape);
+  }
+
+  Expr applyIndices(Expr embIdx, const Shape& shape) const override final {
     auto queryEmbed   = ulrEmbeddings_[0]; // Q : dimQueries*dimUlrEmb
     auto keyEmbed     = ulrEmbeddings_[1]; // K : dimKeys*dimUlrEmb
     auto uniEmbed     = ulrEmbeddings_[2]; // E : dimQueries*dimEmb
     auto srcEmbed     = ulrEmbeddings_[3]; // I : dimQueries*dimEmb
     auto ulrTransform = ulrEmbeddings_[4]; // A : dimUlrEmb *dimUlrEmb
     auto ulrSharable  = ulrEmbeddings_[5]; // alpha : dimQueries*1
-    int dimBatch = (int)subBatch->batchSize();
-    int dimEmb = uniEmbed->shape()[-1];
-    int dimWords = (int)subBatch->batchWidth();
     // D = K.A.QT
     // dimm(K) = univ_tok_vocab*uni_embed_size
     // dim A = uni_embed_size*uni_embed_size
@@ -398,7 +465,8 @@ public:
     // note all above can be precombuted and serialized if A is not trainiable and during decoding (TBD)
     // here we need to handle the mini-batch
     // extract raws corresponding to Xs in this minibatch from Q
-    auto embIdx = toWordIndexVector(subBatch->data());
+    if(embIdx->shape().size() != 1) // e.g. [dimBeam, 1, dimBatch, 1] from argmax()
+      embIdx = reshape(embIdx, {(int)embIdx->shape().elements()});
     auto queryEmbeddings = rows(queryEmbed, embIdx);
     auto srcEmbeddings = rows(srcEmbed, embIdx);   // extract trainable src embeddings
     auto alpha = rows(ulrSharable, embIdx);  // extract sharable flags
@@ -417,22 +485,7 @@ public:
     auto weights = softmax(z / tau);  // assume default  is dim=-1, what about temprature? - scaler ??
     auto chosenEmbeddings = dot(weights, uniEmbed);  // AVERAGE
     auto chosenEmbeddings_mix = srcEmbeddings + alpha * chosenEmbeddings;  // this should be elementwise  broadcast
-    auto batchEmbeddings = reshape(chosenEmbeddings_mix, { dimWords, dimBatch, dimEmb });
-    auto graph = ulrEmbeddings_.front()->graph();
-    auto batchMask = graph->constant({ dimWords, dimBatch, 1 },
-                                     inits::fromVector(subBatch->mask()));
-    if(!inference_)
-      batchEmbeddings = dropout(batchEmbeddings, options_->get<float>("dropout-embeddings", 0.0f), {batchEmbeddings->shape()[-3], 1, 1});
-    return std::make_tuple(batchEmbeddings, batchMask);
-  }
-
-  Expr apply(const Words& words, const Shape& shape) const override final {
-    return applyIndices(toWordIndexVector(words), shape);
-  }
-
-  Expr applyIndices(const std::vector<WordIndex>& embIdx, const Shape& shape) const override final {
-    embIdx; shape;
-    ABORT("not implemented"); // @TODO: implement me
+    return reshape(chosenEmbeddings_mix, shape);
   }
 };
 
@@ -455,6 +508,20 @@ Expr denseInline(Expr x, std::string prefix, std::string suffix, int outDim, con
   return x;
 }
 
+// denseInline() with a ReLU, for which affineWithRelu() can fuse bias and activation into the product
+static inline
+Expr denseReluInline(Expr x, std::string prefix, std::string suffix, int outDim, float dropProb = 0.0f)
+{
+  auto graph = x->graph();
+
+  auto W = graph->param(prefix + "_W" + suffix, { x->shape()[-1], outDim }, inits::glorotUniform());
+  auto b = graph->param(prefix + "_b" + suffix, { 1,              outDim }, inits::zeros());
+
+  x = affineWithRelu(x, W, b);
+  x = dropout(x, dropProb);
+  return x;
+}
+
 static inline
 Expr layerNorm(Expr x, std::string prefix, std::string suffix = std::string()) {
   int dimModel = x->shape()[-1];
@@ -463,4 +530,13 @@ Expr layerNorm(Expr x, std::string prefix, std::string suffix = std::string()) {
   return marian::layerNorm(x, scale, bias, 1e-6f);
 }
 
+// layerNorm(dropout(x, mask) + residual, prefix, suffix) in a single pass, mask may be nullptr
+static inline
+Expr residualLayerNorm(Expr x, Expr mask, Expr residual, std::string prefix, std::string suffix = std::string()) {
+  int dimModel = x->shape()[-1];
+  auto scale = x->graph()->param(prefix + "_ln_scale" + suffix, { 1, dimModel }, inits::ones());
+  auto bias  = x->graph()->param(prefix + "_ln_bias"  + suffix, { 1, dimModel }, inits::zeros());
+  return marian::residualLayerNorm(x, mask, residual, scale, bias, 1e-6f);
+}
+
 }  // namespace marian
@@ -14,44 +14,47 @@ static inline RationalLoss guidedAlignmentCost(Ptr<ExpressionGraph> /*graph*/,
   float guidedLossWeight = options->get<float>("guided-alignment-weight");
 
   const auto& shape = attention->shape(); // [beam depth=1, max src length, batch size, tgt length]
+  auto dimBatch    = shape[-2];
+  auto dimTrgWords = shape[-1];
+  auto dimSrcWords = shape[-3];
+  ABORT_IF(shape[-4] != 1, "Guided alignments with beam??");
+  ABORT_IF(dimBatch != batch->size() || dimTrgWords != batch->widthTrg() || dimSrcWords != batch->width(), "Attention-matrix and batch shapes differ??");
+
+  // The alignment is 1 at the aligned positions and 0 elsewhere, so only the attention at the aligned positions
+  // is gathered, instead of creating the dense alignment matrix in the graph.
+  const auto& aligned = batch->getGuidedAlignment(); // ascending positions in [dimSrcWords, dimBatch, dimTrgWords] flattened, like 'attention'
+  ABORT_IF(!aligned.empty() && aligned.back() >= shape.elements(), "Guided alignment outside of the attention matrix??");
+  Expr attentionAtAligned = aligned.empty() ? nullptr : index_select(flatten(attention), -1, aligned); // [aligned.size()]
+  Expr alignedSum = aligned.empty() ? sum(flatten(attention)) * 0.f : sum(attentionAtAligned); // sum of attention * alignment
+
   float epsilon = 1e-6f;
   Expr alignmentLoss; // sum up loss over all attention/alignment positions
   size_t numLabels;
   if(guidedLossType == "ce") {
-    // normalizedAlignment is multi-hot, but ce requires normalized probabilities, so need to normalize to P(s|t)
-    auto dimBatch    = shape[-2];
-    auto dimTrgWords = shape[-1];
-    auto dimSrcWords = shape[-3];
-    ABORT_IF(shape[-4] != 1, "Guided alignments with beam??");
-    auto normalizedAlignment = batch->getGuidedAlignment(); // [dimSrcWords, dimBatch, dimTrgWords] flattened, matches shape of 'attention'
+    // the alignment is multi-hot, but ce requires normalized probabilities, so need to normalize to P(s|t)
     auto srcBatch = batch->front();
     const auto& srcMask = srcBatch->mask();
-    ABORT_IF(shape.elements() != normalizedAlignment.size(), "Attention-matrix and alignment shapes differ??");
-    ABORT_IF(dimBatch != batch->size() || dimTrgWords != batch->widthTrg() || dimSrcWords != batch->width(), "Attention-matrix and batch shapes differ??");
-    auto locate = [=](size_t s, size_t b, size_t t) { return ((s * dimBatch) + b) * dimTrgWords + t; };
-    for (size_t b = 0; b < dimBatch; b++) {
-      for (size_t t = 0; t < dimTrgWords; t++) {
-        for (size_t s = 0; s < dimSrcWords; s++)
-          ABORT_IF(locate(s, b, t) != batch->locateInGuidedAlignments(b, s, t), "locate() and locateInGuidedAlignments() differ??");
-        // renormalize the alignment such that it sums up to 1
-        float sum = 0;
-        for (size_t s = 0; s < dimSrcWords; s++)
-          sum += srcMask[srcBatch->locate(b, s)] * normalizedAlignment[locate(s, b, t)]; // these values are 0 or 1
-        if (sum != 0 && sum != 1)
-          for (size_t s = 0; s < dimSrcWords; s++)
-            normalizedAlignment[locate(s, b, t)] /= sum;
-      }
-    }
-    auto alignment = constant_like(attention, std::move(normalizedAlignment));
-    alignmentLoss = -sum(flatten(alignment * log(attention + epsilon)));
+    auto sentence = [=](IndexType i) -> size_t { return i / dimTrgWords % dimBatch; };
+    auto target   = [=](IndexType i) -> size_t { return sentence(i) * dimTrgWords + i % dimTrgWords; }; // in [dimBatch, dimTrgWords]
+    std::vector<float> sums(dimBatch * dimTrgWords, 0.f); // aligned source positions in the sentence per target position
+    for(auto i : aligned)
+      sums[target(i)] += srcMask[srcBatch->locate(sentence(i), i / dimTrgWords / dimBatch)]; // these values are 0 or 1
+    // renormalize the alignment such that it sums up to 1
+    std::vector<float> normalizedAlignment;
+    normalizedAlignment.reserve(aligned.size());
+    for(auto i : aligned)
+      normalizedAlignment.push_back(sums[target(i)] != 0 ? 1.f / sums[target(i)] : 1.f);
+    if(aligned.empty())
+      alignmentLoss = alignedSum;
+    else
+      alignmentLoss = -sum(constant_like(attentionAtAligned, std::move(normalizedAlignment)) * log(attentionAtAligned + epsilon));
     numLabels = batch->back()->batchWords();
     ABORT_IF(numLabels > shape.elements() / shape[-3], "Num labels of guided alignment cost is off??");
   } else {
-    auto alignment = constant_like(attention, batch->getGuidedAlignment());
-    if(guidedLossType == "mse")
-      alignmentLoss = sum(flatten(square(attention - alignment))) / 2.f;
+    if(guidedLossType == "mse") // sum over all positions of (attention - alignment)^2, with the alignment 0 or 1
+      alignmentLoss = (sum(flatten(square(attention))) - 2.f * alignedSum + (float)aligned.size()) / 2.f;
     else if(guidedLossType == "mult") // @TODO: I don't know what this criterion is for. Can we remove it?
-      alignmentLoss = -log(sum(flatten(attention * alignment)) + epsilon);
+      alignmentLoss = -log(alignedSum + epsilon);
     else
        ABORT("Unknown alignment cost type: {}", guidedLossType);
     // every position is a label as they should all agree
@@ -11,7 +11,8 @@ Ptr<LabelwiseLoss> newLoss(Ptr<Options> options, bool inference) {
 
   if(costType == "ce-rescore") {  // per-batch-item scores (while ce-mean reduces over batch)
     bool wordScores = options->get<bool>("word-scores", false);
-    return New<RescorerLoss>(wordScores);
+    bool skipSoftmax = options->get<bool>("skip-softmax", false);
+    return New<RescorerLoss>(wordScores, skipSoftmax);
   } else if(unlikelihood) {
     ABORT_IF(!options->hasAndNotEmpty("data-weighting")
              && options->get<std::string>("data-weighting-type") != "word",
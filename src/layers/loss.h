@@ -346,6 +346,9 @@ protected:
                        Expr mask = nullptr, Expr labelWeights = nullptr) override {
     // logits may be factored; in that case, the getLoss() function computes one loss for each, and sums them up
     int inFactor = false;
+    if(logits.isDeferred()) // the logits are computed in chunks inside the loss, see --output-loss-chunk
+      return weighted(logits.applyCrossEntropy(labels, labelSmoothing_, factorWeight_), logits, mask, labelWeights);
+
     auto ce = logits.applyLossFunction(labels, [&](Expr logits, Expr indices) {
       logits = atleast_3d(logits); // we always assume a time and batch dimension exists.
       // for bert training or classification the time dimension is lost.
@@ -360,6 +363,10 @@ protected:
       return ce;
     });
 
+    return weighted(ce, logits, mask, labelWeights);
+  }
+
+  Expr weighted(Expr ce, const Logits& logits, Expr mask, Expr labelWeights) {
     if(mask)
       ce = ce * cast(mask, Type::float32);
 
@@ -433,16 +440,42 @@ protected:
  */
 class RescorerLoss : public CrossEntropyLoss {
 private:
-  bool wordScores_{false};  // compute word-level log probabilities
+  bool wordScores_{false};   // compute word-level log probabilities
+  bool skipSoftmax_{false};  // use raw logits instead of log probabilities
 
 public:
   // For sentence-wise CE reduce only over time axis.
   // For word-level CE do not reduce over any axis.
-  RescorerLoss(bool wordScores)
+  RescorerLoss(bool wordScores, bool skipSoftmax = false)
       : CrossEntropyLoss(/*axes=*/wordScores ? std::vector<int>({}) : std::vector<int>({-3}),
                          /*smoothing=*/0.f,
                          /*factorWeight=*/1.0f),
-        wordScores_(wordScores) {}
+        wordScores_(wordScores),
+        skipSoftmax_(skipSoftmax) {}
+
+protected:
+  // Without softmax the negated logit of each label is selected, which saves the normalization over
+  // the whole vocabulary. The resulting scores are not log probabilities.
+  virtual Expr compute(Logits logits, const Words& labels,
+                       Expr mask = nullptr, Expr labelWeights = nullptr) override {
+    if(!skipSoftmax_)
+      return CrossEntropyLoss::compute(logits, labels, mask, labelWeights);
+
+    auto loss = logits.applyLossFunction(labels, [&](Expr logits, Expr indices) {
+      logits = atleast_3d(logits);
+      Shape indicesShape = logits->shape();
+      indicesShape.set(-1, 1);
+      return -cast(gather(logits, /*axis=*/-1, reshape(indices, indicesShape)), Type::float32);
+    });
+
+    if(mask)
+      loss = loss * cast(mask, Type::float32);
+    if(labelWeights)
+      loss = loss * cast(labelWeights, Type::float32);
+    return loss;
+  }
+
+public:
 
   virtual RationalLoss apply(Logits logits,
                              const Words& labels,
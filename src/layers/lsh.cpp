@@ -6,8 +6,43 @@
 #include "3rd_party/faiss/IndexLSH.h"
 #endif
 
+#include "common/hash.h"
+#include "common/utils.h"
+
+#include <cstdio>
+#include <fstream>
+
 namespace marian {
 
+#if BLAS_FOUND
+namespace {
+
+const uint64_t INDEX_MAGIC = 0x5845444e4948534cULL; // "LSHINDEX" as little-endian bytes
+
+// Layout of an index file: header, rotation matrix (if rotated) and the codes of all indexed vectors
+struct IndexHeader {
+  uint64_t magic;
+  uint64_t checksum; // of the indexed vectors
+  int64_t dim;
+  int64_t nbits;
+  int64_t rows;
+  int64_t rotate;
+  int64_t rotationSize;
+  int64_t codesSize;
+};
+
+}  // namespace
+
+// Identifies the indexed vectors, e.g. the output embeddings of a model, by their content
+static size_t contentChecksum(const float* data, size_t size) {
+  size_t seed = size;
+  const uint32_t* words = (const uint32_t*)data;
+  for(size_t i = 0; i < size; ++i)
+    util::hash_combine(seed, words[i]);
+  return seed;
+}
+#endif
+
 Expr LSH::apply(Expr input, Expr W, Expr b) {
   auto idx = search(input, W);
   return affine(idx, input, W, b);
@@ -17,6 +52,8 @@ Expr LSH::search(Expr query, Expr values) {
 #if BLAS_FOUND
   ABORT_IF(query->graph()->getDeviceId().type == DeviceType::gpu,
            "LSH index (--output-approx-knn) currently not implemented for GPU");
+  ABORT_IF(values->value_type() != Type::float32,
+           "LSH index (--output-approx-knn) needs float32 weights, not {}", values->value_type());
 
   auto kShape = query->shape();
   kShape.set(-1, k_);
@@ -28,13 +65,18 @@ Expr LSH::search(Expr query, Expr values) {
     int dim = values->shape()[-1];
 
     if(!index_ || indexHash_ != values->hash()) {
-      LOG(info, "Building LSH index for vector dim {} and with hash size {} bits", dim, nbits_);
-      index_.reset(new faiss::IndexLSH(dim, nbits_, 
-                                       /*rotate=*/dim != nbits_, 
-                                       /*train_thesholds*/false));
       int vRows = values->shape().elements() / dim;
-      index_->train(vRows, values->val()->data<float>());
-      index_->add(  vRows, values->val()->data<float>());
+      size_t checksum = indexPath_.empty() ? 0 : contentChecksum(values->val()->data<float>(), (size_t)vRows * dim);
+      if(indexPath_.empty() || !loadIndex(dim, vRows, checksum)) {
+        LOG(info, "Building LSH index for vector dim {} and with hash size {} bits", dim, nbits_);
+        index_.reset(new faiss::IndexLSH(dim, nbits_,
+                                         /*rotate=*/dim != nbits_,
+                                         /*train_thesholds*/false));
+        index_->train(vRows, values->val()->data<float>());
+        index_->add(  vRows, values->val()->data<float>());
+        if(!indexPath_.empty())
+          saveIndex(checksum);
+      }
       indexHash_ = values->hash();
     }
 
@@ -60,7 +102,87 @@ Expr LSH::search(Expr query, Expr values) {
 #endif
 }
 
+#if BLAS_FOUND
+bool LSH::loadIndex(int dim, int rows, size_t checksum) {
+  std::ifstream in(indexPath_, std::ios::binary);
+  if(!in)
+    return false;
+
+  IndexHeader header;
+  in.read((char*)&header, sizeof(header));
+  if(!in || header.magic != INDEX_MAGIC || header.checksum != checksum || header.dim != dim
+     || header.nbits != nbits_ || header.rows != rows || header.rotate != (dim != nbits_)
+     || header.rotationSize != (header.rotate ? (int64_t)dim * nbits_ : 0)
+     || header.codesSize != (int64_t)rows * ((nbits_ + 7) / 8)) {
+    LOG(warn, "LSH index in {} does not match the output layer, rebuilding it", indexPath_);
+    return false;
+  }
+
+  // fill a default-constructed index to avoid re-computing the random rotation
+  Ptr<faiss::IndexLSH> index(new faiss::IndexLSH());
+  index->d = dim;
+  index->nbits = nbits_;
+  index->bytes_per_vec = (nbits_ + 7) / 8;
+  index->rotate_data = header.rotate != 0;
+  index->train_thresholds = false;
+  index->is_trained = true;
+  if(index->rotate_data) {
+    index->rrot = faiss::RandomRotationMatrix(dim, nbits_);
+    index->rrot.A.resize(header.rotationSize);
+    in.read((char*)index->rrot.A.data(), header.rotationSize * sizeof(float));
+    index->rrot.is_orthonormal = true;
+    index->rrot.is_trained = true;
+  }
+  index->codes.resize(header.codesSize);
+  in.read((char*)index->codes.data(), header.codesSize);
+  index->ntotal = rows;
+  if(!in) {
+    LOG(warn, "LSH index in {} is truncated, rebuilding it", indexPath_);
+    return false;
+  }
+
+  LOG(info, "Loaded LSH index for vector dim {} and with hash size {} bits from {}", dim, nbits_, indexPath_);
+  index_ = index;
+  return true;
+}
+
+void LSH::saveIndex(size_t checksum) const {
+  IndexHeader header;
+  header.magic        = INDEX_MAGIC;
+  header.checksum     = checksum;
+  header.dim          = index_->d;
+  header.nbits        = index_->nbits;
+  header.rows         = index_->ntotal;
+  header.rotate       = index_->rotate_data;
+  header.rotationSize = index_->rotate_data ? index_->rrot.A.size() : 0;
+  header.codesSize    = index_->codes.size();
+
+  // write to a temporary file first, so that concurrent processes never see a partial index
+  std::string tmpPath = indexPath_ + ".tmp" + std::to_string(utils::hostnameAndProcessId().second);
+  {
+    std::ofstream out(tmpPath, std::ios::binary);
+    out.write((const char*)&header, sizeof(header));
+    if(index_->rotate_data)
+      out.write((const char*)index_->rrot.A.data(), header.rotationSize * sizeof(float));
+    out.write((const char*)index_->codes.data(), header.codesSize);
+    if(!out) {
+      LOG(warn, "Could not save LSH index to {}", indexPath_);
+      std::remove(tmpPath.c_str());
+      return;
+    }
+  }
+  if(std::rename(tmpPath.c_str(), indexPath_.c_str()) != 0) {
+    LOG(warn, "Could not save LSH index to {}", indexPath_);
+    std::remove(tmpPath.c_str());
+    return;
+  }
+  LOG(info, "Saved LSH index to {}", indexPath_);
+}
+#endif
+
 Expr LSH::affine(Expr idx, Expr input, Expr W, Expr b) {
+  ABORT_IF(W->value_type() != Type::float32,
+           "LSH index (--output-approx-knn) needs float32 weights, not {}", W->value_type());
   auto outShape = input->shape();
   int dimVoc    = W->shape()[-2];
   outShape.set(-1, dimVoc);
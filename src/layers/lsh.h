@@ -1,5 +1,6 @@
 #include "graph/expression_graph.h"
 #include <memory>
+#include <string>
 
 namespace faiss {
   struct IndexLSH;
@@ -9,7 +10,8 @@ namespace marian {
 
 class LSH {  
 public:
-  LSH(int k, int nbits) : k_{k}, nbits_{nbits} {
+  LSH(int k, int nbits, const std::string& indexPath = "")
+    : k_{k}, nbits_{nbits}, indexPath_{indexPath} {
 #if !BLAS_FOUND
     ABORT("LSH-based output approximation requires BLAS library");
 #endif
@@ -24,7 +26,14 @@ private:
   int k_{100};
   int nbits_{1024};
 
+  // Optional file with a previously built index, see --output-approx-knn-index
+  std::string indexPath_;
+
   Expr search(Expr query, Expr values);
+
+  // Load the index from indexPath_ if it was built with the same parameters for the same values
+  bool loadIndex(int dim, int rows, size_t checksum);
+  void saveIndex(size_t checksum) const;
   Expr affine(Expr idx, Expr query, Expr values, Expr bias);
 };
 
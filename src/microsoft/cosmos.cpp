@@ -3,6 +3,8 @@
 #include "models/model_base.h"
 #include "models/model_factory.h"
 #include "data/text_input.h"
+#include "common/utils.h"
+#include "3rd_party/threadpool.h"
 
 #if MKL_FOUND
 #include "mkl.h"
@@ -37,19 +39,62 @@ const size_t MAX_BATCH_SIZE =  32;
 const size_t MAX_LENGTH     = 256;
 
 /** 
- * Single CPU-core implementation of an Embedder/Similiarity scorer. Turns sets of '\n' strings
- * into parallel batches and either outputs embedding vectors or similarity scores.
+ * CPU implementation of an Embedder/Similiarity scorer. Turns sets of '\n' strings into parallel
+ * batches and either outputs embedding vectors or similarity scores. The batches are computed by
+ * one or more workers, each with its own graph; the graphs share the memory of the parameters.
  */
 class Embedder {
 private: 
   Ptr<Options> options_;
-  Ptr<ExpressionGraph> graph_;
   Ptr<Vocab> vocab_;
 
-  Ptr<EmbedderModel> model_;
-  
+  std::vector<Ptr<ExpressionGraph>> graphs_; // one per worker
+  std::vector<Ptr<EmbedderModel>> models_;
+  UPtr<ThreadPool> threadPool_;              // only with more than one worker
+
+  struct BatchOutput {
+    Ptr<data::CorpusBatch> batch;
+    std::vector<float> values; // [batch size, dim]
+    int dim{0};
+  };
+
+  // Computes the model output for all batches of the input streams, on the workers in parallel
+  std::vector<BatchOutput> compute(const std::vector<std::string>& streams) {
+    auto text = New<data::TextInput>(streams,
+                                     std::vector<Ptr<Vocab>>(streams.size(), vocab_),
+                                     options_);
+    // we set runAsync=false as we are throwing exceptions instead of aborts. Exceptions and threading do not mix well.
+    data::BatchGenerator<data::TextInput> batchGenerator(text, options_, /*stats=*/nullptr, /*runAsync=*/false);
+    batchGenerator.prepare();
+
+    std::vector<BatchOutput> outputs;
+    for(auto batch : batchGenerator) {
+      outputs.emplace_back();
+      outputs.back().batch = batch;
+    }
+
+    auto computeBatch = [&](size_t i, size_t worker) {
+      auto output = models_[worker]->build(graphs_[worker], outputs[i].batch);
+      graphs_[worker]->forward();
+      output->val()->get(outputs[i].values);
+      outputs[i].dim = output->shape()[-1];
+    };
+
+    if(!threadPool_) {
+      for(size_t i = 0; i < outputs.size(); ++i)
+        computeBatch(i, 0);
+    } else {
+      std::vector<std::future<void>> computed;
+      for(size_t i = 0; i < outputs.size(); ++i)
+        computed.push_back(threadPool_->enqueue([&computeBatch, i]() { computeBatch(i, ThreadPool::currentWorker()); }));
+      for(auto& future : computed)
+        future.get(); // rethrows the exceptions of the workers here
+    }
+    return outputs;
+  }
+
 public:
-  Embedder(const std::string& modelPath, const std::string& vocabPath, bool computeSimilarity = false) {
+  Embedder(const std::string& modelPath, const std::string& vocabPath, bool computeSimilarity = false, size_t numWorkers = 1) {
     options_ = New<Options>("inference", true, 
                             "shuffle", "none",
                             "mini-batch", MAX_BATCH_SIZE,
@@ -63,10 +108,6 @@ public:
     vocab_ = New<Vocab>(options_, 0);
     vocab_->load(vocabPath, 0);
 
-    graph_ = New<ExpressionGraph>(/*inference=*/true);
-    graph_->setDevice(CPU0);
-    graph_->reserveWorkspaceMB(512);
-
     YAML::Node config;
     io::getYamlFromModel(config, "special:model.yml", modelPath);
     
@@ -74,75 +115,90 @@ public:
     modelOpts->merge(options_);
     modelOpts->merge(config);
 
-    model_ = New<EmbedderModel>(modelOpts);
-    model_->load(graph_, modelPath);
+    ABORT_IF(numWorkers == 0, "The embedder needs at least one worker");
+    for(size_t i = 0; i < numWorkers; ++i) {
+      auto graph = New<ExpressionGraph>(/*inference=*/true);
+      graph->setDevice(CPU0);
+      graph->setParameterSharing(true);
+      graph->reserveWorkspaceMB(512);
+
+      auto model = New<EmbedderModel>(modelOpts);
+      model->load(graph, modelPath);
+
+      graphs_.push_back(graph);
+      models_.push_back(model);
+    }
+    if(numWorkers > 1)
+      threadPool_.reset(new ThreadPool(numWorkers, numWorkers));
   }
 
   // Compute embedding vectors for a batch of sentences
   std::vector<std::vector<float>> embed(const std::string& input) {
-    auto text = New<data::TextInput>(std::vector<std::string>({input}), 
-                                     std::vector<Ptr<Vocab>>({vocab_}),
-                                     options_);
-    // we set runAsync=false as we are throwing exceptions instead of aborts. Exceptions and threading do not mix well.
-    data::BatchGenerator<data::TextInput> batchGenerator(text, options_, /*stats=*/nullptr, /*runAsync=*/false);
-    batchGenerator.prepare();
-
     std::vector<std::vector<float>> output;
 
-    for(auto batch : batchGenerator) {
-      auto embeddings = model_->build(graph_, batch);
-      graph_->forward();
-
-      std::vector<float> sentVectors;
-      embeddings->val()->get(sentVectors);
-
+    for(const auto& computed : compute({input})) {
       // collect embedding vector per sentence.
-      // if we compute similarities this is only one similarity per sentence pair.
-      for(size_t i = 0; i < batch->size(); ++i) {
-        auto batchIdx = batch->getSentenceIds()[i];
+      for(size_t i = 0; i < computed.batch->size(); ++i) {
+        auto batchIdx = computed.batch->getSentenceIds()[i];
         if(output.size() <= batchIdx)
           output.resize(batchIdx + 1);
         
-        int embSize = embeddings->shape()[-1];
-        size_t beg = i * embSize;
-        size_t end = (i + 1) * embSize;
-        std::vector<float> sentVector(sentVectors.begin() + beg, sentVectors.begin() + end);
-        output[batchIdx] = sentVector;
+        auto beg = computed.values.begin() + i * computed.dim;
+        output[batchIdx] = std::vector<float>(beg, beg + computed.dim);
       }
     }
 
     return output;
   }
 
+  // Compute embedding vectors for many sentences, as one [inputs, dim] buffer
+  std::vector<float> embed(const std::vector<std::string>& inputs, size_t& dim) {
+    dim = 0;
+    if(inputs.empty())
+      return {};
+
+    auto outputs = compute({utils::join(inputs, "\n")});
+    for(const auto& computed : outputs)
+      dim = std::max(dim, (size_t)computed.dim);
+
+    std::vector<float> output(inputs.size() * dim, 0.f);
+    for(const auto& computed : outputs)
+      for(size_t i = 0; i < computed.batch->size(); ++i)
+        std::copy(computed.values.begin() + i * dim,
+                  computed.values.begin() + (i + 1) * dim,
+                  output.begin() + computed.batch->getSentenceIds()[i] * dim);
+    return output;
+  }
+
   // Compute cosine similarity scores for a two batches of corresponding sentences
   std::vector<float> similarity(const std::string& input1, const std::string& input2) {
-    auto text = New<data::TextInput>(std::vector<std::string>({input1, input2}), 
-                                     std::vector<Ptr<Vocab>>({vocab_, vocab_}),
-                                     options_);
-    // we set runAsync=false as we are throwing exceptions instead of aborts. Exceptions and threading do not mix well.
-    data::BatchGenerator<data::TextInput> batchGenerator(text, options_, /*stats=*/nullptr, /*runAsync=*/false);
-    batchGenerator.prepare();
-
     std::vector<float> output;
 
-    for(auto batch : batchGenerator) {
-      auto similarities = model_->build(graph_, batch);
-      graph_->forward();
-
-      std::vector<float> vSimilarities;
-      similarities->val()->get(vSimilarities);
-
-      // collect similarity score per sentence pair.
-      for(size_t i = 0; i < batch->size(); ++i) {
-        auto batchIdx = batch->getSentenceIds()[i];
+    // collect similarity score per sentence pair.
+    for(const auto& computed : compute({input1, input2})) {
+      for(size_t i = 0; i < computed.batch->size(); ++i) {
+        auto batchIdx = computed.batch->getSentenceIds()[i];
         if(output.size() <= batchIdx)
           output.resize(batchIdx + 1);
-        output[batchIdx] = vSimilarities[i];
+        output[batchIdx] = computed.values[i];
       }
     }
 
     return output;
   };
+
+  // Compute cosine similarity scores for many pairs of sentences
+  std::vector<float> similarity(const std::vector<std::string>& inputs1, const std::vector<std::string>& inputs2) {
+    ABORT_IF(inputs1.size() != inputs2.size(), "Different numbers of sentences to compare: {} and {}", inputs1.size(), inputs2.size());
+    std::vector<float> output(inputs1.size(), 0.f);
+    if(inputs1.empty())
+      return output;
+
+    for(const auto& computed : compute({utils::join(inputs1, "\n"), utils::join(inputs2, "\n")}))
+      for(size_t i = 0; i < computed.batch->size(); ++i)
+        output[computed.batch->getSentenceIds()[i]] = computed.values[i];
+    return output;
+  }
 };
 
 /* Interface functions ***************************************************************************/
@@ -159,8 +215,13 @@ std::vector<std::vector<float>> MarianEmbedder::embed(const std::string& input)
   return embedder_->embed(input);
 }
 
-bool MarianEmbedder::load(const std::string& modelPath, const std::string& vocabPath) {
-  embedder_ = New<Embedder>(modelPath, vocabPath, /*computeSimilarity*/false);
+std::vector<float> MarianEmbedder::embedBatch(const std::vector<std::string>& inputs, size_t& dim) {
+  ABORT_IF(!embedder_, "Embedder is not defined??");
+  return embedder_->embed(inputs, dim);
+}
+
+bool MarianEmbedder::load(const std::string& modelPath, const std::string& vocabPath, size_t numWorkers) {
+  embedder_ = New<Embedder>(modelPath, vocabPath, /*computeSimilarity*/false, numWorkers);
   ABORT_IF(!embedder_, "Embedder is not defined??");
   return true;
 }
@@ -177,8 +238,13 @@ std::vector<float> MarianCosineScorer::score(const std::string& input1, const st
   return embedder_->similarity(input1, input2);
 };
 
-bool MarianCosineScorer::load(const std::string& modelPath, const std::string& vocabPath) {
-  embedder_ = New<Embedder>(modelPath, vocabPath, /*computeSimilarity*/true);
+std::vector<float> MarianCosineScorer::scoreBatch(const std::vector<std::string>& inputs1, const std::vector<std::string>& inputs2) {
+  ABORT_IF(!embedder_, "Embedder is not defined??");
+  return embedder_->similarity(inputs1, inputs2);
+}
+
+bool MarianCosineScorer::load(const std::string& modelPath, const std::string& vocabPath, size_t numWorkers) {
+  embedder_ = New<Embedder>(modelPath, vocabPath, /*computeSimilarity*/true, numWorkers);
   ABORT_IF(!embedder_, "Embedder is not defined??");
   return true;
 }
@@ -30,10 +30,18 @@ namespace cosmos {
        */
       std::vector<std::vector<float>> embed(const std::string& input);
 
+      /**
+       * `inputs` are single sentences without '\n'. They are sorted by length into batches, which
+       * the workers given to load() embed in parallel. Returns the embeddings of all inputs in order
+       * in one buffer of inputs.size() * `dim` floats, `dim` is set to the size of the embeddings.
+       */
+      std::vector<float> embedBatch(const std::vector<std::string>& inputs, size_t& dim);
+
       /** 
        * `modelPath` is a Marian model, `vocabPath` a matching SentencePiece model with *.spm suffix.
+       * `numWorkers` graphs compute batches in parallel, sharing the memory of the parameters.
        */
-      bool load(const std::string& modelPath, const std::string& vocabPath);
+      bool load(const std::string& modelPath, const std::string& vocabPath, size_t numWorkers = 1);
   };
 
   /**
@@ -53,11 +61,18 @@ namespace cosmos {
        * Returns a vector of similarity scores in order corresponding to input sentence order.
        */
       std::vector<float> score(const std::string& input1, const std::string& input2);
+
+      /**
+       * `inputs1` and `inputs2` are corresponding single sentences without '\n', see
+       * MarianEmbedder::embedBatch(). Returns the similarity scores in input order.
+       */
+      std::vector<float> scoreBatch(const std::vector<std::string>& inputs1, const std::vector<std::string>& inputs2);
       
       /** 
        * `modelPath` is a Marian model, `vocabPath` a matching SentencePiece model with *.spm suffix.
+       * `numWorkers` graphs compute batches in parallel, sharing the memory of the parameters.
        */
-      bool load(const std::string& modelPath, const std::string& vocabPath);
+      bool load(const std::string& modelPath, const std::string& vocabPath, size_t numWorkers = 1);
   };
 }
 
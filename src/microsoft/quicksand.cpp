@@ -11,6 +11,7 @@
 #include "data/alignment.h"
 #include "data/vocab_base.h"
 #include "tensors/cpu/expression_graph_packable.h"
+#include "3rd_party/threadpool.h"
 
 #if USE_FBGEMM
 #include "fbgemm/Utils.h"
@@ -59,10 +60,31 @@ private:
 
   std::vector<Ptr<Vocab>> vocabs_;
 
+  // source batch of the token id API, reused by batches of the same shape, see tokenBatch()
+  Ptr<data::CorpusBatch> tokenBatch_;
+
+  // A batch of batchSize sentences of width words, the cleared one of the previous call if it has
+  // the same shape
+  Ptr<data::CorpusBatch> tokenBatch(size_t batchSize, size_t width) {
+    if(!tokenBatch_ || tokenBatch_->size() != batchSize || tokenBatch_->width() != width) {
+      auto subBatch = New<data::SubBatch>(batchSize, width, vocabs_[0]);
+      auto tgtSubBatch = New<data::SubBatch>(batchSize, 0, vocabs_[1]); // only holds a vocab, but data is dummy
+      tokenBatch_ = New<data::CorpusBatch>(std::vector<Ptr<data::SubBatch>>{subBatch, tgtSubBatch});
+      tokenBatch_->setSentenceIds(std::vector<size_t>(batchSize, 0));
+    } else {
+      auto subBatch = tokenBatch_->front();
+      std::fill(subBatch->data().begin(), subBatch->data().end(), Word::ZERO);
+      std::fill(subBatch->mask().begin(), subBatch->mask().end(), 0.f);
+    }
+    return tokenBatch_;
+  }
+
 public:
+  // shareParameters: see ExpressionGraph::setParameterSharing(), for several decoders of one model
   BeamSearchDecoder(Ptr<Options> options,
                     const std::vector<const void*>& ptrs,
-                    const std::vector<Ptr<IVocabWrapper>>& vocabs)
+                    const std::vector<Ptr<IVocabWrapper>>& vocabs,
+                    bool shareParameters = false)
       : IBeamSearchDecoder(options, ptrs) {
 
     // copy the vocabs
@@ -75,6 +97,7 @@ public:
     DeviceId deviceId{0, DeviceType::cpu};
     device_ = New<cpu::WrappedDevice>(deviceId);
     graph_->setDevice(deviceId, device_);
+    graph_->setParameterSharing(shareParameters);
 
 #if MKL_FOUND
     mkl_set_num_threads(options->get<int>("mkl-threads", 1));
@@ -117,6 +140,12 @@ public:
 
   void setWorkspace(uint8_t* data, size_t size) override { device_->set(data, size); }
 
+  // Decodes the batches of createWarmupBatches(), requires the workspace to be set
+  void warmup(const std::vector<Ptr<data::CorpusBatch>>& batches) {
+    for(auto batch : batches)
+      New<BeamSearch>(options_, scorers_, vocabs_[1])->search(graph_, batch);
+  }
+
   QSNBestBatch decode(const QSBatch& qsBatch,
                       size_t maxLength,
                       const std::unordered_set<WordIndex>& shortlist) override {
@@ -186,6 +215,39 @@ public:
 
     return qsNbestBatch;
   }
+
+  void decode(const QSTokenBatch& tokens, const QSTokenResults& results) override {
+    size_t maxLength = 0;
+    for(size_t j = 0; j < tokens.size; ++j)
+      maxLength = std::max(maxLength, tokens.offsets[j + 1] - tokens.offsets[j]);
+    ABORT_IF(maxLength == 0, "Cannot decode a batch of empty sentences");
+
+    // interleave the words over the sentences like decode() above
+    auto batch = tokenBatch(tokens.size, maxLength);
+    auto subBatch = batch->front();
+    for(size_t j = 0; j < tokens.size; ++j) {
+      for(size_t i = 0; i < tokens.offsets[j + 1] - tokens.offsets[j]; ++i) {
+        subBatch->data()[i * tokens.size + j] = Word::fromWordIndex(tokens.ids[tokens.offsets[j] + i]);
+        subBatch->mask()[i * tokens.size + j] = 1.f;
+      }
+    }
+
+    auto search = New<BeamSearch>(options_, scorers_, vocabs_[1]);
+    Histories histories = search->search(graph_, batch);
+
+    size_t pos = 0;
+    for(size_t j = 0; j < histories.size(); ++j) {
+      auto best = histories[j]->top();
+      const auto& words = std::get<0>(best);
+      ABORT_IF(pos + words.size() > results.capacity,
+               "The translations need more than the {} ids of the result buffer", results.capacity);
+      results.offsets[j] = pos;
+      for(auto word : words)
+        results.ids[pos++] = word.toWordIndex();
+      results.scores[j] = std::get<2>(best);
+    }
+    results.offsets[histories.size()] = pos;
+  }
 };
 
 Ptr<IBeamSearchDecoder> newDecoder(Ptr<Options> options,
@@ -198,6 +260,105 @@ Ptr<IBeamSearchDecoder> newDecoder(Ptr<Options> options,
   return New<BeamSearchDecoder>(options, ptrs, vocabs/*, eos*/);
 }
 
+class AsyncBeamSearchDecoder : public IAsyncBeamSearchDecoder {
+private:
+  static const size_t ALIGNMENT = 256; // see cpu::WrappedDevice
+
+  std::vector<Ptr<BeamSearchDecoder>> decoders_; // one per worker
+  std::vector<std::vector<uint8_t>> workspaces_;
+  UPtr<ThreadPool> threadPool_; // last, so that the workers finish before the decoders are destroyed
+
+  QSNBestBatch decodeOnWorker(const QSBatch& qsBatch,
+                              size_t maxLength,
+                              const std::unordered_set<WordIndex>& shortlist) {
+    auto worker = ThreadPool::currentWorker();
+    ABORT_IF(worker >= decoders_.size(), "Batch is not decoded by a worker of the decoder");
+    return decoders_[worker]->decode(qsBatch, maxLength, shortlist);
+  }
+
+public:
+  AsyncBeamSearchDecoder(Ptr<Options> options,
+                         const std::vector<const void*>& ptrs,
+                         const std::vector<Ptr<IVocabWrapper>>& vocabs,
+                         size_t numWorkers,
+                         size_t maxQueued) {
+    ABORT_IF(numWorkers == 0, "The decoder needs at least one worker");
+    size_t workspaceBytes = (size_t)options->get<int>("workspace", 512) * 1024 * 1024;
+
+    workspaces_.resize(numWorkers);
+    for(size_t i = 0; i < numWorkers; ++i) {
+      auto decoder = New<BeamSearchDecoder>(options, ptrs, vocabs, /*shareParameters=*/true);
+      workspaces_[i].resize(workspaceBytes + ALIGNMENT);
+      auto data = workspaces_[i].data();
+      auto aligned = data + (ALIGNMENT - (size_t)data % ALIGNMENT) % ALIGNMENT;
+      decoder->setWorkspace(aligned, workspaceBytes);
+      decoders_.push_back(decoder);
+    }
+    threadPool_.reset(new ThreadPool(numWorkers, maxQueued));
+
+    // with --warmup, all workers decode synthetic batches before the first batch is queued
+    auto batches = createWarmupBatches(options, {std::dynamic_pointer_cast<VocabWrapper>(vocabs[0])->getVocab()});
+    if(!batches.empty()) {
+      std::vector<std::future<void>> warmedUp;
+      for(auto decoder : decoders_)
+        warmedUp.push_back(threadPool_->enqueue([decoder, batches]() { decoder->warmup(batches); }));
+      for(auto& f : warmedUp)
+        f.get();
+      LOG(info, "Warmed up {} workers with {} batches", decoders_.size(), batches.size());
+    }
+  }
+
+  ~AsyncBeamSearchDecoder() {
+    threadPool_.reset(); // finishes the pending batches
+  }
+
+  std::future<QSNBestBatch> decodeAsync(const QSBatch& qsBatch,
+                                        size_t maxLength,
+                                        const std::unordered_set<WordIndex>& shortlist) override {
+    return threadPool_->enqueue([this, qsBatch, maxLength, shortlist]() {
+      return decodeOnWorker(qsBatch, maxLength, shortlist);
+    });
+  }
+
+  void decodeAsync(const QSBatch& qsBatch,
+                   size_t maxLength,
+                   const std::unordered_set<WordIndex>& shortlist,
+                   QSDecodeCallback callback) override {
+    threadPool_->enqueue([this, qsBatch, maxLength, shortlist, callback]() {
+      QSNBestBatch result;
+      std::exception_ptr error;
+      try {
+        result = decodeOnWorker(qsBatch, maxLength, shortlist);
+      } catch(...) {
+        error = std::current_exception();
+      }
+      callback(result, error);
+    });
+  }
+
+  std::future<void> decodeAsync(const QSTokenBatch& batch, const QSTokenResults& results) override {
+    return threadPool_->enqueue([this, batch, results]() {
+      auto worker = ThreadPool::currentWorker();
+      ABORT_IF(worker >= decoders_.size(), "Batch is not decoded by a worker of the decoder");
+      decoders_[worker]->decode(batch, results);
+    });
+  }
+
+  size_t getNumWorkers() const override { return decoders_.size(); }
+};
+
+Ptr<IAsyncBeamSearchDecoder> newAsyncDecoder(Ptr<Options> options,
+                                             const std::vector<const void*>& ptrs,
+                                             const std::vector<Ptr<IVocabWrapper>>& vocabs,
+                                             WordIndex eosDummy, // @TODO: remove this parameter
+                                             size_t numWorkers,
+                                             size_t maxQueued) {
+  marian::setThrowExceptionOnAbort(true); // globally defined to throw now
+  ABORT_IF(marian::Word::fromWordIndex(eosDummy) != std::dynamic_pointer_cast<VocabWrapper>(vocabs[1])->getVocab()->getEosId(), "Inconsistent eos vs. vocabs_[1]");
+
+  return New<AsyncBeamSearchDecoder>(options, ptrs, vocabs, numWorkers, maxQueued);
+}
+
 std::vector<Ptr<IVocabWrapper>> loadVocabs(const std::vector<std::string>& vocabPaths) {
   std::vector<Ptr<IVocabWrapper>> res(vocabPaths.size());
   for (size_t i = 0; i < vocabPaths.size(); i++) {
@@ -1,4 +1,7 @@
 #pragma once
+#include <exception>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -25,6 +28,23 @@ typedef std::tuple<WordIndices, AlignmentSets, float> QSSentenceWithProb;
 typedef std::vector<QSSentenceWithProb> QSNBest;
 typedef std::vector<QSNBest> QSNBestBatch;
 
+// A batch of sentences as flat token ids for the decoders below, bypassing any text processing:
+// sentence j consists of ids[offsets[j]] up to ids[offsets[j + 1]], as they are fed to the model
+struct QSTokenBatch {
+  const WordIndex* ids;
+  const size_t* offsets; // size + 1 entries
+  size_t size;           // number of sentences
+};
+
+// Buffers of the caller for the best translation of each sentence of a QSTokenBatch: its ids are
+// written to ids[offsets[j]] up to ids[offsets[j + 1]] and its normalized score to scores[j]
+struct QSTokenResults {
+  WordIndex* ids;
+  size_t capacity; // number of ids that fit into ids, decoding throws if the translations need more
+  size_t* offsets; // size + 1 entries
+  float* scores;   // size entries
+};
+
 enum class DecoderCpuAvxVersion {
   AVX,
   AVX2,
@@ -61,14 +81,56 @@ public:
                               const std::unordered_set<WordIndex>& shortlist)
       = 0;
 
+  // Decodes the best translations of the token ids into the buffers of the caller. The source batch
+  // is reused by following calls with as many sentences of the same maximum length, so that these
+  // do not allocate anything outside of the search itself.
+  virtual void decode(const QSTokenBatch& batch, const QSTokenResults& results) = 0;
+
   virtual void setWorkspace(uint8_t* data, size_t size) = 0;
 };
 
+// called on a worker thread with the result of a batch, or with error set if decoding failed
+typedef std::function<void(const QSNBestBatch& result, std::exception_ptr error)> QSDecodeCallback;
+
+// Decodes batches asynchronously on a pool of workers, each with its own graph and workspace; the
+// graphs share the memory of the parameters. Submitting blocks only while the queue of pending
+// batches is full, so that callers can keep preparing batches while others are decoded.
+class IAsyncBeamSearchDecoder {
+public:
+  virtual ~IAsyncBeamSearchDecoder() {}
+
+  // the future returns the result or rethrows the exception of decoding the batch
+  virtual std::future<QSNBestBatch> decodeAsync(const QSBatch& qsBatch,
+                                                size_t maxLength,
+                                                const std::unordered_set<WordIndex>& shortlist)
+      = 0;
+
+  virtual void decodeAsync(const QSBatch& qsBatch,
+                           size_t maxLength,
+                           const std::unordered_set<WordIndex>& shortlist,
+                           QSDecodeCallback callback)
+      = 0;
+
+  // the buffers of the batch and the results have to stay valid until the future is ready
+  virtual std::future<void> decodeAsync(const QSTokenBatch& batch, const QSTokenResults& results) = 0;
+
+  virtual size_t getNumWorkers() const = 0;
+};
+
 Ptr<IBeamSearchDecoder> newDecoder(Ptr<Options> options,
                                    const std::vector<const void*>& ptrs,
                                    const std::vector<Ptr<IVocabWrapper>>& vocabs,
                                    WordIndex eos/*dummy --@TODO: remove*/);
 
+// numWorkers decoders with a workspace of options "workspace" MB each (512 by default), and a
+// queue of at most maxQueued pending batches, or an unbounded queue if 0
+Ptr<IAsyncBeamSearchDecoder> newAsyncDecoder(Ptr<Options> options,
+                                             const std::vector<const void*>& ptrs,
+                                             const std::vector<Ptr<IVocabWrapper>>& vocabs,
+                                             WordIndex eos,
+                                             size_t numWorkers,
+                                             size_t maxQueued);
+
 // load src and tgt vocabs
 std::vector<Ptr<IVocabWrapper>> loadVocabs(const std::vector<std::string>& vocabPaths);
 
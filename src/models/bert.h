@@ -75,7 +75,9 @@ public:
     : CorpusBatch(*batch),
       maskSymbol_(maskSymbol), sepSymbol_(sepSymbol), clsSymbol_(clsSymbol) {
 
-    // BERT expects a textual first stream and a second stream with class labels
+    // BERT expects a textual first stream and a second stream with class labels. The words are
+    // masked in a copy, the batch may be reused, e.g. the cached batches of the validators.
+    subBatches_.front() = New<SubBatch>(*subBatches_.front());
     auto subBatch = subBatches_.front();
     const auto& vocab = *subBatch->vocab();
 
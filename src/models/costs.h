@@ -78,6 +78,17 @@ public:
                                     weights);
     multiLoss->push_back(partialLoss);
 
+    // auxiliary losses of the early-exit layers of the decoder, weighted like guided alignment
+    float exitWeight = options_->get<float>("transformer-early-exit-weight", 0.f);
+    if(exitWeight > 0.f && !inference_) {
+      bool sum = options_->get<std::string>("multi-loss-type", "sum") == "sum";
+      for(const auto& exitLogits : encdec->getDecoders()[0]->getExitLogits()) {
+        auto exitLoss = loss_->apply(exitLogits, state->getTargetWords(), state->getTargetMask(), weights);
+        multiLoss->push_back(RationalLoss(exitWeight * exitLoss.loss(),
+                                          sum ? exitWeight * exitLoss.count() : exitLoss.count()));
+      }
+    }
+
     if(options_->get("guided-alignment", std::string("none")) != "none" && !inference_) {
       auto attentionVectors = encdec->getDecoders()[0]->getAlignments(); // [tgt index][beam depth, max src length, batch size, 1]
       ABORT_IF(attentionVectors.empty(), "Model does not seem to support alignments");
@@ -292,13 +303,20 @@ public:
 
 // Gumbel-max noising for sampling during beam-search
 // Seems to work well enough with beam-size=1. Turn on
-// with --output-sampling during translation with marian-decoder
+// with --output-sampling during translation with marian-decoder.
+// The logits are divided by --output-sampling-temperature before the noise is added.
 class GumbelSoftmaxStep : public ILogProbStep {
+  float temperature_;
+
 public:
+  GumbelSoftmaxStep(float temperature = 1.f) : temperature_(temperature) {}
   virtual ~GumbelSoftmaxStep() {}
   virtual Ptr<DecoderState> apply(Ptr<DecoderState> state) override {
+    float invTemperature = 1.f / temperature_;
     state->setLogProbs(state->getLogProbs().applyUnaryFunctions(
-      [](Expr logits){ // lemma gets gumbelled
+      [invTemperature](Expr logits){ // lemma gets gumbelled
+        if(invTemperature != 1.f)
+          logits = logits * invTemperature;
         return logsoftmax(logits + constant_like(logits, inits::gumbel()));
       },
       logsoftmax)); // factors don't
@@ -361,6 +379,22 @@ public:
     return cost_->apply(nextState);
   }
 
+  virtual Ptr<DecoderState> step(Ptr<ExpressionGraph> graph,
+                                 Ptr<DecoderState> state,
+                                 Expr words,
+                                 int dimBatch) override {
+    auto nextState = encdec_->step(graph, state, words, dimBatch);
+    return cost_->apply(nextState);
+  }
+
+  virtual Ptr<DecoderState> stepTokens(Ptr<ExpressionGraph> graph,
+                                       Ptr<DecoderState> state,
+                                       const Words& words,
+                                       int dimBatch) override {
+    auto nextState = encdec_->stepTokens(graph, state, words, dimBatch);
+    return cost_->apply(nextState);
+  }
+
   virtual Logits build(Ptr<ExpressionGraph> /*graph*/,
                        Ptr<data::CorpusBatch> /*batch*/,
                        bool /*clearGraph*/ = true) override {
@@ -72,8 +72,37 @@ public:
     state->setTargetHistoryEmbeddings(selectedEmbs);
   }
 
+  // embeddings of several consecutive tokens per sentence for a single step over all of them, with
+  // words[t * dimBatch + b] the t-th token of the b-th sentence
+  virtual void embeddingsFromTokens(Ptr<ExpressionGraph> graph,
+                                    Ptr<DecoderState> state,
+                                    const Words& words,
+                                    int dimBatch) {
+    graph_ = graph;
+    int dimEmb = opt<int>("dim-emb");
+    int dimTokens = (int)words.size() / dimBatch;
+    state->setTargetHistoryEmbeddings(getEmbeddingLayer()->apply(words, {1, dimTokens, dimBatch, dimEmb}));
+  }
+
+  // same as above for the word indices of the previous step as an expression [dimBeam, 1, dimBatch, 1],
+  // which stays on the device, see --device-search-sync
+  virtual void embeddingsFromPrediction(Ptr<ExpressionGraph> graph,
+                                        Ptr<DecoderState> state,
+                                        Expr words,
+                                        int dimBatch,
+                                        int dimBeam) {
+    ABORT_IF(shortlist_, "Word indices on the device are not supported with a shortlist");
+    graph_ = graph;
+    auto embeddingLayer = getEmbeddingLayer();
+    int dimEmb = opt<int>("dim-emb");
+    state->setTargetHistoryEmbeddings(embeddingLayer->applyIndices(words, {dimBeam, 1, dimBatch, dimEmb}));
+  }
+
   virtual const std::vector<Expr> getAlignments(int /*i*/ = 0) { return {}; }; // [tgt index][beam depth, max src length, batch size, 1]
 
+  // logits of the early-exit layers for their auxiliary losses in training, if any
+  virtual const std::vector<Logits> getExitLogits() { return {}; }
+
   virtual Ptr<data::Shortlist> getShortlist() { return shortlist_; }
   virtual void setShortlist(Ptr<data::Shortlist> shortlist) {
     shortlist_ = shortlist;
@@ -174,11 +174,41 @@ void EncoderDecoder::clear(Ptr<ExpressionGraph> graph) {
     dec->clear();
 }
 
+std::vector<Ptr<EncoderState>> EncoderDecoder::encode(Ptr<ExpressionGraph> graph,
+                                                      Ptr<data::CorpusBatch> batch) {
+  // When rescoring n-best lists, the candidates of one source are encoded once and its encoding is
+  // broadcast to all of them
+  std::vector<size_t> firstIndices;
+  std::vector<IndexType> sourceIndices;
+  if(opt<bool>("share-source-encoding", false) && opt<std::string>("guided-alignment", "none") == "none"
+     && batch->getDataWeights().empty())
+    sourceIndices = batch->distinctSources(firstIndices);
+
+  std::vector<Ptr<EncoderState>> encoderStates;
+  if(!sourceIndices.empty() && firstIndices.size() < batch->size()) {
+    auto sourceBatch = batch->select(firstIndices);
+    for(auto& encoder : encoders_)
+      encoderStates.push_back(encoder->build(graph, sourceBatch)->select(sourceIndices, batch));
+  } else {
+    for(auto& encoder : encoders_)
+      encoderStates.push_back(encoder->build(graph, batch));
+  }
+  return encoderStates;
+}
+
+void EncoderDecoder::setEncoderStates(const std::vector<Ptr<EncoderState>>& encoderStates) {
+  ABORT_IF(!encoderStates.empty() && encoderStates.size() != encoders_.size(),
+           "Expected {} encoder states, got {}", encoders_.size(), encoderStates.size());
+  pendingEncoderStates_ = encoderStates;
+}
+
 Ptr<DecoderState> EncoderDecoder::startState(Ptr<ExpressionGraph> graph,
                                              Ptr<data::CorpusBatch> batch) {
   std::vector<Ptr<EncoderState>> encoderStates;
-  for(auto& encoder : encoders_)
-    encoderStates.push_back(encoder->build(graph, batch));
+  if(pendingEncoderStates_.empty())
+    encoderStates = encode(graph, batch);
+  else
+    encoderStates.swap(pendingEncoderStates_);
 
   // initialize shortlist here
   if(shortlistGenerator_) {
@@ -205,6 +235,22 @@ Ptr<DecoderState> EncoderDecoder::step(Ptr<ExpressionGraph> graph,
   return nextState;
 }
 
+Ptr<DecoderState> EncoderDecoder::step(Ptr<ExpressionGraph> graph,
+                                       Ptr<DecoderState> state,
+                                       Expr words,    // [1, 1, dimBatch, 1]
+                                       int dimBatch) {
+  decoders_[0]->embeddingsFromPrediction(graph, state, words, dimBatch, /*dimBeam=*/1);
+  return decoders_[0]->step(graph, state);
+}
+
+Ptr<DecoderState> EncoderDecoder::stepTokens(Ptr<ExpressionGraph> graph,
+                                             Ptr<DecoderState> state,
+                                             const Words& words, // [dimTokens * dimBatch]
+                                             int dimBatch) {
+  decoders_[0]->embeddingsFromTokens(graph, state, words, dimBatch);
+  return decoders_[0]->step(graph, state);
+}
+
 Ptr<DecoderState> EncoderDecoder::stepAll(Ptr<ExpressionGraph> graph,
                                           Ptr<data::CorpusBatch> batch,
                                           bool clearGraph) {
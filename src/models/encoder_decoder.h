@@ -48,6 +48,24 @@ public:
                                  int beamSize)
       = 0;
 
+  // decoder step from the words of the previous step given as indices on the device [1, 1, dimBatch, 1],
+  // without reordering the hypotheses, see --device-search-sync
+  virtual Ptr<DecoderState> step(Ptr<ExpressionGraph> graph,
+                                 Ptr<DecoderState> state,
+                                 Expr words,
+                                 int dimBatch)
+      = 0;
+
+  // decoder step over several tokens per sentence at once, words[t * dimBatch + b], with the
+  // log-probs of the next token after each of them [1, dimTokens, dimBatch, dimVocab]. The tokens
+  // follow the ones already consumed by the state, which is not reordered.
+  virtual Ptr<DecoderState> stepTokens(Ptr<ExpressionGraph> /*graph*/,
+                                       Ptr<DecoderState> /*state*/,
+                                       const Words& /*words*/,
+                                       int /*dimBatch*/) {
+    ABORT("Decoder steps over several tokens are not supported by this model");
+  }
+
   virtual Ptr<Options> getOptions() = 0;
 
   virtual void setShortlistGenerator(
@@ -71,6 +89,8 @@ protected:
 
   std::set<std::string> modelFeatures_;
 
+  std::vector<Ptr<EncoderState>> pendingEncoderStates_; // see setEncoderStates()
+
   Config::YamlNode getModelParameters();
   std::string getModelParametersAsString();
 
@@ -142,6 +162,14 @@ public:
 
   /*********************************************************************/
 
+  // runs all encoders on the source side of the batch
+  virtual std::vector<Ptr<EncoderState>> encode(Ptr<ExpressionGraph> graph,
+                                                Ptr<data::CorpusBatch> batch);
+
+  // The next startState() starts from these encoder states instead of running the encoders, e.g. with
+  // the outputs of encoders that were computed in another graph. Used once, then cleared.
+  void setEncoderStates(const std::vector<Ptr<EncoderState>>& encoderStates);
+
   virtual Ptr<DecoderState> startState(Ptr<ExpressionGraph> graph,
                                        Ptr<data::CorpusBatch> batch) override;
 
@@ -152,6 +180,16 @@ public:
                                  const std::vector<IndexType>& batchIndices,
                                  int beamSize) override;
 
+  virtual Ptr<DecoderState> step(Ptr<ExpressionGraph> graph,
+                                 Ptr<DecoderState> state,
+                                 Expr words,
+                                 int dimBatch) override;
+
+  virtual Ptr<DecoderState> stepTokens(Ptr<ExpressionGraph> graph,
+                                       Ptr<DecoderState> state,
+                                       const Words& words,
+                                       int dimBatch) override;
+
   virtual Ptr<DecoderState> stepAll(Ptr<ExpressionGraph> graph,
                                     Ptr<data::CorpusBatch> batch,
                                     bool clearGraph = true);
@@ -371,7 +371,8 @@ Ptr<IModel> createModelFromOptions(Ptr<Options> options, usage use) {
   if (use == usage::translation) {
     if(std::dynamic_pointer_cast<EncoderDecoder>(baseModel)) {
       if(options->get<bool>("output-sampling", false))
-        return New<Stepwise>(std::dynamic_pointer_cast<EncoderDecoder>(baseModel), New<GumbelSoftmaxStep>());
+        return New<Stepwise>(std::dynamic_pointer_cast<EncoderDecoder>(baseModel),
+                             New<GumbelSoftmaxStep>(options->get<float>("output-sampling-temperature", 1.f)));
       else
         return New<Stepwise>(std::dynamic_pointer_cast<EncoderDecoder>(baseModel), New<LogSoftmaxStep>());
     }
@@ -320,6 +320,9 @@ public:
       last("lemma-dim-emb", opt<int>("lemma-dim-emb", 0)); // for factored outputs
       
       last("output-omit-bias", opt<bool>("output-omit-bias", false)); 
+      last("output-loss-chunk", opt<int>("output-loss-chunk", 0));
+      last("output-loss-vocab-chunk", opt<int>("output-loss-vocab-chunk", 0));
+      last("output-sampled-softmax", opt<int>("output-sampled-softmax", 0));
 
       // assemble layers into MLP and apply to embeddings, decoder context and
       // aligned source context
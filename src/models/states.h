@@ -27,10 +27,12 @@ public:
     return batch_->front()->data();
   }
 
-  // Sub-select active batch entries from encoder context and context mask
-  Ptr<EncoderState> select(const std::vector<IndexType>& batchIndices) { // [batchIndex] indices of active batch entries
+  // Sub-select active batch entries from encoder context and context mask. Entries may be repeated, e.g. to broadcast
+  // one encoding to several sentences of `batch`, the batch of the selected entries if it is not the one of this state
+  Ptr<EncoderState> select(const std::vector<IndexType>& batchIndices, // [batchIndex] indices of active batch entries
+                           Ptr<data::CorpusBatch> batch = nullptr) {
     // Dimension -2 is OK for both, RNN and Transformer models as the encoder context in Transformer gets transposed to the same dimension layout
-    return New<EncoderState>(index_select(context_, -2, batchIndices), index_select(mask_, -2, batchIndices), batch_);
+    return New<EncoderState>(index_select(context_, -2, batchIndices), index_select(mask_, -2, batchIndices), batch ? batch : batch_);
   }
 };
 
@@ -83,6 +85,12 @@ public:
     return selectedState;
   }
 
+  // The state after the first `positions` target positions, without the later ones of a step over
+  // several positions, see IEncoderDecoder::stepTokens()
+  virtual Ptr<DecoderState> truncate(size_t /*positions*/) const {
+    ABORT("Truncating the decoder state is only supported for transformer decoders with self-attention");
+  }
+
   virtual const rnn::States& getStates() const { return states_; }
 
   virtual Expr getTargetHistoryEmbeddings() const { return targetHistoryEmbeddings_; };
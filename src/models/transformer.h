@@ -14,10 +14,97 @@
 #define _USE_MATH_DEFINES  // enables math constants. We need M_PI_2
 #include <math.h>
 
+#include <algorithm>
+#include <numeric>
+
 namespace marian {
 
 // clang-format off
 
+// Packing of the sentences of a batch into as few rows of the same width as possible, longest sentences
+// first, each into the first row with enough room. With several sides, e.g. the source and target of
+// the sentence pairs in training, a sentence takes the same row on every side and has to fit on all.
+// The sides keep their widths, so a packed row still has the length of the longest sentence.
+class SequencePacking {
+private:
+  int dimBatch_;
+  int dimRows_{0};
+  std::vector<int> dimWords_;              // [side] width
+  std::vector<std::vector<int>> lengths_;  // [side][sentence]
+  std::vector<std::vector<int>> offsetOf_; // [side][sentence] first position in its row
+  std::vector<int> rowOf_;                 // [sentence]
+
+public:
+  // masks are the [max length, batch size] masks of the sides, ordered by the lengths of the first
+  SequencePacking(const std::vector<const std::vector<float>*>& masks, const std::vector<int>& dimWords, int dimBatch)
+      : dimBatch_(dimBatch), dimWords_(dimWords), lengths_(masks.size()), offsetOf_(masks.size()), rowOf_(dimBatch) {
+    for(size_t side = 0; side < masks.size(); ++side) {
+      lengths_[side].assign(dimBatch, 0);
+      offsetOf_[side].assign(dimBatch, 0);
+      for(int i = 0; i < dimWords_[side]; ++i)
+        for(int b = 0; b < dimBatch; ++b)
+          lengths_[side][b] += (*masks[side])[i * dimBatch + b] != 0.f;
+    }
+
+    std::vector<int> order(dimBatch);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return lengths_[0][a] > lengths_[0][b]; });
+
+    std::vector<std::vector<int>> used(masks.size()); // [side][row]
+    auto fits = [&](size_t row, int b) {
+      for(size_t side = 0; side < masks.size(); ++side)
+        if(used[side][row] + lengths_[side][b] > dimWords_[side])
+          return false;
+      return true;
+    };
+    for(int b : order) {
+      size_t row = 0;
+      while(row < used[0].size() && !fits(row, b))
+        ++row;
+      for(size_t side = 0; side < masks.size(); ++side) {
+        if(row == used[side].size())
+          used[side].push_back(0);
+        offsetOf_[side][b] = used[side][row];
+        used[side][row] += lengths_[side][b];
+      }
+      rowOf_[b] = (int)row;
+    }
+    dimRows_ = (int)used[0].size();
+  }
+
+  int rows() const { return dimRows_; }
+
+  // packIndices are the positions in the [batch size, max length] layout of each position of the
+  // [rows, max length] layout of the side, unpackIndices the reverse, both 0 for padding
+  void indices(size_t side, std::vector<IndexType>& packIndices, std::vector<IndexType>& unpackIndices) const {
+    int dimWords = dimWords_[side];
+    packIndices.assign(dimRows_ * dimWords, 0);
+    unpackIndices.assign(dimBatch_ * dimWords, 0);
+    for(int b = 0; b < dimBatch_; ++b) {
+      for(int i = 0; i < lengths_[side][b]; ++i) {
+        int pos = rowOf_[b] * dimWords + offsetOf_[side][b] + i;
+        packIndices[pos] = b * dimWords + i;
+        unpackIndices[b * dimWords + i] = pos;
+      }
+    }
+  }
+
+  // The [rows, query width, key width] mask of the key words of keySide each query word of querySide
+  // may attend to, i.e. the words of the same sentence, and with causal only the earlier ones
+  std::vector<float> mask(size_t querySide, size_t keySide, bool causal = false) const {
+    int dimQueries = dimWords_[querySide], dimKeys = dimWords_[keySide];
+    std::vector<float> packedMask((size_t)dimRows_ * dimQueries * dimKeys, 0.f);
+    for(int b = 0; b < dimBatch_; ++b) {
+      for(int i = 0; i < lengths_[querySide][b]; ++i) {
+        size_t pos = (size_t)rowOf_[b] * dimQueries + offsetOf_[querySide][b] + i;
+        int keys = causal ? std::min(i + 1, lengths_[keySide][b]) : lengths_[keySide][b];
+        std::fill_n(packedMask.begin() + pos * dimKeys + offsetOf_[keySide][b], keys, 1.f);
+      }
+    }
+    return packedMask;
+  }
+};
+
 // shared base class for transformer-based EncoderTransformer and DecoderTransformer
 // Both classes share a lot of code. This template adds that shared code into their
 // base while still deriving from EncoderBase and DecoderBase, respectively.
@@ -47,7 +134,7 @@ protected:
   T opt(const char* const key, const T& def) const { Ptr<Options> options = options_; return options->get<T>(key, def);  }
 
   template <typename T> 
-  T opt(const std::string& key, const T& def) const { opt<T>(key.c_str(), def); }
+  T opt(const std::string& key, const T& def) const { return opt<T>(key.c_str(), def); }
 
 public:
   static Expr transposeTimeBatch(Expr input) { return transpose(input, {0, 2, 1, 3}); }
@@ -117,13 +204,19 @@ public:
     return addPositionalEmbeddings(input, start, trainPosEmbeddings);
   }
 
-  Expr triangleMask(int length) const {
+  // [1, length, offset + length] with 1 where position i may attend to position j, i.e. to all
+  // `offset` earlier positions, see DecoderTransformer::step(), and causally among the new ones
+  Expr triangleMask(int length, int offset = 0) const {
     // fill triangle mask
-    std::vector<float> vMask(length * length, 0);
+    int dimKeys = offset + length;
+    std::vector<float> vMask(length * dimKeys, 0);
     for(int i = 0; i < length; ++i)
-      for(int j = 0; j <= i; ++j)
-        vMask[i * length + j] = 1.f;
-    return graph_->constant({1, length, length}, inits::fromVector(vMask));
+      for(int j = 0; j <= offset + i; ++j)
+        vMask[i * dimKeys + j] = 1.f;
+    auto init = inits::fromVector(vMask);
+    std::string key = "triangleMask:" + std::to_string(length) + (offset > 0 ? ":" + std::to_string(offset) : "");
+    init->setContentHash(util::hash<std::string>()(key)); // memoized in inference
+    return graph_->constant({1, length, dimKeys}, init);
   }
 
   // convert multiplicative 1/0 mask to additive 0/-inf log mask, and transpose to match result of bdot() op in Attention()
@@ -134,6 +227,38 @@ public:
     return reshape(mask, {ms[-3], 1, ms[-2], ms[-1]}); // [-4: batch size, -3: num heads broadcast=1, -2: max length broadcast=1, -1: max length]
   }
 
+  // [1, rows, max length, vector dim] of the [1, batch size, max length, vector dim] input x, or the
+  // reverse with unpack indices, see SequencePacking::indices()
+  static Expr packRows(Expr x, const std::vector<IndexType>& indices, int dimRows) {
+    int dimWords = x->shape()[-2], dimModel = x->shape()[-1];
+    return reshape(rows(reshape(x, {x->shape().elements() / dimModel, dimModel}), indices),
+                   {1, dimRows, dimWords, dimModel});
+  }
+
+  // Whether the sentence pairs of training batches are packed, see SequencePacking, which is only
+  // supported for single-source transformers with self-attention decoders
+  bool packedTraining() const {
+    if(inference_ || !opt<bool>("transformer-packed-training", false))
+      return false;
+    ABORT_IF(opt<std::string>("type") != "transformer",
+             "--transformer-packed-training is only supported for --type transformer");
+    ABORT_IF(opt<std::string>("transformer-decoder-autoreg", "self-attention") != "self-attention",
+             "--transformer-packed-training requires self-attention in the decoder");
+    ABORT_IF(options_->get("guided-alignment", std::string("none")) != "none",
+             "--transformer-packed-training does not support guided alignment");
+    return true;
+  }
+
+  // The packing of the source and target sentences of a training batch, the same in the encoder and
+  // the decoder
+  static SequencePacking packPairs(Ptr<data::CorpusBatch> batch) {
+    ABORT_IF(batch->sets() != 2, "--transformer-packed-training requires batches of sentence pairs");
+    auto src = batch->front(), trg = batch->back();
+    return SequencePacking({&src->mask(), &trg->mask()},
+                           {(int)src->batchWidth(), (int)trg->batchWidth()},
+                           (int)batch->size());
+  }
+
   static Expr SplitHeads(Expr input, int dimHeads) {
     int dimModel = input->shape()[-1];
     int dimSteps = input->shape()[-2];
@@ -179,7 +304,20 @@ public:
 
   Expr postProcess(std::string prefix, std::string ops, Expr input, Expr prevInput, float dropProb = 0.0f) const {
     auto output = input;
-    for(auto op : ops) {
+    for(size_t i = 0; i < ops.size(); ++i) {
+      char op = ops[i];
+#ifndef USE_ONNX // the ONNX exporter expects separate operations
+      // dropout, skip connection and layer normalization in a single pass
+      size_t fused = ops.compare(i, 3, "dan") == 0 ? 3 : ops.compare(i, 2, "an") == 0 ? 2 : 0;
+      if(fused > 0) {
+        Expr mask;
+        if(fused == 3 && dropProb > 0)
+          mask = output->graph()->dropoutMask(dropProb, output->shape());
+        output = residualLayerNorm(output, mask, prevInput, prefix);
+        i += fused - 1;
+        continue;
+      }
+#endif
       // dropout
       if(op == 'd')
         output = dropout(output, dropProb);
@@ -223,6 +361,16 @@ public:
     }
   }
 
+  // batched product of activations in attention, in 8 bits on the CPU in inference if requested
+  Expr attentionDot(Expr a, Expr b, bool transA = false, bool transB = false, float scale = 1.f) {
+    auto precision = opt<std::string>("transformer-attention-precision", "float32");
+    ABORT_IF(precision != "float32" && precision != "int8",
+             "Unknown --transformer-attention-precision {}, use float32 or int8", precision);
+    if(precision == "int8" && inference_ && graph_->getDeviceId().type == DeviceType::cpu)
+      return bdotInt8(a, b, transA, transB, scale);
+    return bdot(a, b, transA, transB, scale);
+  }
+
   // determine the multiplicative-attention probability and performs the associative lookup as well
   // q, k, and v have already been split into multiple heads, undergone any desired linear transform.
   Expr Attention(std::string /*prefix*/,
@@ -239,7 +387,14 @@ public:
 
     // multiplicative attention with flattened softmax
     float scale = 1.0f / std::sqrt((float)dk); // scaling to avoid extreme values due to matrix multiplication
-    auto z = bdot(q, k, false, true, scale); // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: max src length]
+
+    // all in one operator, unless the attention weights themselves are needed
+    float dropProb = inference_ ? 0 : opt<float>("transformer-dropout-attention");
+    if(opt<bool>("transformer-fused-attention", false) && !saveAttentionWeights && dropProb == 0
+       && !(inference_ && opt<std::string>("transformer-attention-precision", "float32") == "int8"))
+      return fusedAttention(q, k, v, mask, scale); // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: split vector dim]
+
+    auto z = attentionDot(q, k, false, true, scale); // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: max src length]
 
     // mask out garbage beyond end of sequences
     z = z + mask;
@@ -251,14 +406,41 @@ public:
       collectOneHead(weights, dimBeam);
 
     // optional dropout for attention weights
-    weights = dropout(weights, inference_ ? 0 : opt<float>("transformer-dropout-attention"));
+    weights = dropout(weights, dropProb);
 
     // apply attention weights to values
-    auto output = bdot(weights, v);   // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: split vector dim]
+    auto output = attentionDot(weights, v);   // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: split vector dim]
 
     return output;
   }
 
+  // With --transformer-fold-parameters, products that only depend on parameters are folded once for
+  // inference: their results are memoized, so they are computed in the first forward pass and then
+  // kept with the graph like the parameters themselves.
+  bool foldParameters() const {
+    return inference_ && opt<bool>("transformer-fold-parameters", false);
+  }
+
+  // Projects the same input to keys and values with a single product on the concatenated weights
+  // and biases, which are folded. Returns false for weights that cannot be concatenated, e.g. the
+  // packed or quantized weights of converted models.
+  bool projectKeysValues(std::string prefix, Expr input, Expr& keys, Expr& values) const {
+    int dimModel = input->shape()[-1];
+    auto Wk = graph_->param(prefix + "_Wk", {dimModel, dimModel}, inits::glorotUniform());
+    auto bk = graph_->param(prefix + "_bk", {1,        dimModel}, inits::zeros());
+    auto Wv = graph_->param(prefix + "_Wv", {dimModel, dimModel}, inits::glorotUniform());
+    auto bv = graph_->param(prefix + "_bv", {1,        dimModel}, inits::zeros());
+    if(!isFloat(Wk->value_type()) || Wk->value_type() != Wv->value_type() || bk->value_type() != bv->value_type())
+      return false;
+
+    auto Wkv = concatenate({Wk, Wv}, /*axis=*/-1); // [dimModel, 2 * dimModel]
+    auto bkv = concatenate({bk, bv}, /*axis=*/-1);
+    auto kv = affine(input, Wkv, bkv);
+    keys   = slice(kv, -1, Slice(0, dimModel));
+    values = slice(kv, -1, Slice(dimModel, 2 * dimModel));
+    return true;
+  }
+
   Expr MultiHead(std::string prefix,
                  int dimOut,
                  int dimHeads,
@@ -267,7 +449,8 @@ public:
                  const Expr &values, // [-4: beam depth, -3: batch size, -2: max kv length, -1: vector dim]
                  const Expr &mask,   // [-4: batch size, -3: num heads broadcast=1, -2: max length broadcast=1, -1: max length]
                  bool cache = false,
-                 bool saveAttentionWeights = false) {
+                 bool saveAttentionWeights = false,
+                 bool projected = false) { // keys and values have already been transformed with Wk/Wv
     int dimModel = q->shape()[-1];
     // @TODO: good opportunity to implement auto-batching here or do something manually?
     auto Wq = graph_->param(prefix + "_Wq", {dimModel, dimModel}, inits::glorotUniform());
@@ -275,14 +458,28 @@ public:
     auto qh = affine(q, Wq, bq);
     qh = SplitHeads(qh, dimHeads); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
 
-    Expr kh;
+    Expr kh, vh;
+    bool cachedKeys = cache && cache_.count(prefix + "_keys") > 0
+                      && cache_[prefix + "_keys"]->shape().elements() == keys->shape().elements();
+    if(!projected && !cachedKeys && keys == values && foldParameters()) {
+      Expr projectedKeys, projectedValues;
+      if(projectKeysValues(prefix, keys, projectedKeys, projectedValues)) {
+        kh = cache_[prefix + "_keys"]   = SplitHeads(projectedKeys, dimHeads);
+        vh = cache_[prefix + "_values"] = SplitHeads(projectedValues, dimHeads);
+      }
+    }
+
     // Caching transformation of the encoder that should not be created again.
     // @TODO: set this automatically by memoizing encoder context and
     // memoization propagation (short-term)
-    if (cache                                                                          // if caching
-        && cache_.count(prefix + "_keys") > 0                                          // and the keys expression has been seen
-        && cache_[prefix + "_keys"]->shape().elements() == keys->shape().elements()) { // and the underlying element size did not change
-      kh = cache_[prefix + "_keys"];                                                   // then return cached tensor
+    if(kh) {
+      // already projected together with the values
+    }
+    else if(projected) {
+      kh = SplitHeads(keys, dimHeads); // [-4: batch size, -3: num heads, -2: max length, -1: split vector dim]
+    }
+    else if (cachedKeys) {             // if caching and the keys expression has been seen with the same element size
+      kh = cache_[prefix + "_keys"];   // then return cached tensor
     }
     else {
       auto Wk = graph_->param(prefix + "_Wk", {dimModel, dimModel}, inits::glorotUniform());
@@ -293,8 +490,13 @@ public:
       cache_[prefix + "_keys"] = kh;
     }
 
-    Expr vh;
-    if (cache 
+    if(vh) {
+      // already projected together with the keys
+    }
+    else if(projected) {
+      vh = SplitHeads(values, dimHeads);
+    }
+    else if (cache 
         && cache_.count(prefix + "_values") > 0 
         && cache_[prefix + "_values"]->shape().elements() == values->shape().elements()) {
       vh = cache_[prefix + "_values"];
@@ -358,7 +560,8 @@ public:
                       const Expr& mask,   // [-4: batch size, -3: num heads broadcast=1, -2: max length broadcast=1, -1: max length]
                       int dimHeads,
                       bool cache = false,
-                      bool saveAttentionWeights = false) {
+                      bool saveAttentionWeights = false,
+                      bool projected = false) {
     int dimModel = input->shape()[-1];
 
     float dropProb = inference_ ? 0 : opt<float>("transformer-dropout");
@@ -366,7 +569,7 @@ public:
     auto output = preProcess(prefix + "_Wo", opsPre, input, dropProb);
 
     // multi-head self-attention over previous input
-    output = MultiHead(prefix, dimModel, dimHeads, output, keys, values, mask, cache, saveAttentionWeights);
+    output = MultiHead(prefix, dimModel, dimHeads, output, keys, values, mask, cache, saveAttentionWeights, projected);
     
     auto opsPost = opt<std::string>("transformer-postprocess");
     output = postProcess(prefix + "_Wo", opsPost, output, input, dropProb);
@@ -381,15 +584,38 @@ public:
                                  Expr selfMask,
                                  int startPos) {
     selfMask = transposedLogMask(selfMask);
+    DecoderLayerSelfAttentionState(decoderLayerState, prevdecoderLayerState, prefix, input, startPos);
 
-    auto values = input;
+    return LayerAttention(prefix, input, decoderLayerState.output, decoderLayerState.cell, selfMask,
+                          opt<int>("transformer-heads"), /*cache=*/false,
+                          /*saveAttentionWeights=*/false, /*projected=*/true);
+  }
+
+  // The decoder state keeps the already projected keys (output) and values (cell) of all previous
+  // positions, so during decoding only the current position needs to be transformed with Wk/Wv
+  // instead of re-projecting the whole history at every step.
+  void DecoderLayerSelfAttentionState(rnn::State& decoderLayerState,
+                                      const rnn::State& prevdecoderLayerState,
+                                      std::string prefix,
+                                      Expr input,
+                                      int startPos) {
+    int dimModel = input->shape()[-1];
+    Expr keys, values; // [-4: beam depth, -3: batch size, -2: max length, -1: vector dim]
+    if(!foldParameters() || !projectKeysValues(prefix, input, keys, values)) {
+      auto Wk = graph_->param(prefix + "_Wk", {dimModel, dimModel}, inits::glorotUniform());
+      auto bk = graph_->param(prefix + "_bk", {1,        dimModel}, inits::zeros());
+      auto Wv = graph_->param(prefix + "_Wv", {dimModel, dimModel}, inits::glorotUniform());
+      auto bv = graph_->param(prefix + "_bv", {1,        dimModel}, inits::zeros());
+
+      keys   = affine(input, Wk, bk);
+      values = affine(input, Wv, bv);
+    }
     if(startPos > 0) {
-      values = concatenate({prevdecoderLayerState.output, input}, /*axis=*/-2);
+      keys   = concatenate({prevdecoderLayerState.output, keys},   /*axis=*/-2);
+      values = concatenate({prevdecoderLayerState.cell,   values}, /*axis=*/-2);
     }
-    decoderLayerState.output = values;
-
-    return LayerAttention(prefix, input, values, values, selfMask,
-                          opt<int>("transformer-heads"), /*cache=*/false);
+    decoderLayerState.output = keys;
+    decoderLayerState.cell   = values;
   }
 
   static inline
@@ -413,15 +639,20 @@ public:
 
     int dimFfn = opt<int>("transformer-dim-ffn");
     int depthFfn = opt<int>("transformer-ffn-depth");
-    auto actFn = activationByName(opt<std::string>("transformer-ffn-activation"));
+    auto actName = opt<std::string>("transformer-ffn-activation");
+    auto actFn = activationByName(actName);
     float ffnDropProb
       = inference_ ? 0 : opt<float>("transformer-dropout-ffn");
 
     ABORT_IF(depthFfn < 1, "Filter depth {} is smaller than 1", depthFfn);
 
-    // the stack of FF layers
-    for(int i = 1; i < depthFfn; ++i)
-      output = denseInline(output, prefix, /*suffix=*/std::to_string(i), dimFfn, actFn, ffnDropProb);
+    // the stack of FF layers, a ReLU can be computed together with the product
+    for(int i = 1; i < depthFfn; ++i) {
+      if(actName == "relu")
+        output = denseReluInline(output, prefix, /*suffix=*/std::to_string(i), dimFfn, ffnDropProb);
+      else
+        output = denseInline(output, prefix, /*suffix=*/std::to_string(i), dimFfn, actFn, ffnDropProb);
+    }
     output = denseInline(output, prefix, /*suffix=*/std::to_string(depthFfn), dimModel);
 
     auto opsPost = opt<std::string>("transformer-postprocess");
@@ -477,17 +708,30 @@ public:
                        int startPos) const {
     auto output = input;
     if(startPos > 0) {
-      // we are decoding at a position after 0
-      output = (prevDecoderState.output * (float)startPos + input) / float(startPos + 1);
+      // we are decoding at a position after 0, the state is the sum of all previous inputs
+      auto history = prevDecoderState.output + input;
+      decoderState.output = history; // BUGBUG: mutable?
+      output = history * (1.f / float(startPos + 1));
     }
     else if(startPos == 0 && output->shape()[-2] > 1) {
       // we are training or scoring, because there is no history and
       // the context is larger than a single time step. We do not need
       // to average batch with only single words.
-      selfMask = selfMask / sum(selfMask, /*axis=*/-1);
-      output = bdot(selfMask, output);
+      // The last row of the self-attention mask is the mask of the target words, the averages are
+      // the cumulative sums of the unmasked words divided by their cumulative count, which is
+      // linear in the length instead of the quadratic product with the triangle mask.
+      int dimTrgWords = output->shape()[-2];
+      auto wordMask = slice(selfMask, -2, dimTrgWords - 1);         // [(1,) batch size or 1, 1, max length]
+      auto maskShape = wordMask->shape();
+      maskShape.set(-2, dimTrgWords);
+      maskShape.set(-1, 1);
+      wordMask = reshape(wordMask, maskShape);                      // [(1,) batch size or 1, max length, 1]
+      auto history = cumsum(output * wordMask, /*axis=*/-2);
+      decoderState.output = history; // BUGBUG: mutable?
+      output = history / cumsum(wordMask, /*axis=*/-2);
+    } else {
+      decoderState.output = output; // BUGBUG: mutable?
     }
-    decoderState.output = output; // BUGBUG: mutable?
 
     return LayerAAN(prefix, input, output);
   }
@@ -558,6 +802,27 @@ public:
     auto layer     = transposeTimeBatch(batchEmbeddings); // [beam depth=1, batch size, max length, vector dim]
     auto layerMask = transposeTimeBatch(batchMask);       // [beam depth=1, batch size, max length, vector dim=1]
 
+    // For inference the sentences can be packed into fewer rows, which saves the computation on the
+    // padding in the projections and feed-forward layers, in training the sentence pairs together
+    // with the decoder. The embeddings already include positions, which hence count per sentence.
+    std::vector<IndexType> packIndices, unpackIndices;
+    std::vector<float> packedMask;
+    int dimRows = dimBatch;
+    if(inference_ && opt<bool>("transformer-packed-inference", false)) {
+      SequencePacking packing({&(*batch)[batchIndex_]->mask()}, {dimSrcWords}, dimBatch);
+      dimRows = packing.rows();
+      packing.indices(0, packIndices, unpackIndices);
+      packedMask = packing.mask(0, 0);
+    } else if(packedTraining()) {
+      auto packing = packPairs(batch);
+      dimRows = packing.rows();
+      packing.indices(0, packIndices, unpackIndices);
+      packedMask = packing.mask(0, 0);
+    }
+    bool packed = dimRows < dimBatch;
+    if(packed)
+      layer = packRows(layer, packIndices, dimRows); // [beam depth=1, packed rows, max length, vector dim]
+
     auto prevLayer = layer; // keep handle to untransformed embeddings, potentially used for a final skip connection
 
     auto opsEmb = opt<std::string>("transformer-postprocess-emb");
@@ -565,8 +830,14 @@ public:
     layer = preProcess(prefix_ + "_emb", opsEmb, layer, dropProb);
 
     // LayerAttention expects mask in a different layout
-    layerMask = reshape(layerMask, {1, dimBatch, 1, dimSrcWords}); // [1,          batch size,            1,                      max length]
-    layerMask = transposedLogMask(layerMask);                      // [batch size, num heads broadcast=1, max length broadcast=1, max length]
+    if(packed) {
+      // block-diagonal, the words of a packed row only attend to the words of the same sentence
+      layerMask = graph_->constant({1, dimRows, dimSrcWords, dimSrcWords}, inits::fromVector(packedMask));
+      layerMask = transposedLogMask(layerMask);                    // [packed rows, num heads broadcast=1, max length, max length]
+    } else {
+      layerMask = reshape(layerMask, {1, dimBatch, 1, dimSrcWords}); // [1,          batch size,            1,                      max length]
+      layerMask = transposedLogMask(layerMask);                      // [batch size, num heads broadcast=1, max length broadcast=1, max length]
+    }
 
     // apply encoder layers
     // This is the Transformer Encoder stack.
@@ -588,6 +859,9 @@ public:
     auto opsTop = opt<std::string>("transformer-postprocess-top", "");
     layer = postProcess(prefix_ + "_top", opsTop, layer, prevLayer, dropProb);
 
+    if(packed) // back to one sentence per row, the padding gets the output of an arbitrary word
+      layer = packRows(layer, unpackIndices, dimBatch);
+
     // restore organization of batch and time steps. This is currently required
     // to make RNN-based decoders and beam search work with this. We are looking
     // into making this more natural.
@@ -607,6 +881,12 @@ public:
                    Ptr<data::CorpusBatch> batch)
       : DecoderState(states, logProbs, encStates, batch) {}
 
+  // The keys and values of the encoder contexts after the projections of the cross-attention
+  // layers, by cache key of the layer, [-4: batch size, -3: num heads, -2: max src length, -1: split
+  // vector dim]. They are computed in the first step and handed on from state to state.
+  const std::unordered_map<std::string, Expr>& getEncoderKeysValues() const { return encoderKeysValues_; }
+  void setEncoderKeysValues(const std::unordered_map<std::string, Expr>& encoderKeysValues) { encoderKeysValues_ = encoderKeysValues; }
+
   virtual Ptr<DecoderState> select(const std::vector<IndexType>& hypIndices,   // [beamIndex * activeBatchSize + batchIndex]
                                    const std::vector<IndexType>& batchIndices, // [batchIndex]
                                    int beamSize) const override {
@@ -621,11 +901,35 @@ public:
     // Create hypothesis-selected state based on current state and hyp indices
     auto selectedState = New<TransformerState>(states_.select(hypIndices, beamSize, /*isBatchMajor=*/true), logProbs_, newEncStates, batch_); 
 
+    // Select the same batch entries from the projected keys and values instead of projecting the
+    // selected encoder contexts again
+    for(const auto& kv : encoderKeysValues_)
+      selectedState->encoderKeysValues_[kv.first]
+          = kv.second->shape()[-4] == (int)batchIndices.size() ? kv.second : index_select(kv.second, -4, batchIndices);
+
     // Set the same target token position as the current state
     // @TODO: This is the same as in base function.
     selectedState->setPosition(getPosition());
     return selectedState;
   }
+
+  // Keeps the projected self-attention keys (output) and values (cell) of the first positions,
+  // [-4: beam depth, -3: batch size, -2: max length, -1: vector dim]
+  virtual Ptr<DecoderState> truncate(size_t positions) const override {
+    rnn::States states;
+    for(const auto& state : states_) {
+      ABORT_IF(!state.output || !state.cell, "Truncating the decoder state requires self-attention layers");
+      states.push_back({slice(state.output, -2, Slice(0, (int)positions)),
+                        slice(state.cell,   -2, Slice(0, (int)positions))});
+    }
+    auto truncatedState = New<TransformerState>(states, logProbs_, encStates_, batch_);
+    truncatedState->encoderKeysValues_ = encoderKeysValues_;
+    truncatedState->setPosition(positions);
+    return truncatedState;
+  }
+
+private:
+  std::unordered_map<std::string, Expr> encoderKeysValues_;
 };
 
 class DecoderTransformer : public Transformer<DecoderBase> {
@@ -638,6 +942,9 @@ private:
   // To be removed after refactoring of transformer.h
   std::unordered_map<std::string, Ptr<rnn::RNN>> perLayerRnn_;
 
+  // output layer applied to the early-exit layers in training, see getExitLogits()
+  std::vector<Logits> exitLogits_;
+
 private:
   // @TODO: move this out for sharing with other models
   void lazyCreateOutputLayer()
@@ -653,6 +960,10 @@ private:
         "vocab", opt<std::vector<std::string>>("vocabs")[batchIndex_], // for factored outputs
         "output-omit-bias", opt<bool>("output-omit-bias", false),
         "output-approx-knn", opt<std::vector<int>>("output-approx-knn", {}),
+        "output-approx-knn-index", opt<std::string>("output-approx-knn-index", ""),
+        "output-loss-chunk", opt<int>("output-loss-chunk", 0),
+        "output-loss-vocab-chunk", opt<int>("output-loss-vocab-chunk", 0),
+        "output-sampled-softmax", opt<int>("output-sampled-softmax", 0),
         "lemma-dim-emb", opt<int>("lemma-dim-emb", 0)); // for factored outputs
 
     if(opt<bool>("tied-embeddings") || opt<bool>("tied-embeddings-all"))
@@ -708,6 +1019,11 @@ public:
     // Used for position embeddings and creating new decoder states.
     int startPos = (int)state->getPosition();
 
+    // continue with the projected encoder contexts of the previous step, if any
+    auto transformerState = std::dynamic_pointer_cast<TransformerState>(state);
+    if(transformerState)
+      cache_ = transformerState->getEncoderKeysValues();
+
     auto scaledEmbeddings = addSpecialEmbeddings(embeddings, startPos);
     scaledEmbeddings = atleast_nd(scaledEmbeddings, 4);
 
@@ -723,8 +1039,36 @@ public:
 
     int dimTrgWords = query->shape()[-2];
     int dimBatch    = query->shape()[-3];
-    auto selfMask = triangleMask(dimTrgWords);  // [ (1,) 1, max length, max length]
-    if(decoderMask) {
+    // several positions at once after earlier ones, e.g. to verify the tokens of a draft model
+    bool multiStep = startPos > 0 && dimTrgWords > 1;
+    ABORT_IF(multiStep && opt<std::string>("transformer-decoder-autoreg", "self-attention") != "self-attention",
+             "Decoder steps over several positions are only supported for self-attention");
+    // In training the sentence pairs may be packed into fewer rows as in the encoder. Then the
+    // decoder layers run on the packed rows, with the encoder contexts packed the same way, and
+    // every word attends to the earlier words of its own target and to its own source sentence.
+    std::vector<IndexType> trgPackIndices, trgUnpackIndices, srcPackIndices, srcUnpackIndices;
+    std::vector<float> packedSelfMask, packedCrossMask;
+    int dimRows = dimBatch;
+    if(packedTraining()) {
+      auto packing = packPairs(state->getBatch());
+      dimRows = packing.rows();
+      packing.indices(0, srcPackIndices, srcUnpackIndices);
+      packing.indices(1, trgPackIndices, trgUnpackIndices);
+      packedSelfMask = packing.mask(1, 1, /*causal=*/true);
+      packedCrossMask = packing.mask(1, 0);
+    }
+    bool packed = dimRows < dimBatch;
+    // the output layer gets one sentence per row again
+    auto unpack = [&](Expr packedQuery) {
+      return packed ? packRows(packedQuery, trgUnpackIndices, dimBatch) : packedQuery;
+    };
+
+    auto selfMask = multiStep ? triangleMask(dimTrgWords, startPos) // [ (1,) 1, max length, start + max length]
+                              : triangleMask(dimTrgWords);          // [ (1,) 1, max length, max length]
+    if(packed) {
+      query = packRows(query, trgPackIndices, dimRows);             // [ 1, packed rows, max length, vector dim ]
+      selfMask = graph_->constant({1, dimRows, dimTrgWords, dimTrgWords}, inits::fromVector(packedSelfMask));
+    } else if(decoderMask) {
       decoderMask = atleast_nd(decoderMask, 4);             // [ 1, max length, batch size, 1 ]
       decoderMask = reshape(transposeTimeBatch(decoderMask),// [ 1, batch size, max length, 1 ]
                             {1, dimBatch, 1, dimTrgWords}); // [ 1, batch size, 1, max length ]
@@ -751,8 +1095,14 @@ public:
                dimBatch);
 
       // LayerAttention expects mask in a different layout
-      encoderMask = reshape(encoderMask, { 1, dimBatch, 1, dimSrcWords }); // [1,          batch size,            1,                      max length]
-      encoderMask = transposedLogMask(encoderMask);                        // [batch size, num heads broadcast=1, max length broadcast=1, max length]
+      if(packed) {
+        encoderContext = packRows(encoderContext, srcPackIndices, dimRows); // [1, packed rows, max length, vector dim]
+        encoderMask = graph_->constant({1, dimRows, dimTrgWords, dimSrcWords}, inits::fromVector(packedCrossMask));
+        encoderMask = transposedLogMask(encoderMask);                        // [packed rows, num heads broadcast=1, max tgt length, max length]
+      } else {
+        encoderMask = reshape(encoderMask, { 1, dimBatch, 1, dimSrcWords }); // [1,          batch size,            1,                      max length]
+        encoderMask = transposedLogMask(encoderMask);                        // [batch size, num heads broadcast=1, max length broadcast=1, max length]
+      }
       if(dimBeam > 1)
         encoderMask = repeat(encoderMask, dimBeam, /*axis=*/ -4);
 
@@ -774,6 +1124,17 @@ public:
              tiedLayers.size(),
              decDepth);
 
+    // Decoder layers after which the output layer is applied as well, for auxiliary losses in
+    // training; when decoding the remaining layers are skipped once the most probable word of every
+    // hypothesis is at least as probable as the threshold
+    auto exitLayers = opt<std::vector<size_t>>("transformer-early-exit-layers", std::vector<size_t>());
+    float exitThreshold = inference_ ? opt<float>("transformer-early-exit-threshold", 0.f) : 0.f;
+    std::string layerType = opt<std::string>("transformer-decoder-autoreg", "self-attention");
+    ABORT_IF(exitThreshold > 0.f && !exitLayers.empty() && layerType == "rnn",
+             "Early exit is not supported for RNN layers in the transformer decoder");
+    exitLogits_.clear();
+    Logits logits;
+
     for(int i = 0; i < decDepth; ++i) {
       std::string layerNo = std::to_string(i + 1);
       if (!tiedLayers.empty())
@@ -784,7 +1145,6 @@ public:
         prevDecoderState = prevDecoderStates[i];
 
       // self-attention
-      std::string layerType = opt<std::string>("transformer-decoder-autoreg", "self-attention");
       rnn::State decoderState;
       if(layerType == "self-attention")
         query = DecoderLayerSelfAttention(decoderState, prevDecoderState, prefix_ + "_l" + layerNo + "_self", query, selfMask, startPos);
@@ -849,8 +1209,54 @@ public:
       query = LayerFFN(prefix_ + "_l" + layerNo + "_ffn", query); // [-4: beam depth=1, -3: batch size, -2: max length, -1: vector dim]
 
       checkpoint(query);
+
+      // early exit: the output layer is applied to this layer, too
+      bool exitLayer = i + 1 < decDepth && std::find(exitLayers.begin(), exitLayers.end(), (size_t)(i + 1)) != exitLayers.end();
+      if(exitLayer && !inference_) {
+        exitLogits_.push_back(applyOutputLayer(unpack(query), prevQuery, dropProb));
+      } else if(exitLayer && exitThreshold > 0.f) {
+        auto exitLogits = applyOutputLayer(query, prevQuery, dropProb);
+        if(isConfident(exitLogits, exitThreshold)) {
+          // The layers above are skipped, but later positions attend to this one. Their states are
+          // those of an input that is the output of this layer.
+          for(int j = i + 1; j < decDepth; ++j) {
+            std::string skippedNo = tiedLayers.empty() ? std::to_string(j + 1) : std::to_string(tiedLayers[j]);
+            rnn::State prevSkippedState;
+            if(prevDecoderStates.size() > 0)
+              prevSkippedState = prevDecoderStates[j];
+            rnn::State skippedState;
+            if(layerType == "self-attention")
+              DecoderLayerSelfAttentionState(skippedState, prevSkippedState, prefix_ + "_l" + skippedNo + "_self", query, startPos);
+            else // average-attention, the sum of all inputs
+              skippedState.output = startPos > 0 ? prevSkippedState.output + query : query;
+            decoderStates.push_back(skippedState);
+          }
+          logits = exitLogits;
+          break;
+        }
+      }
     }
 
+    if(logits.empty())
+      logits = applyOutputLayer(unpack(query), prevQuery, dropProb); // [-4: beam depth=1, -3: max length, -2: batch size, -1: vocab or shortlist dim]
+
+    // return unormalized(!) probabilities
+    Ptr<DecoderState> nextState;
+    if (opt<std::string>("transformer-decoder-autoreg", "self-attention") == "rnn") {
+      nextState = New<DecoderState>(
+        decoderStates, logits, state->getEncoderStates(), state->getBatch());
+    } else {
+      auto nextTransformerState = New<TransformerState>(
+        decoderStates, logits, state->getEncoderStates(), state->getBatch());
+      nextTransformerState->setEncoderKeysValues(cache_);
+      nextState = nextTransformerState;
+    }
+    nextState->setPosition(state->getPosition() + (multiStep ? dimTrgWords : 1));
+    return nextState;
+  }
+
+  // The output layer applied to the output of the last or an early-exit decoder layer
+  Logits applyOutputLayer(Expr query, Expr prevQuery, float dropProb) {
     // This allows to run a final layernorm operation after going through the transformer layer stack.
     // By default the operations are empty, but with prenorm (--transformer-preprocess n --transformer-postprocess da) 
     // it is recommended to normalize here. Can also be used to add a skip connection from the very bottom if requested.
@@ -859,24 +1265,23 @@ public:
 
     auto decoderContext = transposeTimeBatch(query); // [-4: beam depth=1, -3: max length, -2: batch size, -1: vector dim]
 
-    //************************************************************************//
-
     // final feed-forward layer (output)
     if(shortlist_)
       output_->setShortlist(shortlist_);
-    auto logits = output_->applyAsLogits(decoderContext); // [-4: beam depth=1, -3: max length, -2: batch size, -1: vocab or shortlist dim]
-    
-    // return unormalized(!) probabilities
-    Ptr<DecoderState> nextState;
-    if (opt<std::string>("transformer-decoder-autoreg", "self-attention") == "rnn") {
-      nextState = New<DecoderState>(
-        decoderStates, logits, state->getEncoderStates(), state->getBatch());
-    } else {
-      nextState = New<TransformerState>(
-        decoderStates, logits, state->getEncoderStates(), state->getBatch());
-    }
-    nextState->setPosition(state->getPosition() + 1);
-    return nextState;
+    return output_->applyAsLogits(decoderContext); // [-4: beam depth=1, -3: max length, -2: batch size, -1: vocab or shortlist dim]
+  }
+
+  // Whether the most probable word of every hypothesis has at least the probability threshold. This
+  // computes the graph up to here.
+  bool isConfident(const Logits& logits, float threshold) {
+    auto z = logits.getLogits();
+    auto logConfidence = min(flatten(max(z, -1) - logsumexp(z, -1)), -1);
+    graph_->forward();
+    return logConfidence->val()->scalar() >= std::log(threshold);
+  }
+
+  virtual const std::vector<Logits> getExitLogits() override {
+    return exitLogits_; // [exit layer][beam depth=1, max length, batch size, vocab or shortlist dim]
   }
 
   // helper function for guided alignment
@@ -890,6 +1295,7 @@ public:
       output_->clear();
     cache_.clear();
     alignments_.clear();
+    exitLogits_.clear();
     perLayerRnn_.clear(); // this needs to be cleared between batches. 
     // @TODO: figure out how to detect stale nodes i.e. nodes that are referenced, 
     // but where underlying memory has been deallocated by dropping all tensors 
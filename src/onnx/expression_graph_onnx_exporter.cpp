@@ -4,8 +4,9 @@
 
 #include "models/model_factory.h"
 #include "models/encoder_decoder.h"
+#include "models/transformer.h"
 #include "data/corpus_base.h"
-#include "tensors/cpu/fbgemm/expression_graph_packable.h"
+#include "tensors/cpu/expression_graph_packable.h"
 
 #include <memory>
 
@@ -33,6 +34,11 @@ namespace marian {
   //    That dimension value must not occur naturally in the model.
   //    That dimension must also not be used in dimension calculations.
   //    E.g. the exporter does not recognize if a constant is added to it, or if it gets multiplied.
+  // Transformer decoders with self-attention keep the projected keys and values of all previous
+  // target positions as decoder states, so decode_next() takes and returns a cache of keys and values
+  // per layer. Its past length is represented the same way by a dimension value of 89, and the one of
+  // its outputs by 90. The cross-attention keys and values of the encoder contexts are outputs of
+  // decode_first() and inputs of decode_next() (encoder_keys_values_*), so they are projected once.
   void ExpressionGraphONNXExporter::exportToONNX(const std::string& modelToPrefix, Ptr<Options> modelOptions, const std::vector<std::string>& vocabPaths)
   {
     auto graph = shared_from_this();
@@ -46,6 +52,7 @@ namespace marian {
       vocabs.emplace_back(vocab);
     }
     setInference(true);  // note: must also set "inference" parameter on options
+    fuseLayerNorm_ = modelOptions->get<bool>("onnx-fused-layer-norm", false);
 
     // if we must suppress <unk>, we do that by patching the bias
     const auto trgUnkId = vocabs.back()->getUnkId();
@@ -64,6 +71,10 @@ namespace marian {
 
     // the input length is represented by a value that hopefully is not used elsewhere
     const size_t sentinelDim = 97;  // who uses prime numbers as dimensions anyways!
+    const size_t pastSentinelDim = 89; // past target length of the key and value caches of decode_next()
+    DynamicAxes dynamicAxes = {{sentinelDim,         "SOURCE_LENGTH"},
+                               {pastSentinelDim,     "PAST_TARGET_LENGTH"},
+                               {pastSentinelDim + 1, "TARGET_LENGTH"}};
     size_t numEncoders = vocabs.size() - 1;  // @TODO: test this exporter for >1 encoder
 
     // some helper functions
@@ -124,9 +135,34 @@ namespace marian {
       /*words=*/{}, /*batchIndices=*/{ 0 }, /*beamSize=*/1);
     auto decodeFirstPosRangeInput = extractInputByName("data_" + std::to_string(numEncoders) + "_posrange");
 
+    // cross-attention keys and values, sorted by name for a deterministic signature
+    std::map<std::string, Expr> encoderKeysValues;
+    auto transformerFirstState = std::dynamic_pointer_cast<TransformerState>(decodeFirstState);
+    if (transformerFirstState)
+      for (const auto& kv : transformerFirstState->getEncoderKeysValues())
+        encoderKeysValues[kv.first] = kv.second;
+
+    // decode_next() continues from keys and values of any past length, so it starts from placeholders
+    // of length pastSentinelDim instead of the states of decode_first(), which are of length 1
+    auto decodeNextStartState = decodeFirstState;
+    if (transformerFirstState && modelOptions->get<std::string>("transformer-decoder-autoreg", "self-attention") == "self-attention") {
+      auto past = [&](Expr e) {
+        Shape shape = e->shape();
+        shape.set(-2, (int)pastSentinelDim);
+        return graph->constant(shape, inits::zeros());
+      };
+      rnn::States pastStates;
+      for (const auto& d : decodeFirstState->getStates())
+        pastStates.push_back(rnn::State{past(d.output), past(d.cell)});
+      auto pastState = New<TransformerState>(pastStates, decodeFirstState->getLogProbs(), decodeFirstState->getEncoderStates(), batch);
+      pastState->setEncoderKeysValues(transformerFirstState->getEncoderKeysValues());
+      pastState->setPosition(decodeFirstState->getPosition());
+      decodeNextStartState = pastState;
+    }
+
     // run it further until the next prediction --> decode_next()
     // This adds more operations to the tape.
-    auto decodeNextState = model->step(graph, decodeFirstState, /*hypIndices=*/{},
+    auto decodeNextState = model->step(graph, decodeNextStartState, /*hypIndices=*/{},
       /*words=*/{ vocabs.back()->randWord() }, /*batchIndices=*/{ 0 }, /*beamSize=*/1);
     auto decodeNextEmbeddingInput = extractEmbeddingInputs(/*forEncoder=*/false);
     auto decodeNextPosRangeInput = extractInputByName("data_" + std::to_string(numEncoders) + "_posrange");
@@ -155,6 +191,8 @@ namespace marian {
     outputs.emplace_back(std::make_pair("first_logits", decodeFirstState->getLogProbs().getLogits()));
     for (const auto& dss : extractStates(decodeFirstState))
       outputs.emplace_back(std::make_pair("first_decoder_state_" + std::to_string(outputs.size()-1), dss));
+    for (const auto& kv : encoderKeysValues)
+      outputs.emplace_back(std::make_pair("first_encoder_keys_values_" + kv.first, kv.second));
     functionDefs["decode_first"] = std::make_pair(std::move(inputs), std::move(outputs));
 
     // descriptor for decode_next(prev_word, data_1_posrange, encoder_context_0, data_0_mask, decoder_state_0, decoder_state_1, ...) -> logits, decoder_state_0, decoder_state_1, ...
@@ -164,15 +202,17 @@ namespace marian {
       inputs.emplace_back(encoderContexts[i]);
       inputs.emplace_back(encoderEmbeddingInputs[1 + 2 * i]);
     }
-    for (const auto& dss : extractStates(decodeFirstState))
+    for (const auto& dss : extractStates(decodeNextStartState))
       inputs.emplace_back(std::make_pair("decoder_state_" + std::to_string(inputs.size() - (numEncoders*2 + 2)), dss));
+    for (const auto& kv : encoderKeysValues) // the same for all steps, so they are not outputs
+      inputs.emplace_back(std::make_pair("encoder_keys_values_" + kv.first, kv.second));
     outputs.emplace_back(std::make_pair("next_logits", decodeNextState->getLogProbs().getLogits()));
     for (const auto& dss : extractStates(decodeNextState))
       outputs.emplace_back(std::make_pair("next_decoder_state_" + std::to_string(outputs.size() - 1), dss));
     functionDefs["decode_next"] = std::make_pair(std::move(inputs), std::move(outputs));
 
     // now export the sub-graph as given by the function descriptor
-    serializeToONNX(modelToPrefix, std::move(functionDefs), sentinelDim);
+    serializeToONNX(modelToPrefix, std::move(functionDefs), dynamicAxes);
   }
 }
 
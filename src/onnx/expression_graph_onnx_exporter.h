@@ -8,12 +8,18 @@ namespace marian {
     // export a seq2seq model to a set of ONNX files
     void exportToONNX(const std::string& modelToPrefix, Ptr<Options> modelOptions, const std::vector<std::string>& vocabPaths);
 
+    // [sentinel dimension] -> name of the dynamic ONNX axis it stands for
+    typedef std::map<size_t, std::string> DynamicAxes;
+
   private:
     // [name] -> (vector(name, Expr), vector(name, Expr))
     typedef std::map<std::string, std::pair<std::vector<std::pair<std::string, Expr>>, std::vector<std::pair<std::string, Expr>> >> FunctionDefs;
 
+    // emit layer_normalization as a single LayerNormalization node instead of InstanceNormalization with reshapes
+    bool fuseLayerNorm_{false};
+
     // serialize the current nodesForward_ to an ONNX file. This operation is destructive.
-    void serializeToONNX(const std::string& filename, FunctionDefs&& functionDefs, size_t sentinelDim);
+    void serializeToONNX(const std::string& filename, FunctionDefs&& functionDefs, const DynamicAxes& dynamicAxes);
 
     // find a node on the current forward tape
     Expr tryFindForwardNodeByName(const std::string& nodeName) const;
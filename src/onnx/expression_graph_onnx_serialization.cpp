@@ -49,6 +49,11 @@ namespace marian {
       return tryGetAttributes<NNaryNodeOp>(e, [&](IPtr<NNaryNodeOp> np) { eps = np->eps_; });
     }
 
+    template<class NNaryNodeOp>
+    static bool tryGetScaleAttribute(Expr e, float& scale) {
+      return tryGetAttributes<NNaryNodeOp>(e, [&](IPtr<NNaryNodeOp> np) { scale = np->scale_; });
+    }
+
     template<class NNaryNodeOp>
     static bool tryGetAxisAttribute(Expr e, size_t& axis) {
       return tryGetAttributes<NNaryNodeOp>(e, [&](IPtr<NNaryNodeOp> np) { axis = (size_t)e->shape().axis(np->axis_); });
@@ -412,6 +417,28 @@ namespace marian {
         }
       }
 #endif
+      else if (v->type() == "fused_attention") {
+        // softmax(q k^T * scale + mask) v, as the pattern of unfused attention
+        auto q = v->child(0);
+        auto k = v->child(1);
+        auto vals = v->child(2);
+        float scale{};
+        E::tryGetScaleAttribute<FusedAttentionNodeOp>(v, scale) || E::fail();
+        auto scores = bdot(q, swapAxes(k, -1, -2)) * newConstant(v, {}, scale, "scale");
+        if (v->children().size() > 3)
+          scores = scores + v->child(3);
+        n = bdot(softmax(scores), vals);
+      }
+      else if (v->type() == "layer_normalization" && fuseLayerNorm_) {
+        // LayerNormalization normalizes along the last axis like Marian, but expects scale and bias vectors
+        auto s = v->child(1);
+        auto b = v->children().size() > 2 ? v->child(2) : nullptr;
+        if (s->shape().size() != 1 || (b && b->shape().size() != 1)) {
+          float epsilon;
+          E::tryGetEpsilonAttribute<LayerNormalizationOp>(v, epsilon) || E::fail();
+          n = layerNorm(v->child(0), flatten(s), b ? flatten(b) : nullptr, epsilon);
+        }
+      }
       else if (v->type() == "layer_normalization" &&
                (v->child(0)->shape().size() != 3 || v->child(1)->shape().size() != 1 || (v->children().size() > 2 && v->child(2)->shape().size() != 1))) {
         // ONNX InferenceNormalization is layer norm for shapes (N, C, D, ...) where N and C are
@@ -490,10 +517,9 @@ namespace marian {
 
   using namespace onnx; // all -Proto classes come from here
 
-  const std::string LENGTH_AXIS_NAME = "SOURCE_LENGTH";  // the source length is a named (dynamic) axis with this name
-
   // C++ port of a subset of https://github.com/onnx/onnx/blob/master/onnx/helper.py
-  static ValueInfoProto makeValueInfoProto(std::string name, TensorProto_DataType dataType, std::vector<size_t> shape, size_t sentinelDim) {
+  static ValueInfoProto makeValueInfoProto(std::string name, TensorProto_DataType dataType, std::vector<size_t> shape,
+                                           const ExpressionGraphONNXExporter::DynamicAxes& dynamicAxes) {
     ValueInfoProto valueInfo;
     valueInfo.set_name(name);
     auto* valueInfoType = valueInfo.mutable_type();
@@ -501,8 +527,8 @@ namespace marian {
     valueInfoTensorType->set_elem_type(dataType);
     auto* valueInfoTensorTypeShape = valueInfoTensorType->mutable_shape();
     for (auto dim : shape)
-      if (dim == sentinelDim)
-        valueInfoTensorTypeShape->add_dim()->set_dim_param(LENGTH_AXIS_NAME);
+      if (dynamicAxes.count(dim)) // dynamic axes are named
+        valueInfoTensorTypeShape->add_dim()->set_dim_param(dynamicAxes.at(dim));
       else
         valueInfoTensorTypeShape->add_dim()->set_dim_value(dim);
     return valueInfo;
@@ -721,7 +747,7 @@ namespace marian {
     }
   }
 
-  static void logNode(const NodeProto& node, const std::vector<size_t>& shape, size_t sentinelDim) {
+  static void logNode(const NodeProto& node, const std::vector<size_t>& shape, const ExpressionGraphONNXExporter::DynamicAxes& dynamicAxes) {
     std::string s = node.name() + " = " + node.op_type() + "(";
     auto addComma = [&]() { if (s.back() != '(' && s.back() != '[') s += ", "; };
     for (int i = 0; i < node.input_size(); i++) {
@@ -737,8 +763,8 @@ namespace marian {
     s += (") : [");
     for (auto dim : shape) {
       addComma();
-      if (dim == sentinelDim)
-          s += LENGTH_AXIS_NAME;
+      if (dynamicAxes.count(dim))
+          s += dynamicAxes.at(dim);
       else
           s += std::to_string(dim);
     }
@@ -752,7 +778,7 @@ namespace marian {
   static void addExprNode(Expr expr, std::vector<NodeProto>& nodes, std::vector<ValueInfoProto>& inputs,
                           std::vector<TensorProto>& initializers,
                           const std::map<Expr, std::string>& nameOverrides, const InputsMap& inputsMap,
-                          size_t sentinelDim) {
+                          const ExpressionGraphONNXExporter::DynamicAxes& dynamicAxes, bool fuseLayerNorm) {
     // get all children
     // These may reference inputs, and hence must be mapped right here.
     // The original child in this case is not on the tape.
@@ -797,7 +823,7 @@ namespace marian {
       for (auto& dim : shape)
         n *= dim;
       std::vector<float> zeros(n);
-      inputs.      push_back(makeValueInfoProto(paddingName, TensorProto_DataType::TensorProto_DataType_FLOAT, shape, sentinelDim));
+      inputs.      push_back(makeValueInfoProto(paddingName, TensorProto_DataType::TensorProto_DataType_FLOAT, shape, dynamicAxes));
       initializers.push_back(makeTensorProto   (paddingName, TensorProto_DataType::TensorProto_DataType_FLOAT, shape, zeros));
       LOG(info, "Pad constant {}", paddingName);
       // Concat([paddingNode, sliceNode], axis=0)
@@ -822,10 +848,11 @@ namespace marian {
       auto shape = getExprShape(expr);
       auto shape64 = std::vector<int64_t>(shape.begin(), shape.end());
       for (auto& dim : shape64)
-        if (dim == (int64_t)sentinelDim)
+        if (dynamicAxes.count((size_t)dim))
           dim = -1;  // means that this one is inferred at runtime
+      ABORT_IF(std::count(shape64.begin(), shape64.end(), -1) > 1, "Reshape {} to more than one dynamic axis", name);
       std::vector<size_t> shapeShape{shape.size()}; // ONNX Reshape requires shape in INT64
-      inputs.      push_back(makeValueInfoProto(shapeInputName, TensorProto_DataType::TensorProto_DataType_INT64, shapeShape, sentinelDim));
+      inputs.      push_back(makeValueInfoProto(shapeInputName, TensorProto_DataType::TensorProto_DataType_INT64, shapeShape, dynamicAxes));
       initializers.push_back(makeTensorProto   (shapeInputName, TensorProto_DataType::TensorProto_DataType_INT64, shapeShape, shape64));
       std::string s = shapeInputName;
       for (auto& dim : shape64)
@@ -907,6 +934,10 @@ namespace marian {
     float epsilon;
     if (E::tryGetEpsilonAttribute<LayerNormalizationOp>(expr, epsilon)) {
       addAttribute(node, "epsilon", epsilon);
+      if (fuseLayerNorm) { // the LayerNormalization of ONNX opset 17, also known to ONNX Runtime at earlier opsets
+        *node.mutable_op_type() = "LayerNormalization";
+        addAttribute(node, "axis", -1);
+      }
     }
     // dropout patches
     if (node.op_type() == "Sub" && children[0]->type() == "const" && children[0]->name().find("opRandomUniform_") == 0) {
@@ -928,14 +959,14 @@ namespace marian {
   // We declare this to be ONNX operator set 9. @TODO: Which ONNX version does this correspond to?
   // The nodes must only contain operations supported by ONNX, so the caller must first call
   // expandMacroOpsForONNX().
-  // One batch axis can be variable-length. It is recognized via a hack: by a special
-  // dimension value that otherwise never naturally occurs, e.g. a larger prime number.
+  // Axes can be variable-length. They are recognized via a hack: by special dimension values
+  // that otherwise never naturally occur, e.g. larger prime numbers, see dynamicAxes.
   // We will not recognize derivates of this value, such as value+1 or value x another dimension.
   // @TODO: This presently does not support variable batch dimensions. How does ONNX handle them?
   // @TODO: How to handle guided alignment? That's another input. Name? Shape?
   // This is based on the simple example in
   // https://github.com/onnx/onnx/blob/master/onnx/examples/make_model.ipynb
-  void ExpressionGraphONNXExporter::serializeToONNX(const std::string& fileRoot, FunctionDefs&& functionDefs, size_t sentinelDim) {
+  void ExpressionGraphONNXExporter::serializeToONNX(const std::string& fileRoot, FunctionDefs&& functionDefs, const DynamicAxes& dynamicAxes) {
     GOOGLE_PROTOBUF_VERIFY_VERSION;
 
     // @TODO: expansion must deal with multiple sub-tapes (encoder, init)
@@ -1026,7 +1057,7 @@ namespace marian {
             (expr->type() == "const" && expr->name().find("opRandomUniform_") != 0)) { // leaves are not nodes in ONNX (except for the uniform placeholder @HACKHACK 2)
           //LOG(info, "exporting leaf name {} op {} ({})", getExprName(expr), E::mapExprOp(expr), expr->children().size());
           auto shape = getExprShape(expr);
-          inputsParamsAndConstants.push_back(makeValueInfoProto(getExprName(expr, nameOverrides), getExprDataType(expr), shape, sentinelDim));
+          inputsParamsAndConstants.push_back(makeValueInfoProto(getExprName(expr, nameOverrides), getExprDataType(expr), shape, dynamicAxes));
           // don't create an initializers entry for inputs
           if (std::any_of(inputsMap.begin(), inputsMap.end(), [&](const std::pair<Expr, Expr>& inputMap) {
                 return inputMap.second == expr;
@@ -1043,10 +1074,10 @@ namespace marian {
           initializers.push_back(makeExprTensorProto(expr, nameOverrides));
           continue;      // parameters must become initializers, name=input name
         }
-        addExprNode(expr, nodes, inputsParamsAndConstants, initializers, nameOverrides, inputsMap, sentinelDim);
-        logNode(nodes.back(), getExprShape(expr), sentinelDim);
+        addExprNode(expr, nodes, inputsParamsAndConstants, initializers, nameOverrides, inputsMap, dynamicAxes, fuseLayerNorm_);
+        logNode(nodes.back(), getExprShape(expr), dynamicAxes);
 
-        auto valueInfo = makeValueInfoProto(nodes.back().name(), getExprDataType(expr), getExprShape(expr), sentinelDim);
+        auto valueInfo = makeValueInfoProto(nodes.back().name(), getExprDataType(expr), getExprShape(expr), dynamicAxes);
         if (outputsSet.find(expr) != outputsSet.end())
           outputs.push_back(valueInfo);
         //else // we add expected-shape information, to more easily be able to track down where it may fail
@@ -2,10 +2,28 @@
 
 #include "common/io.h"
 #include "tensors/tensor_operators.h"
+#include "3rd_party/mio/mio.hpp"
 #include <array>
+#include <cstring>
+#include <future>
 
 namespace marian {
 
+// *.bin files, e.g. of --sharded-optimizer-state, are memory-mapped instead of read into memory first;
+// the items are only valid while mmap exists
+static std::vector<io::Item> loadStateItems(const std::string& name, mio::mmap_source& mmap) {
+  if(!io::isBin(name))
+    return io::loadItems(name);
+  mmap = mio::mmap_source(name);
+  return io::mmapItems(mmap.data());
+}
+
+void OptimizerBase::updateAndSmoothImpl(Tensor params, Tensor grads, Tensor avg, float avgDecay, size_t actualMBSize, size_t refMBWords) {
+  updateImpl(params, grads, actualMBSize, refMBWords);
+  using namespace functional;
+  Element(_1 = ((1.f - avgDecay) * _1) + (avgDecay * _2), avg, params);
+}
+
 void Sgd::updateImpl(Tensor params, Tensor grads, size_t actualMBSize, size_t refMBWords) {
   actualMBSize, refMBWords; // (no correction for base update needed beyond using ce-sum)
   using namespace functional;
@@ -55,7 +73,8 @@ void Adagrad::load(const std::string& name,
 
   std::vector<float> vGt;
 
-  auto items = io::loadItems(name);
+  mio::mmap_source mmap;
+  auto items = loadStateItems(name, mmap);
   for(auto item : items) {
     // get the size of gt_
     auto totalSize = item.shape.elements();
@@ -121,18 +140,121 @@ void Adagrad::resetStats() {
 
 // Adam
 
+// Moments of 16-bit types are moved and zeroed through a uint16 view of their memory, as the 16-bit float
+// types are not dispatched by TensorBase::get() and set()
+static Tensor asUInt16(Tensor t) {
+  return TensorBase::New(t->memory(), t->shape(), Type::uint16, t->getBackend());
+}
+
+static void zeroMoment(Tensor t) {
+  if(t->type() == Type::float32)
+    t->set(0.f);
+  else
+    asUInt16(t)->set((uint16_t)0);
+}
+
+template <typename M>
+static std::vector<float> toFloats(const std::vector<uint16_t>& bits) {
+  std::vector<float> v(bits.size());
+  for(size_t i = 0; i < bits.size(); ++i) {
+    M m;
+    std::memcpy((void*)&m, &bits[i], sizeof(m));
+    v[i] = (float)m;
+  }
+  return v;
+}
+
+template <typename M>
+static std::vector<uint16_t> toBits(std::vector<float>::const_iterator begin, std::vector<float>::const_iterator end) {
+  std::vector<uint16_t> bits(end - begin);
+  for(size_t i = 0; i < bits.size(); ++i) {
+    M m = (M)begin[i];
+    std::memcpy(&bits[i], &m, sizeof(m));
+  }
+  return bits;
+}
+
+// the checkpoint always holds float32 moments, independent of --optimizer-state-precision
+static std::vector<float> getMoment(Tensor t) {
+  std::vector<float> v;
+  if(t->type() == Type::float32) {
+    t->get(v);
+    return v;
+  }
+  std::vector<uint16_t> bits;
+  asUInt16(t)->get(bits);
+  return t->type() == Type::float16 ? toFloats<float16>(bits) : toFloats<bfloat16>(bits);
+}
+
+static void setMoment(Tensor t, std::vector<float>::const_iterator begin, std::vector<float>::const_iterator end) {
+  if(t->type() == Type::float32)
+    t->set(std::vector<float>(begin, end));
+  else
+    asUInt16(t)->set(t->type() == Type::float16 ? toBits<float16>(begin, end) : toBits<bfloat16>(begin, end));
+}
+
 void Adam::updateImpl(Tensor params, Tensor grads, size_t actualMBSize, size_t refMBWords) {
-  // lazy allocation
-  if(!alloc_)
-    alloc_ = New<TensorAllocator>(params->getBackend());
+  updateAndSmoothImpl(params, grads, /*avg=*/nullptr, /*avgDecay=*/0.f, actualMBSize, refMBWords);
+}
+
+void Adam::allocate(Ptr<Backend> backend, int elements) {
+  size_t bytes = 2 * elements * sizeOf(momentType_);
+  if(offloaded(backend)) {
+    auto host = BackendByDeviceId({backend->getDeviceId().no, DeviceType::cpu}, /*seed=*/0);
+    host->setNumThreads(offloadThreads_);
+    alloc_ = New<TensorAllocator>(host);
+    alloc_->reserveExact(bytes + 2 * elements * sizeof(float));
+    alloc_->allocate(paramsHost_, {1, elements});
+    alloc_->allocate(gradsHost_, {1, elements});
+  } else {
+    alloc_ = New<TensorAllocator>(backend);
+    alloc_->reserveExact(bytes);
+  }
+  alloc_->allocate(mt_, {1, elements}, momentType_);
+  alloc_->allocate(vt_, {1, elements}, momentType_);
+}
+
+// Elements per chunk of an offloaded update
+static const size_t OFFLOAD_CHUNK = 1 << 22;
+
+// The shard is updated in chunks: while the CPU updates one chunk, the gradients and parameters of the
+// next chunk are downloaded and the parameters of the previous chunk are uploaded.
+void Adam::updateOffloaded(Tensor params, Tensor grads, const AdamStep& step) {
+  size_t elements = params->size();
+  auto download = [&](size_t offset) {
+    size_t size = std::min(OFFLOAD_CHUNK, elements - offset);
+    gradsHost_->subtensor(offset, size)->copyFrom(grads->subtensor(offset, size));
+    paramsHost_->subtensor(offset, size)->copyFrom(params->subtensor(offset, size));
+  };
+  auto upload = [&](size_t offset) {
+    size_t size = std::min(OFFLOAD_CHUNK, elements - offset);
+    params->subtensor(offset, size)->copyFrom(paramsHost_->subtensor(offset, size));
+  };
+
+  std::future<void> downloaded = std::async(std::launch::async, download, 0);
+  std::future<void> uploaded;
+  for(size_t offset = 0; offset < elements; offset += OFFLOAD_CHUNK) {
+    downloaded.get();
+    if(offset + OFFLOAD_CHUNK < elements)
+      downloaded = std::async(std::launch::async, download, offset + OFFLOAD_CHUNK);
+
+    size_t size = std::min(OFFLOAD_CHUNK, elements - offset);
+    AdamUpdate(paramsHost_->subtensor(offset, size), mt_->subtensor(offset, size), vt_->subtensor(offset, size),
+               gradsHost_->subtensor(offset, size), /*avg=*/nullptr, step);
+
+    if(uploaded.valid())
+      uploaded.get();
+    uploaded = std::async(std::launch::async, upload, offset);
+  }
+  uploaded.get();
+}
 
+void Adam::updateAndSmoothImpl(Tensor params, Tensor grads, Tensor avg, float avgDecay, size_t actualMBSize, size_t refMBWords) {
+  // lazy allocation
   if(!mt_) {
-    int elements = (int)params->size();
-    alloc_->reserveExact(2 * params->memory()->size());
-    alloc_->allocate(mt_, {1, elements});
-    mt_->set(0.f);
-    alloc_->allocate(vt_, {1, elements});
-    vt_->set(0.f);
+    allocate(params->getBackend(), (int)params->size());
+    zeroMoment(mt_);
+    zeroMoment(vt_);
   }
 
   double T    = (double)actualMBSize;
@@ -158,20 +280,29 @@ void Adam::updateImpl(Tensor params, Tensor grads, size_t actualMBSize, size_t r
   denom2_ = (beta2 * denom2_) + (1 - beta2); // RMS normalization
 
   // numerators. Divide by T to convert ce-sum gradient to avg gradient.
-  using namespace functional;
-  Element(_1 = ((float)beta1 * _1) + float((1 - beta1) / T    ) *  _2,       mt_, grads); // momentum smoothing. At steady state: =smoothed avg gradient
-  Element(_1 = ((float)beta2 * _1) + float((1 - beta2) / T / T) * (_2 * _2), vt_, grads); // RMS normalization.  At steady state: =mean square of the avg gradients
-
-  // apply Adam normalization
-  float etaf = (float)eta, denom1f = (float)denom1_, denom2f = (float)denom2_, decayf = (float)decay; // (get casts out of Element expression for readability)
-  Element(_1 -= etaf                               // learning-rate: x_t = x_{t-1} - \eta * (...)
-                * ((  (     _2 / denom1f)          // momentum-smoothed per-sample gradient: m_{t-1}
-                    / (sqrt(_3 / denom2f) + eps_)) // normalize by RMS: \sqrt(v_{t-1})
-                   + decayf * _1),                 // weight-decay: w * x_{t-1}
-          params, // =_1
-          mt_,    // =_2
-          vt_     // =_3
-          );
+  // At steady state mt is the smoothed avg gradient and vt the mean square of the avg gradients.
+  // The moments, the Adam normalization and the optional smoothing are done by one kernel.
+  AdamStep step;
+  step.beta1    = (float)beta1;
+  step.beta2    = (float)beta2;
+  step.scale1   = float((1 - beta1) / T    ); // momentum smoothing
+  step.scale2   = float((1 - beta2) / T / T); // RMS normalization
+  step.eta      = (float)eta;                 // learning-rate: x_t = x_{t-1} - \eta * (...)
+  step.denom1   = (float)denom1_;
+  step.denom2   = (float)denom2_;
+  step.eps      = eps_;
+  step.decay    = (float)decay;               // weight-decay: w * x_{t-1}
+  step.avgDecay = avgDecay;
+  step.lazy     = lazy_;
+  if(paramsHost_) {
+    updateOffloaded(params, grads, step);
+    if(avg) { // the smoothed parameters stay on the device
+      using namespace functional;
+      Element(_1 = ((1.f - avgDecay) * _1) + (avgDecay * _2), avg, params);
+    }
+  } else {
+    AdamUpdate(params, mt_, vt_, grads, avg, step);
+  }
 
   params->getBackend()->synchronize(); // @TODO: This should not be in here. Maybe in the wrapper. Why is it needed at all?
 }
@@ -191,7 +322,8 @@ void Adam::load(const std::string& name,
   std::vector<float> vVt;
   std::array<double, 2> vDenoms;
 
-  auto items = io::loadItems(name);
+  mio::mmap_source mmap;
+  auto items = loadStateItems(name, mmap);
   for(auto item : items) {
     // get the size of mt_ and vt_, they are the same
     auto totalSize = item.shape.elements();
@@ -224,21 +356,15 @@ void Adam::load(const std::string& name,
   scatterFn(vMt,
     [&](size_t localDeviceIndex, std::vector<float>::const_iterator begin, std::vector<float>::const_iterator end) {
     auto opt = std::dynamic_pointer_cast<Adam>(opts[localDeviceIndex]);
-    if(!opt->mt_ || !opt->vt_) { // lazily allocate
-      if(!opt->alloc_)
-        opt->alloc_ = New<TensorAllocator>(backends[localDeviceIndex]);
-      auto size = end-begin;
-      opt->alloc_->reserveExact(2 * sizeof(float) * size);
-      opt->alloc_->allocate(opt->mt_, {1, (int)size});
-      opt->alloc_->allocate(opt->vt_, {1, (int)size});
-    }
-    opt->mt_->set(std::vector<float>(begin, end)); // set the value
+    if(!opt->mt_ || !opt->vt_) // lazily allocate
+      opt->allocate(backends[localDeviceIndex], (int)(end - begin));
+    setMoment(opt->mt_, begin, end); // set the value
   });
 
   scatterFn(vVt,
     [&](size_t id, std::vector<float>::const_iterator begin, std::vector<float>::const_iterator end) {
     auto opt = std::dynamic_pointer_cast<Adam>(opts[id]);
-    opt->vt_->set(std::vector<float>(begin, end));
+    setMoment(opt->vt_, begin, end);
   });
 
   denom1_ = vDenoms[0];
@@ -256,16 +382,12 @@ void Adam::save(const std::string& name,
   // fetch and concatenate state vectors from distributed shards into a CPU-side vector
   auto vMt = gatherFn([&](size_t localDeviceIndex) {
     auto opt = std::dynamic_pointer_cast<Adam>(opts[localDeviceIndex]);
-    std::vector<float> data;
-    opt->mt_->get(data);
-    return data;
+    return getMoment(opt->mt_);
   });
 
   auto vVt = gatherFn([&](size_t localDeviceIndex) {
     auto opt = std::dynamic_pointer_cast<Adam>(opts[localDeviceIndex]);
-    std::vector<float> data;
-    opt->vt_->get(data);
-    return data;
+    return getMoment(opt->vt_);
   });
 
   // if not main MPI process then we have done our duty
@@ -304,10 +426,10 @@ void Adam::save(const std::string& name,
 
 void Adam::resetStats() {
   if(mt_)
-    mt_->set(0.f);
+    zeroMoment(mt_);
 
   if(vt_)
-    vt_->set(0.f);
+    zeroMoment(vt_);
 
   denom1_ = 0; // @BUGBUG: or 1 or refMBWords if so specified. Fix once we have proper parameterization for that.
   denom2_ = 0;
@@ -326,12 +448,27 @@ Ptr<OptimizerBase> Optimizer(Ptr<Options> options) {
 
   auto opt = options->get<std::string>("optimizer");
 
+  Type stateType = typeFromString(options->get<std::string>("optimizer-state-precision", "float32"));
+  ABORT_IF(stateType != Type::float32 && stateType != Type::float16 && stateType != Type::bfloat16,
+           "Optimizer state precision {} is not supported, use float32, float16 or bfloat16", stateType);
+  if(stateType != Type::float32 && opt != "adam")
+    LOG(warn, "[optimizers] Only Adam supports --optimizer-state-precision {}, {} keeps float32", stateType, opt);
+  bool lazy = options->get<bool>("optimizer-lazy", false);
+  if(lazy && opt != "adam")
+    LOG(warn, "[optimizers] Only Adam supports --optimizer-lazy, {} updates all parameters", opt);
+  if(options->get<size_t>("optimizer-offload", 0) > 0 && opt != "adam")
+    LOG(warn, "[optimizers] Only Adam supports --optimizer-offload, {} keeps its state on the device", opt);
+
   if(opt == "sgd") {
     return Optimizer<Sgd>(lrate, refMBWordsParam, clipper, params);
   } else if(opt == "adagrad") {
     return Optimizer<Adagrad>(lrate, refMBWordsParam, clipper, params);
   } else if(opt == "adam") {
-    return Optimizer<Adam>(lrate, refMBWordsParam, clipper, params);
+    auto adam = Optimizer<Adam>(lrate, refMBWordsParam, clipper, params);
+    std::dynamic_pointer_cast<Adam>(adam)->setMomentType(stateType);
+    std::dynamic_pointer_cast<Adam>(adam)->setLazy(lazy);
+    std::dynamic_pointer_cast<Adam>(adam)->setOffload(options->get<size_t>("optimizer-offload", 0));
+    return adam;
   } else {
     ABORT("Unknown optimizer kind: {}", opt);
   }
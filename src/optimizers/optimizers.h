@@ -41,21 +41,18 @@ public:
   }
 
   void update(Tensor params, Tensor grads, size_t mbSize = mbSizeNotProvided) {
-    if(clipper_)
-      clipper_->clip(grads); //@BUGBUG: take into account actual mini-batch size since gradients are not normalized
-
-    size_t refMBWords = refMBWordsParam_;
-    if (refMBWords == 0) { // optimizer not configured to use hyper-parameter auto-adjustment
-      refMBWords = mbSize = 1; // neutral settings that keep the standard behavior
-    }
-    else { // optimizer is configured to auto-adjust hyper-parameters
-      ABORT_IF(mbSize == mbSizeNotProvided, "Using rational optimizer auto-adjustment with trainer that does not provide MB size");
-      // note: this behavior is only meaningful if using the ce-sum criterion
-    }
-
+    size_t refMBWords = prepareUpdate(grads, mbSize);
     updateImpl(params, grads, mbSize, refMBWords);
   }
 
+  // update() followed by exponential smoothing of the updated parameters into avg:
+  //   avg = (1 - avgDecay) * avg + avgDecay * params
+  // Adam does both in one pass over the memory.
+  void updateAndSmooth(Tensor params, Tensor grads, Tensor avg, float avgDecay, size_t mbSize = mbSizeNotProvided) {
+    size_t refMBWords = prepareUpdate(grads, mbSize);
+    updateAndSmoothImpl(params, grads, avg, avgDecay, mbSize, refMBWords);
+  }
+
   virtual void init(TrainingState& state) override {
     eta_ = state.eta;
   }
@@ -80,6 +77,9 @@ public:
 
   virtual void setParams(const std::vector<float>& params) = 0;
 
+  // The tensors of the optimizer state of the shard, empty before the first update, see --local-sgd-average-optimizer
+  virtual std::vector<Tensor> stateTensors() { return {}; }
+
   typedef std::function<void(size_t /*localDeviceIndex*/,
                              std::vector<float>::const_iterator /*begin*/,
                              std::vector<float>::const_iterator /*end*/)> ScatterStateSetFunc;
@@ -99,8 +99,25 @@ public:
 
 protected:
   virtual void updateImpl(Tensor params, Tensor grads, size_t actualMBSize, size_t refMBWords) = 0;
+  virtual void updateAndSmoothImpl(Tensor params, Tensor grads, Tensor avg, float avgDecay, size_t actualMBSize, size_t refMBWords);
   virtual void resetStats() = 0;
 
+  // clips the gradients and returns the reference MB size, adjusting mbSize to it if there is none
+  size_t prepareUpdate(Tensor grads, size_t& mbSize) {
+    if(clipper_)
+      clipper_->clip(grads); //@BUGBUG: take into account actual mini-batch size since gradients are not normalized
+
+    size_t refMBWords = refMBWordsParam_;
+    if (refMBWords == 0) { // optimizer not configured to use hyper-parameter auto-adjustment
+      refMBWords = mbSize = 1; // neutral settings that keep the standard behavior
+    }
+    else { // optimizer is configured to auto-adjust hyper-parameters
+      ABORT_IF(mbSize == mbSizeNotProvided, "Using rational optimizer auto-adjustment with trainer that does not provide MB size");
+      // note: this behavior is only meaningful if using the ce-sum criterion
+    }
+    return refMBWords;
+  }
+
   // Learning rate
   float eta_;
   // Reference MB size. This enables automatic adjustment of optimizer hyper-parameters to MB size.
@@ -148,6 +165,12 @@ public:
       eps_ = params[0];
   }
 
+  std::vector<Tensor> stateTensors() override {
+    if(!gt_)
+      return {};
+    return {gt_};
+  }
+
 private:
   void updateImpl(Tensor params, Tensor grads, size_t actualMBSize, size_t refMBWords) override;
   void resetStats() override;
@@ -164,6 +187,8 @@ private:
  *
  * with Frank's modifications for automatic hyper-parameter adjustment.
  */
+struct AdamStep;
+
 class Adam : public OptimizerBase {
 public:
   Adam(float eta, size_t refMBWordsParam = 0, Ptr<ClipperBase> clipper = nullptr)
@@ -178,8 +203,32 @@ public:
             const GatherStateFunc& gatherFn,
             bool isMainProcess = true) override;
 
+  // Element type of the moments, float32 by default; float16 and bfloat16 halve their memory. The moments
+  // are always computed in float32, see --optimizer-state-precision.
+  void setMomentType(Type type) { momentType_ = type; }
+
+  // Lazy Adam: only parameters with a non-zero gradient and their moments are updated, see --optimizer-lazy
+  void setLazy(bool lazy) { lazy_ = lazy; }
+
+  // Keeps the moments of GPU shards in host memory and updates these shards on the CPU with `threads`
+  // threads, see --optimizer-offload. 0 keeps the moments on the device of the parameters.
+  void setOffload(size_t threads) { offloadThreads_ = threads; }
+
+  std::vector<Tensor> stateTensors() override {
+    if(!mt_)
+      return {};
+    return {mt_, vt_};
+  }
+
 private:
+  bool offloaded(Ptr<Backend> backend) const {
+    return offloadThreads_ > 0 && backend->getDeviceId().type == DeviceType::gpu;
+  }
+  void allocate(Ptr<Backend> backend, int elements);
+  void updateOffloaded(Tensor params, Tensor grads, const AdamStep& step);
+
   void updateImpl(Tensor params, Tensor grads, size_t actualMBSize, size_t refMBWords) override;
+  void updateAndSmoothImpl(Tensor params, Tensor grads, Tensor avg, float avgDecay, size_t actualMBSize, size_t refMBWords) override;
   void resetStats() override;
 
   // Adam parameters:
@@ -208,9 +257,16 @@ private:
   double denom2_ = 0;
 
   // GPU-side running accumulators
+  Type momentType_{Type::float32};
+  bool lazy_{false};
   Ptr<TensorAllocator> alloc_;
   Tensor mt_;
   Tensor vt_;
+
+  // host copies of the parameters and gradients of an offloaded shard
+  size_t offloadThreads_{0};
+  Tensor paramsHost_;
+  Tensor gradsHost_;
 };
 
 template <class Algorithm>
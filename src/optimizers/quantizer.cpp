@@ -8,72 +8,8 @@
 
 namespace marian {
 
-/* simulate a fixed quantization for values in data.
- * For example:
- * data  = [0.96, 0.73, 0.82, 0.84, 0.42, 0.29, 0.65]
- * res   = [1   , 0.6,  0.8 , 0.8 , 0.4,  0.2 , 0.6 ]
- *
- * @param data contains the original data
- * @param res will contain the resulting quantized data. set data = res for in-place operation
- * @param numCenters the number of quantized centers in absolute. It should be 2^(bit-1)
- * @param S stores the scaling factor.
- */
-static void fixedPointQuantization(Tensor data, Tensor res, int numCenters, float S) {
-  using namespace functional;
-  float multiplier = numCenters / S;
-
-  // clip based on the scale
-  Element(_1 = clip(_2, S), res, data);
-
-  // get the quantization bin ID
-  Element(_1 = round(_1 * multiplier), res);
-
-  // revert back to floating point representation
-  Element(_1 /= multiplier, res);
-}
-
-/* simulate a log-based quantization for values in data. The quantized value will be in the form of
- * S*2^q For example: 
- * data  = [0.9, 0.7, 0.5, 0.2 , 1.1] 
- * res   = [1,   0.5, 0.5, 0.25, 1  ]
- *
- * @param data contains the original data.
- * @param res will contain the resulting quantized data. set data = res for in-place operation.
- * @param size the data size.
- * @param numCenters the number of quantized centers in absolute. It should be 2^(bit-1).
- * @param S stores the scaling factor.
- * @param base for log quantized center. Default of 2.
- */
-static void logQuantization(Tensor data, Tensor res, int numCenters, float S, float base = 2.0f) {
-  using namespace functional;
-
-  // clip based on the scaling factor
-  Element(_1 = clip(_2, S), res, data);
-
-  // multiplier such that the quantization is rounded in normal-space instead of log space.
-  // 4/3 for base = 2. example: 11.8 should be quantized to 8, instead of 16.
-  float mult = (2.0f * base) / (1.0f + base);
-
-  // log-quantization works as the following:
-  // 1. capture the sign:
-  // sign = sgn(v)
-  // 2. get the quantization center:
-  // qc = floor(log2(abs(v/S) * _mult))
-  // 3. clip the center to make sure we have no more than 2^(bit-1) centers.
-  // qc = clip(qc, num_centers)
-  // 4. revert back to floating point space:
-  // q = 2^qc * S * sign
-  //
-  // The above steps are writen in 1 call as below, to avoid reserving extra Tensors:
-
-  Element(
-      _1 = sgn(_1)                                                // revert the sign back
-           * S                                                    // revert the scaling function
-           * pow(base,                                            // revert from log space to normal FP represtation
-                 clip(floor(log(abs(_1 / S) * mult) / log(base)), // get the quantization center
-                      (float) numCenters)),                       // clip
-      res);
-}
+// parts of the partial sums of QuantizeScaleStats(), one block each on the GPU
+static const size_t SCALE_STATS_PARTS = 64;
 
 /* Quantize all the parameters (except bias, unless enabled via --quantize-biases).
  * Quantization only works if we store the quantization error residual.
@@ -99,49 +35,39 @@ void ModelQuantizer::quantize(Ptr<ExpressionGraph> graph) {
   {
     // apply error feedback mechanism
     using namespace functional;
-    Element(_1 += _2, graph->params()->vals(), errorResidual_); // add the previous error residual to the current model 
-    errorResidual_->copyFrom(graph->params()->vals()); // set the model as the error-residual (will be updated below)
+    Element(_1 += _2, graph->params()->vals(), errorResidual_); // add the previous error residual to the current model
   }
 
+  // The parameters are consecutive in the memory of vals, and so are their error residuals. The
+  // residuals of the quantized parameters are written while quantizing them, new error-residual =
+  // original model - quantized model, those of the others stay 0. Skip the first one.
+  auto vals = graph->params()->vals();
   for(auto p : *graph->params()) {
     // quantize weight tensors, biases optional
-    if(quantBias_ || p->val()->shape()[0] > 1)
-      quantizeImpl(p->val());
-  }
-
-  // get new error residual. Skip the first one.
-  if (!isFirstError_) {
-    using namespace functional;
-    Element(_1 -= _2, errorResidual_, graph->params()->vals()); // new error-residual = original model - quantized model
-  }
-  else {
-    errorResidual_->set(0);
-    isFirstError_ = false;
+    if(quantBias_ || p->val()->shape()[0] > 1) {
+      size_t offset = p->val()->data<float>() - vals->data<float>();
+      quantizeImpl(p->val(), isFirstError_ ? nullptr : errorResidual_->subtensor(offset, p->val()->size()));
+    }
   }
+  isFirstError_ = false;
 }
 
 
-/* Tensor quantization implementation.
+/* Tensor quantization implementation, with one pass over the tensor for the initial scaling factor,
+ * one per optimization step and one for the quantization and the error residual.
  * @param t is the tensor to be quantized (in-place)
+ * @param residual receives the quantization error of t, unless it is nullptr
  */
-void ModelQuantizer::quantizeImpl(Tensor t) {
+void ModelQuantizer::quantizeImpl(Tensor t, Tensor residual) {
   if(!tempVar_) {
-    // init the swap tensor
+    // init the swap tensor and the partial sums for the scaling optimization
     auto allocator = New<TensorAllocator>(t->getBackend());
-    allocator->reserveExact(sizeof(float));
+    allocator->reserveExact((1 + 2 * SCALE_STATS_PARTS) * sizeof(float));
     allocator->allocate(tempVar_, {1, 1});
+    allocator->allocate(stats_, {1, (int)(2 * SCALE_STATS_PARTS)});
     allocators_.push_back(allocator);
   }
 
-  // init additional tensor for scaling optimization
-  if(!delta_ && optSteps_ > 0) {
-    int msize = (int) errorResidual_->size();
-    auto allocator = New<TensorAllocator>(errorResidual_->getBackend());
-    allocator->reserveExact(msize * sizeof(float));
-    allocator->allocate(delta_, {1, msize});
-    allocators_.push_back(allocator);
-  }
-  
   Tensor tflat = t->subtensor(0, t->size());   // flatten t for reduce
 
   float S = 0.0f; // scaling factor S
@@ -151,38 +77,37 @@ void ModelQuantizer::quantizeImpl(Tensor t) {
     Reduce(abs(_1), max(_1, _2), 0.0f, tempVar_, tflat);
     S = tempVar_->get(0);
   }
+  if(S == 0.0f) { // all zeros, nothing to quantize
+    if(residual)
+      residual->set(0);
+    return;
+  }
+
+  QuantizeStep step;
+  step.scale = S;
+  step.numCenters = (float)((1 << (bits_ - 1)) - 1);
+  step.logBase = logQuant_ ? 2.0f : 0.0f;
 
   // optimize the scaling factor S
-  for(int i = 0; i < optSteps_; i++) {
-    Tensor q = delta_->subtensor(0, t->size());  // to store the quantized t
-    
+  std::vector<float> stats;
+  for(size_t i = 0; i < optSteps_; i++) {
     // let t be the original tensor, and q be the quantized tensor, and q = S*a where S is the
     // scaling factor. we want to optimize S to minimize MSE(S*a - t) therefore, S =
     // sum(a*t)/sum(a*a) see https://www.aclweb.org/anthology/2020.ngt-1.4.pdf for more details.
-    if(logQuant_)
-      logQuantization(t, q, (1 << (bits_ - 1)) - 1, S);
-    else
-      fixedPointQuantization(t, q, (1 << (bits_ - 1)) - 1, S);
-
-    // obtain a by applying q/=S
-    using namespace functional;
-    Element(_1 /= S, delta_);
-
-    // get sum(a*t)
-    Reduce(_1 * _2, tempVar_, tflat, q);
-    float deltaNumer = tempVar_->get(0);
-
-    // get sum(a*a)
-    Reduce(_1 * _1, tempVar_, q);
-    float deltaDenom = tempVar_->get(0);
-
-    S = deltaNumer / deltaDenom;  // S = sum(a*t)/sum(a*a)
+    // Both sums are computed in one pass without storing a.
+    QuantizeScaleStats(stats_, tflat, step);
+    stats_->get(stats);
+    double deltaNumer = 0, deltaDenom = 0;
+    for(size_t j = 0; j < SCALE_STATS_PARTS; j++) {
+      deltaNumer += stats[2 * j];
+      deltaDenom += stats[2 * j + 1];
+    }
+    if(deltaDenom == 0)
+      break;
+    step.scale = (float)(deltaNumer / deltaDenom);  // S = sum(a*t)/sum(a*a)
   }
 
   // final quantization
-  if(logQuant_) {
-    logQuantization(t, t, (1 << (bits_ - 1)) - 1, S);
-  } else
-    fixedPointQuantization(t, t,(1 << (bits_ - 1)) - 1, S);
+  Quantize(tflat, residual, step);
 }
 }  // namespace marian
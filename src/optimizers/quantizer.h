@@ -31,7 +31,7 @@ public:
   void quantize(Ptr<ExpressionGraph> graph);
 
 protected:
-  void quantizeImpl(Tensor t);
+  void quantizeImpl(Tensor t, Tensor residual);
 
   size_t bits_;
   size_t optSteps_;
@@ -42,7 +42,7 @@ protected:
   std::vector<Ptr<TensorAllocator>> allocators_;
 
   Tensor errorResidual_; // Tensor to store the error-residual
-  Tensor delta_; // temporary Tensor for storing q to calculate optimal S
   Tensor tempVar_; // single element Tensor for Reduce swap variable
+  Tensor stats_; // partial sums of QuantizeScaleStats() to calculate optimal S
 };
 }  // namespace marian
@@ -55,9 +55,14 @@ public:
     ABORT_IF(options_->hasAndNotEmpty("summary") && options_->get<bool>("normalize"),
              "Normalization by length cannot be used with summary scores");
 
+    ABORT_IF(options_->hasAndNotEmpty("summary") && options_->get<bool>("skip-softmax", false),
+             "Summary scores require log probabilities and cannot be used with --skip-softmax");
+
     options_->set("inference", true);
     options_->set("shuffle", "none");
     options_->set("cost-type", "ce-rescore"); // indicates that to keep separate per-batch-item scoresForSummary
+    if(options_->get<bool>("n-best"))
+      options_->set("share-source-encoding", true); // encode the source of all its candidates once
 
     if(options_->get<bool>("n-best"))
       corpus_ = New<CorpusNBest>(options_);
@@ -163,18 +168,27 @@ public:
           }
 
           // update statistics for the summarized score
-          std::unique_lock<std::mutex> lock(smutex);
+          float batchLoss = 0;
           for(auto s : scoresForSummary)
-            sumLoss += s;
-          sumWords += batch->back()->batchWords();
-          sumSamples += batch->size();
+            batchLoss += s;
+          {
+            std::lock_guard<std::mutex> lock(smutex);
+            sumLoss += batchLoss;
+            sumWords += batch->back()->batchWords();
+            sumSamples += batch->size();
+          }
 
           if(!summarize) {
+            // format outside of the output lock and write the whole batch at once
+            std::vector<long> ids;
+            std::vector<std::string> messages;
             if(!wordLevel) {
-              for(size_t i = 0; i < batch->size(); ++i)
-                output->Write((long)batch->getSentenceIds()[i],
-                              -1.f * sentScores[i],  // report logProb while score is CE, hence negate
-                              aligns[i]);
+              for(size_t i = 0; i < batch->size(); ++i) {
+                ids.push_back((long)batch->getSentenceIds()[i]);
+                messages.push_back(output->format(ids.back(),
+                                                  -1.f * sentScores[i],  // report logProb while score is CE, hence negate
+                                                  aligns[i]));
+              }
             } else {
               std::vector<float> wordScores;
               float sentScore{0.f};
@@ -194,12 +208,14 @@ public:
                   // TODO: return length-normalized scores in both marian-scorer and marian-decoder
                   sentScore /= sentLengths[i];
 
-                output->Write((long)batch->getSentenceIds()[i], sentScore, aligns[i], wordScores);
+                ids.push_back((long)batch->getSentenceIds()[i]);
+                messages.push_back(output->format(ids.back(), sentScore, aligns[i], wordScores));
 
                 wordScores.clear();
                 sentScore = 0.f;
               }
             }
+            output->Write(ids, messages);
           }
 
           // progress heartbeat for MS-internal Philly compute cluster
@@ -4,6 +4,7 @@
 #include "common/utils.h"
 
 #include <iostream>
+#include <sstream>
 
 namespace marian {
 
@@ -20,8 +21,22 @@ ScoreCollector::ScoreCollector(const Ptr<Options>& options)
 
 void ScoreCollector::Write(long id, const std::string& message) {
   std::lock_guard<std::mutex> lock(mutex_);
+  writeOrdered(id, message);
+  *outStrm_ << std::flush;
+}
+
+void ScoreCollector::Write(const std::vector<long>& ids, const std::vector<std::string>& messages) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for(size_t i = 0; i < ids.size(); ++i)
+    writeOrdered(ids[i], messages[i]);
+  *outStrm_ << std::flush;
+}
+
+void ScoreCollector::writeOrdered(long id, const std::string& message) {
   if(id == nextId_) {
-    *outStrm_ << message << std::endl;
+    *outStrm_ << message;
+    if(!binary_)
+      *outStrm_ << "\n";
 
     ++nextId_;
 
@@ -32,7 +47,9 @@ void ScoreCollector::Write(long id, const std::string& message) {
 
       if(currId == nextId_) {
         // 1st element in the map is the next
-        *outStrm_ << iter->second << std::endl;
+        *outStrm_ << iter->second;
+        if(!binary_)
+          *outStrm_ << "\n";
 
         ++nextId_;
 
@@ -54,16 +71,16 @@ void ScoreCollector::Write(long id, const std::string& message) {
   }
 }
 
-void ScoreCollector::Write(long id,
-                           float score,
-                           const data::SoftAlignment& align /*= {}*/,
-                           const std::vector<float>& wordScores /*= {}*/) {
+std::string ScoreCollector::format(long /*id*/,
+                                   float score,
+                                   const data::SoftAlignment& align /*= {}*/,
+                                   const std::vector<float>& wordScores /*= {}*/) {
   auto msg = std::to_string(score);
   if(!alignment_.empty() && !align.empty())
     msg += " ||| " + getAlignment(align);
   if(!wordScores.empty())
     msg += " ||| WordScores= " + utils::join(wordScores, " ");
-  Write(id, msg);
+  return msg;
 }
 
 std::string ScoreCollector::getAlignment(const data::SoftAlignment& align) {
@@ -84,15 +101,51 @@ ScoreCollectorNBest::ScoreCollectorNBest(const Ptr<Options>& options)
       nBestList_(options->get<std::vector<std::string>>("train-sets").back()),
       fname_(options->get<std::string>("n-best-feature")) {
   file_.reset(new io::InputFileStream(nBestList_));
+  binary_ = options->get<std::string>("n-best-format", "text") == "binary";
+}
+
+data::NBestEntry ScoreCollectorNBest::readEntry(long id) {
+  std::lock_guard<std::mutex> lock(readMutex_);
+  auto iter = entries_.find(id);
+  if(iter == entries_.end()) {
+    ABORT_IF(lastRead_ >= id,
+             "Entry {} < {} already read but not in buffer",
+             id,
+             lastRead_);
+    data::NBestEntry entry;
+    while(lastRead_ < id && data::readNBestEntry(*file_, entry)) {
+      lastRead_++;
+      iter = entries_.emplace(lastRead_, std::move(entry)).first;
+    }
+    ABORT_IF(lastRead_ < id, "Too few entries in binary n-best list {}", nBestList_);
+  }
+
+  auto entry = std::move(iter->second);
+  entries_.erase(iter);
+  return entry;
 }
 
-void ScoreCollectorNBest::Write(long id,
-                                float score,
-                                const data::SoftAlignment& align /*= {}*/,
-                                const std::vector<float>& wordScores /*= {}*/) {
+std::string ScoreCollectorNBest::format(long id,
+                                       float score,
+                                       const data::SoftAlignment& align /*= {}*/,
+                                       const std::vector<float>& wordScores /*= {}*/) {
+  if(binary_) {
+    // the new score becomes the last feature of the score breakdown
+    auto entry = readEntry(id);
+    entry.scores.push_back(score);
+    if(!alignment_.empty() && !align.empty())
+      entry.alignment = align;
+    if(!wordScores.empty())
+      entry.wordScores = wordScores;
+
+    std::ostringstream message;
+    data::writeNBestEntry(message, entry);
+    return message.str();
+  }
+
   std::string line;
   {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(readMutex_);
     auto iter = buffer_.find(id);
     if(iter == buffer_.end()) {
       ABORT_IF(lastRead_ >= id,
@@ -109,7 +162,7 @@ void ScoreCollectorNBest::Write(long id,
     buffer_.erase(iter);
   }
 
-  ScoreCollector::Write(id, addToNBest(line, fname_, score, align, wordScores));
+  return addToNBest(line, fname_, score, align, wordScores);
 }
 
 std::string ScoreCollectorNBest::addToNBest(const std::string nbest,
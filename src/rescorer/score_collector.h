@@ -4,6 +4,7 @@
 #include "common/definitions.h"
 #include "common/file_stream.h"
 #include "data/alignment.h"
+#include "data/nbest_binary.h"
 
 #include <map>
 #include <mutex>
@@ -15,16 +16,32 @@ public:
   ScoreCollector(const Ptr<Options>& options);
   virtual ~ScoreCollector() {}
 
-  virtual void Write(long id, const std::string& message);
-  virtual void Write(long id,
-                     float score,
-                     const data::SoftAlignment& align = {},
-                     const std::vector<float>& wordScores = {});
+  void Write(long id, const std::string& message);
+  void Write(long id,
+             float score,
+             const data::SoftAlignment& align = {},
+             const std::vector<float>& wordScores = {}) {
+    Write(id, format(id, score, align, wordScores));
+  }
+
+  // Writes the messages of a whole batch at once, hence the lock is only taken and the output only
+  // flushed once per batch. Messages should be created with format() before.
+  void Write(const std::vector<long>& ids, const std::vector<std::string>& messages);
+
+  // Creates the output line for a scored sentence, can be called concurrently
+  virtual std::string format(long id,
+                             float score,
+                             const data::SoftAlignment& align = {},
+                             const std::vector<float>& wordScores = {});
 
 protected:
   long nextId_{0};
   UPtr<std::ostream> outStrm_;
   std::mutex mutex_;
+  bool binary_{false}; // messages are binary n-best entries and written without newlines
+
+  // Writes the message and all consecutive buffered messages if it is the next one. Requires mutex_.
+  void writeOrdered(long id, const std::string& message);
 
   typedef std::map<long, std::string> Outputs;
   Outputs outputs_;
@@ -50,10 +67,10 @@ public:
   ScoreCollectorNBest(const Ptr<Options>& options);
   ScoreCollectorNBest(const ScoreCollectorNBest&) = delete;
 
-  virtual void Write(long id,
-                     float score,
-                     const data::SoftAlignment& align = {},
-                     const std::vector<float>& wordScores = {}) override;
+  virtual std::string format(long id,
+                             float score,
+                             const data::SoftAlignment& align = {},
+                             const std::vector<float>& wordScores = {}) override;
 
 private:
   std::string nBestList_;
@@ -61,6 +78,10 @@ private:
   long lastRead_{-1};
   UPtr<io::InputFileStream> file_;
   std::map<long, std::string> buffer_;
+  std::mutex readMutex_; // guards reading the n-best list, separate from writing the output
+  std::map<long, data::NBestEntry> entries_; // used instead of buffer_ for binary n-best lists
+
+  data::NBestEntry readEntry(long id);
 
   std::string addToNBest(const std::string nbest,
                          const std::string feature,
@@ -49,6 +49,43 @@ struct AttentionNodeOp : public NaryNodeOp {
   const std::string color() override { return "yellow"; }
 };
 
+// The attention weights of attOps() followed by the masked softmax over the source positions, see
+// AttentionWeights(). Only for inference.
+struct AttentionWeightsNodeOp : public NaryNodeOp {
+  AttentionWeightsNodeOp(const std::vector<Expr>& nodes)
+      : NaryNodeOp(nodes, newShape(nodes)) {}
+
+  Shape newShape(const std::vector<Expr>& nodes) {
+    const auto& context = nodes[1]->shape(); // [src words, batch, depth]
+    const auto& state   = nodes[2]->shape(); // [beam, 1, batch, depth]
+    ABORT_IF(nodes[0]->shape()[-2] != context[-1] || nodes[0]->shape()[-1] != 1, "Wrong size");
+    ABORT_IF(state[-1] != context[-1] || state[-2] != context[-2], "Wrong size");
+    int dimBeam = state.size() > 3 ? state[-4] : 1;
+    return {dimBeam, context[-3], context[-2], 1};
+  }
+
+  NodeOps forwardOps() override {
+    Tensor mask = children_.size() > 3 ? child(3)->val() : nullptr;
+    float maskValue = NumericLimits<float>(value_type()).lowest / 2.f; // like softmax() with a mask
+    return {NodeOp(AttentionWeights(val_, child(0)->val(), child(1)->val(), child(2)->val(), mask, maskValue))};
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("The fused attention weights are only for inference");
+  }
+
+  const std::string type() override { return "att-weights"; }
+
+  const std::string color() override { return "yellow"; }
+};
+
+Expr attentionWeights(Expr va, Expr context, Expr state, Expr mask) {
+  std::vector<Expr> nodes{va, context, state};
+  if(mask)
+    nodes.push_back(mask);
+  return Expression<AttentionWeightsNodeOp>(nodes);
+}
+
 Expr attOps(Expr va, Expr context, Expr state) {
   std::vector<Expr> nodes{va, context, state};
 
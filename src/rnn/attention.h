@@ -8,6 +8,8 @@ namespace marian {
 namespace rnn {
 
 Expr attOps(Expr va, Expr context, Expr state);
+// attOps() followed by the masked softmax over the source positions in one operation, inference only
+Expr attentionWeights(Expr va, Expr context, Expr state, Expr mask);
 
 // Attitive attention used in RNN cells.
 // @TODO: come up with common framework for attention in RNNs and Transformer.
@@ -126,12 +128,18 @@ public:
       }
     }
 
-    auto attReduce = attOps(va_, mappedContext_, mappedState);
+    Expr e;
+    if(mappedState->graph()->isInference()) {
+      // scores, masked softmax and layout in one kernel, the mask [src words, batch] as the encoder has it
+      e = attentionWeights(va_, mappedContext_, mappedState, encState_->getMask());
+    } else {
+      auto attReduce = attOps(va_, mappedContext_, mappedState);
 
-    // @TODO: horrible ->
-    auto e = reshape(transpose(softmax(transpose(attReduce), softmaxMask_)),
-                     {dimBeam, srcWords, dimBatch, 1});
-    // <- horrible
+      // @TODO: horrible ->
+      e = reshape(transpose(softmax(transpose(attReduce), softmaxMask_)),
+                  {dimBeam, srcWords, dimBatch, 1});
+      // <- horrible
+    }
 
     auto alignedSource = scalar_product(encState_->getAttended(), e, /*axis =*/ -3);
 
@@ -977,6 +977,16 @@ public:
 
     return {maskedState, maskedCellState};
   }
+
+  State applySequence(std::vector<Expr> xWs, State state, Expr mask, bool reverse) override {
+    if(!state.cell)
+      return State();
+
+    // only the cell states are recurrent, the outputs are elementwise over all time steps
+    auto cellStates = ssruScan(state.cell, xWs[0], xWs[1], mask, reverse);
+    auto states = highway(tanh(cellStates), xWs[3], xWs[2]);
+    return {mask ? mask * states : states, cellStates};
+  }
 };
 
 class SSRU : public Cell {
@@ -1055,14 +1065,20 @@ public:
     auto x = xWs[0];
     auto f = xWs[1];
 
-    auto nextCellState = highway(cellState, x, f);  // rename to "gate"?
-    auto nextState = relu(nextCellState);
-
-    auto maskedCellState = mask ? mask * nextCellState : nextCellState;
-    auto maskedState = mask ? mask * nextState : nextState;
+    // the gate and the mask in one kernel; the mask is 0 or 1, so it commutes with the relu
+    auto maskedCellState = ssruCell(cellState, x, f, mask);
+    auto maskedState = relu(maskedCellState);
 
     return {maskedState, maskedCellState};
   }
+
+  State applySequence(std::vector<Expr> xWs, State state, Expr mask, bool reverse) override {
+    if(!state.cell)
+      return State();
+
+    auto cellStates = ssruScan(state.cell, xWs[0], xWs[1], mask, reverse);
+    return {relu(cellStates), cellStates};
+  }
 };
 
 // class LSSRU : public Cell {
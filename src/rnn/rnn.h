@@ -66,6 +66,13 @@ private:
 
     auto timeSteps = input->shape()[-3];
 
+    // all time steps in a single node, the outputs of the time steps along axis -3
+    auto sequence = cell_->applySequence(xWs, state, mask, direction_ == dir::backward);
+    if(sequence.output) {
+      last_.push_back({slice(sequence.output, -3, timeSteps - 1), slice(sequence.cell, -3, timeSteps - 1)});
+      return States({sequence});
+    }
+
     States outputs;
     for(int i = 0; i < timeSteps; ++i) {
       int j = i;
@@ -36,10 +36,22 @@ struct State {
     int numCols = isBatchMajor ? dimDepth * dimTime : dimDepth;
     // @TODO: Can this complex operation be more easily written using index_select()?
     sel = reshape(sel, { sel->shape().elements() / numCols, numCols }); // [beamSize * dimBatch, dimDepth] or [beamSize * dimBatch, dimTime * dimDepth]
-    sel = rows(sel, selIdx);
+    // Every hypothesis continuing from its own row, e.g. in greedy decoding, leaves the state as it is.
+    // Skipping the gather then avoids copying the whole (for the transformer: time-growing) state.
+    if(!isIdentity(selIdx, sel->shape()[0]))
+      sel = rows(sel, selIdx);
     sel = reshape(sel, { beamSize, isBatchMajor ? dimBatch : dimTime, isBatchMajor ? dimTime : dimBatch, dimDepth });
     return sel;
   }
+
+  static bool isIdentity(const std::vector<IndexType>& selIdx, int numRows) {
+    if((int)selIdx.size() != numRows)
+      return false;
+    for(size_t i = 0; i < selIdx.size(); ++i)
+      if(selIdx[i] != (IndexType)i)
+        return false;
+    return true;
+  }
 };
 
 class States {
@@ -167,6 +179,13 @@ public:
   virtual std::vector<Expr> applyInput(std::vector<Expr> inputs) = 0;
   virtual State applyState(std::vector<Expr>, State, Expr = nullptr) = 0;
 
+  // Cells whose recurrence is elementwise compute the outputs and cell states of all time steps
+  // (axis -3) of the sequence projected by applyInput() at once. Returns an empty state if the
+  // cell does not support this, then the time steps are unrolled with applyState().
+  virtual State applySequence(std::vector<Expr> /*xWs*/, State /*state*/, Expr /*mask*/, bool /*reverse*/) {
+    return State();
+  }
+
   virtual void clear() override {}
 };
 
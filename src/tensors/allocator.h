@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <deque>
+#include <iterator>
+#include <map>
 #include <memory>
 #include <set>
 #include <unordered_map>
@@ -86,10 +89,20 @@ private:
   size_t alignment_{256};
 
   bool throw_{false};
+  size_t limit_{0};     // largest size the workspace may grow to, 0 for no limit
+  size_t highWater_{0}; // largest end offset of an allocation since the last resetHighWater()
 
+  // Free memory is kept twice: ordered by size for best-fit allocation (the smallest gap that
+  // fits, lowest address first) and ordered by address for merging a freed piece with its
+  // neighbours in logarithmic time. Gaps are always maximal, no two gaps are adjacent.
   std::set<Gap> gaps_;
+  std::map<uint8_t*, size_t> gapsByAddress_; // [gap begin] -> gap size
   std::unordered_map<uint8_t*, MemoryPiece::PtrType> allocated_;
 
+  // Pieces at fixed offsets inside of allocated pieces, see view(). They are moved along with the
+  // workspace and released when the enclosing piece is freed.
+  std::vector<MemoryPiece::PtrType> views_;
+
   void grow(size_t add) {
     add = alignedSize(add);
     uint8_t* oldData = device_->data();
@@ -99,10 +112,13 @@ private:
 
     std::set<Gap> oldGaps;
     gaps_.swap(oldGaps);
+    gapsByAddress_.clear();
 
-    for(auto gap : oldGaps)
-      gaps_.insert(Gap(device_->data() + std::distance(oldData, gap.data()),
-                       gap.size()));
+    for(auto gap : oldGaps) {
+      Gap moved(device_->data() + std::distance(oldData, gap.data()), gap.size());
+      gaps_.insert(moved);
+      gapsByAddress_[moved.data()] = moved.size();
+    }
     insertGap(Gap(device_->data() + oldSize, add));
 
     std::unordered_map<uint8_t*, MemoryPiece::PtrType> oldAllocated;
@@ -112,11 +128,26 @@ private:
       allocated_[newPtr] = oldAllocated[it.first];
       allocated_[newPtr]->setPtr(newPtr);
     }
+
+    for(auto& view : views_)
+      view->setPtr(device_->data() + std::distance(oldData, view->data()));
+  }
+
+  void releaseViews(uint8_t* ptr, size_t bytes) {
+    auto inside = [=](const MemoryPiece::PtrType& view) {
+      return view->data() >= ptr && view->data() < ptr + bytes;
+    };
+    auto released = std::partition(views_.begin(), views_.end(), [&](const MemoryPiece::PtrType& view) {
+      return !inside(view);
+    });
+    for(auto it = released; it != views_.end(); ++it)
+      (*it)->set(nullptr, 0);
+    views_.erase(released, views_.end());
   }
 
   Gap getGap(size_t size) {
     size = alignedSize(size);
-    auto it = std::lower_bound(gaps_.begin(), gaps_.end(), Gap(nullptr, size));
+    auto it = gaps_.lower_bound(Gap(nullptr, size));
 
     if(throw_ && it == gaps_.end()) {
       //ABORT("Trying to allocate {}, but only {} available.", available_, size);
@@ -125,12 +156,27 @@ private:
 
     // @TODO: compact memory before re-allocation attempt, maybe by left shifting memory over currently largest gap
     while(it == gaps_.end()) {
-      grow(step_);
-      it = std::lower_bound(gaps_.begin(), gaps_.end(), Gap(nullptr, size));
+      if(available_ >= size) // enough memory is free, but not in one piece
+        LOG(info,
+            "[memory] Growing workspace of {} bytes for an allocation of {} bytes: {} bytes free in {} gaps, largest gap {} bytes ({:.1f}% fragmented)",
+            device_->size(), size, available_, gaps_.size(), largestGap(), 100.0 * fragmentation());
+      else
+        LOG(debug,
+            "[memory] Growing workspace of {} bytes for an allocation of {} bytes, {} bytes free",
+            device_->size(), size, available_);
+      size_t add = step_;
+      if(limit_ > 0 && device_->size() + add > limit_) // the last step may be smaller
+        add = limit_ > device_->size() ? limit_ - device_->size() : 0;
+      ABORT_IF(add == 0 || (add < size && available_ + add < size),
+               "Allocation of {} bytes would grow the workspace of {} bytes beyond its limit of {} bytes, see --workspace-limit",
+               size, device_->size(), limit_);
+      grow(add);
+      it = gaps_.lower_bound(Gap(nullptr, size));
     }
 
     Gap gap = *it;
     gaps_.erase(it);
+    gapsByAddress_.erase(gap.data());
 
     available_ -= gap.size();
     return gap;
@@ -139,19 +185,26 @@ private:
   void insertGap(Gap gap, bool consolidate = true) {
     available_ += gap.size();
     if(consolidate) {
-      auto it = gaps_.begin();
-      std::vector<decltype(it)> adjacent;
-      while(it != gaps_.end()) {
-        if(gap.adjacent(*it)) {
-          gap = gap.combine(*it);
-          adjacent.push_back(it);
+      // merge with the gap following and the gap preceding it, if they touch
+      auto next = gapsByAddress_.lower_bound(gap.data());
+      if(next != gapsByAddress_.end() && gap.data() + gap.size() == next->first) {
+        Gap nextGap(next->first, next->second);
+        gaps_.erase(nextGap);
+        next = gapsByAddress_.erase(next);
+        gap = gap + nextGap;
+      }
+      if(next != gapsByAddress_.begin()) {
+        auto prev = std::prev(next);
+        Gap prevGap(prev->first, prev->second);
+        if(prevGap.data() + prevGap.size() == gap.data()) {
+          gaps_.erase(prevGap);
+          gapsByAddress_.erase(prev);
+          gap = prevGap + gap;
         }
-        it++;
       }
-      for(auto&& a : adjacent)
-        gaps_.erase(a);
     }
     gaps_.insert(gap);
+    gapsByAddress_[gap.data()] = gap.size();
   }
 
 public:
@@ -176,11 +229,15 @@ public:
   }
 
   size_t alignedSize(size_t size) {
-    return (size_t)(ceil(size / (double)alignment_) * alignment_);
+    return (size + alignment_ - 1) / alignment_ * alignment_;
   }
 
   void throwAtReallocation(bool throwRealloc) { throw_ = throwRealloc; }
 
+  // Limits the size to which the workspace grows on demand, 0 for no limit
+  void setLimit(size_t bytes) { limit_ = bytes; }
+  size_t getLimit() const { return limit_; }
+
   void reserve(size_t bytes) {
     bytes = alignedSize(bytes);
     if(bytes > 0)
@@ -209,6 +266,7 @@ public:
     auto ptr = gap.data();
     auto mp = MemoryPiece::New(ptr, bytes);
     allocated_[ptr] = mp;
+    highWater_ = std::max(highWater_, (size_t)std::distance(device_->data(), ptr) + bytes);
     return mp;
   }
 
@@ -223,6 +281,8 @@ public:
     auto it = allocated_.find(ptr);
     if(it != allocated_.end()) {
       allocated_.erase(ptr);
+      if(!views_.empty())
+        releaseViews(ptr, bytes);
       insertGap(Gap(ptr, bytes), true);
       return true;
     }
@@ -230,6 +290,10 @@ public:
   }
 
   bool free(MemoryPiece::PtrType mp) {
+    // a view at offset 0 shares the address of its enclosing piece, it is not freed by itself
+    auto it = allocated_.find(mp->data());
+    if(it == allocated_.end() || it->second != mp)
+      return false;
     if(free(mp->data(), mp->size())) {
       mp->set(nullptr, 0);
       return true;
@@ -240,10 +304,23 @@ public:
   void clear() {
     available_ = 0;
     gaps_.clear();
+    gapsByAddress_.clear();
     allocated_.clear();
+    views_.clear();
     insertGap({device_->data(), device_->size()}, false);
   }
 
+  // Returns a piece of the given size at an offset inside of the allocated piece mp, e.g. for a
+  // precomputed memory plan. Views are not freed individually, but together with mp.
+  MemoryPiece::PtrType view(MemoryPiece::PtrType mp, size_t offset, size_t bytes) {
+    ABORT_IF(offset + bytes > mp->size(),
+             "View of {} bytes at offset {} exceeds the piece of {} bytes",
+             bytes, offset, mp->size());
+    auto view = MemoryPiece::New(mp->data() + offset, bytes);
+    views_.push_back(view);
+    return view;
+  }
+
   MemoryPiece::PtrType memory() {
     return MemoryPiece::New(device_->data(), device_->size());
   }
@@ -252,6 +329,17 @@ public:
 
   size_t available() { return available_; }
 
+  // Size of the largest free piece, the largest allocation that does not need to grow the workspace
+  size_t largestGap() { return gaps_.empty() ? 0 : gaps_.rbegin()->size(); }
+
+  // Share of the free memory that is not in the largest gap, 0 if all free memory is in one piece
+  double fragmentation() { return available_ == 0 ? 0.0 : 1.0 - (double)largestGap() / available_; }
+
+  // Size of the smallest reserved memory that the allocations so far would have needed with this
+  // allocation pattern, i.e. the high-water mark of the used address range
+  size_t highWater() { return highWater_; }
+  void resetHighWater() { highWater_ = 0; }
+
   DeviceId getDeviceId() { return device_->getDeviceId(); }
 };
 }  // namespace marian
@@ -21,6 +21,9 @@ public:
   // for GPU only, calls cudaSetDevice, does nothing on CPU. Maybe change name.
   virtual void setDevice() = 0;
   virtual void synchronize() = 0;
+
+  // for CPU only, number of threads that split single operations, does nothing on GPU.
+  virtual void setNumThreads(size_t /*threads*/) {}
 };
 
 Ptr<Backend> BackendByDeviceId(DeviceId deviceId, size_t seed);
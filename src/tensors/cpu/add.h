@@ -9,18 +9,50 @@
 #include "functional/shape.h"
 #include "functional/tensor.h"
 #include "functional/tmp.h"
+#include "tensors/cpu/backend.h"
 #include "tensors/tensor.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace marian {
 
 namespace cpu {
 
+// The kernels below compute the output elements [begin, end), so that Aggregate() can split them
+// across the threads of the graph, see parallelFor().
+
+// Number of independent partial results of a contiguous reduction. One accumulator is a chain of
+// dependent additions, several of them overlap and are vectorized by the compiler for sums, maxima etc.
+const int AGGREGATE_ACCUMULATORS = 8;
+
+// Aggregates functor applied to the elements [begin, end) of inputs of the same shape
+template <size_t K, class Functor, class AggFunctor>
+inline float aggregateContiguous(Functor functor, float aggInit, AggFunctor aggFunctor,
+                                 functional::Array<functional::Tensor<float>, K>& ins,
+                                 int begin, int end) {
+  float acc[AGGREGATE_ACCUMULATORS];
+  for(int a = 0; a < AGGREGATE_ACCUMULATORS; ++a)
+    acc[a] = aggInit;
+
+  int i = begin;
+  for(; i + AGGREGATE_ACCUMULATORS <= end; i += AGGREGATE_ACCUMULATORS)
+    for(int a = 0; a < AGGREGATE_ACCUMULATORS; ++a)
+      acc[a] = aggFunctor(acc[a], functional::apply(functor, ins, i + a));
+  for(; i < end; ++i)
+    acc[0] = aggFunctor(acc[0], functional::apply(functor, ins, i));
+
+  for(int a = 1; a < AGGREGATE_ACCUMULATORS; ++a)
+    acc[0] = aggFunctor(acc[0], acc[a]);
+  return acc[0];
+}
+
 template <size_t K, class Functor, class AggFunctor>
 void gAggregateGeneric(Functor functor, float aggInit, AggFunctor aggFunctor,
                  const functional::Shape full,
                  functional::Tensor<float> out,
                  functional::Array<functional::Tensor<float>, K> ins,
-                 float scale = 1.0) {
+                 float scale, int begin, int end) {
   int outLength = out.shape().elements();
   bool same = outLength == full.elements();
   for(size_t i = 0; i < K; ++i)
@@ -32,7 +64,7 @@ void gAggregateGeneric(Functor functor, float aggInit, AggFunctor aggFunctor,
     len[i] = full[i] / out.shape()[i];
 
   functional::Array<int, N> dims;
-  for(int index = 0; index < outLength; ++index) {
+  for(int index = begin; index < end; ++index) {
     if(same) {
       out[index] = aggFunctor(out[index], functional::apply(functor, ins, index) * scale);
     } else {
@@ -47,11 +79,10 @@ void gAggregateEqual(Functor functor, AggFunctor aggFunctor,
                functional::Tensor<float> out,
                functional::Array<functional::Tensor<float>, K> ins,
                float scale,
-               bool broadcast) {
-  int length = out.shape().elements();
+               bool broadcast, int begin, int end) {
   functional::Array<int, functional::Shape::size()> dims;
 
-  for(int index = 0; index < length; ++index) {
+  for(int index = begin; index < end; ++index) {
     functional::Array<int, K> indices;
     indices.fill(index);
 
@@ -65,24 +96,23 @@ void gAggregateEqual(Functor functor, AggFunctor aggFunctor,
   }
 }
 
+// reduction over the last axis, out[j] aggregates row j of full
 template <size_t K, class Functor, class AggFunctor>
 void gAggregateReduce(Functor functor, float aggInit, AggFunctor aggFunctor,
                 const functional::Shape full,
                 functional::Tensor<float> out,
                 functional::Array<functional::Tensor<float>, K> ins,
-                float scale = 1.0) {
-  int rows = full.elements() / full.back();
+                float scale, int begin, int end) {
   int cols = full.back();
 
   bool same = true;
   for(size_t i = 0; i < K; ++i)
     same = same && ins[i].shape().elements() == full.elements();
 
-  for(int j = 0; j < rows; ++j) {
+  for(int j = begin; j < end; ++j) {
     float colSum = aggInit;
     if(same) {
-      for(int id = 0; id < cols; ++id)
-        colSum = aggFunctor(colSum, functional::apply(functor, ins, j * cols + id));
+      colSum = aggregateContiguous(functor, aggInit, aggFunctor, ins, j * cols, (j + 1) * cols);
     } else {
       functional::Array<int, functional::Shape::size()> dims;
       for(int id = 0; id < cols; ++id) {
@@ -97,28 +127,78 @@ void gAggregateReduce(Functor functor, float aggInit, AggFunctor aggFunctor,
   }
 }
 
+// reduction over all but the last axis of inputs of the same shape, e.g. the gradients of biases:
+// out[c] aggregates column c of full, the rows are traversed in memory order for the columns
+// [begin, end)
+template <size_t K, class Functor, class AggFunctor>
+void gAggregateColumns(Functor functor, float aggInit, AggFunctor aggFunctor,
+                 const functional::Shape full,
+                 functional::Tensor<float> out,
+                 functional::Array<functional::Tensor<float>, K> ins,
+                 float scale, int begin, int end) {
+  int rows = full.elements() / full.back();
+  int cols = full.back();
+
+  std::vector<float> acc(end - begin, aggInit);
+  for(int j = 0; j < rows; ++j) {
+    int offset = j * cols + begin;
+    for(int c = 0; c < end - begin; ++c)
+      acc[c] = aggFunctor(acc[c], functional::apply(functor, ins, offset + c));
+  }
+  for(int c = begin; c < end; ++c)
+    out[c] = aggFunctor(out[c], acc[c - begin] * scale);
+}
+
 template <class Functor, class AggFunctor, class... Tensors>
 void Aggregate(Functor functor, float aggInit, AggFunctor aggFunctor, float scale, marian::Tensor out, Tensors... tensors) {
   auto full = marian::Shape::broadcast({out, tensors...});
 
-  //int length = out->shape().elements();
-
   constexpr size_t K = sizeof...(Tensors);
 
   functional::Tensor<float> gOut = out;
   functional::Array<functional::Tensor<float>, K> gIns = {tensors...};
 
-  if(full.back() != 1 && out->shape().back() == 1) {
-    //size_t m = full.elements() / length;
-    //size_t k = full.back();
-    cpu::gAggregateReduce(functor, aggInit, aggFunctor, full, gOut, gIns, scale);
+  int length = out->shape().elements();
+  bool sameInputs = true;
+  for(size_t i = 0; i < K; ++i)
+    sameInputs = sameInputs && gIns[i].shape().elements() == full.elements();
+
+  if(length == 1 && full.elements() > 1 && sameInputs) {
+    // reduction of everything: partial results of ranges of the inputs, aggregated in order
+    int elements = full.elements();
+    int chunks = (int)std::max((size_t)1, std::min((size_t)64, (size_t)elements / MIN_WORK_PER_THREAD));
+    std::vector<float> partial(chunks, aggInit);
+    parallelFor(out, chunks, (size_t)elements / chunks, [&](size_t begin, size_t end) {
+      for(size_t c = begin; c < end; ++c)
+        partial[c] = aggregateContiguous(functor, aggInit, aggFunctor, gIns,
+                                         (int)(c * elements / chunks), (int)((c + 1) * elements / chunks));
+    });
+    float total = aggInit;
+    for(auto p : partial)
+      total = aggFunctor(total, p);
+    gOut[0] = aggFunctor(gOut[0], total * scale);
+  } else if(full.back() != 1 && out->shape().back() == 1 && (size_t)length * full.back() == full.elements()) {
+    int cols = full.back();
+    parallelFor(out, length, cols, [&](size_t begin, size_t end) {
+      cpu::gAggregateReduce(functor, aggInit, aggFunctor, full, gOut, gIns, scale, (int)begin, (int)end);
+    });
   } else if(out->shape() == full) {
     bool broadcast = false;
     for(size_t i = 0; i < K; ++i)
       broadcast = broadcast || gOut.shape() != gIns[i].shape();
-    cpu::gAggregateEqual(functor, aggFunctor, gOut, gIns, scale, broadcast);
+    parallelFor(out, length, K + 1, [&](size_t begin, size_t end) {
+      cpu::gAggregateEqual(functor, aggFunctor, gOut, gIns, scale, broadcast, (int)begin, (int)end);
+    });
+  } else if(length == full.back() && out->shape().back() == full.back() && sameInputs) {
+    int rows = full.elements() / full.back();
+    parallelFor(out, length, rows, [&](size_t begin, size_t end) {
+      cpu::gAggregateColumns(functor, aggInit, aggFunctor, full, gOut, gIns, scale, (int)begin, (int)end);
+    });
   } else {
-    cpu::gAggregateGeneric(functor, aggInit, aggFunctor, full, gOut, gIns, scale);
+    size_t work = full.elements() / length;
+    parallelFor(out, length, work, [&](size_t begin, size_t end) {
+      cpu::gAggregateGeneric(functor, aggInit, aggFunctor, full, gOut, gIns, scale, (int)begin, (int)end);
+    });
   }
 }
 
@@ -0,0 +1,241 @@
+#include "tensors/cpu/amx_gemm.h"
+
+#include "common/logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__GNUC__) && !defined(__CUDACC__) && defined(__x86_64__) && defined(__linux__) \
+    && ((defined(__clang__) && __clang_major__ >= 12) || (!defined(__clang__) && __GNUC__ >= 11))
+#include <cpuid.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define AMX_GEMM_AVAILABLE 1
+#endif
+
+namespace marian {
+namespace cpu {
+namespace integer {
+namespace amx {
+
+static const int BLOCK_COLS = 16;  // columns of B in a block of the packed layout
+static const int TILE_INNER = 64;  // rows of B in a tile, bytes of a row of a tile of A
+
+// offset of the element (k, col) of B in the packed layout of a B with `cols` columns
+static inline size_t packedOffset(int k, int col, int inner, int cols) {
+  int block = col / BLOCK_COLS;
+  int w = std::min(BLOCK_COLS, cols - block * BLOCK_COLS);
+  return (size_t)block * BLOCK_COLS * inner + (size_t)(k / TILE_INNER) * TILE_INNER * w
+         + (k % TILE_INNER) / 4 * (w * 4) + (col % BLOCK_COLS) * 4 + k % 4;
+}
+
+// the 4 consecutive rows from k of the columns are contiguous in the packed layout
+void prepareBQuantizedTransposed(const int8_t* input, int8_t* output, int inner, int cols) {
+  ABORT_IF(inner % TILE_INNER != 0 || cols % 8 != 0,
+           "AMX needs an inner dimension that is a multiple of {} and columns that are a multiple of 8, not {} and {}",
+           TILE_INNER, inner, cols);
+  for(int col = 0; col < cols; ++col)
+    for(int k = 0; k < inner; k += 4)
+      std::memcpy(output + packedOffset(k, col, inner, cols), input + (size_t)col * inner + k, 4);
+}
+
+void selectColumnsB(const int8_t* input, int8_t* output, int inner, int cols, const uint32_t* begin, const uint32_t* end) {
+  int selected = (int)(end - begin);
+  ABORT_IF(selected % 8 != 0, "AMX selects columns in groups of 8, {} given", selected);
+  for(int j = 0; j < selected; ++j)
+    for(int k = 0; k < inner; k += 4)
+      std::memcpy(output + packedOffset(k, j, inner, selected), input + packedOffset(k, (int)begin[j], inner, cols), 4);
+}
+
+#ifdef AMX_GEMM_AVAILABLE
+
+// https://www.kernel.org/doc/html/latest/arch/x86/xstate.html
+static const int ARCH_REQ_XCOMP_PERM = 0x1023;
+static const int XFEATURE_XTILEDATA = 18;
+
+// AMX-TILE and AMX-INT8 in CPUID leaf 7, and permission of the kernel to use the tile data
+static bool detect() {
+  unsigned int eax, ebx, ecx, edx;
+  if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return false;
+  bool amxTile = (edx >> 24) & 1, amxInt8 = (edx >> 25) & 1, avx512bw = (ebx >> 30) & 1;
+  if(!amxTile || !amxInt8 || !avx512bw)
+    return false;
+  return syscall(SYS_arch_prctl, ARCH_REQ_XCOMP_PERM, XFEATURE_XTILEDATA) == 0;
+}
+
+bool available() {
+  static const bool available = detect();
+  return available;
+}
+
+// Everything up to the matching pop is compiled for AMX
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("amx-tile,amx-int8,avx512f,avx512bw"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("amx-tile,amx-int8,avx512f,avx512bw")
+#endif
+}  // namespace amx
+}  // namespace integer
+}  // namespace cpu
+}  // namespace marian
+
+#include <immintrin.h>
+
+namespace marian {
+namespace cpu {
+namespace integer {
+namespace amx {
+
+// palette 1: the C tiles tmm0 to tmm3, the A tiles tmm4 and tmm5, the B tiles tmm6 and tmm7
+struct TileConfig {
+  uint8_t palette{1};
+  uint8_t startRow{0};
+  uint8_t reserved[14]{};
+  uint16_t colsb[16]{};
+  uint8_t rows[16]{};
+
+  // for blocks of w columns of B
+  TileConfig(int w) {
+    for(int t = 0; t < 8; ++t) {
+      rows[t] = 16;
+      colsb[t] = (uint16_t)(t == 4 || t == 5 ? TILE_INNER : w * 4);
+    }
+  }
+};
+
+static const int ACC_COLS = 2 * BLOCK_COLS;  // columns of the accumulators of one step
+
+// Accumulates 16 or 32 rows of A, from `a` with `width` columns, times one or two blocks of w
+// columns of B into acc, [32, ACC_COLS]. The tiles of the blocks of B are bTile bytes apart.
+template <bool twoRows, bool twoBlocks>
+static inline void multiplyTiles(const int8_t* a, int width, const int8_t* b0, const int8_t* b1, int w, int32_t* acc) {
+  int bStride = w * 4;
+  size_t bTile = (size_t)TILE_INNER * w;
+  _tile_zero(0);
+  if(twoBlocks)
+    _tile_zero(1);
+  if(twoRows)
+    _tile_zero(2);
+  if(twoRows && twoBlocks)
+    _tile_zero(3);
+  for(int k = 0, t = 0; k < width; k += TILE_INNER, ++t) {
+    _tile_loadd(4, a + k, width);
+    if(twoRows)
+      _tile_loadd(5, a + (size_t)16 * width + k, width);
+    _tile_loadd(6, b0 + t * bTile, bStride);
+    if(twoBlocks)
+      _tile_loadd(7, b1 + t * bTile, bStride);
+    _tile_dpbssd(0, 4, 6);
+    if(twoBlocks)
+      _tile_dpbssd(1, 4, 7);
+    if(twoRows)
+      _tile_dpbssd(2, 5, 6);
+    if(twoRows && twoBlocks)
+      _tile_dpbssd(3, 5, 7);
+  }
+  const int accStride = ACC_COLS * sizeof(int32_t);
+  _tile_stored(0, acc, accStride);
+  if(twoBlocks)
+    _tile_stored(1, acc + w, accStride);
+  if(twoRows)
+    _tile_stored(2, acc + 16 * ACC_COLS, accStride);
+  if(twoRows && twoBlocks)
+    _tile_stored(3, acc + 16 * ACC_COLS + w, accStride);
+}
+
+// rows of A from `a` times the columns [col, col + w) or [col, col + 2 * w) of B
+static inline void multiplyStep(const int8_t* a, int rows, int width, const int8_t* B, int cols, int col, int w, bool twoBlocks,
+                                int32_t* acc, float unquantMult, const float* bias, float* out) {
+  const int8_t* b0 = B + (size_t)col * width;
+  const int8_t* b1 = b0 + (size_t)w * width;
+  if(rows > 16) {
+    if(twoBlocks)
+      multiplyTiles<true, true>(a, width, b0, b1, w, acc);
+    else
+      multiplyTiles<true, false>(a, width, b0, b1, w, acc);
+  } else {
+    if(twoBlocks)
+      multiplyTiles<false, true>(a, width, b0, b1, w, acc);
+    else
+      multiplyTiles<false, false>(a, width, b0, b1, w, acc);
+  }
+
+  int n = twoBlocks ? 2 * w : w;
+  for(int i = 0; i < rows; ++i) {
+    float* o = out + (size_t)i * cols + col;
+    const int32_t* c = acc + i * ACC_COLS;
+    if(bias) {
+      for(int j = 0; j < n; ++j)
+        o[j] = c[j] * unquantMult + bias[col + j];
+    } else {
+      for(int j = 0; j < n; ++j)
+        o[j] = c[j] * unquantMult;
+    }
+  }
+}
+
+void multiply(const int8_t* A, const int8_t* B, int rows, int width, int cols, float unquantMult, const float* bias, float* out) {
+  ABORT_IF(!available(), "Your CPU or operating system doesn't support AMX, necessary for type intgemm8amx");
+  ABORT_IF(width % TILE_INNER != 0 || cols % 8 != 0,
+           "AMX needs an inner dimension that is a multiple of {} and columns that are a multiple of 8, not {} and {}",
+           TILE_INNER, width, cols);
+
+  alignas(64) int32_t acc[32 * ACC_COLS];
+  std::vector<int8_t> padded; // the last rows of A if they fill fewer than 16 or 32 rows of a tile
+  int fullCols = cols - cols % BLOCK_COLS;
+
+  // blocks of 16 columns, then the last one of 8 with tiles of 8 columns
+  for(int w : {BLOCK_COLS, 8}) {
+    int colsBegin = w == BLOCK_COLS ? 0 : fullCols;
+    int colsEnd = w == BLOCK_COLS ? fullCols : cols;
+    if(colsBegin == colsEnd)
+      continue;
+    TileConfig config(w);
+    _tile_loadconfig(&config);
+
+    for(int row = 0; row < rows; row += 32) {
+      int m = std::min(32, rows - row);
+      const int8_t* a = A + (size_t)row * width;
+      if(m != 16 && m != 32) {
+        padded.assign((size_t)(m > 16 ? 32 : 16) * width, 0);
+        std::copy(a, a + (size_t)m * width, padded.begin());
+        a = padded.data();
+      }
+      float* o = out + (size_t)row * cols;
+      for(int col = colsBegin; col < colsEnd; col += 2 * w)
+        multiplyStep(a, m, width, B, cols, col, w, col + w < colsEnd, acc, unquantMult, bias, o);
+    }
+  }
+  _tile_release();
+}
+
+}  // namespace amx
+}  // namespace integer
+}  // namespace cpu
+}  // namespace marian
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#else  // AMX_GEMM_AVAILABLE
+
+bool available() {
+  return false;
+}
+
+void multiply(const int8_t*, const int8_t*, int, int, int, float, const float*, float*) {
+  ABORT("AMX kernels need GCC 11 or Clang 12 on x86-64 Linux, necessary for type intgemm8amx");
+}
+
+}  // namespace amx
+}  // namespace integer
+}  // namespace cpu
+}  // namespace marian
+
+#endif  // AMX_GEMM_AVAILABLE
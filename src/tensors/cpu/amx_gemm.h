@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+namespace marian {
+namespace cpu {
+namespace integer {
+
+// 8-bit matrix products with the AMX tile instructions of Sapphire Rapids and newer CPUs, the
+// kernels of Type::intgemm8amx. A is quantized like for intgemm, row-major with `width` columns.
+// B is packed in blocks of 16 of its columns, the last one may have 8. A block holds tiles of 64
+// rows of B, in which each row of the tile stores 4 consecutive rows of B for all columns of the
+// block, the layout TDPBSSD multiplies. The width has to be a multiple of 64, the columns of B a
+// multiple of 8. Compiled with function-level target attributes, they need GCC 11 or Clang 12.
+namespace amx {
+
+// Whether the CPU has AMX-INT8 and the OS allowed this process to use the tile registers
+bool available();
+
+// Packs B given as its transpose, quantized and row-major with `cols` rows of `inner` elements
+void prepareBQuantizedTransposed(const int8_t* input, int8_t* output, int inner, int cols);
+
+// Packs the columns [begin, end) of the packed B with `cols` columns into output
+void selectColumnsB(const int8_t* input, int8_t* output, int inner, int cols, const uint32_t* begin, const uint32_t* end);
+
+// out = unquantMult * A * B (+ bias) for A with `rows` rows and B with `cols` columns, bias may be
+// nullptr. out is row-major with `cols` columns.
+void multiply(const int8_t* A,
+              const int8_t* B,
+              int rows,
+              int width,
+              int cols,
+              float unquantMult,
+              const float* bias,
+              float* out);
+
+}  // namespace amx
+}  // namespace integer
+}  // namespace cpu
+}  // namespace marian
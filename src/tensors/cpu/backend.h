@@ -5,16 +5,45 @@
 
 #include "common/config.h"
 #include "tensors/backend.h"
+#include "tensors/cpu/worker_pool.h"
+#include "tensors/tensor.h"
 
 namespace marian {
 namespace cpu {
 
 class Backend : public marian::Backend {
+private:
+  UPtr<WorkerPool> workers_; // intra-op threads of this graph, nullptr if single-threaded
+
 public:
   Backend(DeviceId deviceId, size_t seed) : marian::Backend(deviceId, seed) {}
   void setDevice() override {}
   void synchronize() override {}
+
+  void setNumThreads(size_t threads) override {
+    workers_.reset(threads > 1 ? new WorkerPool(threads) : nullptr);
+  }
+
+  WorkerPool* getWorkerPool() { return workers_.get(); }
 };
 
+// Minimum number of elements a kernel processes per thread, below that the thread hand-off costs
+// more than it saves
+const size_t MIN_WORK_PER_THREAD = 16384;
+
+// Calls f(begin, end) on consecutive ranges of [0, items) in parallel on the threads of the backend
+// of tensor t, where every item costs about `work` elements. Runs f(0, items) directly if the graph
+// is single-threaded or the work is too small to split.
+template <class Function>
+inline void parallelFor(const Tensor& t, size_t items, size_t work, const Function& f) {
+  auto workers = static_cast<Backend*>(t->getBackend().get())->getWorkerPool();
+  size_t chunks = items * work / MIN_WORK_PER_THREAD;
+  if(!workers || chunks <= 1) {
+    f(0, items);
+    return;
+  }
+  workers->parallelFor(items, chunks, f);
+}
+
 }  // namespace cpu
 }  // namespace marian
@@ -0,0 +1,135 @@
+#include "tensors/cpu/block_sparse.h"
+
+#include "common/logging.h"
+
+#include <algorithm>
+
+namespace marian {
+namespace cpu {
+namespace blocksparse {
+
+// the sections of the block-CSR form, see block_sparse.h
+struct Layout {
+  int blockRows, blockCols, k, n, blocks;
+  const float* offsets;
+  const float* columns;
+  const float* values;
+
+  Layout(const float* packed) {
+    blockRows = (int)packed[0];
+    blockCols = (int)packed[1];
+    k = (int)packed[2];
+    n = (int)packed[3];
+    blocks = (int)packed[4];
+    offsets = packed + HEADER_SIZE;
+    columns = offsets + k / blockRows + 1;
+    values = columns + blocks;
+  }
+};
+
+bool pack(const float* W, int k, int n, int blockRows, int blockCols, float minZeros, std::vector<float>& packed) {
+  ABORT_IF(blockRows <= 0 || blockCols <= 0 || k % blockRows != 0 || n % blockCols != 0,
+           "Blocks of {}x{} do not tile a matrix of {}x{}", blockRows, blockCols, k, n);
+  int blockRowCount = k / blockRows, blockColCount = n / blockCols;
+
+  auto isZero = [&](int br, int bc) {
+    for(int r = 0; r < blockRows; ++r) {
+      const float* row = W + (size_t)(br * blockRows + r) * n + bc * blockCols;
+      for(int c = 0; c < blockCols; ++c)
+        if(row[c] != 0.f)
+          return false;
+    }
+    return true;
+  };
+
+  std::vector<float> offsets(1, 0.f), columns, values;
+  for(int br = 0; br < blockRowCount; ++br) {
+    for(int bc = 0; bc < blockColCount; ++bc) {
+      if(isZero(br, bc))
+        continue;
+      columns.push_back((float)bc);
+      for(int r = 0; r < blockRows; ++r) {
+        const float* row = W + (size_t)(br * blockRows + r) * n + bc * blockCols;
+        values.insert(values.end(), row, row + blockCols);
+      }
+    }
+    offsets.push_back((float)columns.size());
+  }
+
+  size_t total = (size_t)blockRowCount * blockColCount;
+  if((float)(total - columns.size()) < minZeros * total)
+    return false;
+  ABORT_IF(std::max(total, (size_t)n) >= (1u << 24), "Block indices of a {}x{} matrix do not fit into floats", k, n);
+
+  packed = {(float)blockRows, (float)blockCols, (float)k, (float)n, (float)columns.size()};
+  packed.insert(packed.end(), offsets.begin(), offsets.end());
+  packed.insert(packed.end(), columns.begin(), columns.end());
+  packed.insert(packed.end(), values.begin(), values.end());
+  return true;
+}
+
+int columns(const Tensor& packed) {
+  return Layout(packed->data()).n;
+}
+
+// Adds scalar * A[rows, :] * block to C[rows, columns of the block] for ROWS rows at a time, which
+// load each row of the block once into vector registers for all of them
+template <int ROWS>
+static inline void blockKernel(float* c, const float* a, int k, int n, const float* block, int blockRows, int blockCols, int col, int row0, float scalar) {
+  for(int r = 0; r < blockRows; ++r) {
+    const float* w = block + (size_t)r * blockCols;
+    float av[ROWS];
+    for(int i = 0; i < ROWS; ++i)
+      av[i] = scalar * a[(size_t)i * k + row0 + r];
+    for(int i = 0; i < ROWS; ++i) {
+      float* ci = c + (size_t)i * n + col;
+      float s = av[i];
+#pragma omp simd
+      for(int j = 0; j < blockCols; ++j)
+        ci[j] += s * w[j];
+    }
+  }
+}
+
+template <int ROWS>
+static void prodRows(float* c, const float* a, const Layout& layout, float scalar) {
+  int blockSize = layout.blockRows * layout.blockCols;
+  for(int br = 0; br * layout.blockRows < layout.k; ++br) {
+    for(int b = (int)layout.offsets[br]; b < (int)layout.offsets[br + 1]; ++b) {
+      int col = (int)layout.columns[b] * layout.blockCols;
+      blockKernel<ROWS>(c, a, layout.k, layout.n, layout.values + (size_t)b * blockSize,
+                        layout.blockRows, layout.blockCols, col, br * layout.blockRows, scalar);
+    }
+  }
+}
+
+void prod(Tensor C, const Tensor& A, const Tensor& packed, const Tensor& bias, float scalar) {
+  ABORT_IF(C->type() != Type::float32 || A->type() != Type::float32,
+           "Block-sparse products are only implemented for float32, not {}", A->type());
+  Layout layout(packed->data());
+  int k = A->shape()[-1];
+  int m = (int)(A->shape().elements() / k);
+  ABORT_IF(k != layout.k || C->shape()[-1] != layout.n,
+           "Block-sparse matrix {}x{} does not match the product of {} into {}", layout.k, layout.n, A->shape(), C->shape());
+
+  float* c = C->data();
+  const float* a = A->data();
+  int n = layout.n;
+  for(int i = 0; i < m; ++i) {
+    if(bias)
+      std::copy(bias->data(), bias->data() + n, c + (size_t)i * n);
+    else
+      std::fill(c + (size_t)i * n, c + (size_t)(i + 1) * n, 0.f);
+  }
+
+  const int TILE = 4;
+  int i = 0;
+  for(; i + TILE <= m; i += TILE)
+    prodRows<TILE>(c + (size_t)i * n, a + (size_t)i * k, layout, scalar);
+  for(; i < m; ++i)
+    prodRows<1>(c + (size_t)i * n, a + (size_t)i * k, layout, scalar);
+}
+
+}  // namespace blocksparse
+}  // namespace cpu
+}  // namespace marian
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "tensors/tensor.h"
+
+#include <string>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+// Block-sparse weights of pruned models for the CPU. marian-conv --block-sparse stores, next to a
+// parameter W [k, n] whose blocks of blockRows x blockCols values are mostly zero, the parameter
+// `packedName(W)` with the non-zero blocks in block-CSR form, one float32 row:
+//   [blockRows, blockCols, k, n, nonZeroBlocks,
+//    offsets into the blocks of each of the k / blockRows block rows, plus the end,
+//    the block column of each block,
+//    the values of each block, row-major]
+// The indices are stored as floats, exact up to 2^24. The product then only visits the non-zero blocks.
+namespace blocksparse {
+
+const int HEADER_SIZE = 5;
+
+// The parameter holding the block-CSR form of the parameter `name`
+static inline std::string packedName(const std::string& name) {
+  auto pos = name.rfind("::");
+  return (pos == std::string::npos ? name : name.substr(pos + 2)) + "_BlockSparse";
+}
+
+// Packs W [k, n], row-major, into `packed` if at least the fraction minZeros of its blocks is zero,
+// otherwise returns false. k and n are multiples of the block size.
+bool pack(const float* W, int k, int n, int blockRows, int blockCols, float minZeros, std::vector<float>& packed);
+
+// C = scalar * A * W (+ bias) for A [..., k] and the block-CSR form of W [k, n] in `packed`, bias may be nullptr
+void prod(Tensor C, const Tensor& A, const Tensor& packed, const Tensor& bias, float scalar);
+
+// The number of columns n of the packed W
+int columns(const Tensor& packed);
+
+}  // namespace blocksparse
+}  // namespace cpu
+}  // namespace marian
@@ -1,18 +1,124 @@
 #include "tensors/device.h"
 #include "tensors/cpu/aligned.h"
 #include <iostream>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace marian {
 namespace cpu {
 
+namespace {
+HugePages hugePages_ = HugePages::off;
+bool bindToNumaNode_ = false;
+thread_local int threadNumaNode_ = -1;
+
+#ifdef __linux__
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+const int MPOL_PREFERRED_ = 1;          // from numaif.h, which needs libnuma
+const unsigned MPOL_MF_MOVE_ = 1 << 1;
+const size_t MAX_NUMA_NODES = 1024;
+
+void* mapMemory(size_t bytes) {
+  void* ptr = MAP_FAILED;
+  if(hugePages_ == HugePages::hugetlb) {
+    ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(ptr == MAP_FAILED)
+      LOG_ONCE(warn, "[memory] Could not allocate {} bytes of reserved huge pages, using transparent huge pages", bytes);
+  }
+  if(ptr == MAP_FAILED)
+    ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ABORT_IF(ptr == MAP_FAILED, "Failed to allocate {} bytes on CPU", bytes);
+  return ptr;
+}
+
+// Asks for transparent huge pages and binds the pages to the NUMA node, also those already present
+void adviseAndBind(void* ptr, size_t bytes) {
+  if(hugePages_ != HugePages::off)
+    madvise(ptr, bytes, MADV_HUGEPAGE); // just advice, ignored where not supported
+  if(!bindToNumaNode_)
+    return;
+  int node = threadNumaNode_;
+  if(node < 0) {
+    unsigned cpu = 0, current = 0;
+    if(syscall(SYS_getcpu, &cpu, &current, nullptr) == 0)
+      node = (int)current;
+  }
+  if(node < 0 || node >= (int)MAX_NUMA_NODES - 1)
+    return;
+  std::vector<unsigned long> mask(MAX_NUMA_NODES / (8 * sizeof(unsigned long)), 0);
+  mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+  if(syscall(SYS_mbind, ptr, bytes, MPOL_PREFERRED_, mask.data(), MAX_NUMA_NODES, MPOL_MF_MOVE_) != 0)
+    LOG_ONCE(warn, "[memory] Could not bind CPU memory to NUMA node {}", node);
+}
+#endif
+}  // namespace
+
+void setMemoryPolicy(HugePages hugePages, bool bindToNumaNode) {
+  hugePages_ = hugePages;
+  bindToNumaNode_ = bindToNumaNode;
+}
+
+void setThreadNumaNode(int node) {
+  threadNumaNode_ = node;
+}
+
 Device::~Device() {
+#ifdef __linux__
+  if(mappedBytes_ > 0) {
+    munmap(data_, mappedBytes_);
+    return;
+  }
+#endif
   genericFree(data_);
 }
 
+// Memory-maps whole (huge) pages with --cpu-huge-pages or --cpu-numa-memory. Grows by remapping the
+// pages, so that they are neither copied nor touched, or by copying if they cannot be remapped, e.g.
+// reserved huge pages on older kernels.
+void Device::reserveMapped(size_t size) {
+#ifdef __linux__
+  size_t pageSize = hugePages_ != HugePages::off ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+  size_t bytes = (size + pageSize - 1) / pageSize * pageSize;
+
+  void* ptr = MAP_FAILED;
+  if(mappedBytes_ > 0)
+    ptr = mremap(data_, mappedBytes_, bytes, MREMAP_MAYMOVE);
+  if(ptr == MAP_FAILED) {
+    ptr = mapMemory(bytes);
+    if(data_) {
+      std::copy(data_, data_ + size_, static_cast<uint8_t*>(ptr));
+      if(mappedBytes_ > 0)
+        munmap(data_, mappedBytes_);
+      else
+        genericFree(data_);
+    }
+  }
+  adviseAndBind(ptr, bytes);
+  data_ = static_cast<uint8_t*>(ptr);
+  size_ = size;
+  mappedBytes_ = bytes;
+#else
+  size;
+  ABORT("Mapped CPU memory is only supported on Linux");
+#endif
+}
+
 void Device::reserve(size_t size) {
   size = align(size);
   ABORT_IF(size < size_ || size == 0,
            "New size must be larger than old size and larger than 0");
 
+#ifdef __linux__
+  if(hugePages_ != HugePages::off || bindToNumaNode_ || mappedBytes_ > 0) {
+    reserveMapped(size);
+    return;
+  }
+#endif
+
   uint8_t *temp = static_cast<uint8_t*>(genericMalloc(alignment_, size));
   if(data_) {
     std::copy(data_, data_ + size_, temp);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "tensors/cpu/backend.h"
 #include "tensors/tensor.h"
 
 namespace marian {
@@ -73,30 +74,59 @@ void element(const Functor& functor, marian::Tensor out, Tensors... tensors) {
   // call elementwise operation going from outer-most dimension
   // to inner-most element.
   F::Array<F::Tensor<ElementType>, argNum> gTensors = {out, tensors...};
-  E<0>::element(functor, gTensors, indices);
+
+  // split the outer-most dimension larger than 1 across the threads of the graph. The loops only
+  // take their extents from the output, so a range only needs a shorter output dimension and
+  // all pointers moved to its beginning.
+  int axis = 0;
+  while(axis < (int)F::Shape::size() - 1 && gTensors[0].shape()[axis] == 1)
+    ++axis;
+  int dim = gTensors[0].shape()[axis];
+  size_t elementsPerItem = out->shape().elements() / dim;
+
+  parallelFor(out, dim, elementsPerItem, [&](size_t begin, size_t end) {
+    auto range = gTensors;
+    range[0].shape().shape_[axis] = (int)(end - begin);
+    for(size_t k = 0; k < argNum; ++k)
+      range[k].data_ += begin * range[k].shape().bstride(axis);
+    E<0>::element(functor, range, indices);
+  });
 }
 
 // Dispatch elementwise functions with float element type based on number of 
-// elements. If dividable by 8 and AVX2 is available (TODO: check this?) use
-// AVX2 specific intrinsics. Similar for 4 and AVX. TODO: Add AVX512 support.
+// elements. If dividable by 16 and AVX512F is available use AVX512 specific
+// intrinsics, if dividable by 8 and AVX is available AVX specific intrinsics.
+// Similar for 4 and SSE.
 template <class Functor, class... Tensors>
 void elementFloat(const Functor& functor, marian::Tensor out, Tensors... tensors) {
 #ifndef __CUDACC__
   std::vector<marian::Tensor> ts({tensors...});
+  bool div16 = true;
   bool div8 = true;
   bool div4 = true;
 
+  if(out->shape()[-1] % 16 != 0)
+    div16 = false;
   if(out->shape()[-1] % 8 != 0)
     div8 = false;
   if(out->shape()[-1] % 4 != 0)
     div4 = false;
   for(auto t : ts) {
+    if(t->shape()[-1] % 16 != 0)
+      div16 = false;
     if(t->shape()[-1] % 8 != 0)
       div8 = false;
     if(t->shape()[-1] % 4 != 0)
       div4 = false;
   }
 
+  if(div16) {
+#ifdef __AVX512F__
+    element<float32x16>(functor, out, tensors...);
+    return;
+#endif
+  }
+
   if(div8) {
     // std::cerr << "8: " << functor.to_string() << std::endl;
 #ifdef __AVX__
@@ -2,7 +2,13 @@
 
 #include "graph/expression_graph.h"
 #include "fbgemm/packed_gemm.h"
+#include "tensors/cpu/block_sparse.h"
 #include "tensors/cpu/integer_common.h"
+#include "3rd_party/threadpool.h"
+
+#include <cstring>
+#include <future>
+#include <regex>
 
 namespace marian {
   namespace cpu {
@@ -15,23 +21,181 @@ namespace marian {
 
 // When FBGEMM based packed GEMM is used, some weight matrices need to be packed offline.
 // The decision which weights can be packed or not should be done walking through the graph.
-// This requires some more changes, but we temporarily do this just by name ("_W") of the weights.
+// This requires some more changes, but we temporarily do this by name of the weights: by default
+// those ending in "_W" or "_W?" like the weights of affine and dot ops, or by rules given with
+// setPackingRules(). Matrices whose shape the GEMM type cannot pack are saved as they are.
 // And, this introduces a low level packed_gemm.h apis interact with high level graph class.
 // So, we make a subclass of ExpressionGraph and put those immature codes in this class.
 // We will improve this in the near future. 
 class ExpressionGraphPackable : public ExpressionGraph {
+private:
+  // A parameter matching `pattern` is packed if `pack` is true, otherwise saved as it is
+  struct PackingRule {
+    std::regex pattern;
+    bool pack;
+  };
+  std::vector<PackingRule> packingRules_;
+
+  std::vector<int> sparseBlock_; // rows and columns of the blocks of --block-sparse, empty if not used
+  float sparseMinZeros_{0.5f};
+
+  bool quantizeEmbeddings_{false};
+  std::string outputEmbeddings_; // tied to the output layer, hence never quantized
+
+  // largest absolute values of the activations by parameter name, see setActivationStatistics()
+  std::map<std::string, float> activationMaxAbs_;
+
+  // Embedding matrices are named Wemb, or prefix_Wemb if not shared between encoder and decoder
+  bool isQuantizedEmbedding(const std::string& pName) const {
+    if(!quantizeEmbeddings_ || pName == outputEmbeddings_)
+      return false;
+    return pName == "Wemb" || (pName.length() > 5 && pName.compare(pName.length() - 5, 5, "_Wemb") == 0);
+  }
+
+  // Quantizes the rows of val to 8 bits, each with the scale of its largest absolute value, into
+  // the layout of Type::int8rows: the int8 values followed by the float32 scales
+  void quantizeRows(Tensor val, io::Item& item) const {
+    ABORT_IF(val->type() != Type::float32 || val->shape().size() != 2,
+             "Cannot quantize the rows of {} {}", val->type(), val->shape());
+    std::vector<float> values;
+    val->get(values);
+    size_t rows = val->shape()[0], cols = val->shape()[1];
+    item.type = Type::int8rows;
+    item.bytes.resize(requiredBytes(val->shape(), Type::int8rows));
+    int8_t* quantized = (int8_t*)item.bytes.data();
+    char* scales = item.bytes.data() + rows * cols;
+    for(size_t r = 0; r < rows; ++r) {
+      const float* row = values.data() + r * cols;
+      float max = 0.f;
+      for(size_t c = 0; c < cols; ++c)
+        max = std::max(max, std::abs(row[c]));
+      float scale = max > 0.f ? max / 127.f : 1.f;
+      for(size_t c = 0; c < cols; ++c)
+        quantized[r * cols + c] = (int8_t)std::round(row[c] / scale);
+      std::memcpy(scales + r * sizeof(float), &scale, sizeof(float));
+    }
+  }
+
+  // Quantizes the columns of val, [k, n], to 8 bits, each with the scale of its largest absolute value,
+  // into the layout of Type::int8cols: the transposed int8 values followed by the float32 scales
+  void quantizeColumns(Tensor val, io::Item& item) const {
+    ABORT_IF(val->type() != Type::float32 || val->shape().size() != 2,
+             "Cannot quantize the columns of {} {}", val->type(), val->shape());
+    std::vector<float> values;
+    val->get(values);
+    size_t k = val->shape()[0], n = val->shape()[1];
+    item.type = Type::int8cols;
+    item.bytes.resize(requiredBytes(val->shape(), Type::int8cols));
+    int8_t* quantized = (int8_t*)item.bytes.data();
+    char* scales = item.bytes.data() + k * n;
+    for(size_t c = 0; c < n; ++c) {
+      float max = 0.f;
+      for(size_t r = 0; r < k; ++r)
+        max = std::max(max, std::abs(values[r * n + c]));
+      float scale = max > 0.f ? max / 127.f : 1.f;
+      for(size_t r = 0; r < k; ++r)
+        quantized[c * k + r] = (int8_t)std::round(values[r * n + c] / scale);
+      std::memcpy(scales + c * sizeof(float), &scale, sizeof(float));
+    }
+  }
+
+  // Whether the packing rules select the parameter, see setPackingRules()
+  bool isSelected(const std::string& pName) const {
+    auto rule = std::find_if(packingRules_.begin(), packingRules_.end(), [&](const PackingRule& r) {
+      return std::regex_search(pName, r.pattern);
+    });
+    return rule != packingRules_.end()
+               ? rule->pack
+               : pName.find("_W") == pName.length() - 3 || pName.find("_W") == pName.length() - 2;
+  }
+
+  // Whether to pack the parameter into gemmElementType, otherwise `reason` says why not if it
+  // was selected for packing but cannot be packed
+  bool isPackable(const std::string& pName, const Shape& shape, Type gemmElementType, std::string& reason) const {
+    reason.clear();
+    if(!isPacked(gemmElementType) && !isIntgemm(gemmElementType) && !isColQuantized(gemmElementType))
+      return false;
+
+    if(!isSelected(pName))
+      return false;
+
+    if(shape.size() != 2) {
+      reason = "it is not a matrix";
+      return false;
+    }
+    // B is k x n, the product has n columns
+    bool transposed = cpu::integer::isTransposedB(pName);
+    int k = transposed ? shape[1] : shape[0];
+    int n = transposed ? shape[0] : shape[1];
+    if(gemmElementType == Type::packed16 && n % 16 != 0) {
+      reason = "packed16 needs a multiple of 16 columns";
+      return false;
+    }
+    if(isIntgemm(gemmElementType) && (k % 64 != 0 || n % 8 != 0)) {
+      reason = "intgemm needs an inner dimension of a multiple of 64 and a multiple of 8 columns";
+      return false;
+    }
+    if(isColQuantized(gemmElementType) && transposed) {
+      reason = "the int8 GEMM of the GPU does not multiply transposed parameters";
+      return false;
+    }
+    if(isColQuantized(gemmElementType) && (k % 4 != 0 || n % 4 != 0)) {
+      reason = "the int8 GEMM of the GPU needs an inner dimension and columns that are multiples of 4";
+      return false;
+    }
+    return true;
+  }
+
 public:
   ExpressionGraphPackable()
     : ExpressionGraph( /* inference =  */ true) {} // Packable expression graph only supports inference
 
   virtual ~ExpressionGraphPackable() {}
 
-  // Convert model weights into packed format and save to IO items.
-  // @TODO: review this
-  void packAndSave(const std::string& name, const std::string& meta, Type gemmElementType = Type::float32, Type saveElementType = Type::float32) {
-    std::vector<io::Item> ioItems;
+  // Rules selecting the parameters to pack, tried in order until one matches a parameter name
+  // (without namespace). A rule is a regular expression searched in the name, with a leading '!'
+  // it excludes the parameters it matches. Names no rule matches are packed by default, i.e. if
+  // they end in "_W" or "_W?".
+  void setPackingRules(const std::vector<std::string>& rules) {
+    packingRules_.clear();
+    for(const auto& rule : rules) {
+      bool exclude = !rule.empty() && rule[0] == '!';
+      try {
+        packingRules_.push_back({std::regex(exclude ? rule.substr(1) : rule), !exclude});
+      } catch(const std::regex_error& e) {
+        ABORT("Invalid packing rule '{}': {}", rule, e.what());
+      }
+    }
+  }
 
+  // Save the block-CSR form of the parameters selected by the packing rules that stay float32 and
+  // whose blocks of rows x cols values are at least the fraction minZeros zero, see tensors/cpu/block_sparse.h
+  void setBlockSparse(const std::vector<int>& block, float minZeros) {
+    ABORT_IF(!block.empty() && block.size() != 2, "Blocks have rows and columns, not {} sizes", block.size());
+    sparseBlock_ = block;
+    sparseMinZeros_ = minZeros;
+  }
+
+  // Save the embedding matrices as Type::int8rows, except for `outputEmbeddings`, which the output
+  // layer multiplies with
+  void setQuantizeEmbeddings(bool quantize, const std::string& outputEmbeddings) {
+    quantizeEmbeddings_ = quantize;
+    outputEmbeddings_ = outputEmbeddings;
+  }
+
+  // Largest absolute values of the activations multiplied with the parameters, as collected by
+  // marian-decoder --quantize-statistics. Parameters packed into 8-bit intgemm types are saved
+  // with the quantization multiplier of their activations, see cpu::integer::quantMultAName()
+  void setActivationStatistics(const std::map<std::string, float>& maxAbs) {
+    activationMaxAbs_ = maxAbs;
+  }
+
+  // Convert model weights into packed format and save to IO items. The parameters are converted
+  // independently of each other by `threads` threads.
+  // @TODO: review this
+  void packAndSave(const std::string& name, const std::string& meta, Type gemmElementType = Type::float32, Type saveElementType = Type::float32, size_t threads = 1) {
     // sorted by name in std::map
+    std::vector<std::pair<std::string, Tensor>> vals;
     for (auto p : params()->getMap()) {
       std::string pName = p.first;
 
@@ -40,14 +204,35 @@ public:
           pName = pName.substr(namespace_.size() + 2);
       }
 
-      Tensor val = p.second->val();
+      vals.emplace_back(pName, p.second->val());
+    }
+
+    std::vector<io::Item> ioItems(vals.size());
+    std::vector<float> quantMultsA(vals.size(), 0.f); // 0 if not precomputed
+    std::vector<std::vector<float>> blockSparse(vals.size()); // empty if not block-sparse
+
+    auto pack = [&](size_t i) {
+      const std::string& pName = vals[i].first;
+      Tensor val = vals[i].second;
 
       // save as packed format
-      // @TODO Hardcoded to find packable weights
       // int8 - all the weights used for affine op and dot op
       // fp16 - all the weights used for affine op
-      if ((gemmElementType == Type::packed8avx2 || gemmElementType == Type::packed8avx512)
-        && (pName.find("_W") == pName.length() - 3 || pName.find("_W") == pName.length() - 2)) {
+      if(isQuantizedEmbedding(pName)) {
+        io::Item item;
+        item.name = pName;
+        item.shape = val->shape();
+        quantizeRows(val, item);
+        ioItems[i] = std::move(item);
+        return;
+      }
+
+      std::string reason;
+      bool pack = isPackable(pName, val->shape(), gemmElementType, reason);
+      if(!reason.empty())
+        LOG(warn, "Saving parameter {} {} as {}, it is not packed to {} because {}", pName, val->shape(), saveElementType, gemmElementType, reason);
+
+      if (pack && (gemmElementType == Type::packed8avx2 || gemmElementType == Type::packed8avx512)) {
 #if USE_FBGEMM
         using namespace marian::cpu::variant;
         // packing information - size
@@ -57,7 +242,7 @@ public:
 
         fbgemmPacked8PackInfo(val->shape(),
                               gemmElementType,
-                              pName.find("Wemb") != std::string::npos,
+                              cpu::integer::isTransposedB(pName),
                               nrow,
                               ncol,
                               packsize);
@@ -72,7 +257,7 @@ public:
         fbgemmPacked8Pack(packedTensor,
                           val->data(),
                           gemmElementType,
-                          pName.find("Wemb") != std::string::npos,
+                          cpu::integer::isTransposedB(pName),
                           nrow,
                           ncol,
                           packsize);
@@ -88,12 +273,12 @@ public:
         item.bytes.resize(mem->size());
         copy(backend_, mem->data<char>(), mem->data<char>() + mem->size(), item.bytes.data());
 
-        ioItems.emplace_back(std::move(item));
+        ioItems[i] = std::move(item);
 #else
         ABORT("Packed type {} only supported when compiled with -DUSE_FBGEMM=on", gemmElementType);
 #endif
       // fp16 quantization option
-      } else if (gemmElementType == Type::packed16 && pName.find("_W") == pName.length() - 3) {
+      } else if (pack && gemmElementType == Type::packed16) {
 #if USE_FBGEMM
         using namespace marian::cpu::variant;
 
@@ -102,7 +287,7 @@ public:
         uint64_t packsize;
 
         fbgemmPacked16PackInfo(val->shape(),
-          false,
+          cpu::integer::isTransposedB(pName),
           nrow,
           ncol,
           kernel_ncol_blocks,
@@ -121,7 +306,7 @@ public:
         // fbgemmPacked16Pack
         fbgemmPacked16Pack(packedTensor,
           val->data(),
-          false,
+          cpu::integer::isTransposedB(pName),
           nrow,
           ncol,
           kernel_ncol_blocks,
@@ -143,12 +328,18 @@ public:
         item.bytes.resize(mem->size());
         copy(backend_, mem->data<char>(), mem->data<char>() + mem->size(), item.bytes.data());
 
-        ioItems.emplace_back(std::move(item));
+        ioItems[i] = std::move(item);
 #else
         ABORT("Packed type {} only supported when compiled with -DUSE_FBGEMM=on", gemmElementType);
 #endif
-      } else if (isIntgemm(gemmElementType) &&
-      (pName.find("_W") == pName.length() - 3 || pName.find("_W") == pName.length() - 2 /* || pName.find("Wemb") != std::string::npos*/)) {
+      } else if (pack && isColQuantized(gemmElementType)) {
+        // weights of the int8 GEMM of the GPU, quantized here on the CPU
+        io::Item item;
+        item.name = pName;
+        item.shape = val->shape();
+        quantizeColumns(val, item);
+        ioItems[i] = std::move(item);
+      } else if (pack && isIntgemm(gemmElementType)) {
 #if COMPILE_CPU
         using cpu::integer::cols;
         using cpu::integer::rows;
@@ -158,41 +349,58 @@ public:
         allocator->allocate(paramMat, val->shape(), gemmElementType);
 
         // Compute QuantMultiplier, compress matrix and store quantMult at the end.
-        // We need to tranpose first, because of our architecture independet format requiring a transposed matrix
+        // We need to tranpose first, because of our architecture independet format requiring a transposed matrix.
+        // A parameter that is stored transposed, like the output layer, already is the transposed B.
+        bool transposedB = cpu::integer::isTransposedB(pName);
+        int inner = transposedB ? cols(val) : rows(val);
+        int bCols = transposedB ? rows(val) : cols(val);
         Tensor tmp;
         allocator->allocate(tmp, val->shape(), val->type());
-        cpu::Transpose10(tmp, val);
+        if(transposedB)
+          tmp->copyFrom(val);
+        else
+          cpu::Transpose10(tmp, val);
   
         if(sizeOf(gemmElementType) == 1) { // is 8-bit Intgemm type
           float quantMult = cpu::integer::computeQuantMult<Type::intgemm8>(val);
 
+          auto maxAbsA = activationMaxAbs_.find(pName);
+          if(maxAbsA != activationMaxAbs_.end() && maxAbsA->second > 0.f)
+            quantMultsA[i] = 127.0f / maxAbsA->second;
+
           // Hardware-specific conversions which allow to implement memory-mapping and avoid conversion at runtime
           cpu::integer::passOrAbort(gemmElementType); // Check if the hardware supports the GEMM type
-          if(isSsse3(gemmElementType)) {
+          if(isAmx(gemmElementType)) {
+            cpu::integer::AmxKernels8::PrepareBTransposed(tmp->data(), /*input*/
+                                                          paramMat->data<int8_t>(), /*output*/
+                                                          quantMult, /*Quant Mult*/
+                                                          inner,
+                                                          bCols);
+          } else if(isSsse3(gemmElementType)) {
             intgemm::ssse3::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
                                                     paramMat->data<int8_t>(), /*output*/
                                                     quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
+                                                    inner,
+                                                    bCols);
           } else if(isAvx2(gemmElementType)) {
             intgemm::avx2::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
                                                    paramMat->data<int8_t>(), /*output*/
                                                    quantMult, /*Quant Mult*/
-                                                   rows(val),
-                                                   cols(val));
+                                                   inner,
+                                                   bCols);
           } else if(isAvx512(gemmElementType)) {
             intgemm::avx512bw::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
                                                      paramMat->data<int8_t>(), /*output*/
                                                      quantMult, /*Quant Mult*/
-                                                     rows(val),
-                                                     cols(val));
+                                                     inner,
+                                                     bCols);
           } else {
             ABORT_IF(gemmElementType != Type::intgemm8, "Type {} is not supported", gemmElementType); // shouldn't really happen, but let's make sure
             intgemm::Int8::PrepareA(tmp->data(), /*input*/
                                     paramMat->data<int8_t>(), /*output*/
                                     quantMult, /*Quant Mult*/
-                                    rows(val),
-                                    cols(val));
+                                    inner,
+                                    bCols);
           }
           //Put the quantMult at the back of the tensor
           cpu::integer::getQuantMult<Type::intgemm8>(paramMat) = quantMult;
@@ -206,27 +414,27 @@ public:
             intgemm::sse2::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
                                                     paramMat->data<int16_t>(), /*output*/
                                                     quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
+                                                    inner,
+                                                    bCols);
           } else if(isAvx2(gemmElementType)) {
             intgemm::avx2::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
                                                     paramMat->data<int16_t>(), /*output*/
                                                     quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
+                                                    inner,
+                                                    bCols);
           } else if(isAvx512(gemmElementType)) {
             intgemm::avx512bw::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
                                                       paramMat->data<int16_t>(), /*output*/
                                                       quantMult, /*Quant Mult*/
-                                                      rows(val),
-                                                      cols(val));
+                                                      inner,
+                                                      bCols);
           } else {
             ABORT_IF(gemmElementType != Type::intgemm16, "Type {} is not supported", gemmElementType); // shouldn't really happen, but let's make sure
             intgemm::Int16::PrepareA(tmp->data(), /*input*/
                                      paramMat->data<int16_t>(), /*output*/
                                      quantMult, /*Quant Mult*/
-                                     rows(val),
-                                     cols(val));
+                                     inner,
+                                     bCols);
           }
           //Put the quantMult at the back of the tensor
           cpu::integer::getQuantMult<Type::intgemm16>(paramMat) = quantMult;
@@ -244,18 +452,69 @@ public:
         auto mem = paramMat->memory();
         item.bytes.resize(mem->size());
         copy(backend_, mem->data<char>(), mem->data<char>() + mem->size(), item.bytes.data());
-        ioItems.emplace_back(std::move(item));
+        ioItems[i] = std::move(item);
 #else
         ABORT("Packed type {} only supported when compiled with -DCOMPILE_CPU=on", gemmElementType);
 #endif
       } else {
-        ABORT_IF(saveElementType != Type::float32, "We currently do not know how to save matrices as {}", saveElementType);
+        ABORT_IF(saveElementType != Type::float32 && saveElementType != Type::float16 && saveElementType != Type::bfloat16,
+                 "We currently do not know how to save matrices as {}", saveElementType);
         io::Item item;
         val->get(item, pName);
         item.convert(saveElementType);
-        ioItems.emplace_back(std::move(item));
+        ioItems[i] = std::move(item);
+
+        // the dense parameter is kept for the GPU and for products with other operands
+        const auto& shape = val->shape();
+        if(!sparseBlock_.empty() && isSelected(pName) && shape.size() == 2 && val->type() == Type::float32
+           && !cpu::integer::isTransposedB(pName) && shape[0] % sparseBlock_[0] == 0 && shape[1] % sparseBlock_[1] == 0) {
+          std::vector<float> values;
+          val->get(values);
+          cpu::blocksparse::pack(values.data(), shape[0], shape[1], sparseBlock_[0], sparseBlock_[1], sparseMinZeros_, blockSparse[i]);
+        }
       }
+    };
+
+    if(threads > 1) {
+      ThreadPool threadPool(threads, threads);
+      std::vector<std::future<void>> packed;
+      for(size_t i = 0; i < vals.size(); ++i)
+        packed.emplace_back(threadPool.enqueue(pack, i));
+      for(auto& f : packed)
+        f.get();
+    } else {
+      for(size_t i = 0; i < vals.size(); ++i)
+        pack(i);
+    }
+
+    for(size_t i = 0; i < vals.size(); ++i) {
+      if(quantMultsA[i] == 0.f)
+        continue;
+      io::Item item;
+      item.name = cpu::integer::quantMultAName(vals[i].first);
+      item.shape = Shape({1});
+      item.type = Type::float32;
+      item.bytes.resize(sizeof(float));
+      std::memcpy(item.bytes.data(), &quantMultsA[i], sizeof(float));
+      ioItems.emplace_back(std::move(item));
+    }
+    for(size_t i = 0; i < vals.size(); ++i) {
+      if(blockSparse[i].empty())
+        continue;
+      io::Item item;
+      item.name = cpu::blocksparse::packedName(vals[i].first);
+      item.shape = Shape({1, (int)blockSparse[i].size()});
+      item.type = Type::float32;
+      item.bytes.resize(blockSparse[i].size() * sizeof(float));
+      std::memcpy(item.bytes.data(), blockSparse[i].data(), item.bytes.size());
+      ioItems.emplace_back(std::move(item));
     }
+    if(!sparseBlock_.empty())
+      LOG(info, "Saved the block-sparse form of {} parameters",
+          std::count_if(blockSparse.begin(), blockSparse.end(), [](const std::vector<float>& b) { return !b.empty(); }));
+    if(!activationMaxAbs_.empty())
+      LOG(info, "Saved precomputed quantization multipliers of the activations of {} parameters",
+          std::count_if(quantMultsA.begin(), quantMultsA.end(), [](float q) { return q != 0.f; }));
 
     if (!meta.empty())
       io::addMetaToItems(meta, "special:model.yml", ioItems);
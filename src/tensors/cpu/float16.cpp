@@ -0,0 +1,73 @@
+#include "tensors/cpu/float16.h"
+
+#if defined(__GNUC__) && !defined(__CUDACC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FLOAT16_RUNTIME_DISPATCH 1
+#endif
+
+namespace marian {
+namespace cpu {
+
+typedef void (*ConvertFn)(float* out, const float16* in, size_t n);
+
+static void convertScalar(float* out, const float16* in, size_t n) {
+  for(size_t i = 0; i < n; ++i)
+    out[i] = (float)in[i];
+}
+
+#ifdef FLOAT16_RUNTIME_DISPATCH
+// Compiled with function-level target attributes like the kernels of transpose.cpp
+__attribute__((target("avx,f16c")))
+static void convertF16C(float* out, const float16* in, size_t n) {
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+  convertScalar(out + i, in + i, n - i);
+}
+
+// false uninitialized warnings of gcc 12.1/12.2 in inlined AVX512 intrinsics, see cpu/softmax.cpp
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f")))
+static void convertAVX512(float* out, const float16* in, size_t n) {
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(out + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(in + i))));
+  convertF16C(out + i, in + i, n - i);
+}
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#elif USE_NEON && defined(__aarch64__)
+static void convertNEON(float* out, const float16* in, size_t n) {
+  size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16((const uint16_t*)(in + i)))));
+  convertScalar(out + i, in + i, n - i);
+}
+#endif
+
+static ConvertFn getConvert() {
+#ifdef FLOAT16_RUNTIME_DISPATCH
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return convertAVX512;
+  if(__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"))
+    return convertF16C;
+#elif USE_NEON && defined(__aarch64__)
+  return convertNEON;
+#endif
+  return convertScalar;
+}
+
+static const ConvertFn convert = getConvert();
+
+void float16ToFloat32(float* out, const float16* in, size_t n) {
+  convert(out, in, n);
+}
+
+}  // namespace cpu
+}  // namespace marian
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <cstddef>
+
+namespace marian {
+namespace cpu {
+
+// Converts n float16 values to float32 with the widest conversion instructions of the CPU, chosen
+// at runtime: AVX512F, F16C or NEON, otherwise one value at a time. CPU parameters stored as
+// float16 (see --cpu-float16-weights) are converted by this in panels right before their use.
+void float16ToFloat32(float* out, const float16* in, size_t n);
+
+}  // namespace cpu
+}  // namespace marian
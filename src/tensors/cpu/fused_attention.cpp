@@ -0,0 +1,206 @@
+#include "tensors/tensor_operators.h"
+#include "tensors/cpu/backend.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// CPU implementation of the fused attention of FusedAttentionNodeOp. Each query row runs an online
+// softmax over blocks of keys: the scores of a block are computed, the running maximum, sum and
+// weighted sum of values are rescaled if the maximum grew, and the block is added. Only a block
+// of scores per row is ever held in memory. The backward step recomputes the scores row by row from
+// the log-sum-exp of each row instead of storing the attention weights.
+
+namespace marian {
+namespace cpu {
+
+namespace {
+
+const int KEY_BLOCK = 64;
+
+// Flattened batches of q, k and v with the batch of the keys and values broadcast as in
+// ProdBatched(), i.e. query batch i uses key batch i % batchK, and the strides of an additive mask
+// that broadcasts to [dims -4 of q, heads, queries, keys]
+struct AttentionLayout {
+  int batchQ, batchK, heads, dimQ, dimK, dimHead, dimValue;
+  size_t maskStride[4]{0, 0, 0, 0};
+
+  AttentionLayout(Tensor q, Tensor k, Tensor v, Tensor mask) {
+    dimQ = q->shape()[-2];
+    dimK = k->shape()[-2];
+    dimHead = q->shape()[-1];
+    dimValue = v->shape()[-1];
+    heads = q->shape()[-3];
+    batchQ = q->shape().elements() / (dimQ * dimHead);
+    batchK = k->shape().elements() / (dimK * dimHead);
+    ABORT_IF(k->shape()[-1] != dimHead, "Keys {} do not match the queries {}", k->shape(), q->shape());
+    ABORT_IF(v->shape()[-2] != dimK || v->shape().elements() / (dimK * dimValue) != batchK,
+             "Values {} do not match the keys {}", v->shape(), k->shape());
+    ABORT_IF(batchQ % batchK != 0, "Batch of the keys {} does not broadcast to the queries {}", k->shape(), q->shape());
+    if(mask) {
+      const auto& ms = mask->shape();
+      int dims[4] = {ms[-4], ms[-3], ms[-2], ms[-1]};
+      int full[4] = {batchQ / heads, heads, dimQ, dimK};
+      size_t stride = 1;
+      for(int i = 3; i >= 0; --i) {
+        ABORT_IF(dims[i] != 1 && dims[i] != full[i], "Attention mask {} does not broadcast to the scores", ms);
+        maskStride[i] = dims[i] == 1 ? 0 : stride;
+        stride *= dims[i];
+      }
+    }
+  }
+
+  // the mask of the keys of query row `row` of batch `batch`
+  const float* maskRow(const float* mask, int batch, int row) const {
+    if(!mask)
+      return nullptr;
+    return mask + (batch / heads) * maskStride[0] + (batch % heads) * maskStride[1] + row * maskStride[2];
+  }
+  float maskAt(const float* maskRow, int key) const { return maskRow ? maskRow[key * maskStride[3]] : 0.f; }
+};
+
+inline float dot(const float* a, const float* b, int n) {
+  float sum = 0.f;
+  for(int i = 0; i < n; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+// scale * q * k^T + mask of one query row and the keys [first, first + n)
+inline void scores(float* out, const AttentionLayout& layout, const float* q, const float* keys,
+                   const float* maskRow, int first, int n, float scale) {
+  for(int j = 0; j < n; ++j)
+    out[j] = scale * dot(q, keys + (size_t)(first + j) * layout.dimHead, layout.dimHead) + layout.maskAt(maskRow, first + j);
+}
+
+// log(sum_j exp(score_j)) of one query row
+float logSumExp(const AttentionLayout& layout, const float* q, const float* keys, const float* maskRow, float scale, float* block) {
+  float max = -std::numeric_limits<float>::infinity(), sum = 0.f;
+  for(int first = 0; first < layout.dimK; first += KEY_BLOCK) {
+    int n = std::min(KEY_BLOCK, layout.dimK - first);
+    scores(block, layout, q, keys, maskRow, first, n, scale);
+    float blockMax = max;
+    for(int j = 0; j < n; ++j)
+      blockMax = std::max(blockMax, block[j]);
+    sum *= std::exp(max - blockMax);
+    for(int j = 0; j < n; ++j)
+      sum += std::exp(block[j] - blockMax);
+    max = blockMax;
+  }
+  return max + std::log(sum);
+}
+
+}  // namespace
+
+void FusedAttention(Tensor out, const Tensor q, const Tensor k, const Tensor v, const Tensor mask, float scale) {
+  ABORT_IF(q->type() != Type::float32, "Fused attention on the CPU is only implemented for {}", Type::float32);
+  AttentionLayout layout(q, k, v, mask);
+  const float* maskData = mask ? mask->data() : nullptr;
+
+  size_t rows = (size_t)layout.batchQ * layout.dimQ;
+  parallelFor(out, rows, (size_t)layout.dimK * (layout.dimHead + layout.dimValue), [&](size_t begin, size_t end) {
+    std::vector<float> block(KEY_BLOCK);
+    for(size_t r = begin; r < end; ++r) {
+      int batch = (int)(r / layout.dimQ), row = (int)(r % layout.dimQ);
+      int batchK = batch % layout.batchK;
+      const float* qRow = q->data() + r * layout.dimHead;
+      const float* keys = k->data() + (size_t)batchK * layout.dimK * layout.dimHead;
+      const float* values = v->data() + (size_t)batchK * layout.dimK * layout.dimValue;
+      const float* maskRow = layout.maskRow(maskData, batch, row);
+      float* o = out->data() + r * layout.dimValue;
+
+      std::fill(o, o + layout.dimValue, 0.f);
+      float max = -std::numeric_limits<float>::infinity(), sum = 0.f;
+      for(int first = 0; first < layout.dimK; first += KEY_BLOCK) {
+        int n = std::min(KEY_BLOCK, layout.dimK - first);
+        scores(block.data(), layout, qRow, keys, maskRow, first, n, scale);
+        float blockMax = max;
+        for(int j = 0; j < n; ++j)
+          blockMax = std::max(blockMax, block[j]);
+        if(blockMax > max) { // rescale what has been accumulated so far
+          float rescale = std::exp(max - blockMax);
+          sum *= rescale;
+          for(int d = 0; d < layout.dimValue; ++d)
+            o[d] *= rescale;
+          max = blockMax;
+        }
+        for(int j = 0; j < n; ++j) {
+          float p = std::exp(block[j] - max);
+          sum += p;
+          const float* value = values + (size_t)(first + j) * layout.dimValue;
+          for(int d = 0; d < layout.dimValue; ++d)
+            o[d] += p * value[d];
+        }
+      }
+      float norm = 1.f / sum;
+      for(int d = 0; d < layout.dimValue; ++d)
+        o[d] *= norm;
+    }
+  });
+}
+
+void FusedAttentionBackward(Tensor gradQ, Tensor gradK, Tensor gradV, const Tensor adj, const Tensor out,
+                            const Tensor q, const Tensor k, const Tensor v, const Tensor mask, float scale) {
+  ABORT_IF(q->type() != Type::float32, "Fused attention on the CPU is only implemented for {}", Type::float32);
+  AttentionLayout layout(q, k, v, mask);
+  const float* maskData = mask ? mask->data() : nullptr;
+
+  // one key batch at a time, so that the gradients of keys and values are written by one thread
+  size_t work = (size_t)(layout.batchQ / layout.batchK) * layout.dimQ * layout.dimK * (2 * layout.dimHead + 2 * layout.dimValue);
+  parallelFor(adj, layout.batchK, work, [&](size_t begin, size_t end) {
+    std::vector<float> block(KEY_BLOCK);
+    std::vector<float> dq(layout.dimHead);
+    for(size_t batchK = begin; batchK < end; ++batchK) {
+      const float* keys = k->data() + batchK * layout.dimK * layout.dimHead;
+      const float* values = v->data() + batchK * layout.dimK * layout.dimValue;
+      float* dKeys = gradK ? gradK->data() + batchK * layout.dimK * layout.dimHead : nullptr;
+      float* dValues = gradV ? gradV->data() + batchK * layout.dimK * layout.dimValue : nullptr;
+
+      for(int batch = (int)batchK; batch < layout.batchQ; batch += layout.batchK) {
+        for(int row = 0; row < layout.dimQ; ++row) {
+          size_t r = (size_t)batch * layout.dimQ + row;
+          const float* qRow = q->data() + r * layout.dimHead;
+          const float* dO = adj->data() + r * layout.dimValue;
+          const float* maskRow = layout.maskRow(maskData, batch, row);
+
+          float lse = logSumExp(layout, qRow, keys, maskRow, scale, block.data());
+          float dOo = dot(dO, out->data() + r * layout.dimValue, layout.dimValue); // sum_j p_j * dP_j
+          std::fill(dq.begin(), dq.end(), 0.f);
+
+          for(int first = 0; first < layout.dimK; first += KEY_BLOCK) {
+            int n = std::min(KEY_BLOCK, layout.dimK - first);
+            scores(block.data(), layout, qRow, keys, maskRow, first, n, scale);
+            for(int j = 0; j < n; ++j) {
+              int key = first + j;
+              float p = std::exp(block[j] - lse);
+              const float* value = values + (size_t)key * layout.dimValue;
+              if(dValues) {
+                float* dv = dValues + (size_t)key * layout.dimValue;
+                for(int d = 0; d < layout.dimValue; ++d)
+                  dv[d] += p * dO[d];
+              }
+              float dS = scale * p * (dot(dO, value, layout.dimValue) - dOo);
+              const float* kRow = keys + (size_t)key * layout.dimHead;
+              for(int d = 0; d < layout.dimHead; ++d)
+                dq[d] += dS * kRow[d];
+              if(dKeys) {
+                float* dk = dKeys + (size_t)key * layout.dimHead;
+                for(int d = 0; d < layout.dimHead; ++d)
+                  dk[d] += dS * qRow[d];
+              }
+            }
+          }
+
+          if(gradQ) {
+            float* dQRow = gradQ->data() + r * layout.dimHead;
+            for(int d = 0; d < layout.dimHead; ++d)
+              dQRow[d] += dq[d];
+          }
+        }
+      }
+    }
+  });
+}
+
+}  // namespace cpu
+}  // namespace marian
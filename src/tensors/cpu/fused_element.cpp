@@ -0,0 +1,153 @@
+#include "tensors/cpu/fused_element.h"
+
+#include "functional/functional.h"
+#include "tensors/cpu/backend.h"
+
+namespace marian {
+namespace cpu {
+
+int elementWidth(const std::vector<Shape>& shapes) {
+  bool div16 = true, div8 = true, div4 = true;
+  for(const auto& shape : shapes) {
+    div16 = div16 && shape[-1] % 16 == 0;
+    div8 = div8 && shape[-1] % 8 == 0;
+    div4 = div4 && shape[-1] % 4 == 0;
+  }
+#ifdef __AVX512F__
+  if(div16)
+    return 16;
+#endif
+#ifdef __AVX__
+  if(div8)
+    return 8;
+#endif
+  return div4 ? 4 : 1;
+}
+
+// Registers hold this many vectors of the innermost dimension at a time, small enough to stay in
+// the L1 cache with the largest program
+static const int BLOCK = 16;
+
+template <typename T>
+static void fusedElement(const FusedElementProgram& program, Tensor out, const std::vector<Tensor>& inputs) {
+  typedef functional::Ops<T> Ops;
+  typedef FusedElementProgram::Op Op;
+  const int lanes = sizeof(T) / sizeof(float);
+
+  const auto& instructions = program.instructions;
+  ABORT_IF(instructions.empty() || instructions.size() > FusedElementProgram::MAX_INSTRUCTIONS,
+           "Fused element-wise program has {} instructions, supported are 1 to {}",
+           instructions.size(), FusedElementProgram::MAX_INSTRUCTIONS);
+
+  const auto& shape = out->shape();
+  int dims = shape.size();
+  int cols = shape[-1] / lanes;
+  int rows = (int)(shape.elements() / shape[-1]);
+
+  // offsets of the inputs per step along each dimension of the output, 0 where broadcast, in units of T
+  size_t numInputs = inputs.size();
+  std::vector<std::vector<int>> strides(numInputs, std::vector<int>(dims, 0));
+  std::vector<const T*> data(numInputs);
+  for(size_t k = 0; k < numInputs; ++k) {
+    const auto& inShape = inputs[k]->shape();
+    ABORT_IF(inShape.size() > dims, "Input {} of fused element-wise operation has too many dimensions", k);
+    int stride = 1;
+    for(int d = inShape.size() - 1; d >= 0; --d) {
+      int outDim = d + dims - inShape.size();
+      ABORT_IF(inShape[d] != 1 && inShape[d] != shape[outDim],
+               "Cannot broadcast input {} of shape {} to {}", k, inShape, shape);
+      if(inShape[d] != 1)
+        strides[k][outDim] = d == inShape.size() - 1 ? 1 : stride / lanes;
+      stride *= inShape[d];
+    }
+    data[k] = inputs[k]->data<T>();
+  }
+
+  T* outData = out->data<T>();
+
+  // rows are split across the threads of the graph, each range with its own registers
+  parallelFor(out, rows, shape[-1] * instructions.size(), [&](size_t begin, size_t end) {
+    alignas(64) float buffer[FusedElementProgram::MAX_INSTRUCTIONS * BLOCK * 16];
+    T* regs = (T*)buffer;
+    T* result = regs + (instructions.size() - 1) * BLOCK;
+
+    std::vector<int> index(dims, 0); // of the current row, the innermost dimension is unused
+    for(int r = (int)begin, d = dims - 2; d >= 0; --d) {
+      index[d] = r % shape[d];
+      r /= shape[d];
+    }
+    std::vector<int> offsets(numInputs, 0);
+    for(int row = (int)begin; row < (int)end; ++row) {
+      for(size_t k = 0; k < numInputs; ++k) {
+        offsets[k] = 0;
+        for(int d = 0; d < dims - 1; ++d)
+          offsets[k] += index[d] * strides[k][d];
+      }
+
+      for(int col = 0; col < cols; col += BLOCK) {
+        int n = std::min(BLOCK, cols - col);
+        for(size_t i = 0; i < instructions.size(); ++i) {
+          const auto& ins = instructions[i];
+          T* r = regs + i * BLOCK;
+          const T* a = regs + ins.arg * BLOCK;
+          const T* b = regs + ins.arg2 * BLOCK;
+          switch(ins.op) {
+            case Op::Input: {
+              const T* in = data[ins.arg] + offsets[ins.arg];
+              if(strides[ins.arg][dims - 1] == 0)
+                for(int j = 0; j < n; ++j) r[j] = in[0];
+              else
+                for(int j = 0; j < n; ++j) r[j] = in[col + j];
+              break;
+            }
+            case Op::Add:       for(int j = 0; j < n; ++j) r[j] = Ops::add(a[j], b[j]); break;
+            case Op::Sub:       for(int j = 0; j < n; ++j) r[j] = Ops::sub(a[j], b[j]); break;
+            case Op::Mul:       for(int j = 0; j < n; ++j) r[j] = Ops::mul(a[j], b[j]); break;
+            case Op::Div:       for(int j = 0; j < n; ++j) r[j] = Ops::div(a[j], b[j]); break;
+            case Op::Max:       for(int j = 0; j < n; ++j) r[j] = Ops::max(a[j], b[j]); break;
+            case Op::Min:       for(int j = 0; j < n; ++j) r[j] = Ops::min(a[j], b[j]); break;
+            case Op::AddScalar: for(int j = 0; j < n; ++j) r[j] = Ops::add(a[j], T(ins.scalar)); break;
+            case Op::MulScalar: for(int j = 0; j < n; ++j) r[j] = Ops::mul(T(ins.scalar), a[j]); break;
+            case Op::Neg:       for(int j = 0; j < n; ++j) r[j] = Ops::neg(a[j]); break;
+            case Op::Abs:       for(int j = 0; j < n; ++j) r[j] = Ops::abs(a[j]); break;
+            case Op::ReLU:      for(int j = 0; j < n; ++j) r[j] = Ops::relu(a[j]); break;
+            case Op::Sigmoid:   for(int j = 0; j < n; ++j) r[j] = Ops::sigmoid(a[j]); break;
+            case Op::Tanh:      for(int j = 0; j < n; ++j) r[j] = Ops::tanh(a[j]); break;
+            case Op::Exp:       for(int j = 0; j < n; ++j) r[j] = Ops::exp(a[j]); break;
+            case Op::Log:       for(int j = 0; j < n; ++j) r[j] = Ops::log(a[j]); break;
+          }
+        }
+        std::copy(result, result + n, outData + (size_t)row * cols + col);
+      }
+
+      // next row
+      for(int d = dims - 2; d >= 0; --d) {
+        if(++index[d] < shape[d])
+          break;
+        index[d] = 0;
+      }
+    }
+  });
+}
+
+void FusedElement(const FusedElementProgram& program, Tensor out, const std::vector<Tensor>& inputs) {
+  ABORT_IF(out->type() != Type::float32, "Unsupported type for fused element-wise operation: {}", out->type());
+
+  std::vector<Shape> shapes = {out->shape()};
+  for(const auto& input : inputs)
+    shapes.push_back(input->shape());
+
+  switch(elementWidth(shapes)) {
+#ifdef __AVX512F__
+    case 16: fusedElement<float32x16>(program, out, inputs); break;
+#endif
+#ifdef __AVX__
+    case 8: fusedElement<float32x8>(program, out, inputs); break;
+#endif
+    case 4: fusedElement<float32x4>(program, out, inputs); break;
+    default: fusedElement<float>(program, out, inputs); break;
+  }
+}
+
+}  // namespace cpu
+}  // namespace marian
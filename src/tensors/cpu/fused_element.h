@@ -0,0 +1,44 @@
+#pragma once
+
+#include "tensors/tensor.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+// Straight-line program of element-wise operations that is evaluated in a single pass over the
+// output, see ElementwiseFusion. Instruction i computes register i from an input tensor or from
+// earlier registers, the last register is the result.
+struct FusedElementProgram {
+  enum class Op : uint8_t {
+    Input,                            // input tensor arg, broadcast to the output shape
+    Add, Sub, Mul, Div, Max, Min,     // registers arg and arg2
+    AddScalar, MulScalar,             // register arg and scalar
+    Neg, Abs, ReLU, Sigmoid, Tanh, Exp, Log // register arg
+  };
+
+  struct Instruction {
+    Op op;
+    uint16_t arg;
+    uint16_t arg2;
+    float scalar;
+  };
+
+  static const size_t MAX_INSTRUCTIONS = 32;
+
+  std::vector<Instruction> instructions;
+};
+
+// Number of floats that cpu::Element processes at once for tensors of these shapes: 16 with AVX512F,
+// 8 with AVX or 4 if the innermost dimensions of all shapes are divisible by it, 1 otherwise
+int elementWidth(const std::vector<Shape>& shapes);
+
+// Evaluates the program for all elements of out. The input tensors are broadcast to the shape of out
+// and the operations are those of cpu::Element with the vector width of elementWidth(), so that the
+// results equal those of evaluating the instructions one by one.
+void FusedElement(const FusedElementProgram& program, Tensor out, const std::vector<Tensor>& inputs);
+
+}  // namespace cpu
+}  // namespace marian
@@ -1,5 +1,11 @@
 #include "integer_common.h"
 
+#include "tensors/cpu/backend.h"
+#include "common/file_stream.h"
+#include "3rd_party/yaml-cpp/yaml.h"
+
+#include <cmath>
+
 namespace marian {
 namespace cpu {
 namespace integer {
@@ -22,6 +28,14 @@ void AddBias(marian::Tensor C, const marian::Tensor Bias) {
       __m512 yi = _mm512_add_ps(ai, bi);
       _mm512_storeu_ps(y + j * n + i, yi);
     }
+#elif USE_NEON
+    int n4 = (n / 4) * 4;
+    for(; i < n4; i += 4) {
+      float32x4_t ai = vld1q_f32(x + j * n + i);
+      float32x4_t bi = vld1q_f32(bias + i);
+      float32x4_t yi = vaddq_f32(ai, bi);
+      vst1q_f32(y + j * n + i, yi);
+    }
 #else
     int n4 = (n / 4) * 4;
     for(; i < n4; i += 4) {
@@ -37,6 +51,147 @@ void AddBias(marian::Tensor C, const marian::Tensor Bias) {
   }
 }
 
+static inline int roundUp(int x, int multiple) {
+  return (x + multiple - 1) / multiple * multiple;
+}
+
+// 127 over the largest absolute value, 1 for a matrix of zeros
+static inline float quantMult8(const float* begin, const float* end) {
+#if COMPILE_CPU
+  float maxAbs = intgemm::MaxAbsolute(begin, end);
+  return maxAbs > 0.f ? 127.f / maxAbs : 1.f;
+#else
+  begin; end;
+  return 1.f;
+#endif
+}
+
+void ProdBatchedInt8(marian::Tensor C,
+                     const marian::Tensor A,
+                     const marian::Tensor B,
+                     bool transA,
+                     bool transB,
+                     float beta,
+                     float scalar) {
+#if COMPILE_CPU
+  int batchA = A->shape().elements() / (A->shape()[-1] * A->shape()[-2]);
+  int batchB = B->shape().elements() / (B->shape()[-1] * B->shape()[-2]);
+  int batchC = std::max(batchA, batchB);
+
+  int m = A->shape()[-2];
+  int k = A->shape()[-1];
+  if(transA)
+    std::swap(m, k);
+
+  int n = B->shape()[-1];
+  if(transB)
+    n = B->shape()[-2];
+
+  int lda = A->shape()[-1];
+  int ldb = B->shape()[-1];
+  size_t strideA = batchA == 1 ? 0 : (size_t)m * k;
+  size_t strideB = batchB == 1 ? 0 : (size_t)n * k;
+  size_t strideC = (size_t)m * n;
+
+  int width = roundUp(k, 64);
+  int cols = roundUp(n, 8);
+
+  parallelFor(C, batchC, (size_t)m * n * k / 16, [&](size_t begin, size_t end) {
+    // intgemm expects 64-byte aligned operands
+    const size_t align = 64;
+    float* aFloat  = (float*)genericMalloc(align, sizeof(float) * m * width);
+    int8_t* aQuant = (int8_t*)genericMalloc(align, m * width);
+    float* bFloat  = (float*)genericMalloc(align, sizeof(float) * width * cols);
+    int8_t* bQuant = (int8_t*)genericMalloc(align, width * cols);
+    float* cFloat  = (float*)genericMalloc(align, sizeof(float) * m * cols);
+
+    std::fill(aFloat, aFloat + m * width, 0.f);
+    std::fill(bFloat, bFloat + width * cols, 0.f);
+
+    for(size_t i = begin; i < end; ++i) {
+      const float* a = A->data() + (i % batchA) * strideA;
+      const float* b = B->data() + (i % batchB) * strideB;
+      float* c = C->data() + i * strideC;
+
+      // op(A) as m x width and op(B) as width x cols, the padding stays zero
+      for(int r = 0; r < m; ++r)
+        for(int p = 0; p < k; ++p)
+          aFloat[r * width + p] = transA ? a[p * lda + r] : a[r * lda + p];
+      for(int p = 0; p < k; ++p)
+        for(int j = 0; j < n; ++j)
+          bFloat[p * cols + j] = transB ? b[j * ldb + p] : b[p * ldb + j];
+
+      float aMult = quantMult8(aFloat, aFloat + m * width);
+      float bMult = quantMult8(bFloat, bFloat + width * cols);
+      intgemm::Int8::PrepareA(aFloat, aQuant, aMult, m, width);
+      intgemm::Int8::PrepareB(bFloat, bQuant, bMult, width, cols);
+      intgemm::Int8::Multiply(aQuant, bQuant, m, width, cols,
+                              intgemm::callbacks::UnquantizeAndWrite(scalar / (aMult * bMult), cFloat));
+
+      for(int r = 0; r < m; ++r)
+        for(int j = 0; j < n; ++j)
+          c[r * n + j] = cFloat[r * cols + j] + (beta == 0.f ? 0.f : beta * c[r * n + j]);
+    }
+
+    genericFree(aFloat);
+    genericFree(aQuant);
+    genericFree(bFloat);
+    genericFree(bQuant);
+    genericFree(cFloat);
+  });
+#else
+  C; A; B; transA; transB; beta; scalar;
+  ABORT("You need to enable CPU compilation to use this feature. Use cmake .. -DCOMPILE_CPU=ON");
+#endif
+}
+
+ActivationStatistics& ActivationStatistics::instance() {
+  static ActivationStatistics statistics;
+  return statistics;
+}
+
+void ActivationStatistics::add(const std::string& name, float maxAbs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  maxAbs_[withoutNamespace(name)].push_back(maxAbs);
+}
+
+void ActivationStatistics::save(const std::string& fileName) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  YAML::Node yaml;
+  for(const auto& it : maxAbs_) {
+    const auto& values = it.second;
+    double sum = 0, sumSquares = 0;
+    float max = 0.f;
+    for(float value : values) {
+      sum += value;
+      sumSquares += (double)value * value;
+      max = std::max(max, value);
+    }
+    double mean = sum / values.size();
+    double stddev = std::sqrt(std::max(0.0, sumSquares / values.size() - mean * mean));
+
+    YAML::Node node;
+    node["products"] = values.size();
+    node["mean"] = (float)mean;
+    node["stddev"] = (float)stddev;
+    node["max"] = max;
+    node["maxabs"] = std::min(max, (float)(mean + 1.1 * stddev));
+    yaml[it.first] = node;
+  }
+  io::OutputFileStream out(fileName);
+  out << yaml;
+  LOG(info, "Saved the activation statistics of {} parameters to {}", maxAbs_.size(), fileName);
+}
+
+std::map<std::string, float> ActivationStatistics::load(const std::string& fileName) {
+  io::InputFileStream in(fileName);
+  YAML::Node yaml = YAML::Load(in);
+  std::map<std::string, float> maxAbs;
+  for(const auto& it : yaml)
+    maxAbs[it.first.as<std::string>()] = it.second["maxabs"].as<float>();
+  return maxAbs;
+}
+
 //template void prepareAndTranspose<intgemm8>;//(io::Item& item, const char * input);
 //template void prepareAndTranspose<intgemm16>(io::Item&, const char *);
 
@@ -3,6 +3,7 @@
 #include "tensors/tensor_allocator.h"
 #include "tensors/tensor_operators.h"
 #include "tensors/cpu/aligned.h"
+#include "tensors/cpu/amx_gemm.h"
 #include "common/io_item.h"
 
 #if COMPILE_CPU
@@ -31,12 +32,19 @@ namespace intgemm {
 }
 #endif
 
+#if !USE_NEON
 #include <emmintrin.h>
 #include <immintrin.h>
 #include <tmmintrin.h>
 #include <xmmintrin.h>
+#endif
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace marian {
 namespace cpu {
@@ -51,6 +59,45 @@ inline int rows(Shape& shape) { return shape.elements() / cols(shape); }
 
 template <Type type> struct intgemm_;
 
+#if COMPILE_CPU
+// The kernels of amx_gemm.h with the interface of the intgemm kernels. A is quantized like for the
+// other 8-bit types. Selecting columns needs the number of columns of B, as the packed layout of
+// its last block depends on it.
+struct AmxKernels8 {
+  static void PrepareA(const float* input, int8_t* output, float quantMult, intgemm::Index rows, intgemm::Index cols) {
+    intgemm::avx512bw::Kernels8::PrepareA(input, output, quantMult, rows, cols);
+  }
+
+  static void PrepareBTransposed(const float* input, int8_t* output, float quantMult, intgemm::Index inner, intgemm::Index cols) {
+    int8_t* quantized = reinterpret_cast<int8_t*>(genericMalloc(64, (size_t)inner * cols));
+    intgemm::avx512bw::Kernels8::PrepareA(input, quantized, quantMult, cols, inner);
+    amx::prepareBQuantizedTransposed(quantized, output, inner, cols);
+    genericFree(quantized);
+  }
+
+  static void PrepareBQuantizedTransposed(const int8_t* input, int8_t* output, intgemm::Index inner, intgemm::Index cols) {
+    amx::prepareBQuantizedTransposed(input, output, inner, cols);
+  }
+
+  static void SelectColumnsB(const int8_t* input, int8_t* output, intgemm::Index inner, intgemm::Index cols,
+                             const intgemm::Index* begin, const intgemm::Index* end) {
+    amx::selectColumnsB(input, output, inner, cols, begin, end);
+  }
+
+  static void Multiply(const int8_t* A, const int8_t* B, intgemm::Index rows, intgemm::Index width, intgemm::Index cols,
+                       intgemm::callbacks::UnquantizeAndWrite callback) {
+    amx::multiply(A, B, rows, width, cols, callback.unquant_mult, nullptr, callback.output_addr);
+  }
+
+  static void Multiply(const int8_t* A, const int8_t* B, intgemm::Index rows, intgemm::Index width, intgemm::Index cols,
+                       intgemm::callbacks::UnquantizeAndAddBiasAndWrite callback) {
+    amx::multiply(A, B, rows, width, cols, callback.unquant_mult, callback.bias_addr, callback.output_addr);
+  }
+};
+#else
+struct AmxKernels8;
+#endif
+
 template <> struct intgemm_<Type::intgemm8> {
   using width = intgemm::Int8;
   using type = int8_t;
@@ -76,6 +123,11 @@ template <> struct intgemm_<Type::intgemm8avx512vnni> {
   using type = int8_t;
 };
 
+template <> struct intgemm_<Type::intgemm8amx> {
+  using width = AmxKernels8;
+  using type = int8_t;
+};
+
 template <> struct intgemm_<Type::intgemm16> {
   using width = intgemm::Int16;
   using type = int16_t;
@@ -111,7 +163,9 @@ static inline float& getQuantMult(marian::Tensor val) {
 static inline Type getIntgemmType(Type vtype) {
 #if COMPILE_CPU
   if (vtype == Type::intgemm8) {
-    if (intgemm::kCPU == intgemm::CPUType::AVX512VNNI) {
+    if (amx::available()) {
+      return Type::intgemm8amx;
+    } else if (intgemm::kCPU == intgemm::CPUType::AVX512VNNI) {
       return Type::intgemm8avx512vnni;
     } else if (intgemm::kCPU == intgemm::CPUType::AVX512BW) {
       return Type::intgemm8avx512;
@@ -155,6 +209,8 @@ static inline bool passOrAbort(Type vtype) {
     ABORT_IF(intgemm::kCPU < intgemm::CPUType::AVX512BW, "Your CPU doesn't support the architecture necessary to decode model of type {}. Try older architecture instead.", vtype);
   } else if (vtype == Type::intgemm8avx512vnni) {
     ABORT_IF(intgemm::kCPU < intgemm::CPUType::AVX512VNNI, "Your CPU doesn't support the architecture necessary to decode model of type {}. Try older architecture instead.", vtype);
+  } else if (vtype == Type::intgemm8amx) {
+    ABORT_IF(!amx::available(), "Your CPU or operating system doesn't support the AMX tiles necessary to decode model of type {}. Try older architecture instead.", vtype);
   }
   return true;
 #else
@@ -179,9 +235,71 @@ static inline float computeQuantMult(marian::Tensor val) {
 #endif
 }
 
+// Whether a parameter is stored as the transpose of the B matrix it is multiplied with, like the
+// output layer '..._Wt' or tied embeddings 'Wemb'. Its packed form is that of B nevertheless, while its
+// shape stays that of the parameter, so the columns of B are its rows and it is multiplied with
+// transB = true.
+static inline bool isTransposedB(const std::string& name) {
+  return name.find("Wemb") != std::string::npos
+         || (name.size() >= 3 && name.compare(name.size() - 3, 3, "_Wt") == 0);
+}
+
+// The name of a parameter without the namespace of its scorer, e.g. 'F0::'
+static inline std::string withoutNamespace(const std::string& name) {
+  auto pos = name.rfind("::");
+  return pos == std::string::npos ? name : name.substr(pos + 2);
+}
+
+// The parameter holding the precomputed quantization multiplier of the activations that are
+// multiplied with the 8-bit parameter `name`, added by marian-conv --quantize-statistics
+static inline std::string quantMultAName(const std::string& name) {
+  return withoutNamespace(name) + "_QuantMultA";
+}
+
+/*
+ * Largest absolute values of the activations that are quantized at runtime for the 8-bit products
+ * with a parameter, one per product, collected by parameter while decoding with marian-decoder
+ * --quantize-statistics. marian-conv --quantize-statistics turns them into the multipliers that
+ * prepareA() uses instead of computeQuantMult(). Shared by all CPU graphs of the process.
+ */
+class ActivationStatistics {
+private:
+  std::atomic<bool> enabled_{false};
+  std::mutex mutex_;
+  std::map<std::string, std::vector<float>> maxAbs_; // by parameter name without namespace
+
+public:
+  static ActivationStatistics& instance();
+
+  void enable() { enabled_ = true; }
+  bool enabled() const { return enabled_; }
+
+  void add(const std::string& name, float maxAbs);
+
+  // Writes the number of products, mean, standard deviation and maximum of the values of every
+  // parameter as YAML, and the value to quantize with, the mean plus 1.1 standard deviations but
+  // at most the maximum, so that the rare outliers are clipped instead of costing precision
+  void save(const std::string& fileName);
+
+  // The values to quantize with by parameter name from a file written by save()
+  static std::map<std::string, float> load(const std::string& fileName);
+};
+
 // This operates on floats after processing so doesn't care about int8_t vs int16_t.
 void AddBias(marian::Tensor C, const marian::Tensor Bias);
 
+// Batched product C = beta * C + scalar * op(A) * op(B) of float activations with 8-bit intgemm, e.g.
+// for the attention scores and contexts. Both matrices of each product are quantized at runtime with
+// their own multipliers, and padded with zeros to the inner dimension of 64 and the columns of 8
+// that intgemm needs. Broadcasting of the batch works as in cpu::ProdBatched.
+void ProdBatchedInt8(marian::Tensor C,
+                     const marian::Tensor A,
+                     const marian::Tensor B,
+                     bool transA,
+                     bool transB,
+                     float beta,
+                     float scalar);
+
 // For loading architecture agnostic models. We do PrepareAndTranpose, because we already transposed
 // in our binary format. Then we copy the quantizationMultiplier information at the end
 template<Type vtype>
@@ -189,21 +307,24 @@ void prepareAndTransposeB(io::Item& item, const char * input) {
 #if COMPILE_CPU
     typedef typename intgemm_<vtype>::type Integer;
     Integer * output_tensor = reinterpret_cast<Integer *>(&(*item.bytes.begin()));
+    // For a transposed parameter the binary holds B^T quantized, as the parameter itself
+    int inner = isTransposedB(item.name) ? cols(item.shape) : rows(item.shape);
+    int bCols = isTransposedB(item.name) ? rows(item.shape) : cols(item.shape);
     // Sometimes we will end up with misaligned intput (and output) so we can't use them directly.
     // If this is the case, we will need to temporary allocate aligned memory, copy the results, and then free it
     if (reinterpret_cast<uintptr_t>(input) % 64 == 0 && reinterpret_cast<uintptr_t>(output_tensor) % 64 == 0) {
         intgemm_<vtype>::width::PrepareBQuantizedTransposed(reinterpret_cast<const Integer *>(input),
                                                    output_tensor,
-                                                   rows(item.shape),  //Since we only transposed, but didn't update the shape when constructing the binary, 
-                                                   cols(item.shape)); //rows here returns the columns of the transposed input matrix, and cols -> the rows
+                                                   inner,  //Since we only transposed, but didn't update the shape when constructing the binary, 
+                                                   bCols); //rows here returns the columns of the transposed input matrix, and cols -> the rows
     } else {
         Integer * aligned_input = reinterpret_cast<Integer *>(genericMalloc(512, rows(item.shape)*cols(item.shape)*sizeof(Integer)));
         std::copy(input, input + rows(item.shape)*cols(item.shape), aligned_input);
         Integer * aligned_output = reinterpret_cast<Integer *>(genericMalloc(512, rows(item.shape)*cols(item.shape)*sizeof(Integer)));
         intgemm_<vtype>::width::PrepareBQuantizedTransposed(reinterpret_cast<const Integer *>(aligned_input),
                                                    reinterpret_cast<Integer *>(aligned_output),
-                                                   rows(item.shape),  //Since we only transposed, but didn't update the shape when constructing the binary, 
-                                                   cols(item.shape)); //rows here returns the columns of the transposed input matrix, and cols -> the rows
+                                                   inner,  //Since we only transposed, but didn't update the shape when constructing the binary, 
+                                                   bCols); //rows here returns the columns of the transposed input matrix, and cols -> the rows
         // Copy to output tensor
         std::copy(aligned_output, aligned_output + rows(item.shape)*cols(item.shape), output_tensor);
         genericFree(aligned_input);
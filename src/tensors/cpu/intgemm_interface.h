@@ -3,6 +3,7 @@
 #include "graph/node.h"
 #include "graph/node_operators_unary.h"
 #include "integer_common.h"
+#include "tensors/cpu/backend.h"
 
 namespace marian {
 
@@ -13,12 +14,22 @@ namespace integer {
 /*
  * Prepare an activation matrix into intgemm8/16 format. For now the activation matrix is just quantized.
  * Expr input: The input tensor
+ * Expr quantMultA: A scalar with a precomputed quantization multiplier, or nullptr to compute it from the input
+ * std::string name: The parameter the input is multiplied with, collects the largest absolute value of the
+ * input in ActivationStatistics if not empty
  */
 template<Type vtype>
-static inline Expr prepareA(Expr a) {
-  auto nodeOp = [](Expr out, const std::vector<Expr>& children) {
+static inline Expr prepareA(Expr a, Expr quantMultA = nullptr, const std::string& name = "") {
+  auto nodeOp = [name](Expr out, const std::vector<Expr>& children) {
     Expr in = children[0];
-    auto quantMult = computeQuantMult<vtype>(in->val());
+    float quantMult;
+    if(children.size() > 1) {
+      quantMult = children[1]->val()->data()[0];
+    } else {
+      quantMult = computeQuantMult<vtype>(in->val());
+      if(!name.empty())
+        ActivationStatistics::instance().add(name, 127.0f / quantMult);
+    }
     typedef typename intgemm_<vtype>::type Integer;
     intgemm_<vtype>::width::PrepareA(in->val()->data(), /*input*/
                                      out->val()->data<Integer>(), /*output*/
@@ -28,7 +39,10 @@ static inline Expr prepareA(Expr a) {
     getQuantMult<vtype>(out->val()) = quantMult;
   };
 
-  return lambda({a}, a->shape(), vtype, nodeOp);
+  std::vector<Expr> children = {a};
+  if(quantMultA)
+    children.push_back(quantMultA);
+  return lambda(children, a->shape(), vtype, nodeOp);
 }
 #endif
 
@@ -38,23 +52,35 @@ static inline Expr prepareA(Expr a) {
  * Expr b: The parameter matrix in intgemm fromat	
  * Expr bias: The bias	
  * bool transA - tranpose input A if true
- * bool transB - unused here (@TODO remove?)
+ * bool transB - B is a transposed parameter (see isTransposedB()), its rows are the columns of the product
  * float scale - scale the output by `scale`
  * the template argument controls whether we're doing 16bit integers or 8bit integers. 
  * It can be Type::intgemm8 or Type::intgemm16 and all hardware-specific variants	
  */
 template<Type vtype>
-static inline Expr affineOrDotTyped(Expr a, Expr bQuant, Expr bias, bool transA, bool /*transB*/, float scale) {
+static inline Expr affineOrDotTyped(Expr a, Expr bQuant, Expr bias, bool transA, bool transB, float scale) {
 #if COMPILE_CPU
   ABORT_IF(!isFloat(a->value_type()), "Intgemm expects type of A to be float32 not {}", a->value_type());
   ABORT_IF(!isIntgemm(bQuant->value_type()), "Intgemm expects type of B to be a variant of intgemm not {}", bQuant->value_type());
 
-  auto aQuant = prepareA<vtype>(transA ? transpose(a) : a); // A should not be quantized yet as seen above, hence quantize here
+  // 8-bit activations multiplied with a parameter are quantized with the multiplier that marian-conv
+  // --quantize-statistics precomputed for it if there is one, which saves a pass over A
+  Expr quantMultA;
+  std::string statisticsName;
+  if(sizeOf(vtype) == 1 && bQuant->type() == "param") {
+    quantMultA = bQuant->graph()->get(quantMultAName(bQuant->name()), Type::float32);
+    if(!quantMultA && ActivationStatistics::instance().enabled())
+      statisticsName = bQuant->name();
+  }
+
+  auto aQuant = prepareA<vtype>(transA ? transpose(a) : a, quantMultA, statisticsName); // A should not be quantized yet as seen above, hence quantize here
   
   // determine the output shape m x n for A: m x k and B: k x n
-  // since we transpose A beforehand we don't need to take care of transposed shapes here 
+  // since we transpose A beforehand we don't need to take care of transposed shapes here, B is
+  // prepared as k x n in any case
   Shape outShape = aQuant->shape();
-  outShape.set(-1, bQuant->shape()[-1]);
+  int bCols = transB ? bQuant->shape()[-2] : bQuant->shape()[-1];
+  outShape.set(-1, bCols);
 
   // wrap the multiply finctions to be executed in the forward step of a Lambda node
   auto dotOrAffineNodeOp = [=](Expr out, const std::vector<Expr>& children) {
@@ -70,21 +96,29 @@ static inline Expr affineOrDotTyped(Expr a, Expr bQuant, Expr bias, bool transA,
     unquant_mult = unquant_mult * scale;
 
     typedef typename intgemm_<vtype>::type Integer;
-    if(bias) { // dispatch a multiply with integrated bias addition i.e affine(...)
-      intgemm_<vtype>::width::Multiply(/*A=*/aQuant->val()->data<Integer>(),
-                                       /*B=*/bQuant->val()->data<Integer>(),
-                                       rows(aQuant->val()),
-                                       cols(aQuant->val()),
-                                       cols(bQuant->val()),
-                                       intgemm::callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, /*bias=*/bias->val()->data(), /*output=*/out->val()->data()));
-    } else { // dispatch a multiply without bias addition i.e dot(...)
-      intgemm_<vtype>::width::Multiply(/*A=*/aQuant->val()->data<Integer>(),
-                                       /*B=*/bQuant->val()->data<Integer>(),
-                                       rows(aQuant->val()),
-                                       cols(aQuant->val()),
-                                       cols(bQuant->val()),
-                                       intgemm::callbacks::UnquantizeAndWrite(unquant_mult, /*output=*/out->val()->data()));
-    }
+    int width = cols(aQuant->val());
+
+    // the rows of A are split across the threads of the graph, the callbacks write the rows of
+    // the output relative to the pointer they get
+    parallelFor(out->val(), rows(aQuant->val()), (size_t)width * bCols / 16, [&](size_t begin, size_t end) {
+      const Integer* aRows = aQuant->val()->data<Integer>() + begin * width;
+      float* outRows = out->val()->data() + begin * bCols;
+      if(bias) { // dispatch a multiply with integrated bias addition i.e affine(...)
+        intgemm_<vtype>::width::Multiply(/*A=*/aRows,
+                                         /*B=*/bQuant->val()->data<Integer>(),
+                                         (int)(end - begin),
+                                         width,
+                                         bCols,
+                                         intgemm::callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, /*bias=*/bias->val()->data(), /*output=*/outRows));
+      } else { // dispatch a multiply without bias addition i.e dot(...)
+        intgemm_<vtype>::width::Multiply(/*A=*/aRows,
+                                         /*B=*/bQuant->val()->data<Integer>(),
+                                         (int)(end - begin),
+                                         width,
+                                         bCols,
+                                         intgemm::callbacks::UnquantizeAndWrite(unquant_mult, /*output=*/outRows));
+      }
+    });
   };
 
   std::vector<Expr> children = {aQuant, bQuant};
@@ -98,6 +132,117 @@ static inline Expr affineOrDotTyped(Expr a, Expr bQuant, Expr bias, bool transA,
 #endif
 }
 
+/*
+ * This computes the batched product scale * op(A) * op(B) of two float activations, e.g. of the
+ * queries and keys or of the weights and values in attention, in 8-bit intgemm. Unlike the
+ * parameters of affineOrDot() neither operand is prepared beforehand, both are quantized at
+ * runtime, each matrix of the batch with its own multipliers. Shapes are those of bdot().
+ */
+static inline Expr bdotInt8(Expr a, Expr b, bool transA, bool transB, float scale) {
+#if COMPILE_CPU
+  ABORT_IF(!isFloat(a->value_type()) || !isFloat(b->value_type()),
+           "Intgemm expects types of A and B to be float32 not {} and {}", a->value_type(), b->value_type());
+
+  Shape outShape = a->shape();
+  int k = transA ? a->shape()[-2] : a->shape()[-1];
+  outShape.set(-2, transA ? a->shape()[-1] : a->shape()[-2]);
+  outShape.set(-1, transB ? b->shape()[-2] : b->shape()[-1]);
+  ABORT_IF(k != (transB ? b->shape()[-1] : b->shape()[-2]),
+           "Batched matrix product requires inner dimensions to match in {}{} * {}{}",
+           std::string(a->shape()), transA, std::string(b->shape()), transB);
+
+  auto bdotNodeOp = [=](Expr out, const std::vector<Expr>& children) {
+    ProdBatchedInt8(out->val(), children[0]->val(), children[1]->val(), transA, transB, /*beta=*/0.f, scale);
+  };
+
+  return lambda({a, b}, outShape, Type::float32, bdotNodeOp); // inference-only Lambda node
+#else
+  a, b, transA, transB, scale;
+  ABORT("You need to enable CPU compilation to use this feature. Use cmake .. -DCOMPILE_CPU=ON");
+#endif
+}
+
+#if COMPILE_CPU
+// The packed B of intgemm does not depend on its number of columns `cols`, that of AMX does
+template <class Kernels, typename Integer>
+static inline void selectColumnsBKernel(const Integer* in, Integer* out, int inner, int cols,
+                                        const intgemm::Index* begin, const intgemm::Index* end) {
+  cols;
+  Kernels::SelectColumnsB(in, out, inner, begin, end);
+}
+
+template <>
+inline void selectColumnsBKernel<AmxKernels8, int8_t>(const int8_t* in, int8_t* out, int inner, int cols,
+                                                      const intgemm::Index* begin, const intgemm::Index* end) {
+  AmxKernels8::SelectColumnsB(in, out, inner, cols, begin, end);
+}
+#endif
+
+/*
+ * Selects columns of a parameter matrix in intgemm format, e.g. the words of a shortlist from the output
+ * layer, without unpacking it. The result is in intgemm format as well, with the quantization multiplier
+ * of b, so the shortlisted product stays quantized and the full matrix is never prepared again.
+ * Expr b: The parameter matrix in intgemm format, k x n or n x k if transposed (see isTransposedB())
+ * int axis: The axis of the columns of B, 0 (or -2) if b is transposed, -1 (or 1) otherwise
+ * indices: The selected columns, intgemm copies them in groups of eight
+ */
+template<Type vtype>
+static inline Expr selectColumnsBTyped(Expr b, int axis, const std::vector<IndexType>& indices) {
+#if COMPILE_CPU
+  ABORT_IF(b->shape().size() != 2, "Intgemm selects columns only from matrices, not from {}", std::string(b->shape()));
+  ABORT_IF(indices.empty() || indices.size() % 8 != 0,
+           "Intgemm selects columns in groups of 8, {} given", indices.size());
+  static_assert(sizeof(IndexType) == sizeof(intgemm::Index), "Indices have to match intgemm::Index");
+
+  axis = b->shape().axis(axis);
+  Shape outShape = b->shape();
+  outShape.set(axis, (int)indices.size());
+  int inner = b->shape()[1 - axis];
+  int cols = b->shape()[axis];
+
+  auto selectNodeOp = [=](Expr out, const std::vector<Expr>& children) {
+    typedef typename intgemm_<vtype>::type Integer;
+    Expr in = children[0];
+    const intgemm::Index* colsBegin = reinterpret_cast<const intgemm::Index*>(indices.data());
+    selectColumnsBKernel<typename intgemm_<vtype>::width>(in->val()->data<Integer>(),
+                                                          out->val()->data<Integer>(),
+                                                          inner,
+                                                          cols,
+                                                          colsBegin,
+                                                          colsBegin + indices.size());
+    getQuantMult<vtype>(out->val()) = getQuantMult<vtype>(in->val());
+  };
+
+  return lambda({b}, outShape, b->value_type(), selectNodeOp); // inference-only Lambda node
+#else
+  b, axis, indices;
+  ABORT("You need to enable CPU compilation to use this feature. Use cmake .. -DCOMPILE_CPU=ON");
+#endif
+}
+
+static inline Expr selectColumnsB(Expr b, int axis, const std::vector<IndexType>& indices) {
+  switch(b->value_type()) {
+    case Type::intgemm8ssse3 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8ssse3>(b, axis, indices);
+    case Type::intgemm8avx2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx2>(b, axis, indices);
+    case Type::intgemm8avx512 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx512>(b, axis, indices);
+    case Type::intgemm8avx512vnni :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx512vnni>(b, axis, indices);
+    case Type::intgemm8amx :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8amx>(b, axis, indices);
+    case Type::intgemm16sse2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16sse2>(b, axis, indices);
+    case Type::intgemm16avx2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16avx2>(b, axis, indices);
+    case Type::intgemm16avx512 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16avx512>(b, axis, indices);
+    default:
+      ABORT("Unsupported type {} for Intgemm type??", b->value_type());
+  }
+}
+
 // Dispatch correct hardware-agnostic or hardware-specific matrix multiplies
 static inline Expr affineOrDot(Expr a, Expr bQuant, Expr bias, bool transA, bool transB, float scale) {
   Type bQuantElementType = bQuant->value_type();
@@ -114,6 +259,8 @@ static inline Expr affineOrDot(Expr a, Expr bQuant, Expr bias, bool transA, bool
       return cpu::integer::affineOrDotTyped<Type::intgemm8avx512>(a, bQuant, bias, transA, transB, scale);
     case Type::intgemm8avx512vnni :
       return cpu::integer::affineOrDotTyped<Type::intgemm8avx512vnni>(a, bQuant, bias, transA, transB, scale);
+    case Type::intgemm8amx :
+      return cpu::integer::affineOrDotTyped<Type::intgemm8amx>(a, bQuant, bias, transA, transB, scale);
     //case Type::intgemm16 :  // The generic case selects CPU automatically, but we set all the types manually anyways.
     //  return cpu::integer::affineOrDotTyped<Type::intgemm16>(a, bQuant, bias, transA, transB, scale);
     case Type::intgemm16sse2 :
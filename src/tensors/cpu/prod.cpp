@@ -15,14 +15,67 @@
 #endif
 #endif
 
+#include "graph/auto_tuner.h"
 #include "integer_common.h"
 #include "prod_blas.h"
+#include "tensors/cpu/float16.h"
 
 
 namespace marian {
 
 namespace cpu {
 
+#if BLAS_FOUND
+// Floats of B converted at once, the panels of B stay in the L2 cache for the product
+static const size_t FLOAT16_PANEL = 64 * 1024;
+
+// Prod() for B stored as float16, see --cpu-float16-weights: every thread converts its columns of B
+// to float32 in panels of at most FLOAT16_PANEL floats, each multiplied right after its conversion
+static void prodFloat16B(marian::Tensor C,
+                         const marian::Tensor& A,
+                         const marian::Tensor& B,
+                         bool transA,
+                         bool transB,
+                         float alpha,
+                         float beta,
+                         int m,
+                         int n,
+                         int k,
+                         int lda,
+                         int ldb,
+                         int ldc,
+                         int block) {
+  int panelCols = std::max(block, (int)(FLOAT16_PANEL / k) / block * block);
+  parallelFor(C, (n + block - 1) / block, (size_t)m * k, [&](size_t begin, size_t end) {
+    static thread_local std::vector<float> panel;
+    const float16* b = B->data<float16>();
+    for(int col = (int)begin * block, colsEnd = std::min(n, (int)end * block); col < colsEnd; col += panelCols) {
+      int cols = std::min(panelCols, colsEnd - col);
+      panel.resize((size_t)cols * k);
+      if(transB) { // the rows [col, col + cols) of B are contiguous
+        float16ToFloat32(panel.data(), b + (size_t)col * ldb, (size_t)cols * k);
+      } else {
+        for(int p = 0; p < k; ++p)
+          float16ToFloat32(panel.data() + (size_t)p * cols, b + (size_t)p * ldb + col, cols);
+      }
+      sgemm(transA,
+            transB,
+            m,
+            cols,
+            k,
+            alpha,
+            A->data(),
+            lda,
+            panel.data(),
+            transB ? k : cols,
+            beta,
+            C->data() + col,
+            ldc);
+    }
+  });
+}
+#endif
+
 void Prod(marian::Tensor C,
           const marian::Tensor& A,
           const marian::Tensor& B,
@@ -50,25 +103,95 @@ void Prod(marian::Tensor C,
   if(transB)
     ldc = B->shape().elements() / B->shape()[-1];
 
-  sgemm(transA,
-        transB,
-        m,
-        n,
-        k,
-        alpha,
-        A->data(),
-        lda,
-        B->data(),
-        ldb,
-        beta,
-        C->data(),
-        ldc);
+  // split the columns of C in blocks of 16 across the threads of the graph, one block of columns
+  // costs about as much as m * k element-wise operations
+  const int block = 16;
+  if(B->type() == Type::float16) {
+    prodFloat16B(C, A, B, transA, transB, alpha, beta, m, n, k, lda, ldb, ldc, block);
+    return;
+  }
+  parallelFor(C, (n + block - 1) / block, (size_t)m * k, [&](size_t begin, size_t end) {
+    int col = (int)begin * block;
+    int cols = std::min(n, (int)end * block) - col;
+    sgemm(transA,
+          transB,
+          m,
+          cols,
+          k,
+          alpha,
+          A->data(),
+          lda,
+          B->data() + (transB ? col * ldb : col),
+          ldb,
+          beta,
+          C->data() + col,
+          ldc);
+  });
 #else
   C; A; B; transA; transB; beta; scalar;
   ABORT("You need to compile with MKL in order to use the CPU version");
 #endif
 }
 
+// Products of matrices up to this many multiply-adds are computed by smallSgemm() instead of the
+// BLAS library, whose per-call overhead dominates e.g. the attention of a single decoding step
+static const size_t SMALL_GEMM = 32 * 32 * 32;
+
+// Batched products up to this many multiply-adds per matrix are tuned between smallSgemm() and the
+// BLAS library with --autotune, larger ones always use the library
+static const size_t TUNED_GEMM = 128 * 128 * 128;
+
+// C = alpha * op(A) * op(B) + beta * C in row-major layout like sgemm()
+static void smallSgemm(bool transA,
+                       bool transB,
+                       int m,
+                       int n,
+                       int k,
+                       float alpha,
+                       const float* A,
+                       int lda,
+                       const float* B,
+                       int ldb,
+                       float beta,
+                       float* C,
+                       int ldc) {
+  static thread_local std::vector<float> column; // a row of op(A) if A is transposed
+  for(int i = 0; i < m; ++i) {
+    const float* a = A + i * lda;
+    if(transA) {
+      column.resize(k);
+      for(int p = 0; p < k; ++p)
+        column[p] = A[p * lda + i];
+      a = column.data();
+    }
+
+    float* c = C + i * ldc;
+    if(transB) { // dot products of the row of A with the rows of B
+      for(int j = 0; j < n; ++j) {
+        const float* b = B + j * ldb;
+        float sum = 0.f;
+#pragma omp simd reduction(+ : sum)
+        for(int p = 0; p < k; ++p)
+          sum += a[p] * b[p];
+        c[j] = alpha * sum + (beta == 0.f ? 0.f : beta * c[j]);
+      }
+    } else { // sums of the rows of B weighted by the row of A
+      if(beta == 0.f)
+        std::fill(c, c + n, 0.f);
+      else if(beta != 1.f)
+        for(int j = 0; j < n; ++j)
+          c[j] *= beta;
+      for(int p = 0; p < k; ++p) {
+        float ap = alpha * a[p];
+        const float* b = B + p * ldb;
+#pragma omp simd
+        for(int j = 0; j < n; ++j)
+          c[j] += ap * b[j];
+      }
+    }
+  }
+}
+
 void ProdBatched(marian::Tensor C,
                  Ptr<Allocator> /*allocator*/,
                  const marian::Tensor A,
@@ -105,82 +228,161 @@ void ProdBatched(marian::Tensor C,
   auto strideC = n * m;
 
   auto batchC = std::max(batchA, batchB);
+
+  // one matrix after the other with the direct code for small products
+  auto small = [&]() {
+    parallelFor(C, batchC, m * n * k / 16, [&](size_t begin, size_t end) {
+      for(size_t i = begin; i < end; ++i) {
+        smallSgemm(transA,
+                   transB,
+                   (int)m,
+                   (int)n,
+                   (int)k,
+                   alpha,
+                   A->data() + (i % batchA) * strideA,
+                   (int)lda,
+                   B->data() + (i % batchB) * strideB,
+                   (int)ldb,
+                   beta,
+                   C->data() + i * strideC,
+                   (int)ldc);
+      }
+    });
+  };
+
+  // the BLAS library, with MKL in batched calls
+  auto blas = [&]() {
 #if MKL_FOUND
-  CBLAS_TRANSPOSE transA_forarr = CblasNoTrans;
-  CBLAS_TRANSPOSE transB_forarr = CblasNoTrans;
+    CBLAS_TRANSPOSE transA_forarr = CblasNoTrans;
+    CBLAS_TRANSPOSE transB_forarr = CblasNoTrans;
 
-  if(transA)
-    transA_forarr = CblasTrans;
+    if(transA)
+      transA_forarr = CblasTrans;
 
-  if(transB)
-    transB_forarr = CblasTrans;
-
-  /* cblas_sgemm_batch allows us to group all the small GEMMs that are done in a for loop with sgemm and compute
-   * them in only one MKL call. For the API documentation refer to
-   * https://software.intel.com/content/www/us/en/develop/documentation/mkl-developer-reference-c/top/blas-and-sparse-blas-routines/blas-like-extensions/cblas-gemm-batch.html
-   * The API supports dependencies, where you can specify one "group" of GEMMs to be computed after another. (This controlled by the group_count parameter).
-   * In our case, the operations are not dependent on one another so we hardcode one group. The rest of the arguments (with the exception of group_size) are
-   * the same as the ones that cblas_sgemm expects, with the difference that we are supposed to provide an array pointer (One element per group).
-   * Weirdly enough, we are required to to provide all of the integer arguments as the MKL_INT datatype
-   */
-
-  static const constexpr size_t group_count = 1; // We have one group
-  const std::vector<CBLAS_TRANSPOSE> transa_arr(group_count, transA_forarr);
-  const std::vector<CBLAS_TRANSPOSE> transb_arr(group_count, transB_forarr);
-  const std::vector<MKL_INT> m_arr(group_count, (MKL_INT)m);
-  const std::vector<MKL_INT> n_arr(group_count, (MKL_INT)n);
-  const std::vector<MKL_INT> k_arr(group_count, (MKL_INT)k);
-  const std::vector<float> alpha_arr(group_count, alpha);
-  const std::vector<float> beta_arr(group_count, beta);
-  const std::vector<MKL_INT> lda_arr(group_count, (MKL_INT)lda);
-  const std::vector<MKL_INT> ldb_arr(group_count, (MKL_INT)ldb);
-  const std::vector<MKL_INT> ldc_arr(group_count, (MKL_INT)ldc);
-  const std::vector<MKL_INT> group_size(group_count, (MKL_INT)batchC); // Group size specifies number of GEMM operations per group (Which is batchC)
-
-  std::vector<const float *> a_array(batchC, nullptr);
-  std::vector<const float *> b_array(batchC, nullptr);
-  std::vector<float *> c_array(batchC, nullptr);
-
-  // This loop initializes the array pointers in the same way as the for loop
-  // in the normal sgemm version a few lines below
-  for(size_t i = 0; i < batchC; ++i) {
-    a_array[i] = A->data() + (i % batchA) * strideA;
-    b_array[i] = B->data() + (i % batchB) * strideB;
-    c_array[i] = C->data() + i * strideC;
-  }
-  cblas_sgemm_batch (CblasRowMajor,
-    &transa_arr[0],
-    &transb_arr[0],
-    &m_arr[0],
-    &n_arr[0],
-    &k_arr[0],
-    &alpha_arr[0],
-    &a_array[0],
-    &lda_arr[0],
-    &b_array[0],
-    &ldb_arr[0],
-    &beta_arr[0],
-    &c_array[0],
-    &ldc_arr[0],
-    group_count,
-    &group_size[0]);
+    if(transB)
+      transB_forarr = CblasTrans;
+
+    /* cblas_sgemm_batch allows us to group all the small GEMMs that are done in a for loop with sgemm and compute
+     * them in only one MKL call. For the API documentation refer to
+     * https://software.intel.com/content/www/us/en/develop/documentation/mkl-developer-reference-c/top/blas-and-sparse-blas-routines/blas-like-extensions/cblas-gemm-batch.html
+     * The API supports dependencies, where you can specify one "group" of GEMMs to be computed after another. (This controlled by the group_count parameter).
+     * In our case, the operations are not dependent on one another so we hardcode one group. The rest of the arguments (with the exception of group_size) are
+     * the same as the ones that cblas_sgemm expects, with the difference that we are supposed to provide an array pointer (One element per group).
+     * Weirdly enough, we are required to to provide all of the integer arguments as the MKL_INT datatype
+     */
+
+    static const constexpr size_t group_count = 1; // We have one group
+    const std::vector<CBLAS_TRANSPOSE> transa_arr(group_count, transA_forarr);
+    const std::vector<CBLAS_TRANSPOSE> transb_arr(group_count, transB_forarr);
+    const std::vector<MKL_INT> m_arr(group_count, (MKL_INT)m);
+    const std::vector<MKL_INT> n_arr(group_count, (MKL_INT)n);
+    const std::vector<MKL_INT> k_arr(group_count, (MKL_INT)k);
+    const std::vector<float> alpha_arr(group_count, alpha);
+    const std::vector<float> beta_arr(group_count, beta);
+    const std::vector<MKL_INT> lda_arr(group_count, (MKL_INT)lda);
+    const std::vector<MKL_INT> ldb_arr(group_count, (MKL_INT)ldb);
+    const std::vector<MKL_INT> ldc_arr(group_count, (MKL_INT)ldc);
+
+    std::vector<const float *> a_array(batchC, nullptr);
+    std::vector<const float *> b_array(batchC, nullptr);
+    std::vector<float *> c_array(batchC, nullptr);
+
+#if INTEL_MKL_VERSION >= 20200002
+    // without broadcasting other than of single matrices the batch is strided and needs no pointer arrays
+    if((batchA == 1 || batchA == batchC) && (batchB == 1 || batchB == batchC)) {
+      parallelFor(C, batchC, m * n * k / 16, [&](size_t begin, size_t end) {
+        cblas_sgemm_batch_strided(CblasRowMajor,
+                                  transA_forarr,
+                                  transB_forarr,
+                                  (MKL_INT)m,
+                                  (MKL_INT)n,
+                                  (MKL_INT)k,
+                                  alpha,
+                                  A->data() + begin * strideA,
+                                  (MKL_INT)lda,
+                                  (MKL_INT)strideA,
+                                  B->data() + begin * strideB,
+                                  (MKL_INT)ldb,
+                                  (MKL_INT)strideB,
+                                  beta,
+                                  C->data() + begin * strideC,
+                                  (MKL_INT)ldc,
+                                  (MKL_INT)strideC,
+                                  (MKL_INT)(end - begin));
+      });
+      return;
+    }
+#endif
+
+    // This loop initializes the array pointers in the same way as the for loop
+    // in the normal sgemm version a few lines below
+    for(size_t i = 0; i < batchC; ++i) {
+      a_array[i] = A->data() + (i % batchA) * strideA;
+      b_array[i] = B->data() + (i % batchB) * strideB;
+      c_array[i] = C->data() + i * strideC;
+    }
+
+    // the batch is split across the threads of the graph, one call per range of GEMMs
+    parallelFor(C, batchC, m * n * k / 16, [&](size_t begin, size_t end) {
+      const std::vector<MKL_INT> group_size(group_count, (MKL_INT)(end - begin)); // Group size specifies number of GEMM operations per group
+      cblas_sgemm_batch (CblasRowMajor,
+        &transa_arr[0],
+        &transb_arr[0],
+        &m_arr[0],
+        &n_arr[0],
+        &k_arr[0],
+        &alpha_arr[0],
+        &a_array[begin],
+        &lda_arr[0],
+        &b_array[begin],
+        &ldb_arr[0],
+        &beta_arr[0],
+        &c_array[begin],
+        &ldc_arr[0],
+        group_count,
+        &group_size[0]);
+    });
 #else
-  for(size_t i = 0; i < batchC; ++i) {
-    sgemm(transA,
-          transB,
-          (int)m,
-          (int)n,
-          (int)k,
-          alpha,
-          A->data() + (i % batchA) * strideA,
-          (int)lda,
-          B->data() + (i % batchB) * strideB,
-          (int)ldb,
-          beta,
-          C->data() + i * strideC,
-          (int)ldc);
-  }
+    parallelFor(C, batchC, m * n * k / 16, [&](size_t begin, size_t end) {
+      for(size_t i = begin; i < end; ++i) {
+        sgemm(transA,
+              transB,
+              (int)m,
+              (int)n,
+              (int)k,
+              alpha,
+              A->data() + (i % batchA) * strideA,
+              (int)lda,
+              B->data() + (i % batchB) * strideB,
+              (int)ldb,
+              beta,
+              C->data() + i * strideC,
+              (int)ldc);
+      }
+    });
+#endif
+  };
+
+  // With --autotune the faster of both is chosen per bucket of shapes. Otherwise small products are
+  // computed directly only without MKL, whose batched calls spread their overhead over the batch.
+  if(AutoTunerCache::instance().enabled() && m * n * k <= TUNED_GEMM) {
+    static AutoTuner tuner("cpu.ProdBatched", {"small", "blas"});
+    std::string key = "m" + std::to_string(AutoTuner::shapeBucket(m))
+                    + "n" + std::to_string(AutoTuner::shapeBucket(n))
+                    + "k" + std::to_string(AutoTuner::shapeBucket(k))
+                    + "b" + std::to_string(AutoTuner::shapeBucket(batchC))
+                    + " " + (transA ? "T" : "N") + (transB ? "T" : "N");
+    tuner.run(key, {small, blas});
+  } else {
+#if MKL_FOUND
+    blas();
+#else
+    if(m * n * k <= SMALL_GEMM)
+      small();
+    else
+      blas();
 #endif
+  }
 #else
   C; A; B; transA; transB; beta; scalar;
   ABORT("You need to compile with MKL in order to use the CPU version");
@@ -208,10 +410,6 @@ void CSRProd(marian::Tensor C,
              bool transS,
              bool swapOperands,
              float beta) {
-  C, S_values, S_indices, S_offsets, D;
-
-  // Note: The CPU implementation currently only implements what's needed for decoding.
-
   // interpret tensor dimensions as matrix dimensions
   const auto& shapeC = C->shape();
   const auto& shapeD = D->shape();
@@ -233,41 +431,71 @@ void CSRProd(marian::Tensor C,
   auto numOffsets = S_offsets->shape().elements() - 1; // -1 since last value is length
   ABORT_IF(numOffsets != rowsS, "Unexpected number of rows in CSR argument"); numOffsets;
   ABORT_IF(S_values->shape() != S_indices->shape(), "CSR values and indices must have the same size");
-  if (!transS && !swapOperands) {
-    // C = S * D, where D = CSR matrix
-    const auto* offsets = S_offsets->data<IndexType>();
-    const auto* indices = S_indices->data<IndexType>();
-    const auto* values  = S_values->data<float>();
-    const auto* dataD   = D->data<float>();
-    auto*       dataC   = C->data<float>();
-    ABORT_IF(beta != 0 && beta != 1, "cpu::CSRProd only supports beta = 0 or 1");
-    for (size_t i = 0; i < rowsC; i++) {
-      auto add = (beta == 1); // first element: overwrite or add according to beta; subsequent elements: add
+  ABORT_IF(C->type() != Type::float32 || D->type() != Type::float32 || S_values->type() != Type::float32,
+           "cpu::CSRProd is only implemented for float32");
+
+  const auto* offsets = S_offsets->data<IndexType>();
+  const auto* indices = S_indices->data<IndexType>();
+  const auto* values  = S_values->data<float>();
+  const auto* dataD   = D->data<float>();
+  auto*       dataC   = C->data<float>();
+
+  // C = beta * C, then the products of the non-zero values are added.
+  // The inner loops run over contiguous rows of C and D, which the compiler vectorizes.
+  if (beta == 0)
+    std::fill(dataC, dataC + rowsC * colsC, 0.f);
+  else if (beta != 1)
+    for (size_t i = 0; i < rowsC * colsC; i++)
+      dataC[i] *= beta;
+
+  if (!swapOperands && !transS) {
+    // C = S x D: row i of C is the sum of the rows of D selected by row i of S
+    for (size_t i = 0; i < rowsS; i++) {
+      auto* rowC = dataC + i * colsC;
       for (size_t kk = offsets[i]; kk < offsets[i + 1]; kk++) {
-        auto k = indices[kk];    // fetch the non-zero row
-        auto valS = values[kk]; // and the value from that row
-        // This code is written with the hope for good vectorization, and the hope
-        // that adding to memory will be done efficiently by the caching system.
-        if (valS == 1)
-          if (!add)
-            for (size_t j = 0; j < colsC; j++)
-              dataC[i * colsC/*==colsD*/ + j] = dataD[k * colsC/*==colsD*/ + j]; // this is a memcpy()
-          else
-            for (size_t j = 0; j < colsC; j++)
-              dataC[i * colsC/*==colsD*/ + j] += dataD[k * colsC/*==colsD*/ + j]; // this is a contiguous-vector addition
-        else
-          if (!add)
-            for (size_t j = 0; j < colsC; j++)
-              dataC[i * colsC/*==colsD*/ + j] = valS * dataD[k * colsC/*==colsD*/ + j];
-          else
-            for (size_t j = 0; j < colsC; j++)
-              dataC[i * colsC/*==colsD*/ + j] += valS * dataD[k * colsC/*==colsD*/ + j]; // notice the +=
-        add = true; // next iteration will add to existing result
+        const auto* rowD = dataD + indices[kk] * colsD;
+        auto valS = values[kk];
+        for (size_t j = 0; j < colsC; j++)
+          rowC[j] += valS * rowD[j];
+      }
+    }
+  } else if (!swapOperands && transS) {
+    // C = S^T x D: row i of D is added to the rows of C selected by row i of S
+    for (size_t i = 0; i < rowsS; i++) {
+      const auto* rowD = dataD + i * colsD;
+      for (size_t kk = offsets[i]; kk < offsets[i + 1]; kk++) {
+        auto* rowC = dataC + indices[kk] * colsC;
+        auto valS = values[kk];
+        for (size_t j = 0; j < colsC; j++)
+          rowC[j] += valS * rowD[j];
+      }
+    }
+  } else if (swapOperands && !transS) {
+    // C = D x S: for each row r, C[r,:] = sum_k D[r,k] S[k,:], skipping the zeros of D
+    for (size_t r = 0; r < rowsC; r++) {
+      const auto* rowD = dataD + r * colsD;
+      auto* rowC = dataC + r * colsC;
+      for (size_t k = 0; k < rowsS; k++) {
+        auto valD = rowD[k];
+        if (valD == 0)
+          continue;
+        for (size_t kk = offsets[k]; kk < offsets[k + 1]; kk++)
+          rowC[indices[kk]] += valD * values[kk];
+      }
+    }
+  } else {
+    // C = D x S^T: C[r,i] is the sparse dot product of row r of D with row i of S
+    for (size_t r = 0; r < rowsC; r++) {
+      const auto* rowD = dataD + r * colsD;
+      auto* rowC = dataC + r * colsC;
+      for (size_t i = 0; i < rowsS; i++) {
+        float sum = 0;
+        for (size_t kk = offsets[i]; kk < offsets[i + 1]; kk++)
+          sum += values[kk] * rowD[indices[kk]];
+        rowC[i] += sum;
       }
     }
   }
-  else
-    ABORT("CSRProd for transS={}, swapOperands={} is not yet implemented for CPU", transS, swapOperands);
 }
 
 }  // namespace cpu
@@ -12,9 +12,9 @@ inline void sgemm(bool transA,
                   int rows_b,
                   int width,
                   float alpha,
-                  float* a,
+                  const float* a,
                   int lda,
-                  float* b,
+                  const float* b,
                   int ldb,
                   float beta,
                   float* c,
@@ -0,0 +1,491 @@
+#include "tensors/cpu/softmax.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__GNUC__) && !defined(__CUDACC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SOFTMAX_RUNTIME_DISPATCH 1
+#endif
+
+#ifdef SOFTMAX_RUNTIME_DISPATCH
+
+// Everything up to the matching pop is compiled for AVX2, including exp256_ps
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include "3rd_party/avx_mathfun.h"
+
+namespace marian {
+namespace cpu {
+namespace avx2 {
+
+// all bits set in the first n lanes
+static inline __m256i tailMask(int n) {
+  return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+static inline float maxReduce(__m256 x) {
+  __m128 m = _mm_max_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+  return _mm_cvtss_f32(m);
+}
+
+static inline float sumReduce(__m256 x) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+// maximum of a row, the masked lanes of the tail do not count
+static inline __m256 rowMax(const float* in, int full, int cols, __m256i tail) {
+  __m256 maxs = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+  for(int i = 0; i < full; i += 8)
+    maxs = _mm256_max_ps(maxs, _mm256_loadu_ps(in + i));
+  if(full < cols)
+    maxs = _mm256_blendv_ps(maxs,
+                            _mm256_max_ps(maxs, _mm256_maskload_ps(in + full, tail)),
+                            _mm256_castsi256_ps(tail));
+  return _mm256_set1_ps(maxReduce(maxs));
+}
+
+static void softmax(float* out, const float* in, int cols) {
+  int full = cols - cols % 8;
+  __m256i tail = tailMask(cols - full);
+  __m256 max = rowMax(in, full, cols, tail);
+
+  __m256 sums = _mm256_setzero_ps();
+  for(int i = 0; i < full; i += 8) {
+    __m256 ex = exp256_ps(_mm256_sub_ps(_mm256_loadu_ps(in + i), max));
+    sums = _mm256_add_ps(sums, ex);
+    _mm256_storeu_ps(out + i, ex);
+  }
+  if(full < cols) {
+    __m256 ex = exp256_ps(_mm256_sub_ps(_mm256_maskload_ps(in + full, tail), max));
+    ex = _mm256_and_ps(ex, _mm256_castsi256_ps(tail));
+    sums = _mm256_add_ps(sums, ex);
+    _mm256_maskstore_ps(out + full, tail, ex);
+  }
+
+  __m256 sum = _mm256_set1_ps(sumReduce(sums));
+  for(int i = 0; i < full; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_loadu_ps(out + i), sum));
+  if(full < cols)
+    _mm256_maskstore_ps(out + full, tail, _mm256_div_ps(_mm256_maskload_ps(out + full, tail), sum));
+}
+
+static void logSoftmax(float* out, const float* in, int cols) {
+  int full = cols - cols % 8;
+  __m256i tail = tailMask(cols - full);
+  __m256 max = rowMax(in, full, cols, tail);
+
+  __m256 sums = _mm256_setzero_ps();
+  for(int i = 0; i < full; i += 8) {
+    __m256 sm = _mm256_sub_ps(_mm256_loadu_ps(in + i), max);
+    sums = _mm256_add_ps(sums, exp256_ps(sm));
+    _mm256_storeu_ps(out + i, sm);
+  }
+  if(full < cols) {
+    __m256 sm = _mm256_sub_ps(_mm256_maskload_ps(in + full, tail), max);
+    sums = _mm256_add_ps(sums, _mm256_and_ps(exp256_ps(sm), _mm256_castsi256_ps(tail)));
+    _mm256_maskstore_ps(out + full, tail, sm);
+  }
+
+  __m256 logSum = _mm256_set1_ps(std::log(sumReduce(sums)));
+  for(int i = 0; i < full; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_loadu_ps(out + i), logSum));
+  if(full < cols)
+    _mm256_maskstore_ps(out + full, tail, _mm256_sub_ps(_mm256_maskload_ps(out + full, tail), logSum));
+}
+
+static void softmaxGrad(float* grad, const float* adj, const float* val, int cols) {
+  int full = cols - cols % 8;
+  __m256i tail = tailMask(cols - full);
+
+  __m256 sums = _mm256_setzero_ps();
+  for(int i = 0; i < full; i += 8)
+    sums = _mm256_add_ps(sums, _mm256_mul_ps(_mm256_loadu_ps(val + i), _mm256_loadu_ps(adj + i)));
+  if(full < cols)
+    sums = _mm256_add_ps(sums, _mm256_mul_ps(_mm256_maskload_ps(val + full, tail), _mm256_maskload_ps(adj + full, tail)));
+
+  __m256 sum = _mm256_set1_ps(sumReduce(sums));
+  for(int i = 0; i < full; i += 8) {
+    __m256 d = _mm256_mul_ps(_mm256_loadu_ps(val + i), _mm256_sub_ps(_mm256_loadu_ps(adj + i), sum));
+    _mm256_storeu_ps(grad + i, _mm256_add_ps(_mm256_loadu_ps(grad + i), d));
+  }
+  if(full < cols) {
+    __m256 d = _mm256_mul_ps(_mm256_maskload_ps(val + full, tail), _mm256_sub_ps(_mm256_maskload_ps(adj + full, tail), sum));
+    _mm256_maskstore_ps(grad + full, tail, _mm256_add_ps(_mm256_maskload_ps(grad + full, tail), d));
+  }
+}
+
+static void logSoftmaxGrad(float* grad, const float* adj, const float* val, int cols) {
+  int full = cols - cols % 8;
+  __m256i tail = tailMask(cols - full);
+
+  __m256 sums = _mm256_setzero_ps();
+  for(int i = 0; i < full; i += 8)
+    sums = _mm256_add_ps(sums, _mm256_loadu_ps(adj + i));
+  if(full < cols)
+    sums = _mm256_add_ps(sums, _mm256_maskload_ps(adj + full, tail));
+
+  __m256 sum = _mm256_set1_ps(sumReduce(sums));
+  for(int i = 0; i < full; i += 8) {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(adj + i), _mm256_mul_ps(sum, exp256_ps(_mm256_loadu_ps(val + i))));
+    _mm256_storeu_ps(grad + i, _mm256_add_ps(_mm256_loadu_ps(grad + i), d));
+  }
+  if(full < cols) {
+    __m256 d = _mm256_sub_ps(_mm256_maskload_ps(adj + full, tail),
+                             _mm256_mul_ps(sum, exp256_ps(_mm256_maskload_ps(val + full, tail))));
+    _mm256_maskstore_ps(grad + full, tail, _mm256_add_ps(_mm256_maskload_ps(grad + full, tail), d));
+  }
+}
+
+}  // namespace avx2
+}  // namespace cpu
+}  // namespace marian
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+// Everything up to the matching pop is compiled for AVX512F, including exp512_ps
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// gcc 12.1 and 12.2 report the _mm512_undefined_* values of inlined AVX512 intrinsics as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#include "3rd_party/avx512_mathfun.h"
+
+namespace marian {
+namespace cpu {
+namespace avx512 {
+
+// the first n lanes
+static inline __mmask16 tailMask(int n) {
+  return (__mmask16)((1u << n) - 1);
+}
+
+// horizontal reductions by folding halves, quarters, then lanes within 128 bits
+static inline float maxReduce(__m512 x) {
+  x = _mm512_max_ps(x, _mm512_shuffle_f32x4(x, x, _MM_SHUFFLE(1, 0, 3, 2)));
+  x = _mm512_max_ps(x, _mm512_shuffle_f32x4(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+  x = _mm512_max_ps(x, _mm512_permute_ps(x, _MM_SHUFFLE(1, 0, 3, 2)));
+  x = _mm512_max_ps(x, _mm512_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm512_cvtss_f32(x);
+}
+
+static inline float sumReduce(__m512 x) {
+  x = _mm512_add_ps(x, _mm512_shuffle_f32x4(x, x, _MM_SHUFFLE(1, 0, 3, 2)));
+  x = _mm512_add_ps(x, _mm512_shuffle_f32x4(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+  x = _mm512_add_ps(x, _mm512_permute_ps(x, _MM_SHUFFLE(1, 0, 3, 2)));
+  x = _mm512_add_ps(x, _mm512_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm512_cvtss_f32(x);
+}
+
+// maximum of a row, the masked lanes of the tail do not count
+static inline __m512 rowMax(const float* in, int full, int cols, __mmask16 tail) {
+  __m512 maxs = _mm512_set1_ps(std::numeric_limits<float>::lowest());
+  for(int i = 0; i < full; i += 16)
+    maxs = _mm512_max_ps(maxs, _mm512_loadu_ps(in + i));
+  if(full < cols)
+    maxs = _mm512_mask_max_ps(maxs, tail, maxs, _mm512_maskz_loadu_ps(tail, in + full));
+  return _mm512_set1_ps(maxReduce(maxs));
+}
+
+static void softmax(float* out, const float* in, int cols) {
+  int full = cols - cols % 16;
+  __mmask16 tail = tailMask(cols - full);
+  __m512 max = rowMax(in, full, cols, tail);
+
+  __m512 sums = _mm512_setzero_ps();
+  for(int i = 0; i < full; i += 16) {
+    __m512 ex = exp512_ps(_mm512_sub_ps(_mm512_loadu_ps(in + i), max));
+    sums = _mm512_add_ps(sums, ex);
+    _mm512_storeu_ps(out + i, ex);
+  }
+  if(full < cols) {
+    __m512 ex = exp512_ps(_mm512_sub_ps(_mm512_maskz_loadu_ps(tail, in + full), max));
+    sums = _mm512_mask_add_ps(sums, tail, sums, ex);
+    _mm512_mask_storeu_ps(out + full, tail, ex);
+  }
+
+  __m512 sum = _mm512_set1_ps(sumReduce(sums));
+  for(int i = 0; i < full; i += 16)
+    _mm512_storeu_ps(out + i, _mm512_div_ps(_mm512_loadu_ps(out + i), sum));
+  if(full < cols)
+    _mm512_mask_storeu_ps(out + full, tail, _mm512_div_ps(_mm512_maskz_loadu_ps(tail, out + full), sum));
+}
+
+static void logSoftmax(float* out, const float* in, int cols) {
+  int full = cols - cols % 16;
+  __mmask16 tail = tailMask(cols - full);
+  __m512 max = rowMax(in, full, cols, tail);
+
+  __m512 sums = _mm512_setzero_ps();
+  for(int i = 0; i < full; i += 16) {
+    __m512 sm = _mm512_sub_ps(_mm512_loadu_ps(in + i), max);
+    sums = _mm512_add_ps(sums, exp512_ps(sm));
+    _mm512_storeu_ps(out + i, sm);
+  }
+  if(full < cols) {
+    __m512 sm = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, in + full), max);
+    sums = _mm512_mask_add_ps(sums, tail, sums, exp512_ps(sm));
+    _mm512_mask_storeu_ps(out + full, tail, sm);
+  }
+
+  __m512 logSum = _mm512_set1_ps(std::log(sumReduce(sums)));
+  for(int i = 0; i < full; i += 16)
+    _mm512_storeu_ps(out + i, _mm512_sub_ps(_mm512_loadu_ps(out + i), logSum));
+  if(full < cols)
+    _mm512_mask_storeu_ps(out + full, tail, _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, out + full), logSum));
+}
+
+static void softmaxGrad(float* grad, const float* adj, const float* val, int cols) {
+  int full = cols - cols % 16;
+  __mmask16 tail = tailMask(cols - full);
+
+  __m512 sums = _mm512_setzero_ps();
+  for(int i = 0; i < full; i += 16)
+    sums = _mm512_add_ps(sums, _mm512_mul_ps(_mm512_loadu_ps(val + i), _mm512_loadu_ps(adj + i)));
+  if(full < cols)
+    sums = _mm512_add_ps(sums, _mm512_mul_ps(_mm512_maskz_loadu_ps(tail, val + full), _mm512_maskz_loadu_ps(tail, adj + full)));
+
+  __m512 sum = _mm512_set1_ps(sumReduce(sums));
+  for(int i = 0; i < full; i += 16) {
+    __m512 d = _mm512_mul_ps(_mm512_loadu_ps(val + i), _mm512_sub_ps(_mm512_loadu_ps(adj + i), sum));
+    _mm512_storeu_ps(grad + i, _mm512_add_ps(_mm512_loadu_ps(grad + i), d));
+  }
+  if(full < cols) {
+    __m512 d = _mm512_mul_ps(_mm512_maskz_loadu_ps(tail, val + full), _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, adj + full), sum));
+    _mm512_mask_storeu_ps(grad + full, tail, _mm512_add_ps(_mm512_maskz_loadu_ps(tail, grad + full), d));
+  }
+}
+
+static void logSoftmaxGrad(float* grad, const float* adj, const float* val, int cols) {
+  int full = cols - cols % 16;
+  __mmask16 tail = tailMask(cols - full);
+
+  __m512 sums = _mm512_setzero_ps();
+  for(int i = 0; i < full; i += 16)
+    sums = _mm512_add_ps(sums, _mm512_loadu_ps(adj + i));
+  if(full < cols)
+    sums = _mm512_add_ps(sums, _mm512_maskz_loadu_ps(tail, adj + full));
+
+  __m512 sum = _mm512_set1_ps(sumReduce(sums));
+  for(int i = 0; i < full; i += 16) {
+    __m512 d = _mm512_sub_ps(_mm512_loadu_ps(adj + i), _mm512_mul_ps(sum, exp512_ps(_mm512_loadu_ps(val + i))));
+    _mm512_storeu_ps(grad + i, _mm512_add_ps(_mm512_loadu_ps(grad + i), d));
+  }
+  if(full < cols) {
+    __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, adj + full),
+                             _mm512_mul_ps(sum, exp512_ps(_mm512_maskz_loadu_ps(tail, val + full))));
+    _mm512_mask_storeu_ps(grad + full, tail, _mm512_add_ps(_mm512_maskz_loadu_ps(tail, grad + full), d));
+  }
+}
+
+}  // namespace avx512
+}  // namespace cpu
+}  // namespace marian
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+#endif  // SOFTMAX_RUNTIME_DISPATCH
+
+// NEON is part of ARMv8-A, so on aarch64 these kernels are always used
+#if defined(__aarch64__) && defined(__ARM_NEON) && !defined(__CUDACC__)
+#include <arm_neon.h>
+#include "3rd_party/neon_mathfun.h"
+#define SOFTMAX_NEON 1
+
+namespace marian {
+namespace cpu {
+namespace neon {
+
+// all bits set in the first n lanes
+static inline uint32x4_t tailMask(int n) {
+  static const uint32_t lanes[4] = {0, 1, 2, 3};
+  return vcltq_u32(vld1q_u32(lanes), vdupq_n_u32((uint32_t)n));
+}
+
+// the first n < 4 elements, the other lanes are 0
+static inline float32x4_t loadTail(const float* in, int n) {
+  float buffer[4] = {0.f, 0.f, 0.f, 0.f};
+  for(int i = 0; i < n; ++i)
+    buffer[i] = in[i];
+  return vld1q_f32(buffer);
+}
+
+static inline void storeTail(float* out, int n, float32x4_t x) {
+  float buffer[4];
+  vst1q_f32(buffer, x);
+  for(int i = 0; i < n; ++i)
+    out[i] = buffer[i];
+}
+
+static inline float32x4_t zeroTail(float32x4_t x, uint32x4_t tail) {
+  return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(x), tail));
+}
+
+// maximum of a row, the masked lanes of the tail do not count
+static inline float32x4_t rowMax(const float* in, int full, int cols, uint32x4_t tail) {
+  float32x4_t maxs = vdupq_n_f32(std::numeric_limits<float>::lowest());
+  for(int i = 0; i < full; i += 4)
+    maxs = vmaxq_f32(maxs, vld1q_f32(in + i));
+  if(full < cols)
+    maxs = vbslq_f32(tail, vmaxq_f32(maxs, loadTail(in + full, cols - full)), maxs);
+  return vdupq_n_f32(vmaxvq_f32(maxs));
+}
+
+static void softmax(float* out, const float* in, int cols) {
+  int full = cols - cols % 4;
+  uint32x4_t tail = tailMask(cols - full);
+  float32x4_t max = rowMax(in, full, cols, tail);
+
+  float32x4_t sums = vdupq_n_f32(0.f);
+  for(int i = 0; i < full; i += 4) {
+    float32x4_t ex = exp_ps(vsubq_f32(vld1q_f32(in + i), max));
+    sums = vaddq_f32(sums, ex);
+    vst1q_f32(out + i, ex);
+  }
+  if(full < cols) {
+    float32x4_t ex = zeroTail(exp_ps(vsubq_f32(loadTail(in + full, cols - full), max)), tail);
+    sums = vaddq_f32(sums, ex);
+    storeTail(out + full, cols - full, ex);
+  }
+
+  float32x4_t sum = vdupq_n_f32(vaddvq_f32(sums));
+  for(int i = 0; i < full; i += 4)
+    vst1q_f32(out + i, vdivq_f32(vld1q_f32(out + i), sum));
+  if(full < cols)
+    storeTail(out + full, cols - full, vdivq_f32(loadTail(out + full, cols - full), sum));
+}
+
+static void logSoftmax(float* out, const float* in, int cols) {
+  int full = cols - cols % 4;
+  uint32x4_t tail = tailMask(cols - full);
+  float32x4_t max = rowMax(in, full, cols, tail);
+
+  float32x4_t sums = vdupq_n_f32(0.f);
+  for(int i = 0; i < full; i += 4) {
+    float32x4_t sm = vsubq_f32(vld1q_f32(in + i), max);
+    sums = vaddq_f32(sums, exp_ps(sm));
+    vst1q_f32(out + i, sm);
+  }
+  if(full < cols) {
+    float32x4_t sm = vsubq_f32(loadTail(in + full, cols - full), max);
+    sums = vaddq_f32(sums, zeroTail(exp_ps(sm), tail));
+    storeTail(out + full, cols - full, sm);
+  }
+
+  float32x4_t logSum = vdupq_n_f32(std::log(vaddvq_f32(sums)));
+  for(int i = 0; i < full; i += 4)
+    vst1q_f32(out + i, vsubq_f32(vld1q_f32(out + i), logSum));
+  if(full < cols)
+    storeTail(out + full, cols - full, vsubq_f32(loadTail(out + full, cols - full), logSum));
+}
+
+static void softmaxGrad(float* grad, const float* adj, const float* val, int cols) {
+  int full = cols - cols % 4;
+
+  float32x4_t sums = vdupq_n_f32(0.f);
+  for(int i = 0; i < full; i += 4)
+    sums = vmlaq_f32(sums, vld1q_f32(val + i), vld1q_f32(adj + i));
+  if(full < cols)
+    sums = vmlaq_f32(sums, loadTail(val + full, cols - full), loadTail(adj + full, cols - full));
+
+  float32x4_t sum = vdupq_n_f32(vaddvq_f32(sums));
+  for(int i = 0; i < full; i += 4) {
+    float32x4_t d = vmulq_f32(vld1q_f32(val + i), vsubq_f32(vld1q_f32(adj + i), sum));
+    vst1q_f32(grad + i, vaddq_f32(vld1q_f32(grad + i), d));
+  }
+  if(full < cols) {
+    float32x4_t d = vmulq_f32(loadTail(val + full, cols - full), vsubq_f32(loadTail(adj + full, cols - full), sum));
+    storeTail(grad + full, cols - full, vaddq_f32(loadTail(grad + full, cols - full), d));
+  }
+}
+
+static void logSoftmaxGrad(float* grad, const float* adj, const float* val, int cols) {
+  int full = cols - cols % 4;
+
+  float32x4_t sums = vdupq_n_f32(0.f);
+  for(int i = 0; i < full; i += 4)
+    sums = vaddq_f32(sums, vld1q_f32(adj + i));
+  if(full < cols)
+    sums = vaddq_f32(sums, loadTail(adj + full, cols - full));
+
+  float32x4_t sum = vdupq_n_f32(vaddvq_f32(sums));
+  for(int i = 0; i < full; i += 4) {
+    float32x4_t d = vsubq_f32(vld1q_f32(adj + i), vmulq_f32(sum, exp_ps(vld1q_f32(val + i))));
+    vst1q_f32(grad + i, vaddq_f32(vld1q_f32(grad + i), d));
+  }
+  if(full < cols) {
+    float32x4_t d = vsubq_f32(loadTail(adj + full, cols - full),
+                              vmulq_f32(sum, exp_ps(loadTail(val + full, cols - full))));
+    storeTail(grad + full, cols - full, vaddq_f32(loadTail(grad + full, cols - full), d));
+  }
+}
+
+}  // namespace neon
+}  // namespace cpu
+}  // namespace marian
+
+#endif  // aarch64 NEON
+
+namespace marian {
+namespace cpu {
+
+// the variants supported by the CPU we are running on, widest first
+static std::vector<const SoftmaxKernels*> getSupportedSoftmaxKernels() {
+  std::vector<const SoftmaxKernels*> supported;
+#ifdef SOFTMAX_RUNTIME_DISPATCH
+  static const SoftmaxKernels avx512Kernels
+      = {"AVX512", avx512::softmax, avx512::logSoftmax, avx512::softmaxGrad, avx512::logSoftmaxGrad};
+  static const SoftmaxKernels avx2Kernels
+      = {"AVX2", avx2::softmax, avx2::logSoftmax, avx2::softmaxGrad, avx2::logSoftmaxGrad};
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    supported.push_back(&avx512Kernels);
+  if(__builtin_cpu_supports("avx2"))
+    supported.push_back(&avx2Kernels);
+#endif
+#ifdef SOFTMAX_NEON
+  static const SoftmaxKernels neonKernels
+      = {"NEON", neon::softmax, neon::logSoftmax, neon::softmaxGrad, neon::logSoftmaxGrad};
+  supported.push_back(&neonKernels);
+#endif
+  return supported;
+}
+
+const std::vector<const SoftmaxKernels*>& supportedSoftmaxKernels() {
+  static const std::vector<const SoftmaxKernels*> supported = getSupportedSoftmaxKernels();
+  return supported;
+}
+
+const SoftmaxKernels* softmaxKernels() {
+  const auto& supported = supportedSoftmaxKernels();
+  return supported.empty() ? nullptr : supported.front();
+}
+
+}  // namespace cpu
+}  // namespace marian
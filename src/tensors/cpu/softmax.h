@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+// Row kernels of Softmax, LogSoftmax and their gradients over `cols` contiguous floats. There are
+// AVX512 and AVX2 variants, which are compiled with function-level target attributes and chosen at
+// runtime like intgemm, so that a binary built for an older architecture still runs at full speed,
+// and a NEON variant on aarch64.
+// Rows of any length are handled, the tail of a row with masked loads and stores.
+struct SoftmaxKernels {
+  std::string name; // instruction set of the kernels
+  void (*softmax)(float* out, const float* in, int cols);
+  void (*logSoftmax)(float* out, const float* in, int cols);
+  void (*softmaxGrad)(float* grad, const float* adj, const float* val, int cols);    // grad += val * (adj - sum(val * adj))
+  void (*logSoftmaxGrad)(float* grad, const float* adj, const float* val, int cols); // grad += adj - sum(adj) * exp(val)
+};
+
+// The kernels for the CPU we are running on, nullptr if it supports neither AVX512, AVX2 nor NEON or
+// runtime dispatch is not available for this compiler. Then the portable templated kernels of
+// tensor_operators.cpp are used.
+const SoftmaxKernels* softmaxKernels();
+
+// All variants the CPU supports, widest first as chosen by softmaxKernels(), e.g. for comparing them
+const std::vector<const SoftmaxKernels*>& supportedSoftmaxKernels();
+
+}  // namespace cpu
+}  // namespace marian
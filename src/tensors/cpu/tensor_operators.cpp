@@ -5,6 +5,9 @@
 
 #include "tensors/tensor_operators.h"
 #include "tensors/cpu/backend.h"
+#include "tensors/cpu/float16.h"
+#include "tensors/cpu/softmax.h"
+#include "tensors/cpu/transpose.h"
 #include "tensors/allocator.h"
 
 #include "functional/approx.h"
@@ -16,6 +19,8 @@
 #include <mkl.h>
 #endif
 
+#include <cstring>
+
 namespace marian {
 
 namespace cpu {
@@ -48,6 +53,8 @@ void CopyCastFrom(Tensor out, const T* in, int length) {
     CopyCastTo(out->data<float>(), in, length);
   } else if(out->type() == Type::float16) {
     CopyCastTo(out->data<float16>(), in, length);
+  } else if(out->type() == Type::bfloat16) {
+    CopyCastTo(out->data<bfloat16>(), in, length);
   } else {
     ABORT("CopyCastTo to type {} not implemented", out->type());
   }
@@ -59,6 +66,8 @@ void CopyCast(Tensor out, const Tensor in) {
     CopyCastFrom(out, in->data<float>(), (int)in->size());
   } else if(in->type() == Type::float16) {
     CopyCastFrom(out, in->data<float16>(), (int)in->size());
+  } else if(in->type() == Type::bfloat16) {
+    CopyCastFrom(out, in->data<bfloat16>(), (int)in->size());
   } else if(in->type() == Type::uint32) {
     CopyCastFrom(out, in->data<uint32_t>(), (int)in->size());
   } else {
@@ -194,198 +203,31 @@ void Deconcatenate(std::vector<Tensor>& outputs, const Tensor in, int ax) {
     SplitCont(outputs, in, ax);
 }
 
-template <bool add>
-void Transpose0213(Tensor out, Tensor in) {
+void Transpose10(Tensor out, const Tensor in) {
   int cols = in->shape()[-1];
-  int rows = in->shape().elements() / in->shape()[-1];
-
-  int r1 = in->shape()[-2];
-  int r2 = in->shape()[-3];
-  int rest = rows / (r1 * r2);
-
-  for(int k = 0; k < rest; ++k) {
-    int shift = k * r1 * r2;
-    for(int j = 0; j < r1 * r2; ++j) {
-      int src = j + shift;
-      int dst = j / r1 + (j % r1) * r2 + shift;
-
-      const float* inRow = in->data() + src * cols;
-      float* outRow = out->data() + dst * cols;
-
-      if(!add) {
-        // mostly for fast forward computation
-        std::copy(inRow, inRow + cols, outRow);
-      } else {
-        for(int i = 0; i < cols; ++i) {
-          outRow[i] += inRow[i];
-        }
-      }
-    }
-  }
-}
-
-// This function is called only when MKL is available.
-#if MKL_FOUND
-// Given a 4D array, transpose (swap) the initial 3 dimensions while keeping the last dimension.
-// e.g. 1234 --> 2134, 1234 --> 3214 (4 is always kept).
-// This is an optimized version for swapping first 3 dimensions
-// assuming the last dimension is large enough to get benefits from vectorized copy.
-//
-// @param out output tensor
-// @param in input tensor
-// @param vAxis target (transposed) axes of each given axes
-template <bool add>
-void TransposeFirst3In4(Tensor out, Tensor in, const std::vector<int>& vAxis) {
-  ABORT_IF(vAxis.size() != 4, "This function handles only 4D arrays.");
-  int innermost = in->shape()[-1];
-
-  int l1 = in->shape()[vAxis[0]];
-  int l2 = in->shape()[vAxis[1]];
-  int l3 = in->shape()[vAxis[2]];
-
-  // find the mapping between the transposed output dimensional indices (oi, oj, ok)
-  // and original input dimensional indices (i, j, k)
-#pragma omp parallel for
-  for(int k = 0; k < l1; ++k) {
-    int shift = k * l2 * l3;
-    for(int j = 0; j < l2; ++j) {
-      for(int i = 0; i < l3; ++i) {
-        int oi, oj, ok;
-        if(vAxis[0] == 0) {
-          if(vAxis[1] == 1) {
-            oi = i; oj = j; ok = k;
-          } else {
-            oi = j; oj = i; ok = k;
-          }
-        } else if(vAxis[0] == 1) {
-          if(vAxis[1] == 0) {
-            oi = i; oj = k; ok = j;
-          } else {
-            oi = j; oj = k; ok = i;
-          }
-        } else {
-          if(vAxis[1] == 0) {
-            oi = k; oj = i; ok = j;
-          } else {
-            oi = k; oj = j; ok = i;
-          }
-        }
-        int src = ok * in->shape()[1] * in->shape()[2] + oj * in->shape()[2] + oi;
-        int dst = l3 * j + shift + i;
-
-        const float* inRow = in->data() + src * innermost;
-        float* outRow = out->data() + dst * innermost;
-
-        if(!add) {
-          mkl_somatcopy('R', 'N', 1, innermost, 1.0f, inRow, innermost, outRow, innermost);
-        } else {
-          for(int ii = 0; ii < innermost; ++ii) {
-            outRow[ii] += inRow[ii];
-          }
-        }
-      }
-    }
-  }
+  cpu::transpose(out->data(), in->data(), {(int)in->shape().elements() / cols, cols}, {1, 0}, /*add=*/false, out);
 }
-#endif  // MKL_FOUND
 
-inline void transpose4x4_SSE(const float* A,
-                             float* B,
-                             const int lda,
-                             const int ldb) {
-  __m128 row1 = _mm_load_ps(&A[0 * lda]);
-  __m128 row2 = _mm_load_ps(&A[1 * lda]);
-  __m128 row3 = _mm_load_ps(&A[2 * lda]);
-  __m128 row4 = _mm_load_ps(&A[3 * lda]);
-  _MM_TRANSPOSE4_PS(row1, row2, row3, row4);
-  _mm_store_ps(&B[0 * ldb], row1);
-  _mm_store_ps(&B[1 * ldb], row2);
-  _mm_store_ps(&B[2 * ldb], row3);
-  _mm_store_ps(&B[3 * ldb], row4);
-}
-
-// from
-// https://stackoverflow.com/questions/16737298/what-is-the-fastest-way-to-transpose-a-matrix-in-c
-#define ROUND_UP(x, s) (((x) + ((s)-1)) & -(s))
-
-void Transpose10(Tensor out, const Tensor in) {
-  const float* A = in->data();
-  float* B = out->data();
-
-  const int n = in->shape().elements() / in->shape()[-1];
-  const int m = in->shape()[-1];
-
-  const int block_size = 16;
-  int lda = ROUND_UP(m, block_size);
-  int ldb = ROUND_UP(n, block_size);
-
-  for(int i = 0; i < n; i += block_size) {
-    for(int j = 0; j < m; j += block_size) {
-      int max_i2 = i + block_size < n ? i + block_size : n;
-      int max_j2 = j + block_size < m ? j + block_size : m;
-      for(int i2 = i; i2 < max_i2; i2 += 4) {
-        for(int j2 = j; j2 < max_j2; j2 += 4) {
-          transpose4x4_SSE(&A[i2 * lda + j2], &B[j2 * ldb + i2], lda, ldb);
-        }
-      }
-    }
-  }
-}
-
-// @TODO: optimize this, currently it's quite horrible
-template <bool add>
-void TransposeGeneric(Tensor out, Tensor in, const std::vector<int>& vAxis) {
-  functional::Array<int, functional::Shape::size()> permute;
-  int diff = int(functional::Shape::size() - vAxis.size());
-  for(int i = 0; i < permute.size(); ++i)
-    if(i < diff)
-      permute[i] = i;
-    else
-      permute[i] = vAxis[i - diff] + diff;
-
-  int length = out->shape().elements();
-
-  constexpr size_t N = functional::Shape::size();
-  functional::Array<int, N> oDims;
-  functional::Array<int, N> pDims;
-  functional::Tensor<float> gOut = out;
-  functional::Tensor<float> gIn = in;
-
-  for(int index = 0; index < length; ++index) {
-    gOut.shape().dims(index, oDims);
-    for(size_t i = 0; i < N; ++i)
-      pDims[permute[i]] = oDims[i];
-
-    // @TODO: where does this change come from?
-    int inIndex = gIn.shape().index(pDims);
-
-    // @TODO: use internal conversion instead of raw indices
-    if(add)
-      gOut.data()[index] += gIn.data()[inIndex];
-    else
-      gOut.data()[index] = gIn.data()[inIndex];
-  }
+static void Transpose(Tensor out, Tensor in, const std::vector<int>& vAxis, bool add) {
+  // axes that vAxis does not cover are leading ones and stay in place
+  int diff = (int)in->shape().size() - (int)vAxis.size();
+  ABORT_IF(diff < 0, "Transposition of a tensor with {} dimensions by {} axes", in->shape().size(), vAxis.size());
+  std::vector<int> dims, axes;
+  for(int i = 0; i < (int)in->shape().size(); ++i)
+    dims.push_back(in->shape()[i]);
+  for(int i = 0; i < diff; ++i)
+    axes.push_back(i);
+  for(auto axis : vAxis)
+    axes.push_back(axis + diff);
+  cpu::transpose(out->data(), in->data(), dims, axes, add, out);
 }
 
 void TransposeND(Tensor out, Tensor in, const std::vector<int>& vAxis) {
-  if(vAxis == std::vector<int>({0, 2, 1, 3}))
-    Transpose0213<false>(out, in);
-#if MKL_FOUND
-  else if(vAxis.size() == 4 && vAxis[3] == 3)
-    TransposeFirst3In4<false>(out, in, vAxis);
-#endif  // MKL_FOUND
-  else if(vAxis == std::vector<int>({1, 0}) && in->shape()[-1] % 16 == 0
-          && in->shape()[-2] % 16 == 0)
-    Transpose10(out, in);
-  else
-    TransposeGeneric<false>(out, in, vAxis);
+  cpu::Transpose(out, in, vAxis, /*add=*/false);
 }
 
 void TransposeNDGrad(Tensor out, Tensor in, const std::vector<int>& vAxis) {
-  if(vAxis == std::vector<int>({0, 2, 1, 3}))
-    Transpose0213<true>(out, in);
-  else
-    TransposeGeneric<true>(out, in, vAxis);
+  cpu::Transpose(out, in, vAxis, /*add=*/true);
 }
 
 template <typename ElementType>
@@ -400,39 +242,60 @@ void Softmax(Tensor out, Tensor in) {
   int rows = fout.shape().elements() / fout.shape().back();
   int cols = fout.shape().back();
 
-  for(int j = 0; j < rows; ++j) {
-    ElementType* so = pOut + j * cols;
-    const ElementType* sp = pIn + j * cols;
+  parallelFor(out, rows, out->shape()[-1], [&](size_t begin, size_t end) {
+    for(int j = (int)begin; j < (int)end; ++j) {
+      ElementType* so = pOut + j * cols;
+      const ElementType* sp = pIn + j * cols;
 
-    ElementType max = sp[0];
-    for(int i = 1; i < cols; ++i) {
-      max = Ops<ElementType>::max(max, sp[i]);
-    }
+      ElementType max = sp[0];
+      for(int i = 1; i < cols; ++i) {
+        max = Ops<ElementType>::max(max, sp[i]);
+      }
 
-    // if ElementType is a complex type, e.g. float32x8, find the max of these 8 values
-    typename Ops<ElementType>::Single maxs = Ops<ElementType>::maxReduce(max);
+      // if ElementType is a complex type, e.g. float32x8, find the max of these 8 values
+      typename Ops<ElementType>::Single maxs = Ops<ElementType>::maxReduce(max);
 
-    ElementType sum = 0.f;
-    for(int i = 0; i < cols; ++i) {
-      ElementType ex = Ops<ElementType>::exp(Ops<ElementType>::sub(sp[i], maxs));
-      sum = Ops<ElementType>::add(sum, ex);
-      so[i] = ex;
-    }
+      ElementType sum = 0.f;
+      for(int i = 0; i < cols; ++i) {
+        ElementType ex = Ops<ElementType>::exp(Ops<ElementType>::sub(sp[i], maxs));
+        sum = Ops<ElementType>::add(sum, ex);
+        so[i] = ex;
+      }
 
-    // if ElementType is a complex type, e.g. float32x8, sum these 8 values
-    typename Ops<ElementType>::Single sums = Ops<ElementType>::sumReduce(sum);
+      // if ElementType is a complex type, e.g. float32x8, sum these 8 values
+      typename Ops<ElementType>::Single sums = Ops<ElementType>::sumReduce(sum);
 
-    for(int i = 0; i < cols; ++i) {
-      so[i] = Ops<ElementType>::div(so[i], sums);
+      for(int i = 0; i < cols; ++i) {
+        so[i] = Ops<ElementType>::div(so[i], sums);
+      }
     }
-  }
+  });
 }
 
 
+// Calls row(offset, cols) with the offset of the first element of every row of out, split across the
+// worker pool
+template <class RowFunction>
+static void forEachRow(Tensor out, const RowFunction& row) {
+  int cols = out->shape()[-1];
+  int rows = out->shape().elements() / cols;
+  parallelFor(out, rows, cols, [&](size_t begin, size_t end) {
+    for(int j = (int)begin; j < (int)end; ++j)
+      row((size_t)j * cols, cols);
+  });
+}
+
 void Softmax(Tensor out, Tensor in) {
   matchOrAbort<float>(out->type());
   matchOrAbort<float>(in->type());
 
+  if(auto kernels = softmaxKernels()) {
+    float* pOut = out->data();
+    const float* pIn = in->data();
+    forEachRow(out, [&](size_t offset, int n) { kernels->softmax(pOut + offset, pIn + offset, n); });
+    return;
+  }
+
 #ifdef __AVX__
   if(out->shape()[-1] % 8 == 0) {
     Softmax<float32x8>(out, in);
@@ -460,35 +323,44 @@ void LogSoftmax(Tensor out, Tensor in) {
   int rows = fout.shape().elements() / fout.shape().back();
   int cols = fout.shape().back();
 
-  for(int j = 0; j < rows; ++j) {
-    ElementType* so = pOut + j * cols;
-    const ElementType* sp = pIn + j * cols;
+  parallelFor(out, rows, out->shape()[-1], [&](size_t begin, size_t end) {
+    for(int j = (int)begin; j < (int)end; ++j) {
+      ElementType* so = pOut + j * cols;
+      const ElementType* sp = pIn + j * cols;
 
-    ElementType max = sp[0];
-    for(int i = 1; i < cols; ++i) {
-      max = Ops<ElementType>::max(max, sp[i]);
-    }
-    typename Ops<ElementType>::Single maxs = Ops<ElementType>::maxReduce(max); // global maximum
+      ElementType max = sp[0];
+      for(int i = 1; i < cols; ++i) {
+        max = Ops<ElementType>::max(max, sp[i]);
+      }
+      typename Ops<ElementType>::Single maxs = Ops<ElementType>::maxReduce(max); // global maximum
 
-    ElementType sum = 0.f;
-    for(int i = 0; i < cols; ++i) {
-      ElementType sm = Ops<ElementType>::sub(sp[i], maxs);
-      sum = Ops<ElementType>::add(sum, Ops<ElementType>::exp(sm));
-      so[i] = sm;
-    }
-    typename Ops<ElementType>::Single sums = Ops<ElementType>::sumReduce(sum); // global sum
+      ElementType sum = 0.f;
+      for(int i = 0; i < cols; ++i) {
+        ElementType sm = Ops<ElementType>::sub(sp[i], maxs);
+        sum = Ops<ElementType>::add(sum, Ops<ElementType>::exp(sm));
+        so[i] = sm;
+      }
+      typename Ops<ElementType>::Single sums = Ops<ElementType>::sumReduce(sum); // global sum
 
-    ElementType logSum = Ops<ElementType>::log(sums); // broadcasts Single to ElementType
-    for(int i = 0; i < cols; ++i) {
-      so[i] = Ops<ElementType>::sub(so[i], logSum);
+      ElementType logSum = Ops<ElementType>::log(sums); // broadcasts Single to ElementType
+      for(int i = 0; i < cols; ++i) {
+        so[i] = Ops<ElementType>::sub(so[i], logSum);
+      }
     }
-  }
+  });
 }
 
 void LogSoftmax(Tensor out, Tensor in) {
   matchOrAbort<float>(out->type());
   matchOrAbort<float>(in->type());
 
+  if(auto kernels = softmaxKernels()) {
+    float* pOut = out->data();
+    const float* pIn = in->data();
+    forEachRow(out, [&](size_t offset, int n) { kernels->logSoftmax(pOut + offset, pIn + offset, n); });
+    return;
+  }
+
 #ifdef __AVX__
   if(out->shape()[-1] % 8 == 0) {
     LogSoftmax<float32x8>(out, in);
@@ -511,6 +383,11 @@ void SoftmaxGrad(Tensor grad_, Tensor adj_, Tensor val_) {
   const float* adj = adj_->data();
   const float* val = val_->data();
 
+  if(auto kernels = softmaxKernels()) {
+    forEachRow(grad_, [&](size_t offset, int n) { kernels->softmaxGrad(grad + offset, adj + offset, val + offset, n); });
+    return;
+  }
+
   for(int j = 0; j < rows; ++j) {
     float* gradRow = grad + j * cols;
     const float* adjRow = adj + j * cols;
@@ -535,6 +412,11 @@ void LogSoftmaxGrad(Tensor grad_, Tensor adj_, Tensor val_) {
   const float* adj = adj_->data();
   const float* val = val_->data();
 
+  if(auto kernels = softmaxKernels()) {
+    forEachRow(grad_, [&](size_t offset, int n) { kernels->logSoftmaxGrad(grad + offset, adj + offset, val + offset, n); });
+    return;
+  }
+
   for(int j = 0; j < rows; ++j) {
     float* gradRow = grad + j * cols;
     const float* adjRow = adj + j * cols;
@@ -560,23 +442,54 @@ void CopyRows(Tensor out_,
   size_t cols = in_->shape()[-1];
   size_t rows = indices->size();
 
+  if(isRowQuantized(in_->type())) {
+    ABORT_IF(out_->type() != Type::float32, "Quantized rows cannot be copied into {}", out_->type());
+    float* out = out_->data();
+    const int8_t* in = in_->data<int8_t>();
+    const char* scales = in_->data<char>() + in_->shape().elements(); // not aligned to floats
+    parallelFor(out_, rows, cols, [&](size_t begin, size_t end) {
+      for(size_t j = begin; j < end; ++j) {
+        size_t src = (size_t)indices->data<IndexType>()[j];
+        float scale;
+        std::memcpy(&scale, scales + src * sizeof(float), sizeof(float));
+        const int8_t* rowIn = in + src * cols;
+        float* rowOut = out + j * cols;
+        for(size_t i = 0; i < cols; ++i)
+          rowOut[i] = scale * rowIn[i];
+      }
+    });
+    return;
+  }
+
+  // rows of float16 weights, see --cpu-float16-weights
+  if(in_->type() == Type::float16 && out_->type() == Type::float32) {
+    float* out = out_->data();
+    const float16* in = in_->data<float16>();
+    parallelFor(out_, rows, cols, [&](size_t begin, size_t end) {
+      for(size_t j = begin; j < end; ++j)
+        float16ToFloat32(out + j * cols, in + (size_t)indices->data<IndexType>()[j] * cols, cols);
+    });
+    return;
+  }
+
   // note: may also be applied to IndexType; works by luck. Fix with fp16
   float* out = out_->data();
   const float* in = in_->data();
 
-#pragma omp parallel for
-  for(size_t j = 0; j < rows; ++j) {
-    size_t dst = j;
+  parallelFor(out_, rows, cols, [&](size_t begin, size_t end) {
+    for(size_t j = begin; j < end; ++j) {
+      size_t dst = j;
 
-    // @TODO: consider moving type checking to this function
-    // instead of matchOrAbort above
-    size_t src = (size_t)indices->data<IndexType>()[j];
+      // @TODO: consider moving type checking to this function
+      // instead of matchOrAbort above
+      size_t src = (size_t)indices->data<IndexType>()[j];
 
-    float* rowOut = out + dst * cols;
-    const float* rowIn = in + src * cols;
+      float* rowOut = out + dst * cols;
+      const float* rowIn = in + src * cols;
 
-    std::copy(rowIn, rowIn + cols, rowOut);
-  }
+      std::copy(rowIn, rowIn + cols, rowOut);
+    }
+  });
 }
 
 void PasteRows(Tensor out_,
@@ -590,18 +503,22 @@ void PasteRows(Tensor out_,
 
   float* out = out_->data();
   const float* in = in_->data();
+  const IndexType* idx = indices->data<IndexType>();
 
-  for(size_t j = 0; j < rows; ++j) {
-    size_t dst = indices->data<IndexType>()[j];  // not a permutation - may alias, unlike PasteCols
-    size_t src = j;
+  // the indices may alias, unlike PasteCols, hence the threads split the columns instead of the rows
+  parallelFor(out_, cols, rows, [&](size_t begin, size_t end) {
+    for(size_t j = 0; j < rows; ++j) {
+      size_t dst = idx[j];
+      size_t src = j;
 
-    float* rowOut = out + dst * cols;
-    const float* rowIn = in + src * cols;
+      float* rowOut = out + dst * cols;
+      const float* rowIn = in + src * cols;
 
-    for(size_t i = 0; i < cols; ++i) {
-      rowOut[i] += rowIn[i];
+      for(size_t i = begin; i < end; ++i) {
+        rowOut[i] += rowIn[i];
+      }
     }
-  }
+  });
 }
 
 void CopyCols(Tensor out_,
@@ -615,6 +532,19 @@ void CopyCols(Tensor out_,
   size_t colsOut = indices->size();
 
   float* out = out_->data();
+
+  if(in_->type() == Type::float16 && out_->type() == Type::float32) {
+    const float16* in = in_->data<float16>();
+#pragma omp parallel for
+    for(size_t j = 0; j < rows; ++j) {
+      const float16* rowIn = in + j * colsIn;
+      float* rowOut = out + j * colsOut;
+      for(size_t i = 0; i < colsOut; ++i)
+        rowOut[i] = (float)rowIn[indices->data<IndexType>()[i]];
+    }
+    return;
+  }
+
   const float* in = in_->data();
 
 #pragma omp parallel for
@@ -689,6 +619,28 @@ void SelectAxis2(Tensor out,
 }
 #endif
 
+// If the indices only vary along the selected axis, e.g. for index_select() in DecoderState::select()
+// or embedding lookups of more than two dimensions, Select and Insert copy contiguous blocks
+// [outer, axis, inner] of all axes behind the selected one instead of computing the coordinates of
+// every element. Returns false if the indices are broadcast differently, e.g. for gather().
+static bool blockLayout(const Shape& outShape, const Shape& inShape, const Shape& idxShape, int axis,
+                        size_t& outer, size_t& outDim, size_t& inDim, size_t& inner) {
+  axis = outShape.axis(axis);
+  if(idxShape.size() != outShape.size() || idxShape[axis] != outShape[axis])
+    return false;
+  outer = inner = 1;
+  for(int i = 0; i < outShape.size(); ++i) {
+    if(i == axis)
+      continue;
+    if(idxShape[i] != 1 || outShape[i] != inShape[i])
+      return false;
+    (i < axis ? outer : inner) *= outShape[i];
+  }
+  outDim = outShape[axis];
+  inDim = inShape[axis];
+  return true;
+}
+
 void Select(Tensor out,
             const Tensor in,
             const Tensor indices,
@@ -696,6 +648,21 @@ void Select(Tensor out,
 
   matchOrAbort<IndexType>(indices->type());
 
+  size_t outer, outDim, inDim, inner;
+  if(blockLayout(out->shape(), in->shape(), indices->shape(), axis, outer, outDim, inDim, inner)) {
+    const IndexType* idx = indices->data<IndexType>();
+    size_t bytes = inner * sizeOf(out->type());
+    char* outData = out->data<char>();
+    const char* inData = in->data<char>();
+    parallelFor(out, outer * outDim, inner, [&](size_t begin, size_t end) {
+      for(size_t j = begin; j < end; ++j) {
+        size_t o = j / outDim, i = j % outDim;
+        std::memcpy(outData + j * bytes, inData + (o * inDim + idx[i]) * bytes, bytes);
+      }
+    });
+    return;
+  }
+
   // @TODO: make this efficient
   functional::Shape outShape = out->shape();
   functional::Shape inShape  = in->shape();
@@ -726,6 +693,25 @@ void Insert(Tensor out,
 
   matchOrAbort<IndexType>(indices->type());
 
+  size_t outer, outDim, inDim, inner;
+  if(blockLayout(in->shape(), out->shape(), indices->shape(), axis, outer, inDim, outDim, inner)) {
+    // the indices may repeat within a block but not across blocks
+    const IndexType* idx = indices->data<IndexType>();
+    float* outData = out->data();
+    const float* inData = in->data();
+    parallelFor(out, outer, inDim * inner, [&](size_t begin, size_t end) {
+      for(size_t o = begin; o < end; ++o) {
+        for(size_t i = 0; i < inDim; ++i) {
+          float* rowOut = outData + (o * outDim + idx[i]) * inner;
+          const float* rowIn = inData + (o * inDim + i) * inner;
+          for(size_t k = 0; k < inner; ++k)
+            rowOut[k] += rowIn[k];
+        }
+      }
+    });
+    return;
+  }
+
   // @TODO: make this efficient
   functional::Shape outShape = out->shape();
   functional::Shape inShape  = in->shape();
@@ -744,48 +730,70 @@ void Insert(Tensor out,
   }
 }
 
-void GRUFastForward(Tensor out_, std::vector<Tensor> inputs, bool final) {
+template <typename FType>
+void GRUFastForwardTyped(Tensor out_, const std::vector<Tensor>& inputs, bool final) {
   int rows = out_->shape().elements() / out_->shape().back();
-  int cols = out_->shape().back();
 
-  float* out = out_->data();
+  int fVecSize = sizeof(FType) / sizeof(float);
+  int cols = out_->shape().back() / fVecSize;
 
-  const float* state = inputs[0]->data();
-  const float* xW = inputs[1]->data();
-  const float* sU = inputs[2]->data();
-  const float* b = inputs[3]->data();
+  FType* out = out_->data<FType>();
+
+  const FType* state = inputs[0]->data<FType>();
+  const FType* xW = inputs[1]->data<FType>();
+  const FType* sU = inputs[2]->data<FType>();
+  const FType* b = inputs[3]->data<FType>();
   const float* mask = inputs.size() > 4 ? inputs[4]->data() : nullptr;
 
+  using fop = functional::Ops<FType>;
+
 #pragma omp parallel for
   for(int j = 0; j < rows; ++j) {
     float m = !mask || mask[j];
-    float* rowOut = out + j * cols;
-    const float* rowState = state + j * cols;
+    FType* rowOut = out + j * cols;
+    const FType* rowState = state + j * cols;
 
-    const float* xWrow = xW + j * cols * 3;
-    const float* sUrow = sU + j * cols * 3;
+    const FType* xWrow = xW + j * cols * 3;
+    const FType* sUrow = sU + j * cols * 3;
 
-#pragma omp simd
     for(int i = 0; i < cols; ++i) {
-      float r = functional::Ops<float>::sigmoid(xWrow[i] + sUrow[i] + b[i]);
+      FType r = fop::sigmoid(fop::add(fop::add(xWrow[i], sUrow[i]), b[i]));
 
       int k = i + cols;
 
-      float z = functional::Ops<float>::sigmoid(xWrow[k] + sUrow[k] + b[k]);
+      FType z = fop::sigmoid(fop::add(fop::add(xWrow[k], sUrow[k]), b[k]));
 
       int l = i + 2 * cols;
-      float h;
+      FType h;
       if(final)
-        h = std::tanh(xWrow[l] + (sUrow[l] + b[l]) * r);
+        h = fop::tanh(fop::add(xWrow[l], fop::mul(fop::add(sUrow[l], b[l]), r)));
       else
-        h = std::tanh(xWrow[l] + sUrow[l] * r + b[l]);
+        h = fop::tanh(fop::add(fop::add(xWrow[l], fop::mul(sUrow[l], r)), b[l]));
 
-      float o = (1.0f - z) * h + z * rowState[i];
-      rowOut[i] = m * o + (1 - m) * rowState[i];
+      FType o = fop::add(fop::mul(fop::sub(1.f, z), h), fop::mul(z, rowState[i]));
+      rowOut[i] = fop::add(fop::mul(m, o), fop::mul(fop::sub(1.f, m), rowState[i]));
     }
   }
 }
 
+void GRUFastForward(Tensor out_, std::vector<Tensor> inputs, bool final) {
+  int cols = out_->shape().back();
+#ifdef __AVX512F__
+  if(cols % 16 == 0)
+    GRUFastForwardTyped<float32x16>(out_, inputs, final);
+  else
+#endif
+#ifdef __AVX__
+  if(cols % 8 == 0)
+    GRUFastForwardTyped<float32x8>(out_, inputs, final);
+  else
+#endif
+  if(cols % 4 == 0)
+    GRUFastForwardTyped<float32x4>(out_, inputs, final);
+  else
+    GRUFastForwardTyped<float>(out_, inputs, final);
+}
+
 void GRUFastBackward(std::vector<Tensor> outputs,
                      std::vector<Tensor> inputs,
                      Tensor adj_,
@@ -956,6 +964,74 @@ void CrossEntropyPickBackward(Tensor out,
   }
 }
 
+void CrossEntropyTileStats(Tensor out,
+                           Tensor stats,
+                           Tensor logits,
+                           Tensor labelIndices,
+                           int offset,
+                           int dimVocab,
+                           float labelSmoothingAlpha) {
+  matchOrAbort<IndexType>(labelIndices->type());
+
+  int rows = logits->shape().elements() / logits->shape().back();
+  int cols = logits->shape().back();
+
+  #pragma omp parallel for
+  for(int j = 0; j < rows; ++j) {
+    const float* sp = logits->data() + j * cols;
+    float* st = stats->data() + j * 4; // max, sumexp, sum, picked
+
+    float max = offset > 0 ? st[0] : sp[0];
+    for(int i = 0; i < cols; ++i)
+      max = std::max(max, sp[i]);
+    float sumexp = offset > 0 ? st[1] * std::exp(st[0] - max) : 0.f; // rescaled to the new maximum
+    float sum = offset > 0 ? st[2] : 0.f;
+    for(int i = 0; i < cols; ++i) {
+      sumexp += std::exp(sp[i] - max);
+      sum += sp[i];
+    }
+    st[0] = max;
+    st[1] = sumexp;
+    st[2] = sum;
+
+    int label = (int)labelIndices->data<IndexType>()[j] - offset;
+    if(label >= 0 && label < cols)
+      st[3] = sp[label];
+
+    if(out && offset + cols == dimVocab) {
+      float logsumexp = std::log(st[1]) + st[0];
+      out->data()[j] = logsumexp - (1.f - labelSmoothingAlpha) * st[3] - labelSmoothingAlpha * st[2] / (float)dimVocab;
+    }
+  }
+}
+
+void CrossEntropyTileBackward(Tensor out,
+                              Tensor adj,
+                              Tensor logits,
+                              Tensor stats,
+                              Tensor labelIndices,
+                              int offset,
+                              int dimVocab,
+                              float labelSmoothingAlpha) {
+  matchOrAbort<IndexType>(labelIndices->type());
+
+  int rows = logits->shape().elements() / logits->shape().back();
+  int cols = logits->shape().back();
+
+  #pragma omp parallel for
+  for(int j = 0; j < rows; ++j) {
+    const float* sp = logits->data() + j * cols;
+    const float* st = stats->data() + j * 4;
+    float* so = out->data() + j * cols;
+    float a = adj->data()[j];
+    int label = (int)labelIndices->data<IndexType>()[j] - offset;
+    for(int i = 0; i < cols; ++i) {
+      float sub = (float)(i == label);
+      so[i] = a * (std::exp(sp[i] - st[0]) / st[1] - (1.f - labelSmoothingAlpha) * sub - labelSmoothingAlpha / (float)dimVocab);
+    }
+  }
+}
+
 float L2Norm(Tensor in, Ptr<Allocator> /*not used*/) {
   float sum = 0.f;
   size_t size = in->size();
@@ -998,6 +1074,45 @@ void Att(Tensor out_, Tensor va_, Tensor context_, Tensor state_) {
   }
 }
 
+void AttentionWeights(Tensor out_, const Tensor va_, const Tensor context_, const Tensor state_, const Tensor mask_, float maskValue) {
+  float* out = out_->data();
+  const float* va = va_->data();
+  const float* ctx = context_->data();
+  const float* state = state_->data();
+  const float* mask = mask_ ? mask_->data() : nullptr;
+
+  int k = context_->shape()[-1];
+  int b = context_->shape()[-2];
+  int t = context_->shape()[-3];
+  int rows = state_->shape().elements() / k; // beam x batch
+
+#pragma omp parallel for
+  for(int j = 0; j < rows; ++j) {
+    const float* stateRow = state + j * k;
+    int batch = j % b;
+    std::vector<float> scores(t);
+    float max = std::numeric_limits<float>::lowest();
+    for(int s = 0; s < t; ++s) {
+      const float* ctxRow = ctx + (s * b + batch) * k;
+      float sum = 0.f;
+#pragma omp simd reduction(+ : sum)
+      for(int i = 0; i < k; ++i)
+        sum += std::tanh(ctxRow[i] + stateRow[i]) * va[i];
+      if(mask)
+        sum += (1.f - mask[s * b + batch]) * maskValue;
+      scores[s] = sum;
+      max = std::max(max, sum);
+    }
+    float sum = 0.f;
+    for(int s = 0; s < t; ++s) {
+      scores[s] = std::exp(scores[s] - max);
+      sum += scores[s];
+    }
+    for(int s = 0; s < t; ++s) // [beam, t, b, 1]
+      out[((j / b) * t + s) * b + batch] = scores[s] / sum;
+  }
+}
+
 void AttBack(Tensor gVa_,
              Tensor gContext_,
              Tensor gState_,
@@ -1045,9 +1160,13 @@ void AttBack(Tensor gVa_,
 }
 
 MARIAN_FFAST_MATH_BEGIN
+// If residual is given, normalizes x * mask + residual instead of x. The sum is written to the output
+// row first and normalized in place, so that it never makes a round trip through main memory.
 template <int alphaStride, int betaStride, bool hasBeta>
 void LayerNormalizationImpl(float* out,
                             const float* in,
+                            const float* mask,
+                            const float* residual,
                             const float* alpha,
                             const float* beta,
                             float eps,
@@ -1058,6 +1177,21 @@ void LayerNormalizationImpl(float* out,
     float* so = out + j * cols;
     const float* sp = in + j * cols;
 
+    if(residual) {
+      const float* sr = residual + j * cols;
+      if(mask) {
+        const float* sm = mask + j * cols;
+#pragma omp simd
+        for(int i = 0; i < cols; ++i)
+          so[i] = sp[i] * sm[i] + sr[i];
+      } else {
+#pragma omp simd
+        for(int i = 0; i < cols; ++i)
+          so[i] = sp[i] + sr[i];
+      }
+      sp = so;
+    }
+
     float sum = 0.f;
 #pragma omp simd reduction(+ : sum)
     for(int i = 0; i < cols; ++i) {
@@ -1089,6 +1223,8 @@ MARIAN_FFAST_MATH_END
 template <int alphaStride>
 inline void LayerNormalizationDispatchBeta(float* out,
                                            const float* in,
+                                           const float* mask,
+                                           const float* residual,
                                            const float* alpha,
                                            Tensor beta,
                                            float eps,
@@ -1096,50 +1232,79 @@ inline void LayerNormalizationDispatchBeta(float* out,
                                            int cols) {
   if (beta) {
     if (beta->shape().back() > 1) {
-      LayerNormalizationImpl<alphaStride, 1, true>(out, in, alpha, beta->data(), eps, rows, cols);
+      LayerNormalizationImpl<alphaStride, 1, true>(out, in, mask, residual, alpha, beta->data(), eps, rows, cols);
     } else {
-      LayerNormalizationImpl<alphaStride, 0, true>(out, in, alpha, beta->data(), eps, rows, cols);
+      LayerNormalizationImpl<alphaStride, 0, true>(out, in, mask, residual, alpha, beta->data(), eps, rows, cols);
     }
   } else {
-    LayerNormalizationImpl<alphaStride, 0, false>(out, in, alpha, nullptr, eps, rows, cols);
+    LayerNormalizationImpl<alphaStride, 0, false>(out, in, mask, residual, alpha, nullptr, eps, rows, cols);
   }
 }
 
-void LayerNormalization(Tensor out_,
-                        Tensor in_,
-                        Tensor gamma_,
-                        Tensor beta,
-                        float eps) {
+void ResidualLayerNormalization(Tensor out_,
+                                Tensor in_,
+                                Tensor mask_,
+                                Tensor residual_,
+                                Tensor gamma_,
+                                Tensor beta,
+                                float eps) {
   float* out = out_->data();
   const float* in = in_->data();
+  const float* mask = mask_ ? mask_->data() : nullptr;
+  const float* residual = residual_ ? residual_->data() : nullptr;
   const float* alpha = gamma_->data();
   const int alphaStride = gamma_->shape().back() > 1;  // broadcasting for alpha and beta
 
   int rows = in_->shape().elements() / in_->shape().back();
   int cols = in_->shape().back();
-  if (alphaStride == 0) {
-    LayerNormalizationDispatchBeta<0>(out, in, alpha, beta, eps, rows, cols);
-  } else {
-    LayerNormalizationDispatchBeta<1>(out, in, alpha, beta, eps, rows, cols);
-  }
+  parallelFor(out_, rows, cols, [&](size_t begin, size_t end) {
+      size_t offset = begin * cols;
+      int n = (int)(end - begin);
+      if (alphaStride == 0) {
+        LayerNormalizationDispatchBeta<0>(out + offset, in + offset, mask ? mask + offset : nullptr,
+                                          residual ? residual + offset : nullptr, alpha, beta, eps, n, cols);
+      } else {
+        LayerNormalizationDispatchBeta<1>(out + offset, in + offset, mask ? mask + offset : nullptr,
+                                          residual ? residual + offset : nullptr, alpha, beta, eps, n, cols);
+      }
+  });
+}
+
+void LayerNormalization(Tensor out,
+                        Tensor in,
+                        Tensor gamma,
+                        Tensor beta,
+                        float eps) {
+  cpu::ResidualLayerNormalization(out, in, nullptr, nullptr, gamma, beta, eps);
+}
+
+// x * mask + residual if residual is given, otherwise x; recomputes the input of ResidualLayerNormalization
+static inline float residualInput(const float* x, const float* mask, const float* residual, size_t i) {
+  return residual ? x[i] * (mask ? mask[i] : 1.f) + residual[i] : x[i];
 }
 
 MARIAN_FFAST_MATH_BEGIN
-void LayerNormalizationGrad(Tensor gradX_,
-                            Tensor gradGamma_,
-                            Tensor gradBeta_,
-                            Tensor adj_,
-                            Tensor y_,
-                            Tensor x_,
-                            Tensor gamma_,
-                            Tensor beta_,
-                            float eps) {
-  float* gradX = gradX_->data();
+void ResidualLayerNormalizationGrad(Tensor gradX_,
+                                    Tensor gradResidual_,
+                                    Tensor gradGamma_,
+                                    Tensor gradBeta_,
+                                    Tensor adj_,
+                                    Tensor y_,
+                                    Tensor x_,
+                                    Tensor mask_,
+                                    Tensor residual_,
+                                    Tensor gamma_,
+                                    Tensor beta_,
+                                    float eps) {
+  float* gradX = gradX_ ? gradX_->data() : nullptr;
+  float* gradResidual = gradResidual_ ? gradResidual_->data() : nullptr;
   float* gradGamma = gradGamma_->data();
   float* gradBeta = gradBeta_ ? gradBeta_->data() : nullptr;
   float* adj = adj_->data();
   float* y = y_->data();
   float* x = x_->data();
+  float* mask = mask_ ? mask_->data() : nullptr;
+  float* residual = residual_ ? residual_->data() : nullptr;
   float* gamma = gamma_->data();
   float* beta = beta_ ? beta_->data() : nullptr;
   // @TODO: The CPU implementation supports scalar gamma and beta. This is a left-over,
@@ -1154,9 +1319,12 @@ void LayerNormalizationGrad(Tensor gradX_,
 #pragma omp parallel for reduction(+ : gradGamma[:cols], gradBeta[:cols])
     for(size_t j = 0; j < rows; ++j) {
       const float* xRow = x + j * cols;
+      const float* maskRow = mask ? mask + j * cols : nullptr;
+      const float* residualRow = residual ? residual + j * cols : nullptr;
       const float* yRow = y + j * cols;
       const float* adjRow = adj + j * cols;
-      float* gradXRow = gradX + j * cols;
+      float* gradXRow = gradX ? gradX + j * cols : nullptr;
+      float* gradResidualRow = gradResidual ? gradResidual + j * cols : nullptr;
 
       float sum_x = 0.f;
       float sum_adj = 0.f;
@@ -1165,7 +1333,7 @@ void LayerNormalizationGrad(Tensor gradX_,
 
 #pragma omp simd reduction(+ : sum_x, sum_adj_x, sum_adj)
       for(size_t i = 0; i < cols; ++i) {
-        sum_x += xRow[i];
+        sum_x += residualInput(xRow, maskRow, residualRow, i);
         sum_adj_x += adjRow[i] * (yRow[i] - (beta ? beta[betaStride * i] : 0.f)) / gamma[gammaStride * i];
         sum_adj += adjRow[i];
       }
@@ -1173,7 +1341,7 @@ void LayerNormalizationGrad(Tensor gradX_,
       float mean = sum_x / cols;
 #pragma omp simd reduction(+ : sum_sqr)
       for(size_t i = 0; i < cols; ++i) {
-        float ex = xRow[i] - mean;
+        float ex = residualInput(xRow, maskRow, residualRow, i) - mean;
         sum_sqr += ex * ex;
       }
 
@@ -1187,7 +1355,11 @@ void LayerNormalizationGrad(Tensor gradX_,
         grad_x -= sum_adj_x * x_hat;
         grad_x /= cols * sigma;
 
-        gradXRow[i] += gamma[gammaStride * i] * grad_x;
+        float gradInput = gamma[gammaStride * i] * grad_x;
+        if(gradResidualRow)
+          gradResidualRow[i] += gradInput;
+        if(gradXRow)
+          gradXRow[i] += maskRow ? maskRow[i] * gradInput : gradInput;
         gradGamma[gammaStride * i] += adjRow[i] * x_hat;
         gradBeta[betaStride * i] += adjRow[i];
       }
@@ -1196,9 +1368,12 @@ void LayerNormalizationGrad(Tensor gradX_,
 #pragma omp parallel for reduction(+ : gradGamma[:cols])
     for(size_t j = 0; j < rows; ++j) {
       const float* xRow = x + j * cols;
+      const float* maskRow = mask ? mask + j * cols : nullptr;
+      const float* residualRow = residual ? residual + j * cols : nullptr;
       const float* yRow = y + j * cols;
       const float* adjRow = adj + j * cols;
-      float* gradXRow = gradX + j * cols;
+      float* gradXRow = gradX ? gradX + j * cols : nullptr;
+      float* gradResidualRow = gradResidual ? gradResidual + j * cols : nullptr;
 
       float sum_x = 0.f;
       float sum_adj = 0.f;
@@ -1207,7 +1382,7 @@ void LayerNormalizationGrad(Tensor gradX_,
 
 #pragma omp simd reduction(+ : sum_x, sum_adj_x, sum_adj)
       for(size_t i = 0; i < cols; ++i) {
-        sum_x += xRow[i];
+        sum_x += residualInput(xRow, maskRow, residualRow, i);
         sum_adj_x += adjRow[i] * (yRow[i] - (beta ? beta[betaStride * i] : 0.f)) / gamma[gammaStride * i];
         // @TODO: beta is NULL here            ^^
         sum_adj += adjRow[i];
@@ -1216,7 +1391,7 @@ void LayerNormalizationGrad(Tensor gradX_,
       float mean = sum_x / cols;
 #pragma omp simd reduction(+ : sum_sqr)
       for(size_t i = 0; i < cols; ++i) {
-        float ex = xRow[i] - mean;
+        float ex = residualInput(xRow, maskRow, residualRow, i) - mean;
         sum_sqr += ex * ex;
       }
 
@@ -1230,7 +1405,11 @@ void LayerNormalizationGrad(Tensor gradX_,
         grad_x -= sum_adj_x * x_hat;
         grad_x /= cols * sigma;
 
-        gradXRow[i] += gamma[gammaStride * i] * grad_x;
+        float gradInput = gamma[gammaStride * i] * grad_x;
+        if(gradResidualRow)
+          gradResidualRow[i] += gradInput;
+        if(gradXRow)
+          gradXRow[i] += maskRow ? maskRow[i] * gradInput : gradInput;
         gradGamma[gammaStride * i] += adjRow[i] * x_hat;
       }
     }
@@ -1238,6 +1417,18 @@ void LayerNormalizationGrad(Tensor gradX_,
 }
 MARIAN_FFAST_MATH_END
 
+void LayerNormalizationGrad(Tensor gradX,
+                            Tensor gradGamma,
+                            Tensor gradBeta,
+                            Tensor adj,
+                            Tensor y,
+                            Tensor x,
+                            Tensor gamma,
+                            Tensor beta,
+                            float eps) {
+  cpu::ResidualLayerNormalizationGrad(gradX, nullptr, gradGamma, gradBeta, adj, y, x, nullptr, nullptr, gamma, beta, eps);
+}
+
 void Shift(Tensor out_,
            Tensor in_,
            marian::Shape shift,
@@ -1285,6 +1476,50 @@ void ShiftGrad(Tensor out_, Tensor in_, marian::Shape shift, bool invert) {
   }
 }
 
+// out = in * mask or out += in * mask, in groups of 4 elements, whose mask elements mostly come from
+// the same counter. With a broadcast mask, the mask index of every element is computed from its coordinates.
+template <bool add>
+static void DropoutImpl(Tensor out_, const Tensor in_, const marian::Shape& maskShape, const DropoutMask& mask) {
+  matchOrAbort<float>(out_->type());
+  float* out = out_->data();
+  const float* in = in_->data();
+  size_t length = in_->shape().elements();
+  float scale = mask.scale();
+  bool broadcast = maskShape.elements() != length;
+  functional::Shape inShape = in_->shape();
+  functional::Shape fMaskShape = maskShape;
+
+  parallelFor(out_, (length + 3) / 4, 4, [&](size_t begin, size_t end) {
+    functional::Array<int, functional::Shape::size()> dims;
+    uint32_t r[4];
+    size_t block = (size_t)-1; // counter block of r
+    for(size_t i = 4 * begin; i < std::min(4 * end, length); ++i) {
+      size_t m = i;
+      if(broadcast) {
+        inShape.dims((int)i, dims);
+        m = fMaskShape.bindex(dims);
+      }
+      if(m / 4 != block) {
+        block = m / 4;
+        mask.block(block, r);
+      }
+      float v = mask.keep(r[m % 4]) ? in[i] * scale : 0.f;
+      if(add)
+        out[i] += v;
+      else
+        out[i] = v;
+    }
+  });
+}
+
+void DropoutForward(Tensor out, const Tensor in, const marian::Shape& maskShape, const DropoutMask& mask) {
+  DropoutImpl</*add=*/false>(out, in, maskShape, mask);
+}
+
+void DropoutBackward(Tensor grad, const Tensor adj, const marian::Shape& maskShape, const DropoutMask& mask) {
+  DropoutImpl</*add=*/true>(grad, adj, maskShape, mask);
+}
+
 void SetSparse(float* out,
                const std::vector<size_t>& indices,
                const std::vector<float>& values) {
@@ -1337,6 +1572,11 @@ void LSTMCellForwardTyped(Tensor out_, const std::vector<Tensor>& inputs) {
 
 void LSTMCellForward(Tensor out, std::vector<Tensor> inputs) {
   int cols = out->shape()[-1];
+#ifdef __AVX512F__
+  if(cols % 16 == 0)
+    LSTMCellForwardTyped<float32x16>(out, inputs);
+  else
+#endif
 #ifdef __AVX__
   if(cols % 8 == 0)
     LSTMCellForwardTyped<float32x8>(out, inputs);
@@ -1381,6 +1621,11 @@ void LSTMOutputForwardTyped(Tensor out_, const std::vector<Tensor>& inputs) {
 void LSTMOutputForward(Tensor out, std::vector<Tensor> inputs) {
   int cols = out->shape()[-1];
 
+#ifdef __AVX512F__
+  if(cols % 16 == 0)
+    LSTMOutputForwardTyped<float32x16>(out, inputs);
+  else
+#endif
 #ifdef __AVX__
   if(cols % 8 == 0)
     LSTMOutputForwardTyped<float32x8>(out, inputs);
@@ -1536,6 +1781,30 @@ void LSTMOutputBackward(std::vector<Tensor> outputs,
   }
 }
 
+void CumSum(Tensor out, const Tensor in, int axis, bool reverse, bool add) {
+  const auto& shape = in->shape();
+  int length = shape[axis];
+  size_t inner = 1;
+  for(int i = axis + 1; i < shape.size(); ++i)
+    inner *= shape[i];
+  size_t outer = shape.elements() / (length * inner);
+
+  std::vector<float> running(inner);
+  for(size_t o = 0; o < outer; ++o) {
+    std::fill(running.begin(), running.end(), 0.f);
+    for(int step = 0; step < length; ++step) {
+      int t = reverse ? length - 1 - step : step;
+      size_t offset = (o * length + t) * inner;
+      const float* x = in->data() + offset;
+      float* y = out->data() + offset;
+      for(size_t i = 0; i < inner; ++i) {
+        running[i] += x[i];
+        y[i] = add ? y[i] + running[i] : running[i];
+      }
+    }
+  }
+}
+
 void HighwayForward(Tensor out,
                    const Tensor in1,
                    const Tensor in2,
@@ -1558,6 +1827,106 @@ void HighwayBackward(Tensor out1,
   cpu::Element(_1 += sigmoid(_2) * (1.f - sigmoid(_2)) * (_3 - _4) * _5, outt, t, in1, in2, adj);
 }
 
+// Layout of the SSRU scan: outer x steps x batch x dim, where the initial state holds a lane for
+// each batch entry and dimension, optionally for each outer index, and the mask one value per batch
+// entry and step, optionally for each outer index
+struct SSRUScanLayout {
+  int outer, steps, batch, lanes;
+  bool c0PerOuter, maskPerOuter;
+
+  SSRUScanLayout(Tensor x, Tensor c0, Tensor mask) {
+    const auto& shape = x->shape();
+    steps = shape[-3];
+    batch = shape[-2];
+    lanes = batch * shape[-1];
+    outer = shape.elements() / (steps * lanes);
+    int c0Elements = c0->shape().elements();
+    ABORT_IF(c0Elements != lanes && c0Elements != outer * lanes,
+             "Initial SSRU state {} does not match the input {}", c0->shape(), shape);
+    c0PerOuter = c0Elements != lanes;
+    maskPerOuter = false;
+    if(mask) {
+      int maskElements = mask->shape().elements();
+      ABORT_IF(maskElements != steps * batch && maskElements != outer * steps * batch,
+               "SSRU mask {} does not match the input {}", mask->shape(), shape);
+      maskPerOuter = maskElements != steps * batch;
+    }
+  }
+
+  size_t offset(int o, int t) const { return ((size_t)o * steps + t) * lanes; }
+  const float* c0(const float* data, int o) const { return data + (c0PerOuter ? (size_t)o * lanes : 0); }
+  const float* mask(const float* data, int o, int t) const {
+    return data ? data + ((maskPerOuter ? (size_t)o * steps : 0) + t) * batch : nullptr;
+  }
+  int time(int step, bool reverse) const { return reverse ? steps - 1 - step : step; }
+};
+
+void SSRUScanForward(Tensor cells, const Tensor c0, const Tensor x, const Tensor f, const Tensor mask, bool reverse) {
+  SSRUScanLayout layout(x, c0, mask);
+  int dim = layout.lanes / layout.batch;
+  float* out = cells->data();
+  const float* maskData = mask ? mask->data() : nullptr;
+
+  for(int o = 0; o < layout.outer; ++o) {
+    const float* prev = layout.c0(c0->data(), o);
+    for(int step = 0; step < layout.steps; ++step) {
+      int t = layout.time(step, reverse);
+      size_t offset = layout.offset(o, t);
+      const float* m = layout.mask(maskData, o, t);
+      float* c = out + offset;
+      const float* xs = x->data() + offset;
+      const float* fs = f->data() + offset;
+      for(int b = 0; b < layout.batch; ++b) {
+        float mb = m ? m[b] : 1.f;
+        for(int i = b * dim; i < (b + 1) * dim; ++i) {
+          float sigma = functional::Ops<float>::sigmoid(fs[i]);
+          c[i] = mb * (sigma * prev[i] + (1.f - sigma) * xs[i]);
+        }
+      }
+      prev = c;
+    }
+  }
+}
+
+void SSRUScanBackward(Tensor gradC0, Tensor gradX, Tensor gradF, Tensor adj, Tensor cells, Tensor c0, Tensor x, Tensor f, Tensor mask, bool reverse) {
+  SSRUScanLayout layout(x, c0, mask);
+  int dim = layout.lanes / layout.batch;
+  const float* maskData = mask ? mask->data() : nullptr;
+
+  // the gradient that flows into the cell states of the previous step
+  std::vector<float> carry(layout.lanes);
+  for(int o = 0; o < layout.outer; ++o) {
+    std::fill(carry.begin(), carry.end(), 0.f);
+    for(int step = layout.steps - 1; step >= 0; --step) {
+      int t = layout.time(step, reverse);
+      size_t offset = layout.offset(o, t);
+      const float* prev = step == 0 ? layout.c0(c0->data(), o) : cells->data() + layout.offset(o, layout.time(step - 1, reverse));
+      const float* m = layout.mask(maskData, o, t);
+      const float* g = adj->data() + offset;
+      const float* xs = x->data() + offset;
+      const float* fs = f->data() + offset;
+      float* gx = gradX->data() + offset;
+      float* gf = gradF ? gradF->data() + offset : nullptr;
+      for(int b = 0; b < layout.batch; ++b) {
+        float mb = m ? m[b] : 1.f;
+        for(int i = b * dim; i < (b + 1) * dim; ++i) {
+          float sigma = functional::Ops<float>::sigmoid(fs[i]);
+          float h = mb * (g[i] + carry[i]);
+          gx[i] += h * (1.f - sigma);
+          if(gf)
+            gf[i] += h * (prev[i] - xs[i]) * sigma * (1.f - sigma);
+          carry[i] = h * sigma;
+        }
+      }
+    }
+    if(gradC0) {
+      float* gc0 = gradC0->data() + (layout.c0PerOuter ? (size_t)o * layout.lanes : 0);
+      for(int i = 0; i < layout.lanes; ++i)
+        gc0[i] += carry[i];
+    }
+  }
+}
+
 void PoolingWithMaskingForward(Tensor /*out*/,
                                Tensor /*in*/,
                                Tensor /*mask*/,
@@ -1574,5 +1943,80 @@ void PoolingWithMaskingBackward(Tensor /*adj*/,
                                 bool /*isEven*/) {
   ABORT("Not implemented!");
 }
+
+template <typename M>
+static void AdamUpdateTyped(Tensor params, Tensor mt, Tensor vt, const Tensor grads, Tensor avg, const AdamStep& step) {
+  float* p = params->data();
+  M* m = mt->data<M>();
+  M* v = vt->data<M>();
+  const float* g = grads->data();
+  float* a = avg ? avg->data() : nullptr;
+
+  parallelFor(params, params->size(), 1, [&](size_t begin, size_t end) {
+    for(size_t i = begin; i < end; ++i) {
+      if(step.lazy && g[i] == 0.f) {
+        if(a)
+          a[i] = ((1.f - step.avgDecay) * a[i]) + (step.avgDecay * p[i]);
+        continue;
+      }
+      float mi = step.beta1 * (float)m[i] + step.scale1 * g[i];
+      float vi = step.beta2 * (float)v[i] + step.scale2 * (g[i] * g[i]);
+      m[i] = (M)mi;
+      v[i] = (M)vi;
+      p[i] -= step.eta * ((mi / step.denom1) / (std::sqrt(vi / step.denom2) + step.eps) + step.decay * p[i]);
+      if(a)
+        a[i] = ((1.f - step.avgDecay) * a[i]) + (step.avgDecay * p[i]);
+    }
+  });
+}
+
+void AdamUpdate(Tensor params, Tensor mt, Tensor vt, const Tensor grads, Tensor avg, const AdamStep& step) {
+  ABORT_IF(params->type() != Type::float32 || grads->type() != Type::float32 || (avg && avg->type() != Type::float32),
+           "AdamUpdate on the CPU needs float32 parameters and gradients");
+  ABORT_IF(mt->type() != vt->type(), "Adam moments of different types {} and {}", mt->type(), vt->type());
+
+  if(mt->type() == Type::float32)
+    AdamUpdateTyped<float>(params, mt, vt, grads, avg, step);
+  else if(mt->type() == Type::float16)
+    AdamUpdateTyped<float16>(params, mt, vt, grads, avg, step);
+  else if(mt->type() == Type::bfloat16)
+    AdamUpdateTyped<bfloat16>(params, mt, vt, grads, avg, step);
+  else
+    ABORT("Adam moments of type {} are not supported", mt->type());
+}
+
+void QuantizeScaleStats(Tensor stats, const Tensor in, const QuantizeStep& step) {
+  ABORT_IF(in->type() != Type::float32 || stats->type() != Type::float32, "Quantization on the CPU needs float32 tensors");
+  size_t parts = stats->size() / 2, size = in->size();
+  const float* x = in->data<float>();
+  float* s = stats->data<float>();
+  parallelFor(in, parts, size / std::max(parts, (size_t)1), [&](size_t begin, size_t end) {
+    for(size_t j = begin; j < end; ++j) {
+      float sumAT = 0.f, sumAA = 0.f;
+      for(size_t i = j * size / parts; i < (j + 1) * size / parts; ++i) {
+        float a = step.center(x[i]);
+        sumAT += a * x[i];
+        sumAA += a * a;
+      }
+      s[2 * j] = sumAT;
+      s[2 * j + 1] = sumAA;
+    }
+  });
+}
+
+void Quantize(Tensor t, Tensor residual, const QuantizeStep& step) {
+  ABORT_IF(t->type() != Type::float32 || (residual && residual->type() != Type::float32),
+           "Quantization on the CPU needs float32 tensors");
+  float* x = t->data<float>();
+  float* r = residual ? residual->data<float>() : nullptr;
+  parallelFor(t, t->size(), 1, [&](size_t begin, size_t end) {
+    for(size_t i = begin; i < end; ++i) {
+      float q = step.scale * step.center(x[i]);
+      if(r)
+        r[i] = x[i] - q;
+      x[i] = q;
+    }
+  });
+}
 }  // namespace cpu
 }  // namespace marian
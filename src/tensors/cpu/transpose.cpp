@@ -0,0 +1,304 @@
+#include "tensors/cpu/transpose.h"
+
+#include "common/logging.h"
+#include "tensors/cpu/backend.h"
+
+#include <limits>
+
+#if defined(__GNUC__) && !defined(__CUDACC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TRANSPOSE_RUNTIME_DISPATCH 1
+#endif
+
+namespace marian {
+namespace cpu {
+
+// Transposes a square tile of width W: row r of W contiguous input floats at in + r * inStride
+// becomes column r of the W output rows at out + c * outStride
+typedef void (*TileFn)(float* out, const float* in, int outStride, int inStride);
+
+struct TileKernel {
+  int width;
+  TileFn copy;
+  TileFn add;
+};
+
+template <bool add, int W>
+static void tileScalar(float* out, const float* in, int outStride, int inStride) {
+  for(int c = 0; c < W; ++c)
+    for(int r = 0; r < W; ++r)
+      if(add)
+        out[c * outStride + r] += in[r * inStride + c];
+      else
+        out[c * outStride + r] = in[r * inStride + c];
+}
+
+#ifdef TRANSPOSE_RUNTIME_DISPATCH
+template <bool add>
+static void tileSSE(float* out, const float* in, int outStride, int inStride) {
+  __m128 r0 = _mm_loadu_ps(in + 0 * inStride);
+  __m128 r1 = _mm_loadu_ps(in + 1 * inStride);
+  __m128 r2 = _mm_loadu_ps(in + 2 * inStride);
+  __m128 r3 = _mm_loadu_ps(in + 3 * inStride);
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  __m128 r[4] = {r0, r1, r2, r3};
+  for(int c = 0; c < 4; ++c) {
+    float* o = out + c * outStride;
+    _mm_storeu_ps(o, add ? _mm_add_ps(_mm_loadu_ps(o), r[c]) : r[c]);
+  }
+}
+
+// The AVX2 and AVX512 tiles are compiled with function-level target attributes, so that they are
+// also available if Marian is compiled for an older architecture.
+template <bool add>
+__attribute__((target("avx2")))
+static void tileAVX2(float* out, const float* in, int outStride, int inStride) {
+  __m256 r[8], t[8];
+  for(int i = 0; i < 8; ++i)
+    r[i] = _mm256_loadu_ps(in + i * inStride);
+  for(int i = 0; i < 8; i += 2) {
+    t[i]     = _mm256_unpacklo_ps(r[i], r[i + 1]);
+    t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+  }
+  for(int i = 0; i < 8; i += 4) {
+    r[i]     = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+    r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+    r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+    r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+  }
+  for(int i = 0; i < 4; ++i) {
+    t[i]     = _mm256_permute2f128_ps(r[i], r[i + 4], 0x20);
+    t[i + 4] = _mm256_permute2f128_ps(r[i], r[i + 4], 0x31);
+  }
+  for(int c = 0; c < 8; ++c) {
+    float* o = out + c * outStride;
+    _mm256_storeu_ps(o, add ? _mm256_add_ps(_mm256_loadu_ps(o), t[c]) : t[c]);
+  }
+}
+
+// false uninitialized warnings of gcc 12.1/12.2 in inlined AVX512 intrinsics, see cpu/softmax.cpp
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+template <bool add>
+__attribute__((target("avx512f")))
+static void tileAVX512(float* out, const float* in, int outStride, int inStride) {
+  __m512 r[16], t[16];
+  for(int i = 0; i < 16; ++i)
+    r[i] = _mm512_loadu_ps(in + i * inStride);
+  // interleave pairs, then quadruples of rows within 128-bit lanes
+  for(int i = 0; i < 16; i += 2) {
+    t[i]     = _mm512_unpacklo_ps(r[i], r[i + 1]);
+    t[i + 1] = _mm512_unpackhi_ps(r[i], r[i + 1]);
+  }
+  for(int i = 0; i < 16; i += 4) {
+    r[i]     = _mm512_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+    r[i + 1] = _mm512_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+    r[i + 2] = _mm512_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+    r[i + 3] = _mm512_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+  }
+  // then move the 128-bit lanes between groups of four and eight rows
+  for(int i = 0; i < 16; i += 8) {
+    for(int j = 0; j < 4; ++j) {
+      t[i + j]     = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0x88);
+      t[i + j + 4] = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0xdd);
+    }
+  }
+  for(int j = 0; j < 8; ++j) {
+    r[j]     = _mm512_shuffle_f32x4(t[j], t[j + 8], 0x88);
+    r[j + 8] = _mm512_shuffle_f32x4(t[j], t[j + 8], 0xdd);
+  }
+  for(int c = 0; c < 16; ++c) {
+    float* o = out + c * outStride;
+    _mm512_storeu_ps(o, add ? _mm512_add_ps(_mm512_loadu_ps(o), r[c]) : r[c]);
+  }
+}
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+// the tiles supported by the CPU we are running on, widest first
+static std::vector<TileKernel> getTileKernels() {
+  std::vector<TileKernel> kernels;
+#ifdef TRANSPOSE_RUNTIME_DISPATCH
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    kernels.push_back({16, tileAVX512<false>, tileAVX512<true>});
+  if(__builtin_cpu_supports("avx2"))
+    kernels.push_back({8, tileAVX2<false>, tileAVX2<true>});
+  kernels.push_back({4, tileSSE<false>, tileSSE<true>});
+#else
+  kernels.push_back({4, tileScalar<false, 4>, tileScalar<true, 4>});
+#endif
+  return kernels;
+}
+
+static const std::vector<TileKernel> tileKernels = getTileKernels();
+
+int transposeTileWidth() {
+  return tileKernels.front().width;
+}
+
+// Input rows of a plane that one task transposes; with tile width W it reads BAND x W input and
+// writes W x BAND output floats per tile column, which stays in the L1 cache
+static const int BAND = 64;
+
+namespace {
+struct Axis {
+  int size;
+  int inStride;
+  int outStride;
+};
+}
+
+// Offsets of the rows or planes of a transposition in row-major order of the output, along all
+// axes except skip1 and skip2
+class Offsets {
+private:
+  std::vector<Axis> axes_;
+  std::vector<int> index_;
+
+public:
+  size_t in{0};
+  size_t out{0};
+
+  Offsets(const std::vector<Axis>& axes, int skip1, int skip2, size_t start) {
+    for(int i = 0; i < (int)axes.size(); ++i)
+      if(i != skip1 && i != skip2)
+        axes_.push_back(axes[i]);
+    index_.resize(axes_.size());
+    for(int i = (int)axes_.size() - 1; i >= 0; --i) {
+      index_[i] = (int)(start % axes_[i].size);
+      start /= axes_[i].size;
+      in += (size_t)index_[i] * axes_[i].inStride;
+      out += (size_t)index_[i] * axes_[i].outStride;
+    }
+  }
+
+  void next() {
+    for(int i = (int)axes_.size() - 1; i >= 0; --i) {
+      in += axes_[i].inStride;
+      out += axes_[i].outStride;
+      if(++index_[i] < axes_[i].size)
+        return;
+      in -= (size_t)axes_[i].size * axes_[i].inStride;
+      out -= (size_t)axes_[i].size * axes_[i].outStride;
+      index_[i] = 0;
+    }
+  }
+};
+
+void transpose(float* out,
+               const float* in,
+               const std::vector<int>& dims,
+               const std::vector<int>& axes,
+               bool add,
+               Tensor threads) {
+  ABORT_IF(dims.size() != axes.size(), "Transposition of {} dimensions by {} axes", dims.size(), axes.size());
+
+  std::vector<int> inStrides(dims.size(), 1);
+  for(int i = (int)dims.size() - 2; i >= 0; --i)
+    inStrides[i] = inStrides[i + 1] * dims[i + 1];
+
+  // output axes without singletons, neighbours that are also neighbours in the input merged
+  std::vector<Axis> merged;
+  for(auto axis : axes) {
+    if(dims[axis] == 1)
+      continue;
+    if(!merged.empty() && merged.back().inStride == inStrides[axis] * dims[axis]) {
+      merged.back().size *= dims[axis];
+      merged.back().inStride = inStrides[axis];
+    } else {
+      merged.push_back({dims[axis], inStrides[axis], 0});
+    }
+  }
+
+  size_t elements = 1;
+  for(int i = (int)merged.size() - 1; i >= 0; --i) {
+    merged[i].outStride = (int)elements;
+    elements *= merged[i].size;
+  }
+
+  if(merged.empty()) { // a single element
+    *out = add ? *out + *in : *in;
+    return;
+  }
+
+  int last = (int)merged.size() - 1;
+  if(merged[last].inStride == 1) { // innermost axis is kept, copy rows
+    int cols = merged[last].size;
+    size_t rows = elements / cols;
+    parallelFor(threads, rows, cols, [&](size_t begin, size_t end) {
+      Offsets offsets(merged, last, -1, begin);
+      for(size_t row = begin; row < end; ++row, offsets.next()) {
+        const float* inRow = in + offsets.in;
+        float* outRow = out + offsets.out;
+        if(add) {
+          for(int i = 0; i < cols; ++i)
+            outRow[i] += inRow[i];
+        } else {
+          std::copy(inRow, inRow + cols, outRow);
+        }
+      }
+    });
+    return;
+  }
+
+  // the innermost input axis becomes the columns of each plane, the innermost output axis its rows
+  int inner = 0;
+  while(merged[inner].inStride != 1)
+    ++inner;
+
+  int cols = merged[inner].size, outStride = merged[inner].outStride;
+  int rows = merged[last].size, inStride = merged[last].inStride;
+  size_t planes = elements / ((size_t)rows * cols);
+  size_t bands = (rows + BAND - 1) / BAND;
+
+  // the widest tile that fits into the plane, small planes are transposed element by element
+  int W = std::numeric_limits<int>::max();
+  TileFn tile = nullptr;
+  for(const auto& kernel : tileKernels) {
+    if(kernel.width <= std::min(std::min(rows, BAND), cols)) {
+      W = kernel.width;
+      tile = add ? kernel.add : kernel.copy;
+      break;
+    }
+  }
+
+  parallelFor(threads, planes * bands, (size_t)BAND * cols, [&](size_t begin, size_t end) {
+    Offsets offsets(merged, inner, last, begin / bands);
+    for(size_t task = begin; task < end; ++task) {
+      if(task != begin && task % bands == 0)
+        offsets.next();
+      int r0 = (int)(task % bands) * BAND;
+      int r1 = std::min(r0 + BAND, rows);
+      const float* inBand = in + offsets.in + (size_t)r0 * inStride;
+      float* outBand = out + offsets.out + r0;
+
+      int r = 0, c = 0;
+      for(; r <= r1 - r0 - W; r += W)
+        for(c = 0; c + W <= cols; c += W)
+          tile(outBand + (size_t)c * outStride + r, inBand + (size_t)r * inStride + c, outStride, inStride);
+
+      // remaining columns of the full tile rows, then the remaining rows
+      for(int cc = c; cc < cols; ++cc)
+        for(int rr = 0; rr < r; ++rr)
+          if(add)
+            outBand[(size_t)cc * outStride + rr] += inBand[(size_t)rr * inStride + cc];
+          else
+            outBand[(size_t)cc * outStride + rr] = inBand[(size_t)rr * inStride + cc];
+      for(int cc = 0; cc < cols; ++cc)
+        for(int rr = r; rr < r1 - r0; ++rr)
+          if(add)
+            outBand[(size_t)cc * outStride + rr] += inBand[(size_t)rr * inStride + cc];
+          else
+            outBand[(size_t)cc * outStride + rr] = inBand[(size_t)rr * inStride + cc];
+    }
+  });
+}
+
+}  // namespace cpu
+}  // namespace marian
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "tensors/tensor.h"
+
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+// Writes the transposition of the row-major float array `in` with dimensions `dims` by `axes` into
+// `out`, or adds it to out if `add` is set. Output axis i is input axis axes[i]. Singleton axes are
+// dropped and axes that stay neighbours are merged first. If the innermost axis is kept, rows are
+// copied, otherwise every plane of the input and output innermost axes is transposed in square
+// tiles with the widest AVX512, AVX2 or SSE kernel the CPU supports, chosen at runtime. The tensor
+// `threads` selects the worker pool of its backend, see --cpu-threads-per-graph.
+void transpose(float* out,
+               const float* in,
+               const std::vector<int>& dims,
+               const std::vector<int>& axes,
+               bool add,
+               Tensor threads);
+
+// Width of the square tiles of the kernel that transpose() uses on this CPU: 16, 8 or 4
+int transposeTileWidth();
+
+}  // namespace cpu
+}  // namespace marian
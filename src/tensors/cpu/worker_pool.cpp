@@ -0,0 +1,85 @@
+#include "tensors/cpu/worker_pool.h"
+
+#include <algorithm>
+
+namespace marian {
+namespace cpu {
+
+// set while a thread computes a range of any pool, so that nested calls do not wait for themselves
+static thread_local bool insideTask = false;
+
+WorkerPool::WorkerPool(size_t threads) {
+  for(size_t id = 1; id < threads; ++id)
+    workers_.emplace_back([this, id]() { work(id); });
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  started_.notify_all();
+  for(auto& worker : workers_)
+    worker.join();
+}
+
+void WorkerPool::work(size_t id) {
+  size_t generation = 0;
+  for(;;) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    started_.wait(lock, [&]() { return shutdown_ || generation_ != generation; });
+    if(shutdown_)
+      return;
+    generation = generation_;
+    if(id >= chunks_) // not needed for this task
+      continue;
+
+    auto task = task_;
+    size_t begin = items_ * id / chunks_;
+    size_t end = items_ * (id + 1) / chunks_;
+    lock.unlock();
+
+    insideTask = true;
+    (*task)(begin, end);
+    insideTask = false;
+
+    lock.lock();
+    if(--pending_ == 0)
+      finished_.notify_one();
+  }
+}
+
+void WorkerPool::parallelFor(size_t items, size_t chunks, const std::function<void(size_t, size_t)>& f) {
+  chunks = std::min(std::min(chunks, size()), items);
+
+  if(chunks <= 1 || insideTask) {
+    f(0, items);
+    return;
+  }
+
+  std::unique_lock<std::mutex> call(callMutex_, std::try_to_lock);
+  if(!call.owns_lock()) {
+    f(0, items);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &f;
+    items_ = items;
+    chunks_ = chunks;
+    pending_ = chunks - 1;
+    generation_++;
+  }
+  started_.notify_all();
+
+  insideTask = true;
+  f(0, items / chunks);
+  insideTask = false;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  finished_.wait(lock, [&]() { return pending_ == 0; });
+}
+
+}  // namespace cpu
+}  // namespace marian
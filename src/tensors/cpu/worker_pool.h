@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+// Persistent threads that split the work of single CPU kernels of one graph, see
+// --cpu-threads-per-graph. The calling thread computes the first range itself, so that a pool of n
+// threads starts n - 1 workers. Only one parallelFor() runs at a time; nested or concurrent calls
+// are computed serially by their calling thread.
+class WorkerPool {
+private:
+  std::vector<std::thread> workers_;
+
+  std::mutex callMutex_; // held by the thread that currently distributes work
+  std::mutex mutex_;     // guards the task below
+  std::condition_variable started_;
+  std::condition_variable finished_;
+
+  const std::function<void(size_t, size_t)>* task_{nullptr};
+  size_t items_{0};
+  size_t chunks_{0};
+  size_t pending_{0};    // workers that have not finished their range yet
+  size_t generation_{0}; // incremented for every task
+  bool shutdown_{false};
+
+  void work(size_t id);
+
+public:
+  WorkerPool(size_t threads);
+  ~WorkerPool();
+
+  size_t size() const { return workers_.size() + 1; }
+
+  // Calls f(begin, end) on at most `chunks` consecutive ranges that cover [0, items) and returns
+  // when all of them are done
+  void parallelFor(size_t items, size_t chunks, const std::function<void(size_t, size_t)>& f);
+};
+
+}  // namespace cpu
+}  // namespace marian
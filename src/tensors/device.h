@@ -35,10 +35,22 @@ public:
 };
 
 namespace gpu {
+// With --gpu-memory-pool the devices allocate from the stream-ordered memory pool of their GPU, which
+// keeps released memory for the other graphs on the same GPU instead of returning it to the driver.
+// Process-wide and set at startup, see Config::initialize(). Needs CUDA 11.2 or later.
+void setMemoryPool(bool usePool);
+bool usesMemoryPool();
+
+// Migrates managed memory to the GPU on a copy stream of the GPU, asynchronously to the computation
+void prefetchManaged(DeviceId deviceId, const uint8_t* ptr, size_t bytes);
+
 class Device : public marian::Device {
+private:
+  bool managed_; // managed memory that stays in host memory until prefetched, see prefetchManaged()
+
 public:
-  Device(DeviceId deviceId, size_t alignment = 256)
-      : marian::Device(deviceId, alignment) {}
+  Device(DeviceId deviceId, size_t alignment = 256, bool managed = false)
+      : marian::Device(deviceId, alignment), managed_(managed) {}
 
   ~Device();
 
@@ -47,7 +59,22 @@ public:
 }  // namespace gpu
 
 namespace cpu {
+// Allocation of the memory of CPU devices, process-wide and set at startup from --cpu-huge-pages and
+// --cpu-numa-memory, see Config::initialize(). Only used on Linux.
+enum class HugePages { off, transparent, hugetlb };
+void setMemoryPolicy(HugePages hugePages, bool bindToNumaNode);
+
+// NUMA node to which the memory allocated by the calling thread is bound with --cpu-numa-memory, so
+// that a thread can allocate for a worker pinned to another node. -1 for the node the calling thread
+// is running on.
+void setThreadNumaNode(int node);
+
 class Device : public marian::Device {
+private:
+  size_t mappedBytes_{0}; // size of the mapping if data_ is memory-mapped, see reserveMapped()
+
+  void reserveMapped(size_t size);
+
 public:
   Device(DeviceId deviceId, size_t alignment = 256)
       : marian::Device(deviceId, alignment) {}
@@ -79,14 +106,17 @@ public:
 
 }  // namespace cpu
 
+// managed: for a GPU, memory that is kept on the host and migrated to the GPU on demand
 static inline Ptr<Device> DispatchDevice(DeviceId deviceId,
-                                         size_t alignment = 256) {
+                                         size_t alignment = 256,
+                                         bool managed = false) {
 #ifdef CUDA_FOUND
   if(deviceId.type == DeviceType::gpu)
-    return New<gpu::Device>(deviceId, alignment);
+    return New<gpu::Device>(deviceId, alignment, managed);
   else
     return New<cpu::Device>(deviceId, alignment);
 #else
+  managed;
   if(deviceId.type == DeviceType::gpu)
     ABORT("CUDA support not compiled into marian");
   else
@@ -2,9 +2,13 @@
 
 // clang-format off
 #include "tensors/tensor_operators.h"
+#include "tensors/gpu/backend.h"
 #include "tensors/gpu/cuda_helpers.h"
 // clang-format on
 
+#include <algorithm>
+#include <cstring>
+
 namespace marian {
 namespace gpu {
 
@@ -30,6 +34,29 @@ template void copy<float>(Ptr<Backend>, const float*, const float*, float*);
 template void copy<double>(Ptr<Backend>, const double*, const double*, double*);
 // clang-format on
 
+template <typename T>
+void copyFromHost(Ptr<marian::Backend> backend, const T* begin, const T* end, T* dest) {
+  if(begin == end)
+    return;
+  CUDA_CHECK(cudaSetDevice(backend->getDeviceId().no));
+  std::static_pointer_cast<gpu::Backend>(backend)->copyToDeviceAsync(begin, dest, (end - begin) * sizeof(T));
+}
+
+// clang-format off
+template void copyFromHost<int8_t>(Ptr<marian::Backend>, const int8_t*, const int8_t*, int8_t*);
+template void copyFromHost<int16_t>(Ptr<marian::Backend>, const int16_t*, const int16_t*, int16_t*);
+template void copyFromHost<int32_t>(Ptr<marian::Backend>, const int32_t*, const int32_t*, int32_t*);
+template void copyFromHost<int64_t>(Ptr<marian::Backend>, const int64_t*, const int64_t*, int64_t*);
+template void copyFromHost<uint8_t>(Ptr<marian::Backend>, const uint8_t*, const uint8_t*, uint8_t*);
+template void copyFromHost<uint16_t>(Ptr<marian::Backend>, const uint16_t*, const uint16_t*, uint16_t*);
+template void copyFromHost<uint32_t>(Ptr<marian::Backend>, const uint32_t*, const uint32_t*, uint32_t*);
+template void copyFromHost<uint64_t>(Ptr<marian::Backend>, const uint64_t*, const uint64_t*, uint64_t*);
+template void copyFromHost<char>(Ptr<marian::Backend>, const char*, const char*, char*);
+template void copyFromHost<float16>(Ptr<marian::Backend>, const float16*, const float16*, float16*);
+template void copyFromHost<float>(Ptr<marian::Backend>, const float*, const float*, float*);
+template void copyFromHost<double>(Ptr<marian::Backend>, const double*, const double*, double*);
+// clang-format on
+
 template <typename T>
 __global__ void gFill(T* d_in, int size, T val) {
   //auto blocks = gridDim.x;
@@ -150,5 +177,72 @@ template void swap_ranges<float>(Ptr<Backend>, float*, float*, float*);
 template void swap_ranges<double>(Ptr<Backend>, double*, double*, double*);
 // clang-format on
 
+void copyToDeviceStaged(Ptr<Backend> backend, std::vector<HostToDeviceCopy> copies, size_t chunkBytes) {
+  const size_t alignment = 256; // of the TensorAllocator, the padding after a tensor belongs to no other tensor
+  CUDA_CHECK(cudaSetDevice(backend->getDeviceId().no));
+  std::sort(copies.begin(), copies.end(), [](const HostToDeviceCopy& a, const HostToDeviceCopy& b) {
+    return a.dst < b.dst;
+  });
+
+  cudaStream_t stream;
+  CUDA_CHECK(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+  char* staging[2];
+  cudaEvent_t transferred[2];
+  for(int i = 0; i < 2; ++i) {
+    CUDA_CHECK(cudaHostAlloc((void**)&staging[i], chunkBytes, cudaHostAllocDefault));
+    CUDA_CHECK(cudaEventCreateWithFlags(&transferred[i], cudaEventDisableTiming));
+  }
+
+  int current = 0;   // staging buffer being filled
+  size_t used = 0;   // bytes of it that belong to the run
+  char* runDst = nullptr;
+  auto flush = [&]() {
+    if(used == 0)
+      return;
+    CUDA_CHECK(cudaMemcpyAsync(runDst, staging[current], used, cudaMemcpyHostToDevice, stream));
+    CUDA_CHECK(cudaEventRecord(transferred[current], stream));
+    current = 1 - current;
+    used = 0;
+    CUDA_CHECK(cudaEventSynchronize(transferred[current])); // the other buffer is free again
+  };
+
+  char* runEnd = nullptr; // the end of the last copy of the run, rounded up to the alignment
+  for(const auto& copy : copies) {
+    const char* src = (const char*)copy.src;
+    char* dst = (char*)copy.dst;
+    size_t left = copy.bytes;
+    if(used > 0 && dst != runEnd && dst != runDst + used)
+      flush(); // not adjacent, start a new run
+    while(left > 0) {
+      if(used > 0 && dst != runDst + used) { // skip the padding of the previous copy
+        size_t padding = dst - (runDst + used);
+        if(used + padding >= chunkBytes)
+          flush();
+        else
+          used += padding;
+      }
+      if(used == 0)
+        runDst = dst;
+      size_t bytes = std::min(left, chunkBytes - used);
+      std::memcpy(staging[current] + used, src, bytes);
+      used += bytes;
+      src += bytes;
+      dst += bytes;
+      left -= bytes;
+      if(used == chunkBytes)
+        flush();
+    }
+    runEnd = (char*)(((size_t)dst + alignment - 1) / alignment * alignment);
+  }
+  flush();
+  CUDA_CHECK(cudaStreamSynchronize(stream));
+
+  for(int i = 0; i < 2; ++i) {
+    CUDA_CHECK(cudaFreeHost(staging[i]));
+    CUDA_CHECK(cudaEventDestroy(transferred[i]));
+  }
+  CUDA_CHECK(cudaStreamDestroy(stream));
+}
+
 }  // namespace gpu
 }  // namespace marian
@@ -7,6 +7,10 @@ namespace gpu {
 template <typename T>
 void copy(Ptr<marian::Backend> backend, const T* begin, const T* end, T* dest);
 
+// Copies from host memory without waiting for the transfer, see gpu::Backend::copyToDeviceAsync()
+template <typename T>
+void copyFromHost(Ptr<marian::Backend> backend, const T* begin, const T* end, T* dest);
+
 template <typename T>
 void fill(Ptr<marian::Backend> backend, T* begin, T* end, T value);
 
@@ -17,5 +21,16 @@ void setSparse(Ptr<marian::Backend> backend,
                const std::vector<size_t>&,
                const std::vector<float>&,
                float*);
+
+struct HostToDeviceCopy {
+  const void* src; // host memory, e.g. a memory-mapped file
+  void* dst;       // device memory
+  size_t bytes;
+};
+
+// Runs the copies through two pinned staging buffers of chunkBytes, so that the host fills one while the
+// other is transferred. Copies whose destinations follow each other in device memory, up to the padding
+// of 256-byte aligned allocations, are sent as one transfer. Returns when all copies are complete.
+void copyToDeviceStaged(Ptr<marian::Backend> backend, std::vector<HostToDeviceCopy> copies, size_t chunkBytes);
 }  // namespace gpu
 }  // namespace marian
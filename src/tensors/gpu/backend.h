@@ -9,6 +9,14 @@
 #include <cuda.h>
 #include <curand.h>
 #include <cusparse.h>
+#if CUDA_VERSION >= 11000
+#include <cublasLt.h>
+#endif
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace marian {
 namespace gpu {
@@ -34,6 +42,14 @@ public:
 
   ~Backend() {
     setDevice();
+    for(auto& segment : uploadSegments_) {
+      cudaEventSynchronize(segment.transferred);
+      cudaEventDestroy(segment.transferred);
+    }
+    if(uploadBuffer_) {
+      cudaFreeHost(uploadBuffer_);
+      uploadBuffer_ = nullptr;
+    }
     if(cusparseHandle_) {
       cusparseDestroy(cusparseHandle_);
       cusparseHandle_ = 0;
@@ -42,16 +58,68 @@ public:
       cublasDestroy(cublasHandle_);
       cublasHandle_ = 0;
     }
+#if CUDA_VERSION >= 11000
+    if(cublasLtWorkspace_) {
+      cudaFree(cublasLtWorkspace_);
+      cublasLtWorkspace_ = nullptr;
+    }
+    if(cublasLtHandle_) {
+      cublasLtDestroy(cublasLtHandle_);
+      cublasLtHandle_ = 0;
+    }
+#endif
   }
 
   void setDevice() override { CUDA_CHECK(cudaSetDevice((int)deviceId_.no)); }
 
-  void synchronize() override { CUDA_CHECK(cudaStreamSynchronize(0)); }
+  // The kernels are compiled with --default-stream per-thread, so each host thread, e.g. each graph
+  // of the translation workers or scorers on a device, issues its work to a stream of its own.
+  // Library calls and synchronization use the same stream rather than their default, the legacy
+  // stream, which waits for and blocks the streams of all other threads on the device.
+  static cudaStream_t getStream() { return cudaStreamPerThread; }
+
+  void synchronize() override { CUDA_CHECK(cudaStreamSynchronize(getStream())); }
+
+  // Copies host memory to the device without waiting for the transfer: the data is staged in a
+  // pinned ring buffer and transferred on getStream(), in order with the kernels that read it, so
+  // the inputs of a batch are uploaded while the host keeps issuing work. Copies larger than a
+  // segment of the ring are synchronous.
+  void copyToDeviceAsync(const void* src, void* dst, size_t bytes) {
+    if(bytes > uploadSegmentBytes) {
+      CUDA_CHECK(cudaMemcpy(dst, src, bytes, cudaMemcpyHostToDevice));
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(uploadMutex_);
+    if(!uploadBuffer_) {
+      setDevice();
+      CUDA_CHECK(cudaHostAlloc((void**)&uploadBuffer_, uploadSegments * uploadSegmentBytes, cudaHostAllocDefault));
+      uploadSegments_.resize(uploadSegments);
+      for(auto& segment : uploadSegments_)
+        CUDA_CHECK(cudaEventCreateWithFlags(&segment.transferred, cudaEventDisableTiming));
+    }
+
+    if(uploadUsed_ + bytes > uploadSegmentBytes) { // continue in the next segment once its last transfers are done
+      CUDA_CHECK(cudaEventRecord(uploadSegments_[uploadCurrent_].transferred, getStream()));
+      uploadCurrent_ = (uploadCurrent_ + 1) % uploadSegments;
+      uploadUsed_ = 0;
+      CUDA_CHECK(cudaEventSynchronize(uploadSegments_[uploadCurrent_].transferred));
+    }
+
+    char* staging = uploadBuffer_ + uploadCurrent_ * uploadSegmentBytes + uploadUsed_;
+    std::memcpy(staging, src, bytes);
+    CUDA_CHECK(cudaMemcpyAsync(dst, staging, bytes, cudaMemcpyHostToDevice, getStream()));
+    uploadUsed_ += (bytes + 255) / 256 * 256; // 256-byte aligned like device allocations
+  }
+
+  static const size_t uploadSegments = 4;
+  static const size_t uploadSegmentBytes = 1024 * 1024;
 
   cublasHandle_t getCublasHandle() {
     if(!cublasHandle_) { // lazy initialization here to avoid memory usage when unused
       setDevice();
       cublasCreate(&cublasHandle_);
+      CUBLAS_CHECK(cublasSetStream(cublasHandle_, getStream()));
     }
     return cublasHandle_;
   }
@@ -60,16 +128,57 @@ public:
     if(!cusparseHandle_) { // lazy initialization here to avoid memory usage when unused
       setDevice();
       cusparseCreate(&cusparseHandle_);
+      CUSPARSE_CHECK(cusparseSetStream(cusparseHandle_, getStream()));
     }
     return cusparseHandle_;
   }
 
+#if CUDA_VERSION >= 11000
+  cublasLtHandle_t getCublasLtHandle() {
+    if(!cublasLtHandle_) { // lazy initialization here to avoid memory usage when unused
+      setDevice();
+      CUBLAS_CHECK(cublasLtCreate(&cublasLtHandle_));
+    }
+    return cublasLtHandle_;
+  }
+
+  // Workspace for cuBLASLt matrix products, allocated once and kept for the lifetime of the backend
+  void* getCublasLtWorkspace() {
+    if(!cublasLtWorkspace_) {
+      setDevice();
+      CUDA_CHECK(cudaMalloc(&cublasLtWorkspace_, cublasLtWorkspaceSize));
+    }
+    return cublasLtWorkspace_;
+  }
+
+  // cuBLASLt heuristic results by a hash of shapes, types and alignments of the product, a state other
+  // than CUBLAS_STATUS_SUCCESS marks a product that cuBLASLt cannot do
+  std::unordered_map<size_t, cublasLtMatmulHeuristicResult_t>& getCublasLtAlgorithms() { return cublasLtAlgorithms_; }
+
+  static const size_t cublasLtWorkspaceSize = 4 * 1024 * 1024;
+#endif
+
   CudaCompute getCudaComputeCapability() { return compute_; }
 
 private:
   cublasHandle_t cublasHandle_{0};     // make sure it's 0, so it can be initalized lazily
   cusparseHandle_t cusparseHandle_{0}; // as above
+#if CUDA_VERSION >= 11000
+  cublasLtHandle_t cublasLtHandle_{0}; // as above
+  void* cublasLtWorkspace_{nullptr};
+  std::unordered_map<size_t, cublasLtMatmulHeuristicResult_t> cublasLtAlgorithms_;
+#endif
   CudaCompute compute_;
+
+  // pinned ring buffer of copyToDeviceAsync(), allocated on first use
+  struct UploadSegment {
+    cudaEvent_t transferred; // recorded after the last transfer from the segment before moving on
+  };
+  char* uploadBuffer_{nullptr};
+  std::vector<UploadSegment> uploadSegments_;
+  size_t uploadCurrent_{0};
+  size_t uploadUsed_{0};
+  std::mutex uploadMutex_;
 };
 }  // namespace gpu
 }  // namespace marian
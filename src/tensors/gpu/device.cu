@@ -1,5 +1,6 @@
 #include <cuda.h>
 #include <iostream>
+#include <mutex>
 
 #include "tensors/device.h"
 #include "tensors/gpu/cuda_helpers.h"
@@ -7,11 +8,54 @@
 namespace marian {
 namespace gpu {
 
+namespace {
+bool usePool_ = false;
+
+#if CUDART_VERSION >= 11020
+// Keeps the memory released to the pool of the current GPU in the pool, by default it is returned to
+// the driver at the next synchronization
+void retainPoolMemory() {
+  int device = 0;
+  CUDA_CHECK(cudaGetDevice(&device));
+  cudaMemPool_t pool;
+  CUDA_CHECK(cudaDeviceGetDefaultMemPool(&pool, device));
+  uint64_t threshold = UINT64_MAX;
+  CUDA_CHECK(cudaMemPoolSetAttribute(pool, cudaMemPoolAttrReleaseThreshold, &threshold));
+}
+#endif
+}  // namespace
+
+void setMemoryPool(bool usePool) {
+#if CUDART_VERSION >= 11020
+  usePool_ = usePool;
+#else
+  ABORT_IF(usePool, "--gpu-memory-pool needs CUDA 11.2 or later");
+#endif
+}
+
+bool usesMemoryPool() {
+  return usePool_;
+}
+
+void prefetchManaged(DeviceId deviceId, const uint8_t* ptr, size_t bytes) {
+  static std::once_flag created[64];
+  static cudaStream_t streams[64];
+  size_t no = deviceId.no % 64;
+  CUDA_CHECK(cudaSetDevice(deviceId.no));
+  std::call_once(created[no], [&]() { CUDA_CHECK(cudaStreamCreateWithFlags(&streams[no], cudaStreamNonBlocking)); });
+  CUDA_CHECK(cudaMemPrefetchAsync(ptr, bytes, (int)deviceId.no, streams[no]));
+}
+
 Device::~Device() {
   // No CUDA error checking as this is a destructor and we cannot do anything about errors anyway.
   cudaSetDevice(deviceId_.no);
   if(data_) {
-    cudaFree(data_);
+#if CUDART_VERSION >= 11020
+    if(usePool_ && !managed_)
+      cudaFreeAsync(data_, 0); // back to the pool for the other graphs
+    else
+#endif
+      cudaFree(data_);
   }
   cudaDeviceSynchronize();
 }
@@ -23,6 +67,42 @@ void Device::reserve(size_t size) {
   ABORT_IF(size < size_ || size == 0,
            "New size must be larger than old size and larger than 0");
 
+  if(managed_) {
+    // preferably in host memory, the GPU reads pages that are not prefetched over the bus
+    uint8_t* temp = nullptr;
+    LOG(debug, "[memory] Allocating {} bytes of managed memory for device {}", size, deviceId_.no);
+    CUDA_CHECK(cudaMallocManaged((void**)&temp, size));
+    CUDA_CHECK(cudaMemAdvise(temp, size, cudaMemAdviseSetPreferredLocation, cudaCpuDeviceId));
+    CUDA_CHECK(cudaMemAdvise(temp, size, cudaMemAdviseSetAccessedBy, (int)deviceId_.no));
+    if(data_) {
+      CUDA_CHECK(cudaMemcpy(temp, data_, size_, cudaMemcpyDefault));
+      CUDA_CHECK(cudaFree(data_));
+    }
+    data_ = temp;
+    size_ = size;
+    return;
+  }
+
+#if CUDART_VERSION >= 11020
+  if(usePool_) {
+    // ordered on the default stream after the kernels that still use the old memory, which goes
+    // back to the pool right away instead of being parked in host memory
+    static std::once_flag retained[64];
+    std::call_once(retained[deviceId_.no % 64], retainPoolMemory);
+    uint8_t* temp = nullptr;
+    LOG(debug, "[memory] Allocating {} bytes from the memory pool of device {}", size, deviceId_.no);
+    CUDA_CHECK(cudaMallocAsync((void**)&temp, size, 0));
+    if(data_) {
+      CUDA_CHECK(cudaMemcpyAsync(temp, data_, size_, cudaMemcpyDeviceToDevice, 0));
+      CUDA_CHECK(cudaFreeAsync(data_, 0));
+    }
+    CUDA_CHECK(cudaStreamSynchronize(0));
+    data_ = temp;
+    size_ = size;
+    return;
+  }
+#endif
+
   if(data_) {
     // Allocate memory while temporarily parking original content in host memory
     std::vector<uint8_t> temp(size_);
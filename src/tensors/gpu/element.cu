@@ -7,6 +7,8 @@
 
 #include "tensors/gpu/cuda_helpers.h"
 
+#include <cstdint>
+
 namespace marian {
 namespace gpu {
 
@@ -34,6 +36,43 @@ __global__ void gElement(
   }
 }
 
+// N consecutive elements of a tensor, read or written with one access of N * sizeof(T) bytes
+template <typename T, int N>
+struct alignas(N * sizeof(T)) Pack {
+  T values[N];
+};
+
+// Fast path of gElement() for tensors of the shape of the output, or operands that are broadcast along
+// rows only, such as a bias of shape [1, cols]. Each thread computes N consecutive elements, which stay in
+// one row as cols % N == 0, from one load per operand. The functor sees the operands through views whose
+// data are the loaded packs; the output is read from memory only if the functor reads it.
+template <size_t K, int N, class Functor, typename T>
+__global__ void gElementPacked(
+    Functor functor,
+    functional::Array<functional::Tensor<T>, K> tensors,
+    functional::Array<bool, K> rows,
+    int cols) {
+  int length = tensors[0].shape().elements();
+  functional::Array<functional::Tensor<T>, K> views = tensors;
+  functional::Array<int, K> indices;
+  Pack<T, N> packs[K];
+
+  for(int index = (blockDim.x * blockIdx.x + threadIdx.x) * N; index < length; index += blockDim.x * gridDim.x * N) {
+#pragma unroll
+    for(int i = 1; i < K; ++i) {
+      packs[i] = *reinterpret_cast<const Pack<T, N>*>(tensors[i].data() + (rows[i] ? index % cols : index));
+      views[i].data_ = packs[i].values;
+    }
+    views[0].data_ = tensors[0].data() + index;
+
+#pragma unroll
+    for(int k = 0; k < N; ++k) {
+      indices.fill(k);
+      packs[0].values[k] = functional::apply(functor, views, indices);
+    }
+    *reinterpret_cast<Pack<T, N>*>(tensors[0].data() + index) = packs[0];
+  }
+}
 
 template <typename T, class Functor, class... Tensors>
 void ElementTyped(Functor functor, Tensor out, Tensors... tensors) {
@@ -42,17 +81,45 @@ void ElementTyped(Functor functor, Tensor out, Tensors... tensors) {
   cudaSetDevice(out->getDeviceId().no);
 
   int length = out->shape().elements();
-  int threads = std::min(MAX_THREADS, length);
-  int blocks = std::min(MAX_BLOCKS, length / threads + (length % threads != 0));
+  if(length == 0)
+    return;
 
   constexpr size_t K = sizeof...(tensors) + 1;
   functional::Array<functional::Tensor<T>, K> gTensors = {out, tensors...};
 
-  bool broadcast = false;
-  for(int i = 1; i < K; ++i)
-    broadcast = broadcast || gTensors[0].shape() != gTensors[i].shape();
-  if(broadcast)
+  // operands of another shape than the output are either broadcast along rows, [1, ..., 1, cols], or in general
+  int cols = out->shape()[-1];
+  bool broadcast = false, general = false;
+  functional::Array<bool, K> rows;
+  rows.fill(false);
+  for(int i = 1; i < K; ++i) {
+    if(gTensors[0].shape() == gTensors[i].shape())
+      continue;
+    broadcast = true;
+    rows[i] = gTensors[i].shape().elements() == cols && gTensors[i].shape().back() == cols;
+    general = general || !rows[i];
+  }
+
+  if(general) {
+    int threads = std::min(MAX_THREADS, length);
+    int blocks = std::min(MAX_BLOCKS, length / threads + (length % threads != 0));
     gElement<K, true><<<blocks, threads>>>(functor, gTensors);
+    return;
+  }
+
+  // 128-bit accesses if all tensors are aligned to them and the packs do not cross rows
+  constexpr int N = 16 / sizeof(T);
+  bool packed = length % N == 0 && (!broadcast || cols % N == 0);
+  for(int i = 0; i < K; ++i)
+    packed = packed && reinterpret_cast<uintptr_t>(gTensors[i].data()) % (N * sizeof(T)) == 0;
+
+  int work = packed ? length / N : length;
+  int threads = std::min(MAX_THREADS, work);
+  int blocks = std::min(MAX_BLOCKS, work / threads + (work % threads != 0));
+  if(packed)
+    gElementPacked<K, N><<<blocks, threads>>>(functor, gTensors, rows, cols);
+  else if(broadcast)
+    gElementPacked<K, 1><<<blocks, threads>>>(functor, gTensors, rows, cols);
   else
     gElement<K, false><<<blocks, threads>>>(functor, gTensors);
 }
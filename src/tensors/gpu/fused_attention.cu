@@ -0,0 +1,251 @@
+#include "tensors/tensor_operators.h"
+#include "tensors/gpu/cuda_helpers.h"
+
+#include <cuda.h>
+
+// GPU implementation of the fused attention of FusedAttentionNodeOp, see the CPU implementation in
+// src/tensors/cpu/fused_attention.cpp. One warp computes one query row: the lanes split the
+// dimensions of the queries and values, a score is a warp-wide reduction, and the softmax is
+// computed online while the keys are streamed, so the attention weights never reach global memory.
+// The backward step recomputes them from the log-sum-exp of each row and adds the gradients of keys
+// and values atomically.
+
+namespace marian {
+namespace gpu {
+
+namespace {
+
+const int WARP_SIZE = 32;
+const int WARPS_PER_BLOCK = 8;
+const int MAX_DIM_PER_LANE = 8; // dimensions of at most 256
+
+// see AttentionLayout in src/tensors/cpu/fused_attention.cpp
+struct AttentionLayout {
+  int batchQ, batchK, heads, dimQ, dimK, dimHead, dimValue;
+  int maskStride[4];
+
+  AttentionLayout(Tensor q, Tensor k, Tensor v, Tensor mask) {
+    dimQ = q->shape()[-2];
+    dimK = k->shape()[-2];
+    dimHead = q->shape()[-1];
+    dimValue = v->shape()[-1];
+    heads = q->shape()[-3];
+    batchQ = q->shape().elements() / (dimQ * dimHead);
+    batchK = k->shape().elements() / (dimK * dimHead);
+    ABORT_IF(k->shape()[-1] != dimHead, "Keys {} do not match the queries {}", k->shape(), q->shape());
+    ABORT_IF(v->shape()[-2] != dimK || v->shape().elements() / (dimK * dimValue) != batchK,
+             "Values {} do not match the keys {}", v->shape(), k->shape());
+    ABORT_IF(batchQ % batchK != 0, "Batch of the keys {} does not broadcast to the queries {}", k->shape(), q->shape());
+    ABORT_IF(dimHead > WARP_SIZE * MAX_DIM_PER_LANE || dimValue > WARP_SIZE * MAX_DIM_PER_LANE,
+             "Fused attention on the GPU supports dimensions of at most {}", WARP_SIZE * MAX_DIM_PER_LANE);
+    for(int i = 0; i < 4; ++i)
+      maskStride[i] = 0;
+    if(mask) {
+      const auto& ms = mask->shape();
+      int dims[4] = {ms[-4], ms[-3], ms[-2], ms[-1]};
+      int full[4] = {batchQ / heads, heads, dimQ, dimK};
+      int stride = 1;
+      for(int i = 3; i >= 0; --i) {
+        ABORT_IF(dims[i] != 1 && dims[i] != full[i], "Attention mask {} does not broadcast to the scores", ms);
+        maskStride[i] = dims[i] == 1 ? 0 : stride;
+        stride *= dims[i];
+      }
+    }
+  }
+
+  __device__ int maskOffset(int batch, int row) const {
+    return (batch / heads) * maskStride[0] + (batch % heads) * maskStride[1] + row * maskStride[2];
+  }
+};
+
+__device__ inline float warpSum(float value) {
+  for(int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+    value += __shfl_xor_sync(0xffffffff, value, offset);
+  return value;
+}
+
+// the lane-local part of the dimensions of row, in registers
+template <typename T>
+__device__ inline void loadRow(float* reg, const T* row, int dim, int lane) {
+  for(int i = 0; i < MAX_DIM_PER_LANE; ++i) {
+    int d = lane + i * WARP_SIZE;
+    reg[i] = d < dim ? (float)row[d] : 0.f;
+  }
+}
+
+template <typename T>
+__device__ inline float warpDot(const float* reg, const T* row, int dim, int lane) {
+  float sum = 0.f;
+  for(int i = 0; i < MAX_DIM_PER_LANE; ++i) {
+    int d = lane + i * WARP_SIZE;
+    if(d < dim)
+      sum += reg[i] * (float)row[d];
+  }
+  return warpSum(sum);
+}
+
+template <typename T>
+__device__ inline float score(const AttentionLayout& layout, const float* qReg, const T* keys,
+                              const T* mask, int key, float scale, int lane) {
+  float s = scale * warpDot(qReg, keys + (size_t)key * layout.dimHead, layout.dimHead, lane);
+  if(mask)
+    s += (float)mask[key * layout.maskStride[3]];
+  return s;
+}
+
+template <typename T>
+__global__ void gFusedAttention(T* out, const T* q, const T* k, const T* v, const T* mask,
+                                AttentionLayout layout, float scale) {
+  int lane = threadIdx.x % WARP_SIZE;
+  int rows = layout.batchQ * layout.dimQ;
+  for(int r = blockIdx.x * WARPS_PER_BLOCK + threadIdx.x / WARP_SIZE; r < rows; r += gridDim.x * WARPS_PER_BLOCK) {
+    int batch = r / layout.dimQ, row = r % layout.dimQ;
+    int batchK = batch % layout.batchK;
+    const T* keys = k + (size_t)batchK * layout.dimK * layout.dimHead;
+    const T* values = v + (size_t)batchK * layout.dimK * layout.dimValue;
+    const T* maskRow = mask ? mask + layout.maskOffset(batch, row) : nullptr;
+
+    float qReg[MAX_DIM_PER_LANE], o[MAX_DIM_PER_LANE];
+    loadRow(qReg, q + (size_t)r * layout.dimHead, layout.dimHead, lane);
+    for(int i = 0; i < MAX_DIM_PER_LANE; ++i)
+      o[i] = 0.f;
+
+    float max = -CUDA_FLT_MAX;
+    float sum = 0.f;
+    for(int key = 0; key < layout.dimK; ++key) {
+      float s = score(layout, qReg, keys, maskRow, key, scale, lane);
+      if(s > max) { // rescale what has been accumulated so far
+        float rescale = __expf(max - s);
+        sum *= rescale;
+        for(int i = 0; i < MAX_DIM_PER_LANE; ++i)
+          o[i] *= rescale;
+        max = s;
+      }
+      float p = __expf(s - max);
+      sum += p;
+      const T* value = values + (size_t)key * layout.dimValue;
+      for(int i = 0; i < MAX_DIM_PER_LANE; ++i) {
+        int d = lane + i * WARP_SIZE;
+        if(d < layout.dimValue)
+          o[i] += p * (float)value[d];
+      }
+    }
+
+    T* oRow = out + (size_t)r * layout.dimValue;
+    for(int i = 0; i < MAX_DIM_PER_LANE; ++i) {
+      int d = lane + i * WARP_SIZE;
+      if(d < layout.dimValue)
+        oRow[d] = (T)(o[i] / sum);
+    }
+  }
+}
+
+__global__ void gFusedAttentionBackward(float* gradQ, float* gradK, float* gradV, const float* adj, const float* out,
+                                        const float* q, const float* k, const float* v, const float* mask,
+                                        AttentionLayout layout, float scale) {
+  int lane = threadIdx.x % WARP_SIZE;
+  int rows = layout.batchQ * layout.dimQ;
+  for(int r = blockIdx.x * WARPS_PER_BLOCK + threadIdx.x / WARP_SIZE; r < rows; r += gridDim.x * WARPS_PER_BLOCK) {
+    int batch = r / layout.dimQ, row = r % layout.dimQ;
+    int batchK = batch % layout.batchK;
+    const float* keys = k + (size_t)batchK * layout.dimK * layout.dimHead;
+    const float* values = v + (size_t)batchK * layout.dimK * layout.dimValue;
+    const float* maskRow = mask ? mask + layout.maskOffset(batch, row) : nullptr;
+
+    float qReg[MAX_DIM_PER_LANE], dO[MAX_DIM_PER_LANE], dq[MAX_DIM_PER_LANE];
+    loadRow(qReg, q + (size_t)r * layout.dimHead, layout.dimHead, lane);
+    loadRow(dO, adj + (size_t)r * layout.dimValue, layout.dimValue, lane);
+    for(int i = 0; i < MAX_DIM_PER_LANE; ++i)
+      dq[i] = 0.f;
+
+    float max = -CUDA_FLT_MAX;
+    float sum = 0.f;
+    for(int key = 0; key < layout.dimK; ++key) {
+      float s = score(layout, qReg, keys, maskRow, key, scale, lane);
+      if(s > max) {
+        sum *= __expf(max - s);
+        max = s;
+      }
+      sum += __expf(s - max);
+    }
+    float lse = max + __logf(sum);
+    float dOo = warpDot(dO, out + (size_t)r * layout.dimValue, layout.dimValue, lane); // sum_j p_j * dP_j
+
+    for(int key = 0; key < layout.dimK; ++key) {
+      float p = __expf(score(layout, qReg, keys, maskRow, key, scale, lane) - lse);
+      const float* value = values + (size_t)key * layout.dimValue;
+      if(gradV) {
+        float* dv = gradV + ((size_t)batchK * layout.dimK + key) * layout.dimValue;
+        for(int i = 0; i < MAX_DIM_PER_LANE; ++i) {
+          int d = lane + i * WARP_SIZE;
+          if(d < layout.dimValue)
+            atomicAdd(dv + d, p * dO[i]);
+        }
+      }
+      float dS = scale * p * (warpDot(dO, value, layout.dimValue, lane) - dOo);
+      const float* kRow = keys + (size_t)key * layout.dimHead;
+      float* dk = gradK ? gradK + ((size_t)batchK * layout.dimK + key) * layout.dimHead : nullptr;
+      for(int i = 0; i < MAX_DIM_PER_LANE; ++i) {
+        int d = lane + i * WARP_SIZE;
+        if(d < layout.dimHead) {
+          dq[i] += dS * kRow[d];
+          if(dk)
+            atomicAdd(dk + d, dS * qReg[i]);
+        }
+      }
+    }
+
+    if(gradQ) {
+      float* dQRow = gradQ + (size_t)r * layout.dimHead;
+      for(int i = 0; i < MAX_DIM_PER_LANE; ++i) {
+        int d = lane + i * WARP_SIZE;
+        if(d < layout.dimHead)
+          dQRow[d] += dq[i];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void FusedAttention(Tensor out, const Tensor q, const Tensor k, const Tensor v, const Tensor mask, float scale) {
+  cudaSetDevice(out->getDeviceId().no);
+  AttentionLayout layout(q, k, v, mask);
+
+  int rows = layout.batchQ * layout.dimQ;
+  int blocks = std::min(MAX_BLOCKS, rows / WARPS_PER_BLOCK + (rows % WARPS_PER_BLOCK != 0));
+  int threads = WARPS_PER_BLOCK * WARP_SIZE;
+
+  if(out->type() == Type::float32) {
+    gFusedAttention<<<blocks, threads>>>(out->data<float>(), q->data<float>(), k->data<float>(), v->data<float>(),
+                                         mask ? mask->data<float>() : nullptr, layout, scale);
+#if COMPILE_FP16
+  } else if(out->type() == Type::float16) {
+    gFusedAttention<<<blocks, threads>>>(out->data<half>(), q->data<half>(), k->data<half>(), v->data<half>(),
+                                         mask ? mask->data<half>() : nullptr, layout, scale);
+#endif
+  } else {
+    ABORT("FusedAttention not implemented for type {}", out->type());
+  }
+}
+
+void FusedAttentionBackward(Tensor gradQ, Tensor gradK, Tensor gradV, Tensor adj, Tensor out,
+                            Tensor q, Tensor k, Tensor v, Tensor mask, float scale) {
+  cudaSetDevice(adj->getDeviceId().no);
+  ABORT_IF(adj->type() != Type::float32, "FusedAttentionBackward not implemented for type {}", adj->type());
+  AttentionLayout layout(q, k, v, mask);
+
+  int rows = layout.batchQ * layout.dimQ;
+  int blocks = std::min(MAX_BLOCKS, rows / WARPS_PER_BLOCK + (rows % WARPS_PER_BLOCK != 0));
+  int threads = WARPS_PER_BLOCK * WARP_SIZE;
+
+  gFusedAttentionBackward<<<blocks, threads>>>(gradQ ? gradQ->data<float>() : nullptr,
+                                               gradK ? gradK->data<float>() : nullptr,
+                                               gradV ? gradV->data<float>() : nullptr,
+                                               adj->data<float>(), out->data<float>(),
+                                               q->data<float>(), k->data<float>(), v->data<float>(),
+                                               mask ? mask->data<float>() : nullptr, layout, scale);
+}
+
+}  // namespace gpu
+}  // namespace marian
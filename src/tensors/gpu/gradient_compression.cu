@@ -0,0 +1,243 @@
+#include "tensors/gpu/gradient_compression.h"
+#include "tensors/gpu/cuda_helpers.h"
+
+#include <cuda_fp16.h>
+#include <thrust/device_ptr.h>
+#include <thrust/sort.h>
+
+namespace marian {
+namespace gpu {
+
+static int numBlocks(size_t size) {
+  return (int)std::min((size_t)MAX_BLOCKS, (size + MAX_THREADS - 1) / MAX_THREADS);
+}
+
+__global__ void gCompressToHalf(__half* out, const float* grads, float* residual, size_t size, float scale) {
+  const float maxHalf = 65504.f;
+  for(size_t index = blockIdx.x * blockDim.x + threadIdx.x; index < size; index += blockDim.x * gridDim.x) {
+    float x = grads[index] + residual[index];
+    __half h = __float2half(fminf(fmaxf(x * scale, -maxHalf), maxHalf));
+    residual[index] = x - __half2float(h) / scale;
+    out[index] = h;
+  }
+}
+
+__global__ void gDecompressFromHalf(float* out, const __half* in, size_t size, float scale) {
+  for(size_t index = blockIdx.x * blockDim.x + threadIdx.x; index < size; index += blockDim.x * gridDim.x)
+    out[index] = __half2float(in[index]) / scale;
+}
+
+void CompressGradientsToHalf(void* out, const float* grads, float* residual, size_t size, float scale) {
+  if(size == 0)
+    return;
+  gCompressToHalf<<<numBlocks(size), MAX_THREADS>>>((__half*)out, grads, residual, size, scale);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+void DecompressGradientsFromHalf(float* out, const void* in, size_t size, float scale) {
+  if(size == 0)
+    return;
+  gDecompressFromHalf<<<numBlocks(size), MAX_THREADS>>>(out, (const __half*)in, size, scale);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+size_t compressedSegmentBytes(size_t segmentSize, int bits) {
+  return (segmentSize * bits + 7) / 8;
+}
+
+// one block per segment, scales[segment] = max(abs(grads + residual)) over the segment
+__global__ void gSegmentAbsMax(float* scales, const float* grads, const float* residual, size_t segmentSize) {
+  extern __shared__ float _share[];
+  const float* g = grads + blockIdx.x * segmentSize;
+  const float* r = residual + blockIdx.x * segmentSize;
+
+  float m = 0.f;
+  for(size_t j = threadIdx.x; j < segmentSize; j += blockDim.x)
+    m = fmaxf(m, fabsf(g[j] + r[j]));
+  _share[threadIdx.x] = m;
+  __syncthreads();
+
+  for(int len = blockDim.x / 2; len > 0; len /= 2) {
+    if(threadIdx.x < len)
+      _share[threadIdx.x] = fmaxf(_share[threadIdx.x], _share[threadIdx.x + len]);
+    __syncthreads();
+  }
+  if(threadIdx.x == 0)
+    scales[blockIdx.x] = _share[0];
+}
+
+// one thread per output byte, which holds 8/bits values; a value is stored as its level + maxLevel
+__global__ void gCompressToBits(uint8_t* out,
+                                const float* scales,
+                                const float* grads,
+                                float* residual,
+                                size_t segmentSize,
+                                size_t segmentBytes,
+                                size_t numSegments,
+                                int bits) {
+  int perByte = 8 / bits;
+  float maxLevel = (float)((1 << (bits - 1)) - 1);
+  for(size_t index = blockIdx.x * blockDim.x + threadIdx.x; index < numSegments * segmentBytes; index += blockDim.x * gridDim.x) {
+    size_t segment = index / segmentBytes;
+    float scale = scales[segment];
+    uint8_t code = 0;
+    for(int k = 0; k < perByte; ++k) {
+      size_t j = (index % segmentBytes) * perByte + k;
+      if(j >= segmentSize)
+        break;
+      size_t i = segment * segmentSize + j;
+      float x = grads[i] + residual[i];
+      float level = scale > 0.f ? fminf(fmaxf(rintf(x / scale * maxLevel), -maxLevel), maxLevel) : 0.f;
+      residual[i] = x - level * scale / maxLevel;
+      code |= (uint8_t)(level + maxLevel) << (k * bits);
+    }
+    out[index] = code;
+  }
+}
+
+__global__ void gDecompressAndSumFromBits(float* out,
+                                          const uint8_t* in,
+                                          const float* scales,
+                                          size_t segmentSize,
+                                          size_t segmentBytes,
+                                          size_t numSegments,
+                                          int bits) {
+  int perByte = 8 / bits;
+  int mask = (1 << bits) - 1;
+  float maxLevel = (float)((1 << (bits - 1)) - 1);
+  for(size_t j = blockIdx.x * blockDim.x + threadIdx.x; j < segmentSize; j += blockDim.x * gridDim.x) {
+    float sum = 0.f;
+    for(size_t s = 0; s < numSegments; ++s) {
+      int code = (in[s * segmentBytes + j / perByte] >> ((j % perByte) * bits)) & mask;
+      sum += (code - maxLevel) * scales[s] / maxLevel;
+    }
+    out[j] = sum;
+  }
+}
+
+void CompressGradientsToBits(uint8_t* out,
+                             float* scales,
+                             const float* grads,
+                             float* residual,
+                             size_t segmentSize,
+                             size_t numSegments,
+                             int bits) {
+  ABORT_IF(bits != 8 && bits != 4, "Gradients cannot be compressed to {} bits", bits);
+  if(segmentSize == 0 || numSegments == 0)
+    return;
+
+  gSegmentAbsMax<<<(int)numSegments, MAX_THREADS, MAX_THREADS * sizeof(float)>>>(scales, grads, residual, segmentSize);
+  CUDA_CHECK(cudaPeekAtLastError());
+
+  size_t segmentBytes = compressedSegmentBytes(segmentSize, bits);
+  gCompressToBits<<<numBlocks(numSegments * segmentBytes), MAX_THREADS>>>(
+      out, scales, grads, residual, segmentSize, segmentBytes, numSegments, bits);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+void DecompressAndSumGradientsFromBits(float* out,
+                                       const uint8_t* in,
+                                       const float* scales,
+                                       size_t segmentSize,
+                                       size_t numSegments,
+                                       int bits) {
+  ABORT_IF(bits != 8 && bits != 4, "Gradients cannot be compressed to {} bits", bits);
+  if(segmentSize == 0)
+    return;
+
+  size_t segmentBytes = compressedSegmentBytes(segmentSize, bits);
+  gDecompressAndSumFromBits<<<numBlocks(segmentSize), MAX_THREADS>>>(
+      out, in, scales, segmentSize, segmentBytes, numSegments, bits);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+__global__ void gSampleAbs(float* sample, const float* grads, const float* residual, size_t sampleSize, size_t stride) {
+  for(size_t index = blockIdx.x * blockDim.x + threadIdx.x; index < sampleSize; index += blockDim.x * gridDim.x) {
+    size_t i = index * stride;
+    sample[index] = fabsf(grads[i] + residual[i]);
+  }
+}
+
+// the values above the threshold take the next free slot while there is one, all others go to the residual
+__global__ void gDropGradients(uint32_t* indices,
+                               float* values,
+                               size_t capacity,
+                               const float* grads,
+                               float* residual,
+                               size_t size,
+                               float threshold,
+                               int* counter) {
+  for(size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < size; i += blockDim.x * gridDim.x) {
+    float x = grads[i] + residual[i];
+    residual[i] = x;
+    if(fabsf(x) > threshold) {
+      int slot = atomicAdd(counter, 1);
+      if((size_t)slot < capacity) {
+        indices[slot] = (uint32_t)i;
+        values[slot] = x;
+        residual[i] = 0.f;
+      }
+    }
+  }
+}
+
+__global__ void gScatterAddSparse(float* out,
+                                  const uint32_t* indices,
+                                  const float* values,
+                                  size_t count,
+                                  size_t begin,
+                                  size_t end) {
+  for(size_t index = blockIdx.x * blockDim.x + threadIdx.x; index < count; index += blockDim.x * gridDim.x) {
+    size_t i = indices[index];
+    if(i >= begin && i < end && values[index] != 0.f)
+      atomicAdd(out + (i - begin), values[index]);
+  }
+}
+
+float DropGradients(uint32_t* indices,
+                    float* values,
+                    size_t capacity,
+                    const float* grads,
+                    float* residual,
+                    size_t size,
+                    float* sample,
+                    size_t sampleSize,
+                    int* counter) {
+  CUDA_CHECK(cudaMemset(indices, 0, capacity * sizeof(uint32_t)));
+  CUDA_CHECK(cudaMemset(values, 0, capacity * sizeof(float)));
+  CUDA_CHECK(cudaMemset(counter, 0, sizeof(int)));
+  if(size == 0 || capacity == 0)
+    return 0.f;
+
+  // the threshold is the quantile of the kept fraction among the sampled absolute values
+  sampleSize = std::min(sampleSize, size);
+  size_t stride = size / sampleSize;
+  gSampleAbs<<<numBlocks(sampleSize), MAX_THREADS>>>(sample, grads, residual, sampleSize, stride);
+  CUDA_CHECK(cudaPeekAtLastError());
+  thrust::device_ptr<float> samplePtr(sample);
+  thrust::sort(samplePtr, samplePtr + sampleSize);
+
+  double keep = std::min(1.0, (double)capacity / size);
+  size_t cut = (size_t)std::max(0.0, sampleSize * (1.0 - keep) - 1);
+  float threshold;
+  CUDA_CHECK(cudaMemcpy(&threshold, sample + cut, sizeof(float), cudaMemcpyDeviceToHost));
+
+  gDropGradients<<<numBlocks(size), MAX_THREADS>>>(indices, values, capacity, grads, residual, size, threshold, counter);
+  CUDA_CHECK(cudaPeekAtLastError());
+  return threshold;
+}
+
+void ScatterAddSparseGradients(float* out,
+                               const uint32_t* indices,
+                               const float* values,
+                               size_t count,
+                               size_t begin,
+                               size_t end) {
+  if(count == 0 || begin >= end)
+    return;
+  gScatterAddSparse<<<numBlocks(count), MAX_THREADS>>>(out, indices, values, count, begin, end);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+}  // namespace gpu
+}  // namespace marian
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace marian {
+namespace gpu {
+
+// Kernels of the compressed gradient communication of the NCCLCommunicator, see --gradient-compression.
+// They run on the default stream of the current device. `residual` is the error feedback: what the
+// previous compression lost is added to the gradients before they are compressed, and what this
+// compression loses is stored for the next one.
+
+// out = fp16((grads + residual) * scale), clipped to the range of fp16
+void CompressGradientsToHalf(void* out, const float* grads, float* residual, size_t size, float scale);
+// out = float(in) / scale
+void DecompressGradientsFromHalf(float* out, const void* in, size_t size, float scale);
+
+// Bytes of a segment of `segmentSize` values with `bits` (8 or 4) per value
+size_t compressedSegmentBytes(size_t segmentSize, int bits);
+
+// Compresses `numSegments` consecutive segments of `segmentSize` values to `bits` per value each. A value
+// is rounded to one of 2^(bits-1)-1 levels on either side of 0 between -scale and scale, where the scale
+// of a segment is its maximum absolute value, written to scales[segment]. Segment s is written to
+// out + s * compressedSegmentBytes(segmentSize, bits).
+void CompressGradientsToBits(uint8_t* out,
+                             float* scales,
+                             const float* grads,
+                             float* residual,
+                             size_t segmentSize,
+                             size_t numSegments,
+                             int bits);
+
+// out = the sum of the `numSegments` compressed segments in `in`, `out` has `segmentSize` values
+void DecompressAndSumGradientsFromBits(float* out,
+                                       const uint8_t* in,
+                                       const float* scales,
+                                       size_t segmentSize,
+                                       size_t numSegments,
+                                       int bits);
+
+// Gradient dropping, --gradient-compression topk: selects up to `capacity` of the values grads + residual
+// with the largest absolute values, whose threshold is estimated from a strided sample of at most
+// `sampleSize` values, which `sample` has room for. The selected values and their indices are written
+// to `values` and `indices`, the slots left over are (0, 0.f). The selected values are removed from the
+// residual, the others are kept in it for the next update. `counter` is a device int for the
+// compaction. Returns the threshold.
+float DropGradients(uint32_t* indices,
+                    float* values,
+                    size_t capacity,
+                    const float* grads,
+                    float* residual,
+                    size_t size,
+                    float* sample,
+                    size_t sampleSize,
+                    int* counter);
+
+// out[index - begin] += value for the `count` pairs in indices and values with index in [begin, end)
+void ScatterAddSparseGradients(float* out,
+                               const uint32_t* indices,
+                               const float* values,
+                               size_t count,
+                               size_t begin,
+                               size_t end);
+
+}  // namespace gpu
+}  // namespace marian
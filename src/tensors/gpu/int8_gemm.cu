@@ -0,0 +1,298 @@
+#include "tensors/gpu/int8_gemm.h"
+
+#include "common/hash.h"
+#include "tensors/gpu/backend.h"
+#include "tensors/gpu/cuda_helpers.h"
+#include "tensors/gpu/prod.h"
+
+namespace marian {
+namespace gpu {
+
+namespace {
+
+const int QUANTIZE_THREADS = 256; // a power of 2 for the reduction of the row maximum
+
+// Quantizes each row of `in`, [rows, cols], with the scale of its largest absolute value, one block
+// per row. The maximum and the quantization share one launch and read the row twice from the cache.
+template <typename T>
+__global__ void gQuantizeRows(int8_t* out, float* scales, const T* in, int rows, int cols) {
+  __shared__ float shared[QUANTIZE_THREADS];
+  for(int bid = 0; bid < rows; bid += gridDim.x) {
+    int j = bid + blockIdx.x;
+    if(j < rows) {
+      const T* rowIn = in + (size_t)j * cols;
+      float max = 0.f;
+      for(int i = threadIdx.x; i < cols; i += blockDim.x)
+        max = fmaxf(max, fabsf((float)rowIn[i]));
+      shared[threadIdx.x] = max;
+      __syncthreads();
+      for(int s = blockDim.x / 2; s > 0; s >>= 1) {
+        if(threadIdx.x < s)
+          shared[threadIdx.x] = fmaxf(shared[threadIdx.x], shared[threadIdx.x + s]);
+        __syncthreads();
+      }
+      float scale = shared[0] > 0.f ? shared[0] / 127.f : 1.f;
+      __syncthreads(); // shared is reused by the next row of this block
+
+      if(threadIdx.x == 0)
+        scales[j] = scale;
+      int8_t* rowOut = out + (size_t)j * cols;
+      for(int i = threadIdx.x; i < cols; i += blockDim.x)
+        rowOut[i] = (int8_t)__float2int_rn(fminf(fmaxf((float)rowIn[i] / scale, -127.f), 127.f));
+    }
+  }
+}
+
+// out = scalar * scalesA[i] * scalesB[j] * acc + bias[j], then max(0, .) if relu, for [rows, cols]
+template <typename T>
+__global__ void gDequantizeProduct(T* out,
+                                   const int32_t* acc,
+                                   const float* scalesA,
+                                   const float* scalesB,
+                                   const T* bias,
+                                   float scalar,
+                                   bool relu,
+                                   int rows,
+                                   int cols) {
+  size_t n = (size_t)rows * cols;
+  for(size_t idx = blockIdx.x * (size_t)blockDim.x + threadIdx.x; idx < n; idx += (size_t)gridDim.x * blockDim.x) {
+    int i = (int)(idx / cols), j = (int)(idx % cols);
+    float v = scalar * scalesA[i] * scalesB[j] * (float)acc[idx];
+    if(bias)
+      v += (float)bias[j];
+    if(relu)
+      v = fmaxf(v, 0.f);
+    out[idx] = (T)v;
+  }
+}
+
+// out [k, n] = the int8cols matrix of n stored rows of k values, dequantized
+template <typename T>
+__global__ void gDequantizeColumns(T* out, const int8_t* in, const float* scales, int k, int n) {
+  size_t total = (size_t)k * n;
+  for(size_t idx = blockIdx.x * (size_t)blockDim.x + threadIdx.x; idx < total; idx += (size_t)gridDim.x * blockDim.x) {
+    int r = (int)(idx / n), j = (int)(idx % n);
+    out[idx] = (T)(scales[j] * (float)in[(size_t)j * k + r]);
+  }
+}
+
+// adds a row vector bias (may be nullptr) to out [rows, cols], then max(0, .) if relu
+template <typename T>
+__global__ void gBiasRelu(T* out, const T* bias, bool relu, int rows, int cols) {
+  size_t n = (size_t)rows * cols;
+  for(size_t idx = blockIdx.x * (size_t)blockDim.x + threadIdx.x; idx < n; idx += (size_t)gridDim.x * blockDim.x) {
+    float v = (float)out[idx];
+    if(bias)
+      v += (float)bias[idx % cols];
+    if(relu)
+      v = fmaxf(v, 0.f);
+    out[idx] = (T)v;
+  }
+}
+
+// one block per selected column, i.e. stored row, and its scale
+__global__ void gSelectColumnsInt8(int8_t* out,
+                                   float* outScales,
+                                   const int8_t* in,
+                                   const float* inScales,
+                                   const IndexType* indices,
+                                   int k,
+                                   int selected) {
+  for(int bid = 0; bid < selected; bid += gridDim.x) {
+    int j = bid + blockIdx.x;
+    if(j < selected) {
+      size_t src = indices[j];
+      for(int i = threadIdx.x; i < k; i += blockDim.x)
+        out[(size_t)j * k + i] = in[src * k + i];
+      if(threadIdx.x == 0)
+        outScales[j] = inScales[src];
+    }
+  }
+}
+
+// the scales behind the n x k int8 values of an int8cols matrix
+static inline const float* columnScales(const Tensor& B, int k, int n) {
+  return reinterpret_cast<const float*>(B->data<int8_t>() + (size_t)n * k);
+}
+
+static inline int elementwiseBlocks(size_t n, int threads) {
+  return (int)std::min((size_t)MAX_BLOCKS, (n + threads - 1) / threads);
+}
+
+#if CUDA_VERSION >= 11000
+// acc [m, n] = Aq [m, k] * Bq [n, k]^T in int32 with cuBLASLt. Both operands are row-major with k
+// columns, i.e. column-major [k, m] and [k, n], the TN layout of the int8 IMMA kernels. Returns false
+// if cuBLASLt has no algorithm for these shapes, e.g. on GPUs without int8 support.
+static bool ProdInt8(int32_t* acc, const int8_t* Aq, const int8_t* Bq, int m, int n, int k, Ptr<gpu::Backend> backend) {
+  // the heuristic query is not free, its result is cached per problem
+  size_t key = 0;
+  for(size_t v : {(size_t)m, (size_t)n, (size_t)k, (size_t)CUDA_R_8I, (size_t)CUBLAS_COMPUTE_32I})
+    util::hash_combine(key, v);
+
+  cublasOperation_t opT = CUBLAS_OP_T, opN = CUBLAS_OP_N;
+  cublasLtMatmulDesc_t operation;
+  CUBLAS_CHECK(cublasLtMatmulDescCreate(&operation, CUBLAS_COMPUTE_32I, CUDA_R_32I));
+  CUBLAS_CHECK(cublasLtMatmulDescSetAttribute(operation, CUBLASLT_MATMUL_DESC_TRANSA, &opT, sizeof(opT)));
+  CUBLAS_CHECK(cublasLtMatmulDescSetAttribute(operation, CUBLASLT_MATMUL_DESC_TRANSB, &opN, sizeof(opN)));
+
+  cublasLtMatrixLayout_t layoutB, layoutA, layoutC;
+  CUBLAS_CHECK(cublasLtMatrixLayoutCreate(&layoutB, CUDA_R_8I, k, n, k));
+  CUBLAS_CHECK(cublasLtMatrixLayoutCreate(&layoutA, CUDA_R_8I, k, m, k));
+  CUBLAS_CHECK(cublasLtMatrixLayoutCreate(&layoutC, CUDA_R_32I, n, m, n));
+
+  auto ltHandle = backend->getCublasLtHandle();
+  void* workspace = backend->getCublasLtWorkspace();
+  size_t workspaceSize = gpu::Backend::cublasLtWorkspaceSize;
+
+  auto& algorithms = backend->getCublasLtAlgorithms();
+  auto it = algorithms.find(key);
+  if(it == algorithms.end()) {
+    cublasLtMatmulPreference_t preference;
+    CUBLAS_CHECK(cublasLtMatmulPreferenceCreate(&preference));
+    CUBLAS_CHECK(cublasLtMatmulPreferenceSetAttribute(preference, CUBLASLT_MATMUL_PREF_MAX_WORKSPACE_BYTES, &workspaceSize, sizeof(workspaceSize)));
+
+    cublasLtMatmulHeuristicResult_t heuristic = {};
+    int found = 0;
+    cublasStatus_t rc = cublasLtMatmulAlgoGetHeuristic(ltHandle, operation, layoutB, layoutA, layoutC, layoutC,
+                                                       preference, 1, &heuristic, &found);
+    CUBLAS_CHECK(cublasLtMatmulPreferenceDestroy(preference));
+
+    // unsupported problems are remembered as well to not ask again
+    if(rc != CUBLAS_STATUS_SUCCESS || found == 0) {
+      heuristic.state = CUBLAS_STATUS_NOT_SUPPORTED;
+      LOG(debug, "[gpu] No cuBLASLt int8 algorithm for {}x{}x{}, multiplying dequantized weights", m, n, k);
+    }
+    it = algorithms.emplace(key, heuristic).first;
+  }
+
+  bool supported = it->second.state == CUBLAS_STATUS_SUCCESS;
+  if(supported) {
+    int32_t alpha = 1, beta = 0;
+    CUBLAS_CHECK(cublasLtMatmul(ltHandle,
+                                operation,
+                                &alpha,
+                                Bq, layoutB,
+                                Aq, layoutA,
+                                &beta,
+                                acc, layoutC,
+                                acc, layoutC,
+                                &it->second.algo,
+                                workspace,
+                                workspaceSize,
+                                backend->getStream()));
+  }
+
+  CUBLAS_CHECK(cublasLtMatrixLayoutDestroy(layoutC));
+  CUBLAS_CHECK(cublasLtMatrixLayoutDestroy(layoutA));
+  CUBLAS_CHECK(cublasLtMatrixLayoutDestroy(layoutB));
+  CUBLAS_CHECK(cublasLtMatmulDescDestroy(operation));
+
+  return supported;
+}
+#endif
+
+template <typename T>
+void AffineInt8Typed(Tensor C,
+                     Ptr<Allocator> allocator,
+                     const Tensor& A,
+                     const Tensor& B,
+                     const Tensor& bias,
+                     float scalar,
+                     bool relu) {
+  CUDA_CHECK(cudaSetDevice((int)C->getDeviceId().no));
+  auto backend = std::static_pointer_cast<gpu::Backend>(C->getBackend());
+
+  int k = A->shape()[-1];
+  int m = (int)(A->shape().elements() / k);
+  int n = B->shape()[-1];
+  ABORT_IF(B->shape().size() != 2 || B->shape()[0] != k,
+           "Matrix product requires inner dimensions to match in {} * {}", A->shape(), B->shape());
+  ABORT_IF(k % 4 != 0, "The int8 GEMM needs an inner dimension that is a multiple of 4, not {}", k);
+  ABORT_IF(bias && bias->shape().elements() != n, "Bias {} does not match the {} columns of the product", bias->shape(), n);
+
+  const int8_t* Bq = B->data<int8_t>();
+  const float* scalesB = columnScales(B, k, n);
+  const T* biasData = bias ? bias->data<T>() : nullptr;
+  size_t outElements = (size_t)m * n;
+  int threads = MAX_THREADS;
+
+  bool done = false;
+#if CUDA_VERSION >= 11000
+  // cuBLASLt wants leading dimensions of int8 and int32 matrices that are multiples of 4
+  if(n % 4 == 0) {
+    auto mpA = allocator->alloc<int8_t>((size_t)m * k);
+    auto mpScalesA = allocator->alloc<float>(m);
+    auto mpAcc = allocator->alloc<int32_t>(outElements);
+
+    int blocks = std::min(MAX_BLOCKS, m);
+    gQuantizeRows<<<blocks, QUANTIZE_THREADS>>>(mpA->data<int8_t>(), mpScalesA->data<float>(), A->data<T>(), m, k);
+    CUDA_CHECK(cudaPeekAtLastError());
+
+    done = ProdInt8(mpAcc->data<int32_t>(), mpA->data<int8_t>(), Bq, m, n, k, backend);
+    if(done) {
+      gDequantizeProduct<<<elementwiseBlocks(outElements, threads), threads>>>(
+          C->data<T>(), mpAcc->data<int32_t>(), mpScalesA->data<float>(), scalesB, biasData, scalar, relu, m, n);
+      CUDA_CHECK(cudaPeekAtLastError());
+    }
+
+    allocator->free(mpAcc);
+    allocator->free(mpScalesA);
+    allocator->free(mpA);
+  }
+#endif
+
+  if(!done) { // float product with the weights dequantized
+    auto mpB = allocator->alloc<T>((size_t)k * n);
+    Tensor dequantized = TensorBase::New(mpB, Shape({k, n}), C->type(), C->getBackend());
+    gDequantizeColumns<<<elementwiseBlocks((size_t)k * n, threads), threads>>>(dequantized->data<T>(), Bq, scalesB, k, n);
+    CUDA_CHECK(cudaPeekAtLastError());
+
+    Prod(C, A, dequantized, /*transA=*/false, /*transB=*/false, 0.f, scalar);
+    if(biasData || relu) {
+      gBiasRelu<<<elementwiseBlocks(outElements, threads), threads>>>(C->data<T>(), biasData, relu, m, n);
+      CUDA_CHECK(cudaPeekAtLastError());
+    }
+    allocator->free(mpB);
+  }
+}
+
+}  // namespace
+
+void AffineInt8(Tensor C,
+                Ptr<Allocator> allocator,
+                const Tensor& A,
+                const Tensor& B,
+                const Tensor& bias,
+                float scalar,
+                bool relu) {
+  ABORT_IF(!isColQuantized(B->type()), "The int8 GEMM expects B of type {}, not {}", Type::int8cols, B->type());
+  if(C->type() == Type::float32) {
+    AffineInt8Typed<float>(C, allocator, A, B, bias, scalar, relu);
+#if COMPILE_FP16
+  } else if(C->type() == Type::float16) {
+    AffineInt8Typed<half>(C, allocator, A, B, bias, scalar, relu);
+#endif
+  } else {
+    ABORT("AffineInt8 not implemented for type {}", C->type());
+  }
+}
+
+void SelectColumnsInt8(Tensor out, const Tensor& in, const Tensor& indices) {
+  CUDA_CHECK(cudaSetDevice((int)out->getDeviceId().no));
+  int k = in->shape()[0];
+  int n = in->shape()[1];
+  int selected = (int)indices->size();
+  ABORT_IF(out->shape()[0] != k || out->shape()[1] != selected,
+           "Selecting {} columns of {} into {}", selected, in->shape(), out->shape());
+
+  int8_t* outData = out->data<int8_t>();
+  float* outScales = reinterpret_cast<float*>(outData + (size_t)selected * k);
+  int threads = std::min(MAX_THREADS, k);
+  int blocks = std::min(MAX_BLOCKS, selected);
+  gSelectColumnsInt8<<<blocks, threads>>>(
+      outData, outScales, in->data<int8_t>(), columnScales(in, k, n), indices->data<IndexType>(), k, selected);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+}  // namespace gpu
+}  // namespace marian
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "tensors/allocator.h"
+#include "tensors/tensor.h"
+
+namespace marian {
+namespace gpu {
+
+// 8-bit matrix products on the tensor cores (IMMA) of Turing and newer GPUs for weights of
+// Type::int8cols, which marian-conv --gemm-type int8cols produces. Such a matrix B [k, n] is stored as
+// its transpose, n rows of k int8 values, followed by one float32 scale per column of B, so that
+// B = scale[j] * Bq[j, :]^T. The activations are quantized at run time with one scale per row.
+
+// C = scalar * A * B (+ bias), followed by a ReLU if `relu` is set, for A [..., k] of float32 or
+// float16 and B of Type::int8cols. bias may be nullptr. The rows of A are quantized to 8 bits in one
+// pass, cuBLASLt accumulates in int32, and a single epilogue scales, adds the bias and applies the
+// ReLU. Falls back to a float product with B dequantized if cuBLASLt has no int8 algorithm for the shapes.
+void AffineInt8(Tensor C,
+                Ptr<Allocator> allocator,
+                const Tensor& A,
+                const Tensor& B,
+                const Tensor& bias,
+                float scalar,
+                bool relu);
+
+// out = the columns `indices` of the int8cols matrix `in`, with their scales, e.g. for a shortlist
+void SelectColumnsInt8(Tensor out, const Tensor& in, const Tensor& indices);
+
+}  // namespace gpu
+}  // namespace marian
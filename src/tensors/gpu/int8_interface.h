@@ -0,0 +1,68 @@
+#pragma once
+
+#include "graph/expression_graph.h"
+#include "graph/expression_operators.h"
+
+#ifdef CUDA_FOUND
+#include "tensors/gpu/int8_gemm.h"
+#endif
+
+namespace marian {
+namespace gpu {
+namespace int8 {
+
+// Expressions for the 8-bit weights of Type::int8cols on the GPU, the counterpart of the intgemm
+// interface of the CPU. They are only used for inference and have no backward step.
+
+/*
+ * This computes A*B (+ bias if available), followed by a ReLU if `relu` is set, with the int8 GEMM.
+ * Expr a: The activations, float32 or float16, quantized on the fly
+ * Expr b: The parameter matrix of Type::int8cols, never transposed
+ * Expr bias: The bias, may be nullptr
+ */
+static inline Expr affineOrDot(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale, bool relu = false) {
+  ABORT_IF(!isFloat(a->value_type()), "The int8 GEMM expects type of A to be float not {}", a->value_type());
+  ABORT_IF(!isColQuantized(b->value_type()), "The int8 GEMM expects type of B to be {} not {}", Type::int8cols, b->value_type());
+  ABORT_IF(transB, "The int8 matrix {} cannot be multiplied transposed", b->name());
+  if(transA)
+    a = transpose(a);
+  ABORT_IF(a->shape()[-1] != b->shape()[0],
+           "Matrix product requires inner dimensions to match in {} * {}", a->shape(), b->shape());
+
+  Shape outShape = a->shape();
+  outShape.set(-1, b->shape()[-1]);
+
+  auto nodeOp = [scale, relu](Expr out, const std::vector<Expr>& children) {
+#ifdef CUDA_FOUND
+    Tensor bias = children.size() > 2 ? children[2]->val() : nullptr;
+    AffineInt8(out->val(), out->graph()->allocator(), children[0]->val(), children[1]->val(), bias, scale, relu);
+#else
+    out; children; scale; relu; // fool warnings
+    ABORT("Matrices of type {} need a build with CUDA", Type::int8cols);
+#endif
+  };
+
+  std::vector<Expr> children = {a, b};
+  if(bias)
+    children.push_back(bias);
+  return lambda(children, outShape, a->value_type(), nodeOp);
+}
+
+// The columns `indices` of the int8cols matrix b, e.g. the shortlist of the output layer, in int8cols form
+static inline Expr selectColumnsB(Expr b, Expr indices) {
+  ABORT_IF(b->shape().size() != 2, "Cannot select columns of the int8 tensor {} {}", b->name(), b->shape());
+  auto nodeOp = [](Expr out, const std::vector<Expr>& children) {
+#ifdef CUDA_FOUND
+    SelectColumnsInt8(out->val(), children[0]->val(), children[1]->val());
+#else
+    out; children; // fool warnings
+    ABORT("Matrices of type {} need a build with CUDA", Type::int8cols);
+#endif
+  };
+  Shape outShape = {b->shape()[0], (int)indices->shape().elements()};
+  return lambda({b, indices}, outShape, Type::int8cols, nodeOp);
+}
+
+}  // namespace int8
+}  // namespace gpu
+}  // namespace marian
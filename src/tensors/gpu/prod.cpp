@@ -10,6 +10,7 @@
 #include "tensors/gpu/prod.h"
 #include "tensors/gpu/backend.h"
 #include "tensors/gpu/cuda_helpers.h"
+#include "common/hash.h"
 // clang-format on
 
 namespace marian {
@@ -192,6 +193,169 @@ void Prod(marian::Tensor C,
   }
 }
 
+#if CUDA_VERSION >= 11000
+// largest power of two up to 256 that divides the address, cuBLASLt heuristics depend on it
+static uint32_t alignmentOf(const void* ptr) {
+  uint32_t alignment = 256;
+  while(alignment > 1 && (size_t)ptr % alignment != 0)
+    alignment /= 2;
+  return alignment;
+}
+
+template <typename T>
+static bool ProdWithBiasTyped(marian::Tensor C,
+                              const marian::Tensor& A,
+                              const marian::Tensor& B,
+                              const marian::Tensor& bias,
+                              bool transA,
+                              bool transB,
+                              T beta,
+                              T scalar,
+                              bool relu,
+                              cudaDataType_t dataType) {
+  CUDA_CHECK(cudaSetDevice((int)C->getDeviceId().no));
+
+  // same row-major to column-major mapping as in ProdTyped: C^T = op(B)^T * op(A)^T
+  int m = A->shape().elements() / A->shape().back();
+  int k = A->shape().back();
+  if(transA)
+    std::swap(m, k);
+
+  int l = B->shape().elements() / B->shape().back();
+  int n = B->shape().back();
+  if(transB)
+    std::swap(l, n);
+
+  int lda = A->shape().back();
+  int ldb = B->shape().back();
+  int ldc = n;
+
+  // the epilogue adds a vector along the rows of the column-major result, i.e. a row vector to C
+  if(bias->shape().elements() != n)
+    return false;
+
+  auto backend = std::static_pointer_cast<gpu::Backend>(C->getBackend());
+  auto computeCapability = backend->getCudaComputeCapability();
+  if(computeCapability.major < 5)
+    return false;
+
+  // float32 products follow the TensorCore setting of cuBLAS, see setTensorMode()
+  cublasComputeType_t computeType = CUBLAS_COMPUTE_16F;
+  cudaDataType_t scaleType = CUDA_R_16F;
+  if(dataType == CUDA_R_32F) {
+    auto cublasHandle = backend->getCublasHandle();
+    setTensorMode(cublasHandle);
+    computeType = tensorOpsEnabled(cublasHandle) ? CUBLAS_COMPUTE_32F_FAST_16F : CUBLAS_COMPUTE_32F;
+    unsetTensorMode(cublasHandle);
+    scaleType = CUDA_R_32F;
+  }
+
+  cublasOperation_t opA = transA ? CUBLAS_OP_T : CUBLAS_OP_N;
+  cublasOperation_t opB = transB ? CUBLAS_OP_T : CUBLAS_OP_N;
+  cublasLtEpilogue_t epilogue = relu ? CUBLASLT_EPILOGUE_RELU_BIAS : CUBLASLT_EPILOGUE_BIAS;
+  const void* biasData = bias->data<T>();
+
+  cublasLtMatmulDesc_t operation;
+  CUBLAS_CHECK(cublasLtMatmulDescCreate(&operation, computeType, scaleType));
+  CUBLAS_CHECK(cublasLtMatmulDescSetAttribute(operation, CUBLASLT_MATMUL_DESC_TRANSA, &opB, sizeof(opB)));
+  CUBLAS_CHECK(cublasLtMatmulDescSetAttribute(operation, CUBLASLT_MATMUL_DESC_TRANSB, &opA, sizeof(opA)));
+  CUBLAS_CHECK(cublasLtMatmulDescSetAttribute(operation, CUBLASLT_MATMUL_DESC_EPILOGUE, &epilogue, sizeof(epilogue)));
+  CUBLAS_CHECK(cublasLtMatmulDescSetAttribute(operation, CUBLASLT_MATMUL_DESC_BIAS_POINTER, &biasData, sizeof(biasData)));
+
+  // layouts describe the stored matrices before transposition, column-major
+  cublasLtMatrixLayout_t layoutB, layoutA, layoutC;
+  CUBLAS_CHECK(cublasLtMatrixLayoutCreate(&layoutB, dataType, transB ? k : n, transB ? n : k, ldb));
+  CUBLAS_CHECK(cublasLtMatrixLayoutCreate(&layoutA, dataType, transA ? m : k, transA ? k : m, lda));
+  CUBLAS_CHECK(cublasLtMatrixLayoutCreate(&layoutC, dataType, n, m, ldc));
+
+  auto ltHandle = backend->getCublasLtHandle();
+  void* workspace = backend->getCublasLtWorkspace();
+  size_t workspaceSize = gpu::Backend::cublasLtWorkspaceSize;
+
+  uint32_t alignA = alignmentOf(A->data<T>());
+  uint32_t alignB = alignmentOf(B->data<T>());
+  uint32_t alignC = alignmentOf(C->data<T>());
+  uint32_t alignBias = alignmentOf(biasData);
+
+  // the heuristic query is not free, its result is cached per problem
+  size_t key = 0;
+  for(size_t v : {(size_t)m, (size_t)n, (size_t)k, (size_t)transA, (size_t)transB, (size_t)relu,
+                  (size_t)dataType, (size_t)computeType, (size_t)alignA, (size_t)alignB, (size_t)alignC, (size_t)alignBias})
+    util::hash_combine(key, v);
+
+  auto& algorithms = backend->getCublasLtAlgorithms();
+  auto it = algorithms.find(key);
+  if(it == algorithms.end()) {
+    cublasLtMatmulPreference_t preference;
+    CUBLAS_CHECK(cublasLtMatmulPreferenceCreate(&preference));
+    CUBLAS_CHECK(cublasLtMatmulPreferenceSetAttribute(preference, CUBLASLT_MATMUL_PREF_MAX_WORKSPACE_BYTES, &workspaceSize, sizeof(workspaceSize)));
+    // cuBLASLt operand A is our B and vice versa
+    CUBLAS_CHECK(cublasLtMatmulPreferenceSetAttribute(preference, CUBLASLT_MATMUL_PREF_MIN_ALIGNMENT_A_BYTES, &alignB, sizeof(alignB)));
+    CUBLAS_CHECK(cublasLtMatmulPreferenceSetAttribute(preference, CUBLASLT_MATMUL_PREF_MIN_ALIGNMENT_B_BYTES, &alignA, sizeof(alignA)));
+    CUBLAS_CHECK(cublasLtMatmulPreferenceSetAttribute(preference, CUBLASLT_MATMUL_PREF_MIN_ALIGNMENT_C_BYTES, &alignC, sizeof(alignC)));
+    CUBLAS_CHECK(cublasLtMatmulPreferenceSetAttribute(preference, CUBLASLT_MATMUL_PREF_MIN_ALIGNMENT_D_BYTES, &alignC, sizeof(alignC)));
+
+    cublasLtMatmulHeuristicResult_t heuristic = {};
+    int found = 0;
+    cublasStatus_t rc = cublasLtMatmulAlgoGetHeuristic(ltHandle, operation, layoutB, layoutA, layoutC, layoutC,
+                                                       preference, 1, &heuristic, &found);
+    CUBLAS_CHECK(cublasLtMatmulPreferenceDestroy(preference));
+
+    // unsupported problems are remembered as well to not ask again
+    if(rc != CUBLAS_STATUS_SUCCESS || found == 0) {
+      heuristic.state = CUBLAS_STATUS_NOT_SUPPORTED;
+      LOG(debug, "[gpu] No cuBLASLt algorithm for {}x{}x{} with fused bias, using separate operations", m, n, k);
+    }
+    it = algorithms.emplace(key, heuristic).first;
+  }
+
+  bool supported = it->second.state == CUBLAS_STATUS_SUCCESS;
+  if(supported) {
+    CUBLAS_CHECK(cublasLtMatmul(ltHandle,
+                                operation,
+                                &scalar,
+                                B->data<T>(), layoutB,
+                                A->data<T>(), layoutA,
+                                &beta,
+                                C->data<T>(), layoutC,
+                                C->data<T>(), layoutC,
+                                &it->second.algo,
+                                workspace,
+                                workspaceSize,
+                                backend->getStream()));
+  }
+
+  CUBLAS_CHECK(cublasLtMatrixLayoutDestroy(layoutC));
+  CUBLAS_CHECK(cublasLtMatrixLayoutDestroy(layoutA));
+  CUBLAS_CHECK(cublasLtMatrixLayoutDestroy(layoutB));
+  CUBLAS_CHECK(cublasLtMatmulDescDestroy(operation));
+
+  return supported;
+}
+#endif
+
+bool ProdWithBias(marian::Tensor C,
+                  const marian::Tensor& A,
+                  const marian::Tensor& B,
+                  const marian::Tensor& bias,
+                  bool transA,
+                  bool transB,
+                  float scalar,
+                  bool relu) {
+#if CUDA_VERSION >= 11000
+  if(C->type() == Type::float32) {
+    return ProdWithBiasTyped<float>(C, A, B, bias, transA, transB, 0.f, scalar, relu, CUDA_R_32F);
+#if COMPILE_FP16
+  } else if(C->type() == Type::float16) {
+    return ProdWithBiasTyped<half>(C, A, B, bias, transA, transB, __float2half(0.f), __float2half(scalar), relu, CUDA_R_16F);
+#endif
+  }
+#else
+  C; A; B; bias; transA; transB; scalar; relu; // fool warnings
+#endif
+  return false;
+}
+
 cublasStatus_t cublasGemmBatchedTyped(cublasHandle_t handle,
                                       CudaCompute computeCapability,
                                       cublasOperation_t transa, 
@@ -16,6 +16,19 @@ void Prod(marian::Tensor C,
           float beta = 0,
           float scalar = 1);
 
+// C = scalar * op(A) * op(B) + bias for a row vector bias, followed by a ReLU if `relu` is set. Bias and
+// ReLU are fused into the epilogue of a single cuBLASLt product. Returns false and leaves C untouched if
+// cuBLASLt (CUDA 11 or newer) is not available or cannot do this product, then the caller has to fall
+// back to separate operations.
+bool ProdWithBias(marian::Tensor C,
+                  const marian::Tensor& A,
+                  const marian::Tensor& B,
+                  const marian::Tensor& bias,
+                  bool transA,
+                  bool transB,
+                  float scalar,
+                  bool relu);
+
 void ProdBatched(marian::Tensor C,
                  Ptr<Allocator> allocator,
                  const marian::Tensor A,
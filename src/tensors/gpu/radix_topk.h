@@ -0,0 +1,160 @@
+#pragma once
+
+// Top-k selection by radix select, shared by gpu::TopK() and the n-best search of the beam search
+// (translator/nth_element.cu). Only to be included from .cu files.
+
+// One block selects the top-k of a row: four passes over the row build a histogram of the next 8 bits of
+// the elements whose higher bits match the k-th largest element so far, which determines that element
+// bit by bit. A last pass collects the k elements, which are sorted with a bitonic sort in shared memory.
+// The cost is five passes over the row independent of k, while the iterative maximum search of
+// gMaxElementUpdate() runs one reduction per selected element.
+
+#include "tensors/gpu/cuda_helpers.h"
+
+#include <climits>
+#include <cstdint>
+
+namespace marian {
+namespace gpu {
+
+const int RADIX_TOPK_THREADS = 1024;
+const int RADIX_TOPK_MAX_K = 1024; // the selected elements of a row are sorted in shared memory
+const int RADIX_TOPK_MIN_K = 8;    // for fewer elements the iterative maximum search is faster
+
+// maps a float to an unsigned integer of the same order
+__device__ __forceinline__ uint32_t radixKey(float value, bool descending) {
+  uint32_t bits = __float_as_uint(value);
+  uint32_t key = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+  return descending ? key : ~key;
+}
+
+// order of the selected elements: larger keys first, ties by smaller index
+__device__ __forceinline__ bool radixBefore(uint32_t keyA, int indexA, uint32_t keyB, int indexB) {
+  return keyA > keyB || (keyA == keyB && indexA < indexB);
+}
+
+// One block per row of `in`, [rows, cols]. Writes the top-k values of row r in order to
+// outValues[r * k, (r + 1) * k) and their columns, plus r * cols with absoluteIndices, to outIndices.
+// Needs blockDim.x >= 256 and P * (sizeof(uint32_t) + sizeof(int)) bytes of shared memory, where P is
+// the smallest power of 2 >= k.
+template <typename T, typename OutT, typename IndexT>
+__global__ void gRadixTopK(const T* in,
+                           int cols,
+                           int k,
+                           bool descending,
+                           IndexT* outIndices,
+                           OutT* outValues,
+                           bool absoluteIndices) {
+  extern __shared__ uint32_t _sharedKeys[];
+  __shared__ int histogram[256];
+  __shared__ uint32_t prefix, mask;
+  __shared__ int remaining, above, equal;
+
+  int tid = threadIdx.x;
+  const T* row = in + (size_t)blockIdx.x * cols;
+
+  int P = 1;
+  while(P < k)
+    P <<= 1;
+  uint32_t* keys = _sharedKeys;
+  int* indices = (int*)(_sharedKeys + P);
+
+  if(tid == 0) {
+    prefix = 0;
+    mask = 0;
+    remaining = k;
+    above = 0;
+    equal = 0;
+  }
+
+  // determine the key of the k-th element 8 bits at a time, from the highest
+  for(int shift = 24; shift >= 0; shift -= 8) {
+    for(int d = tid; d < 256; d += blockDim.x)
+      histogram[d] = 0;
+    __syncthreads();
+
+    for(int i = tid; i < cols; i += blockDim.x) {
+      uint32_t key = radixKey((float)row[i], descending);
+      if((key & mask) == prefix)
+        atomicAdd(&histogram[(key >> shift) & 0xFF], 1);
+    }
+    __syncthreads();
+
+    if(tid == 0) {
+      int count = 0;
+      int d = 255;
+      for(; d > 0 && count + histogram[d] < remaining; --d)
+        count += histogram[d];
+      remaining -= count;
+      prefix |= (uint32_t)d << shift;
+      mask |= 0xFFu << shift;
+    }
+    __syncthreads();
+  }
+
+  // the elements above the k-th one, and as many of those equal to it as are still missing
+  uint32_t threshold = prefix;
+  int fromAbove = k - remaining;
+  for(int i = tid; i < cols; i += blockDim.x) {
+    uint32_t key = radixKey((float)row[i], descending);
+    int slot = -1;
+    if(key > threshold) {
+      slot = atomicAdd(&above, 1);
+    } else if(key == threshold) {
+      int e = atomicAdd(&equal, 1);
+      if(e < remaining)
+        slot = fromAbove + e;
+    }
+    if(slot >= 0) {
+      keys[slot] = key;
+      indices[slot] = i;
+    }
+  }
+  for(int slot = k + tid; slot < P; slot += blockDim.x) { // padding sorts last
+    keys[slot] = 0;
+    indices[slot] = INT_MAX;
+  }
+  __syncthreads();
+
+  // bitonic sort of the P slots
+  for(int size = 2; size <= P; size <<= 1) {
+    for(int stride = size >> 1; stride > 0; stride >>= 1) {
+      for(int i = tid; i < P; i += blockDim.x) {
+        int j = i ^ stride;
+        if(j > i) {
+          bool inOrder = (i & size) == 0;
+          bool swap = inOrder ? radixBefore(keys[j], indices[j], keys[i], indices[i])
+                              : radixBefore(keys[i], indices[i], keys[j], indices[j]);
+          if(swap) {
+            uint32_t key = keys[i]; keys[i] = keys[j]; keys[j] = key;
+            int index = indices[i]; indices[i] = indices[j]; indices[j] = index;
+          }
+        }
+      }
+      __syncthreads();
+    }
+  }
+
+  for(int j = tid; j < k; j += blockDim.x) {
+    int i = indices[j];
+    outValues[(size_t)blockIdx.x * k + j] = (OutT)(float)row[i];
+    outIndices[(size_t)blockIdx.x * k + j] = (IndexT)(absoluteIndices ? blockIdx.x * cols + i : i);
+  }
+}
+
+// Launches gRadixTopK() for `rows` rows on the default stream, k <= RADIX_TOPK_MAX_K
+template <typename T, typename OutT, typename IndexT>
+void radixTopK(const T* in, int rows, int cols, int k, bool descending, IndexT* outIndices, OutT* outValues, bool absoluteIndices) {
+  ABORT_IF(k > RADIX_TOPK_MAX_K, "Radix top-k selects at most {} elements per row, not {}", RADIX_TOPK_MAX_K, k);
+  if(rows == 0 || k == 0)
+    return;
+  int P = 1;
+  while(P < k)
+    P <<= 1;
+  gRadixTopK<<<rows, RADIX_TOPK_THREADS, P * (sizeof(uint32_t) + sizeof(int)), /* stream_ */ 0>>>(
+      in, cols, k, descending, outIndices, outValues, absoluteIndices);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+}  // namespace gpu
+}  // namespace marian
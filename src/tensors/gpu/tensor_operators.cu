@@ -562,6 +562,69 @@ void TransposeNDGrad(Tensor out, Tensor in, const std::vector<int>& vAxis) {
   }
 }
 
+// Rows of up to 128 columns, as those of attention, and of up to 1024 columns when there are enough rows
+// to occupy the device, are computed by one warp per row with shuffle reductions instead of one block per
+// row with reductions in shared memory, see gSoftmaxWarp() and gLNormalizationWarp()
+static const int ROW_WARP_SIZE = 32;
+static const int ROWS_PER_BLOCK = 4; // warps of a block, each computes its own rows
+
+static bool warpPerRow(int rows, int cols) {
+  return cols <= 128 || (cols <= 1024 && rows >= 256);
+}
+
+static void warpPerRowLaunch(int rows, int& blocks, dim3& threads) {
+  blocks = std::min(MAX_BLOCKS, (rows + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK);
+  threads = dim3(ROW_WARP_SIZE, ROWS_PER_BLOCK);
+}
+
+template <typename AccType>
+__device__ inline AccType warpRowSum(AccType value) {
+  for(int offset = ROW_WARP_SIZE / 2; offset > 0; offset /= 2)
+    value += __shfl_xor_sync(0xffffffff, value, offset);
+  return value;
+}
+
+template <typename AccType>
+__device__ inline AccType warpRowMax(AccType value) {
+  for(int offset = ROW_WARP_SIZE / 2; offset > 0; offset /= 2) {
+    AccType other = __shfl_xor_sync(0xffffffff, value, offset);
+    value = other > value ? other : value;
+  }
+  return value;
+}
+
+// Softmax, or log-softmax, of short rows, one warp per row. All lanes of a warp take the same rows, so that
+// they all take part in the shuffles; a lane reads back only the columns it has written, so out may be in.
+template <typename T, typename AccType = float, bool logSoftmax = false>
+__global__ void gSoftmaxWarp(T* out, const T* in, int rows, int cols) {
+  using namespace functional;
+  for(int j = blockIdx.x * blockDim.y + threadIdx.y; j < rows; j += gridDim.x * blockDim.y) {
+    const T* sp = in + (size_t)j * cols;
+    T* so       = out + (size_t)j * cols;
+
+    AccType max = -CUDA_FLT_MAX;
+    for(int i = threadIdx.x; i < cols; i += ROW_WARP_SIZE) {
+      AccType x = (AccType)sp[i];
+      max = x > max ? x : max;
+    }
+    max = warpRowMax(max);
+
+    AccType sum = 0;
+    for(int i = threadIdx.x; i < cols; i += ROW_WARP_SIZE)
+      sum += Ops<AccType>::exp((AccType)sp[i] - max);
+    sum = warpRowSum(sum);
+
+    if(logSoftmax) {
+      AccType logSum = Ops<AccType>::log(sum);
+      for(int i = threadIdx.x; i < cols; i += ROW_WARP_SIZE)
+        so[i] = (T)((AccType)sp[i] - max - logSum);
+    } else {
+      for(int i = threadIdx.x; i < cols; i += ROW_WARP_SIZE)
+        so[i] = (T)(Ops<AccType>::exp((AccType)sp[i] - max) / sum);
+    }
+  }
+}
+
 // Computes the softmax
 // in - input tensor
 // out - output tensor
@@ -664,6 +727,21 @@ void Softmax(Tensor out, Tensor in) {
   size_t m = out->shape().elements() / out->shape().back();
   size_t k = out->shape().back();
 
+  if(warpPerRow((int)m, (int)k)) {
+    int blocks; dim3 threads;
+    warpPerRowLaunch((int)m, blocks, threads);
+    if(in->type() == Type::float32) {
+      gSoftmaxWarp<float, float><<<blocks, threads>>>(out->data<float>(), in->data<float>(), (int)m, (int)k);
+#if COMPILE_FP16
+    } else if (in->type() == Type::float16) {
+      gSoftmaxWarp<half, float><<<blocks, threads>>>(out->data<half>(), in->data<half>(), (int)m, (int)k);
+#endif
+    } else {
+      ABORT("Softmax not implemented for type {}", in->type());
+    }
+    return;
+  }
+
   int blocks = std::min(MAX_BLOCKS, (int)m);
   int threads = std::min(MAX_THREADS, (int)k);
   int shared = sizeof(float) * threads;  // accumulate into float
@@ -765,6 +843,21 @@ void LogSoftmax(Tensor out, Tensor in) {
   size_t m = out->shape().elements() / out->shape().back();
   size_t k = out->shape().back();
 
+  if(warpPerRow((int)m, (int)k)) {
+    int blocks; dim3 threads;
+    warpPerRowLaunch((int)m, blocks, threads);
+    if(in->type() == Type::float32) {
+      gSoftmaxWarp<float, float, true><<<blocks, threads>>>(out->data<float>(), in->data<float>(), (int)m, (int)k);
+#if COMPILE_FP16
+    } else if (in->type() == Type::float16) {
+      gSoftmaxWarp<half, float, true><<<blocks, threads>>>(out->data<half>(), in->data<half>(), (int)m, (int)k);
+#endif
+    } else {
+      ABORT("LogSoftmax not implemented for type {}", in->type());
+    }
+    return;
+  }
+
   int blocks = std::min(MAX_BLOCKS, (int)m);
   int threads = std::min(MAX_THREADS, (int)k);
   int shared = sizeof(float) * threads; // use float32 as accumulation type
@@ -952,6 +1045,33 @@ __global__ void gCopyRows(T* out,
   }
 }
 
+// dequantizes the selected rows of an int8rows matrix, whose scales follow the rows x cols values
+template <typename T>
+__global__ void gCopyQuantizedRows(T* out,
+                                   const int8_t* in,
+                                   const char* scales,
+                                   size_t cols,
+                                   const IndexType* sourceRowIdx,
+                                   size_t rows) {
+  for(int bid = 0; bid < rows; bid += gridDim.x) {
+    int j = bid + blockIdx.x;
+    if(j < rows) {
+      size_t srcId = sourceRowIdx[j];
+      float scale;
+      memcpy(&scale, scales + srcId * sizeof(float), sizeof(float));
+
+      T* rowOut = out + j * cols;
+      const int8_t* rowIn = in + srcId * cols;
+
+      for(int tid = 0; tid < cols; tid += blockDim.x) {
+        int i = tid + threadIdx.x;
+        if(i < cols)
+          rowOut[i] = (T)(scale * (float)rowIn[i]);
+      }
+    }
+  }
+}
+
 void CopyRows(Tensor out,
               const Tensor in,
               const Tensor indices) {
@@ -966,7 +1086,20 @@ void CopyRows(Tensor out,
   int threads = std::min(MAX_THREADS, (int)cols);
   int blocks = std::min(MAX_BLOCKS, (int)rowsToCopy);
 
-  if(out->type() == Type::float32) {
+  if(isRowQuantized(in->type())) {
+    const char* scales = in->data<char>() + in->shape().elements();
+    if(out->type() == Type::float32) {
+      gCopyQuantizedRows<<<blocks, threads>>>(
+        out->data<float>(), in->data<int8_t>(), scales, cols, indices->data<IndexType>(), rowsToCopy);
+#if COMPILE_FP16
+    } else if(out->type() == Type::float16) {
+      gCopyQuantizedRows<<<blocks, threads>>>(
+        out->data<half>(), in->data<int8_t>(), scales, cols, indices->data<IndexType>(), rowsToCopy);
+#endif
+    } else {
+      ABORT("CopyRows not implemented for type {}", out->type());
+    }
+  } else if(out->type() == Type::float32) {
     gCopyRows<<<blocks, threads>>>(
       out->data<float>(), in->data<float>(), cols, indices->data<IndexType>(), rowsToCopy);
 #if COMPILE_FP16
@@ -1709,6 +1842,151 @@ void CrossEntropyPickBackward(Tensor out, Tensor adj, Tensor a, Tensor indices,
   }
 }
 
+// one block per row of the tile, see CrossEntropyTileStats() in tensor_operators.h
+template <typename T, typename AccType = float>
+__global__ void gCrossEntropyTileStats(AccType* out,
+                                       AccType* stats,
+                                       const T* in,
+                                       int rows,
+                                       int cols,
+                                       const IndexType* pick,
+                                       int offset,
+                                       int dimVocab,
+                                       AccType labelSmoothingAlpha) {
+  extern __shared__ uint8_t _sharedBytes[];
+  AccType* _acc = (AccType*)_sharedBytes;
+
+  for(int bid = 0; bid < rows; bid += gridDim.x) {
+    int j = bid + blockIdx.x;
+    if(j < rows) {
+      const T* sp = in + j * cols;
+      AccType* st = stats + j * 4; // max, sumexp, sum, picked
+
+      AccType max = offset > 0 ? st[0] : (AccType)sp[0];
+      for(int id = threadIdx.x; id < cols; id += blockDim.x)
+        max = max > (AccType)sp[id] ? max : (AccType)sp[id];
+      _acc[threadIdx.x] = max;
+      __syncthreads();
+      int len = blockDim.x;
+      while(len != 1) {
+        __syncthreads();
+        int skip = (len + 1) >> 1;
+        if(threadIdx.x < (len >> 1) && _acc[threadIdx.x + skip] > _acc[threadIdx.x])
+          _acc[threadIdx.x] = _acc[threadIdx.x + skip];
+        len = (len + 1) >> 1;
+      }
+      __syncthreads();
+      max = _acc[0];
+      __syncthreads();
+
+      _acc[2 * threadIdx.x    ] = (AccType)0.f;
+      _acc[2 * threadIdx.x + 1] = (AccType)0.f;
+      for(int id = threadIdx.x; id < cols; id += blockDim.x) {
+        _acc[2 * threadIdx.x    ] += functional::Ops<AccType>::exp((AccType)sp[id] - max);
+        _acc[2 * threadIdx.x + 1] += (AccType)sp[id];
+        if(id + offset == (int)pick[j])
+          st[3] = (AccType)sp[id];
+      }
+      __syncthreads();
+      len = blockDim.x;
+      while(len != 1) {
+        __syncthreads();
+        int skip = (len + 1) >> 1;
+        if(threadIdx.x < (len >> 1)) {
+          _acc[2 * threadIdx.x    ] += _acc[2 * (threadIdx.x + skip)    ];
+          _acc[2 * threadIdx.x + 1] += _acc[2 * (threadIdx.x + skip) + 1];
+        }
+        len = (len + 1) >> 1;
+      }
+      __syncthreads();
+
+      if(threadIdx.x == 0) {
+        AccType sumexp = _acc[0] + (offset > 0 ? st[1] * functional::Ops<AccType>::exp(st[0] - max) : (AccType)0.f);
+        AccType sum    = _acc[1] + (offset > 0 ? st[2] : (AccType)0.f);
+        st[0] = max;
+        st[1] = sumexp;
+        st[2] = sum;
+        if(out && offset + cols == dimVocab) {
+          AccType logsumexp = functional::Ops<AccType>::log(sumexp) + max;
+          out[j] = logsumexp - (1.f - labelSmoothingAlpha) * st[3] - labelSmoothingAlpha * sum / (AccType)dimVocab;
+        }
+      }
+    }
+    __syncthreads();
+  }
+}
+
+void CrossEntropyTileStats(Tensor out, Tensor stats, Tensor logits, Tensor indices, int offset, int dimVocab, float labelSmoothingAlpha) {
+  matchOrAbort<IndexType>(indices->type());
+
+  cudaSetDevice(stats->getDeviceId().no);
+
+  int rows = logits->shape().elements() / logits->shape().back();
+  int cols = logits->shape().back();
+
+  int blocks = std::min(MAX_BLOCKS, (int)rows);
+  int threads = std::min(MAX_THREADS, (int)cols);
+  int shared = sizeof(float) * threads * 2; // use float32 as accumulation type
+
+  float* outData = out ? out->data<float>() : nullptr;
+  if(logits->type() == Type::float32) {
+    gCrossEntropyTileStats<float, float><<<blocks, threads, shared>>>(
+      outData, stats->data<float>(), logits->data<float>(), rows, cols, indices->data<IndexType>(), offset, dimVocab, labelSmoothingAlpha);
+#if COMPILE_FP16
+  } else if(logits->type() == Type::float16) {
+    gCrossEntropyTileStats<half, float><<<blocks, threads, shared>>>(
+      outData, stats->data<float>(), logits->data<half>(), rows, cols, indices->data<IndexType>(), offset, dimVocab, labelSmoothingAlpha);
+#endif
+  } else {
+    ABORT("CrossEntropyTileStats not implemented for type {}", logits->type());
+  }
+}
+
+template <typename T, typename AccType = float>
+__global__ void gCrossEntropyTileBackward(T* out,
+                                          const AccType* adj,
+                                          const T* in,
+                                          const AccType* stats,
+                                          int rows,
+                                          int cols,
+                                          const IndexType* pick,
+                                          int offset,
+                                          int dimVocab,
+                                          AccType labelSmoothingAlpha) {
+  for(int index = blockIdx.x * blockDim.x + threadIdx.x; index < rows * cols; index += blockDim.x * gridDim.x) {
+    int j = index / cols;
+    int i = index % cols;
+    const AccType* st = stats + j * 4;
+    AccType sub = (AccType)(i + offset == (int)pick[j]);
+    AccType p = functional::Ops<AccType>::exp((AccType)in[index] - st[0]) / st[1];
+    out[index] = (T)(adj[j] * (p - (1.f - labelSmoothingAlpha) * sub - labelSmoothingAlpha / (AccType)dimVocab));
+  }
+}
+
+void CrossEntropyTileBackward(Tensor out, Tensor adj, Tensor logits, Tensor stats, Tensor indices, int offset, int dimVocab, float labelSmoothingAlpha) {
+  matchOrAbort<IndexType>(indices->type());
+
+  cudaSetDevice(out->getDeviceId().no);
+
+  int rows = logits->shape().elements() / logits->shape().back();
+  int cols = logits->shape().back();
+
+  int threads = std::min(MAX_THREADS, rows * cols);
+  int blocks = std::min(MAX_BLOCKS, (rows * cols + threads - 1) / threads);
+
+  if(out->type() == Type::float32 && adj->type() == Type::float32) {
+    gCrossEntropyTileBackward<float, float><<<blocks, threads>>>(
+      out->data<float>(), adj->data<float>(), logits->data<float>(), stats->data<float>(), rows, cols, indices->data<IndexType>(), offset, dimVocab, labelSmoothingAlpha);
+#if COMPILE_FP16
+  } else if(out->type() == Type::float16 && adj->type() == Type::float32) {
+    gCrossEntropyTileBackward<half, float><<<blocks, threads>>>(
+      out->data<half>(), adj->data<float>(), logits->data<half>(), stats->data<float>(), rows, cols, indices->data<IndexType>(), offset, dimVocab, labelSmoothingAlpha);
+#endif
+  } else {
+    ABORT("CrossEntropyTileBackward not implemented for type {} and adjoint type {}", out->type(), adj->type());
+  }
+}
+
 // computes the L2Norm of tensor and returns value as flaot on the CPU, 
 // this is mostly used for diagnostic purposes and gradient clipping
 float L2Norm(Tensor in, Ptr<Allocator> allocator) { // @TODO: reverse order of arguments
@@ -1890,9 +2168,116 @@ void AttBack(Tensor gVa,
   }
 }
 
+// One block per row of the state, [beam x batch], each warp computes the scores of some source positions.
+// Needs (t + warps) floats of shared memory.
+template <typename T>
+__global__ void gAttentionWeights(T* out,
+                                  const T* va,
+                                  const T* ctx,
+                                  const T* state,
+                                  const T* mask,
+                                  float maskValue,
+                                  int k,  // depth
+                                  int b,  // batch size
+                                  int t   // time of ctx
+) {
+  extern __shared__ float _scores[]; // [t], then one value per warp
+  float* _warps = _scores + t;
+
+  int j = blockIdx.x;
+  int batch = j % b;
+  const T* stateRow = state + (size_t)j * k;
+  int warp = threadIdx.x / ROW_WARP_SIZE, lane = threadIdx.x % ROW_WARP_SIZE;
+  int numWarps = blockDim.x / ROW_WARP_SIZE;
+
+  for(int s = warp; s < t; s += numWarps) {
+    const T* ctxRow = ctx + ((size_t)s * b + batch) * k;
+    float sum = 0.f;
+    for(int i = lane; i < k; i += ROW_WARP_SIZE)
+      sum += tanhf((float)ctxRow[i] + (float)stateRow[i]) * (float)va[i];
+    sum = warpRowSum(sum);
+    if(lane == 0)
+      _scores[s] = mask ? sum + (1.f - (float)mask[s * b + batch]) * maskValue : sum;
+  }
+  __syncthreads();
+
+  // the maximum and the sum of the exponentials over the block, through one value per warp
+  float max = -CUDA_FLT_MAX;
+  for(int s = threadIdx.x; s < t; s += blockDim.x)
+    max = fmaxf(max, _scores[s]);
+  max = warpRowMax(max);
+  if(lane == 0)
+    _warps[warp] = max;
+  __syncthreads();
+  max = _warps[0];
+  for(int w = 1; w < numWarps; ++w)
+    max = fmaxf(max, _warps[w]);
+  __syncthreads();
+
+  float sum = 0.f;
+  for(int s = threadIdx.x; s < t; s += blockDim.x) {
+    float ex = __expf(_scores[s] - max);
+    _scores[s] = ex;
+    sum += ex;
+  }
+  sum = warpRowSum(sum);
+  if(lane == 0)
+    _warps[warp] = sum;
+  __syncthreads();
+  sum = 0.f;
+  for(int w = 0; w < numWarps; ++w)
+    sum += _warps[w];
+
+  for(int s = threadIdx.x; s < t; s += blockDim.x) // [beam, t, b, 1]
+    out[((size_t)(j / b) * t + s) * b + batch] = (T)(_scores[s] / sum);
+}
+
+void AttentionWeights(Tensor out, const Tensor va, const Tensor context, const Tensor state, const Tensor mask, float maskValue) {
+  cudaSetDevice(out->getDeviceId().no);
+
+  int k = context->shape()[-1];
+  int b = context->shape()[-2];
+  int t = context->shape()[-3];
+  int rows = state->shape().elements() / k; // beam x batch
+
+  int threads = std::min(MAX_THREADS, 8 * ROW_WARP_SIZE);
+  int shared = sizeof(float) * (t + threads / ROW_WARP_SIZE);
+
+  if(out->type() == Type::float32) {
+    gAttentionWeights<float><<<rows, threads, shared>>>(
+      out->data<float>(), va->data<float>(), context->data<float>(), state->data<float>(),
+      mask ? mask->data<float>() : nullptr, maskValue, k, b, t);
+#if COMPILE_FP16
+  } else if (out->type() == Type::float16) {
+    gAttentionWeights<half><<<rows, threads, shared>>>(
+      out->data<half>(), va->data<half>(), context->data<half>(), state->data<half>(),
+      mask ? mask->data<half>() : nullptr, maskValue, k, b, t);
+#endif
+  } else {
+    ABORT("gAttentionWeights not implemented for type {}", out->type());
+  }
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+// x * mask + residual if residual is given, otherwise x. The sum is rounded to T as it is stored
+// between the passes of the forward kernel, so that the backward kernel recomputes the same input.
+template <typename T, typename AccType>
+__device__ inline AccType residualInput(const T* x, const T* mask, const T* residual, int id) {
+  AccType xv = (AccType)x[id];
+  if(residual) {
+    if(mask)
+      xv *= (AccType)mask[id];
+    xv += (AccType)residual[id];
+    xv = (AccType)(T)xv;
+  }
+  return xv;
+}
+
 template <typename T, typename AccType = float>
 __global__ void gLNormalization(T* out,
                                 const T* in,
+                                const T* mask,
+                                const T* residual,
                                 const T* gamma,
                                 const T* beta,
                                 int rows,
@@ -1909,6 +2294,19 @@ __global__ void gLNormalization(T* out,
       T* yRow       = out + j * cols;
       const T* xRow =  in + j * cols;
 
+      // with a residual, the sum is written to the output row and normalized in place; every
+      // thread reads back only the elements it has written itself
+      if(residual) {
+        const T* maskRow     = mask ? mask + j * cols : nullptr;
+        const T* residualRow = residual + j * cols;
+        for(int tid = 0; tid < cols; tid += blockDim.x) {
+          int id = tid + threadIdx.x;
+          if(id < cols)
+            yRow[id] = (T)residualInput<T, AccType>(xRow, maskRow, residualRow, id);
+        }
+        xRow = yRow;
+      }
+
       AccType* _sum = _shareAccType; // accumulate into floats
       _sum[threadIdx.x] = (AccType)0.0f;
       for(int tid = 0; tid < cols; tid += blockDim.x) {
@@ -1971,16 +2369,94 @@ __global__ void gLNormalization(T* out,
   }
 }
 
-void LayerNormalization(Tensor out,
-                        Tensor in,
-                        Tensor gamma,
-                        Tensor beta,
-                        float eps) {
+// gLNormalization() for short rows, one warp per row as gSoftmaxWarp()
+template <typename T, typename AccType = float>
+__global__ void gLNormalizationWarp(T* out,
+                                    const T* in,
+                                    const T* mask,
+                                    const T* residual,
+                                    const T* gamma,
+                                    const T* beta,
+                                    int rows,
+                                    int cols,
+                                    AccType eps = 1e-9) {
+  AccType N = cols;
+  for(int j = blockIdx.x * blockDim.y + threadIdx.y; j < rows; j += gridDim.x * blockDim.y) {
+    T* yRow       = out + (size_t)j * cols;
+    const T* xRow =  in + (size_t)j * cols;
+
+    if(residual) {
+      const T* maskRow     = mask ? mask + (size_t)j * cols : nullptr;
+      const T* residualRow = residual + (size_t)j * cols;
+      for(int id = threadIdx.x; id < cols; id += ROW_WARP_SIZE)
+        yRow[id] = (T)residualInput<T, AccType>(xRow, maskRow, residualRow, id);
+      xRow = yRow;
+    }
+
+    AccType sum = 0;
+    for(int id = threadIdx.x; id < cols; id += ROW_WARP_SIZE)
+      sum += (AccType)xRow[id];
+    AccType mean = warpRowSum(sum) / N;
+
+    AccType sqSum = 0;
+    for(int id = threadIdx.x; id < cols; id += ROW_WARP_SIZE) {
+      AccType ex = (AccType)xRow[id] - mean;
+      sqSum += ex * ex;
+    }
+    AccType sigma = functional::Ops<AccType>::sqrt(warpRowSum(sqSum) / N + eps);
+
+    for(int id = threadIdx.x; id < cols; id += ROW_WARP_SIZE) {
+      AccType gammav = (AccType)gamma[id];
+      AccType xv     = (AccType)xRow[id];
+      AccType betav  = beta ? (AccType)beta[id] : (AccType)0.f;
+      yRow[id]       = (T)(gammav * (xv - mean) / sigma + betav);
+    }
+  }
+}
+
+void ResidualLayerNormalization(Tensor out,
+                                Tensor in,
+                                Tensor mask,
+                                Tensor residual,
+                                Tensor gamma,
+                                Tensor beta,
+                                float eps) {
   cudaSetDevice(out->getDeviceId().no);
 
   int rows = in->shape().elements() / in->shape().back();
   int cols = in->shape().back();
 
+  if(warpPerRow(rows, cols)) {
+    int blocks; dim3 threads;
+    warpPerRowLaunch(rows, blocks, threads);
+    if(out->type() == Type::float32) {
+      gLNormalizationWarp<float, float><<<blocks, threads>>>(out->data<float>(),
+                                                             in->data<float>(),
+                                                             mask ? mask->data<float>() : nullptr,
+                                                             residual ? residual->data<float>() : nullptr,
+                                                             gamma->data<float>(),
+                                                             beta ? beta->data<float>() : nullptr,
+                                                             rows,
+                                                             cols,
+                                                             eps);
+#if COMPILE_FP16
+    } else if (out->type() == Type::float16) {
+      gLNormalizationWarp<half, float><<<blocks, threads>>>(out->data<half>(),
+                                                            in->data<half>(),
+                                                            mask ? mask->data<half>() : nullptr,
+                                                            residual ? residual->data<half>() : nullptr,
+                                                            gamma->data<half>(),
+                                                            beta ? beta->data<half>() : nullptr,
+                                                            rows,
+                                                            cols,
+                                                            eps);
+#endif
+    } else {
+      ABORT("LayerNormalization not implemented for type {}", out->type());
+    }
+    return;
+  }
+
   int blocks = std::min(MAX_BLOCKS, (int)rows);
   int threads = std::min(MAX_THREADS, (int)cols);
   int shared = threads * sizeof(float);
@@ -1988,6 +2464,8 @@ void LayerNormalization(Tensor out,
   if(out->type() == Type::float32) {
     gLNormalization<float, float><<<blocks, threads, shared>>>(out->data<float>(),
                                                  in->data<float>(),
+                                                 mask ? mask->data<float>() : nullptr,
+                                                 residual ? residual->data<float>() : nullptr,
                                                  gamma->data<float>(),
                                                  beta ? beta->data<float>() : nullptr,
                                                  rows,
@@ -1997,6 +2475,8 @@ void LayerNormalization(Tensor out,
   } else if (out->type() == Type::float16) {
     gLNormalization<half, float><<<blocks, threads, shared>>>(out->data<half>(),
                                                  in->data<half>(),
+                                                 mask ? mask->data<half>() : nullptr,
+                                                 residual ? residual->data<half>() : nullptr,
                                                  gamma->data<half>(),
                                                  beta ? beta->data<half>() : nullptr,
                                                  rows,
@@ -2008,12 +2488,23 @@ void LayerNormalization(Tensor out,
   }
 }
 
+void LayerNormalization(Tensor out,
+                        Tensor in,
+                        Tensor gamma,
+                        Tensor beta,
+                        float eps) {
+  gpu::ResidualLayerNormalization(out, in, nullptr, nullptr, gamma, beta, eps);
+}
+
 template <typename T, typename AccType = float>
 __global__ void gLayerNormalizationGrad(T* gradX,
+                                        T* gradResidual,
                                         T* gradGamma,
                                         T* adj,
                                         T* y,
                                         T* x,
+                                        T* mask,
+                                        T* residual,
                                         T* gamma,
                                         T* beta,
                                         int rows,
@@ -2032,9 +2523,11 @@ __global__ void gLayerNormalizationGrad(T* gradX,
       AccType* sum_x     = shared + 2 * blockDim.x;  // sum of input value x
       AccType* sum_sqr   = shared + 3 * blockDim.x;  // sum of (x - mean)^2
 
-      const T* xRow   =   x + j * cols;
-      const T* yRow   =   y + j * cols;
-      const T* adjRow = adj + j * cols;
+      const T* xRow        =   x + j * cols;
+      const T* maskRow     = mask ? mask + j * cols : nullptr;
+      const T* residualRow = residual ? residual + j * cols : nullptr;
+      const T* yRow        =   y + j * cols;
+      const T* adjRow      = adj + j * cols;
 
       sum_x[threadIdx.x]     = (AccType)0.0f;
       sum_adj[threadIdx.x]   = (AccType)0.0f;
@@ -2044,7 +2537,7 @@ __global__ void gLayerNormalizationGrad(T* gradX,
       for(int tid = 0; tid < cols; tid += blockDim.x) {
         int id = tid + threadIdx.x;
         if(id < cols) {
-          AccType xv     = xRow[id];
+          AccType xv     = residualInput<T, AccType>(xRow, maskRow, residualRow, id);
           AccType yv     = yRow[id];
           AccType betav  = beta ? (AccType)beta[id] : (AccType)0.f;
           AccType gammav = (AccType)gamma[id];
@@ -2075,7 +2568,7 @@ __global__ void gLayerNormalizationGrad(T* gradX,
       for(int tid = 0; tid < cols; tid += blockDim.x) {
         int id = tid + threadIdx.x;
         if(id < cols) {
-          AccType xv = xRow[id];
+          AccType xv = residualInput<T, AccType>(xRow, maskRow, residualRow, id);
           AccType ex = xv - mean;
           sum_sqr[threadIdx.x] += ex * ex;
         }
@@ -2102,7 +2595,7 @@ __global__ void gLayerNormalizationGrad(T* gradX,
         int id = tid + threadIdx.x;
         if(id < cols) {
 
-          AccType xv     = xRow[id];
+          AccType xv     = residualInput<T, AccType>(xRow, maskRow, residualRow, id);
           AccType gammav = (AccType)gamma[id];
           AccType adjv   = adjRow[id];
           AccType lv     = (xv - mean) / sigma;
@@ -2118,8 +2611,15 @@ __global__ void gLayerNormalizationGrad(T* gradX,
                                             // or better: make obsolete.
           gradXv = functional::Ops<AccType>::abs(gradXv) > cutoff ? sign * cutoff : gradXv;
 
-          T* gradXRow      = gradX     + j * cols;
-          gradXRow[id]    += (T)(gradXv);
+          if(gradResidual) {
+            T* gradResidualRow = gradResidual + j * cols;
+            gradResidualRow[id] += (T)(gradXv);
+          }
+
+          if(gradX) {
+            T* gradXRow    = gradX     + j * cols;
+            gradXRow[id]  += (T)(maskRow ? gradXv * (AccType)maskRow[id] : gradXv);
+          }
 
           T* gradGammaRow  = gradGamma + j * cols;
           // assignment is correct here as this gets summed up
@@ -2132,16 +2632,19 @@ __global__ void gLayerNormalizationGrad(T* gradX,
   }
 }
 
-void LayerNormalizationGrad(Ptr<Allocator> allocator,
-                            Tensor gradX,
-                            Tensor gradGamma,
-                            Tensor gradBeta,
-                            Tensor adj,
-                            Tensor y,
-                            Tensor x,
-                            Tensor gamma,
-                            Tensor beta,
-                            float eps) {
+void ResidualLayerNormalizationGrad(Ptr<Allocator> allocator,
+                                    Tensor gradX,
+                                    Tensor gradResidual,
+                                    Tensor gradGamma,
+                                    Tensor gradBeta,
+                                    Tensor adj,
+                                    Tensor y,
+                                    Tensor x,
+                                    Tensor mask,
+                                    Tensor residual,
+                                    Tensor gamma,
+                                    Tensor beta,
+                                    float eps) {
   cudaSetDevice(adj->getDeviceId().no);
   int rows = y->shape().elements() / y->shape()[-1];
   int cols = y->shape()[-1];
@@ -2157,29 +2660,35 @@ void LayerNormalizationGrad(Ptr<Allocator> allocator,
   Tensor tempOnes = TensorBase::New(tempOnesMemory, Shape({1, rows}), adj->type(), adj->getBackend());
   tempOnes->set(1.f);
 
-  if(gradX->type() == Type::float32) {
+  if(adj->type() == Type::float32) {
     int shared = sizeof(float) * threads * 4;
     gLayerNormalizationGrad<float, float><<<blocks, threads, shared>>>(
-      gradX->data<float>(),
+      gradX ? gradX->data<float>() : nullptr,
+      gradResidual ? gradResidual->data<float>() : nullptr,
       tempGradGamma->data<float>(),
       adj->data<float>(),
       y->data<float>(),
       x->data<float>(),
+      mask ? mask->data<float>() : nullptr,
+      residual ? residual->data<float>() : nullptr,
       gamma->data<float>(),
       (beta) ? beta->data<float>() : nullptr,
       rows,
       cols,
       eps);
 #if COMPILE_FP16
-  } else if (gradX->type() == Type::float16) {
+  } else if (adj->type() == Type::float16) {
     // accumulate in float
     int shared = sizeof(float) * threads * 4;
     gLayerNormalizationGrad<half, float><<<blocks, threads, shared>>>(
-      gradX->data<half>(),
+      gradX ? gradX->data<half>() : nullptr,
+      gradResidual ? gradResidual->data<half>() : nullptr,
       tempGradGamma->data<half>(),
       adj->data<half>(),
       y->data<half>(),
       x->data<half>(),
+      mask ? mask->data<half>() : nullptr,
+      residual ? residual->data<half>() : nullptr,
       gamma->data<half>(),
       (beta) ? beta->data<half>() : nullptr,
       rows,
@@ -2187,7 +2696,7 @@ void LayerNormalizationGrad(Ptr<Allocator> allocator,
       eps);
 #endif
   } else {
-    ABORT("LayerNormalizationGrad not implemented for type {}", gradX->type());
+    ABORT("LayerNormalizationGrad not implemented for type {}", adj->type());
   }
 
   // We use this go get rid of the atomicAdd and perform a reduce of the gradients afterwards.
@@ -2201,6 +2710,19 @@ void LayerNormalizationGrad(Ptr<Allocator> allocator,
   allocator->free(tempOnesMemory);
 }
 
+void LayerNormalizationGrad(Ptr<Allocator> allocator,
+                            Tensor gradX,
+                            Tensor gradGamma,
+                            Tensor gradBeta,
+                            Tensor adj,
+                            Tensor y,
+                            Tensor x,
+                            Tensor gamma,
+                            Tensor beta,
+                            float eps) {
+  gpu::ResidualLayerNormalizationGrad(allocator, gradX, nullptr, gradGamma, gradBeta, adj, y, x, nullptr, nullptr, gamma, beta, eps);
+}
+
 template <bool add, typename T>
 __global__ void gShift(T* out,
                        const T* in,
@@ -2688,6 +3210,118 @@ void LSTMOutputBackward(std::vector<Tensor> outputs,
   }
 }
 
+// one thread per position of the dimensions other than the axis
+template <typename T>
+__global__ void gCumSum(T* out, const T* in, int outer, int length, int inner, bool reverse, bool add) {
+  int total = outer * inner;
+  for(int bid = 0; bid < total; bid += blockDim.x * gridDim.x) {
+    int index = bid + blockDim.x * blockIdx.x + threadIdx.x;
+    if(index < total) {
+      int o = index / inner, i = index % inner;
+      float running = 0.f;
+      for(int step = 0; step < length; ++step) {
+        int t = reverse ? length - 1 - step : step;
+        size_t offset = ((size_t)o * length + t) * inner + i;
+        running += (float)in[offset];
+        out[offset] = add ? (T)((float)out[offset] + running) : (T)running;
+      }
+    }
+  }
+}
+
+void CumSum(Tensor out, const Tensor in, int axis, bool reverse, bool add) {
+  cudaSetDevice(out->getDeviceId().no);
+
+  const auto& shape = in->shape();
+  int length = shape[axis];
+  int inner = 1;
+  for(int i = axis + 1; i < shape.size(); ++i)
+    inner *= shape[i];
+  int outer = shape.elements() / (length * inner);
+
+  int total = outer * inner;
+  int threads = std::min(MAX_THREADS, total);
+  int blocks = std::min(MAX_BLOCKS, total / threads + (total % threads != 0));
+
+  if(out->type() == Type::float32) {
+    gCumSum<<<blocks, threads>>>(out->data<float>(), in->data<float>(), outer, length, inner, reverse, add);
+#if COMPILE_FP16
+  } else if(out->type() == Type::float16) {
+    gCumSum<<<blocks, threads>>>(out->data<half>(), in->data<half>(), outer, length, inner, reverse, add);
+#endif
+  } else {
+    ABORT("CumSum not implemented for type {}", out->type());
+  }
+}
+
+// Every thread handles groups of 4 elements, whose mask elements mostly come from the same counter,
+// see cpu::DropoutImpl()
+template <bool add, typename T>
+__global__ void gDropout(T* out,
+                         const T* in,
+                         size_t length,
+                         functional::Shape inShape,
+                         functional::Shape maskShape,
+                         bool broadcast,
+                         DropoutMask mask) {
+  float scale = mask.scale();
+  size_t groups = (length + 3) / 4;
+  for(size_t g = blockIdx.x * blockDim.x + threadIdx.x; g < groups; g += blockDim.x * gridDim.x) {
+    functional::Array<int, functional::Shape::size()> dims;
+    uint32_t r[4];
+    size_t block = (size_t)-1;
+    for(size_t i = 4 * g; i < 4 * g + 4 && i < length; ++i) {
+      size_t m = i;
+      if(broadcast) {
+        inShape.dims((int)i, dims);
+        m = maskShape.bindex(dims);
+      }
+      if(m / 4 != block) {
+        block = m / 4;
+        mask.block(block, r);
+      }
+      T v = mask.keep(r[m % 4]) ? (T)((float)in[i] * scale) : (T)0.f;
+      if(add)
+        out[i] += v;
+      else
+        out[i] = v;
+    }
+  }
+}
+
+template <bool add>
+static void DropoutImpl(Tensor out, const Tensor in, const marian::Shape& maskShape, const DropoutMask& mask) {
+  cudaSetDevice(out->getDeviceId().no);
+
+  size_t length = in->shape().elements();
+  if(length == 0)
+    return;
+  int groups = (int)((length + 3) / 4);
+  int threads = std::min(MAX_THREADS, groups);
+  int blocks = std::min(MAX_BLOCKS, groups / threads + (groups % threads != 0));
+  bool broadcast = maskShape.elements() != length;
+
+  if(out->type() == Type::float32) {
+    gDropout<add><<<blocks, threads>>>(
+        out->data<float>(), in->data<float>(), length, in->shape(), maskShape, broadcast, mask);
+#if COMPILE_FP16
+  } else if(out->type() == Type::float16) {
+    gDropout<add><<<blocks, threads>>>(
+        out->data<half>(), in->data<half>(), length, in->shape(), maskShape, broadcast, mask);
+#endif
+  } else {
+    ABORT("Dropout not implemented for type {}", out->type());
+  }
+}
+
+void DropoutForward(Tensor out, const Tensor in, const marian::Shape& maskShape, const DropoutMask& mask) {
+  DropoutImpl</*add=*/false>(out, in, maskShape, mask);
+}
+
+void DropoutBackward(Tensor grad, const Tensor adj, const marian::Shape& maskShape, const DropoutMask& mask) {
+  DropoutImpl</*add=*/true>(grad, adj, maskShape, mask);
+}
+
 template <typename T>
 __global__ void gHighwayForward(T* out,
                                 const T* in1,
@@ -2787,6 +3421,155 @@ void HighwayBackward(Tensor out1,
   }
 }
 
+// One thread per batch entry and dimension scans all time steps, see cpu::SSRUScanForward()
+template <typename T>
+__global__ void gSSRUScanForward(T* cells,
+                                 const T* c0,
+                                 const T* x,
+                                 const T* f,
+                                 const T* mask,
+                                 int outer,
+                                 int steps,
+                                 int batch,
+                                 int lanes,
+                                 bool c0PerOuter,
+                                 bool maskPerOuter,
+                                 bool reverse) {
+  int length = outer * lanes;
+  int dim = lanes / batch;
+  for(int bid = 0; bid < length; bid += blockDim.x * gridDim.x) {
+    int index = bid + blockDim.x * blockIdx.x + threadIdx.x;
+    if(index < length) {
+      int o = index / lanes, i = index % lanes;
+      T prev = c0[c0PerOuter ? index : i];
+      for(int step = 0; step < steps; ++step) {
+        int t = reverse ? steps - 1 - step : step;
+        size_t offset = ((size_t)o * steps + t) * lanes + i;
+        T m = mask ? mask[((maskPerOuter ? o * steps : 0) + t) * batch + i / dim] : (T)1.f;
+        T sigma = functional::Ops<T>::sigmoid(f[offset]);
+        prev = m * (sigma * prev + ((T)1.f - sigma) * x[offset]);
+        cells[offset] = prev;
+      }
+    }
+  }
+}
+
+template <typename T>
+__global__ void gSSRUScanBackward(T* gradC0,
+                                  T* gradX,
+                                  T* gradF,
+                                  const T* adj,
+                                  const T* cells,
+                                  const T* c0,
+                                  const T* x,
+                                  const T* f,
+                                  const T* mask,
+                                  int outer,
+                                  int steps,
+                                  int batch,
+                                  int lanes,
+                                  bool c0PerOuter,
+                                  bool maskPerOuter,
+                                  bool reverse) {
+  int length = outer * lanes;
+  int dim = lanes / batch;
+  for(int bid = 0; bid < length; bid += blockDim.x * gridDim.x) {
+    int index = bid + blockDim.x * blockIdx.x + threadIdx.x;
+    if(index < length) {
+      int o = index / lanes, i = index % lanes;
+      float carry = 0.f;
+      for(int step = steps - 1; step >= 0; --step) {
+        int t = reverse ? steps - 1 - step : step;
+        int tPrev = reverse ? t + 1 : t - 1;
+        size_t offset = ((size_t)o * steps + t) * lanes + i;
+        float prev = step == 0 ? (float)c0[c0PerOuter ? index : i] : (float)cells[((size_t)o * steps + tPrev) * lanes + i];
+        float m = mask ? (float)mask[((maskPerOuter ? o * steps : 0) + t) * batch + i / dim] : 1.f;
+        float sigma = functional::Ops<float>::sigmoid((float)f[offset]);
+        float h = m * ((float)adj[offset] + carry);
+        gradX[offset] += (T)(h * (1.f - sigma));
+        if(gradF)
+          gradF[offset] += (T)(h * (prev - (float)x[offset]) * sigma * (1.f - sigma));
+        carry = h * sigma;
+      }
+      if(gradC0) {
+        if(c0PerOuter)
+          gradC0[index] += (T)carry;
+        else
+          atomics::atomicAdd(gradC0 + i, (T)carry); // summed over the outer indices
+      }
+    }
+  }
+}
+
+static void ssruScanLayout(Tensor x, Tensor c0, Tensor mask, int& outer, int& steps, int& batch, int& lanes, bool& c0PerOuter, bool& maskPerOuter) {
+  const auto& shape = x->shape();
+  steps = shape[-3];
+  batch = shape[-2];
+  lanes = batch * shape[-1];
+  outer = shape.elements() / (steps * lanes);
+  int c0Elements = c0->shape().elements();
+  ABORT_IF(c0Elements != lanes && c0Elements != outer * lanes,
+           "Initial SSRU state {} does not match the input {}", c0->shape(), shape);
+  c0PerOuter = c0Elements != lanes;
+  maskPerOuter = mask && mask->shape().elements() != steps * batch;
+}
+
+void SSRUScanForward(Tensor cells, const Tensor c0, const Tensor x, const Tensor f, const Tensor mask, bool reverse) {
+  cudaSetDevice(cells->getDeviceId().no);
+
+  int outer, steps, batch, lanes;
+  bool c0PerOuter, maskPerOuter;
+  ssruScanLayout(x, c0, mask, outer, steps, batch, lanes, c0PerOuter, maskPerOuter);
+
+  int length = outer * lanes;
+  int threads = std::min(MAX_THREADS, length);
+  int blocks = std::min(MAX_BLOCKS, length / threads + (length % threads != 0));
+
+  if(cells->type() == Type::float32) {
+    gSSRUScanForward<<<blocks, threads>>>(cells->data<float>(), c0->data<float>(), x->data<float>(), f->data<float>(),
+                                          mask ? mask->data<float>() : nullptr,
+                                          outer, steps, batch, lanes, c0PerOuter, maskPerOuter, reverse);
+#if COMPILE_FP16
+  } else if(cells->type() == Type::float16) {
+    gSSRUScanForward<<<blocks, threads>>>(cells->data<half>(), c0->data<half>(), x->data<half>(), f->data<half>(),
+                                          mask ? mask->data<half>() : nullptr,
+                                          outer, steps, batch, lanes, c0PerOuter, maskPerOuter, reverse);
+#endif
+  } else {
+    ABORT("SSRUScanForward not implemented for type {}", cells->type());
+  }
+}
+
+void SSRUScanBackward(Tensor gradC0, Tensor gradX, Tensor gradF, Tensor adj, Tensor cells, Tensor c0, Tensor x, Tensor f, Tensor mask, bool reverse) {
+  cudaSetDevice(adj->getDeviceId().no);
+
+  int outer, steps, batch, lanes;
+  bool c0PerOuter, maskPerOuter;
+  ssruScanLayout(x, c0, mask, outer, steps, batch, lanes, c0PerOuter, maskPerOuter);
+
+  int length = outer * lanes;
+  int threads = std::min(MAX_THREADS, length);
+  int blocks = std::min(MAX_BLOCKS, length / threads + (length % threads != 0));
+
+  if(adj->type() == Type::float32) {
+    gSSRUScanBackward<<<blocks, threads>>>(gradC0 ? gradC0->data<float>() : nullptr, gradX->data<float>(),
+                                           gradF ? gradF->data<float>() : nullptr,
+                                           adj->data<float>(), cells->data<float>(), c0->data<float>(),
+                                           x->data<float>(), f->data<float>(), mask ? mask->data<float>() : nullptr,
+                                           outer, steps, batch, lanes, c0PerOuter, maskPerOuter, reverse);
+#if COMPILE_FP16
+  } else if(adj->type() == Type::float16) {
+    gSSRUScanBackward<<<blocks, threads>>>(gradC0 ? gradC0->data<half>() : nullptr, gradX->data<half>(),
+                                           gradF ? gradF->data<half>() : nullptr,
+                                           adj->data<half>(), cells->data<half>(), c0->data<half>(),
+                                           x->data<half>(), f->data<half>(), mask ? mask->data<half>() : nullptr,
+                                           outer, steps, batch, lanes, c0PerOuter, maskPerOuter, reverse);
+#endif
+  } else {
+    ABORT("SSRUScanBackward not implemented for type {}", adj->type());
+  }
+}
+
 __global__ void gMaxPoolingForward(float* out,
                                    int outRows,
                                    int outCols,
@@ -2930,5 +3713,141 @@ void PoolingWithMaskingBackward(Tensor adj,
                                            width,
                                            lastWidth);
 }
+
+// conversions of the moments of AdamUpdate(), bfloat16 with rounding to nearest even like on the CPU
+static inline __device__ float adamLoad(float x) { return x; }
+static inline __device__ void adamStore(float& out, float x) { out = x; }
+#if COMPILE_FP16
+static inline __device__ float adamLoad(half x) { return __half2float(x); }
+static inline __device__ void adamStore(half& out, float x) { out = __float2half(x); }
+#endif
+static inline __device__ float adamLoad(bfloat16 x) { return __uint_as_float((unsigned int)x.x << 16); }
+static inline __device__ void adamStore(bfloat16& out, float x) {
+  unsigned int bits = __float_as_uint(x);
+  if((bits & 0x7fffffff) > 0x7f800000) // NaN
+    out.x = (uint16_t)((bits >> 16) | 0x0040);
+  else
+    out.x = (uint16_t)((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+template <typename P, typename M>
+__global__ void gAdamUpdate(P* params, M* mt, M* vt, const P* grads, P* avg, size_t size, AdamStep step) {
+  for(size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < size; i += blockDim.x * gridDim.x) {
+    float p = (float)params[i];
+    float g = (float)grads[i];
+    if(step.lazy && g == 0.f) {
+      if(avg)
+        avg[i] = (P)(((1.f - step.avgDecay) * (float)avg[i]) + (step.avgDecay * p));
+      continue;
+    }
+    float m = step.beta1 * adamLoad(mt[i]) + step.scale1 * g;
+    float v = step.beta2 * adamLoad(vt[i]) + step.scale2 * (g * g);
+    adamStore(mt[i], m);
+    adamStore(vt[i], v);
+    p -= step.eta * ((m / step.denom1) / (sqrtf(v / step.denom2) + step.eps) + step.decay * p);
+    params[i] = (P)p;
+    if(avg)
+      avg[i] = (P)(((1.f - step.avgDecay) * (float)avg[i]) + (step.avgDecay * p));
+  }
+}
+
+template <typename P, typename M>
+static void AdamUpdateTyped(Tensor params, Tensor mt, Tensor vt, const Tensor grads, Tensor avg, const AdamStep& step) {
+  int size = (int)params->size();
+  int threads = std::min(MAX_THREADS, size);
+  int blocks = std::min(MAX_BLOCKS, size / threads + (size % threads != 0));
+  gAdamUpdate<<<blocks, threads>>>(params->data<P>(), mt->data<M>(), vt->data<M>(), grads->data<P>(),
+                                   avg ? avg->data<P>() : nullptr, params->size(), step);
+}
+
+template <typename P>
+static void AdamUpdateByMoments(Tensor params, Tensor mt, Tensor vt, const Tensor grads, Tensor avg, const AdamStep& step) {
+  if(mt->type() == Type::float32)
+    AdamUpdateTyped<P, float>(params, mt, vt, grads, avg, step);
+#if COMPILE_FP16
+  else if(mt->type() == Type::float16)
+    AdamUpdateTyped<P, half>(params, mt, vt, grads, avg, step);
+#endif
+  else if(mt->type() == Type::bfloat16)
+    AdamUpdateTyped<P, bfloat16>(params, mt, vt, grads, avg, step);
+  else
+    ABORT("Adam moments of type {} are not supported", mt->type());
+}
+
+void AdamUpdate(Tensor params, Tensor mt, Tensor vt, const Tensor grads, Tensor avg, const AdamStep& step) {
+  cudaSetDevice(params->getDeviceId().no);
+  ABORT_IF(grads->type() != params->type() || (avg && avg->type() != params->type()),
+           "AdamUpdate needs parameters, gradients and smoothed parameters of the same type");
+  ABORT_IF(mt->type() != vt->type(), "Adam moments of different types {} and {}", mt->type(), vt->type());
+  if(params->size() == 0)
+    return;
+
+  if(params->type() == Type::float32)
+    AdamUpdateByMoments<float>(params, mt, vt, grads, avg, step);
+#if COMPILE_FP16
+  else if(params->type() == Type::float16)
+    AdamUpdateByMoments<half>(params, mt, vt, grads, avg, step);
+#endif
+  else
+    ABORT("AdamUpdate for parameters of type {} not implemented", params->type());
+}
+
+// one block per part of the input, see QuantizeScaleStats()
+__global__ void gQuantizeScaleStats(float* stats, const float* in, size_t size, int parts, QuantizeStep step) {
+  __shared__ float sumAT[MAX_THREADS];
+  __shared__ float sumAA[MAX_THREADS];
+
+  size_t begin = blockIdx.x * size / parts, end = (blockIdx.x + 1) * size / parts;
+  float at = 0.f, aa = 0.f;
+  for(size_t i = begin + threadIdx.x; i < end; i += blockDim.x) {
+    float a = step.center(in[i]);
+    at += a * in[i];
+    aa += a * a;
+  }
+  sumAT[threadIdx.x] = at;
+  sumAA[threadIdx.x] = aa;
+  __syncthreads();
+
+  for(int len = blockDim.x / 2; len > 0; len /= 2) {
+    if(threadIdx.x < len) {
+      sumAT[threadIdx.x] += sumAT[threadIdx.x + len];
+      sumAA[threadIdx.x] += sumAA[threadIdx.x + len];
+    }
+    __syncthreads();
+  }
+  if(threadIdx.x == 0) {
+    stats[2 * blockIdx.x] = sumAT[0];
+    stats[2 * blockIdx.x + 1] = sumAA[0];
+  }
+}
+
+void QuantizeScaleStats(Tensor stats, const Tensor in, const QuantizeStep& step) {
+  cudaSetDevice(in->getDeviceId().no);
+  ABORT_IF(in->type() != Type::float32 || stats->type() != Type::float32, "Quantization needs float32 tensors");
+  int parts = (int)(stats->size() / 2);
+  ABORT_IF(parts > MAX_BLOCKS, "Too many parts for the quantization statistics");
+  gQuantizeScaleStats<<<parts, MAX_THREADS>>>(stats->data<float>(), in->data<float>(), in->size(), parts, step);
+}
+
+__global__ void gQuantize(float* t, float* residual, size_t size, QuantizeStep step) {
+  for(size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < size; i += blockDim.x * gridDim.x) {
+    float q = step.scale * step.center(t[i]);
+    if(residual)
+      residual[i] = t[i] - q;
+    t[i] = q;
+  }
+}
+
+void Quantize(Tensor t, Tensor residual, const QuantizeStep& step) {
+  cudaSetDevice(t->getDeviceId().no);
+  ABORT_IF(t->type() != Type::float32 || (residual && residual->type() != Type::float32),
+           "Quantization needs float32 tensors");
+  int size = (int)t->size();
+  if(size == 0)
+    return;
+  int threads = std::min(MAX_THREADS, size);
+  int blocks = std::min(MAX_BLOCKS, size / threads + (size % threads != 0));
+  gQuantize<<<blocks, threads>>>(t->data<float>(), residual ? residual->data<float>() : nullptr, t->size(), step);
+}
 }  // namespace gpu
 }  // namespace marian
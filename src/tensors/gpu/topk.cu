@@ -1,5 +1,6 @@
 #include "tensors/tensor_operators.h"
 #include "tensors/gpu/cuda_helpers.h"
+#include "tensors/gpu/radix_topk.h"
 #include "tensors/allocator.h"
 
 #include <cuda.h>
@@ -330,6 +331,19 @@ void TopK(Tensor outVal, Tensor outInd, Ptr<Allocator> allocator, const Tensor i
 
   ABORT_IF(k > cols, "Cannot select more than {} elements for axis {}", cols, axis);
 
+  // larger k are selected by radix select, whose cost does not grow with k
+  if(k >= RADIX_TOPK_MIN_K && k <= RADIX_TOPK_MAX_K) {
+    if(in->type() == Type::float32)
+      radixTopK(in->data<float>(), rows, cols, k, descending, outInd->data<IndexType>(), outVal->data<float>(), /*absoluteIndices=*/false);
+#if COMPILE_FP16
+    else if(in->type() == Type::float16)
+      radixTopK(in->data<__half>(), rows, cols, k, descending, outInd->data<IndexType>(), outVal->data<__half>(), /*absoluteIndices=*/false);
+#endif
+    else
+      ABORT("Topk not implemented for type {}", in->type());
+    return;
+  }
+
   float minimal = NumericLimits<float>(in->type()).lowest; // lowest if looking for max
 
   const int numBlocks = std::min(MAX_BINS, int(cols / (2 * BLOCK_SIZE)) + int(cols % (2 * BLOCK_SIZE) != 0));
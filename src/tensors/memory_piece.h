@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common/definitions.h"
+#include "common/object_pool.h"
 
 #include <iostream>
 
@@ -17,6 +18,8 @@ private:
   MemoryPiece(uint8_t* data, size_t size) : data_(data), size_(size) {}
 
 public:
+  ENABLE_POOLED_NEW
+
   // Use this whenever pointing to MemoryPiece
   typedef IPtr<MemoryPiece> PtrType;
 
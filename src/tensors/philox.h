@@ -0,0 +1,65 @@
+#pragma once
+
+#include "functional/defs.h"
+
+#include <cstdint>
+
+namespace marian {
+
+// Philox4x32-10, the counter-based random number generator of Salmon et al. (2011), "Parallel
+// random numbers: as easy as 1, 2, 3". The numbers of a counter only depend on the counter and
+// the key, so every element of a tensor can compute its own numbers, on the CPU and the GPU alike,
+// and the same numbers can be computed again later instead of being stored.
+struct Philox {
+  uint32_t key0, key1;
+
+  HOST_DEVICE Philox(uint64_t seed) : key0((uint32_t)seed), key1((uint32_t)(seed >> 32)) {}
+
+  // the four random 32-bit numbers of the counter
+  HOST_DEVICE_INLINE void operator()(uint64_t counter, uint32_t out[4]) const {
+    uint32_t c0 = (uint32_t)counter, c1 = (uint32_t)(counter >> 32), c2 = 0, c3 = 0;
+    uint32_t k0 = key0, k1 = key1;
+    for(int round = 0; round < 10; ++round) {
+      uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+      uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+      c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+      c1 = (uint32_t)p1;
+      c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+      c3 = (uint32_t)p0;
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+  }
+
+  // uniform in [0, 1) from the upper 24 bits
+  HOST_DEVICE_INLINE static float uniform(uint32_t r) { return (r >> 8) * (1.f / 16777216.f); }
+};
+
+// Dropout mask that is computed from the random stream (seed, offset) wherever it is needed instead
+// of being stored: element i is 1 / keepProb with probability keepProb and 0 otherwise. The four
+// elements of a counter are consecutive, offset is a multiple of 4, see RandomGenerator::reserve().
+struct DropoutMask {
+  Philox philox;
+  uint64_t offset;
+  float keepProb;
+
+  DropoutMask(uint64_t seed, uint64_t offset, float dropProb)
+      : philox(seed), offset(offset), keepProb(1.f - dropProb) {}
+
+  HOST_DEVICE_INLINE float scale() const { return 1.f / keepProb; }
+
+  HOST_DEVICE_INLINE bool keep(uint32_t r) const { return Philox::uniform(r) < keepProb; }
+
+  // the element i of the mask, for i in ascending order call block() once per 4 elements instead
+  HOST_DEVICE_INLINE float operator()(uint64_t i) const {
+    uint32_t r[4];
+    philox((offset + i) / 4, r);
+    return keep(r[i % 4]) ? scale() : 0.f;
+  }
+
+  // the random numbers of the elements 4 * block to 4 * block + 3
+  HOST_DEVICE_INLINE void block(uint64_t block, uint32_t r[4]) const { philox(offset / 4 + block, r); }
+};
+
+}  // namespace marian
@@ -12,12 +12,23 @@ typedef IPtr<TensorBase> Tensor;
 class RandomGenerator {
 protected:
   size_t seed_;
+  size_t counter_{0}; // next offset of the counter-based stream, see reserve()
 
 public:
   RandomGenerator(size_t seed) : seed_(seed) { }
   virtual ~RandomGenerator() {}
   virtual void uniform(Tensor, float a, float b) = 0;
   virtual void normal(Tensor, float mean, float stddev) = 0;
+
+  // Reserves the next `elements` numbers of the counter-based stream of the seed (see Philox in
+  // tensors/philox.h) and returns their offset, a multiple of 4. Consumers such as the dropout node
+  // compute the numbers of (seed(), offset) themselves, as often as needed.
+  size_t reserve(size_t elements) {
+    size_t offset = counter_;
+    counter_ += (elements + 3) / 4 * 4;
+    return offset;
+  }
+  size_t seed() const { return seed_; }
 };
 
 Ptr<RandomGenerator> createRandomGenerator(size_t /*seed*/, DeviceId);
@@ -55,6 +55,8 @@ class TensorBase {
         shape_(shape), type_(type), backend_(backend) {}
 
 public:
+  ENABLE_POOLED_NEW
+
   // Use this whenever pointing to MemoryPiece
   typedef IPtr<TensorBase> PtrType;
 
@@ -157,7 +159,7 @@ public:
       }
 #ifdef CUDA_FOUND
       else {
-        gpu::copy(backend_, &value, &value + 1, data<T>() + i);
+        gpu::copyFromHost(backend_, &value, &value + 1, data<T>() + i);
       }
 #endif
     }
@@ -177,7 +179,7 @@ public:
     }
 #ifdef CUDA_FOUND
     else {
-      gpu::copy(backend_, begin, end, data<T>());
+      gpu::copyFromHost(backend_, begin, end, data<T>());
     }
 #endif
   }
@@ -242,7 +244,9 @@ public:
     }
 #ifdef CUDA_FOUND
     else {
-      gpu::copy(backend_, in->data<T>(), in->data<T>() + in->size(), data<T>());
+      // a copy into CPU memory runs on the device of the source
+      auto backend = backend_->getDeviceId().type == DeviceType::cpu ? in->getBackend() : backend_;
+      gpu::copy(backend, in->data<T>(), in->data<T>() + in->size(), data<T>());
     }
 #endif
   }
@@ -271,6 +275,9 @@ public:
       if(backend_->getDeviceId() == swapee->getBackend()->getDeviceId()) {
         // we live on the same GPU; do an element-wise swap
         gpu::swap_ranges(backend_, swapee->data<T>(), swapee->data<T>() + swapee->size(), data<T>());
+      } else if(backend_->getDeviceId().type == DeviceType::cpu) {
+        // the transfers have to run on the device of the swapee
+        swapee->swap<T>(PtrType(this));
       } else {
         // we live on two different GPUs or devices; go through CPU RAM
         std::vector<T> temp;
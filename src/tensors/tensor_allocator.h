@@ -91,5 +91,6 @@ public:
   size_t size(Type type = Type::float32) { return allocator_->size() / sizeOf(type); }
 
   Ptr<Allocator> allocator() { return allocator_; }
+  Ptr<Backend> getBackend() { return backend_; }
 };
 }  // namespace marian
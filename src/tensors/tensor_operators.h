@@ -5,6 +5,7 @@
 #include "tensors/tensor.h"
 
 #include "tensors/dispatch.h"
+#include "tensors/philox.h"
 
 #include "functional/shape.h"
 #include "functional/tensor.h"
@@ -21,6 +22,7 @@
 #include "tensors/cpu/element.h"
 
 #include <algorithm>
+#include <cmath>
 
 namespace marian {
 
@@ -112,6 +114,16 @@ DISPATCH3(LogSoftmaxGrad, marian::Tensor, marian::Tensor, marian::Tensor)
 DISPATCH4(CrossEntropyPick, marian::Tensor, marian::Tensor, marian::Tensor, float)
 DISPATCH5(CrossEntropyPickBackward, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, float)
 
+// Cross-entropy over a vocabulary that is processed in tiles, see AffineCrossEntropyNodeOp. logits is the
+// [rows x cols] tile that starts at column offset of the [rows x dimVocab] logits. CrossEntropyTileStats
+// updates stats [rows x 4], the running maximum, sum of exp(logit - maximum), sum of logits and the logit
+// of the label of each row; the tile at offset 0 initializes them. After the last tile, it writes the
+// cross-entropy with label smoothing to out [rows] unless out is null, like CrossEntropyPick would for
+// the whole logits. CrossEntropyTileBackward sets out [rows x cols] to the gradient of the tile for the
+// adjoint adj [rows] of the cross-entropy, given the stats of all tiles.
+DISPATCH7(CrossEntropyTileStats, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, int, int, float)
+DISPATCH8(CrossEntropyTileBackward, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, int, int, float)
+
 DISPATCH3(TransposeND, marian::Tensor, marian::Tensor, const std::vector<int>&)
 DISPATCH3(TransposeNDGrad, marian::Tensor, marian::Tensor, const std::vector<int>&)
 
@@ -137,6 +149,12 @@ static inline void Dropout(Tensor tensor, float dropProb) {
   Bernoulli(tensor, keepProb, scale, /*shift=*/0.f);
 }
 
+// out = in * mask with the mask computed on the fly, see DropoutMask. The mask has maskShape, which
+// broadcasts to the shape of in, e.g. {dimTime, 1, 1} to drop whole embeddings. DropoutBackward adds
+// adj * mask to grad, with the same mask, which hence is never stored.
+DISPATCH4(DropoutForward, marian::Tensor, const marian::Tensor, const marian::Shape&, const DropoutMask&)
+DISPATCH4(DropoutBackward, marian::Tensor, const marian::Tensor, const marian::Shape&, const DropoutMask&)
+
 #ifdef CUDA_FOUND
 namespace gpu {
 void Deconcatenate(std::vector<marian::Tensor>& outputs,
@@ -211,9 +229,97 @@ static inline void LayerNormalizationGrad(
     cpu::LayerNormalizationGrad(gradX, gradGamma, gradBeta, adj, y, x, gamma, beta, eps);
 }
 
+// Layer normalization of x * mask + residual along the last axis without materializing the sum.
+// mask (a dropout mask of the shape of x) may be nullptr.
+DISPATCH7(ResidualLayerNormalization, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, float)
+
+#ifdef CUDA_FOUND
+namespace gpu {
+void ResidualLayerNormalizationGrad(Ptr<Allocator> allocator,
+                                    Tensor gradX,
+                                    Tensor gradResidual,
+                                    Tensor gradGamma,
+                                    Tensor gradBeta,
+                                    Tensor adj,
+                                    Tensor y,
+                                    Tensor x,
+                                    Tensor mask,
+                                    Tensor residual,
+                                    Tensor gamma,
+                                    Tensor beta,
+                                    float eps);
+}
+#endif
+
+namespace cpu {
+void ResidualLayerNormalizationGrad(Tensor gradX,
+                                    Tensor gradResidual,
+                                    Tensor gradGamma,
+                                    Tensor gradBeta,
+                                    Tensor adj,
+                                    Tensor y,
+                                    Tensor x,
+                                    Tensor mask,
+                                    Tensor residual,
+                                    Tensor gamma,
+                                    Tensor beta,
+                                    float eps);
+}
+
+static inline void ResidualLayerNormalizationGrad(
+                            Ptr<Allocator> allocator,
+                            Tensor gradX,
+                            Tensor gradResidual,
+                            Tensor gradGamma,
+                            Tensor gradBeta,
+                            Tensor adj,
+                            Tensor y,
+                            Tensor x,
+                            Tensor mask,
+                            Tensor residual,
+                            Tensor gamma,
+                            Tensor beta,
+                            float eps) {
+#ifdef CUDA_FOUND
+  if(adj->getBackend()->getDeviceId().type == DeviceType::gpu)
+    gpu::ResidualLayerNormalizationGrad(allocator, gradX, gradResidual, gradGamma, gradBeta, adj, y, x, mask, residual, gamma, beta, eps);
+  else
+#endif
+    cpu::ResidualLayerNormalizationGrad(gradX, gradResidual, gradGamma, gradBeta, adj, y, x, mask, residual, gamma, beta, eps);
+}
+
+// out = cumulative sum of in along axis, from the last position backwards if reverse; with add the
+// sums are added to out
+DISPATCH5(CumSum, marian::Tensor, const marian::Tensor, int, bool, bool)
+
 DISPATCH4(HighwayForward, marian::Tensor, const marian::Tensor, const marian::Tensor, const marian::Tensor)
 DISPATCH7(HighwayBackward, marian::Tensor, marian::Tensor, marian::Tensor, const marian::Tensor, const marian::Tensor, const marian::Tensor, const marian::Tensor)
 
+// cells[t] = mask[t] * (sigmoid(f[t]) * cells[t - 1] + (1 - sigmoid(f[t])) * x[t]) along axis -3,
+// backwards in time if reverse, with c0 as cells[-1]. mask may be nullptr.
+DISPATCH6(SSRUScanForward, marian::Tensor, const marian::Tensor, const marian::Tensor, const marian::Tensor, const marian::Tensor, bool)
+
+#ifdef CUDA_FOUND
+namespace gpu {
+void SSRUScanBackward(Tensor gradC0, Tensor gradX, Tensor gradF, Tensor adj, Tensor cells, Tensor c0, Tensor x, Tensor f, Tensor mask, bool reverse);
+}
+#endif
+
+namespace cpu {
+void SSRUScanBackward(Tensor gradC0, Tensor gradX, Tensor gradF, Tensor adj, Tensor cells, Tensor c0, Tensor x, Tensor f, Tensor mask, bool reverse);
+}
+
+// adds the gradients of SSRUScanForward(), gradC0 and gradF may be nullptr
+static inline void SSRUScanBackward(
+    Tensor gradC0, Tensor gradX, Tensor gradF, Tensor adj, Tensor cells, Tensor c0, Tensor x, Tensor f, Tensor mask, bool reverse) {
+#ifdef CUDA_FOUND
+  if(adj->getBackend()->getDeviceId().type == DeviceType::gpu)
+    gpu::SSRUScanBackward(gradC0, gradX, gradF, adj, cells, c0, x, f, mask, reverse);
+  else
+#endif
+    cpu::SSRUScanBackward(gradC0, gradX, gradF, adj, cells, c0, x, f, mask, reverse);
+}
+
 DISPATCH3(CopyRows, marian::Tensor, const marian::Tensor, const marian::Tensor)
 DISPATCH3(PasteRows, marian::Tensor, const marian::Tensor, const marian::Tensor)
 
@@ -225,6 +331,33 @@ DISPATCH4(Insert, marian::Tensor, const marian::Tensor, const marian::Tensor, in
 
 DISPATCH7(TopK, marian::Tensor, marian::Tensor, Ptr<Allocator>, const marian::Tensor, int, int, bool);
 
+// out = softmax(scale * q * k^T + mask) * v without materializing the attention weights. q is
+// [..., heads, queries, dim], k and v are [..., heads, keys, dim] with their batch broadcast as in
+// ProdBatched(), mask is additive and broadcasts to the scores, it may be nullptr.
+DISPATCH6(FusedAttention, marian::Tensor, const marian::Tensor, const marian::Tensor, const marian::Tensor, const marian::Tensor, float)
+
+#ifdef CUDA_FOUND
+namespace gpu {
+void FusedAttentionBackward(Tensor gradQ, Tensor gradK, Tensor gradV, Tensor adj, Tensor out, Tensor q, Tensor k, Tensor v, Tensor mask, float scale);
+}
+#endif
+
+namespace cpu {
+void FusedAttentionBackward(Tensor gradQ, Tensor gradK, Tensor gradV, Tensor adj, Tensor out, Tensor q, Tensor k, Tensor v, Tensor mask, float scale);
+}
+
+// adds the gradients of FusedAttention(), recomputing the attention weights; gradQ, gradK and gradV
+// may be nullptr
+static inline void FusedAttentionBackward(
+    Tensor gradQ, Tensor gradK, Tensor gradV, Tensor adj, Tensor out, Tensor q, Tensor k, Tensor v, Tensor mask, float scale) {
+#ifdef CUDA_FOUND
+  if(adj->getBackend()->getDeviceId().type == DeviceType::gpu)
+    gpu::FusedAttentionBackward(gradQ, gradK, gradV, adj, out, q, k, v, mask, scale);
+  else
+#endif
+    cpu::FusedAttentionBackward(gradQ, gradK, gradV, adj, out, q, k, v, mask, scale);
+}
+
 DISPATCH2(LSTMCellForward, marian::Tensor, std::vector<marian::Tensor>)
 DISPATCH2(LSTMOutputForward, marian::Tensor, std::vector<marian::Tensor>);
 // clang-format on
@@ -314,6 +447,12 @@ DISPATCH4(Att, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor)
 DISPATCH7(AttBack, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor)
 // clang-format on
 
+// The attention weights of a decoder step of the RNN attention in one pass: the scores of Att(), the softmax
+// over the source positions and the layout [beam, src words, batch, 1] of the transposes around it. Masked
+// positions get maskValue added to their scores, like softmax() with a mask. mask may be nullptr. Inference
+// only, there is no backward operation.
+DISPATCH6(AttentionWeights, marian::Tensor /*out*/, const marian::Tensor /*va*/, const marian::Tensor /*context*/, const marian::Tensor /*state*/, const marian::Tensor /*mask*/, float /*maskValue*/)
+
 #ifdef CUDA_FOUND
 namespace gpu {
 float L2Norm(marian::Tensor in, Ptr<Allocator> allocator);
@@ -337,4 +476,51 @@ static inline float L2Norm(marian::Tensor in, Ptr<Allocator> allocator) {
 DISPATCH5(PoolingWithMaskingForward, marian::Tensor, marian::Tensor, marian::Tensor, int, bool)
 DISPATCH6(PoolingWithMaskingBackward, marian::Tensor, marian::Tensor, marian::Tensor, marian::Tensor, int, bool)
 // clang-format on
+
+// Constants of one step of AdamUpdate(), see Adam::updateImpl()
+struct AdamStep {
+  float beta1, beta2;   // decay of the moments
+  float scale1, scale2; // factor of the gradients, and the squared gradients, in the moments
+  float eta, denom1, denom2, eps, decay;
+  float avgDecay;       // weight of the updated parameters in the exponential smoothing
+  bool lazy;            // leave parameters and moments with a zero gradient alone (lazy Adam)
+};
+
+// One step of Adam in a single pass over the memory, per element:
+//   mt = beta1 * mt + scale1 * g,  vt = beta2 * vt + scale2 * g * g
+//   params -= eta * ((mt / denom1) / (sqrt(vt / denom2) + eps) + decay * params)
+//   avg = (1 - avgDecay) * avg + avgDecay * params, if avg is not null (exponential smoothing)
+// mt and vt may be float32, float16 or bfloat16, they are computed in float32. With step.lazy, elements
+// with a zero gradient, e.g. the embeddings of words not in the batch, are only smoothed.
+DISPATCH6(AdamUpdate, marian::Tensor /*params*/, marian::Tensor /*mt*/, marian::Tensor /*vt*/, const marian::Tensor /*grads*/, marian::Tensor /*avg*/, const AdamStep&)
+
+// Simulated quantization of ModelQuantizer: values are clipped to [-scale, scale] and rounded to one
+// of numCenters evenly spaced centers on either side of 0 or, with a logBase, to scale times a power of
+// logBase with an exponent in [-numCenters, 0]
+struct QuantizeStep {
+  float scale;
+  float numCenters; // 2^(bits - 1) - 1
+  float logBase;    // 0 for fixed-point quantization
+
+  // the quantized value of x divided by scale
+  HOST_DEVICE_INLINE float center(float x) const {
+    float c = fabsf(x) >= scale ? (x > 0.f ? scale : -scale) : x;
+    if(logBase == 0.f)
+      return roundf(c * (numCenters / scale)) / numCenters;
+    // rounds in normal space instead of log space, e.g. 11.8 to 8 instead of 16 for base 2
+    float mult = (2.f * logBase) / (1.f + logBase);
+    float e = floorf(logf(fabsf(c / scale) * mult) / logf(logBase));
+    e = fabsf(e) >= numCenters ? (e > 0.f ? numCenters : -numCenters) : e;
+    return (float)((0.f < c) - (c < 0.f)) * powf(logBase, e);
+  }
+};
+
+// The fused passes of ModelQuantizer over a parameter tensor. QuantizeScaleStats() splits `in` into
+// stats->size() / 2 consecutive parts and writes the sums of a * t and a * a over each part, where
+// a = step.center(t), to the even and odd elements of stats; the optimal scale for the centers is
+// sum(a * t) / sum(a * a). The parts keep the result independent of threads and atomics, the caller
+// sums them in order. Quantize() replaces t by its quantized values step.scale * step.center(t) and,
+// unless residual is null, writes the quantization error, the original minus the quantized t, to it.
+DISPATCH3(QuantizeScaleStats, marian::Tensor /*stats*/, const marian::Tensor /*in*/, const QuantizeStep&)
+DISPATCH3(Quantize, marian::Tensor /*t*/, marian::Tensor /*residual*/, const QuantizeStep&)
 }  // namespace marian
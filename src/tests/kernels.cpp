@@ -0,0 +1,308 @@
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "marian.h"
+#include "common/timer.h"
+#include "translator/nth_element.h"
+
+#if USE_FBGEMM
+#include "tensors/cpu/fbgemm/expanded_gemm.h"
+#endif
+
+// Microbenchmarks of the kernels behind the operators that dominate training and decoding, on
+// Transformer-like shapes: elementwise operations, reductions, softmax, layer normalization,
+// transposition, matrix products in float, int8 (intgemm) and packed fp16 (fbgemm), and the
+// n-best selection of the beam search. Each case builds its expression once and then times the
+// forward step of the final node only, waiting for the device after each run. The achieved GB/s and
+// GFLOP/s count the bytes of the operands and the result, and 2*m*n*k for matrix products.
+//
+// Usage: test_kernels [--gpu N] [--threads N] [--repeats N] [--json] [filter]
+// where filter selects the cases whose name contains it. With --json, every case is printed as
+// one JSON object per line, e.g. for comparing hardware or revisions.
+
+using namespace marian;
+
+namespace {
+
+struct Settings {
+  DeviceId device{0, DeviceType::cpu};
+  size_t threads{1};
+  size_t repeats{0}; // 0: as many as fit into minSeconds
+  bool json{false};
+  std::string filter;
+};
+
+const double minSeconds = 0.25;
+
+std::string cpuLabel() {
+  std::string model;
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while(std::getline(cpuinfo, line)) {
+    if(line.compare(0, 10, "model name") == 0) {
+      model = line.substr(line.find(':') + 2);
+      break;
+    }
+  }
+  std::string features;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx"))      features += " avx";
+  if(__builtin_cpu_supports("avx2"))     features += " avx2";
+  if(__builtin_cpu_supports("fma"))      features += " fma";
+  if(__builtin_cpu_supports("avx512f"))  features += " avx512f";
+  if(__builtin_cpu_supports("avx512bw")) features += " avx512bw";
+  if(__builtin_cpu_supports("avx512vl")) features += " avx512vl";
+#endif
+  return (model.empty() ? "unknown CPU" : model) + (features.empty() ? "" : " |" + features);
+}
+
+std::string shapeString(const Shape& shape) {
+  std::string s;
+  for(int dim : shape)
+    s += (s.empty() ? "" : "x") + std::to_string(dim);
+  return s;
+}
+
+class Bench {
+private:
+  Settings settings_;
+  Ptr<ExpressionGraph> graph_;
+
+  bool selected(const std::string& name) const {
+    return settings_.filter.empty() || name.find(settings_.filter) != std::string::npos;
+  }
+
+  // runs fn until minSeconds have passed or for the given number of repeats, returns seconds per run
+  double time(const std::function<void()>& fn) {
+    auto backend = graph_->getBackend();
+    fn(); // warm-up, e.g. for lazily allocated scratch memory
+    backend->synchronize();
+
+    size_t runs = 0;
+    timer::Timer timer;
+    do {
+      fn();
+      backend->synchronize();
+      ++runs;
+    } while(settings_.repeats ? runs < settings_.repeats : timer.elapsed() < minSeconds);
+    return timer.elapsed() / runs;
+  }
+
+  void report(const std::string& name, const std::string& shape, Type type, double seconds, double flops, double bytes) {
+    double gflops = flops / seconds * 1e-9;
+    double gbytes = bytes / seconds * 1e-9;
+    if(settings_.json) {
+      std::cout << fmt::format("{{\"kernel\": \"{}\", \"shape\": \"{}\", \"type\": \"{}\", \"device\": \"{}\", "
+                               "\"threads\": {}, \"us\": {:.3f}, \"gflops\": {:.3f}, \"gbytes\": {:.3f}}}",
+                               name, shape, type, std::string(settings_.device), settings_.threads,
+                               seconds * 1e6, gflops, gbytes)
+                << std::endl;
+    } else {
+      std::cout << fmt::format("{:<24} {:<24} {:<8} {:>12.2f} {:>10.2f} {:>10.2f}", name, shape, type, seconds * 1e6, gflops, gbytes)
+                << std::endl;
+    }
+  }
+
+public:
+  Bench(const Settings& settings) : settings_(settings) {
+    // not an inference graph, which would release the children of the nodes after the forward
+    // pass, plan their memory and fuse elementwise chains
+    graph_ = New<ExpressionGraph>();
+    graph_->setDevice(settings_.device);
+    graph_->getBackend()->setNumThreads(settings_.threads);
+    graph_->reserveWorkspaceMB(2048);
+  }
+
+  Ptr<ExpressionGraph> graph() { return graph_; }
+
+  void header() {
+    if(settings_.json)
+      return;
+    std::cout << "Device " << std::string(settings_.device) << ", " << settings_.threads << " thread(s), " << cpuLabel() << std::endl;
+    std::cout << fmt::format("{:<24} {:<24} {:<8} {:>12} {:>10} {:>10}", "Kernel", "Shape", "Type", "us", "GFLOP/s", "GB/s") << std::endl;
+  }
+
+  // Times the forward step of the node returned by build(). Flops are given per element of the
+  // result, the bytes are those of the children and the result unless given explicitly.
+  void node(const std::string& name, Type type, const std::function<Expr(Expr)>& build, const Shape& shape,
+            double flopsPerElement = 1, double flops = 0) {
+    if(!selected(name))
+      return;
+    graph_->clear();
+    auto x = graph_->constant(shape, inits::uniform(-1.f, 1.f), Type::float32);
+    if(type != Type::float32)
+      x = cast(x, type);
+    auto y = build(x);
+    graph_->forward();
+
+    double bytes = (double)y->shape().elements() * sizeOf(y->value_type());
+    for(auto& child : y->children())
+      bytes += (double)child->shape().elements() * sizeOf(child->value_type());
+    if(flops == 0)
+      flops = flopsPerElement * y->shape().elements();
+
+    double seconds = time([&]() { y->forward(); });
+    report(name, shapeString(shape), type, seconds, flops, bytes);
+  }
+
+  // Times C = op(A, B) with A [rows, k] and B [k, cols], flops 2*rows*cols*k
+  void product(const std::string& name, Type type, int rows, int k, int cols,
+               const std::function<Expr(Expr, Expr)>& build) {
+    if(!selected(name))
+      return;
+    graph_->clear();
+    auto a = graph_->constant({rows, k}, inits::uniform(-1.f, 1.f), Type::float32);
+    auto b = graph_->constant({k, cols}, inits::uniform(-1.f, 1.f), Type::float32);
+    if(type != Type::float32) {
+      a = cast(a, type);
+      b = cast(b, type);
+    }
+    auto y = build(a, b);
+    graph_->forward();
+
+    double bytes = ((double)rows * k + (double)k * cols + (double)rows * cols) * sizeOf(type);
+    double seconds = time([&]() { y->forward(); });
+    report(name, fmt::format("{}x{}x{}", rows, k, cols), type, seconds, 2. * rows * cols * k, bytes);
+  }
+
+  // Times the selection of the beam search from scores of the given shape with fn
+  void nbest(const std::string& name, const Shape& shape,
+             const std::function<void(Tensor, std::vector<float>&, std::vector<unsigned>&)>& fn) {
+    if(!selected(name))
+      return;
+    graph_->clear();
+    auto x = graph_->constant(shape, inits::uniform(-1.f, 1.f), Type::float32);
+    graph_->forward();
+
+    std::vector<float> scores;
+    std::vector<unsigned> keys;
+    double seconds = time([&]() {
+      scores.clear();
+      keys.clear();
+      fn(x->val(), scores, keys);
+    });
+    report(name, shapeString(shape), Type::float32, seconds, (double)shape.elements(), (double)shape.elements() * sizeof(float));
+  }
+};
+
+void run(const Settings& settings) {
+  Bench bench(settings);
+  bench.header();
+  auto graph = bench.graph();
+  bool cpu = settings.device.type == DeviceType::cpu;
+
+  const int dimModel = 512, dimFfn = 2048, dimVocab = 32000, heads = 8;
+  std::vector<int> tokens = {256, 1024}; // batch x length, e.g. training and decoding
+  std::vector<Type> types = {Type::float32};
+  if(!cpu)
+    types.push_back(Type::float16);
+
+  for(auto type : types) {
+    for(int t : tokens) {
+      // elementwise and reductions, memory bound
+      bench.node("tanh", type, [](Expr x) { return tanh(x); }, {t, dimFfn});
+      bench.node("add_bias", type, [&](Expr x) {
+        auto bias = graph->constant({1, dimFfn}, inits::uniform(), type);
+        return x + bias;
+      }, {t, dimFfn});
+      bench.node("relu", type, [](Expr x) { return relu(x); }, {t, dimFfn});
+      bench.node("sum_rows", type, [](Expr x) { return sum(x, -1); }, {t, dimFfn});
+
+      // softmax and normalizations
+      bench.node("softmax", type, [](Expr x) { return softmax(x); }, {t / 32, heads, 32, 32}, 5);
+      bench.node("logsoftmax", type, [](Expr x) { return logsoftmax(x); }, {t / 8, dimVocab}, 5);
+      bench.node("layer_norm", type, [&](Expr x) {
+        auto gamma = graph->constant({1, dimModel}, inits::ones(), type);
+        auto beta = graph->constant({1, dimModel}, inits::zeros(), type);
+        return layerNorm(x, gamma, beta);
+      }, {t, dimModel}, 8);
+
+      // splitting and merging attention heads
+      bench.node("transpose_0213", type, [](Expr x) { return transpose(x, {0, 2, 1, 3}); },
+                 {t / 32, 32, heads, dimModel / heads}, 0);
+
+      // matrix products of the feed-forward layers, the attention and the output layer
+      auto dotFn = [](Expr a, Expr b) { return dot(a, b); };
+      bench.product("dot_ffn1", type, t, dimModel, dimFfn, dotFn);
+      bench.product("dot_ffn2", type, t, dimFfn, dimModel, dotFn);
+      bench.product("dot_output", type, t / 8, dimModel, dimVocab, dotFn);
+      int batch = t / 32;
+      bench.node("bdot_attention", type, [&](Expr q) {
+        auto k = graph->constant({batch, heads, 32, dimModel / heads}, inits::uniform(-1.f, 1.f), type);
+        return bdot(q, k, false, true);
+      }, {batch, heads, 32, dimModel / heads}, 0, 2. * batch * heads * 32 * 32 * (dimModel / heads));
+
+      // n-best over the vocabulary as a graph operator
+      bench.node("topk_4", type, [](Expr x) { return std::get<0>(topk(x, 4, -1)); }, {t / 8, dimVocab});
+    }
+  }
+
+  for(int t : tokens) {
+    if(cpu) {
+      // int8 products quantizing both operands at runtime
+      bench.product("dot_int8_ffn1", Type::float32, t, dimModel, dimFfn,
+                    [](Expr a, Expr b) { return bdotInt8(a, b); });
+      bench.product("dot_int8_output", Type::float32, t / 8, dimModel, dimVocab,
+                    [](Expr a, Expr b) { return bdotInt8(a, b); });
+#if USE_FBGEMM
+      // products with B packed to fp16 ahead of time, as for models converted with marian-conv
+      auto packed16Fn = [](Expr a, Expr b) {
+        auto packed = cpu::variant::pack(Type::packed16, b, cpu::variant::PackMatrix::B, false);
+        return cpu::variant::dot(a, packed, b->shape(), false, false, 1.f);
+      };
+      bench.product("dot_packed16_ffn1", Type::float32, t, dimModel, dimFfn, packed16Fn);
+      bench.product("dot_packed16_output", Type::float32, t / 8, dimModel, dimVocab, packed16Fn);
+#endif
+    }
+  }
+
+  // the selection of the next hypotheses in the beam search, batch of 16 sentences
+  for(int beamSize : {1, 4, 8}) {
+    const int batch = 16;
+    auto nthElement = createGetNBestListFn(beamSize, batch, settings.device);
+    bench.nbest(fmt::format("nth_element_beam{}", beamSize), {batch, 1, beamSize, dimVocab},
+                [&](Tensor x, std::vector<float>& scores, std::vector<unsigned>& keys) {
+                  nthElement(x, beamSize, scores, keys, /*isFirst=*/false);
+                });
+    if(cpu) {
+      bench.nbest(fmt::format("nbest_fused_beam{}", beamSize), {beamSize, 1, batch, dimVocab},
+                  [&](Tensor x, std::vector<float>& scores, std::vector<unsigned>& keys) {
+                    getNBestListFusedLogSoftmax(x, {}, 1.f, -1, beamSize, scores, keys);
+                  });
+      if(beamSize == 1)
+        bench.nbest("best_per_row", {batch, dimVocab},
+                    [&](Tensor x, std::vector<float>& scores, std::vector<unsigned>& keys) {
+                      getBestPerRow(x, -1, scores, keys);
+                    });
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Settings settings;
+  for(int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if(arg == "--gpu" && i + 1 < argc) {
+      settings.device = {(size_t)std::stoul(argv[++i]), DeviceType::gpu};
+    } else if(arg == "--threads" && i + 1 < argc) {
+      settings.threads = std::stoul(argv[++i]);
+    } else if(arg == "--repeats" && i + 1 < argc) {
+      settings.repeats = std::stoul(argv[++i]);
+    } else if(arg == "--json") {
+      settings.json = true;
+    } else if(arg.compare(0, 2, "--") != 0) {
+      settings.filter = arg;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--gpu N] [--threads N] [--repeats N] [--json] [filter]" << std::endl;
+      return 1;
+    }
+  }
+
+  run(settings);
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <iostream>
+#include <vector>
+
+#include "marian.h"
+#include "common/timer.h"
+#include "tensors/cpu/transpose.h"
+
+using namespace marian;
+
+// Element by element with index arithmetic, like the former generic CPU transposition
+static void transposeReference(Tensor out, Tensor in, const std::vector<int>& axes) {
+  int n = (int)axes.size();
+  std::vector<int> inShape(n), outShape(n), oDims(n), iDims(n);
+  for(int i = 0; i < n; ++i) {
+    inShape[i] = in->shape()[i];
+    outShape[i] = out->shape()[i];
+  }
+  const float* inData = in->data();
+  float* outData = out->data();
+  for(int index = 0; index < out->shape().elements(); ++index) {
+    for(int i = n - 1, rest = index; i >= 0; --i) {
+      oDims[i] = rest % outShape[i];
+      rest /= outShape[i];
+    }
+    for(int i = 0; i < n; ++i)
+      iDims[axes[i]] = oDims[i];
+    int inIndex = 0;
+    for(int i = 0; i < n; ++i)
+      inIndex = inIndex * inShape[i] + iDims[i];
+    outData[index] = inData[inIndex];
+  }
+}
+
+int main(int /*argc*/, char** /*argv*/) {
+  auto g = New<ExpressionGraph>(true);
+  g->setDevice({0, DeviceType::cpu});
+  g->reserveWorkspaceMB(512);
+
+  std::cout << "Tile width " << cpu::transposeTileWidth() << std::endl;
+
+  // batch x length x heads x dimHead and the permutations of attention head splitting and merging
+  std::vector<Shape> shapes = {{64, 32, 8, 64}, {16, 100, 16, 64}, {1, 250, 8, 33}, {5, 17, 3, 48}};
+  std::vector<std::vector<int>> permutations
+      = {{0, 2, 1, 3}, {0, 2, 3, 1}, {0, 3, 1, 2}, {0, 1, 3, 2}, {2, 0, 1, 3}, {3, 2, 1, 0}};
+
+  bool ok = true;
+  for(const auto& shape : shapes) {
+    for(const auto& axes : permutations) {
+      g->clear();
+      auto x = g->constant(shape, inits::uniform());
+      auto y = transpose(x, axes);
+      auto ref = g->constant(y->shape(), inits::zeros());
+      g->forward();
+
+      int iterations = (int)(1e8 / shape.elements()) + 1;
+
+      timer::Timer timer;
+      for(int i = 0; i < iterations; ++i)
+        cpu::TransposeND(y->val(), x->val(), axes);
+      double tiled = timer.elapsed<std::chrono::microseconds>() / iterations;
+
+      timer.start();
+      for(int i = 0; i < iterations; ++i)
+        transposeReference(ref->val(), x->val(), axes);
+      double reference = timer.elapsed<std::chrono::microseconds>() / iterations;
+
+      std::vector<float> vy, vref;
+      y->val()->get(vy);
+      ref->val()->get(vref);
+      bool equal = vy == vref;
+      ok = ok && equal;
+
+      std::cout << shape << " axes " << axes[0] << axes[1] << axes[2] << axes[3] << ": " << tiled
+                << " us, reference " << reference << " us, speedup " << reference / tiled
+                << (equal ? "" : " MISMATCH") << std::endl;
+    }
+  }
+
+  return ok ? 0 : 1;
+}
@@ -121,3 +121,79 @@ TEST_CASE("Expression graph can be initialized with constant values (cpu)",
     REQUIRE(values == v);
   }
 }
+
+TEST_CASE("Gradient checkpointing does not change gradients (cpu)", "[graph]") {
+  // a residual stack with a manual checkpoint after every second layer
+  auto gradients = [](bool checkpointing, size_t budgetMB) {
+    auto graph = New<ExpressionGraph>();
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(32);
+    graph->setCheckpointing(checkpointing);
+    graph->setCheckpointingBudget(budgetMB);
+
+    std::vector<float> values;
+    for(int step = 0; step < 3; ++step) { // the policy times the recomputations of the first passes
+      graph->clear();
+      std::vector<float> x(256 * 512);
+      for(size_t i = 0; i < x.size(); ++i)
+        x[i] = (float)((i * 7919) % 101) / 101.f - 0.5f;
+      auto h = graph->constant({256, 512}, inits::fromVector(x));
+      for(int l = 0; l < 4; ++l) {
+        auto W = graph->param("W" + std::to_string(l), {512, 512}, inits::glorotUniform());
+        auto b = graph->param("b" + std::to_string(l), {1, 512}, inits::zeros());
+        h = h + tanh(affine(h, W, b));
+        if(l % 2 == 1)
+          checkpoint(h);
+      }
+      sum(sum(h * h, -1), 0);
+      graph->forward();
+      graph->backward();
+    }
+    graph->params()->grads()->get(values);
+    return values;
+  };
+
+  auto expected = gradients(false, 0);
+  CHECK(gradients(true, 0) == expected);
+  CHECK(gradients(true, 1) == expected);   // keeps two of the 512 KB outputs
+  CHECK(gradients(true, 100) == expected); // keeps all of them
+}
+
+TEST_CASE("Element-wise fusion and memory planning do not change results (cpu)", "[graph]") {
+  // chains of element-wise nodes around matrix products, some results with several readers
+  auto outputs = [](bool fuse, bool planMemory, int dimRows, int dimCols) {
+    auto graph = New<ExpressionGraph>(/*inference=*/true);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(16);
+    graph->setElementwiseFusion(fuse);
+    graph->setMemoryPlanning(planMemory);
+
+    std::vector<float> values, result;
+    for(int step = 0; step < 2; ++step) { // the second pass reuses the plan
+      graph->clear();
+      std::vector<float> x(dimRows * dimCols);
+      for(size_t i = 0; i < x.size(); ++i)
+        x[i] = (float)((i * 7919 + step) % 101) / 101.f - 0.5f;
+      auto h = graph->constant({dimRows, dimCols}, inits::fromVector(x));
+      auto W = graph->param("W", {dimCols, dimCols}, inits::glorotUniform());
+      auto b = graph->param("b", {1, dimCols}, inits::zeros());
+      auto a = dot(h, W) + b;
+      auto g = sigmoid(a * 2.f - 1.f);           // a is read twice, g only once
+      auto y = tanh(a) * g + relu(h - a) / (abs(h) + 1.f);
+      y = exp(-abs(y)) + log(maximum(y, 0.5f) + 0.5f);
+      y = minimum(y, 2.f) * y;
+      auto out = dot(y, W) + y;
+      graph->forward();
+      out->val()->get(values);
+      result.insert(result.end(), values.begin(), values.end());
+    }
+    return result;
+  };
+
+  for(auto dims : std::vector<std::pair<int, int>>({{16, 64}, {3, 7}})) { // vectorized and scalar
+    auto expected = outputs(false, false, dims.first, dims.second);
+    CHECK(outputs(true, false, dims.first, dims.second) == expected);
+    CHECK(outputs(false, true, dims.first, dims.second) == expected);
+    CHECK(outputs(true, true, dims.first, dims.second) == expected);
+  }
+}
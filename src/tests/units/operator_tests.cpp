@@ -5,11 +5,13 @@
 #include "catch.hpp"
 #include "graph/expression_graph.h"
 #include "graph/expression_operators.h"
+#include "tensors/cpu/softmax.h"
 
 #ifdef CUDA_FOUND
 #include "tensors/gpu/backend.h"
 #endif
 
+#include <algorithm>
 #include <cmath>
 
 using namespace marian;
@@ -297,6 +299,212 @@ void tests(DeviceType device, Type floatType = Type::float32) {
 
   }
 
+  SECTION("residual layer normalization vs add and layer normalization") {
+    graph->clear();
+    values.clear();
+    values2.clear();
+
+    std::vector<T> vX({1, 6, 3, 8,
+                       5, 2, 7, 4});
+    std::vector<T> vR({0.5, -1, 2, 0,
+                       -3, 1, 0.25, 2});
+    std::vector<T> vM({2, 0, 2, 2,
+                       0, 2, 2, 0});
+    std::vector<T> vW({1, -2, 3, 0.5,
+                       -1, 0.5, 2, -3});
+    std::vector<T> vGamma({1, 2, 0.5, -1});
+    std::vector<T> vBeta({0, 0.5, -1, 1});
+
+    auto mask = graph->constant({2, 4}, inits::fromVector(vM));
+    auto w    = graph->constant({2, 4}, inits::fromVector(vW));
+
+    auto x      = graph->param("x",      {2, 4}, inits::fromVector(vX));
+    auto r      = graph->param("r",      {2, 4}, inits::fromVector(vR));
+    auto gamma  = graph->param("gamma",  {1, 4}, inits::fromVector(vGamma));
+    auto beta   = graph->param("beta",   {1, 4}, inits::fromVector(vBeta));
+    auto fused  = residualLayerNorm(x, mask, r, gamma, beta);
+
+    auto x2     = graph->param("x2",     {2, 4}, inits::fromVector(vX));
+    auto r2     = graph->param("r2",     {2, 4}, inits::fromVector(vR));
+    auto gamma2 = graph->param("gamma2", {1, 4}, inits::fromVector(vGamma));
+    auto beta2  = graph->param("beta2",  {1, 4}, inits::fromVector(vBeta));
+    auto ln     = layerNorm(x2 * mask + r2, gamma2, beta2);
+
+    auto top = sum(sum(fused * w, -1), -2) + sum(sum(ln * w, -1), -2);
+
+    graph->forward();
+    graph->backward();
+
+    CHECK(fused->shape() == ln->shape());
+
+    fused->val()->get(values);
+    ln->val()->get(values2);
+    CHECK( std::equal(values.begin(), values.end(),
+                      values2.begin(), floatApprox) );
+
+    for(auto p : std::vector<std::pair<Expr, Expr>>({{x, x2}, {r, r2}, {gamma, gamma2}, {beta, beta2}})) {
+      p.first->grad()->get(values);
+      p.second->grad()->get(values2);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+    }
+  }
+
+  SECTION("dropout with the same mask in the forward and backward step") {
+    graph->clear();
+    values.clear();
+    values2.clear();
+
+    std::vector<T> vX(4 * 256);
+    for(size_t i = 0; i < vX.size(); ++i)
+      vX[i] = (T)(1.f + i % 7);
+
+    auto x  = graph->param("x",  {4, 256}, inits::fromVector(vX));
+    auto x2 = graph->param("x2", {4, 256}, inits::fromVector(vX));
+    auto y  = dropout(x, 0.25f);
+    auto y2 = dropout(x2, 0.25f, {4, 1}); // drops whole rows
+    auto y3 = dropout(x2, 0.25f);         // another mask of the same input
+
+    auto top = sum(sum(y, -1), -2) + sum(sum(y2, -1), -2) + 0.f * sum(sum(y3, -1), -2);
+
+    graph->forward();
+    graph->backward();
+
+    // the gradient is the mask, which the forward step applied
+    y->val()->get(values);
+    x->grad()->get(values2);
+    size_t dropped = 0;
+    for(size_t i = 0; i < vX.size(); ++i) {
+      CHECK((values2[i] == 0.f || floatApprox(values2[i], 1.f / 0.75f)));
+      CHECK(floatApprox(values[i], vX[i] * values2[i]));
+      dropped += values2[i] == 0.f;
+    }
+    CHECK(dropped > vX.size() / 8);
+    CHECK(dropped < vX.size() * 3 / 8);
+
+    y2->val()->get(values);
+    x2->grad()->get(values2);
+    for(size_t i = 0; i < vX.size(); ++i) {
+      CHECK(values2[i] == values2[i / 256 * 256]);
+      CHECK(floatApprox(values[i], vX[i] * values2[i]));
+    }
+
+    std::vector<T> values3;
+    y->val()->get(values);
+    y3->val()->get(values3);
+    CHECK(values != values3);
+  }
+
+  SECTION("ssru cell vs highway and mask") {
+    graph->clear();
+    values.clear();
+    values2.clear();
+
+    std::vector<T> vC({1, -6, 3, 0.5,
+                       5, 2, -7, 4});
+    std::vector<T> vX({0.5, -1, 2, 0,
+                       -3, 1, 0.25, 2});
+    std::vector<T> vF({2, 0, -2, 1,
+                       0.5, -1, 3, 0});
+    std::vector<T> vW({1, -2, 3, 0.5,
+                       -1, 0.5, 2, -3});
+
+    auto mask = graph->constant({2, 1}, inits::fromVector(std::vector<T>({1, 0})));
+    auto w    = graph->constant({2, 4}, inits::fromVector(vW));
+
+    auto c        = graph->param("c",  {2, 4}, inits::fromVector(vC));
+    auto x        = graph->param("x",  {2, 4}, inits::fromVector(vX));
+    auto f        = graph->param("f",  {2, 4}, inits::fromVector(vF));
+    auto fused    = ssruCell(c, x, f, mask);
+    auto unmasked = ssruCell(c, x, f);
+
+    auto c2       = graph->param("c2", {2, 4}, inits::fromVector(vC));
+    auto x2       = graph->param("x2", {2, 4}, inits::fromVector(vX));
+    auto f2       = graph->param("f2", {2, 4}, inits::fromVector(vF));
+    auto gated    = highway(c2, x2, f2);
+    auto masked   = mask * gated;
+
+    auto top = sum(sum((fused + 2 * unmasked) * w, -1), -2) + sum(sum((masked + 2 * gated) * w, -1), -2);
+
+    graph->forward();
+    graph->backward();
+
+    CHECK(fused->shape() == masked->shape());
+
+    for(auto p : std::vector<std::pair<Expr, Expr>>({{fused, masked}, {unmasked, gated}})) {
+      p.first->val()->get(values);
+      p.second->val()->get(values2);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+    }
+
+    for(auto p : std::vector<std::pair<Expr, Expr>>({{c, c2}, {x, x2}, {f, f2}})) {
+      p.first->grad()->get(values);
+      p.second->grad()->get(values2);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+    }
+  }
+
+  SECTION("ssru scan vs ssru cell steps") {
+    for(bool reverse : {false, true}) {
+      graph->clear();
+      values.clear();
+      values2.clear();
+
+      std::vector<T> vX(24), vF(24), vW(24);
+      for(int i = 0; i < 24; ++i) {
+        vX[i] = (T)(0.25f * (i % 7) - 0.5f);
+        vF[i] = (T)(0.5f * (i % 5) - 1.f);
+        vW[i] = (T)(1.f - 0.125f * (i % 9));
+      }
+      std::vector<T> vC0({1, -2, 0.5, 0,
+                          -1, 3, 2, -0.5});
+      std::vector<T> vM({1, 1,
+                         1, 0,
+                         1, 0});
+
+      auto mask = graph->constant({3, 2, 1}, inits::fromVector(vM));
+      auto w    = graph->constant({3, 2, 4}, inits::fromVector(vW));
+
+      auto c0   = graph->param("c0", {1, 2, 4}, inits::fromVector(vC0));
+      auto x    = graph->param("x",  {3, 2, 4}, inits::fromVector(vX));
+      auto f    = graph->param("f",  {3, 2, 4}, inits::fromVector(vF));
+      auto scan = ssruScan(c0, x, f, mask, reverse);
+
+      auto c02  = graph->param("c02", {1, 2, 4}, inits::fromVector(vC0));
+      auto x2   = graph->param("x2",  {3, 2, 4}, inits::fromVector(vX));
+      auto f2   = graph->param("f2",  {3, 2, 4}, inits::fromVector(vF));
+      std::vector<Expr> steps(3);
+      auto cell = c02;
+      for(int i = 0; i < 3; ++i) {
+        int t = reverse ? 2 - i : i;
+        cell = ssruCell(cell, slice(x2, -3, t), slice(f2, -3, t), slice(mask, -3, t));
+        steps[t] = cell;
+      }
+      auto stepped = concatenate(steps, -3);
+
+      auto top = sum(sum(sum(scan * w, -1), -2), -3) + sum(sum(sum(stepped * w, -1), -2), -3);
+
+      graph->forward();
+      graph->backward();
+
+      CHECK(scan->shape() == stepped->shape());
+
+      scan->val()->get(values);
+      stepped->val()->get(values2);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+
+      for(auto p : std::vector<std::pair<Expr, Expr>>({{c0, c02}, {x, x2}, {f, f2}})) {
+        p.first->grad()->get(values);
+        p.second->grad()->get(values2);
+        CHECK( std::equal(values.begin(), values.end(),
+                          values2.begin(), floatApprox) );
+      }
+    }
+  }
+
   SECTION("reductions") {
     graph->clear();
     values.clear();
@@ -369,6 +577,119 @@ void tests(DeviceType device, Type floatType = Type::float32) {
     wa->val()->get(values); CHECK(std::equal(values.begin(), values.end(), vW.begin(), floatApprox));
   }
 
+  SECTION("cumulative sums") {
+    graph->clear();
+    values.clear();
+
+    std::vector<T> vA({1, 6, 3, 8,
+                       5, 2, 7, 4});
+    // np.cumsum(a, axis=0), np.cumsum(a, axis=1)
+    std::vector<T> vC0({1, 6, 3, 8,
+                        6, 8, 10, 12});
+    std::vector<T> vC1({1, 7, 10, 18,
+                        5, 7, 14, 18});
+    // gradient of sum(cumsum(a, axis=1) * w) + sum(cumsum(a, axis=0)) with w = [1, 2, 3, 4] in each row
+    std::vector<T> vG({12, 11, 9, 6,
+                       11, 10, 8, 5});
+
+    auto a = graph->param("a", {2, 4}, inits::fromVector(vA));
+    auto w = graph->constant({1, 4}, inits::fromVector(std::vector<T>({1, 2, 3, 4})));
+
+    auto c0 = cumsum(a, /*axis=*/ 0);
+    auto c1 = cumsum(a, /*axis=*/ -1);
+    auto top = sum(sum(c1 * w, -1), -2) + sum(sum(c0, -1), -2);
+
+    graph->forward();
+    graph->backward();
+
+    CHECK(c0->shape() == a->shape());
+    CHECK(c1->shape() == a->shape());
+
+    c0->val()->get(values); CHECK(values == vC0);
+    c1->val()->get(values); CHECK(values == vC1);
+    a->grad()->get(values); CHECK(values == vG);
+  }
+
+  // The backward step of fused attention is only implemented for float32
+  if(floatType == Type::float32) {
+    SECTION("fused attention vs softmax of batched products") {
+      graph->clear();
+      values.clear();
+      values2.clear();
+
+      // 2 sentences with 2 heads, 3 queries and 70 keys, i.e. more than one block of keys
+      int dimBatch = 2, dimHeads = 2, dimQ = 3, dimK = 70, dimHead = 8, dimValue = 6;
+      auto init = [](int size, float shift) {
+        std::vector<T> v(size);
+        for(int i = 0; i < size; ++i)
+          v[i] = (T)std::sin(0.37f * i + shift);
+        return v;
+      };
+      auto vQ = init(dimBatch * dimHeads * dimQ * dimHead, 0.f);
+      auto vK = init(dimBatch * dimHeads * dimK * dimHead, 1.f);
+      auto vV = init(dimBatch * dimHeads * dimK * dimValue, 2.f);
+      auto vW = init(dimBatch * dimHeads * dimQ * dimValue, 3.f);
+      // the second sentence is 50 words long
+      std::vector<T> vM(dimBatch * dimK, (T)0.f);
+      for(int j = 50; j < dimK; ++j)
+        vM[dimK + j] = (T)-99999.f;
+      float scale = 1.f / std::sqrt((float)dimHead);
+
+      auto mask = graph->constant({dimBatch, 1, 1, dimK}, inits::fromVector(vM));
+      auto w    = graph->constant({dimBatch, dimHeads, dimQ, dimValue}, inits::fromVector(vW));
+
+      auto q  = graph->param("q",  {dimBatch, dimHeads, dimQ, dimHead}, inits::fromVector(vQ));
+      auto k  = graph->param("k",  {dimBatch, dimHeads, dimK, dimHead}, inits::fromVector(vK));
+      auto v  = graph->param("v",  {dimBatch, dimHeads, dimK, dimValue}, inits::fromVector(vV));
+      auto fused = fusedAttention(q, k, v, mask, scale);
+
+      auto q2 = graph->param("q2", {dimBatch, dimHeads, dimQ, dimHead}, inits::fromVector(vQ));
+      auto k2 = graph->param("k2", {dimBatch, dimHeads, dimK, dimHead}, inits::fromVector(vK));
+      auto v2 = graph->param("v2", {dimBatch, dimHeads, dimK, dimValue}, inits::fromVector(vV));
+      auto unfused = bdot(softmax(bdot(q2, k2, false, true, scale) + mask), v2);
+
+      auto top = sum(sum(sum(sum(fused * w, -1), -2), -3), -4) + sum(sum(sum(sum(unfused * w, -1), -2), -3), -4);
+
+      graph->forward();
+      graph->backward();
+
+      CHECK(fused->shape() == unfused->shape());
+
+      fused->val()->get(values);
+      unfused->val()->get(values2);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+
+      for(auto p : std::vector<std::pair<Expr, Expr>>({{q, q2}, {k, k2}, {v, v2}})) {
+        p.first->grad()->get(values);
+        p.second->grad()->get(values2);
+        CHECK( std::equal(values.begin(), values.end(),
+                          values2.begin(), floatApprox) );
+      }
+
+      // 2 beams of the same sentences, keys and values are broadcast over the beams
+      graph->clear();
+
+      std::vector<T> vMBeam(vM);
+      vMBeam.insert(vMBeam.end(), vM.begin(), vM.end());
+      auto beamMask = graph->constant({2 * dimBatch, 1, 1, dimK}, inits::fromVector(vMBeam));
+      auto qBeam = graph->constant({2 * dimBatch, dimHeads, dimQ, dimHead}, inits::fromVector(init(2 * dimBatch * dimHeads * dimQ * dimHead, 4.f)));
+      auto kBeam = graph->constant({dimBatch, dimHeads, dimK, dimHead}, inits::fromVector(vK));
+      auto vBeam = graph->constant({dimBatch, dimHeads, dimK, dimValue}, inits::fromVector(vV));
+      auto fusedBeam = fusedAttention(qBeam, kBeam, vBeam, beamMask, scale);
+      auto unfusedBeam = bdot(softmax(bdot(qBeam, kBeam, false, true, scale) + beamMask), vBeam);
+
+      graph->forward();
+
+      CHECK(fusedBeam->shape() == unfusedBeam->shape());
+
+      fusedBeam->val()->get(values);
+      unfusedBeam->val()->get(values2);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+    }
+  }
+
   SECTION("concatenation") {
     graph->clear();
     values.clear();
@@ -451,8 +772,8 @@ void tests(DeviceType device, Type floatType = Type::float32) {
     CHECK(values == vC);
   }
 
-  // Currently no support for fp16 or CPU - TODO use MKL for CPU, convert to float32 on the fly for fp16 via cast(x, Type::float16) or internally
-  if(device == DeviceType::gpu && floatType == Type::float32) {
+  // Currently no support for fp16 - TODO convert to float32 on the fly for fp16 via cast(x, Type::float16) or internally
+  if(floatType == Type::float32) {
     SECTION("csr-dot product") {
       graph->clear();
       values.clear();
@@ -524,6 +845,40 @@ void tests(DeviceType device, Type floatType = Type::float32) {
       DTxSTd  ->val()->get(values2); DTxSTs  ->val()->get(values); CHECK(values == values2);
       DTxSTxSd->val()->get(values2); DTxSTxSs->val()->get(values); CHECK(values == values2);
     }
+
+    SECTION("csr-dot product gradient") {
+      graph->clear();
+      values.clear();
+      // the gradient of the dense matrix is a product with the transposed sparse matrix
+      std::vector<float> vS({1, 0, 0, 1,
+                             0, 0, 1, 1.5});
+      std::vector<float> vD({1, 2, 3, 1.2, 5.6,
+                             4, 5, 6, 2.3, 6.7,
+                             7, 8, 9, 3.4, 7.8,
+                             1, 1, 2, 4.5, 8.9});
+      std::vector<float> SV({1, 1, 1, 1.5}); // CSR version of S
+      std::vector<IndexType> SI({0, 3, 2, 3}), SO({0, 2, 4});
+
+      auto D2 = graph->param("D2", { 4, 5 }, inits::fromVector(vD));
+      auto D3 = graph->param("D3", { 4, 5 }, inits::fromVector(vD));
+      auto W  = graph->constant({ 2, 5 }, inits::fromVector(std::vector<float>({1, -2, 3, -4, 5, 0.5, 1, -1.5, 2, -2.5})));
+      auto sparse = csr_dot(
+            Shape({ 2, 4 }),
+            graph->constant({(int)SV.size()}, inits::fromVector(SV), floatType),
+            graph->constant({(int)SI.size()}, inits::fromVector(SI), Type::uint32),
+            graph->constant({(int)SO.size()}, inits::fromVector(SO), Type::uint32),
+            D2);
+      auto dense = dot(graph->constant({ 2, 4 }, inits::fromVector(vS)), D3);
+      auto top = sum(sum(sparse * W, -1), -2) + sum(sum(dense * W, -1), -2);
+
+      graph->forward();
+      graph->backward();
+
+      D2->grad()->get(values);
+      D3->grad()->get(values2);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+    }
   }
 
   SECTION("affine transformation") {
@@ -974,6 +1329,66 @@ void tests(DeviceType device, Type floatType = Type::float32) {
     CHECK( std::equal(values.begin(), values.end(),
                       values2.begin(), floatApprox) );
   }
+
+  SECTION("cross entropy of affine in chunks vs affine and cross entropy") {
+    graph->clear();
+    values.clear();
+    values2.clear();
+
+    std::vector<T> vX({1, -2, 0.5,
+                       0, 1.5, -1,
+                       2, 0.25, 1,
+                       -1, -0.5, 3,
+                       0.5, 1, -2});
+    std::vector<T> vW({0.5, -1, 0.25,
+                       1, 0, -0.5,
+                       -2, 1, 1,
+                       0.75, 0.5, -0.25}); // [4 x 3], used transposed
+    std::vector<T> vB({0.1, -0.2, 0.3, 0});
+    std::vector<T> vAdj({1, 2, 0.5, -1, 3});
+    std::vector<IndexType> yhatVec = { 0, 3, 1, 2, 3 };
+
+    auto adj  = graph->constant({5, 1}, inits::fromVector(vAdj));
+    auto yhat = graph->indices(yhatVec);
+
+    auto x  = graph->param("x",  {5, 3}, inits::fromVector(vX));
+    auto W  = graph->param("W",  {4, 3}, inits::fromVector(vW));
+    auto b  = graph->param("b",  {1, 4}, inits::fromVector(vB));
+    auto ceChunks = affine_cross_entropy(x, W, b, yhat, /*transB=*/true, /*labelSmoothing=*/0.1f, /*chunkRows=*/2);
+
+    auto x2 = graph->param("x2", {5, 3}, inits::fromVector(vX));
+    auto W2 = graph->param("W2", {4, 3}, inits::fromVector(vW));
+    auto b2 = graph->param("b2", {1, 4}, inits::fromVector(vB));
+    auto ce = cross_entropy(affine(x2, W2, b2, false, true), yhat, /*labelSmoothing=*/0.1f);
+
+    // the vocabulary in tiles of 3 and 1 words
+    auto x3 = graph->param("x3", {5, 3}, inits::fromVector(vX));
+    auto W3 = graph->param("W3", {4, 3}, inits::fromVector(vW));
+    auto b3 = graph->param("b3", {1, 4}, inits::fromVector(vB));
+    auto ceTiles = affine_cross_entropy(x3, W3, b3, yhat, /*transB=*/true, /*labelSmoothing=*/0.1f, /*chunkRows=*/2, /*chunkVocab=*/3);
+
+    auto top = sum(ceChunks * adj, -2) + sum(ce * adj, -2) + sum(ceTiles * adj, -2);
+
+    graph->forward();
+    graph->backward();
+
+    CHECK(ceChunks->shape() == ce->shape());
+    CHECK(ceTiles->shape() == ce->shape());
+
+    ce->val()->get(values2);
+    for(auto chunked : {ceChunks, ceTiles}) {
+      chunked->val()->get(values);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+    }
+
+    for(auto p : std::vector<std::pair<Expr, Expr>>({{x, x2}, {W, W2}, {b, b2}, {x3, x2}, {W3, W2}, {b3, b2}})) {
+      p.first->grad()->get(values);
+      p.second->grad()->get(values2);
+      CHECK( std::equal(values.begin(), values.end(),
+                        values2.begin(), floatApprox) );
+    }
+  }
 }
 
 #ifdef CUDA_FOUND
@@ -1049,3 +1464,55 @@ TEST_CASE("Compare aggregate operator", "[graph]") {
 
   #endif
   #endif
+
+TEST_CASE("Softmax kernels of the CPU vs double precision", "[operator]") {
+  // relative to the value, or absolute for values below 1 such as probabilities
+  auto close = [](float x, double y) -> bool { return std::abs(x - y) <= 2e-6 * std::max(std::abs(y), 1.0); };
+
+  for(auto kernels : cpu::supportedSoftmaxKernels()) {
+    INFO(kernels->name);
+    for(int cols = 1; cols <= 300; ++cols) { // full vectors and all tails
+      INFO("row length " << cols);
+      std::vector<float> x(cols), adj(cols);
+      for(int i = 0; i < cols; ++i) {
+        x[i]   = (float)((i * 7919 + cols) % 101) / 10.1f - 5.f;
+        adj[i] = (float)((i * 104729 + 3 * cols) % 97) / 97.f - 0.5f;
+      }
+      double max = *std::max_element(x.begin(), x.end());
+      double sumExp = 0, sumAdj = 0;
+      for(int i = 0; i < cols; ++i) {
+        sumExp += std::exp(x[i] - max);
+        sumAdj += adj[i];
+      }
+
+      std::vector<double> probs(cols), logProbs(cols), softmaxGrad(cols), logSoftmaxGrad(cols);
+      std::vector<float> probs32(cols), logProbs32(cols); // inputs of the gradients
+      for(int i = 0; i < cols; ++i) {
+        probs[i]    = std::exp(x[i] - max) / sumExp;
+        logProbs[i] = x[i] - max - std::log(sumExp);
+        probs32[i]    = (float)probs[i];
+        logProbs32[i] = (float)logProbs[i];
+      }
+      double sumProbsAdj = 0;
+      for(int i = 0; i < cols; ++i)
+        sumProbsAdj += (double)probs32[i] * adj[i];
+      for(int i = 0; i < cols; ++i) { // the gradients are accumulated into 1
+        softmaxGrad[i]    = 1.0 + probs32[i] * (adj[i] - sumProbsAdj);
+        logSoftmaxGrad[i] = 1.0 + adj[i] - sumAdj * std::exp((double)logProbs32[i]);
+      }
+
+      std::vector<float> out(cols);
+      kernels->softmax(out.data(), x.data(), cols);
+      CHECK(std::equal(out.begin(), out.end(), probs.begin(), close));
+      kernels->logSoftmax(out.data(), x.data(), cols);
+      CHECK(std::equal(out.begin(), out.end(), logProbs.begin(), close));
+
+      std::fill(out.begin(), out.end(), 1.f);
+      kernels->softmaxGrad(out.data(), adj.data(), probs32.data(), cols);
+      CHECK(std::equal(out.begin(), out.end(), softmaxGrad.begin(), close));
+      std::fill(out.begin(), out.end(), 1.f);
+      kernels->logSoftmaxGrad(out.data(), adj.data(), logProbs32.data(), cols);
+      CHECK(std::equal(out.begin(), out.end(), logSoftmaxGrad.begin(), close));
+    }
+  }
+}
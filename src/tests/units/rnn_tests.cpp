@@ -94,6 +94,42 @@ void tests(DeviceType type, Type floatType = Type::float32) {
                       vOutput.begin(), floatApprox) );
   }
 
+  SECTION("State selection") {
+    auto graph = New<ExpressionGraph>();
+    graph->setDefaultElementType(floatType);
+    graph->setDevice({0, type});
+    graph->reserveWorkspaceMB(16);
+
+    // [beam depth 2, batch size 2, time 2, depth 2], batch-major as in the transformer
+    std::vector<T> vState({
+      0, 1,  2,  3,     4,  5,  6,  7,
+      8, 9, 10, 11,    12, 13, 14, 15
+    });
+    auto state = graph->constant({2, 2, 2, 2}, inits::fromVector(vState));
+
+    auto same      = rnn::State::select(state, {0, 1, 2, 3}, /*beamSize=*/2, /*isBatchMajor=*/true);
+    auto reordered = rnn::State::select(state, {2, 1, 0, 0}, /*beamSize=*/2, /*isBatchMajor=*/true);
+    auto shrunk    = rnn::State::select(state, {3, 2},       /*beamSize=*/1, /*isBatchMajor=*/true);
+
+    graph->forward();
+
+    std::vector<T> values;
+
+    CHECK(same->shape() == Shape({2, 2, 2, 2}));
+    same->val()->get(values);
+    CHECK( std::equal(values.begin(), values.end(), vState.begin(), floatApprox) );
+
+    CHECK(reordered->shape() == Shape({2, 2, 2, 2}));
+    reordered->val()->get(values);
+    std::vector<T> vReordered({8, 9, 10, 11,  4, 5, 6, 7,  0, 1, 2, 3,  0, 1, 2, 3});
+    CHECK( std::equal(values.begin(), values.end(), vReordered.begin(), floatApprox) );
+
+    CHECK(shrunk->shape() == Shape({1, 2, 2, 2}));
+    shrunk->val()->get(values);
+    std::vector<T> vShrunk({12, 13, 14, 15,  8, 9, 10, 11});
+    CHECK( std::equal(values.begin(), values.end(), vShrunk.begin(), floatApprox) );
+  }
+
   SECTION("S2S-style encoder") {
     Config::seed = 1234;
 
@@ -0,0 +1,87 @@
+#include "catch.hpp"
+#include "marian.h"
+
+#include "common/config.h"
+#include "models/model_factory.h"
+#include "translator/beam_search.h"
+
+using namespace marian;
+
+TEST_CASE("Speculative search", "[search]") {
+  Config::seed = 1234;
+
+  // a small random transformer, the model file does not exist and is not loaded
+  std::vector<std::string> args = {"marian",
+                                   "--type", "transformer",
+                                   "--dim-emb", "16",
+                                   "--transformer-heads", "2",
+                                   "--transformer-dim-ffn", "32",
+                                   "--enc-depth", "1",
+                                   "--dec-depth", "1",
+                                   "--dim-vocabs", "20", "20",
+                                   "--model", "search_tests.does_not_exist.npz"};
+  std::vector<char*> argv;
+  for(auto& arg : args)
+    argv.push_back(&arg[0]);
+  auto options = parseOptions((int)argv.size(), argv.data(), cli::mode::training, /*validate=*/false);
+  options->set("inference", true,
+               "beam-size", 1,
+               "n-best", false,
+               "allow-unk", false,
+               "normalize", 0.f,
+               "word-penalty", 0.f,
+               "max-length-factor", 3.f,
+               "speculative-tokens", 3);
+
+  auto vocab = New<Vocab>(options, 0);
+  vocab->createFake(); // </s> and <unk>, the other ids have no strings
+
+  // two sentences of 4 words and </s>
+  const size_t dimBatch = 2, dimTime = 5;
+  auto subBatch = New<data::SubBatch>(dimBatch, dimTime, vocab);
+  for(size_t s = 0; s < dimTime; ++s) {
+    for(size_t b = 0; b < dimBatch; ++b) {
+      auto i = data::SubBatch::locate(b, s, dimBatch);
+      subBatch->data()[i] = s + 1 < dimTime ? Word::fromWordIndex(2 + 5 * b + 3 * s) : vocab->getEosId();
+      subBatch->mask()[i] = 1.f;
+    }
+  }
+  subBatch->setWords(dimBatch * dimTime);
+  auto batch = New<data::CorpusBatch>(std::vector<Ptr<data::SubBatch>>({subBatch}));
+  batch->setSentenceIds({0, 1});
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(64);
+
+  // the same name makes the draft share the parameters of the main model
+  auto createScorer = [&]() -> Ptr<Scorer> {
+    auto model = models::createModelFromOptions(options, models::usage::translation);
+    return New<ScorerWrapper>(model, "F0", 1.f, "");
+  };
+  auto mainScorer = createScorer();
+  auto draftScorer = createScorer();
+
+  SECTION("A draft equal to the main model has all proposals accepted") {
+    BeamSearch speculative(options, {mainScorer, draftScorer}, vocab);
+    REQUIRE(speculative.canSearchSpeculative(/*numGraphs=*/1));
+    auto speculativeHistories = speculative.searchSpeculative(graph, batch);
+
+    BeamSearch greedy(options, {mainScorer}, vocab);
+    auto greedyHistories = greedy.searchGreedy(graph, batch);
+
+    REQUIRE(speculativeHistories.size() == dimBatch);
+    size_t numWords = 0;
+    for(size_t b = 0; b < dimBatch; ++b) {
+      auto speculativeWords = std::get<0>(speculativeHistories[b]->top());
+      auto greedyWords = std::get<0>(greedyHistories[b]->top());
+      CHECK(speculativeWords == greedyWords);
+      numWords += speculativeWords.size();
+    }
+
+    // the first token and the choice after each step come from the main model
+    if(numWords > dimBatch)
+      CHECK(speculative.getProposedTokens() > 0);
+    CHECK(speculative.getAcceptedTokens() == speculative.getProposedTokens());
+  }
+}
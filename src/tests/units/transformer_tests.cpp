@@ -0,0 +1,86 @@
+#include "catch.hpp"
+#include "marian.h"
+
+#include "common/config.h"
+#include "models/model_factory.h"
+#include "models/encoder_decoder.h"
+
+using namespace marian;
+
+TEST_CASE("Packed transformer encoder vs padded", "[transformer]") {
+  auto floatApprox = [](float x, float y) -> bool { return x == Approx(y).margin(0.0001f); };
+
+  Config::seed = 1234;
+
+  // a small random transformer, the model file does not exist and is not loaded
+  std::vector<std::string> args = {"marian",
+                                   "--type", "transformer",
+                                   "--dim-emb", "16",
+                                   "--transformer-heads", "2",
+                                   "--transformer-dim-ffn", "32",
+                                   "--enc-depth", "2",
+                                   "--dec-depth", "1",
+                                   "--dim-vocabs", "20", "20",
+                                   "--model", "transformer_tests.does_not_exist.npz"};
+  std::vector<char*> argv;
+  for(auto& arg : args)
+    argv.push_back(&arg[0]);
+  auto options = parseOptions((int)argv.size(), argv.data(), cli::mode::training, /*validate=*/false);
+  options->set("inference", true);
+
+  auto vocab = New<Vocab>(options, 0);
+  vocab->createFake();
+
+  // sentences of 5, 2, 3 and 1 words including </s>, packed into 3 rows of 5 words
+  const std::vector<size_t> lengths = {5, 2, 3, 1};
+  const size_t dimBatch = lengths.size(), dimTime = 5;
+  auto subBatch = New<data::SubBatch>(dimBatch, dimTime, vocab);
+  size_t words = 0;
+  for(size_t s = 0; s < dimTime; ++s) {
+    for(size_t b = 0; b < dimBatch; ++b) {
+      auto i = data::SubBatch::locate(b, s, dimBatch);
+      bool isWord = s < lengths[b];
+      subBatch->data()[i] = !isWord ? Word::ZERO : s + 1 < lengths[b] ? Word::fromWordIndex(2 + 5 * b + 3 * s)
+                                                                      : vocab->getEosId();
+      subBatch->mask()[i] = isWord ? 1.f : 0.f;
+      words += isWord;
+    }
+  }
+  subBatch->setWords(words);
+  auto batch = New<data::CorpusBatch>(std::vector<Ptr<data::SubBatch>>({subBatch}));
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  // the encoder context as [words, batch, dim], both models share the parameters of the graph
+  auto encode = [&](bool packed) {
+    auto modelOptions = New<Options>(options->clone());
+    modelOptions->set("transformer-packed-inference", packed);
+    auto model = std::static_pointer_cast<IEncoderDecoder>(
+        models::createModelFromOptions(modelOptions, models::usage::translation));
+    model->clear(graph);
+    auto state = model->startState(graph, batch);
+    auto context = state->getEncoderStates()[0]->getContext();
+    graph->forward();
+    std::vector<float> values;
+    context->val()->get(values);
+    return values;
+  };
+
+  auto padded = encode(false);
+  auto packed = encode(true);
+  REQUIRE(packed.size() == padded.size());
+
+  // the outputs of the padding are arbitrary when packed
+  const size_t dimModel = padded.size() / (dimTime * dimBatch);
+  for(size_t s = 0; s < dimTime; ++s) {
+    for(size_t b = 0; b < dimBatch; ++b) {
+      if(s >= lengths[b])
+        continue;
+      INFO("word " << s << " of sentence " << b);
+      auto begin = (s * dimBatch + b) * dimModel;
+      CHECK(std::equal(packed.begin() + begin, packed.begin() + begin + dimModel, padded.begin() + begin, floatApprox));
+    }
+  }
+}
@@ -34,3 +34,29 @@ TEST_CASE("utils::splitTsv", "[utils]") {
 
   //SECTION("excessive tab-separated fields abort the execution") {}
 }
+
+TEST_CASE("utils::splitTsv into string ranges", "[utils]") {
+  std::string line1 = "foo bar";
+  std::string line3 = "foo bar\t\tfoo quux";
+
+  std::vector<utils::StringRange> fields;
+  auto strings = [&]() {
+    std::vector<std::string> out;
+    for(const auto& field : fields)
+      out.push_back(field.str());
+    return out;
+  };
+
+  SECTION("the fields refer to the line") {
+    utils::splitTsv(line3, fields, 3);
+    CHECK( strings() == std::vector<std::string>({"foo bar", "", "foo quux"}) );
+    CHECK( fields[0].data == line3.data() );
+    CHECK( fields[2].data == line3.data() + 9 );
+  }
+
+  SECTION("the output has at least as many elements as requested") {
+    utils::splitTsv(line1, fields, 3);
+    CHECK( fields.size() == 3 );
+    CHECK( strings() == std::vector<std::string>({"foo bar", "", ""}) );
+  }
+}
@@ -0,0 +1,73 @@
+#include "training/checkpoint_writer.h"
+#include "common/logging.h"
+#include "common/timer.h"
+
+#include <cstdio>
+#include <fstream>
+
+namespace marian {
+
+// model.npz -> model.tmp.npz, so that the file format is still recognized by its suffix
+std::string AsyncCheckpointWriter::temporaryName(const std::string& fileName) {
+  auto dot = fileName.rfind('.');
+  auto slash = fileName.find_last_of("/\\");
+  if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return fileName + ".tmp";
+  return fileName.substr(0, dot) + ".tmp" + fileName.substr(dot);
+}
+
+Ptr<io::DeferredSaveItems> AsyncCheckpointWriter::collect() {
+  return New<io::DeferredSaveItems>([this](const std::string& fileName, const std::vector<io::Item>& items) {
+    items_.emplace_back(fileName, items);
+    order_.push_back(fileName);
+  });
+}
+
+void AsyncCheckpointWriter::addText(const std::string& fileName, const std::string& content) {
+  texts_.emplace_back(fileName, content);
+  order_.push_back(fileName);
+}
+
+void AsyncCheckpointWriter::write() {
+  wait();
+
+  struct Checkpoint {
+    std::vector<std::pair<std::string, std::vector<io::Item>>> items;
+    std::vector<std::pair<std::string, std::string>> texts;
+    std::vector<std::string> order;
+  };
+  auto checkpoint = New<Checkpoint>();
+  std::swap(checkpoint->items, items_);
+  std::swap(checkpoint->texts, texts_);
+  std::swap(checkpoint->order, order_);
+  if(checkpoint->order.empty())
+    return;
+
+  pending_ = threadPool_.enqueue([checkpoint]() {
+    timer::Timer timer;
+    for(const auto& file : checkpoint->items)
+      io::saveItems(temporaryName(file.first), file.second);
+    for(const auto& file : checkpoint->texts) {
+      std::ofstream out(temporaryName(file.first));
+      out << file.second;
+      ABORT_IF(!out, "Could not write {}", temporaryName(file.first));
+    }
+
+    for(const auto& fileName : checkpoint->order) {
+#ifdef _WIN32 // rename() does not replace existing files on Windows
+      std::remove(fileName.c_str());
+#endif
+      ABORT_IF(std::rename(temporaryName(fileName).c_str(), fileName.c_str()) != 0,
+               "Could not rename {} to {}", temporaryName(fileName), fileName);
+    }
+    LOG(info, "[training] Checkpoint of {} files written in the background in {:.1f}s",
+        checkpoint->order.size(), timer.elapsed());
+  });
+}
+
+void AsyncCheckpointWriter::wait() {
+  if(pending_.valid())
+    pending_.get();
+}
+
+}  // namespace marian
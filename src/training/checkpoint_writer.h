@@ -0,0 +1,45 @@
+#pragma once
+
+#include "3rd_party/threadpool.h"
+#include "common/definitions.h"
+#include "common/io.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace marian {
+
+// Writes checkpoints on a background thread while training goes on, see --async-save. The files of a
+// checkpoint are collected in host memory first: the model and optimizer files through the
+// io::DeferredSaveItems of collect(), text files with addText(). write() then writes them all with
+// temporary names in the background and renames them in the order they were added once all of them are
+// complete, so that a crash leaves the files of the previous or of the new checkpoint, never half-written
+// ones. The training progress should be added last, as it tells which checkpoint a restart continues from.
+// Only one checkpoint is written at a time, write() waits for the previous one.
+class AsyncCheckpointWriter {
+private:
+  std::vector<std::pair<std::string, std::vector<io::Item>>> items_; // [file] the checkpoint being collected
+  std::vector<std::pair<std::string, std::string>> texts_;           // [file]
+  std::vector<std::string> order_;                                   // file names in the order they were added
+
+  ThreadPool threadPool_{1};
+  std::future<void> pending_; // the checkpoint being written
+
+  static std::string temporaryName(const std::string& fileName);
+
+public:
+  ~AsyncCheckpointWriter() { wait(); }
+
+  // While the returned object exists, io::saveItems() of this thread adds to the checkpoint instead of writing
+  Ptr<io::DeferredSaveItems> collect();
+  void addText(const std::string& fileName, const std::string& content);
+
+  // Starts writing the collected checkpoint
+  void write();
+
+  // Waits until the last checkpoint has been written
+  void wait();
+};
+
+}  // namespace marian
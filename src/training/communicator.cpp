@@ -9,22 +9,29 @@
 #include "mpi.h"
 #endif
 
+
 namespace marian {
 
 Ptr<ICommunicator> createCommunicator(
   const std::vector<Ptr<ExpressionGraph>>& graphs,
-  bool noNccl, Ptr<IMPIWrapper> mpi) {
-  mpi;
+  bool noNccl, Ptr<IMPIWrapper> mpi, bool hierarchical,
+  const std::string& compression, bool pinThreads, float dropRate) {
+  mpi; hierarchical; dropRate;
+  auto createDefaultCommunicator = [&]() {
+    if(compression != "none")
+      LOG(warn, "[comm] Gradients are only compressed with NCCL, --gradient-compression {} is ignored", compression);
+    return New<DefaultCommunicator>(graphs, mpi, pinThreads);
+  };
 #if defined(CUDA_FOUND) && defined(USE_NCCL)
   if(noNccl) {
     LOG(warn, "[comm] NCCL communicator overridden");
-    return New<DefaultCommunicator>(graphs, mpi);
+    return createDefaultCommunicator();
   }
 
   // if at least one of the devices is not a gpu, fall-back to default
   for(auto& graph : graphs) {
     if(graph->getBackend()->getDeviceId().type == DeviceType::cpu) {
-      return New<DefaultCommunicator>(graphs, mpi);
+      return createDefaultCommunicator();
     }
   }
 
@@ -38,10 +45,27 @@ Ptr<ICommunicator> createCommunicator(
   }
 
   // the actual implementation is inside communicator.cu
-  return New<NCCLCommunicator>(graphs, mpi);
+  return New<NCCLCommunicator>(graphs, mpi, hierarchical, compression, dropRate);
 #else // no CUDA or no NCCL
   noNccl; // (unused)
-  return New<DefaultCommunicator>(graphs, mpi);
+  return createDefaultCommunicator();
+#endif
+}
+
+void DefaultCommunicator::pinThreadToCore(size_t idx, size_t count) {
+#ifdef __linux__
+  auto nodes = utils::numaNodeCpus();
+  if(count > nodes.size() * nodes[0].size())
+    LOG_ONCE(warn, "[comm] More CPU graphs ({}) than cores, some of them share a core", count);
+  int node = -1;
+  int cpu = utils::pinThreadToCore(idx, &node);
+  if(cpu < 0)
+    LOG(warn, "[comm] Could not pin the thread of CPU graph {} to a core", idx);
+  else
+    LOG(info, "[comm] Pinned the thread of CPU graph {} to core {} of NUMA node {}", idx, cpu, node);
+#else
+  idx; count;
+  LOG_ONCE(warn, "[comm] Pinning threads to cores is only supported on Linux, ignoring --cpu-pin-threads");
 #endif
 }
 
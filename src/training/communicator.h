@@ -1,10 +1,12 @@
 #pragma once
 
 // clang-format off
+#include "common/tracer.h"
 #include "graph/expression_graph.h"
 #include "functional/functional.h"
 #include "tensors/tensor_operators.h"
 #include "optimizers/optimizers.h"
+#include "tensors/cpu/worker_pool.h"
 #if MPI_FOUND
 #ifdef __GNUC__
 #pragma GCC diagnostic push
@@ -40,12 +42,42 @@ public:
   // @TODO: We probably can still share foreach() between the two implementations. Just need to move some helper functions from the .cu file.
 
   virtual void scatterReduceAndResetGrads() const = 0; // reduce param gradients and scatter into gradient shards
+
+  // Gradient reduction that overlaps with the backward pass: scatterReduceRangeAsync() starts reducing
+  // the gradients [begin, end) of a local device into the shards that own them, as soon as the backward
+  // pass has completed them, and may be called from the thread of each device. All devices must start
+  // the same ranges in the same order, which must cover all gradients once.
+  // finishScatterReduceAndResetGrads() waits for all of them and resets the gradients outside of the
+  // shards, leaving the state of scatterReduceAndResetGrads().
+  virtual bool canOverlapScatterReduce() const { return false; }
+  virtual void scatterReduceRangeAsync(size_t /*localDeviceIndex*/, size_t /*begin*/, size_t /*end*/) const {
+    ABORT("This communicator cannot overlap the gradient reduction with the backward pass");
+  }
+  virtual void finishScatterReduceAndResetGrads() const {
+    ABORT("This communicator cannot overlap the gradient reduction with the backward pass");
+  }
   virtual void allGatherParams() const = 0;     // redistribute value shards into param values
 
   virtual void swapParams(const std::vector<Tensor>& paramShards) const = 0;
 
+  // Optimizer state is sharded like the gradients, over all devices of all MPI processes.
+  // scatterState() sets the shards of this process from the complete state, which all processes pass.
+  // gatherState() returns the complete state on the main MPI process, which is the one that saves it,
+  // and an empty vector on the others.
   virtual void scatterState(const std::vector<float>& data, const OptimizerBase::ScatterStateSetFunc& setFn) const = 0;
   virtual std::vector<float> gatherState(const OptimizerBase::GatherStateGetFunc& getFn) const = 0;
+
+  // The same for only the shards of this process, concatenated in the order of the local devices, so that
+  // every process saves and loads its own part of the state, see --sharded-optimizer-state
+  virtual void scatterLocalState(const std::vector<float>& data, const OptimizerBase::ScatterStateSetFunc& setFn) const = 0;
+  std::vector<float> gatherLocalState(const OptimizerBase::GatherStateGetFunc& getFn) const {
+    std::vector<float> data;
+    for(size_t localDeviceIndex = 0; localDeviceIndex < graphs_.size(); localDeviceIndex++) {
+      std::vector<float> tmp = getFn(localDeviceIndex);
+      data.insert(data.end(), tmp.begin(), tmp.end());
+    }
+    return data;
+  }
 };
 
 // Abstracts MPI operations, allowing alternative implementations (specifically fake (for debugging) and NCCL.
@@ -97,6 +129,12 @@ private:
   std::vector<Ptr<TensorAllocator>> paramsAllocs_;
   std::vector<Tensor> tmpTensors_;
 
+  // all graphs are on the CPU: gradients are summed directly from the memory of the other graphs
+  bool cpu_{false};
+  // one persistent thread per graph for foreach(), so that it may be pinned to a core; the calling
+  // thread only waits
+  std::unique_ptr<cpu::WorkerPool> workers_;
+
   void lazyInit() {
     if(tmpTensors_.size() == 0) {
       int totalSize = (int)graphs_[0]->params()->vals()->size();
@@ -124,57 +162,93 @@ private:
   }
 
 public:
-  DefaultCommunicator(const std::vector<Ptr<ExpressionGraph>>& graphs, Ptr<IMPIWrapper> mpi)
+  // pinThreads: pin the thread of each CPU graph to a core, spreading them over the NUMA nodes, see --cpu-pin-threads
+  DefaultCommunicator(const std::vector<Ptr<ExpressionGraph>>& graphs, Ptr<IMPIWrapper> mpi, bool pinThreads = false)
       : ICommunicator(graphs) {
     ABORT_IF(mpi && mpi->numMPIProcesses() != 1, "DefaultCommunicator does not support multi-process MPI");
+    cpu_ = true;
+    for(auto graph : graphs_)
+      cpu_ &= graph->getBackend()->getDeviceId().type == DeviceType::cpu;
+    if(graphs_.size() > 1)
+      workers_.reset(new cpu::WorkerPool(graphs_.size() + 1));
+    if(pinThreads && cpu_ && workers_)
+      foreach([this](size_t idx, size_t /*begin*/, size_t /*end*/) { pinThreadToCore(idx, graphs_.size()); });
+    else if(pinThreads)
+      LOG(warn, "[comm] Only the threads of several CPU graphs are pinned, ignoring --cpu-pin-threads");
   }
 
   ~DefaultCommunicator() override {}
 
+  // Pins the calling thread to a core for the graph with index idx out of count. The graphs are spread
+  // round-robin over the NUMA nodes and then over the cores of each node.
+  static void pinThreadToCore(size_t idx, size_t count);
+
   void foreach(const ForeachFunc& func, bool parallel = true) const override {
     parallel &= graphs_.size() > 1;
 
     size_t totalSize = graphs_[0]->params()->vals()->size();
     size_t shardSize = (size_t)ceil(totalSize / (float)graphs_.size());
 
-    size_t pos = 0;
-    std::vector<std::thread> group;
-    // iterate over all shards
-    for(size_t idx = 0; idx < graphs_.size(); ++idx) {
-      size_t size = std::min(shardSize, totalSize);
-
-      if (parallel)
-        group.emplace_back(func, idx, pos, pos+size);
-      else
-        func(idx, pos, pos+size);
+    // shard idx of all shards
+    auto shard = [&](size_t idx) {
+      size_t begin = std::min(idx * shardSize, totalSize);
+      size_t end = std::min(begin + shardSize, totalSize);
+      func(idx, begin, end);
+    };
 
-      pos += size;
-      totalSize -= size;
+    if(!parallel) {
+      for(size_t idx = 0; idx < graphs_.size(); ++idx)
+        shard(idx);
+      return;
     }
-    for(auto& t : group) // (note: group is empty is not parallel)
-      t.join();
+    // range i + 1 of the pool is always computed by its worker i, range 0 by the calling thread
+    workers_->parallelFor(graphs_.size() + 1, graphs_.size() + 1, [&](size_t begin, size_t end) {
+      for(size_t i = std::max(begin, (size_t)1); i < end; ++i)
+        shard(i - 1);
+    });
   }
 
   void scatterReduceAndResetGrads() const override {
-    const_cast<DefaultCommunicator*>(this)->lazyInit();
-
-    // Gather gradients from different devices into current gradient shards
-    auto scatter = [this](size_t idx, size_t begin, size_t end) {
-      auto curGrad = graphs_[idx]->params()->grads()->subtensor(begin, end-begin);
-
-      // collect and sum gradients
-      for(auto graph : graphs_) {
-        if(graph != graphs_[idx]) {
-          auto subGrad = graph->params()->grads()->subtensor(begin, end - begin);
-          tmpTensors_[idx]->copyFrom(subGrad);
-
-          using namespace functional;
-          Element(_1 = _1 + _2, curGrad, tmpTensors_[idx]);
+    tracing::Span span("communicator", "scatterReduceAndResetGrads");
+    if(cpu_) {
+      // Sum the gradients of all graphs into the shard in one pass over blocks that stay in the cache
+      auto reduce = [this](size_t idx, size_t begin, size_t end) {
+        const size_t blockSize = 4096;
+        float* curGrad = graphs_[idx]->params()->grads()->data<float>();
+        for(size_t block = begin; block < end; block += blockSize) {
+          size_t blockEnd = std::min(block + blockSize, end);
+          for(auto graph : graphs_) {
+            if(graph == graphs_[idx])
+              continue;
+            const float* subGrad = graph->params()->grads()->data<float>();
+            for(size_t i = block; i < blockEnd; ++i)
+              curGrad[i] += subGrad[i];
+          }
         }
-      }
-    };
+      };
+      foreach(reduce);
+    } else {
+      const_cast<DefaultCommunicator*>(this)->lazyInit();
+
+      // Gather gradients from different devices into current gradient shards
+      auto scatter = [this](size_t idx, size_t begin, size_t end) {
+        auto curGrad = graphs_[idx]->params()->grads()->subtensor(begin, end-begin);
+
+        // collect and sum gradients
+        for(auto graph : graphs_) {
+          if(graph != graphs_[idx]) {
+            auto subGrad = graph->params()->grads()->subtensor(begin, end - begin);
+            tmpTensors_[idx]->copyFrom(subGrad);
+
+            using namespace functional;
+            Element(_1 = _1 + _2, curGrad, tmpTensors_[idx]);
+          }
+        }
+      };
+      foreach(scatter);
+    }
 
-    // reset gradients outside current shard
+    // reset gradients outside current shard, once all graphs have read them
     auto reset = [this](size_t idx, size_t begin, size_t end) {
       auto grad = graphs_[idx]->params()->grads();
       if (begin > 0)
@@ -182,12 +256,11 @@ public:
       if (end < grad->size())
         grad->subtensor(end, grad->size()-end)->set(0);
     };
-
-    foreach(scatter);
     foreach(reset);
   }
 
   void allGatherParams() const override {
+    tracing::Span span("communicator", "allGatherParams");
 
     // Update all graphs with parameter shard
     auto gather = [this](size_t idx, size_t begin, size_t end) {
@@ -209,6 +282,7 @@ public:
   }
 
   void swapParams(const std::vector<Tensor>& paramShards) const override {
+    tracing::Span span("communicator", "swapParams");
     // Update all graphs with parameter shard
     auto gather = [this, paramShards](size_t idx, size_t begin, size_t end) {
       ABORT_IF(end - begin != paramShards[idx]->size(), "inconsistent shard size (swapParams, [{}], {} vs {})??", idx, end-begin, paramShards[idx]->size());
@@ -246,10 +320,22 @@ public:
     ABORT_IF(data.size() != graphs_[0]->params()->vals()->size(), "gathering wrong amount of data??");
     return data;
   }
+
+  void scatterLocalState(const std::vector<float>& data, const OptimizerBase::ScatterStateSetFunc& setFn) const override {
+    ABORT_IF(data.size() != graphs_[0]->params()->vals()->size(),
+             "The optimizer state was saved with other shards, resume with the same number of devices and MPI processes");
+    scatterState(data, setFn); // a single process holds all shards
+  }
 };
 
+// hierarchical: reduce within each process before across processes with NCCL, see --nccl-hierarchical
+// compression: none, fp16, 8bit or 4bit gradients, or topk gradient dropping for NCCL, see --gradient-compression
+// pinThreads: pin the thread of each CPU graph to a core, see --cpu-pin-threads
+// dropRate: the fraction of the gradients that topk does not send, see --gradient-dropping-rate
 Ptr<ICommunicator> createCommunicator(
     const std::vector<Ptr<ExpressionGraph>>& graphs,
-    bool noNccl, Ptr<IMPIWrapper> mpi);
+    bool noNccl, Ptr<IMPIWrapper> mpi, bool hierarchical = false,
+    const std::string& compression = "none", bool pinThreads = false,
+    float dropRate = 0.99f);
 
 }  // namespace marian
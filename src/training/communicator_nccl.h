@@ -3,6 +3,7 @@
 #include "training/communicator.h"
 #include "3rd_party/threadpool.h"
 #include "tensors/gpu/cuda_helpers.h"
+#include "tensors/gpu/gradient_compression.h"
 
 #include "common/timer.h"
 
@@ -11,10 +12,15 @@
 #include "nccl.h"
 #include <cuda_runtime.h>
 
+#include <cmath>
+#include <limits>
+
 #if (NCCL_MAJOR<3 || NCCL_MINOR<2)
 #define ncclGetVersion(pv) (*(pv) = (NCCL_MAJOR * 1000 + NCCL_MINOR * 100 + NCCL_PATCH))
 #endif
 
+#define NCCL_HAS_SEND_RECV (NCCL_MAJOR > 2 || (NCCL_MAJOR == 2 && NCCL_MINOR >= 7)) // ncclSend(), ncclRecv()
+
 #include <signal.h> // HACK
 #include <sys/types.h>
 #include <sys/syscall.h>
@@ -26,8 +32,38 @@ class NCCLCommunicator : public ICommunicator {
 private:
   std::vector<ncclComm_t> comms_;     // [device index]
   std::vector<cudaStream_t> streams_; // [device index]
+  std::vector<cudaEvent_t> gradsReady_; // [device index] marks completed gradients on the compute stream
   std::vector<int> devices_;          // [device index]
   Ptr<IMPIWrapper> mpi_; // (may be null)
+
+  // --nccl-hierarchical: gradients are first reduced among the devices of this process (e.g. over NVLink),
+  // then each device reduces its shards with the devices of the same index in the other processes; the
+  // all-gather of the parameters goes the opposite way. Phases are timed and logged every logFreq updates.
+  bool hierarchical_{false};
+  std::vector<ncclComm_t> localComms_; // [device index] among the devices of this process
+  std::vector<ncclComm_t> crossComms_; // [device index] among the devices with this index in all processes
+  enum Phase { localReduceScatter, crossReduce, crossBroadcast, localAllGather, numPhases };
+  mutable std::vector<double> phaseSeconds_ = std::vector<double>(numPhases, 0.0);
+  mutable size_t phaseUpdates_{0};
+  static const size_t logFreq = 100;
+
+  // --gradient-compression: the gradients are sent as fp16 (sums in fp16 by NCCL) or with 8 or 4 bits
+  // per value (sent to the owner of each shard, which sums them in fp32), see compressedScatterReduce().
+  // What the compression loses is kept per device in a residual and added to the next gradients.
+  // With topk (gradient dropping) each device sends only the indices and values of its largest gradients
+  // to all others, see sparseScatterReduce().
+  int compressionBits_{32}; // 32 means uncompressed
+  bool topk_{false};
+  float dropRate_{0.99f};   // fraction of the gradients that topk does not send, see --gradient-dropping-rate
+  mutable size_t topkCapacity_{0}; // gradients sent per device with topk, set with the buffers
+  static const size_t topkSampleSize = 100000; // values sampled to estimate the threshold of topk
+  mutable std::vector<float*> residuals_;      // [device index] a float per gradient, allocated on first use
+  mutable std::vector<uint8_t*> sendBuffers_;  // [device index] the compressed gradients of all shards
+  mutable std::vector<uint8_t*> recvBuffers_;  // [device index] the compressed shards of all ranks, not fp16
+  mutable std::vector<float*> scales_;         // [device index] the scales sent per shard, then the received ones; the sample of topk
+  mutable std::vector<int*> counters_;         // [device index] the number of selected gradients of topk
+  mutable double topkThresholds_{0.0};         // sum of the thresholds since the last log message
+  mutable size_t topkUpdates_{0};
   mutable ThreadPool threadPool_;
   mutable std::vector<std::future<void>> threadResults_; // [device index]
 
@@ -71,6 +107,8 @@ private:
       return devices_.size();
   }
 
+  bool compressed() const { return compressionBits_ < 32 || topk_; }
+
   size_t dataSize() const { // total number of floats that comprise the concatenated parameter and gradient vector
     return graphs_[0]->params()->vals()->size();
   }
@@ -112,6 +150,261 @@ private:
       mpi_->barrier();
   }
 
+  // reset gradients after their reduction into shards
+  void resetGradsOutsideShards() const {
+    // In the future, we can keep quantization residuals here straight in the grads themselves.
+    auto resetGrads = [&](size_t i, size_t begin, size_t end) {
+      auto grads = graphs_[i]->params()->grads();
+      auto size = grads->size();
+      // reset everything outside the shard that we reduce in
+      if (begin > 0)
+        grads->subtensor(0, begin)->set(0.f);
+      if (end < size)
+        grads->subtensor(end, size - end)->set(0.f);
+    };
+    foreach(resetGrads);
+  }
+
+  // communicators among the local devices and among the devices with the same index across processes
+  void initHierarchical() {
+    size_t numLocal = devices_.size();
+    size_t numProcesses = mpi_->numMPIProcesses();
+
+    ncclUniqueId localId;
+    NCCL_CHECK(ncclGetUniqueId(&localId));
+
+    std::vector<ncclUniqueId> crossIds(numLocal);
+    if(mpi_->myMPIRank() == 0)
+      for(auto& id : crossIds)
+        NCCL_CHECK(ncclGetUniqueId(&id));
+    mpi_->bCast(crossIds.data(), crossIds.size() * sizeof(ncclUniqueId), MPI_BYTE, 0);
+
+    localComms_.resize(numLocal);
+    crossComms_.resize(numLocal);
+    groupStart();
+    for(size_t i = 0; i < numLocal; i++) {
+      CUDA_CHECK(cudaSetDevice(devices_[i]));
+      NCCL_CHECK(ncclCommInitRank(&localComms_[i], (int)numLocal, localId, (int)i));
+      NCCL_CHECK(ncclCommInitRank(&crossComms_[i], (int)numProcesses, crossIds[i], (int)mpi_->myMPIRank()));
+    }
+    groupEnd();
+
+    hierarchical_ = true;
+    LOG(info, "[comm] Using hierarchical NCCL communication: {} local devices x {} processes", numLocal, numProcesses);
+  }
+
+  // synchronizes the phase and adds its time since the last phase
+  void endPhase(Phase phase, timer::Timer& timer) const {
+    synchronizeAll();
+    phaseSeconds_[phase] += timer.elapsed();
+    timer.start();
+  }
+
+  // The shard of global rank p * numLocal + i lives on local device i of process p. Each local device
+  // gets the sums over this process of its shards of all processes, then the owner gets the total.
+  void hierarchicalScatterReduce() const {
+    size_t numLocal = devices_.size();
+    size_t numProcesses = mpi_->numMPIProcesses();
+    size_t size = shardSize();
+    timer::Timer timer;
+
+    groupStart();
+    for(size_t i = 0; i < numLocal; ++i) {
+      auto* grads = graphs_[i]->params()->grads()->data();
+      for(size_t p = 0; p < numProcesses; ++p) {
+        auto* shards = grads + p * numLocal * size; // the shards of process p, in place
+        NCCL_CHECK(ncclReduceScatter(shards, shards + i * size, size, ncclFloat, ncclSum, localComms_[i], streams_[i]));
+      }
+    }
+    groupEnd();
+    endPhase(localReduceScatter, timer);
+
+    groupStart();
+    for(size_t i = 0; i < numLocal; ++i) {
+      auto* grads = graphs_[i]->params()->grads()->data();
+      for(size_t p = 0; p < numProcesses; ++p) {
+        auto* shard = grads + (p * numLocal + i) * size;
+        NCCL_CHECK(ncclReduce(shard, shard, size, ncclFloat, ncclSum, (int)p, crossComms_[i], streams_[i]));
+      }
+    }
+    groupEnd();
+    endPhase(crossReduce, timer);
+  }
+
+  void hierarchicalAllGather() const {
+    size_t numLocal = devices_.size();
+    size_t numProcesses = mpi_->numMPIProcesses();
+    size_t size = shardSize();
+    timer::Timer timer;
+
+    groupStart();
+    for(size_t i = 0; i < numLocal; ++i) {
+      auto* vals = graphs_[i]->params()->vals()->data();
+      for(size_t p = 0; p < numProcesses; ++p) {
+        auto* shard = vals + (p * numLocal + i) * size;
+        NCCL_CHECK(ncclBroadcast(shard, shard, size, ncclFloat, (int)p, crossComms_[i], streams_[i]));
+      }
+    }
+    groupEnd();
+    endPhase(crossBroadcast, timer);
+
+    groupStart();
+    for(size_t i = 0; i < numLocal; ++i) {
+      auto* vals = graphs_[i]->params()->vals()->data();
+      for(size_t p = 0; p < numProcesses; ++p) {
+        auto* shards = vals + p * numLocal * size; // in place
+        NCCL_CHECK(ncclAllGather(shards + i * size, shards, size, ncclFloat, localComms_[i], streams_[i]));
+      }
+    }
+    groupEnd();
+    endPhase(localAllGather, timer);
+
+    if(++phaseUpdates_ == logFreq) {
+      auto ms = [&](Phase phase) { return phaseSeconds_[phase] * 1000 / phaseUpdates_; };
+      LOG(info,
+          "[comm] Hierarchical NCCL per update: local reduce-scatter {:.2f} ms, cross-process reduce {:.2f} ms, "
+          "cross-process broadcast {:.2f} ms, local all-gather {:.2f} ms",
+          ms(localReduceScatter), ms(crossReduce), ms(crossBroadcast), ms(localAllGather));
+      std::fill(phaseSeconds_.begin(), phaseSeconds_.end(), 0.0);
+      phaseUpdates_ = 0;
+    }
+  }
+
+  void allocateCompressionBuffers() const {
+    size_t numRanks = numNcclRanks();
+    if(topk_) {
+      ABORT_IF(dataSize() > std::numeric_limits<uint32_t>::max(), "Gradient dropping supports at most 2^32 parameters");
+      topkCapacity_ = std::max((size_t)1, (size_t)std::ceil(dataSize() * (1.0 - dropRate_)));
+      LOG(info, "[comm] Dropping gradients with error feedback: sending the {} of {} gradients of largest magnitude per device",
+          topkCapacity_, dataSize());
+    }
+    size_t sendBytes = topk_ ? topkCapacity_ * (sizeof(uint32_t) + sizeof(float))
+                     : compressionBits_ == 16 ? dataSize() * sizeof(uint16_t)
+                                              : numRanks * gpu::compressedSegmentBytes(shardSize(), compressionBits_);
+    size_t recvBytes = topk_ ? numRanks * sendBytes : sendBytes;
+    size_t scalesSize = topk_ ? topkSampleSize : 2 * numRanks;
+    residuals_.resize(devices_.size());
+    sendBuffers_.resize(devices_.size(), nullptr);
+    recvBuffers_.resize(devices_.size(), nullptr);
+    scales_.resize(devices_.size(), nullptr);
+    counters_.resize(devices_.size(), nullptr);
+    for(size_t i = 0; i < devices_.size(); ++i) {
+      CUDA_CHECK(cudaSetDevice(devices_[i]));
+      CUDA_CHECK(cudaMalloc((void**)&residuals_[i], dataSize() * sizeof(float)));
+      CUDA_CHECK(cudaMemset(residuals_[i], 0, dataSize() * sizeof(float)));
+      CUDA_CHECK(cudaMalloc((void**)&sendBuffers_[i], sendBytes));
+      if(compressionBits_ < 16 || topk_) {
+        CUDA_CHECK(cudaMalloc((void**)&recvBuffers_[i], recvBytes));
+        CUDA_CHECK(cudaMalloc((void**)&scales_[i], scalesSize * sizeof(float)));
+      }
+      if(topk_)
+        CUDA_CHECK(cudaMalloc((void**)&counters_[i], sizeof(int)));
+    }
+  }
+
+  // Compresses the gradients of each device with the residual of the previous update, exchanges them and
+  // decompresses the sum of each shard into the gradients of its owner. fp16 gradients are scaled by
+  // 1/numRanks so that NCCL's fp16 sums stay in range. With 8 and 4 bits, each device sends each shard with
+  // its own scale to the shard's owner, an all-to-all exchange, since quantized values of different scales
+  // cannot be summed by NCCL.
+  void compressedScatterReduce() const {
+    if(residuals_.empty())
+      allocateCompressionBuffers();
+
+    size_t numRanks = numNcclRanks();
+    size_t size = shardSize();
+    size_t segmentBytes = compressionBits_ == 16 ? size * sizeof(uint16_t) : gpu::compressedSegmentBytes(size, compressionBits_);
+    float scale = 1.f / numRanks;
+
+    for(size_t i = 0; i < devices_.size(); ++i) {
+      CUDA_CHECK(cudaSetDevice(devices_[i]));
+      const auto* grads = graphs_[i]->params()->grads()->data();
+      if(compressionBits_ == 16)
+        gpu::CompressGradientsToHalf(sendBuffers_[i], grads, residuals_[i], dataSize(), scale);
+      else
+        gpu::CompressGradientsToBits(sendBuffers_[i], scales_[i], grads, residuals_[i], size, numRanks, compressionBits_);
+    }
+    synchronizeAllOnNullStream();
+
+    groupStart();
+    for(size_t i = 0; i < devices_.size(); ++i) {
+      auto* shard = sendBuffers_[i] + myNcclRank(i) * segmentBytes;
+      if(compressionBits_ == 16) { // in place
+        NCCL_CHECK(ncclReduceScatter(sendBuffers_[i], shard, size, ncclHalf, ncclSum, comms_[i], streams_[i]));
+        continue;
+      }
+#if NCCL_HAS_SEND_RECV
+      for(size_t rank = 0; rank < numRanks; ++rank) {
+        NCCL_CHECK(ncclSend(sendBuffers_[i] + rank * segmentBytes, segmentBytes, ncclUint8, (int)rank, comms_[i], streams_[i]));
+        NCCL_CHECK(ncclRecv(recvBuffers_[i] + rank * segmentBytes, segmentBytes, ncclUint8, (int)rank, comms_[i], streams_[i]));
+        NCCL_CHECK(ncclSend(scales_[i] + rank, 1, ncclFloat, (int)rank, comms_[i], streams_[i]));
+        NCCL_CHECK(ncclRecv(scales_[i] + numRanks + rank, 1, ncclFloat, (int)rank, comms_[i], streams_[i]));
+      }
+#endif
+    }
+    groupEnd();
+    synchronizeAll();
+
+    for(size_t i = 0; i < devices_.size(); ++i) {
+      CUDA_CHECK(cudaSetDevice(devices_[i]));
+      size_t begin, end; std::tie
+      (begin, end) = localShardRange(i);
+      auto* grads = graphs_[i]->params()->grads()->data() + begin;
+      if(compressionBits_ == 16)
+        gpu::DecompressGradientsFromHalf(grads, sendBuffers_[i] + myNcclRank(i) * segmentBytes, end - begin, scale);
+      else
+        gpu::DecompressAndSumGradientsFromBits(grads, recvBuffers_[i], scales_[i] + numRanks, end - begin, numRanks, compressionBits_);
+    }
+  }
+
+  // Gradient dropping: each device selects its topkCapacity_ largest gradients with the residual of the
+  // previous update, all devices gather the indices and values of all others, and the owner of each
+  // shard sums those that fall into it. The dropped gradients stay in the residual.
+  void sparseScatterReduce() const {
+    if(residuals_.empty())
+      allocateCompressionBuffers();
+
+    size_t numRanks = numNcclRanks();
+    size_t k = topkCapacity_;
+    // a buffer holds `count` indices followed by their values
+    auto indices = [](uint8_t* buffer) { return (uint32_t*)buffer; };
+    auto values = [](uint8_t* buffer, size_t count) { return (float*)(buffer + count * sizeof(uint32_t)); };
+
+    for(size_t i = 0; i < devices_.size(); ++i) {
+      CUDA_CHECK(cudaSetDevice(devices_[i]));
+      const auto* grads = graphs_[i]->params()->grads()->data();
+      topkThresholds_ += gpu::DropGradients(indices(sendBuffers_[i]), values(sendBuffers_[i], k), k,
+                                            grads, residuals_[i], dataSize(),
+                                            scales_[i], topkSampleSize, counters_[i]);
+    }
+    synchronizeAllOnNullStream();
+
+    groupStart();
+    for(size_t i = 0; i < devices_.size(); ++i) {
+      NCCL_CHECK(ncclAllGather(indices(sendBuffers_[i]), indices(recvBuffers_[i]), k, ncclUint32, comms_[i], streams_[i]));
+      NCCL_CHECK(ncclAllGather(values(sendBuffers_[i], k), values(recvBuffers_[i], numRanks * k), k, ncclFloat, comms_[i], streams_[i]));
+    }
+    groupEnd();
+    synchronizeAll();
+
+    for(size_t i = 0; i < devices_.size(); ++i) {
+      CUDA_CHECK(cudaSetDevice(devices_[i]));
+      size_t begin, end; std::tie
+      (begin, end) = localShardRange(i);
+      auto* grads = graphs_[i]->params()->grads()->data() + begin;
+      CUDA_CHECK(cudaMemset(grads, 0, (end - begin) * sizeof(float)));
+      gpu::ScatterAddSparseGradients(grads, indices(recvBuffers_[i]), values(recvBuffers_[i], numRanks * k),
+                                     numRanks * k, begin, end);
+    }
+
+    if(++topkUpdates_ == logFreq) {
+      LOG(info, "[comm] Gradient dropping: mean threshold {:.3e} over the last {} updates",
+          topkThresholds_ / (topkUpdates_ * devices_.size()), topkUpdates_);
+      topkThresholds_ = 0.0;
+      topkUpdates_ = 0;
+    }
+  }
+
   // helper class to temporarily block a UNIX signal
   class BlockSignal {
     typedef std::function<void(int, const sigset_t*, sigset_t*)> SigMaskFn;
@@ -134,10 +427,15 @@ public:
   // If MPI is used, then each MPI process has an instance of this class for its specific
   // set of GPU devices, which are communicating with each other. The total number of GPUs
   // involved in the NCCL communication setup is (#MPI processes) x (#GPUs per process).
-  NCCLCommunicator(const std::vector<Ptr<ExpressionGraph>>& graphs, Ptr<IMPIWrapper> mpi)
+  NCCLCommunicator(const std::vector<Ptr<ExpressionGraph>>& graphs,
+                   Ptr<IMPIWrapper> mpi,
+                   bool hierarchical = false,
+                   const std::string& compression = "none",
+                   float dropRate = 0.99f)
       : ICommunicator(graphs),
         comms_(graphs.size()),
         streams_(graphs.size()),
+        gradsReady_(graphs.size()),
         devices_(graphs.size()),
         mpi_(mpi),
         threadPool_(graphs.size(), graphs.size()), threadResults_(graphs.size()) {
@@ -147,6 +445,26 @@ public:
         (mpi_ && mpi_->numMPIProcesses() > 1) ? "and MPI " : "");
     mpiBarrier(); // (synchronize the log messages)
 
+    if(compression == "fp16")
+      compressionBits_ = 16;
+    else if(compression == "8bit")
+      compressionBits_ = 8;
+    else if(compression == "4bit")
+      compressionBits_ = 4;
+    else if(compression == "topk")
+      topk_ = true;
+    else
+      ABORT_IF(compression != "none", "Unknown gradient compression '{}', use none, fp16, 8bit, 4bit or topk", compression);
+#if !NCCL_HAS_SEND_RECV
+    ABORT_IF(compressionBits_ < 16, "--gradient-compression {} needs NCCL 2.7 or newer", compression);
+#endif
+    if(compressionBits_ < 32)
+      LOG(info, "[comm] Compressing gradients to {} with error feedback", compression);
+    if(topk_) {
+      ABORT_IF(dropRate <= 0.f || dropRate >= 1.f, "--gradient-dropping-rate has to be in (0, 1), got {}", dropRate);
+      dropRate_ = dropRate;
+    }
+
     // set up our local devices
     for(int i = 0; i < graphs_.size(); ++i) {
       auto device = graphs_[i]->getBackend()->getDeviceId();
@@ -157,6 +475,7 @@ public:
       devices_[i] = device.no;
       CUDA_CHECK(cudaSetDevice(devices_[i]));
       CUDA_CHECK(cudaStreamCreate(&streams_[i]));
+      CUDA_CHECK(cudaEventCreateWithFlags(&gradsReady_[i], cudaEventDisableTiming));
     }
 
     // Note: due to a bug in NCCL 2.3.5, NCCL's allocation of shared memory intermittently fails with
@@ -190,6 +509,15 @@ public:
     }
     groupEnd();
 
+    if(hierarchical && compressed()) {
+      LOG(warn, "[comm] --nccl-hierarchical is not combined with --gradient-compression, using a flat communicator");
+    } else if(hierarchical) {
+      if(mpi_ && mpi_->numMPIProcesses() > 1 && devices_.size() > 1)
+        initHierarchical();
+      else
+        LOG(info, "[comm] --nccl-hierarchical needs several MPI processes with several devices each, using a flat communicator");
+    }
+
     mpiBarrier(); // (synchronize the log messages)
     LOG(info, "[comm] NCCLCommunicator constructed successfully");
     mpiBarrier(); // (synchronize the log messages)
@@ -199,7 +527,19 @@ public:
     for(int i = 0; i < devices_.size(); ++i) {
       cudaSetDevice(devices_[i]);
       cudaStreamDestroy(streams_[i]);
+      cudaEventDestroy(gradsReady_[i]);
       ncclCommDestroy(comms_[i]);
+      if(hierarchical_) {
+        ncclCommDestroy(localComms_[i]);
+        ncclCommDestroy(crossComms_[i]);
+      }
+      if(!residuals_.empty()) {
+        cudaFree(residuals_[i]);
+        cudaFree(sendBuffers_[i]);
+        cudaFree(recvBuffers_[i]);
+        cudaFree(scales_[i]);
+        cudaFree(counters_[i]);
+      }
     }
   }
 
@@ -220,8 +560,27 @@ public:
   }
 
   void scatterReduceAndResetGrads() const override {
+    tracing::Span span("communicator", "scatterReduceAndResetGrads");
     synchronizeAllOnNullStream();
 
+    if(hierarchical_) {
+      hierarchicalScatterReduce();
+      resetGradsOutsideShards();
+      return;
+    }
+
+    if(topk_) {
+      sparseScatterReduce();
+      resetGradsOutsideShards();
+      return;
+    }
+
+    if(compressionBits_ < 32) {
+      compressedScatterReduce();
+      resetGradsOutsideShards();
+      return;
+    }
+
     groupStart();
     for(int i = 0; i < graphs_.size(); ++i) {
       size_t begin, end; std::tie
@@ -238,26 +597,54 @@ public:
     groupEnd();
     synchronizeAll();
 
-    // reset gradients
-    // In the future, we can keep quantization residuals here straight in the grads themselves.
-    auto resetGrads = [&](size_t i, size_t begin, size_t end) {
-      auto grads = graphs_[i]->params()->grads();
-      auto size = grads->size();
-      // reset everything outside the shard that we reduce in
-      if (begin > 0)
-        grads->subtensor(0, begin)->set(0.f);
-      if (end < size)
-        grads->subtensor(end, size - end)->set(0.f);
-    };
-    foreach(resetGrads);
+    resetGradsOutsideShards();
+  }
+
+  bool canOverlapScatterReduce() const override { return !hierarchical_ && !compressed(); }
+
+  // Reduces the range with one ncclReduce() to its owner per shard that it overlaps, which amounts to a
+  // ncclReduceScatter() once all ranges have been reduced. The reduction runs on the NCCL stream after
+  // the kernels that have been queued on the compute stream so far, the host does not wait.
+  void scatterReduceRangeAsync(size_t localDeviceIndex, size_t begin, size_t end) const override {
+    tracing::Span span("communicator", "scatterReduceRangeAsync");
+    size_t i = localDeviceIndex;
+    CUDA_CHECK(cudaSetDevice(devices_[i]));
+    CUDA_CHECK(cudaEventRecord(gradsReady_[i], /*stream=*/0));
+    CUDA_CHECK(cudaStreamWaitEvent(streams_[i], gradsReady_[i], 0));
+
+    auto* grads = graphs_[i]->params()->grads()->data();
+    groupStart();
+    for(size_t rank = 0; rank < numNcclRanks(); ++rank) {
+      size_t shardBegin, shardEnd; std::tie
+      (shardBegin, shardEnd) = ncclRankShardRange(rank);
+      size_t from = std::max(begin, shardBegin);
+      size_t to   = std::min(end, shardEnd);
+      if(from < to) // in place, the owner receives the sum in its own gradients
+        NCCL_CHECK(ncclReduce(grads + from, grads + from, to - from, ncclFloat, ncclSum, (int)rank, comms_[i], streams_[i]));
+    }
+    groupEnd();
   }
 
+  void finishScatterReduceAndResetGrads() const override {
+    tracing::Span span("communicator", "finishScatterReduceAndResetGrads");
+    synchronizeAllOnNullStream();
+    synchronizeAll();
+    resetGradsOutsideShards();
+  }
+
+
   // This distributes all 64 model shards to all 64 GPUs.
   // @TODO: For unknown reasons, this takes longer than any other operation incl. scatterReduceAndResetGrads().
   //        But both should have the same number of data transfers of the same size.
   void allGatherParams() const override {
+    tracing::Span span("communicator", "allGatherParams");
     synchronizeAllOnNullStream();
 
+    if(hierarchical_) {
+      hierarchicalAllGather();
+      return;
+    }
+
     groupStart();
     for(int i = 0; i < graphs_.size(); ++i) {
       size_t begin, end; std::tie
@@ -276,32 +663,16 @@ public:
 
   // swap distributed paramShards with model params()
   // It is assumed that all model params() on all devices and MPI processes are identical.
-  // This is used for the smoothed parameters.
+  // This is used for the smoothed parameters. Each device swaps its shard with its slice of params(),
+  // then all slices are gathered on the GPUs, so no copy of the complete parameters goes through the CPU.
   void swapParams(const std::vector<Tensor>& distributedParamShards) const override {
-    // get everything onto the CPU
-    auto distributedParams = gatherState([&](size_t localDeviceIndex) {
-      std::vector<float> tmp;
-      distributedParamShards[localDeviceIndex]->get(tmp);
-      return tmp;
-    });
-    // Now all MPI processes hold an identical copy of a concatenation of all distributedParamShards[] across local and remote devices.
-    std::vector<float> localParams;
-    graphs_[0]->params()->vals()->get(localParams);
-    // Now all MPI processes hold an identical copy of params() (remember, we assumed all devices hold the same params()).
-    ABORT_IF(distributedParams.size() != localParams.size(), "distributed sharded and local params have different size??");
-
-    // swap
-    std::swap(distributedParams, localParams);
-
-    // distribute it back
-    scatterState(distributedParams, [&](size_t localDeviceIndex,
-                                        std::vector<float>::const_iterator begin,
-                                        std::vector<float>::const_iterator end){
-      ABORT_IF(distributedParamShards[localDeviceIndex]->size() != end-begin, "swapParams size mismatch??"); // @TODO: move check to set()
-      distributedParamShards[localDeviceIndex]->set(std::vector<float>(begin, end)); // @TODO: directly pass iterators to set()
+    tracing::Span span("communicator", "swapParams");
+    foreach([&](size_t localDeviceIndex, size_t begin, size_t end) {
+      auto shard = distributedParamShards[localDeviceIndex];
+      ABORT_IF(shard->size() != end - begin, "swapParams size mismatch??");
+      shard->swap(graphs_[localDeviceIndex]->params()->vals()->subtensor(begin, end - begin));
     });
-    for (auto& graph : graphs_) // broadcast to every local graph
-      graph->params()->vals()->set(localParams);
+    allGatherParams();
   }
 
   // Distribute a single CPU-side vector to shards across multiple devices and MPI processes.
@@ -320,8 +691,18 @@ public:
     }
   }
 
-  // Collect shards across multiple devices and MPI processes in the NCCL configuration into a single CPU-side vector.
-  // This is used when persisting optimizer state, which is sharded, and as part of swapParams().
+  // All shards have the same size, see shardSize()
+  void scatterLocalState(const std::vector<float>& data, const OptimizerBase::ScatterStateSetFunc& setFn) const override {
+    ABORT_IF(data.size() != graphs_.size() * shardSize(),
+             "The optimizer state was saved with other shards, resume with the same number of devices and MPI processes");
+    for(size_t localDeviceIndex = 0; localDeviceIndex < graphs_.size(); localDeviceIndex++) {
+      auto begin = data.begin() + localDeviceIndex * shardSize();
+      setFn(localDeviceIndex, begin, begin + shardSize());
+    }
+  }
+
+  // Collect shards across multiple devices and MPI processes in the NCCL configuration into a single CPU-side vector
+  // on the main MPI process. This is used when persisting optimizer state, which is sharded.
   std::vector<float> gatherState(const OptimizerBase::GatherStateGetFunc& getFn) const override {
     std::vector<float> tmp; // (temp buffer used multiple times)
     // first, concatenate over all local devices
@@ -330,17 +711,20 @@ public:
       tmp = getFn(localDeviceIndex);
       localData.insert(localData.end(), tmp.begin(), tmp.end());
     }
-    // second, concatenate across MPI processes
-    // Note that all local devices occupy consecutive ncclRanks in order.
+    // second, concatenate across MPI processes on the main one, the others only send their shards
+    // Note that all local devices occupy consecutive ncclRanks in order, and all shards have the same size.
     std::vector<float> data;
-    if (mpi_) {
-      // push one rank's data at a time using broadcast
-      for(size_t mpiRank = 0; mpiRank < mpi_->numMPIProcesses(); mpiRank++) {
-        // broadcast mpiRank's localData to all
-        if(mpiRank == mpi_->myMPIRank())
-          tmp = localData;
-        mpi_->bCast(tmp, /*rootRank=*/mpiRank);
-        // now all ranks have the same slice: concatenate (we will end up with the same on all MPI processes)
+    if (mpi_ && mpi_->numMPIProcesses() > 1) {
+      const int tag = 0;
+      if (mpi_->myMPIRank() != 0) {
+        mpi_->sSend(localData.data(), localData.size(), MPI_FLOAT, /*destRank=*/0, tag);
+        return data;
+      }
+      data.reserve(localData.size() * mpi_->numMPIProcesses());
+      data.insert(data.end(), localData.begin(), localData.end());
+      tmp.resize(localData.size());
+      for(size_t mpiRank = 1; mpiRank < mpi_->numMPIProcesses(); mpiRank++) {
+        mpi_->recv(tmp.data(), tmp.size(), MPI_FLOAT, /*sourceRank=*/mpiRank, tag);
         data.insert(data.end(), tmp.begin(), tmp.end());
       }
     }
@@ -17,10 +17,21 @@ public:
       mvDecayBy_ = options->get<float>("exponential-smoothing");
       refBatchTrgWords_ = options->get<size_t>("mini-batch-words-ref"); // adjust as if our MB size (in target labels) was this value
       mvAvg_ = (mvDecayBy_ > 0);
+      mvInterval_ = std::max(options->get<size_t>("exponential-smoothing-interval", 1), (size_t)1);
     }
 
 protected:
+  // Whether the average is updated with update number batches + 1, see --exponential-smoothing-interval
+  bool smoothingDue(size_t batches) const { return (batches + 1) % mvInterval_ == 0; }
+
   void updateAvgParams(Tensor paramsAvg, Tensor params, size_t batches, size_t actualBatchTrgWords = OptimizerBase::mbSizeNotProvided) {
+    float decayBy = avgDecay(batches, actualBatchTrgWords);
+    using namespace functional;
+    Element(_1 = ((1.f - decayBy) * _1) + (decayBy * _2), paramsAvg, params);
+  }
+
+  // The weight of the current parameters in the average, e.g. for OptimizerBase::updateAndSmooth()
+  float avgDecay(size_t batches, size_t actualBatchTrgWords = OptimizerBase::mbSizeNotProvided) {
     double beta = 1. - mvDecayBy_;
     // correction term if batch size is different from what mvDecayBy_ was specified for
     if (refBatchTrgWords_) {
@@ -34,14 +45,17 @@ protected:
       batches = std::max(batches, batches * actualBatchTrgWords / refBatchTrgWords_); // @BUGBUG: Does not consider that batch size is changing
     }
     // reduce effect of decay parameter in early training stages
-    float decayBy = std::max(1.f - (float)beta,
-                             1.f - (float)(batches + 1) / (float)(batches + 10));
-    using namespace functional;
-    Element(_1 = ((1.f - decayBy) * _1) + (decayBy * _2), paramsAvg, params);
+    float decay = std::max(1.f - (float)beta,
+                           1.f - (float)(batches + 1) / (float)(batches + 10));
+    // the average is only updated every mvInterval_ updates, with the decay of all of them
+    if(mvInterval_ > 1)
+      decay = 1.f - (float)pow(1. - decay, (double)mvInterval_);
+    return decay;
   }
 
   bool mvAvg_{false};
   float mvDecayBy_{1e-4f};     // decay prior model by this factor
   size_t refBatchTrgWords_{0}; // mvDecayBy_ is specified for this batch size (in target words) (0 means not specified)
+  size_t mvInterval_{1};       // update the average every this many updates
 };
 }  // namespace marian
@@ -1,4 +1,10 @@
 #include "training/graph_group.h"
+#include "common/fastopt.h"
+#include "common/filesystem.h"
+#include "common/version.h"
+
+#include <iomanip>
+#include <sstream>
 
 namespace marian {
 
@@ -12,10 +18,69 @@ void GraphGroup::finalize() {
   finalized_ = true;
 }
 
+// Options that do not influence how many sentences fit into the workspace, changing them keeps
+// cached batch statistics valid. Entries ending in '*' are prefixes.
+static const std::vector<std::string> batchStatsIgnoredOptions = {
+  "after*", "binary-corpus", "config", "cpu-threads", "data-*", "devices", "disp-*", "dump-config",
+  "early-stopping*", "elastic", "keep-best", "learn-rate", "log*", "lr-*", "mini-batch-fit-cache",
+  "model", "no-restore-corpus", "num-devices", "optimizer-delay", "overwrite", "quiet*",
+  "relative-paths", "save-freq", "seed", "shuffle*", "sigterm", "sqlite*", "tempdir", "train-sets",
+  "valid-*", "vocabs"
+};
+
+static bool isIgnoredForBatchStats(const std::string& key) {
+  for(const auto& ignored : batchStatsIgnoredOptions) {
+    if(ignored.back() == '*' ? key.compare(0, ignored.size() - 1, ignored, 0, ignored.size() - 1) == 0
+                             : key == ignored)
+      return true;
+  }
+  return false;
+}
+
+std::string GraphGroup::batchStatsCachePath(Ptr<ExpressionGraph> graph,
+                                            const std::vector<Ptr<Vocab>>& vocabs) {
+  auto dir = options_->get<std::string>("mini-batch-fit-cache", "");
+  if(dir == "none")
+    return "";
+  if(dir.empty())
+    dir = filesystem::Path(options_->get<std::string>("model")).parentPath().string();
+
+  // options in sorted order, so that the key does not depend on the order in the config
+  std::map<std::string, std::string> relevant;
+  auto config = options_->cloneToYamlNode();
+  for(const auto& it : config) {
+    auto key = it.first.as<std::string>();
+    if(!isIgnoredForBatchStats(key))
+      relevant[key] = YAML::Dump(it.second);
+  }
+
+  std::stringstream key;
+  for(const auto& it : relevant)
+    key << it.first << ": " << it.second << "\n";
+  for(const auto& vocab : vocabs)
+    key << "vocab-size: " << vocab->size() << "\n";
+  key << "device-type: " << (graph->getDeviceId().type == DeviceType::gpu ? "gpu" : "cpu") << "\n";
+  key << "per-device\n"; // unlike older caches, which included the multiplier
+  key << "version: " << buildVersion() << "\n";
+
+  auto keyStr = key.str();
+  std::stringstream name;
+  name << "batch-stats." << std::hex << std::setw(16) << std::setfill('0') << crc::crc(keyStr.data(), keyStr.size());
+  return dir.empty() ? name.str() : (filesystem::Path(dir) / filesystem::Path(name.str())).string();
+}
+
 Ptr<data::BatchStats> GraphGroup::collectStats(Ptr<ExpressionGraph> graph,
                                                Ptr<models::ICriterionFunction> model,
                                                const std::vector<Ptr<Vocab>>& vocabs,
                                                double multiplier) {
+  auto cachePath = batchStatsCachePath(graph, vocabs);
+  if(!cachePath.empty() && filesystem::exists(cachePath)) {
+    LOG(info, "[batching] Using cached statistics from {}", cachePath);
+    auto stats = data::BatchStats::load(cachePath);
+    stats->multiply(multiplier);
+    return stats;
+  }
+
   auto stats = New<data::BatchStats>();
   size_t numFiles = numberOfInputFiles();
 
@@ -69,7 +134,7 @@ Ptr<data::BatchStats> GraphGroup::collectStats(Ptr<ExpressionGraph> graph,
       LOG(debug, "[batching] length: {} - size: {} - fits: {}", lengths[0], current, fits);
 
       if(fits) {
-        stats->add(batch, multiplier);
+        stats->add(batch);
         start = current + 1;
       } else {
         end = current - 1;
@@ -78,6 +143,12 @@ Ptr<data::BatchStats> GraphGroup::collectStats(Ptr<ExpressionGraph> graph,
 
     maxBatch = start;
   }
+
+  if(!cachePath.empty()) {
+    LOG(info, "[batching] Caching statistics in {}", cachePath);
+    stats->save(cachePath);
+  }
+  stats->multiply(multiplier);
   return stats;
 }
 
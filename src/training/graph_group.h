@@ -29,6 +29,11 @@ protected:
   // to be included in the batch, i.e. without alignments and weights
   size_t numberOfInputFiles();
 
+  // file for caching the statistics of collectStats() for one device, named after a hash of everything
+  // that influences them, or empty if caching is disabled
+  std::string batchStatsCachePath(Ptr<ExpressionGraph> graph,
+                                  const std::vector<Ptr<Vocab>>& vocabs);
+
 public:
   GraphGroup(Ptr<Options> options);
 
@@ -54,6 +59,9 @@ public:
    * In a multi-GPU scenario, the first GPU is used to determine the size.
    * The actual allowed size is then determined by multiplying it with the
    * number of devices, which is passed in as the 'multiplier'.
+   * The statistics are cached in --mini-batch-fit-cache and reused as long as no option that
+   * could change them differs. They are cached before the multiplier is applied, so that a run on
+   * a different number of devices, e.g. with --elastic, reuses them.
    */
   // @TODO: Can this be made const? It seems wrong to have a stateful method that still returns a result.
   Ptr<data::BatchStats> collectStats(Ptr<ExpressionGraph> graph,
@@ -2,6 +2,7 @@
 #include "data/corpus_base.h"
 #include "functional/functional.h"
 #include "tensors/tensor_operators.h"
+#include "common/timer.h"
 
 namespace marian {
 
@@ -10,15 +11,34 @@ AsyncGraphGroup::AsyncGraphGroup(Ptr<Options> config, Ptr<IMPIWrapper> mpi)
       ExponentialSmoothing(options_),
       devices_{Config::getDevices(options_)},
       shardSync_(devices_.size()),
+      current_(devices_.size()),
+      readers_(2 * devices_.size()),
+      bufferVersions_(2 * devices_.size()),
+      fetchedVersions_(devices_.size(), std::vector<size_t>(devices_.size(), 0)),
+      maxStaleness_(options_->get<size_t>("async-max-staleness", 0)),
+      updates_(devices_.size(), 0),
+      staleness_(devices_.size(), 0),
+      maxStalenessSeen_(devices_.size(), 0),
+      dropped_(devices_.size(), 0),
+      pushWaitSeconds_(devices_.size(), 0),
+      fetchWaitSeconds_(devices_.size(), 0),
       optimizerDelay_((size_t)options_->get<double>("optimizer-delay")) {
   ABORT_IF(mpi->numMPIProcesses() != 1, "AsyncGraphGroup presently does not support multiple MPI processes");
   ABORT_IF((double)optimizerDelay_ != options_->get<double>("optimizer-delay"), "AsyncGraphGroup presently does not implement fractional values for --optimizer-delay");
   pool_.reset(new ThreadPool(devices_.size(), devices_.size()));
+  copyPool_.reset(new ThreadPool(devices_.size()));
+  for(auto& c : current_)
+    c = 0;
+  for(auto& r : readers_)
+    r = 0;
+  for(auto& v : bufferVersions_)
+    v = 0;
 
   for(auto device : devices_) {
     auto graph = New<ExpressionGraph>();
     graph->setDevice(device);
     graph->setCheckpointing(options_->get<bool>("gradient-checkpointing"));
+    graph->setCheckpointingBudget(options_->get<size_t>("gradient-checkpointing-budget"));
     graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
     graphs_.push_back(graph);
     shardOpt_.push_back(Optimizer(options_));
@@ -38,53 +58,113 @@ void AsyncGraphGroup::setScheduler(Ptr<Scheduler> scheduler) {
 
 void AsyncGraphGroup::fetchParams(Tensor oldParams,
                                   const std::vector<Tensor>& params,
-                                  int /*device_id*/) {
-  // @TODO read guard on parameters
-  int pos = 0;
+                                  int device_id) {
+  timer::Timer timer;
+  // the moving average is only fetched while the other threads wait, see execute()
+  bool current = &params == &params_;
 
-  std::vector<std::thread> threads;
+  std::vector<std::future<void>> copies;
+  int pos = 0;
   for(int idx = 0; idx < devices_.size(); idx++) {
-    threads.emplace_back(std::thread(
-        [&](int idx, int pos) {
-          // individual mutex per-shard
-          std::lock_guard<std::mutex> guard(shardSync_[idx]);
-          oldParams->subtensor((int)pos, (int)params[idx]->size())->copyFrom(params[idx]);
-        },
-        idx,
-        pos));
+    copies.push_back(copyPool_->enqueue([=, &params](int idx, int pos) {
+      auto dest = oldParams->subtensor(pos, (int)params[idx]->size());
+      if(!current) {
+        dest->copyFrom(params[idx]);
+        return;
+      }
+
+      // register as a reader of the published buffer; if an update was published in between, the
+      // writer may already be overwriting the buffer, so try again with the new one
+      int buffer;
+      for(;;) {
+        buffer = current_[idx];
+        readers_[2 * idx + buffer]++;
+        if(current_[idx] == buffer)
+          break;
+        readers_[2 * idx + buffer]--;
+      }
+      dest->copyFrom(shardParams(idx, buffer)); // synchronous
+      fetchedVersions_[device_id][idx] = bufferVersions_[2 * idx + buffer];
+      readers_[2 * idx + buffer]--;
+    }, idx, pos));
 
     pos += shardSize_;
   }
-  for(auto&& t : threads) {
-    t.join();
-  }
+  for(auto& copy : copies)
+    copy.get();
+
+  if(current)
+    fetchWaitSeconds_[device_id] += timer.elapsed();
 }
 
 void AsyncGraphGroup::pushGradients(Tensor newGrads,
-                                    int /*device_id*/) {
-  // add instead of copy?
-  std::vector<std::thread> threads;
+                                    int device_id) {
+  std::vector<std::future<void>> updates;
   int pos = 0;
   for(int idx = 0; idx < devices_.size(); idx++) {
-    threads.emplace_back(std::thread(
-        [&](int idx, int pos) {
-          // individual mutex per-shard
-          std::lock_guard<std::mutex> guard(shardSync_[idx]);
-          grads_[idx]->copyFrom(newGrads->subtensor(pos, (int)grads_[idx]->size()));
+    updates.push_back(copyPool_->enqueue([=](int idx, int pos) {
+      timer::Timer timer;
+      // individual mutex per-shard, as the optimizer state is updated
+      std::lock_guard<std::mutex> guard(shardSync_[idx]);
+
+      int buffer = current_[idx], next = 1 - buffer;
+      size_t version = bufferVersions_[2 * idx + buffer];
+      size_t staleness = version - fetchedVersions_[device_id][idx]; // updates since the parameters were fetched
+      staleness_[idx] += staleness;
+      maxStalenessSeen_[idx] = std::max(maxStalenessSeen_[idx], staleness);
+      if(maxStaleness_ > 0 && staleness > maxStaleness_) {
+        dropped_[idx]++;
+        pushWaitSeconds_[idx] += timer.elapsed();
+        return;
+      }
 
-          shardOpt_[idx]->update(params_[idx], grads_[idx]);
+      // wait for the readers that started on the other buffer before the last update was published
+      while(readers_[2 * idx + next] > 0)
+        std::this_thread::yield();
+      pushWaitSeconds_[idx] += timer.elapsed();
 
-          if(mvAvg_)
-            updateAvgParams(
-                paramsAvg_[idx], params_[idx], scheduler_->numberOfBatches());
-        },
-        idx,
-        pos));
+      auto params = shardParams(idx, next);
+      params->copyFrom(shardParams(idx, buffer));
+      grads_[idx]->copyFrom(newGrads->subtensor(pos, (int)grads_[idx]->size()));
+
+      if(mvAvg_ && smoothingDue(scheduler_->numberOfBatches()))
+        shardOpt_[idx]->updateAndSmooth(params, grads_[idx], paramsAvg_[idx],
+                                        avgDecay(scheduler_->numberOfBatches()));
+      else
+        shardOpt_[idx]->update(params, grads_[idx]);
+      graphs_[idx]->getBackend()->synchronize(); // the update is complete before readers see it
+
+      bufferVersions_[2 * idx + next] = version + 1;
+      current_[idx] = next; // publish
+      updates_[idx]++;
+    }, idx, pos));
 
     pos += shardSize_;
   }
-  for(auto&& t : threads)
-    t.join();
+  for(auto& update : updates)
+    update.get();
+}
+
+void AsyncGraphGroup::reportParameterServer() {
+  size_t updates = 0, pushes = 0, staleness = 0, maxStaleness = 0, dropped = 0;
+  double pushWait = 0, fetchWait = 0;
+  for(size_t idx = 0; idx < devices_.size(); idx++) {
+    updates      += updates_[idx];
+    pushes       += updates_[idx] + dropped_[idx];
+    staleness    += staleness_[idx];
+    maxStaleness  = std::max(maxStaleness, maxStalenessSeen_[idx]);
+    dropped      += dropped_[idx];
+    pushWait     += pushWaitSeconds_[idx];
+    fetchWait    += fetchWaitSeconds_[idx];
+    updates_[idx] = staleness_[idx] = maxStalenessSeen_[idx] = dropped_[idx] = 0;
+    pushWaitSeconds_[idx] = fetchWaitSeconds_[idx] = 0;
+  }
+  if(pushes == 0)
+    return;
+  LOG(info,
+      "[training] Parameter server: {} shard updates, staleness {:.2f} on average and {} at most, "
+      "{} stale gradients dropped, {:.2f}s waiting to update and {:.2f}s fetching parameters",
+      updates, staleness / (double)pushes, maxStaleness, dropped, pushWait, fetchWait);
 }
 
 void AsyncGraphGroup::init(Ptr<data::Batch> batch) {
@@ -120,6 +200,14 @@ void AsyncGraphGroup::init(Ptr<data::Batch> batch) {
       param->copyFrom(graphs_[0]->params()->vals()->subtensor(pos, __size__));
       params_.push_back(param);
 
+      Tensor paramNext;
+      Ptr<TensorAllocator> allocatorNext
+          = New<TensorAllocator>(graph->getBackend());
+      allocatorNext->reserveExact(__size__ * sizeof(float));
+      allocatorNext->allocate(paramNext, {1, __size__});
+      paramsAlloc_.push_back(allocatorNext);
+      paramsNext_.push_back(paramNext);
+
       pos += __size__;
     }
   }
@@ -281,8 +369,10 @@ void AsyncGraphGroup::execute(Ptr<data::Batch> batch) {
         if(scheduler_->validating())
           scheduler_->validate(graphs_);
 
-        if(scheduler_->saving())
+        if(scheduler_->saving()) {
           this->save(graph);
+          reportParameterServer();
+        }
 
         // Validation or saving is done, tell other threads to continue work.
         pool_->notify_others();
@@ -399,6 +489,7 @@ void AsyncGraphGroup::save(Ptr<ExpressionGraph> graph, bool final /*=false*/) {
 void AsyncGraphGroup::finalize() {
   pool_->join_all();  // call before destructing thread pool
   pool_.reset(nullptr);
+  reportParameterServer();
   finalized_ = true;
 }
 
@@ -4,6 +4,7 @@
 #include "training/exponential_smoothing.h"
 #include "training/graph_group.h"
 
+#include <atomic>
 #include <future>
 #include <thread>
 
@@ -21,12 +22,28 @@ protected:
   std::vector<DeviceId> devices_;
 
   std::mutex sync_;
-  std::vector<std::mutex> shardSync_;
+  std::vector<std::mutex> shardSync_; // [shard] one update of a shard at a time
 
   std::mutex schedulerMutex_;
 
-  std::vector<Tensor> params_;
+  // Each shard is double-buffered: pushGradients() updates a copy of the current parameters in the other
+  // buffer and then publishes it, so that fetchParams() never waits for an update. A writer only has to wait
+  // for the readers that still copy the buffer it is about to overwrite from before the previous update.
+  std::vector<Tensor> params_;     // [shard] buffer 0
+  std::vector<Tensor> paramsNext_; // [shard] buffer 1
   std::vector<Ptr<TensorAllocator>> paramsAlloc_;
+  std::vector<std::atomic<int>> current_;           // [shard] the published buffer
+  std::vector<std::atomic<int>> readers_;           // [shard * 2 + buffer] fetchParams() copying from it
+  std::vector<std::atomic<size_t>> bufferVersions_; // [shard * 2 + buffer] number of updates it contains
+  std::vector<std::vector<size_t>> fetchedVersions_; // [device][shard] versions of the last fetchParams()
+  size_t maxStaleness_{0}; // --async-max-staleness
+
+  // statistics since the last reportParameterServer(), see there
+  std::vector<size_t> updates_, staleness_, maxStalenessSeen_, dropped_; // [shard]
+  std::vector<double> pushWaitSeconds_;  // [shard] waiting for the shard and its readers
+  std::vector<double> fetchWaitSeconds_; // [device] in fetchParams()
+
+  std::unique_ptr<ThreadPool> copyPool_; // copies and updates of the shards in parallel, kept for saving after finalize()
 
   std::vector<Tensor> grads_;
   std::vector<Ptr<TensorAllocator>> gradsAlloc_;
@@ -51,6 +68,11 @@ protected:
   virtual void init(Ptr<data::Batch> batch);
   void execute(Ptr<data::Batch> batch);
 
+  Tensor shardParams(size_t idx, int buffer) const { return buffer == 0 ? params_[idx] : paramsNext_[idx]; }
+  // Logs the staleness of the gradients and the waits of the parameter server; not thread-safe, called
+  // while the other threads wait for saving or after training
+  void reportParameterServer();
+
 public:
   AsyncGraphGroup(Ptr<Options> config, Ptr<IMPIWrapper> mpi);
 
@@ -0,0 +1,311 @@
+#include "training/graph_group_pipeline.h"
+#include "common/filesystem.h"
+#include "common/io.h"
+#include "models/costs.h"
+
+#include <future>
+
+namespace marian {
+
+PipelineGraphGroup::PipelineGraphGroup(Ptr<Options> options, Ptr<IMPIWrapper> mpi)
+    : GraphGroup(options),
+      ExponentialSmoothing(options),
+      numMicroBatches_(options_->get<size_t>("pipeline-parallel")) {
+  ABORT_IF(mpi->numMPIProcesses() != 1, "--pipeline-parallel does not support multiple MPI processes");
+  auto devices = Config::getDevices(options_);
+  ABORT_IF(devices.size() != 2, "--pipeline-parallel trains on two devices, the encoders on the first one and the decoder on the second one");
+
+  double delay = options_->get<double>("optimizer-delay");
+  ABORT_IF(delay < 1 || delay != std::floor(delay), "--pipeline-parallel requires a whole number of batches for --optimizer-delay");
+  delay_ = (size_t)delay;
+
+  // a parameter that both stages use would have to be kept in sync between the devices
+  ABORT_IF(options_->get<bool>("tied-embeddings-src") || options_->get<bool>("tied-embeddings-all"),
+           "--pipeline-parallel cannot train source and target embeddings that are tied");
+  ABORT_IF(options_->get<bool>("transformer-train-position-embeddings", false),
+           "--pipeline-parallel cannot train the position embeddings that encoders and decoder share");
+
+  stages_.resize(devices.size());
+  for(size_t i = 0; i < stages_.size(); ++i) {
+    auto& stage = stages_[i];
+    stage.graph = New<ExpressionGraph>();
+    stage.graph->setDevice(devices[i]);
+    // the encoder stage keeps the outputs of all micro-batches for its backward pass, which
+    // checkpointing would free after each forward pass
+    if(i == 1) {
+      stage.graph->setCheckpointing(options_->get<bool>("gradient-checkpointing"));
+      stage.graph->setCheckpointingBudget(options_->get<size_t>("gradient-checkpointing-budget"));
+    }
+    stage.graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+    stage.opt = i == 0 ? opt_ : Optimizer(options_);
+    stage.builder = models::createCriterionFunctionFromOptions(options_, models::usage::training);
+    auto trainer = std::dynamic_pointer_cast<models::Trainer>(stage.builder);
+    stage.model = trainer ? std::dynamic_pointer_cast<EncoderDecoder>(trainer->getModel()) : nullptr;
+    ABORT_IF(!stage.model, "--pipeline-parallel requires an encoder-decoder model, not --type {}",
+             options_->get<std::string>("type"));
+  }
+}
+
+void PipelineGraphGroup::setScheduler(Ptr<Scheduler> scheduler) {
+  scheduler_ = scheduler;
+  // optimizers have to be registered last to see changes of learning rate
+  scheduler_->registerTrainingObserver(scheduler_);
+  for(auto& stage : stages_)
+    scheduler_->registerTrainingObserver(stage.opt);
+}
+
+size_t PipelineGraphGroup::stageOf(const std::string& paramName) {
+  // the parameters of all encoders are prefixed with "encoder", e.g. encoder1_l1_self_Wq with several of them
+  return paramName.compare(0, 7, "encoder") == 0 ? 0 : 1;
+}
+
+void PipelineGraphGroup::checkStage(size_t stageIndex) {
+  auto& stage = stages_[stageIndex];
+  if(stage.checked)
+    return;
+  for(auto param : *stage.graph->params())
+    ABORT_IF(stageOf(param->name()) != stageIndex,
+             "Parameter {} is used by the {}, but is saved and updated with the {}. --pipeline-parallel cannot "
+             "train models whose encoders and decoder share parameters",
+             param->name(),
+             stageIndex == 0 ? "encoders" : "decoder",
+             stageIndex == 0 ? "decoder" : "encoders");
+  stage.checked = true;
+}
+
+void PipelineGraphGroup::execute(Ptr<data::Batch> batch) {
+  auto microBatches = batch->split(numMicroBatches_);
+  bool resetGradients = delayedBatches_ == 0;
+
+  // the encoder states of each micro-batch on their way to the decoder stage, as the values of
+  // context and mask of each encoder, and the gradients of the contexts on their way back
+  std::vector<std::promise<std::vector<io::Item>>> states(microBatches.size()), stateGrads(microBatches.size());
+  std::vector<std::future<std::vector<io::Item>>> stateFutures, stateGradFutures;
+  for(size_t i = 0; i < microBatches.size(); ++i) {
+    stateFutures.push_back(states[i].get_future());
+    stateGradFutures.push_back(stateGrads[i].get_future());
+  }
+
+  auto encoderStage = encoderThread_.enqueue([&]() {
+    auto& stage = stages_[0];
+    stage.graph->getBackend()->setDevice();
+    stage.model->clear(stage.graph);
+
+    // the graph keeps the forward passes of all micro-batches until the backward pass below
+    std::vector<std::vector<Expr>> contexts(microBatches.size()); // [micro-batch][encoder]
+    for(size_t i = 0; i < microBatches.size(); ++i) {
+      auto encoderStates = stage.model->encode(stage.graph, std::static_pointer_cast<data::CorpusBatch>(microBatches[i]));
+      stage.graph->forward();
+      checkStage(0);
+
+      std::vector<io::Item> items(2 * encoderStates.size());
+      for(size_t j = 0; j < encoderStates.size(); ++j) {
+        contexts[i].push_back(encoderStates[j]->getContext());
+        encoderStates[j]->getContext()->val()->get(items[2 * j], "context");
+        encoderStates[j]->getMask()->val()->get(items[2 * j + 1], "mask");
+      }
+      states[i].set_value(std::move(items));
+    }
+
+    // The gradient of sum(context * grad) with respect to the context is grad, so that the
+    // backward pass from this sum passes on the gradients of the decoder stage
+    Expr sumWithGrads;
+    for(size_t i = 0; i < microBatches.size(); ++i) {
+      auto grads = stateGradFutures[i].get();
+      for(size_t j = 0; j < grads.size(); ++j) {
+        auto grad = stage.graph->constant(grads[j].shape, inits::fromItem(grads[j]), grads[j].type);
+        auto term = sum(flatten(contexts[i][j] * grad), /*axis=*/0);
+        sumWithGrads = sumWithGrads ? sumWithGrads + term : term;
+      }
+    }
+    stage.graph->forward();
+    stage.graph->backward(/*reset=*/resetGradients);
+  });
+
+  auto& stage = stages_[1];
+  stage.graph->getBackend()->setDevice();
+  for(size_t i = 0; i < microBatches.size(); ++i) {
+    auto microBatch = std::static_pointer_cast<data::CorpusBatch>(microBatches[i]);
+    auto items = stateFutures[i].get();
+
+    stage.model->clear(stage.graph);
+    std::vector<Expr> contexts;
+    std::vector<Ptr<EncoderState>> encoderStates;
+    for(size_t j = 0; j < items.size(); j += 2) {
+      auto context = stage.graph->constant(items[j].shape, inits::fromItem(items[j]), items[j].type);
+      context->setTrainable(true); // for the gradient that is handed back to the encoder stage
+      auto mask = stage.graph->constant(items[j + 1].shape, inits::fromItem(items[j + 1]), items[j + 1].type);
+      contexts.push_back(context);
+      encoderStates.push_back(New<EncoderState>(context, mask, microBatch));
+    }
+    stage.model->setEncoderStates(encoderStates);
+
+    auto loss = stage.builder->build(stage.graph, microBatch, /*clearGraph=*/false);
+    stage.graph->forward();
+    checkStage(1);
+    delayedLoss_ += *loss;
+    stage.graph->backward(/*reset=*/resetGradients && i == 0);
+
+    std::vector<io::Item> grads(contexts.size());
+    for(size_t j = 0; j < contexts.size(); ++j)
+      contexts[j]->grad()->get(grads[j], "grad");
+    stateGrads[i].set_value(std::move(grads));
+  }
+  encoderStage.get();
+
+  delayedSentences_ += batch->size();
+  delayedLabels_ += batch->wordsTrg();
+  if(++delayedBatches_ < delay_)
+    return;
+
+  auto mbSize = options_->get<std::string>("cost-type") == "ce-sum" ? delayedLabels_ : OptimizerBase::mbSizeNotProvided;
+  for(auto& stage : stages_)
+    stage.opt->update(stage.graph, mbSize);
+
+  if(mvAvg_) {
+    ABORT_IF(!scheduler_, "Scheduler is required for exponential smoothing");
+
+    for(auto& stage : stages_) {
+      if(!stage.graphAvg) {
+        stage.graphAvg = New<ExpressionGraph>();
+        stage.graphAvg->setDevice(stage.graph->getDeviceId());
+        stage.graphAvg->copyParams(stage.graph);
+      } else if(smoothingDue(scheduler_->numberOfBatches())) {
+        updateAvgParams(stage.graphAvg->params()->vals(),
+                        stage.graph->params()->vals(),
+                        scheduler_->numberOfBatches());
+      }
+    }
+  }
+
+  if(scheduler_) {
+    scheduler_->update(delayedLoss_, delayedBatches_, delayedSentences_, delayedLabels_);
+
+    if(scheduler_->validating())
+      scheduler_->validate({mergedGraph(/*averaged=*/mvAvg_)});
+
+    if(scheduler_->saving())
+      save();
+  }
+
+  delayedBatches_ = 0;
+  delayedSentences_ = 0;
+  delayedLabels_ = 0;
+  delayedLoss_.reset();
+}
+
+void PipelineGraphGroup::loadParameters(const std::string& name, bool averaged, bool markReloaded) {
+  LOG(info, "Loading model from {}", name);
+  auto items = io::loadItems(name);
+  for(size_t i = 0; i < stages_.size(); ++i) {
+    auto& stage = stages_[i];
+    std::vector<io::Item> stageItems;
+    for(const auto& item : items)
+      if(stageOf(item.name) == i)
+        stageItems.push_back(item);
+
+    if(averaged) {
+      stage.graphAvg = New<ExpressionGraph>();
+      stage.graphAvg->setDevice(stage.graph->getDeviceId());
+      stage.graphAvg->load(stageItems, markReloaded);
+      stage.graphAvg->forward();
+    } else {
+      stage.graph->load(stageItems, markReloaded);
+    }
+  }
+}
+
+void PipelineGraphGroup::load() {
+  if(options_->get<bool>("no-reload"))
+    return;
+
+  std::string name = options_->get<std::string>("model");
+  bool markReloaded = !options_->get<bool>("ignore-model-config", false);
+  if(filesystem::exists(name)) {
+    if(scheduler_)
+      scheduler_->load(name);
+
+    if(mvAvg_ && filesystem::exists(name + ".orig.npz")) {
+      // the original parameters from model.npz.orig.npz, the averaged ones from model.npz
+      loadParameters(name + ".orig.npz", /*averaged=*/false, markReloaded);
+      loadParameters(name, /*averaged=*/true, markReloaded);
+    } else {
+      loadParameters(name, /*averaged=*/false, markReloaded);
+    }
+
+    for(size_t i = 0; i < stages_.size(); ++i)
+      stages_[i].opt->load(optimizerStateName(name, i), {stages_[i].opt}, {stages_[i].graph->getBackend()},
+        /*scatterStateFn=*/[&](const std::vector<float>& data, const OptimizerBase::ScatterStateSetFunc& setFn) {
+          setFn(/*localDeviceIndex=*/0, data.begin(), data.end());
+        });
+  } else if(options_->hasAndNotEmpty("pretrained-model")) {
+    std::string init = options_->get<std::string>("pretrained-model");
+    LOG(info, "Initialize model weights with the pre-trained model {}", init);
+    loadParameters(init, /*averaged=*/false, /*markReloaded=*/false);
+  }
+}
+
+// Copies the parameters of both stages into one inference graph on the device of the encoders
+Ptr<ExpressionGraph> PipelineGraphGroup::mergedGraph(bool averaged) {
+  std::vector<io::Item> items;
+  for(auto& stage : stages_)
+    (averaged ? stage.graphAvg : stage.graph)->save(items);
+
+  if(!mergedGraph_) {
+    mergedGraph_ = New<ExpressionGraph>(/*inference=*/true);
+    mergedGraph_->setDevice(stages_[0].graph->getDeviceId());
+    mergedGraph_->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+    mergedGraph_->load(items, /*markReloaded=*/false);
+    mergedGraph_->forward(); // allocates and initializes the parameters
+  } else {
+    for(const auto& item : items)
+      if(auto param = mergedGraph_->get(item.name))
+        param->val()->set(item);
+  }
+  return mergedGraph_;
+}
+
+std::string PipelineGraphGroup::optimizerStateName(const std::string& name, size_t stageIndex) const {
+  return name + (stageIndex == 0 ? ".optimizer.encoders.npz" : ".optimizer.decoder.npz");
+}
+
+void PipelineGraphGroup::save(bool isFinal) {
+  std::string name = options_->get<std::string>("model");
+  auto builder = stages_[0].builder;
+
+  // The model with averaged parameters is saved into model.npz as it is the one that should be used
+  // for decoding, the original parameters into model.npz.orig.npz
+  bool averaged = mvAvg_ && stages_[0].graphAvg;
+  if(averaged)
+    builder->save(mergedGraph(/*averaged=*/false), name + ".orig.npz");
+  auto graph = mergedGraph(averaged);
+
+  if(isFinal && scheduler_)
+    scheduler_->validate({graph}, true);
+
+  if(!options_->get<bool>("overwrite") && !isFinal) {
+    std::string numberOfBatches
+        = scheduler_ ? std::to_string(scheduler_->numberOfBatches()) : "unknown";
+    std::string nameOverwrite = name;
+    nameOverwrite.replace(name.size() - 4, 4, ".iter" + numberOfBatches + ".npz");
+    builder->save(graph, nameOverwrite);
+  }
+
+  builder->save(graph, name, true);
+  if(scheduler_)
+    scheduler_->save(name);
+
+  for(size_t i = 0; i < stages_.size(); ++i)
+    stages_[i].opt->save(optimizerStateName(name, i), {stages_[i].opt},
+      /*gatherStateFn=*/[&](const OptimizerBase::GatherStateGetFunc& getFn) {
+        return getFn(/*localDeviceIndex=*/0);
+      });
+}
+
+Ptr<data::BatchStats> PipelineGraphGroup::collectStats(const std::vector<Ptr<Vocab>>& vocabs) {
+  // The encoder stage keeps the activations of all micro-batches until its backward pass, so a batch is
+  // taken to fit if the full model fits on one device with it. This model is not used for training.
+  return GraphGroup::collectStats(stages_[1].graph, stages_[1].builder, vocabs);
+}
+
+}  // namespace marian
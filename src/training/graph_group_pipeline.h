@@ -0,0 +1,70 @@
+#pragma once
+
+#include "training/graph_group.h"
+#include "training/exponential_smoothing.h"
+#include "models/encoder_decoder.h"
+
+#include "3rd_party/threadpool.h"
+
+namespace marian {
+
+/**
+ * Pipeline-parallel training of an encoder-decoder model on two devices, see --pipeline-parallel.
+ * The encoders are trained on the first device and the decoder with the output layer on the second one,
+ * so that each device only holds the parameters, gradients and optimizer state of its own stage.
+ *
+ * Every batch is split into micro-batches. The encoder stage encodes them one after the other and hands
+ * the encoder states of each to the decoder stage, which runs the forward and backward pass of the decoder
+ * on it while the next one is encoded, and hands back the gradients of the encoder states. Once those of
+ * all micro-batches have arrived, the encoder stage runs a single backward pass over all of them (GPipe).
+ * The gradients of --optimizer-delay batches are accumulated before each update.
+ */
+class PipelineGraphGroup : public GraphGroup, public ExponentialSmoothing {
+  struct Stage {
+    Ptr<ExpressionGraph> graph;
+    Ptr<ExpressionGraph> graphAvg;          // with exponential smoothing
+    Ptr<models::ICriterionFunction> builder;
+    Ptr<EncoderDecoder> model;              // the model of builder
+    Ptr<OptimizerBase> opt;
+    bool checked{false};                    // whether the parameters of the graph were checked to belong to this stage
+  };
+  std::vector<Stage> stages_;               // [0] the encoders, [1] the decoder
+
+  size_t numMicroBatches_;                  // --pipeline-parallel
+  size_t delay_;                            // --optimizer-delay
+  ThreadPool encoderThread_{1};             // runs the encoder stage while the calling thread runs the decoder stage
+
+  // of the batches since the last update
+  size_t delayedBatches_{0};
+  size_t delayedSentences_{0};
+  size_t delayedLabels_{0};
+  StaticLoss delayedLoss_;
+
+  Ptr<ExpressionGraph> mergedGraph_;        // all parameters on one device, for validation and saving
+
+  // index of the stage that owns a parameter, by name
+  static size_t stageOf(const std::string& paramName);
+  void checkStage(size_t stageIndex);
+
+  void execute(Ptr<data::Batch> batch);
+  void loadParameters(const std::string& name, bool averaged, bool markReloaded);
+  Ptr<ExpressionGraph> mergedGraph(bool averaged);
+  std::string optimizerStateName(const std::string& name, size_t stageIndex) const;
+
+public:
+  PipelineGraphGroup(Ptr<Options> options, Ptr<IMPIWrapper> mpi);
+
+  void setScheduler(Ptr<Scheduler> scheduler) override;
+
+  void update(Ptr<data::Batch> batch) override {
+    validate();
+    execute(batch);
+  }
+
+  void load() override;
+  void save(bool isFinal = false) override;
+
+  Ptr<data::BatchStats> collectStats(const std::vector<Ptr<Vocab>>& vocabs);
+};
+
+}  // namespace marian
@@ -24,7 +24,7 @@ void SingletonGraph::execute(Ptr<data::Batch> batch) {
       graphAvg_ = New<ExpressionGraph>();
       graphAvg_->setDevice(graph_->getDeviceId());
       graphAvg_->copyParams(graph_);
-    } else {
+    } else if(smoothingDue(scheduler_->numberOfBatches())) {
       updateAvgParams(graphAvg_->params()->vals(),
                       graph_->params()->vals(),
                       scheduler_->numberOfBatches());
@@ -35,6 +35,7 @@ public:
     graph_ = New<ExpressionGraph>();
     graph_->setDevice(deviceId);
     graph_->setCheckpointing(options_->get<bool>("gradient-checkpointing"));
+    graph_->setCheckpointingBudget(options_->get<size_t>("gradient-checkpointing-budget"));
     graph_->reserveWorkspaceMB(options_->get<size_t>("workspace"));
     opt_ = Optimizer(options_);
     builder_ = models::createCriterionFunctionFromOptions(options_, models::usage::training);
@@ -2,6 +2,15 @@
 
 namespace marian {
 
+// --elastic: keeps the number of devices that the updates are sized for in the training state
+class ElasticDevices : public TrainingObserver {
+  size_t devices_;
+public:
+  ElasticDevices(size_t devices) : devices_(devices) {}
+  void init(TrainingState& state) override { state.elasticDevices = devices_; }
+  void actAfterLoaded(TrainingState& state) override { state.elasticDevices = devices_; }
+};
+
 SyncGraphGroup::SyncGraphGroup(Ptr<Options> config, Ptr<IMPIWrapper> mpi)
     : GraphGroup(config), ExponentialSmoothing(config),
       delay_{options_->get<double>("optimizer-delay")}, mpi_(mpi) { // @TODO: rename delay_ to something else; delay means delayed updated, not accumulation
@@ -11,6 +20,7 @@ SyncGraphGroup::SyncGraphGroup(Ptr<Options> config, Ptr<IMPIWrapper> mpi)
     auto graph = New<ExpressionGraph>();
     graph->setDevice(device);
     graph->setCheckpointing(options_->get<bool>("gradient-checkpointing"));
+    graph->setCheckpointingBudget(options_->get<size_t>("gradient-checkpointing-budget"));
     graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
 
     graphs_.push_back(graph);
@@ -18,10 +28,61 @@ SyncGraphGroup::SyncGraphGroup(Ptr<Options> config, Ptr<IMPIWrapper> mpi)
     builders_.push_back(models::createCriterionFunctionFromOptions(options_, models::usage::training));
   }
 
+  localSgdSteps_ = std::max((size_t)1, options_->get<size_t>("local-sgd-steps", 1));
+  if(localSgd() && mpi_->numMPIProcesses() == 1) {
+    LOG(info, "[training] --local-sgd-steps needs several MPI processes, updating with all gradients");
+    localSgdSteps_ = 1;
+  }
+  if(localSgd()) {
+    localSgdMomentum_ = options_->get<float>("local-sgd-momentum", 0.f);
+    localSgdAverageOptimizer_ = options_->get<bool>("local-sgd-average-optimizer", false);
+    LOG(info, "[training] Local SGD: averaging the models of {} processes every {} updates{}",
+        mpi_->numMPIProcesses(), localSgdSteps_,
+        localSgdMomentum_ > 0.f ? " with outer momentum " + std::to_string(localSgdMomentum_) : "");
+  }
+
   // Note: We may well end up with only one MPI process or only one graph per worker.
   // This part of the code will not special-case any of this here.
   // Rather, it is assumed that the communicator knows to reduce unnecessary transfers to no-ops.
-  comm_ = createCommunicator(graphs_, /*noNccl=*/options_->get<bool>("no-nccl", false), /*mpi=*/mpi_);
+  // With local SGD, the gradients are only reduced among the devices of this process.
+  comm_ = createCommunicator(graphs_,
+                             /*noNccl=*/options_->get<bool>("no-nccl", false),
+                             /*mpi=*/localSgd() ? nullptr : mpi_,
+                             /*hierarchical=*/options_->get<bool>("nccl-hierarchical", false),
+                             /*compression=*/options_->get<std::string>("gradient-compression", "none"),
+                             /*pinThreads=*/options_->get<bool>("cpu-pin-threads", false),
+                             /*dropRate=*/options_->get<float>("gradient-dropping-rate", 0.99f));
+
+  if(options_->get<bool>("async-save", false))
+    checkpointWriter_ = New<AsyncCheckpointWriter>();
+
+  avgOnCpu_ = mvAvg_ && options_->get<bool>("exponential-smoothing-on-cpu", false);
+
+  overlapReduction_ = options_->get<bool>("overlap-gradient-reduction", false);
+  if(overlapReduction_ && !comm_->canOverlapScatterReduce()) {
+    LOG(warn, "[training] --overlap-gradient-reduction needs flat, uncompressed NCCL communication, gradients are reduced after the backward pass");
+    overlapReduction_ = false;
+  }
+
+  // --elastic: a checkpoint may be resumed with fewer or more devices than it was trained with, e.g. after
+  // preemptible nodes were lost. Each update still covers the data of the first run's number of devices,
+  // with a larger or smaller --optimizer-delay, so that training continues with the same batch size.
+  if(options_->get<bool>("elastic", false)) {
+    size_t devices = devices_.size() * mpi_->numMPIProcesses();
+    size_t elasticDevices = devices;
+    auto progressPath = options_->get<std::string>("model") + ".progress.yml";
+    if(!options_->get<bool>("no-reload") && filesystem::exists(progressPath)) {
+      TrainingState recorded(0.f);
+      recorded.load(progressPath);
+      if(recorded.elasticDevices > 0)
+        elasticDevices = recorded.elasticDevices;
+    }
+    if(elasticDevices != devices) {
+      delay_ *= (double)elasticDevices / (double)devices;
+      LOG(info, "[training] Resuming training of {} devices on {} devices, --optimizer-delay is now {}", elasticDevices, devices, delay_);
+    }
+    elasticObserver_ = New<ElasticDevices>(elasticDevices);
+  }
 
   auto formattedDeviceType = utils::utf8ToUpper(devices_.front().typeAsString()) + "s";
   if (mpi_->numMPIProcesses() > 1)
@@ -39,6 +100,9 @@ void SyncGraphGroup::setScheduler(Ptr<Scheduler> scheduler) /*override*/ {
 
   for(auto opt : shardOpt_)
     scheduler_->registerTrainingObserver(opt);
+
+  if(elasticObserver_)
+    scheduler_->registerTrainingObserver(elasticObserver_);
 }
 
 void SyncGraphGroup::initialize(const Ptr<data::Batch>& exampleBatch) {
@@ -59,6 +123,73 @@ void SyncGraphGroup::initialize(const Ptr<data::Batch>& exampleBatch) {
   });
 }
 
+void SyncGraphGroup::initializeGradientBuckets() {
+  // one bucket spans at least this many gradients, without splitting parameters
+  size_t bucketSize = options_->get<size_t>("gradient-bucket-mb", 25) * 1024 * 1024 / sizeof(float);
+  bucketSize = std::max(bucketSize, (size_t)1);
+
+  gradientBuckets_.resize(graphs_.size());
+  for(size_t i = 0; i < graphs_.size(); ++i) {
+    auto grads = graphs_[i]->params()->grads();
+    const float* data = grads->data();
+
+    // parameters by offset of their gradients
+    std::vector<std::pair<size_t, std::string>> offsets;
+    for(auto& kv : graphs_[i]->params()->getMap())
+      offsets.emplace_back((size_t)(kv.second->grad()->data() - data), kv.first);
+    std::sort(offsets.begin(), offsets.end());
+
+    auto& buckets = gradientBuckets_[i];
+    buckets.begins.push_back(0);
+    buckets.params.push_back(0);
+    for(const auto& offset : offsets) {
+      if(buckets.params.back() > 0 && offset.first - buckets.begins.back() >= bucketSize) {
+        buckets.ends.push_back(offset.first);
+        buckets.begins.push_back(offset.first);
+        buckets.params.push_back(0);
+      }
+      buckets.bucketOf[offset.second] = buckets.params.size() - 1;
+      buckets.params.back()++;
+    }
+    buckets.ends.push_back(grads->size()); // the last bucket includes the padding at the end
+  }
+
+  LOG(info, "[training] Reducing gradients in {} buckets during the backward pass",
+      gradientBuckets_.front().begins.size());
+}
+
+void SyncGraphGroup::startGradientBuckets(size_t localDeviceIndex) {
+  auto& buckets = gradientBuckets_[localDeviceIndex];
+  buckets.pending = buckets.params;
+  buckets.started = buckets.params.size();
+  graphs_[localDeviceIndex]->setGradientReadyCallback([this, localDeviceIndex](Expr param) {
+    gradientReady(localDeviceIndex, param);
+  });
+}
+
+void SyncGraphGroup::gradientReady(size_t localDeviceIndex, Expr param) {
+  auto& buckets = gradientBuckets_[localDeviceIndex];
+  auto it = buckets.bucketOf.find(param->name());
+  if(it == buckets.bucketOf.end()) // e.g. not of the element type of params()
+    return;
+
+  buckets.pending[it->second]--;
+  while(buckets.started > 0 && buckets.pending[buckets.started - 1] == 0) {
+    buckets.started--;
+    comm_->scatterReduceRangeAsync(localDeviceIndex, buckets.begins[buckets.started], buckets.ends[buckets.started]);
+  }
+}
+
+void SyncGraphGroup::finishGradientBuckets(size_t localDeviceIndex) {
+  // buckets with parameters that the backward pass did not reach, e.g. unused embeddings
+  auto& buckets = gradientBuckets_[localDeviceIndex];
+  while(buckets.started > 0) {
+    buckets.started--;
+    comm_->scatterReduceRangeAsync(localDeviceIndex, buckets.begins[buckets.started], buckets.ends[buckets.started]);
+  }
+  graphs_[localDeviceIndex]->setGradientReadyCallback(nullptr);
+}
+
 void SyncGraphGroup::initializeAvg() {
   Ptr<ExpressionGraph> graphAvg; // CPU-side temp
   std::string name = options_->get<std::string>("model");
@@ -81,15 +212,18 @@ void SyncGraphGroup::initializeAvg() {
   auto init = [&](size_t localDeviceIndex, size_t begin, size_t end) {
     size_t size = end-begin;
 
-    // get the device-specific allocator
-    auto paramsAllocator = New<TensorAllocator>(graphs_[localDeviceIndex]->getBackend());
+    // get the device-specific allocator, or one in CPU memory for --exponential-smoothing-on-cpu
+    auto backend = avgOnCpu_ ? BackendByDeviceId({0, DeviceType::cpu}, Config::seed) : graphs_[localDeviceIndex]->getBackend();
+    auto paramsAllocator = New<TensorAllocator>(backend);
     paramsAllocs_[localDeviceIndex] = paramsAllocator;
 
-    paramsAllocator->reserveExact(size * sizeof(float));
+    paramsAllocator->reserveExact((avgOnCpu_ ? 2 : 1) * size * sizeof(float));
 
     Tensor paramAvg;
     paramsAllocator->allocate(paramAvg, {1, (int)size});
     paramsAvg_[localDeviceIndex] = paramAvg;
+    if(avgOnCpu_)
+      paramsAllocator->allocate(paramsAvgStaging_[localDeviceIndex], {1, (int)size});
 
     if(graphAvg)
       paramAvg->copyFrom(graphAvg  ->params()->vals()->subtensor(begin, size));
@@ -102,9 +236,83 @@ void SyncGraphGroup::initializeAvg() {
 
   paramsAllocs_.resize(graphs_.size()); // allocators
   paramsAvg_.resize(graphs_.size());    // averaged parameters (shards; distributed over MPI processes if applicable)
+  if(avgOnCpu_) {
+    paramsAvgStaging_.resize(graphs_.size());
+    avgPending_.resize(graphs_.size());
+    avgThreads_ = New<ThreadPool>(graphs_.size());
+  }
   comm_->foreach(init, /*parallel=*/false); // @TODO: is sequential operation necessary here? (is the allocation stuff sufficiently reentrant or thread-separated?)
 }
 
+// Copies the updated shard to CPU memory and averages it there in the background. The copy waits for the
+// averaging of the previous time, which has had all updates since to finish.
+void SyncGraphGroup::smoothOnCpu(size_t localDeviceIndex, Tensor params, float decay) {
+  auto& pending = avgPending_[localDeviceIndex];
+  if(pending.valid())
+    pending.get();
+
+  auto paramAvg = paramsAvg_[localDeviceIndex];
+  auto staging = paramsAvgStaging_[localDeviceIndex];
+  staging->copyFrom(params);
+  pending = avgThreads_->enqueue([paramAvg, staging, decay]() {
+    using namespace functional;
+    Element(_1 = ((1.f - decay) * _1) + (decay * _2), paramAvg, staging);
+  });
+}
+
+void SyncGraphGroup::waitForAvg() {
+  for(auto& pending : avgPending_)
+    if(pending.valid())
+      pending.get();
+}
+
+// Averages the parameter shards, and with --local-sgd-average-optimizer the optimizer state, of all processes
+// in host memory. With --local-sgd-momentum m, the average is the target of an outer momentum step from the
+// parameters after the last averaging (the anchor), v = m * v + (anchor - average), anchor -= v. MPI is only
+// called from this thread. The first call, before the first update, makes the initial models identical.
+void SyncGraphGroup::averageModels() {
+  tracing::Span span("training", "averageModels");
+  float scale = 1.f / mpi_->numMPIProcesses();
+  std::vector<float> values;
+  auto average = [&](Tensor tensor) {
+    ABORT_IF(tensor->type() != Type::float32, "Local SGD only averages float32 tensors, not {}", tensor->type());
+    tensor->get(values);
+    mpi_->allReduce(values.data(), values.data(), values.size(), MPI_FLOAT, MPI_SUM);
+    for(auto& value : values)
+      value *= scale;
+  };
+
+  bool first = localSgdAnchors_.empty();
+  localSgdAnchors_.resize(devices_.size());
+  localSgdVelocities_.resize(devices_.size());
+  comm_->foreach([&](size_t idx, size_t begin, size_t end) {
+    auto params = graphs_[idx]->params()->vals()->subtensor(begin, end - begin);
+    average(params);
+    auto& anchor = localSgdAnchors_[idx];
+    auto& velocity = localSgdVelocities_[idx];
+    if(localSgdMomentum_ > 0.f && !first) {
+      for(size_t i = 0; i < values.size(); ++i) {
+        velocity[i] = localSgdMomentum_ * velocity[i] + (anchor[i] - values[i]);
+        anchor[i] -= velocity[i];
+      }
+      values = anchor;
+    } else if(localSgdMomentum_ > 0.f) {
+      anchor = values;
+      velocity.assign(values.size(), 0.f);
+    }
+    params->set(values);
+
+    if(localSgdAverageOptimizer_) {
+      for(auto state : shardOpt_[idx]->stateTensors()) {
+        average(state);
+        state->set(values);
+      }
+    }
+  }, /*parallel=*/false);
+  comm_->allGatherParams();
+  localSgdUpdates_ = 0;
+}
+
 Ptr<data::BatchStats> SyncGraphGroup::collectStats(const std::vector<Ptr<Vocab>>& vocabs) {
   // This function determines the granularity in which the reader provides data.
   // If no mini-batch-fit, then user provides a constant number. It reads that much. We won't get into this function.
@@ -306,6 +514,8 @@ void SyncGraphGroup::update(std::vector<Ptr<data::Batch>> subBatches, size_t num
     LOG(info, "[training] Batches are processed as {} process(es) x {} devices/process",
         mpi_->numMPIProcesses(), devices_.size());
     initialize(subBatches.front());
+    if(overlapReduction_)
+      initializeGradientBuckets();
     if(mvAvg_ && paramsAvg_.empty())
       initializeAvg();
  
@@ -316,13 +526,46 @@ void SyncGraphGroup::update(std::vector<Ptr<data::Batch>> subBatches, size_t num
       comm_->foreach(quantizeModel);
     }
 
+    if(localSgd())
+      averageModels();
+
     first_ = false;
   }
 
+  // --disp-time-breakdown: times fn() as the given phase of the update, including the work it queued on the
+  // devices of the given graphs
+  using Phase = Scheduler::UpdatePhase;
+  bool timing = scheduler_ && scheduler_->timingPhases();
+  auto timed = [&](Phase phase, const std::vector<Ptr<ExpressionGraph>>& graphs, const std::function<void()>& fn) {
+    if(!timing)
+      return fn();
+    timer::Timer timer;
+    fn();
+    for(const auto& graph : graphs)
+      graph->getBackend()->synchronize();
+    scheduler_->addPhaseTime(phase, timer.elapsed());
+  };
+
+  // with local SGD, the update of this process only sums the labels of its own sub-batches
+  size_t localTrgWords = 0;
+  if(localSgd())
+    for(size_t warp = 0; getSubBatch(warp, 0, mpi_->myMPIRank()); warp++)
+      for(size_t localDeviceIndex = 0; localDeviceIndex < devices_.size(); localDeviceIndex++)
+        if(auto subBatch = getSubBatch(warp, localDeviceIndex, mpi_->myMPIRank()))
+          localTrgWords += subBatch->wordsTrg();
+
   // Compute gradients
   std::vector<StaticLoss> localDeviceLosses(devices_.size()); // [local device index] aggregate cost for each local device
+  std::vector<char> localDeviceOverflows(devices_.size(), 0); // [local device index] a loss was not finite, see below
   comm_->foreach([&](size_t localDeviceIndex, size_t /*begin*/, size_t /*end*/) { // parallel across devices. Aggregate for warp > 1.
     auto graph = graphs_[localDeviceIndex];
+    // the devices run in parallel, the phases are timed on the first one
+    auto timedOnDevice = [&](Phase phase, const std::function<void()>& fn) {
+      if(localDeviceIndex == 0)
+        timed(phase, {graph}, fn);
+      else
+        fn();
+    };
     // reset gradient  --presently done outside
     //graph->params()->allocateBackward();
     //graph->params()->set_zero_adjoint();
@@ -333,16 +576,45 @@ void SyncGraphGroup::update(std::vector<Ptr<data::Batch>> subBatches, size_t num
       if (!subBatch)
         break;
 
-      auto rationalLoss = builders_[localDeviceIndex]->build(graph, subBatch);
-      graph->forward();
+      Ptr<RationalLoss> rationalLoss;
+      timedOnDevice(Phase::build, [&]() { rationalLoss = builders_[localDeviceIndex]->build(graph, subBatch); });
+      timedOnDevice(Phase::forward, [&]() { graph->forward(); });
+
+      StaticLoss subBatchLoss = *rationalLoss;
+      localDeviceLosses[localDeviceIndex] += subBatchLoss;
+
+      // This update is skipped anyway, so do not spend a backward pass on it. The loss is known after the
+      // forward pass already, which makes it the cheapest overflow check: a single value instead of a pass
+      // over the gradients.
+      if(!std::isfinite(subBatchLoss.loss)) {
+        localDeviceOverflows[localDeviceIndex] = 1;
+        break;
+      }
 
-      localDeviceLosses[localDeviceIndex] += *rationalLoss;
-      graph->backward(/*zero=*/false); // (gradients are reset before we get here)
+      // the last backward pass of this device completes the gradients, reduce them meanwhile
+      bool lastWarp = !getSubBatch(warp + 1, localDeviceIndex, mpi_->myMPIRank());
+      if(overlapReduction_ && lastWarp)
+        startGradientBuckets(localDeviceIndex);
+      timedOnDevice(Phase::backward, [&]() {
+        graph->backward(/*zero=*/false); // (gradients are reset before we get here)
+      });
+      if(overlapReduction_ && lastWarp)
+        finishGradientBuckets(localDeviceIndex);
+    }
+    // devices without a sub-batch, or that stopped at an overflow, take part in the reduction, which is discarded then
+    if(overlapReduction_ && (localDeviceOverflows[localDeviceIndex] || !getSubBatch(0, localDeviceIndex, mpi_->myMPIRank()))) {
+      startGradientBuckets(localDeviceIndex);
+      finishGradientBuckets(localDeviceIndex);
     }
   });
   // At this point, each device on each MPI process has a gradient aggregated over a subset of the sub-batches.
+  if(overlapReduction_)
+    timed(Phase::communication, graphs_, [&]() {
+      comm_->finishScatterReduceAndResetGrads(); // wait for the reductions started during the backward pass
+    });
 
   // Update parameter shard with gradient shard
+  double smoothingSeconds = 0; // --exponential-smoothing-on-cpu: time of the first shard, fused with the update otherwise
   auto update = [&](size_t idx, size_t begin, size_t end) {
     auto curGrad = graphs_[idx]->params()->grads()->subtensor(begin, end-begin);
     auto curParam = graphs_[idx]->params()->vals()->subtensor(begin, end-begin);
@@ -350,39 +622,88 @@ void SyncGraphGroup::update(std::vector<Ptr<data::Batch>> subBatches, size_t num
     // actual model update
     auto updateTrgWords =
         /*if*/(options_->get<std::string>("cost-type") == "ce-sum") ?
-          batchTrgWords // total number of labels across all GPUs and nodes
+          (localSgd() ? localTrgWords : batchTrgWords) // total number of labels across all GPUs (and nodes)
         /*else*/:
           OptimizerBase::mbSizeNotProvided;
-    shardOpt_[idx]->update(curParam, curGrad, updateTrgWords);
+    bool smooth = mvAvg_ && smoothingDue(scheduler_->numberOfBatches());
+    if(smooth && !avgOnCpu_) // with Adam, the smoothing is done in the same pass over the memory as the update
+      shardOpt_[idx]->updateAndSmooth(curParam, curGrad, paramsAvg_[idx],
+                                      avgDecay(scheduler_->numberOfBatches(), updateTrgWords), updateTrgWords);
+    else
+      shardOpt_[idx]->update(curParam, curGrad, updateTrgWords);
+    if(smooth && avgOnCpu_) {
+      timer::Timer timer;
+      smoothOnCpu(idx, curParam, avgDecay(scheduler_->numberOfBatches(), updateTrgWords));
+      if(idx == 0)
+        smoothingSeconds = timer.elapsed();
+    }
     curGrad->set(0.f);
-
-    if(mvAvg_)
-      updateAvgParams(
-          paramsAvg_[idx], curParam, scheduler_->numberOfBatches(), updateTrgWords);
   };
 
   // cost across all local devices (scheduler will aggregate cross-process)
   StaticLoss localLoss = std::accumulate(localDeviceLosses.begin(), localDeviceLosses.end(), StaticLoss());
   
+  // Skip the update if any device of any process saw a NaN or Inf loss. All processes have to agree, since the
+  // reduction and gathering below are collective.
+  float overflows = (float)std::accumulate(localDeviceOverflows.begin(), localDeviceOverflows.end(), 0);
+  if(mpi_->numMPIProcesses() > 1)
+    mpi_->allReduce(&overflows, &overflows, 1, MPI_FLOAT, MPI_SUM);
+
   // model update
-  if (std::isfinite(localLoss.loss) || mpi_->numMPIProcesses() > 1) { // guard against NaN (except with MPI, as this simple way could hang it)
-    comm_->scatterReduceAndResetGrads(); // reduce gradients across all devices and MPI nodes into shards
-    comm_->foreach(update);              // per-shard model-update
-    comm_->allGatherParams();            // distribute param value shards back
+  if(overflows == 0) {
+    if(!overlapReduction_)
+      timed(Phase::communication, graphs_, [&]() {
+        comm_->scatterReduceAndResetGrads(); // reduce gradients across all devices and MPI nodes into shards
+      });
+    timed(Phase::optimizer, graphs_, [&]() {
+      comm_->foreach(update);              // per-shard model-update
+    });
+    timed(Phase::communication, graphs_, [&]() {
+      comm_->allGatherParams();            // distribute param value shards back
+    });
   
+    // local SGD: the models of the processes are averaged every localSgdSteps_ updates
+    if(localSgd() && ++localSgdUpdates_ == localSgdSteps_)
+      timed(Phase::communication, graphs_, [&]() { averageModels(); });
+
+    // the smoothing on the CPU is part of the time of the update above
+    if(timing && smoothingSeconds > 0) {
+      scheduler_->addPhaseTime(Phase::optimizer, -smoothingSeconds);
+      scheduler_->addPhaseTime(Phase::smoothing, smoothingSeconds);
+    }
+
     // Re-add the error residual from previous quantization,
     // then re-quantize the model back and update the error residual
     if (options_->get<size_t>("quantize-bits") > 0)
       comm_->foreach(quantizeModel);
   }
-  else
-    LOG(info, "[training] skipping {}-th update due to loss being {}", scheduler_->numberOfBatches(), localLoss.loss);
+  else {
+    LOG(info, "[training] skipping {}-th update due to a loss of {} on {} device(s)",
+        scheduler_->numberOfBatches(), localLoss.loss, overflows);
+    // the reduced gradient shards would otherwise be added to the next step
+    if(overlapReduction_)
+      comm_->foreach([&](size_t idx, size_t /*begin*/, size_t /*end*/) { graphs_[idx]->params()->grads()->set(0.f); });
+  }
 
   if(scheduler_) {
+    // about 6 operations per parameter and label for the forward and backward pass, and the largest workspace
+    if(timing) {
+      size_t highWater = 0;
+      for(const auto& graph : graphs_) {
+        highWater = std::max(highWater, graph->getWorkspaceHighWater());
+        graph->resetWorkspaceHighWater();
+      }
+      scheduler_->addUpdateCost(6.0 * graphs_[0]->params()->vals()->size() * batchTrgWords, highWater);
+    }
+
     // track and log localLoss
     scheduler_->update(localLoss, numReadBatches, batchSize, batchTrgWords, mpi_);
 
     // save intermediate model (and optimizer state) to file
+    // the main process saves and validates its model, which are all the same after averaging
+    if(localSgd() && localSgdUpdates_ > 0 && (scheduler_->saving() || scheduler_->validating()))
+      averageModels();
+
     if(scheduler_->saving())
       save();
 
@@ -427,10 +748,18 @@ void SyncGraphGroup::load() /*override*/ {
       std::vector<Ptr<Backend>> backends;
       for(auto graph : graphs_)
         backends.push_back(graph->getBackend());
-      shardOpt_[0]->load(name + ".optimizer.npz", shardOpt_, backends, // keep npz suffix for optimize checkpoint
-        [&](const std::vector<float>& optimizerStateVector, const OptimizerBase::ScatterStateSetFunc& setShardFn) {
-          comm_->scatterState(optimizerStateVector, setShardFn);
-        });
+      auto shardName = shardedOptimizerStateName(name);
+      if(options_->get<bool>("sharded-optimizer-state", false) && filesystem::exists(shardName)) {
+        shardOpt_[0]->load(shardName, shardOpt_, backends,
+          [&](const std::vector<float>& optimizerStateVector, const OptimizerBase::ScatterStateSetFunc& setShardFn) {
+            comm_->scatterLocalState(optimizerStateVector, setShardFn);
+          });
+      } else {
+        shardOpt_[0]->load(name + ".optimizer.npz", shardOpt_, backends, // keep npz suffix for optimize checkpoint
+          [&](const std::vector<float>& optimizerStateVector, const OptimizerBase::ScatterStateSetFunc& setShardFn) {
+            comm_->scatterState(optimizerStateVector, setShardFn);
+          });
+      }
       LOG(info, "[training] Model reloaded from {}", name);
     } else if(options_->hasAndNotEmpty("pretrained-model")) {
       std::string nameInit = options_->get<std::string>("pretrained-model");
@@ -466,6 +795,16 @@ void SyncGraphGroup::save(bool final) /*override*/ {
   std::string suffix = name.substr(name.size() - 4);
   ABORT_IF(suffix != ".npz" && suffix != ".bin", "Unknown model suffix {}", suffix);
 
+  // --async-save: the files are collected in CPU memory until the end of this function and written in the
+  // background. A final model is written right away, after the last checkpoint so that it is not replaced.
+  Ptr<io::DeferredSaveItems> deferredSave;
+  std::vector<std::pair<std::string, std::string>> deferredSchedulerFiles;
+  if(checkpointWriter_) {
+    checkpointWriter_->wait();
+    if(!final)
+      deferredSave = checkpointWriter_->collect();
+  }
+
   barrier(); // (for better grouping of log messages)
   // if smoothing then save original (unsmoothed) parameters as well
   if(mvAvg_ && paramsAvg_.size() > 0 && isMainProcess()) // only save from one MPI process
@@ -490,7 +829,9 @@ void SyncGraphGroup::save(bool final) /*override*/ {
     // save main model file
     builders_[0]->save(graphs_[0], name, true);
     // save scheduler-related state
-    if (scheduler_)
+    if (scheduler_ && deferredSave)
+      deferredSchedulerFiles = scheduler_->serialize(name); // written last, see AsyncCheckpointWriter
+    else if (scheduler_)
       scheduler_->save(name);
   }
 
@@ -500,17 +841,35 @@ void SyncGraphGroup::save(bool final) /*override*/ {
   barrier(); // (for better grouping of log messages)
 
   // persist optimizer state
-  shardOpt_[0]->save(name + ".optimizer.npz", shardOpt_,
-    [&](const OptimizerBase::GatherStateGetFunc& getShardFn) {
-      return comm_->gatherState(getShardFn);
-    },
-    isMainProcess());
+  if(options_->get<bool>("sharded-optimizer-state", false)) {
+    // every process writes its own shards at the same time, nothing is sent to the main process
+    shardOpt_[0]->save(shardedOptimizerStateName(name), shardOpt_,
+      [&](const OptimizerBase::GatherStateGetFunc& getShardFn) {
+        return comm_->gatherLocalState(getShardFn);
+      });
+  } else {
+    shardOpt_[0]->save(name + ".optimizer.npz", shardOpt_,
+      [&](const OptimizerBase::GatherStateGetFunc& getShardFn) {
+        return comm_->gatherState(getShardFn);
+      },
+      isMainProcess());
+  }
+
+  if(deferredSave) {
+    for(const auto& file : deferredSchedulerFiles)
+      checkpointWriter_->addText(file.first, file.second);
+    deferredSave.reset();
+    checkpointWriter_->write();
+  }
 
   barrier(); // (for better grouping of log messages)
 }
 
 void SyncGraphGroup::finalize() /*override*/ {
   validate();
+  if(checkpointWriter_)
+    checkpointWriter_->wait();
+  waitForAvg();
   Base::finalize();
 }
 
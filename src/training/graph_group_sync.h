@@ -2,6 +2,7 @@
 
 #include "optimizers/quantizer.h"
 #include "training/graph_group.h"
+#include "training/checkpoint_writer.h"
 #include "training/communicator.h"
 #include "training/exponential_smoothing.h"
 
@@ -9,7 +10,8 @@ namespace marian {
 
 class SyncGraphGroup : public GraphGroup, public ExponentialSmoothing {
   using Base = GraphGroup;
-  const double delay_{1.}; // optimizer-delay parameter. Fractional means to use a fraction of whatever the MB size is
+  double delay_{1.}; // optimizer-delay parameter. Fractional means to use a fraction of whatever the MB size is; rescaled by --elastic
+  Ptr<TrainingObserver> elasticObserver_; // --elastic: records the number of devices the updates are sized for
 
   Ptr<ICommunicator> comm_; // [not null] communicator, e.g. NCCLCommunicator
   Ptr<IMPIWrapper> mpi_;    // [not null] all MPI-like communication goes through this (this is a dummy implementation if no MPI run)
@@ -24,9 +26,52 @@ class SyncGraphGroup : public GraphGroup, public ExponentialSmoothing {
   std::vector<Ptr<TensorAllocator>> paramsAllocs_; // [deviceIndex] we must hold a reference to the memory until this class dies
   // @TODO: move this nto ExponentialSmoothing, together with paramsAvg_?
 
+  // --exponential-smoothing-on-cpu: paramsAvg_ lives in CPU memory. On the updates that smooth, the shards are
+  // copied to paramsAvgStaging_ and averaged on avgThreads_ while training goes on.
+  bool avgOnCpu_{false};
+  std::vector<Tensor> paramsAvgStaging_;       // [deviceIndex] the updated parameters, in CPU memory
+  std::vector<std::future<void>> avgPending_;  // [deviceIndex] averaging in progress
+  Ptr<ThreadPool> avgThreads_;
+
+  void smoothOnCpu(size_t localDeviceIndex, Tensor params, float decay);
+  void waitForAvg();
+
   // model quantizer
   std::vector<Ptr<ModelQuantizer>> quantizers_;
   
+  // --overlap-gradient-reduction: the gradient buffer is split into buckets of consecutive parameters, which
+  // are reduced while the backward pass of the last sub-batch goes on. Buckets are started from the last to
+  // the first, each once the gradients of it and all buckets after it are complete, so that all devices
+  // start them in the same order.
+  struct GradientBuckets {
+    std::vector<size_t> begins, ends;                 // [bucket] range in the gradient buffer
+    std::vector<size_t> params;                       // [bucket] number of parameters
+    std::unordered_map<std::string, size_t> bucketOf; // parameter name -> bucket
+    std::vector<size_t> pending;                      // [bucket] parameters with incomplete gradients in this step
+    size_t started{0};                                // buckets [started, size) have been started
+  };
+  bool overlapReduction_{false};
+  std::vector<GradientBuckets> gradientBuckets_; // [deviceIndex]
+
+  void initializeGradientBuckets();
+  void startGradientBuckets(size_t localDeviceIndex);
+  void gradientReady(size_t localDeviceIndex, Expr param);
+  void finishGradientBuckets(size_t localDeviceIndex);
+
+  Ptr<AsyncCheckpointWriter> checkpointWriter_; // --async-save, null otherwise
+
+  // --local-sgd-steps: with several MPI processes, each process updates its own copy of the model with the
+  // gradients of its devices, and the copies are averaged over MPI every localSgdSteps_ updates, see
+  // averageModels(). The communicator only covers the devices of this process then.
+  size_t localSgdSteps_{1};
+  size_t localSgdUpdates_{0};            // updates since the last averaging
+  float localSgdMomentum_{0.f};          // --local-sgd-momentum, 0 replaces the copies by their average
+  bool localSgdAverageOptimizer_{false}; // --local-sgd-average-optimizer
+  std::vector<std::vector<float>> localSgdAnchors_;    // [deviceIndex] the parameter shard after the last averaging
+  std::vector<std::vector<float>> localSgdVelocities_; // [deviceIndex] the outer momentum of the shard
+  bool localSgd() const { return localSgdSteps_ > 1; }
+  void averageModels();
+
   // state for update()
   bool first_{ true };                           // gets interpreted and cleared by update()
   std::vector<Ptr<data::Batch>> pendingBatches_; // in case of dynamic MB-size scaling, we temporarly buffer up batches across update() calls until enough
@@ -36,8 +81,11 @@ class SyncGraphGroup : public GraphGroup, public ExponentialSmoothing {
   void initializeAvg();
 
   bool isMainProcess() const { return mpi_->myMPIRank() == 0; } // (we need this test a few times)
+  std::string shardedOptimizerStateName(const std::string& name) const { // --sharded-optimizer-state, memory-mappable
+    return name + ".optimizer." + std::to_string(mpi_->myMPIRank()) + "-of-" + std::to_string(mpi_->numMPIProcesses()) + ".bin";
+  }
   void barrier() const { mpi_->barrier(); } // (we need this several times)
-  void swapParamsAvg() { if (mvAvg_ && paramsAvg_.size() > 0) comm_->swapParams(paramsAvg_); } // note: must call this on all MPI ranks in parallel
+  void swapParamsAvg() { if (mvAvg_ && paramsAvg_.size() > 0) { waitForAvg(); comm_->swapParams(paramsAvg_); } } // note: must call this on all MPI ranks in parallel
 
   bool tryGetSubBatches(Ptr<data::Batch> newBatch, std::vector<Ptr<data::Batch>>& subBatches, size_t& numReadBatches);
   void update(std::vector<Ptr<data::Batch>> subBatches, size_t numReadBatches);
@@ -2,11 +2,15 @@
 
 #include "common/options.h"
 #include "common/signal_handling.h"
+#include "common/tracer.h"
 #include "training/training_state.h"
 #include "training/validator.h"
 #include "training/communicator.h"
 #include "layers/loss.h"
 
+#include <chrono>
+#include <future>
+
 namespace marian {
 
 class Scheduler : public TrainingObserver {
@@ -22,24 +26,107 @@ private:
   timer::Timer timer_;
   timer::Timer heartBeatTimer_;
 
+public:
+  // --disp-time-breakdown: the phases of an update whose times are reported in the progress log
+  enum class UpdatePhase : size_t { build, forward, backward, communication, optimizer, smoothing, count };
+
+private:
+  // --disp-time-breakdown: sums since the last display, not part of the training state
+  std::vector<double> phaseSecondsDisp_ = std::vector<double>((size_t)UpdatePhase::count, 0.0);
+  double flopsDisp_{0};               // estimated floating-point operations of the updates
+  size_t workspaceHighWaterDisp_{0};  // largest workspace used by an update, over all devices
+
   // The variable helps to keep track of the end of the current epoch
   // (regardless if it's the 1st or nth epoch and if it's a new or continued training),
   // which indicates the end of the training data stream from STDIN
   bool endOfStdin_{false};  // true at the end of the epoch if training from STDIN;
 
+  // The options consulted for every update, read and parsed once by the constructor
+  struct Settings {
+    float learnRate;
+    SchedulingParameter lrWarmup;
+    float lrWarmupStartRate;
+    bool lrWarmupAtReload;
+    bool lrWarmupCycle;
+    SchedulingParameter lrDecayInvSqrt;      // unset if --lr-decay-inv-sqrt is 0
+    size_t lrDecayInvSqrtStart;
+    float lrDecay;
+    std::string lrDecayStrategy;
+    std::vector<size_t> lrDecayStart;
+    size_t lrDecayFreq;
+    bool lrDecayResetOptimizer;
+    bool lrDecayRepeatWarmup;
+    bool lrReport;
+    std::string costType;
+    bool dispLabelCounts;
+    bool dispTimeBreakdown;
+    SchedulingParameter dispFreq;
+    size_t dispFirst;
+    SchedulingParameter validFreq;
+    SchedulingParameter saveFreq;
+    size_t afterEpochs;
+    size_t afterBatches;
+    std::vector<SchedulingParameter> after;
+    size_t earlyStopping;
+    SchedulingParameter miniBatchWarmup;
+    bool miniBatchTrackLr;
+
+    Settings(Ptr<Options> options) {
+      learnRate             = options->get<float>("learn-rate");
+      lrWarmup              = SchedulingParameter::parse(options->get<std::string>("lr-warmup"));
+      lrWarmupStartRate     = options->get<float>("lr-warmup-start-rate");
+      lrWarmupAtReload      = options->get<bool>("lr-warmup-at-reload");
+      lrWarmupCycle         = options->get<bool>("lr-warmup-cycle");
+
+      auto args = options->get<std::vector<std::string>>("lr-decay-inv-sqrt");
+      ABORT_IF(args.empty() || args.size() > 2, "--lr-decay-inv-sqrt argument must be one or two numbers with units");
+      lrDecayInvSqrt = SchedulingParameter::parse(args[0]);
+      lrDecayInvSqrtStart = lrDecayInvSqrt.n;
+      if(args.size() > 1) {
+        auto decayStart = SchedulingParameter::parse(args[1]);
+        ABORT_IF(decayStart && decayStart.unit != lrDecayInvSqrt.unit,
+                 "both --lr-decay-inv-sqrt arguments must have the same unit");
+        lrDecayInvSqrtStart = decayStart.n;
+      }
+
+      lrDecay               = options->get<float>("lr-decay");
+      lrDecayStrategy       = options->get<std::string>("lr-decay-strategy");
+      lrDecayStart          = options->get<std::vector<size_t>>("lr-decay-start");
+      lrDecayFreq           = options->get<size_t>("lr-decay-freq");
+      lrDecayResetOptimizer = options->get<bool>("lr-decay-reset-optimizer");
+      lrDecayRepeatWarmup   = options->get<bool>("lr-decay-repeat-warmup");
+      lrReport              = options->get<bool>("lr-report");
+      costType              = options->get<std::string>("cost-type");
+      dispLabelCounts       = options->get<bool>("disp-label-counts");
+      dispTimeBreakdown     = options->get<bool>("disp-time-breakdown", false);
+      dispFreq              = SchedulingParameter::parse(options->get<std::string>("disp-freq"));
+      dispFirst             = options->get<size_t>("disp-first");
+      validFreq             = SchedulingParameter::parse(options->get<std::string>("valid-freq"));
+      saveFreq              = SchedulingParameter::parse(options->get<std::string>("save-freq"));
+      afterEpochs           = options->get<size_t>("after-epochs");
+      afterBatches          = options->get<size_t>("after-batches");
+      for(const auto& criterion : utils::split(options->get<std::string>("after"), ","))
+        after.push_back(SchedulingParameter::parse(criterion));
+      earlyStopping         = options->get<size_t>("early-stopping");
+      miniBatchWarmup       = SchedulingParameter::parse(options->get<std::string>("mini-batch-warmup"));
+      miniBatchTrackLr      = options->get<bool>("mini-batch-track-lr");
+    }
+  } settings_;
+
+  // Validation in the background, see --valid-async. The validators always run on validGraphs_, which hold
+  // a copy of the parameters of the validated update. One validation runs at a time.
+  std::vector<Ptr<ExpressionGraph>> validGraphs_;
+  std::future<std::vector<float>> pendingValidation_; // [validator index] results of the running validation
+  std::vector<size_t> pendingStalledPrev_;             // [validator index] stalled counts before it
+  std::string pendingEpoch_;                           // logical epoch and update of it
+  size_t pendingBatches_{0};
+  ThreadPool validThreadPool_{1};                      // declared last, so that it finishes the validation first
+
   // determine scheduled LR decay factor (--lr-decay-inv-sqrt option)
   float getScheduledLRDecayFactor(const TrainingState& state) const {
-    auto args = options_->get<std::vector<std::string>>("lr-decay-inv-sqrt");
-    ABORT_IF(args.empty() || args.size() > 2, "--lr-decay-inv-sqrt argument must be one or two numbers with units");
-    auto decayGoogle = SchedulingParameter::parse(args[0]);
+    const auto& decayGoogle = settings_.lrDecayInvSqrt;
     size_t progress = state.getProgressIn(decayGoogle.unit);
-    size_t start = decayGoogle.n;
-    if (args.size() > 1) {
-      auto decayStart = SchedulingParameter::parse(args[1]);
-      ABORT_IF(decayStart && decayStart.unit != decayGoogle.unit,
-               "both --lr-decay-inv-sqrt arguments must have the same unit");
-      start = decayStart.n;
-    }
+    size_t start = settings_.lrDecayInvSqrtStart;
     if (decayGoogle && progress > start) {
       progress = progress - start + decayGoogle.n; // shift so that we get 1 at progress==start
       return (float)(std::sqrt((double)decayGoogle.n / (double)progress));
@@ -55,11 +142,11 @@ private:
   //  - scheduled LR decay (--lr-decay-inv-sqrt)
   //  - state-based LR decay (--lr-decay, --lr-decay-strategy)
   void updateLearningRate(TrainingState& state) const {
-    float baselr = options_->get<float>("learn-rate");
+    float baselr = settings_.learnRate;
 
     // warm-up factor
     float warmupFactor = 1.f;
-    auto warmupParam = SchedulingParameter::parse(options_->get<std::string>("lr-warmup"));
+    const auto& warmupParam = settings_.lrWarmup;
     if(warmupParam) {
       ABORT_IF(state.warmupStart && state.warmupStart.unit != warmupParam.unit,
                "lr-warmup and warmup-start must have the same unit");
@@ -68,7 +155,7 @@ private:
     }
 
     // TODO: why lr-warmup-start-rate is extracted from options_ instead of using state.warmupStart?
-    float lrStart = options_->get<float>("lr-warmup-start-rate");
+    float lrStart = settings_.lrWarmupStartRate;
     baselr = lrStart + (baselr - lrStart) * warmupFactor; // linear interpolation between
                                                           // lr-warmup-start-rate to learn-rate
 
@@ -127,6 +214,18 @@ private:
       ABORT("Unknown scheduling unit occurred in logical epoch"); // shouldn't really happen unless we add a new unit in the corresponding enum
   }
 
+  // --disp-time-breakdown: where the time since the last display went, the achieved TFLOPs and the peak workspace
+  std::string formatTimeBreakdown(double seconds) const {
+    static const char* names[] = {"build", "forward", "backward", "comm", "optimizer", "smoothing"};
+    std::string phases = fmt::format("data {:.2f}s", state_->dataWaitSecondsDisp);
+    for(size_t i = 0; i < phaseSecondsDisp_.size(); ++i)
+      phases += fmt::format(", {} {:.2f}s", names[i], phaseSecondsDisp_[i]);
+    return fmt::format(" : Phases {} : {:.2f} TFLOPs : Peak workspace {:.1f} MB",
+                       phases,
+                       seconds > 0 ? flopsDisp_ / seconds * 1e-12 : 0.0,
+                       workspaceHighWaterDisp_ / (1024.0 * 1024.0));
+  }
+
   // Formatting for logical epochs
   std::string formatLogicalEpoch() {
     return fmt::format("{:." + std::to_string(logicalEpochWidth_) + "f}", calculateLogicalEpoch());
@@ -134,7 +233,7 @@ private:
 
 public:
   Scheduler(Ptr<Options> options, Ptr<TrainingState> state)
-      : options_(options), state_(state) {
+      : options_(options), state_(state), settings_(options) {
 
     // parse logical-epoch parameters
     auto logicalEpochStr = options->get<std::vector<std::string>>("logical-epoch", {"1e", "0"});
@@ -157,18 +256,28 @@ public:
     updateLearningRate(*state);
   }
 
+  // --disp-time-breakdown: the graph groups time the phases of their updates only if this is true, since that
+  // synchronizes the devices after each phase
+  bool timingPhases() const { return settings_.dispTimeBreakdown; }
+
+  void addPhaseTime(UpdatePhase phase, double seconds) { phaseSecondsDisp_[(size_t)phase] += seconds; }
+
+  // The estimated floating-point operations of an update and the workspace it used, called before update()
+  void addUpdateCost(double flops, size_t workspaceHighWater) {
+    flopsDisp_ += flops;
+    workspaceHighWaterDisp_ = std::max(workspaceHighWaterDisp_, workspaceHighWater);
+  }
+
   // test if any parameters specify dynamic MB scaling
   bool isDynamicMBSizeScaling() const {
-    auto mbWarmup = SchedulingParameter::parse(options_->get<std::string>("mini-batch-warmup"));
-    auto mbTracking = options_->get<bool>("mini-batch-track-lr");
-    return mbWarmup || mbTracking;
+    return settings_.miniBatchWarmup || settings_.miniBatchTrackLr;
   }
 
   // determine dynamic MB scaling factor
   double getDynamicMBSizeMultiplier() const {
     double ratio = 1.0;
 
-    auto mbWarmup = SchedulingParameter::parse(options_->get<std::string>("mini-batch-warmup"));
+    const auto& mbWarmup = settings_.miniBatchWarmup;
     if (mbWarmup) {
       // mini-batch-warmup
       LOG_ONCE(info, "[scheduler] Mini-batch size warmup {}", std::string(mbWarmup));
@@ -184,8 +293,7 @@ public:
 
     // dynamic MB-size tracking with learning rate
     // As LR goes down, MB gets ramped up by the same ratio, which has been found to be safe.
-    auto mbTracking = options_->get<bool>("mini-batch-track-lr");
-    if (mbTracking) {
+    if (settings_.miniBatchTrackLr) {
       auto lrFactor = getScheduledLRDecayFactor(*state_) * state_->factor; // (don't include lr-warmup)
       if (lrFactor != 1)
         LOG_ONCE(info, "[scheduler] Dynamic mini-batch size adjustment enabled and kicking in");
@@ -200,21 +308,19 @@ public:
 
 #if 1  // @TODO: to be removed once we deprecate after-epochs and after-batches   
     // stop if it reached the maximum number of epochs
-    size_t stopAfterEpochs = options_->get<size_t>("after-epochs");
+    size_t stopAfterEpochs = settings_.afterEpochs;
     if(stopAfterEpochs > 0 && calculateLogicalEpoch() > stopAfterEpochs)
       return false;
 
     // stop if it reached the maximum number of batch updates
-    size_t stopAfterBatches = options_->get<size_t>("after-batches");
+    size_t stopAfterBatches = settings_.afterBatches;
     if(stopAfterBatches > 0 && state_->batches >= stopAfterBatches)
       return false;
 #endif
 
     // get list of stopping criteria e.g. "10e,300Ku,20Gt" (10 epochs, 300,000 updates, 20 billion target labels)
     // and stop for whatever criterion hits first.
-    std::vector<std::string> stoppingCriteria = utils::split(options_->get<std::string>("after"), ",");
-    for(auto stoppingCriterionString : stoppingCriteria) {
-      SchedulingParameter stoppingCriterion = SchedulingParameter::parse(stoppingCriterionString);
+    for(const auto& stoppingCriterion : settings_.after) {
       if(stoppingCriterion.n > 0) { // is any stopping criterion defined?
         if(stoppingCriterion.unit == SchedulingUnit::epochs    && calculateLogicalEpoch() >  stoppingCriterion.n) return false;
         if(stoppingCriterion.unit == SchedulingUnit::updates   && state_->batches         >= stoppingCriterion.n) return false;
@@ -223,7 +329,7 @@ public:
     }
 
     // stop if the first validator did not improve for a given number of checks
-    size_t stopAfterStalled = options_->get<size_t>("early-stopping");
+    size_t stopAfterStalled = settings_.earlyStopping;
     if(stopAfterStalled > 0 && !validators_.empty()
        && stalled() >= stopAfterStalled)
       return false;
@@ -246,6 +352,7 @@ public:
 
   void started() { LOG(info, "Training started"); }
   void finished() {
+    finishValidation(/*wait=*/true);
     if (saveAndExitRequested())
       LOG(info, "Training interrupted (via signal).");
     else
@@ -266,12 +373,12 @@ public:
 
   bool validating() {
     return (!validators_.empty()
-            && state_->enteredNewPeriodOf(options_->get<std::string>("valid-freq"))
+            && state_->enteredNewPeriodOf(settings_.validFreq)
             && keepGoing());
   }
 
   bool saving() {
-    return state_->enteredNewPeriodOf(options_->get<std::string>("save-freq"));
+    return state_->enteredNewPeriodOf(settings_.saveFreq);
   }
 
   void validate(const std::vector<Ptr<ExpressionGraph>>& graphs,
@@ -281,29 +388,117 @@ public:
     // was requested.
     if(saveAndExitRequested()
        || state_->validated // already validated (in resumed training, for example)
-       || (!state_->enteredNewPeriodOf(options_->get<std::string>("valid-freq")) && !isFinal)) // not now
+       || (!state_->enteredNewPeriodOf(settings_.validFreq) && !isFinal)) // not now
+      return;
+
+    if(options_->get<bool>("valid-async", false)) {
+      validateAsync(graphs, isFinal);
+      return;
+    }
+
+    std::vector<float> values(validators_.size());
+    std::vector<size_t> stalledPrev(validators_.size());
+    for(size_t i = 0; i < validators_.size(); ++i) {
+      if(!validators_[i])
+        continue;
+      stalledPrev[i] = validators_[i]->stalled();
+      tracing::Span span("validation", validators_[i]->type());
+      values[i] = validators_[i]->validate(graphs, state_);
+    }
+    reportValidation(values, stalledPrev, formatLogicalEpoch(), state_->batches);
+
+    state_->validated = true;
+  }
+
+  // Copies the parameters of graphs[0] to the validation graphs and starts validating them in the
+  // background; a final validation is waited for
+  void validateAsync(const std::vector<Ptr<ExpressionGraph>>& graphs, bool isFinal) {
+    finishValidation(/*wait=*/true);
+
+    timer::Timer timer;
+    std::vector<io::Item> items;
+    graphs[0]->save(items);
+    if(validGraphs_.empty()) {
+      auto deviceType = graphs[0]->getDeviceId().type;
+      auto deviceIds = options_->get<std::vector<size_t>>("valid-devices", {});
+      if(deviceIds.empty())
+        deviceIds.push_back(graphs[0]->getDeviceId().no);
+      for(auto id : deviceIds) {
+        auto graph = New<ExpressionGraph>(/*inference=*/true);
+        graph->setDevice({id, deviceType});
+        graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+        graph->load(items, /*markReloaded=*/false);
+        graph->forward(); // allocates and initializes the parameters
+        validGraphs_.push_back(graph);
+      }
+    } else {
+      for(auto graph : validGraphs_)
+        for(const auto& item : items)
+          if(auto param = graph->get(item.name)) // skips the special: items
+            param->val()->set(item);
+    }
+
+    pendingStalledPrev_.assign(validators_.size(), 0);
+    for(size_t i = 0; i < validators_.size(); ++i)
+      if(validators_[i])
+        pendingStalledPrev_[i] = validators_[i]->stalled();
+    pendingEpoch_ = formatLogicalEpoch();
+    pendingBatches_ = state_->batches;
+
+    auto state = New<TrainingState>(*state_); // the validators see the state of the validated update
+    pendingValidation_ = validThreadPool_.enqueue([this, state]() {
+      std::vector<float> values(validators_.size());
+      for(size_t i = 0; i < validators_.size(); ++i)
+        if(validators_[i]) {
+          tracing::Span span("validation", validators_[i]->type());
+          values[i] = validators_[i]->validate(validGraphs_, state);
+        }
+      return values;
+    });
+    LOG(info, "[valid] Validating update {} in the background, copying the parameters took {:.1f}s",
+        pendingBatches_, timer.elapsed());
+
+    state_->validated = true;
+    if(isFinal)
+      finishValidation(/*wait=*/true);
+  }
+
+  // Reports the results of a background validation, if it has finished or else with wait
+  void finishValidation(bool wait) {
+    if(!pendingValidation_.valid())
+      return;
+    if(!wait && pendingValidation_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
       return;
+    auto values = pendingValidation_.get();
+    reportValidation(values, pendingStalledPrev_, pendingEpoch_, pendingBatches_);
+  }
 
+  // Logs the values of the validators and records them in the training state, values[i] and
+  // stalledPrev[i] belong to validators_[i]
+  void reportValidation(const std::vector<float>& values,
+                        const std::vector<size_t>& stalledPrev,
+                        const std::string& epoch,
+                        size_t batches) {
     bool firstValidator = true;
-    for(auto validator : validators_) {
+    for(size_t i = 0; i < validators_.size(); ++i) {
+      auto validator = validators_[i];
       if(!validator)
         continue;
 
-      size_t stalledPrev = validator->stalled();
-      float value = validator->validate(graphs, state_);
+      float value = values[i];
       if(validator->stalled() > 0) {
         LOG_VALID(info,
                   "Ep. {} : Up. {} : {} : {} : stalled {} times (last best: {})",
-                  formatLogicalEpoch(),
-                  state_->batches,
+                  epoch,
+                  batches,
                   validator->type(),
                   value,
                   validator->stalled(), validator->lastBest());
       } else {
         LOG_VALID(info,
                   "Ep. {} : Up. {} : {} : {} : new best",
-                  formatLogicalEpoch(),
-                  state_->batches,
+                  epoch,
+                  batches,
                   validator->type(),
                   value);
 
@@ -316,18 +511,16 @@ public:
       state_->validators[validator->type()]["stalled"] = validator->stalled();
 
       // notify training observers if the first validator did not improve
-      if(firstValidator && validator->stalled() > stalledPrev)
+      if(firstValidator && validator->stalled() > stalledPrev[i])
         state_->newStalled(validator->stalled());
       firstValidator = false;
     }
-
-    state_->validated = true;
   }
 
   size_t stalled() {
     if(!validators_.empty())
-      if(validators_[0])
-        return validators_[0]->stalled();
+      if(validators_[0]) // a running background validation changes the count once it is reported
+        return pendingValidation_.valid() ? pendingStalledPrev_[0] : validators_[0]->stalled();
     return 0;
   }
 
@@ -343,6 +536,7 @@ public:
               size_t batchSize,      // total number of sentences in batch
               size_t batchLabels,    // total number of target words in batch
               Ptr<IMPIWrapper> mpi = nullptr) {
+    finishValidation(/*wait=*/false);
     state_->rememberPreviousProgress();  // note: epoch increases happen at the wrong place, hence
                                          // -freq parameters do not support epoch units
     state_->validated = false;
@@ -368,11 +562,11 @@ public:
     state_->newUpdate(numReadBatches);
 
     // reconstruct sum cost, for displaying epoch-level averages instead of minibatch-level
-    auto lossType = options_->get<std::string>("cost-type");
-    auto dispLabelCounts = options_->get<bool>("disp-label-counts");  // if true then show as "cost per label * number of labels"
+    const auto& lossType = settings_.costType;
+    bool dispLabelCounts = settings_.dispLabelCounts;  // if true then show as "cost per label * number of labels"
 
-    if(state_->enteredNewPeriodOf(options_->get<std::string>("disp-freq")) ||
-       state_->batches <= options_->get<size_t>("disp-first")) {
+    if(state_->enteredNewPeriodOf(settings_.dispFreq) ||
+       state_->batches <= settings_.dispFirst) {
       // if MPI then aggregate precise cost across workers
       if(mpi) {
         state_->costSum /= mpi->numMPIProcesses(); // undo the extra scaling
@@ -381,25 +575,35 @@ public:
 
       if(mpi && mpi->myMPIRank() != 0) {
         // skip the report on alternate worker processes
-      } else if(options_->get<bool>("lr-report")) {
-        LOG(info,
-            "Ep. {} : Up. {} : Sen. {} : {} : Time {:.2f}s : {:.2f} words/s : L.r. {:.4e}",
-            formatLogicalEpoch(),
-            state_->batches,
-            utils::withCommas(state_->samplesEpoch),
-            formatLoss(lossType, dispLabelCounts, batchLabels, state_),
-            timer_.elapsed(),
-            state_->wordsDisp / timer_.elapsed(),
-            state_->eta);
       } else {
-        LOG(info,
-            "Ep. {} : Up. {} : Sen. {} : {} : Time {:.2f}s : {:.2f} words/s",
-            formatLogicalEpoch(),
-            state_->batches,
-            utils::withCommas(state_->samplesEpoch),
-            formatLoss(lossType, dispLabelCounts, 0, state_), // ignore batchLabels
-            timer_.elapsed(),
-            state_->wordsDisp / timer_.elapsed());
+        // only shown if the training had to wait for data since the last display
+        std::string dataWaits;
+        if(state_->dataWaitsDisp > 0)
+          dataWaits = fmt::format(" : Data waits {} ({:.2f}s)", state_->dataWaitsDisp, state_->dataWaitSecondsDisp);
+        if(settings_.dispTimeBreakdown)
+          dataWaits += formatTimeBreakdown(timer_.elapsed());
+        if(settings_.lrReport) {
+          LOG(info,
+              "Ep. {} : Up. {} : Sen. {} : {} : Time {:.2f}s : {:.2f} words/s : L.r. {:.4e}{}",
+              formatLogicalEpoch(),
+              state_->batches,
+              utils::withCommas(state_->samplesEpoch),
+              formatLoss(lossType, dispLabelCounts, batchLabels, state_),
+              timer_.elapsed(),
+              state_->wordsDisp / timer_.elapsed(),
+              state_->eta,
+              dataWaits);
+        } else {
+          LOG(info,
+              "Ep. {} : Up. {} : Sen. {} : {} : Time {:.2f}s : {:.2f} words/s{}",
+              formatLogicalEpoch(),
+              state_->batches,
+              utils::withCommas(state_->samplesEpoch),
+              formatLoss(lossType, dispLabelCounts, 0, state_), // ignore batchLabels
+              timer_.elapsed(),
+              state_->wordsDisp / timer_.elapsed(),
+              dataWaits);
+        }
       }
 
 
@@ -410,6 +614,13 @@ public:
       state_->updatesDisp  = 0;
       state_->samplesDisp  = 0;
       state_->wordsDisp    = 0;
+
+      state_->dataWaitsDisp       = 0;
+      state_->dataWaitSecondsDisp = 0;
+
+      std::fill(phaseSecondsDisp_.begin(), phaseSecondsDisp_.end(), 0.0);
+      flopsDisp_              = 0;
+      workspaceHighWaterDisp_ = 0;
     }
 
     // progress heartbeat for MS-internal Philly compute cluster
@@ -439,6 +650,9 @@ public:
       state_->updatesDisp  = 0;
       state_->samplesDisp  = 0;
       state_->wordsDisp    = 0;
+
+      state_->dataWaitsDisp       = 0;
+      state_->dataWaitSecondsDisp = 0;
     }
 
     if(options_->get<bool>("valid-reset-stalled")) {
@@ -453,11 +667,19 @@ public:
   }
 
   void save(const std::string& name) {
-    // Save config options
-    std::ofstream fout(name + ".yml");
-    fout << options_->asYamlString();
-    // Save training progress
-    state_->save(name + ".progress.yml");
+    for(const auto& file : serialize(name)) {
+      std::ofstream fout(file.first);
+      fout << file.second;
+    }
+  }
+
+  // The files of save() with their contents, the config options and then the training progress,
+  // e.g. to be written later by an AsyncCheckpointWriter
+  std::vector<std::pair<std::string, std::string>> serialize(const std::string& name) const {
+    std::stringstream progress;
+    progress << state_->asYaml();
+    return {{name + ".yml", options_->asYamlString()},
+            {name + ".progress.yml", progress.str()}};
   }
 
   size_t numberOfBatches() { return state_->batches; }
@@ -472,32 +694,32 @@ public:
     if(options_->get<bool>("tsv", false) && (firstPath == "stdin" || firstPath == "-"))
       endOfStdin_ = true;
 
-    float factor = options_->get<float>("lr-decay");
+    float factor = settings_.lrDecay;
 
     updateLearningRate(state);
 
     if(factor > 0.0) {
       bool decay = false;
-      auto strategy = options_->get<std::string>("lr-decay-strategy");
+      const auto& strategy = settings_.lrDecayStrategy;
       state.reset = false;
 
       if(strategy == "epoch" || strategy == "epoch+batches"
          || strategy == "epoch+stalled") {
         size_t startEpoch
-            = options_->get<std::vector<size_t>>("lr-decay-start").front();
+            = settings_.lrDecayStart.front();
         if(startEpoch && state.epochs >= startEpoch)
           decay = true;
       }
 
       if(strategy == "epoch+batches") {
         size_t startBatches
-            = options_->get<std::vector<size_t>>("lr-decay-start")[1];
+            = settings_.lrDecayStart[1];
         if(startBatches && state.batches >= startBatches)
           decay = true;
       }
       if(strategy == "epoch+stalled") {
         size_t startStalled
-            = options_->get<std::vector<size_t>>("lr-decay-start")[1];
+            = settings_.lrDecayStart[1];
         if(startStalled && state.maxStalled >= startStalled)
           decay = true;
       }
@@ -507,28 +729,28 @@ public:
         updateLearningRate(state);
         LOG(info, "Decaying learning rate to {} in epoch {}", state.eta, state.epochs);
 
-        state.reset = options_->get<bool>("lr-decay-reset-optimizer");
+        state.reset = settings_.lrDecayResetOptimizer;
         if(state.reset)
           LOG(info, "Resetting optimizer statistics");
 
-        if(options_->get<bool>("lr-decay-repeat-warmup")) {
+        if(settings_.lrDecayRepeatWarmup) {
           LOG(info, "Restarting learning rate warmup");
-          state.warmupStart.n = state.getProgressIn(SchedulingParameter::parse(options_->get<std::string>("lr-warmup")).unit);
+          state.warmupStart.n = state.getProgressIn(settings_.lrWarmup.unit);
         }
       }
     }
   }
 
   void actAfterBatches(TrainingState& state) override {
-    float factor = options_->get<float>("lr-decay");
+    float factor = settings_.lrDecay;
     state.reset = false;
 
     updateLearningRate(state);
 
     if(factor > 0.0) {
-      if(options_->get<std::string>("lr-decay-strategy") == "batches") {
-        size_t start = options_->get<std::vector<size_t>>("lr-decay-start").front();
-        size_t freq  = options_->get<size_t>("lr-decay-freq"); // note: unlike e.g. disp-freq, this is always in batches
+      if(settings_.lrDecayStrategy == "batches") {
+        size_t start = settings_.lrDecayStart.front();
+        size_t freq  = settings_.lrDecayFreq; // note: unlike e.g. disp-freq, this is always in batches
 
         if(start > 0 && freq > 0 && state.batches >= start
            && ((state.batches - start) % freq == 0)) {
@@ -536,41 +758,40 @@ public:
           updateLearningRate(state);
           LOG(info, "Decaying learning rate to {} after {} batches", state.eta, state.batches);
 
-          state.reset = options_->get<bool>("lr-decay-reset-optimizer");
+          state.reset = settings_.lrDecayResetOptimizer;
           if(state.reset)
             LOG(info, "Resetting optimizer statistics");
 
-          if(options_->get<bool>("lr-decay-repeat-warmup")) {
+          if(settings_.lrDecayRepeatWarmup) {
             LOG(info, "Restarting learning rate warmup");
-            // TODO: avoid repeating this many times and minimize calls to options_->get
-            state.warmupStart.n = state.getProgressIn(SchedulingParameter::parse(options_->get<std::string>("lr-warmup")).unit);
+            state.warmupStart.n = state.getProgressIn(settings_.lrWarmup.unit);
           }
         }
       }
     }
 
-    if(first_ && options_->get<bool>("lr-warmup-at-reload")) {
+    if(first_ && settings_.lrWarmupAtReload) {
       LOG(info, "Restarting learning rate warmup");
-      state.warmupStart.n = state.getProgressIn(SchedulingParameter::parse(options_->get<std::string>("lr-warmup")).unit);
+      state.warmupStart.n = state.getProgressIn(settings_.lrWarmup.unit);
     }
 
-    if(options_->get<bool>("lr-warmup-cycle")) {
-      if(state_->enteredNewPeriodOf(options_->get<std::string>("lr-warmup")))
-        state.warmupStart.n = state.getProgressIn(SchedulingParameter::parse(options_->get<std::string>("lr-warmup")).unit);
+    if(settings_.lrWarmupCycle) {
+      if(state_->enteredNewPeriodOf(settings_.lrWarmup))
+        state.warmupStart.n = state.getProgressIn(settings_.lrWarmup.unit);
     }
 
     first_ = false;
   }
 
   void actAfterStalled(TrainingState& state) override {
-    float factor = options_->get<float>("lr-decay");
+    float factor = settings_.lrDecay;
     state.reset = false;
 
     updateLearningRate(state);
 
     if(factor > 0.0) {
-      if(options_->get<std::string>("lr-decay-strategy") == "stalled") {
-        size_t startStalled = options_->get<std::vector<size_t>>("lr-decay-start").front();
+      if(settings_.lrDecayStrategy == "stalled") {
+        size_t startStalled = settings_.lrDecayStart.front();
         if(startStalled && state.stalled && state.stalled % startStalled == 0) {
           state.factor *= factor;
           updateLearningRate(state);
@@ -579,13 +800,13 @@ public:
               state.eta,
               state.stalled);
 
-          state.reset = options_->get<bool>("lr-decay-reset-optimizer");
+          state.reset = settings_.lrDecayResetOptimizer;
           if(state.reset)
             LOG(info, "Resetting optimizer statistics");
 
-          if(options_->get<bool>("lr-decay-repeat-warmup")) {
+          if(settings_.lrDecayRepeatWarmup) {
             LOG(info, "Restarting learning rate warmup");
-            state.warmupStart.n = state.getProgressIn(SchedulingParameter::parse(options_->get<std::string>("lr-warmup")).unit);
+            state.warmupStart.n = state.getProgressIn(settings_.lrWarmup.unit);
           }
         }
       }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "common/config.h"
+#include "common/tracer.h"
 #include "common/utils.h"
 #include "data/batch_generator.h"
+#include "data/corpus_mixed.h"
 #ifndef _MSC_VER // @TODO: include SqLite in Visual Studio project
 #include "data/corpus_sqlite.h"
 #endif
@@ -31,6 +33,8 @@ public:
 #else
       ABORT("SqLite presently not supported on Windows");
 #endif
+    else if(!options_->get<std::vector<std::string>>("mix-corpora", {}).empty())
+      dataset = New<MixedCorpus>(options_);
     else
       dataset = New<Corpus>(options_);
 
@@ -92,6 +96,7 @@ public:
       for(auto batch : *batchGenerator) {
         if (!scheduler->keepGoing())
           break;
+        tracing::Span span("training", "update");
         model->update(batch);
       }
 
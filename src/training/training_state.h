@@ -114,12 +114,26 @@ public:
   size_t samplesDisp{0};
   // Number of updates seen since last display
   size_t updatesDisp{0};
+  // Number of times and seconds the training waited for the batch generator since last display
+  size_t dataWaitsDisp{0};
+  double dataWaitSecondsDisp{0};
 
   // The state of the random number generator from a batch generator
   std::string seedBatch;
   // The state of the random number generator from a corpus
   std::string seedCorpus;
 
+  // Where the batch generator continues within the epoch when resuming: the number of batches of
+  // this epoch before the swath (maxi-batch) currently trained on, the position of the corpus before
+  // it was read and the batch generator's random number generator state before it was shuffled
+  bool swathSaved{false}; // not present in older checkpoints
+  size_t swathBatches{0};
+  size_t swathPosition{0};
+  std::string swathSeed;
+
+  // --elastic: the number of devices over all processes that the updates are sized for, 0 if not recorded
+  size_t elasticDevices{0};
+
   // Set flag if training was resumed
   bool loaded{false};
 
@@ -174,10 +188,13 @@ public:
   // is called at the wrong place for this to work, so SchedulingUnit::epoch is forbidden
   // for periods.
   bool enteredNewPeriodOf(std::string schedulingParam) const {
-    auto period = SchedulingParameter::parse(schedulingParam);
+    return enteredNewPeriodOf(SchedulingParameter::parse(schedulingParam));
+  }
+
+  bool enteredNewPeriodOf(const SchedulingParameter& period) const {
     ABORT_IF(period.unit == SchedulingUnit::epochs,
              "Unit {} is not supported for frequency parameters (the one(s) with value {})",
-             schedulingParam);
+             std::string(period));
     auto previousProgress = getPreviousProgressIn(period.unit);
     auto progress = getProgressIn(period.unit);
     return period && progress / period.n != previousProgress / period.n;
@@ -192,6 +209,7 @@ public:
     }
     samplesEpoch = 0;
     batchesEpoch = 0;
+    swathSaved = false;
   }
 
   void newUpdate(size_t batchesInUpdate) {
@@ -266,10 +284,22 @@ public:
 
     seedBatch = config["seed-batch"].as<std::string>();
     seedCorpus = config["seed-corpus"].as<std::string>();
+
+    swathSaved = (bool)config["swath-batches"]; // optional for backward compatibility
+    if(swathSaved) {
+      swathBatches  = config["swath-batches"].as<size_t>();
+      swathPosition = config["swath-position"].as<size_t>();
+      swathSeed     = config["swath-seed"].as<std::string>();
+    }
+    elasticDevices = config["elastic-devices"] ? config["elastic-devices"].as<size_t>() : 0;
   }
 
   void save(const std::string& name) const {
     std::ofstream fout(name);
+    fout << asYaml();
+  }
+
+  YAML::Node asYaml() const {
     YAML::Node config;
 
     config["epochs"] = epochs;
@@ -302,7 +332,15 @@ public:
     config["seed-batch"] = seedBatch;
     config["seed-corpus"] = seedCorpus;
 
-    fout << config;
+    if(swathSaved) {
+      config["swath-batches"] = swathBatches;
+      config["swath-position"] = swathPosition;
+      config["swath-seed"] = swathSeed;
+    }
+    if(elasticDevices > 0)
+      config["elastic-devices"] = elasticDevices;
+
+    return config;
   }
 
   std::string fillTemplate(const std::string& templ) const {
@@ -106,7 +106,7 @@ float CrossEntropyValidator::validateBG(const std::vector<Ptr<ExpressionGraph>>&
   {
     threadPool_.reserve(graphs.size());
     TaskBarrier taskBarrier;
-    for(auto batch : *batchGenerator_)
+    for(auto batch : batches())
       taskBarrier.push_back(threadPool_.enqueue(task, batch));
     // ~TaskBarrier waits until all are done
   }
@@ -184,7 +184,7 @@ float AccuracyValidator::validateBG(const std::vector<Ptr<ExpressionGraph>>& gra
     threadPool_.reserve(graphs.size());
 
     TaskBarrier taskBarrier;
-    for(auto batch : *batchGenerator_)
+    for(auto batch : batches())
       taskBarrier.push_back(threadPool_.enqueue(task, batch));
 
     // ~TaskBarrier waits until all are done
@@ -280,7 +280,7 @@ float BertAccuracyValidator::validateBG(const std::vector<Ptr<ExpressionGraph>>&
   {
     threadPool_.reserve(graphs.size());
     TaskBarrier taskBarrier;
-    for(auto batch : *batchGenerator_) {
+    for(auto batch : batches()) {
       taskBarrier.push_back(threadPool_.enqueue(task, batch, batchId));
       batchId++;
     }
@@ -333,9 +333,6 @@ float TranslationValidator::validate(const std::vector<Ptr<ExpressionGraph>>& gr
                                      Ptr<const TrainingState> state) {
   using namespace data;
 
-  // Generate batches
-  batchGenerator_->prepare();
-
   // Create scorer
   auto model = options_->get<std::string>("model");
 
@@ -410,7 +407,7 @@ float TranslationValidator::validate(const std::vector<Ptr<ExpressionGraph>>& gr
 
     threadPool_.reserve(graphs.size());
     TaskBarrier taskBarrier;
-    for(auto batch : *batchGenerator_)
+    for(auto batch : batches())
       taskBarrier.push_back(threadPool_.enqueue(task, batch));
     // ~TaskBarrier waits until all are done
   }
@@ -443,9 +440,12 @@ SacreBleuValidator::SacreBleuValidator(std::vector<Ptr<Vocab>> vocabs, Ptr<Optio
       metric_(metric),
       computeChrF_(metric == "chrf"),
       useWordIds_(metric == "bleu-segmented"),
-      quiet_(options_->get<bool>("quiet-translation")) {
+      quiet_(options_->get<bool>("quiet-translation")),
+      tokenize_(options_->get<std::string>("valid-tokenize", "auto")) {
 
   ABORT_IF(computeChrF_ && useWordIds_, "Cannot compute ChrF on word ids"); // should not really happen, but let's check.
+  ABORT_IF(tokenize_ != "auto" && tokenize_ != "13a" && tokenize_ != "none",
+           "Unknown tokenization for validation: --valid-tokenize {}", tokenize_);
 
   if(computeChrF_) // according to SacreBLEU implementation this is the default for ChrF, 
     order_ = 6;    // we compute stats over character ngrams up to length 6
@@ -460,9 +460,6 @@ float SacreBleuValidator::validate(const std::vector<Ptr<ExpressionGraph>>& grap
                               Ptr<const TrainingState> state) {
   using namespace data;
 
-  // Generate batches
-  batchGenerator_->prepare();
-
   // Create scorer
   auto model = options_->get<std::string>("model");
 
@@ -478,6 +475,8 @@ float SacreBleuValidator::validate(const std::vector<Ptr<ExpressionGraph>>& grap
     scorers.push_back(scorer);
   }
 
+  cacheReferences();
+
   for(auto graph : graphs)
     graph->setInference(true);
 
@@ -529,12 +528,12 @@ float SacreBleuValidator::validate(const std::vector<Ptr<ExpressionGraph>>& grap
       auto search = New<BeamSearch>(options_, std::vector<Ptr<Scorer>>{scorer}, vocabs_.back());
       auto histories = search->search(graph, batch);
 
-      size_t no = 0;
-      std::lock_guard<std::mutex> statsLock(mutex_);
+      // the statistics of the batch are collected without blocking the other workers
+      std::vector<float> batchStats(stats.size(), 0.f);
       for(auto history : histories) {
         auto result = history->top();
         const auto& words = std::get<0>(result);
-        updateStats(stats, words, batch, no);
+        updateStats(batchStats, words, history->getLineNum());
 
         std::stringstream best1;
         std::stringstream bestn;
@@ -543,13 +542,16 @@ float SacreBleuValidator::validate(const std::vector<Ptr<ExpressionGraph>>& grap
                          best1.str(),
                          bestn.str(),
                          /*nbest=*/false);
-        no++;
       }
+
+      std::lock_guard<std::mutex> statsLock(mutex_);
+      for(size_t i = 0; i < stats.size(); ++i)
+        stats[i] += batchStats[i];
     };
 
     threadPool_.reserve(graphs.size());
     TaskBarrier taskBarrier;
-    for(auto batch : *batchGenerator_)
+    for(auto batch : batches())
       taskBarrier.push_back(threadPool_.enqueue(task, batch));
     // ~TaskBarrier waits until all are done
   }
@@ -571,7 +573,9 @@ std::vector<std::string> SacreBleuValidator::decode(const Words& words, bool add
   auto tokenString = vocab->surfaceForm(words);  // detokenize to surface form
 
   auto vocabType = vocab->type();
-  if(vocabType == "FactoredVocab" || vocabType == "SentencePieceVocab") {
+  bool tokenize13a = tokenize_ == "13a"
+                     || (tokenize_ == "auto" && (vocabType == "FactoredVocab" || vocabType == "SentencePieceVocab"));
+  if(tokenize13a) {
     LOG_VALID_ONCE(info, "Decoding validation set with {} for scoring", vocabType);
     tokenString = tokenize(tokenString); // tokenize according to SacreBLEU rules
     if(!computeChrF_) // for ChrF, we break into characters below, so no need to do this here
@@ -588,27 +592,43 @@ std::vector<std::string> SacreBleuValidator::decode(const Words& words, bool add
   return tokens;
 }
 
-void SacreBleuValidator::updateStats(std::vector<float>& stats,
-                                     const Words& cand,
-                                     const Ptr<data::Batch> batch,
-                                     size_t no) {
-  auto vocab = vocabs_.back();
-
-  auto corpusBatch = std::static_pointer_cast<data::CorpusBatch>(batch);
-  auto subBatch = corpusBatch->back();
+void SacreBleuValidator::cacheReferences() {
+  if(!refWords_.empty())
+    return;
 
-  size_t size = subBatch->batchSize();
-  size_t width = subBatch->batchWidth();
+  auto vocab = vocabs_.back();
+  for(auto batch : batches()) {
+    auto subBatch = batch->back();
+    size_t size = subBatch->batchSize();
+    size_t width = subBatch->batchWidth();
+
+    for(size_t no = 0; no < size; ++no) {
+      Words ref;  // fill ref
+      for(size_t i = 0; i < width; ++i) {
+        Word w = subBatch->data()[i * size + no];
+        if(w == vocab->getEosId())
+          break;
+        if(w == vocab->getUnkId())
+          LOG_VALID_ONCE(info, "References contain unknown word, metric scores may be inaccurate");
+        ref.push_back(w);
+      }
 
-  Words ref;  // fill ref
-  for(size_t i = 0; i < width; ++i) {
-    Word w = subBatch->data()[i * size + no];
-    if(w == vocab->getEosId())
-      break;
-    if(w == vocab->getUnkId())
-      LOG_VALID_ONCE(info, "References contain unknown word, metric scores may be inaccurate");
-    ref.push_back(w);
+      size_t id = batch->getSentenceIds()[no];
+      if(id >= refWords_.size()) {
+        refWords_.resize(id + 1);
+        refTokens_.resize(id + 1);
+      }
+      if(!useWordIds_)
+        refTokens_[id] = decode(ref, /*addEOS=*/false);
+      refWords_[id] = std::move(ref);
+    }
   }
+}
+
+void SacreBleuValidator::updateStats(std::vector<float>& stats,
+                                     const Words& cand,
+                                     size_t sentenceId) {
+  const auto& ref = refWords_[sentenceId];
 
   LOG_VALID_ONCE(info, "[valid] First sentence's tokens as scored:");
   LOG_VALID_ONCE(info, "[valid]   Hyp: {}", utils::join(decode(cand, /*addEOS=*/false)));
@@ -617,7 +637,7 @@ void SacreBleuValidator::updateStats(std::vector<float>& stats,
   if(useWordIds_)
     updateStats(stats, cand, ref);
   else
-    updateStats(stats, decode(cand, /*addEOS=*/false), decode(ref, /*addEOS=*/false));
+    updateStats(stats, decode(cand, /*addEOS=*/false), refTokens_[sentenceId]);
   
 }
 
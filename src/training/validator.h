@@ -20,6 +20,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <limits>
+#include <map>
+#include <mutex>
 
 namespace marian {
 
@@ -89,6 +91,44 @@ protected:
     // Create batch generator
     batchGenerator_ = New<data::BatchGenerator<DataSet>>(corpus, options_);
   }
+
+  // The options that determine the batches, validators with the same ones share their batches
+  std::string batchesKey() const {
+    std::string key = utils::join(options_->get<std::vector<std::string>>("valid-sets"), "\t");
+    for(auto name : {"mini-batch", "mini-batch-words", "maxi-batch", "max-length"})
+      key += "\t" + std::to_string(options_->get<size_t>(name, 0));
+    key += "\t" + options_->get<std::string>("mini-batch-sort", "");
+    key += options_->get<bool>("max-length-crop", false) ? "\tcrop" : "";
+    for(const auto& vocab : vocabs_)
+      key += "\t" + std::to_string((size_t)vocab.get());
+    return key;
+  }
+
+  // The batches of the validation set, which are read, encoded with the vocabularies and batched at
+  // the first validation and reused by all later ones. They are shared with the other validators of
+  // the same validation set and batching options, e.g. of --valid-metrics cross-entropy bleu, so the
+  // corpus is read once for all of them; the batch generator is released afterwards.
+  const std::vector<BatchPtr>& batches() {
+    if(!batches_) {
+      static std::mutex cacheMutex;
+      static std::map<std::string, std::weak_ptr<std::vector<BatchPtr>>> cache;
+
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      auto& cached = cache[batchesKey()];
+      batches_ = cached.lock();
+      if(!batches_) {
+        timer::Timer timer;
+        batches_ = New<std::vector<BatchPtr>>();
+        batchGenerator_->prepare();
+        for(auto batch : *batchGenerator_)
+          batches_->push_back(batch);
+        cached = batches_;
+        LOG(info, "[valid] Prepared {} batches of the validation sets in {:.2f}s", batches_->size(), timer.elapsed());
+      }
+      batchGenerator_.reset();
+    }
+    return *batches_;
+  }
 public:
 
   virtual float validate(const std::vector<Ptr<ExpressionGraph>>& graphs,
@@ -96,8 +136,6 @@ public:
     for(auto graph : graphs)
       graph->setInference(true);
 
-    batchGenerator_->prepare();
-
     // Validate on batches
     float val = validateBG(graphs);
     updateStalled(graphs, val);
@@ -113,6 +151,7 @@ protected:
   Ptr<Options> options_;
   Ptr<BuilderType> builder_; // @TODO: remove, this is not guaranteed to be state-free, hence not thread-safe, but we are using validators with multi-threading.
   Ptr<data::BatchGenerator<DataSet>> batchGenerator_;
+  Ptr<std::vector<BatchPtr>> batches_; // see batches()
 
   virtual float validateBG(const std::vector<Ptr<ExpressionGraph>>&)
       = 0;
@@ -337,11 +376,13 @@ protected:
     stats[statsPerOrder * order_] += ref.size(); // reference length for BLEU (technically same as stats[2], but let's keep it separate)
   }
 
-  // Extract matching target reference from batch and pass on to update BLEU stats
+  // Update BLEU stats with the candidate and the cached reference of the sentence
   void updateStats(std::vector<float>& stats,
                    const Words& cand,
-                   const Ptr<data::Batch> batch,
-                   size_t no);
+                   size_t sentenceId);
+
+  // Extracts the references from the batches and tokenizes them once for all validations
+  void cacheReferences();
 
   float calcBLEU(const std::vector<float>& stats);
   float calcChrF(const std::vector<float>& stats);
@@ -358,6 +399,10 @@ private:
   static const size_t statsPerOrder = 3;   // 0: common ngrams, 1: candidate ngrams, 2: reference ngrams
   bool useWordIds_{ false };               // compute BLEU score by matching numeric segment ids
   bool quiet_{ false };
+  std::string tokenize_;                   // auto, 13a or none, see --valid-tokenize
+
+  std::vector<Words> refWords_;                    // [sentence id] reference, see cacheReferences()
+  std::vector<std::vector<std::string>> refTokens_; // [sentence id] tokenized reference, unless useWordIds_
 };
 
 /**
@@ -1,10 +1,13 @@
 #include "translator/beam_search.h"
 
 #include "data/factored_vocab.h"
+#include "translator/decoder_profiler.h"
 #include "translator/helpers.h"
 #include "translator/nth_element.h"
 #include "data/shortlist.h"
 
+#include "3rd_party/threadpool.h"
+
 namespace marian {
 
 // combine new expandedPathScores and previous beams into new set of beams
@@ -18,9 +21,6 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
                          Ptr<FactoredVocab/*const*/> factoredVocab, size_t factorGroup,
                          const std::vector<bool>& dropBatchEntries, // [origDimBatch] - empty source batch entries are marked with true, should be cleared after first use.
                          const std::vector<IndexType>& batchIdxMap) const { // [origBatchIdx -> currentBatchIdx]
-  std::vector<float> align; // collects alignment information from the last executed time step
-  if(options_->hasAndNotEmpty("alignment") && factorGroup == 0)
-    align = scorers_[0]->getAlignment(); // [beam depth * max src length * current batch size] -> P(s|t); use alignments from the first scorer, even if ensemble,
 
   const auto origDimBatch = beams.size(); // see function search for definition of origDimBatch and currentDimBatch etc.
   Beams newBeams(origDimBatch);           // return value of this function goes here. There are always origDimBatch beams.
@@ -40,6 +40,18 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
     }
   }
 
+  // attention of the last executed time step, from which the alignments of the hypotheses are only
+  // gathered when they are traced back; uses the alignments from the first scorer, even if ensemble
+  Ptr<StepAttention> attention;
+  if(options_->hasAndNotEmpty("alignment") && factorGroup == 0) {
+    attention = New<StepAttention>();
+    attention->values = scorers_[0]->getAlignment(); // [beam depth * max src length * current batch size] -> P(s|t)
+    attention->srcMask = batch->front()->mask();     // [max src length * orig batch size]
+    attention->srcLength = batch->width();
+    attention->currentDimBatch = currentDimBatch;
+    attention->origDimBatch = origDimBatch;
+  }
+
   for(size_t i = 0; i < nBestKeys.size(); ++i) { // [currentDimBatch, beamSize] flattened
     // Keys encode batchIdx, beamHypIdx, and word index in the entire beam.
     // They can be between 0 and (vocabSize * nBestBeamSize * batchSize)-1.
@@ -56,9 +68,7 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
     WordIndex wordIdx;
     if(dropHyp) { // if we force=drop the hypothesis, assign EOS, otherwise the expected word id.
       if(factoredVocab) { // when using factoredVocab, extract the EOS lemma index from the word id, we predicting factors one by one here, hence lemma only
-        std::vector<size_t> eosFactors;
-        factoredVocab->word2factors(factoredVocab->getEosId(), eosFactors);
-        wordIdx = (WordIndex)eosFactors[0];
+        wordIdx = (WordIndex)factoredVocab->getFactor(factoredVocab->getEosId(), 0);
       } else { // without factoredVocab lemma index and word index are the same. Safe cruising. 
         wordIdx = trgVocab_->getEosId().toWordIndex();
       }
@@ -95,10 +105,9 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
       // starting with the lemma, then adding factors one by one.
       if (factorGroup == 0) {
         word = factoredVocab->lemma2Word(shortlist ? shortlist->reverseMap(wordIdx) : wordIdx); // @BUGBUG: reverseMap is only correct if factoredVocab_->getGroupRange(0).first == 0
-        std::vector<size_t> factorIndices; factoredVocab->word2factors(word, factorIndices);
-        //LOG(info, "{} + {} ({}) -> {} -> {}",
+        //LOG(info, "{} + {} -> {} -> {}",
         //    factoredVocab->decode(prevHyp->tracebackWords()),
-        //    factoredVocab->word2string(word), factorIndices[0], prevHyp->getPathScore(), pathScore);
+        //    factoredVocab->word2string(word), prevHyp->getPathScore(), pathScore);
       }
       else {
         //LOG(info, "{} |{} ({}) = {} ({}) -> {} -> {}",
@@ -119,10 +128,10 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
     else
       word = Word::fromWordIndex(wordIdx);
 
-    auto hyp = Hypothesis::New(prevHyp, word, prevBeamHypIdx, pathScore);
+    auto hyp = pool_->New(prevHyp, word, prevBeamHypIdx, pathScore);
 
     // Set score breakdown for n-best lists
-    if(options_->get<bool>("n-best")) {
+    if(nBest_) {
       auto breakDown = beam[beamHypIdx]->getScoreBreakdown();
       ABORT_IF(factoredVocab && factorGroup > 0 && !factoredVocab->canExpandFactoredWord(word, factorGroup),
                "A word without this factor snuck through to here??");
@@ -143,10 +152,10 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
     }
 
     // Set alignments
-    if(!align.empty())
-      hyp->setAlignment(getAlignmentsForHypothesis(align, batch, (int)beamHypIdx, (int)currentBatchIdx, (int)origBatchIdx, (int)currentDimBatch));
+    if(attention)
+      hyp->setAlignment(attention, beamHypIdx, currentBatchIdx, origBatchIdx);
     else // not first factor: just copy
-      hyp->setAlignment(beam[beamHypIdx]->getAlignment());
+      hyp->setAlignmentFrom(*beam[beamHypIdx]);
 
     newBeam.push_back(hyp);
   }
@@ -167,7 +176,7 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
       }
       if (newBeam.size() > beam.size()) {
         //LOG(info, "Size {}, sorting...", newBeam.size());
-        std::nth_element(newBeam.begin(), newBeam.begin() + beam.size(), newBeam.end(), [](Hypothesis::PtrType a, Hypothesis::PtrType b) {
+        std::nth_element(newBeam.begin(), newBeam.begin() + beam.size(), newBeam.end(), [](const Hypothesis* a, const Hypothesis* b) {
           return a->getPathScore() > b->getPathScore(); // (sort highest score first)
         });
         //LOG(info, "Size {}, sorted...", newBeam.size());
@@ -178,51 +187,6 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
   return newBeams;
 }
 
-std::vector<float> BeamSearch::getAlignmentsForHypothesis( // -> P(s|t) for current t and given beam and batch dim
-    const std::vector<float> alignAll, // [beam depth, max src length, batch size, 1], flattened vector of all attention probablities
-    Ptr<data::CorpusBatch> batch,
-    int beamHypIdx,
-    int currentBatchIdx,
-    int origBatchIdx,
-    int currentDimBatch) const {
-  // Let's B be the beam size, N be the number of batched sentences,
-  // and L the number of words in the longest sentence in the batch.
-  // The alignment vector:
-  //
-  // if(first)
-  //   * has length of N x L if it's the first beam
-  //   * stores elements in the following order:
-  //     beam1 = [word1-batch1, word1-batch2, ..., word2-batch1, ...]
-  // else
-  //   * has length of N x L x B
-  //   * stores elements in the following order:
-  //     beams = [beam1, beam2, ..., beam_n]
-  //
-  // The mask vector is always of length N x L and has 1/0s stored like
-  // in a single beam, i.e.:
-  //   * [word1-batch1, word1-batch2, ..., word2-batch1, ...]
-  //
-
-  size_t origDimBatch = batch->size();  // number of sentences in batch
-  size_t batchWidth   = batch->width(); // max src length
-
-  // loop over words of batch entry 'currentBatchIdx' and beam entry 'beamHypIdx'
-  std::vector<float> align;
-  for(size_t srcPos = 0; srcPos < batchWidth; ++srcPos) { // loop over source positions
-    // We are looking into the probabilites from an actual tensor, hence we need to use currentDimBatch and currentBatchIdx.
-    size_t currentAttIdx = (batchWidth * beamHypIdx + srcPos) * currentDimBatch + currentBatchIdx; // = flatten [beam index, s, batch index, 0]
-
-    // We are looking into the mask from the orginal batch, hence we need to use origDmBatch and origBatchIdx.
-    size_t origAttIdx  = (batchWidth * beamHypIdx + srcPos) * origDimBatch + origBatchIdx;; // = flatten [beam index, s, batch index, 0]
-    size_t origMaskIdx = origAttIdx % (batchWidth * origDimBatch); // == batchIdx + (batchSize * srcPos) = flatten [0, s, batch index, 0]
-
-    // If the original position is not masked out used the corresponding current attention score.
-    if(batch->front()->mask()[origMaskIdx] != 0)
-      align.emplace_back(alignAll[currentAttIdx]);
-  }
-  return align;
-}
-
 // remove all beam entries that have reached EOS
 Beams BeamSearch::purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexType>& batchIdxMap) {
   const auto trgEosId = trgVocab_->getEosId();
@@ -246,14 +210,605 @@ Beams BeamSearch::purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexTyp
   return newBeams;
 }
 
+bool BeamSearch::pruneBeam(const Beam& beam, Beam& activeBeam, const History& history, float maxLength) const {
+  const float threshold = beamThreshold_;
+  const float alpha = normalize_;
+  const float wp = wordPenalty_;
+  // Path scores are sums of log-probs and can only decrease. With alpha and wp of at least 0 the
+  // normalized score of any completion of a hypothesis is then bounded by its path score minus the
+  // word penalty of the shortest completion, divided by the length penalty of the longest one.
+  const bool earlyStop = beamEarlyStop_ && alpha >= 0 && wp >= 0 && !nBest_;
+  if(threshold <= 0 && !earlyStop)
+    return false;
+
+  float bestPathScore = -std::numeric_limits<float>::infinity();
+  for(auto hyp : beam)
+    bestPathScore = std::max(bestPathScore, hyp->getPathScore());
+  const float bestFinalScore = history.bestFinalScore();
+  const float minLength = (float)history.size(); // the unfinished hypotheses need at least one more word
+  const float maxLengthPenalty = std::pow(std::max(minLength, maxLength + 1), alpha);
+
+  Beam kept;
+  bool hopeless = earlyStop;
+  for(auto hyp : activeBeam) {
+    if(threshold > 0 && hyp->getPathScore() < bestPathScore - threshold)
+      continue;
+    if(hopeless) {
+      float score = hyp->getPathScore() - wp * minLength;
+      float bound = score / (score < 0 ? maxLengthPenalty : std::pow(minLength, alpha));
+      hopeless = bound < bestFinalScore;
+    }
+    kept.push_back(hyp);
+  }
+  // hopeless hypotheses are only dropped all at once, dropping one would shrink the next beam and change the result
+  if(hopeless)
+    kept.clear();
+  activeBeam.swap(kept);
+  return activeBeam.empty();
+}
+
 //**********************************************************************
 // main decoding function
 Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch) {
+  return search(std::vector<Ptr<ExpressionGraph>>({graph}), batch);
+}
+
+// Maximum output length per batch entry. By default all entries are bound by the longest source
+// sentence in the batch. With --max-length-per-sentence each entry is bound by its own source
+// length instead, so that entries which do not produce EOS in time are retired and purged from
+// the batch early rather than keeping their slots busy until the longest entry is done.
+std::vector<float> BeamSearch::getMaxLengths(Ptr<data::CorpusBatch> batch) const {
+  const int origDimBatch = (int)batch->size();
+  const float maxLengthFactor = options_->get<float>("max-length-factor");
+  std::vector<float> maxLengths(origDimBatch, maxLengthFactor * batch->front()->batchWidth());
+  if(options_->get<bool>("max-length-per-sentence", false)) {
+    const auto& srcMask = batch->front()->mask(); // [batchWidth, origDimBatch] flattened
+    for(int origBatchIdx = 0; origBatchIdx < origDimBatch; ++origBatchIdx) {
+      size_t srcLength = 0;
+      for(size_t srcPos = 0; srcPos < batch->front()->batchWidth(); ++srcPos)
+        srcLength += srcMask[srcPos * origDimBatch + origBatchIdx] != 0;
+      maxLengths[origBatchIdx] = maxLengthFactor * srcLength;
+    }
+  }
+  return maxLengths;
+}
+
+bool BeamSearch::canSearchGreedy(size_t numGraphs) const {
+  auto factoredVocab = trgVocab_->tryAs<FactoredVocab>();
+  return beamSize_ == 1 && numGraphs == 1
+         && (!factoredVocab || factoredVocab->getNumGroups() == 1)
+         && !options_->hasAndNotEmpty("alignment")
+         && !nBest_;
+}
+
+Histories BeamSearch::searchGreedy(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch) {
+  DECODER_PROFILE_START(profile);
+  const int origDimBatch = (int)batch->size();
+  const auto trgEosId = trgVocab_->getEosId();
+  const auto trgUnkId = trgVocab_->getUnkId();
+  const bool cpu = graph->getDeviceId().type == DeviceType::cpu;
+
+  pool_ = New<HypothesisPool>();
+
+  // with --output-sampling (see sampleInSearch()) the raw logits are sampled on the CPU, and on the
+  // GPU restricted distributions from the n-best lists of the normalized scores, while the scorer
+  // adds Gumbel noise for unrestricted sampling, whose best words are taken as usual
+  const bool sample = sampleInSearch(options_);
+  OutputSampling sampling(options_);
+  const bool sampleNBest = sample && !cpu && sampling.restricted();
+  const size_t sampleCandidates = sampling.topK > 0 ? sampling.topK : SAMPLING_CANDIDATES;
+  std::seed_seq seeds{(uint32_t)Config::seed, (uint32_t)batch->getSentenceIds()[0]};
+  std::mt19937 rng(seeds); // reproducible for a given --seed and batch
+
+  auto getNBestList = cpu ? GetNBestListFn()
+                          : createGetNBestListFn(/*beamSize=*/sampleNBest ? sampleCandidates : 1, origDimBatch, graph->getDeviceId());
+
+  for(auto scorer : scorers_)
+    scorer->clear(graph);
+
+  std::vector<Ptr<ScorerState>> states;
+  for(auto scorer : scorers_)
+    states.push_back(scorer->startState(graph, batch));
+  if(DECODER_PROFILE_ENABLED(profile)) // run the encoders on their own to time them
+    graph->forward();
+  DECODER_PROFILE_LAP(profile, Encoder);
+
+  // per sentence token buffer and path score after each of the tokens
+  std::vector<Words> words(origDimBatch);
+  std::vector<std::vector<float>> pathScores(origDimBatch);
+
+  const auto& srcEosId = batch->front()->vocab()->getEosId();
+  std::vector<bool> emptyBatchEntries(origDimBatch); // forced to EOS in the first step, see search()
+  for(int origBatchIdx = 0; origBatchIdx < origDimBatch; ++origBatchIdx)
+    emptyBatchEntries[origBatchIdx] = batch->front()->data()[origBatchIdx] == srcEosId;
+
+  int unkColId = -1;
+  if (trgUnkId != Word::NONE && !allowUnk_) {
+    unkColId = trgUnkId.toWordIndex();
+    auto shortlist = scorers_[0]->getShortlist();
+    if (shortlist)
+      unkColId = shortlist->tryForwardMap(unkColId);
+  }
+
+  auto maxLengths = getMaxLengths(batch);
+
+  Histories histories(origDimBatch);
+  for(int i = 0; i < origDimBatch; ++i)
+    histories[i] = New<History>(batch->getSentenceIds()[i],
+                                normalize_,
+                                wordPenalty_,
+                                pool_);
+
+  auto finish = [&](int origBatchIdx) {
+    auto hyp = pool_->New();
+    for(size_t i = 0; i < words[origBatchIdx].size(); ++i)
+      hyp = pool_->New(hyp, words[origBatchIdx][i], /*prevBeamHypIdx=*/0, pathScores[origBatchIdx][i]);
+    histories[origBatchIdx]->addFinal(hyp, words[origBatchIdx].size());
+  };
+
+  std::vector<int> active(origDimBatch);               // [currentBatchIdx -> origBatchIdx]
+  std::iota(active.begin(), active.end(), 0);
+  std::vector<IndexType> batchIndices(origDimBatch);   // [currentBatchIdx -> batch index of the state tensors]
+  std::iota(batchIndices.begin(), batchIndices.end(), 0);
+  std::vector<IndexType> hypIndices;                   // empty as long as no sentence has been purged
+  std::vector<Word> prevWords;                         // [currentBatchIdx]
+  std::vector<float> prevScores;                       // [currentBatchIdx]
+  std::vector<float> bestScores;
+  std::vector<unsigned> bestKeys;
+
+  DECODER_PROFILE_LAP(profile, Prepare);
+  for(size_t t = 0; !active.empty(); t++) {
+    DECODER_PROFILE_COUNT(profile, steps, 1);
+    Expr expandedScores; // [1, 1, currentDimBatch, dimVocab]
+    bool fused = false;
+    for(size_t i = 0; i < scorers_.size(); ++i) {
+      states[i] = scorers_[i]->step(graph, states[i], hypIndices, prevWords, batchIndices, /*beamSize=*/1);
+      auto logProbs = states[i]->getLogProbs().getLogits();
+      if(!states[i]->isNormalized()) {
+        ABORT_IF(scorers_.size() != 1, "Unnormalized scores are only supported for a single scorer without factors");
+        expandedScores = logProbs;
+        fused = true;
+        continue;
+      }
+      logProbs = scorers_[i]->getWeight() * logProbs;
+      expandedScores = expandedScores ? expandedScores + logProbs : logProbs;
+    }
+
+    if(!cpu) // the n-best search expects [currentDimBatch, 1, 1, dimVocab] which is just a reshape here
+      expandedScores = swapAxes(expandedScores, 0, 2);
+
+    if(t == 0)
+      graph->forward();
+    else
+      graph->forwardNext();
+    DECODER_PROFILE_LAP(profile, Forward);
+
+    // select the best word for every sentence, previous path scores are added below unless fused
+    bestScores.clear();
+    bestKeys.clear();
+    if(fused && sample) {
+      sampleFromLogits(expandedScores->val(), unkColId, sampling, rng, bestScores, bestKeys);
+    } else if(fused) {
+      getNBestListFusedLogSoftmax(expandedScores->val(), prevScores, scorers_[0]->getWeight(), unkColId, /*N=*/1, bestScores, bestKeys);
+    } else if(cpu) {
+      for(auto state : states)
+        state->blacklist(expandedScores, batch);
+      getBestPerRow(expandedScores->val(), unkColId, bestScores, bestKeys);
+    } else {
+      if(unkColId != -1)
+        suppressWord(expandedScores, unkColId);
+      for(auto state : states)
+        state->blacklist(expandedScores, batch);
+      if(sampleNBest) {
+        size_t N = std::min(sampleCandidates, (size_t)expandedScores->shape()[-1]);
+        std::vector<float> nBestScores;
+        std::vector<unsigned> nBestKeys;
+        getNBestList(expandedScores->val(), N, nBestScores, nBestKeys, /*first=*/true);
+        std::vector<float> rowLogTotals; // of the suppressed scores, for a nucleus of the whole row
+        if(sampling.topK == 0) {
+          auto logTotals = logsumexp(expandedScores * (1.f / sampling.temperature), /*axis=*/-1);
+          graph->forwardNext();
+          logTotals->val()->get(rowLogTotals);
+        }
+        sampleFromNBestList(nBestScores, nBestKeys, N, rowLogTotals, sampling, rng, bestScores, bestKeys);
+      } else {
+        getNBestList(expandedScores->val(), /*N=*/1, bestScores, bestKeys, /*first=*/true);
+      }
+    }
+    DECODER_PROFILE_LAP(profile, TopK);
+
+    const size_t vocabSize = expandedScores->shape()[-1];
+    auto shortlist = scorers_[0]->getShortlist();
+
+    std::vector<int> survivors;
+    std::vector<IndexType> survivorIndices;
+    prevWords.clear();
+    std::vector<float> survivorScores;
+    for(size_t currentBatchIdx = 0; currentBatchIdx < active.size(); ++currentBatchIdx) {
+      int origBatchIdx = active[currentBatchIdx];
+      Word word;
+      float pathScore;
+      if(t == 0 && emptyBatchEntries[origBatchIdx]) {
+        word = trgEosId;
+        pathScore = 0.f;
+      } else {
+        auto wordIdx = (WordIndex)(bestKeys[currentBatchIdx] % vocabSize);
+        word = Word::fromWordIndex(shortlist ? shortlist->reverseMap(wordIdx) : wordIdx);
+        pathScore = bestScores[currentBatchIdx];
+        if((!fused || sample) && !prevScores.empty())
+          pathScore += prevScores[currentBatchIdx];
+      }
+      words[origBatchIdx].push_back(word);
+      pathScores[origBatchIdx].push_back(pathScore);
+
+      if(word == trgEosId || words[origBatchIdx].size() >= maxLengths[origBatchIdx]) {
+        finish(origBatchIdx);
+      } else {
+        survivors.push_back(origBatchIdx);
+        survivorIndices.push_back((IndexType)currentBatchIdx);
+        prevWords.push_back(word);
+        survivorScores.push_back(pathScore);
+      }
+    }
+
+    // reorder the decoder states only if sentences have been purged from the batch
+    if(survivors.size() == active.size())
+      hypIndices.clear();
+    else
+      hypIndices = survivorIndices;
+    batchIndices = survivorIndices;
+    active.swap(survivors);
+    prevScores.swap(survivorScores);
+    DECODER_PROFILE_LAP(profile, History);
+  }
+
+  DECODER_PROFILE_FINISH(profile, origDimBatch);
+  return histories;
+}
+
+bool BeamSearch::canSearchSpeculative(size_t numGraphs) const {
+  return draft_ && beamSize_ == 1 && numGraphs == 1
+         && !trgVocab_->tryAs<FactoredVocab>()
+         && !options_->hasAndNotEmpty("shortlist")
+         && !options_->hasAndNotEmpty("alignment")
+         && !nBest_;
+}
+
+Histories BeamSearch::searchSpeculative(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch) {
+  DECODER_PROFILE_START(profile);
+  const int origDimBatch = (int)batch->size();
+  const auto trgEosId = trgVocab_->getEosId();
+  const auto trgUnkId = trgVocab_->getUnkId();
+  const size_t numDraftTokens = options_->get<size_t>("speculative-tokens");
+  const bool cpu = graph->getDeviceId().type == DeviceType::cpu;
+
+  pool_ = New<HypothesisPool>();
+
+  // the rows are the positions of a single sentence, at most one more than the draft tokens
+  auto getNBestList = cpu ? GetNBestListFn() : createGetNBestListFn(/*beamSize=*/1, numDraftTokens + 1, graph->getDeviceId());
+  int unkColId = -1;
+  if(trgUnkId != Word::NONE && !allowUnk_)
+    unkColId = trgUnkId.toWordIndex();
+
+  // the log-probs or logits of a state as rows [positions, 1, 1, dimVocab]
+  auto rows = [](Expr logProbs) {
+    int dimVocab = logProbs->shape()[-1];
+    return reshape(logProbs, {logProbs->shape().elements() / dimVocab, 1, 1, dimVocab});
+  };
+  // weighted sum of the normalized log-probs of the large models
+  auto combine = [&](const std::vector<Ptr<ScorerState>>& states) {
+    Expr scores;
+    for(size_t i = 0; i < scorers_.size(); ++i) {
+      auto logProbs = states[i]->getLogProbs().getLogits();
+      if(!states[i]->isNormalized())
+        logProbs = logsoftmax(logProbs);
+      logProbs = scorers_[i]->getWeight() * logProbs;
+      scores = scores ? scores + logProbs : logProbs;
+    }
+    return rows(scores);
+  };
+  // the best word of each row and its score, after the graph has been computed
+  std::vector<float> bestScores;
+  std::vector<unsigned> bestKeys;
+  auto best = [&](Expr scores, Words& words) {
+    bestScores.clear();
+    bestKeys.clear();
+    if(cpu) {
+      getBestPerRow(scores->val(), unkColId, bestScores, bestKeys);
+    } else {
+      if(unkColId != -1)
+        suppressWord(scores, unkColId);
+      getNBestList(scores->val(), /*N=*/1, bestScores, bestKeys, /*first=*/true);
+    }
+    const size_t vocabSize = scores->shape()[-1];
+    words.clear();
+    for(auto key : bestKeys)
+      words.push_back(Word::fromWordIndex(key % vocabSize));
+  };
+
+  auto maxLengths = getMaxLengths(batch);
+  const auto& srcEosId = batch->front()->vocab()->getEosId();
+
+  Histories histories(origDimBatch);
+  for(int origBatchIdx = 0; origBatchIdx < origDimBatch; ++origBatchIdx) {
+    auto history = New<History>(batch->getSentenceIds()[origBatchIdx],
+                                normalize_,
+                                wordPenalty_,
+                                pool_);
+    histories[origBatchIdx] = history;
+
+    // token buffer and path score after each of the tokens
+    Words words;
+    std::vector<float> pathScores;
+    auto finish = [&]() {
+      auto hyp = pool_->New();
+      for(size_t i = 0; i < words.size(); ++i)
+        hyp = pool_->New(hyp, words[i], /*prevBeamHypIdx=*/0, pathScores[i]);
+      history->addFinal(hyp, words.size());
+    };
+
+    if(batch->front()->data()[origBatchIdx] == srcEosId) { // empty line, see search()
+      words.push_back(trgEosId);
+      pathScores.push_back(0.f);
+      finish();
+      continue;
+    }
+
+    auto sentence = batch->select({(size_t)origBatchIdx});
+    const size_t maxLength = (size_t)maxLengths[origBatchIdx];
+
+    for(auto scorer : scorers_)
+      scorer->clear(graph);
+    draft_->clear(graph);
+
+    std::vector<Ptr<ScorerState>> states;
+    for(auto scorer : scorers_)
+      states.push_back(scorer->startState(graph, sentence));
+    auto draftState = draft_->startState(graph, sentence);
+    if(DECODER_PROFILE_ENABLED(profile)) // run the encoders on their own to time them
+      graph->forward();
+    DECODER_PROFILE_LAP(profile, Encoder);
+
+    // the first token is chosen by the large models as in the greedy search
+    for(size_t i = 0; i < scorers_.size(); ++i)
+      states[i] = scorers_[i]->step(graph, states[i], {}, {}, {0}, /*beamSize=*/1);
+    // the draft takes the same BOS step, its proposals start from the first token
+    draftState = draft_->step(graph, draftState, {}, {}, {0}, /*beamSize=*/1);
+    auto scores = combine(states);
+    graph->forward();
+    DECODER_PROFILE_COUNT(profile, steps, 1);
+    Words choices;
+    best(scores, choices);
+    words.push_back(choices[0]);
+    pathScores.push_back(bestScores[0]);
+    DECODER_PROFILE_LAP(profile, Forward);
+
+    // After BOS, the large models have consumed all tokens but the last one. The draft has consumed
+    // the first draftPos tokens, usually also all but the last one.
+    size_t draftPos = 0;
+    while(words.back() != trgEosId && words.size() < maxLength) {
+      // the draft proposes tokens after the last one
+      const size_t numTokens = words.size();
+      const size_t maxProposals = std::min(numDraftTokens, maxLength - numTokens - 1);
+      Words proposals;
+      std::vector<Ptr<ScorerState>> draftStates; // [j] has consumed numTokens + j tokens
+      for(size_t j = 0; j < maxProposals && (proposals.empty() || proposals.back() != trgEosId); ++j) {
+        if(j > 0)
+          draftState = draft_->step(graph, draftState, {}, {proposals.back()}, {0}, /*beamSize=*/1);
+        else if(numTokens - draftPos == 1)
+          draftState = draft_->step(graph, draftState, {}, {words.back()}, {0}, /*beamSize=*/1);
+        else
+          draftState = draft_->stepTokens(graph, draftState, Words(words.begin() + draftPos, words.end()));
+        draftStates.push_back(draftState);
+        auto draftScores = rows(draftState->getLogProbs().getLogits());
+        draftScores = slice(draftScores, 0, draftScores->shape()[0] - 1); // the last position
+        graph->forwardNext();
+        Words proposal;
+        best(draftScores, proposal);
+        proposals.push_back(proposal[0]);
+      }
+      DECODER_PROFILE_LAP(profile, TopK);
+
+      // the large models score the last token and all proposals in one step
+      Words input(1, words.back());
+      input.insert(input.end(), proposals.begin(), proposals.end());
+      for(size_t i = 0; i < scorers_.size(); ++i)
+        states[i] = input.size() == 1 ? scorers_[i]->step(graph, states[i], {}, input, {0}, /*beamSize=*/1)
+                                      : scorers_[i]->stepTokens(graph, states[i], input);
+      scores = combine(states);
+      graph->forwardNext();
+      DECODER_PROFILE_COUNT(profile, steps, 1);
+      best(scores, choices); // [j] the choice after input[j]
+      DECODER_PROFILE_LAP(profile, Forward);
+
+      // keep the agreeing proposals and the choice of the large models after them
+      size_t accepted = 0;
+      while(accepted < proposals.size() && proposals[accepted] == choices[accepted])
+        accepted++;
+      proposedTokens_ += proposals.size();
+      acceptedTokens_ += accepted;
+      for(size_t j = 0; j <= accepted; ++j) {
+        words.push_back(choices[j]);
+        pathScores.push_back(pathScores.back() + bestScores[j]);
+        if(choices[j] == trgEosId)
+          break;
+      }
+
+      // drop the positions of the rejected proposals from the states
+      if(accepted < proposals.size())
+        for(size_t i = 0; i < scorers_.size(); ++i)
+          states[i] = scorers_[i]->truncate(states[i], /*BOS=*/1 + numTokens + accepted);
+      if(!draftStates.empty()) {
+        size_t j = std::min(accepted, draftStates.size() - 1);
+        draftState = draftStates[j];
+        draftPos = numTokens + j;
+      }
+      DECODER_PROFILE_LAP(profile, History);
+    }
+    finish();
+  }
+
+  DECODER_PROFILE_FINISH(profile, origDimBatch);
+  return histories;
+}
+
+bool BeamSearch::canSearchOnDevice() const {
+  return options_->get<size_t>("device-search-sync", 0) > 0
+         && !trgVocab_->tryAs<FactoredVocab>()
+         && !options_->hasAndNotEmpty("shortlist");
+}
+
+Histories BeamSearch::searchGreedyOnDevice(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch) {
+  DECODER_PROFILE_START(profile);
+  const int dimBatch = (int)batch->size();
+  const auto trgEosId = trgVocab_->getEosId();
+  const auto trgUnkId = trgVocab_->getUnkId();
+  const size_t syncSteps = options_->get<size_t>("device-search-sync");
+
+  pool_ = New<HypothesisPool>();
+
+  for(auto scorer : scorers_)
+    scorer->clear(graph);
+
+  std::vector<Ptr<ScorerState>> states;
+  for(auto scorer : scorers_)
+    states.push_back(scorer->startState(graph, batch));
+  if(DECODER_PROFILE_ENABLED(profile)) // run the encoders on their own to time them
+    graph->forward();
+  DECODER_PROFILE_LAP(profile, Encoder);
+
+  // empty source sentences are finished from the start, their output is replaced by EOS below
+  const auto& srcEosId = batch->front()->vocab()->getEosId();
+  std::vector<float> emptyBatchEntries(dimBatch);
+  for(int batchIdx = 0; batchIdx < dimBatch; ++batchIdx)
+    emptyBatchEntries[batchIdx] = batch->front()->data()[batchIdx] == srcEosId;
+
+  // every sentence consists of at least one word, see searchGreedy()
+  auto maxLengths = getMaxLengths(batch);
+  size_t maxSteps = 1;
+  for(auto maxLength : maxLengths)
+    maxSteps = std::max(maxSteps, (size_t)std::ceil(maxLength));
+
+  const bool suppressUnk = trgUnkId != Word::NONE && !allowUnk_;
+  std::vector<IndexType> batchIndices(dimBatch); // the batch is never purged
+  std::iota(batchIndices.begin(), batchIndices.end(), 0);
+
+  Expr words;       // [1, 1, dimBatch, 1] indices of the best words of the last step
+  Expr pathScores;  // [1, 1, dimBatch, 1]
+  Expr finished = graph->constant({1, 1, dimBatch, 1}, inits::fromVector(emptyBatchEntries), Type::float32);
+  Expr unkPenalty;  // [1, dimVocab]
+  std::vector<Expr> steps; // [1, 1, dimBatch, 2] per step: word index and path score, only copied at the end
+
+  DECODER_PROFILE_LAP(profile, Prepare);
+  size_t t = 0;
+  while(t < maxSteps) {
+    DECODER_PROFILE_COUNT(profile, steps, 1);
+    Expr scores; // [1, 1, dimBatch, dimVocab]
+    for(size_t i = 0; i < scorers_.size(); ++i) {
+      if(t == 0)
+        states[i] = scorers_[i]->step(graph, states[i], /*hypIndices=*/{}, /*words=*/{}, batchIndices, /*beamSize=*/1);
+      else
+        states[i] = scorers_[i]->step(graph, states[i], words, dimBatch);
+      auto logProbs = states[i]->getLogProbs().getLogits();
+      if(!states[i]->isNormalized())
+        logProbs = logsoftmax(logProbs);
+      logProbs = scorers_[i]->getWeight() * logProbs;
+      scores = scores ? scores + logProbs : logProbs;
+    }
+
+    if(suppressUnk) {
+      if(!unkPenalty) {
+        std::vector<float> penalty(scores->shape()[-1], 0.f);
+        penalty[trgUnkId.toWordIndex()] = INVALID_PATH_SCORE;
+        unkPenalty = graph->constant({1, (int)penalty.size()}, inits::fromVector(penalty), scores->value_type());
+      }
+      scores = scores + unkPenalty;
+    }
+
+    auto best = argmax(scores, /*axis=*/-1);
+    words = get<1>(best);
+    pathScores = pathScores ? pathScores + get<0>(best) : get<0>(best);
+    auto wordIndices = cast(words, Type::float32);
+    finished = maximum(finished, eq(wordIndices, (float)trgEosId.toWordIndex()));
+    steps.push_back(concatenate({wordIndices, cast(pathScores, Type::float32)}, /*axis=*/-1));
+
+    if(t == 0)
+      graph->forward();
+    else
+      graph->forwardNext();
+    DECODER_PROFILE_LAP(profile, Forward);
+
+    // the only copy to the host while decoding, every syncSteps steps
+    ++t;
+    if(t % syncSteps == 0 && t < maxSteps) {
+      std::vector<float> done;
+      finished->val()->get(done);
+      if(std::all_of(done.begin(), done.end(), [](float d) { return d != 0.f; }))
+        break;
+    }
+    DECODER_PROFILE_LAP(profile, TopK);
+  }
+
+  // traceback of all steps with one copy
+  auto output = concatenate(steps, /*axis=*/0); // [steps, 1, dimBatch, 2]
+  graph->forwardNext();
+  std::vector<float> values;
+  output->val()->get(values);
+
+  Histories histories(dimBatch);
+  for(int batchIdx = 0; batchIdx < dimBatch; ++batchIdx) {
+    histories[batchIdx] = New<History>(batch->getSentenceIds()[batchIdx],
+                                       normalize_,
+                                       wordPenalty_,
+                                       pool_);
+    auto hyp = pool_->New();
+    size_t length = 0;
+    if(emptyBatchEntries[batchIdx] != 0.f) {
+      hyp = pool_->New(hyp, trgEosId, /*prevBeamHypIdx=*/0, /*pathScore=*/0.f);
+      length = 1;
+    } else {
+      for(size_t s = 0; s < t; ++s) {
+        const float* step = values.data() + (s * dimBatch + batchIdx) * 2;
+        auto word = Word::fromWordIndex((WordIndex)step[0]);
+        hyp = pool_->New(hyp, word, /*prevBeamHypIdx=*/0, step[1]);
+        ++length;
+        if(word == trgEosId || length >= maxLengths[batchIdx])
+          break;
+      }
+    }
+    histories[batchIdx]->addFinal(hyp, length);
+  }
+  DECODER_PROFILE_LAP(profile, History);
+
+  DECODER_PROFILE_FINISH(profile, dimBatch);
+  return histories;
+}
+
+Histories BeamSearch::search(const std::vector<Ptr<ExpressionGraph>>& graphs, Ptr<data::CorpusBatch> batch) {
+  if(canSearchSpeculative(graphs.size()))
+    return searchSpeculative(graphs[0], batch);
+  if(canSearchGreedy(graphs.size()))
+    return canSearchOnDevice() && !sampleInSearch(options_) ? searchGreedyOnDevice(graphs[0], batch)
+                                                            : searchGreedy(graphs[0], batch);
+
   auto factoredVocab = trgVocab_->tryAs<FactoredVocab>();
   size_t numFactorGroups = factoredVocab ? factoredVocab->getNumGroups() : 1;
   if (numFactorGroups == 1) // if no factors then we didn't need this object in the first place
     factoredVocab.reset();
 
+  // graph of the i-th scorer, the path scores are combined and searched on the first graph
+  ABORT_IF(graphs.size() != 1 && graphs.size() != scorers_.size(),
+           "Number of graphs ({}) must be 1 or match the number of scorers ({})", graphs.size(), scorers_.size());
+  auto graph = graphs[0];
+  auto scorerGraph = [&](size_t i) { return graphs.size() == 1 ? graph : graphs[i]; };
+  const bool parallel = graphs.size() > 1;
+  ABORT_IF(parallel && factoredVocab, "Parallel ensembles are not supported for factored vocabularies");
+  // one thread per scorer, kept by each decoding worker across batches instead of started per batch
+  thread_local UPtr<ThreadPool> scorerPool;
+  if(parallel && (!scorerPool || scorerPool->getNumThreads() != scorers_.size()))
+    scorerPool.reset(new ThreadPool(scorers_.size(), scorers_.size()));
+  DECODER_PROFILE_START(profile);
+
   // We will use the prefix "origBatch..." whenever we refer to batch dimensions of the original batch. These do not change during search.
   // We will use the prefix "currentBatch.." whenever we refer to batch dimension that can change due to batch-pruning.
   const int origDimBatch = (int)batch->size();
@@ -262,26 +817,33 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
 
   auto getNBestList = createGetNBestListFn(beamSize_, origDimBatch, graph->getDeviceId());
 
-  for(auto scorer : scorers_) {
-    scorer->clear(graph);
+  pool_ = New<HypothesisPool>(); // freed with the last of the returned histories
+
+  for(size_t i = 0; i < scorers_.size(); ++i) {
+    scorers_[i]->clear(scorerGraph(i));
   }
 
   Histories histories(origDimBatch);
   for(int i = 0; i < origDimBatch; ++i) {
     size_t sentId = batch->getSentenceIds()[i];
     histories[i] = New<History>(sentId,
-                                options_->get<float>("normalize"),
-                                options_->get<float>("word-penalty"));
+                                normalize_,
+                                wordPenalty_,
+                                pool_);
   }
 
   // start states
   std::vector<Ptr<ScorerState>> states;
-  for(auto scorer : scorers_) {
-    states.push_back(scorer->startState(graph, batch));
+  for(size_t i = 0; i < scorers_.size(); ++i) {
+    states.push_back(scorers_[i]->startState(scorerGraph(i), batch));
   }
+  if(DECODER_PROFILE_ENABLED(profile)) // run the encoders on their own to time them
+    for(auto g : graphs)
+      g->forward();
+  DECODER_PROFILE_LAP(profile, Encoder);
 
   // create one beam per batch entry with sentence-start hypothesis
-  Beams beams(origDimBatch, Beam(beamSize_, Hypothesis::New())); // array [origDimBatch] of array [maxBeamSize] of Hypothesis, keeps full size through search.
+  Beams beams(origDimBatch, Beam(beamSize_, pool_->New())); // array [origDimBatch] of array [maxBeamSize] of Hypothesis, keeps full size through search.
                                                                  // batch purging is determined from an empty sub-beam.
   std::vector<IndexType> batchIdxMap(origDimBatch); // Record at which batch entry a beam is looking.
                                                     // By default that corresponds to position in array,
@@ -300,7 +862,7 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
 
   // determine index of UNK in the log prob vectors if we want to suppress it in the decoding process
   int unkColId = -1;
-  if (trgUnkId != Word::NONE && !options_->get<bool>("allow-unk", false)) { // do we need to suppress unk?
+  if (trgUnkId != Word::NONE && !allowUnk_) { // do we need to suppress unk?
     unkColId = factoredVocab ? factoredVocab->getUnkIndex() : trgUnkId.toWordIndex(); // what's the raw index of unk in the log prob vector?
     auto shortlist = scorers_[0]->getShortlist();      // first shortlist is generally ok, @TODO: make sure they are the same across scorers?
     if (shortlist)
@@ -317,10 +879,16 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
   //    with History: vector [t] of array [maxBeamSize] of Hypothesis
   //    with Hypothesis: (last word, aggregate score, prev Hypothesis)
 
+  // Maximum output length per batch entry, entries which do not produce EOS in time are retired
+  // and purged from the batch early with --max-length-per-sentence, see getMaxLengths()
+  auto maxLengths = getMaxLengths(batch);
+
   IndexType currentDimBatch = origDimBatch;
   auto prevBatchIdxMap = batchIdxMap; // [origBatchIdx -> currentBatchIdx] but shifted by one time step
   // main loop over output time steps
+  DECODER_PROFILE_LAP(profile, Prepare);
   for (size_t t = 0; ; t++) {
+    DECODER_PROFILE_COUNT(profile, steps, 1);
     ABORT_IF(origDimBatch != beams.size(), "Lost a batch entry??");
     // determine beam size for next output time step, as max over still-active sentences
     // E.g. if all batch entries are down from beam 5 to no more than 4 surviving hyps, then
@@ -344,6 +912,7 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       std::vector<IndexType> hypIndices;      // [maxBeamSize, 1, currentDimBatch, 1] (flattened) tensor index ((beamHypIdx, batchIdx), flattened) of prev hyp that a hyp originated from
       std::vector<Word> prevWords;            // [maxBeamSize, 1, currentDimBatch, 1] (flattened) word that a hyp ended in, for advancing the decoder-model's history
       Expr prevPathScores;                    // [maxBeamSize, 1, currentDimBatch, 1], path score that a hyp ended in (last axis will broadcast into vocab size when adding expandedPathScores)
+      std::vector<float> prevScores;          // [maxBeamSize, 1, currentDimBatch, 1] (flattened) values of prevPathScores, empty in first step
 
       bool anyCanExpand = false; // stays false if all hyps are invalid factor expansions
       if(t == 0 && factorGroup == 0) { // no scores yet
@@ -359,7 +928,6 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
             if(!beams[currentBatchIdx].empty() || !PURGE_BATCH)                           // for each beam check
               batchIndices.push_back(prevBatchIdxMap[currentBatchIdx]);                   // which batch entries were active in previous step
 
-        std::vector<float> prevScores;
         for(size_t beamHypIdx = 0; beamHypIdx < maxBeamSize; ++beamHypIdx) { // loop over globally maximal beam-size (maxBeamSize)
           for(int origBatchIdx = 0; origBatchIdx < origDimBatch; ++origBatchIdx) { // loop over all batch entries (active and inactive)
             auto& beam = beams[origBatchIdx];
@@ -398,6 +966,7 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
           currentDimBatch = (IndexType) batchIndices.size(); // keep batch size constant for all factor groups in a time step
         prevPathScores = graph->constant({(int)maxBeamSize, 1, (int)currentDimBatch, 1}, inits::fromVector(prevScores));
       }
+      DECODER_PROFILE_LAP(profile, Prepare);
       if (!anyCanExpand) // all words cannot expand this factor: skip
         continue;
 
@@ -405,8 +974,36 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       // compute expanded path scores with word prediction probs from all scorers
       auto expandedPathScores = prevPathScores; // will become [maxBeamSize, 1, currDimBatch, dimVocab]
       Expr logProbs;
+      bool fused = false; // if true, expandedPathScores holds raw logits and the normalization happens during n-best search
+
+      // step all scorers concurrently, each one on its own graph, their log-probs are then copied
+      // to the main graph and combined there like those of scorers sharing a graph
+      std::vector<Expr> parallelLogProbs;
+      if(parallel) {
+        std::vector<std::future<void>> steps;
+        parallelLogProbs.resize(scorers_.size());
+        for(size_t i = 0; i < scorers_.size(); ++i) {
+          steps.emplace_back(scorerPool->enqueue([&, i]() {
+            states[i] = scorers_[i]->step(graphs[i], states[i], hypIndices, prevWords, batchIndices, (int)maxBeamSize);
+            parallelLogProbs[i] = states[i]->getLogProbs().getLogits(); // [maxBeamSize, 1, currentDimBatch, dimVocab]
+            if(t == 0)
+              graphs[i]->forward();
+            else
+              graphs[i]->forwardNext();
+          }));
+        }
+        for(auto& step : steps) // all of them, the pool outlives this search
+          step.wait();
+        for(auto& step : steps)
+          step.get(); // also rethrows exceptions from the scorer threads
+      }
+
       for(size_t i = 0; i < scorers_.size(); ++i) {
-        if (factorGroup == 0) {
+        if(parallel) {
+          logProbs = i == 0 ? parallelLogProbs[i]
+                            : graph->constant(parallelLogProbs[i]->shape(), inits::fromTensor(parallelLogProbs[i]->val()));
+        }
+        else if (factorGroup == 0) {
           // compute output probabilities for current output time step
           //  - uses hypIndices[index in beam, 1, batch index, 1] to reorder scorer state to reflect the top-N in beams[][]
           //  - adds prevWords [index in beam, 1, batch index, 1] to the scorer's target history
@@ -439,25 +1036,36 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
           // previous hypothesis.
           logProbs = states[i]->getLogProbs().getFactoredLogits(factorGroup, /*shortlist=*/ nullptr, hypIndices, maxBeamSize); // [maxBeamSize, 1, currentDimBatch, dimVocab]
         }
+        // a single scorer may leave the log-softmax to us, which is then fused with the n-best search
+        if(!states[i]->isNormalized()) {
+          ABORT_IF(scorers_.size() != 1 || factorGroup != 0, "Unnormalized scores are only supported for a single scorer without factors");
+          expandedPathScores = logProbs; // [maxBeamSize, 1, currentDimBatch, dimVocab], raw logits
+          fused = true;
+          continue;
+        }
         // expand all hypotheses, [maxBeamSize, 1, currentDimBatch, 1] -> [maxBeamSize, 1, currentDimBatch, dimVocab]
         expandedPathScores = expandedPathScores + scorers_[i]->getWeight() * logProbs;
       }
 
-      // make beams continuous
-      expandedPathScores = swapAxes(expandedPathScores, 0, 2); // -> [currentDimBatch, 1, maxBeamSize, dimVocab]
+      // make beams continuous, the fused search handles the original layout
+      if(!fused)
+        expandedPathScores = swapAxes(expandedPathScores, 0, 2); // -> [currentDimBatch, 1, maxBeamSize, dimVocab]
 
       // perform NN computation
       if(t == 0 && factorGroup == 0)
         graph->forward();
       else
         graph->forwardNext();
+      DECODER_PROFILE_LAP(profile, Forward);
 
       //**********************************************************************
       // suppress specific symbols if not at right positions
-      if(unkColId != -1 && factorGroup == 0)
-        suppressWord(expandedPathScores, unkColId);
-      for(auto state : states)
-        state->blacklist(expandedPathScores, batch);
+      if(!fused) { // the fused search suppresses unk itself
+        if(unkColId != -1 && factorGroup == 0)
+          suppressWord(expandedPathScores, unkColId);
+        for(auto state : states)
+          state->blacklist(expandedPathScores, batch);
+      }
 
       //**********************************************************************
       // perform beam search
@@ -465,17 +1073,27 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       // find N best amongst the (maxBeamSize * dimVocab) hypotheses
       std::vector<unsigned int> nBestKeys; // [currentDimBatch, maxBeamSize] flattened -> (batchIdx, beamHypIdx, word idx) flattened
       std::vector<float> nBestPathScores;  // [currentDimBatch, maxBeamSize] flattened
-      getNBestList(/*in*/   expandedPathScores->val(),   // [currentDimBatch, 1, maxBeamSize, dimVocab or dimShortlist]
-                  /*N=*/    maxBeamSize,                 // desired beam size
-                  /*out*/   nBestPathScores,
-                   /*out*/  nBestKeys,
-                  /*first=*/t == 0 && factorGroup == 0); // @TODO: this is only used for checking presently, and should be removed altogether
+      if(fused)
+        getNBestListFusedLogSoftmax(/*in*/  expandedPathScores->val(), // [maxBeamSize, 1, currentDimBatch, dimVocab or dimShortlist], raw logits
+                                    /*in*/  prevScores,                // empty in first step
+                                    /*weight=*/scorers_[0]->getWeight(),
+                                    /*suppressedWordIdx=*/unkColId,
+                                    /*N=*/  maxBeamSize,
+                                    /*out*/ nBestPathScores,
+                                    /*out*/ nBestKeys);
+      else
+        getNBestList(/*in*/   expandedPathScores->val(),   // [currentDimBatch, 1, maxBeamSize, dimVocab or dimShortlist]
+                    /*N=*/    maxBeamSize,                 // desired beam size
+                    /*out*/   nBestPathScores,
+                     /*out*/  nBestKeys,
+                    /*first=*/t == 0 && factorGroup == 0); // @TODO: this is only used for checking presently, and should be removed altogether
       // Now, nBestPathScores contain N-best expandedPathScores for each batch and beam,
       // and nBestKeys for each their original location (batchIdx, beamHypIdx, word).
+      DECODER_PROFILE_LAP(profile, TopK);
 
       // combine N-best sets with existing search space (beams) to updated search space
       beams = toHyps(nBestKeys, nBestPathScores,
-                     /*nBestBeamSize*/expandedPathScores->shape()[-2], // used for interpretation of keys
+                     /*nBestBeamSize*/expandedPathScores->shape()[fused ? -4 : -2], // used for interpretation of keys
                      /*vocabSize=*/expandedPathScores->shape()[-1],    // used for interpretation of keys
                      beams,
                      states,            // used for keeping track of per-ensemble-member path score
@@ -483,6 +1101,7 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
                      factoredVocab, factorGroup,
                      emptyBatchEntries, // [origDimBatch] - empty source batch entries are marked with true
                      batchIdxMap);      // used to create a reverse batch index map to recover original batch indices for this step
+      DECODER_PROFILE_LAP(profile, ToHyps);
     } // END FOR factorGroup = 0 .. numFactorGroups-1
 
     prevBatchIdxMap = batchIdxMap; // save current batchIdx map to be used in next step; we are then going to look one step back
@@ -490,25 +1109,46 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
     // remove all hyps that end in EOS
     // The position of a hyp in the beam may change.
     // in/out = shifts the batch index map if a beam gets fully purged
-    const auto purgedNewBeams = purgeBeams(beams, /*in/out=*/batchIdxMap);
+    auto purgedNewBeams = purgeBeams(beams, /*in/out=*/batchIdxMap);
+    DECODER_PROFILE_LAP(profile, Purge);
 
     // add updated search space (beams) to our return value
     bool maxLengthReached = false;
+    bool anyActive = false;
     for(int batchIdx = 0; batchIdx < origDimBatch; ++batchIdx) {
       // if this batch entry has surviving hyps then add them to the traceback grid
       if(!beams[batchIdx].empty()) { // if the beam is not empty expand the history object associated with the beam
-        if (histories[batchIdx]->size() >= options_->get<float>("max-length-factor") * batch->front()->batchWidth())
+        if (histories[batchIdx]->size() >= maxLengths[batchIdx]) {
+          // retire this batch entry, shift the batch index map like purgeBeams() does for finished entries
+          if(!purgedNewBeams[batchIdx].empty()) {
+            purgedNewBeams[batchIdx].clear();
+            if(PURGE_BATCH)
+              for(size_t i = batchIdx + 1; i < batchIdxMap.size(); ++i)
+                batchIdxMap[i] = batchIdxMap[i] - 1;
+          }
           maxLengthReached = true;
-        histories[batchIdx]->add(beams[batchIdx], trgEosId, purgedNewBeams[batchIdx].empty() || maxLengthReached);
+          histories[batchIdx]->add(beams[batchIdx], trgEosId, /*last=*/true);
+        } else {
+          histories[batchIdx]->add(beams[batchIdx], trgEosId, purgedNewBeams[batchIdx].empty());
+          // retire the entry if no hypothesis is worth expanding, shifting the batch index map as above
+          if(!purgedNewBeams[batchIdx].empty()
+             && pruneBeam(beams[batchIdx], purgedNewBeams[batchIdx], *histories[batchIdx], maxLengths[batchIdx])
+             && PURGE_BATCH)
+            for(size_t i = batchIdx + 1; i < batchIdxMap.size(); ++i)
+              batchIdxMap[i] = batchIdxMap[i] - 1;
+        }
+        anyActive |= !purgedNewBeams[batchIdx].empty();
       }
     }
-    if (maxLengthReached) // early exit if max length limit was reached
+    DECODER_PROFILE_LAP(profile, History);
+    if (maxLengthReached && (!PURGE_BATCH || !anyActive)) // early exit if max length limit was reached for all entries
       break;
 
     // this is the search space for the next output time step
     beams = purgedNewBeams;
   } // end of main loop over output time steps
 
+  DECODER_PROFILE_FINISH(profile, origDimBatch);
   return histories; // [origDimBatch][t][N best hyps]
 }
 
@@ -10,16 +10,41 @@ class BeamSearch {
 private:
   Ptr<Options> options_;
   std::vector<Ptr<Scorer>> scorers_;
+  Ptr<Scorer> draft_; // with --speculative-tokens the last model, not part of scorers_
   size_t beamSize_;
   Ptr<const Vocab> trgVocab_;
+  Ptr<HypothesisPool> pool_; // hypotheses of the current search, shared with the returned histories
+
+  // options used in every step, read once instead of looked up per hypothesis or sentence
+  const bool nBest_;
+  const bool allowUnk_;
+  const float normalize_;
+  const float wordPenalty_;
+  const float beamThreshold_;
+  const bool beamEarlyStop_;
+
+  // draft tokens proposed and accepted by searchSpeculative() so far
+  size_t proposedTokens_{0};
+  size_t acceptedTokens_{0};
 
   const float INVALID_PATH_SCORE = std::numeric_limits<float>::lowest(); // @TODO: observe this closely
   const bool PURGE_BATCH = true; // @TODO: diagnostic, to-be-removed once confirmed there are no issues.
 
 public:
   BeamSearch(Ptr<Options> options, const std::vector<Ptr<Scorer>>& scorers, const Ptr<const Vocab> trgVocab)
-      : options_(options), scorers_(scorers), beamSize_(options_->get<size_t>("beam-size")), trgVocab_(trgVocab)
-  {}
+      : options_(options), scorers_(scorers), beamSize_(options_->get<size_t>("beam-size")), trgVocab_(trgVocab),
+        nBest_(options_->get<bool>("n-best")),
+        allowUnk_(options_->get<bool>("allow-unk", false)),
+        normalize_(options_->get<float>("normalize")),
+        wordPenalty_(options_->get<float>("word-penalty")),
+        beamThreshold_(options_->get<float>("beam-threshold", 0.f)),
+        beamEarlyStop_(options_->get<bool>("beam-early-stop", false))
+  {
+    if(options_->get<size_t>("speculative-tokens", 0) > 0 && scorers_.size() > 1) {
+      draft_ = scorers_.back();
+      scorers_.pop_back();
+    }
+  }
 
   // combine new expandedPathScores and previous beams into new set of beams
   Beams toHyps(const std::vector<unsigned int>& nBestKeys, // [currentDimBatch, beamSize] flattened -> ((batchIdx, beamHypIdx) flattened, word idx) flattened
@@ -33,19 +58,51 @@ public:
                const std::vector<bool>& dropBatchEntries, // [origDimBatch] - empty source batch entries are marked with true, should be cleared after first use.
                const std::vector<IndexType>& batchIdxMap) const;
 
-  std::vector<float> getAlignmentsForHypothesis( // -> P(s|t) for current t and given beam and batch dim
-      const std::vector<float> alignAll, // [beam depth, max src length, batch size, 1], flattened vector of all attention probablities
-      Ptr<data::CorpusBatch> batch,
-      int beamHypIdx,
-      int currentBatchIdx,
-      int origBatchIdx,
-      int currentDimBatch) const;
+  std::vector<float> getMaxLengths(Ptr<data::CorpusBatch> batch) const; // [origDimBatch]
 
   // remove all beam entries that have reached EOS
   Beams purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexType>& batchIdxMap);
 
+  // Removes the hypotheses from activeBeam, the unfinished hypotheses of beam, that --beam-threshold
+  // and --beam-early-stop rule out, given the history of the sentence to which beam has been added
+  // and its maximum length. Returns true if this removed all of them, i.e. the sentence is done.
+  bool pruneBeam(const Beam& beam, Beam& activeBeam, const History& history, float maxLength) const;
+
+  // Specialization of search() for a beam size of 1 on a single graph. Keeps one token buffer and
+  // path score per sentence instead of beams of hypotheses, the hypotheses for the traceback are
+  // only created once a sentence is finished. Falls back to the general search for factored
+  // vocabularies and when alignments or n-best lists are requested.
+  bool canSearchGreedy(size_t numGraphs) const;
+  Histories searchGreedy(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch);
+
+  // Variant of searchGreedy() for --device-search-sync. The best words, path scores and finished flags
+  // stay on the device: the next step looks up the embeddings of the argmax indices directly, and the
+  // host only checks every --device-search-sync steps whether all sentences are finished. The batch
+  // is therefore never purged, and the words and scores of all steps are copied once at the end.
+  // Not used for factored vocabularies and shortlists, which need the words on the host.
+  bool canSearchOnDevice() const;
+  Histories searchGreedyOnDevice(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch);
+
+  // Speculative greedy search with --speculative-tokens K: the draft model, the last of --models,
+  // proposes up to K tokens greedily, which the other models then score in a single decoder step
+  // over all of them. The longest prefix of the proposals that agrees with the greedy choices of
+  // these models is kept, followed by their own choice at the first disagreement, so the result is
+  // that of the greedy search without the draft, with up to K + 1 tokens per step of the large
+  // models. Decodes the sentences of the batch one by one. Requires transformer models with
+  // self-attention decoders, and falls back to the other searches when a beam size other than 1, a
+  // shortlist, factors, alignments, n-best lists or several graphs are used.
+  bool canSearchSpeculative(size_t numGraphs) const;
+  Histories searchSpeculative(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch);
+  size_t getProposedTokens() const { return proposedTokens_; }
+  size_t getAcceptedTokens() const { return acceptedTokens_; }
+
   // main decoding function
   Histories search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch);
+
+  // Decodes with each scorer on its own graph (graphs[i] for scorers_[i], e.g. on different devices).
+  // The scorers of an ensemble are then stepped concurrently and their log-probs are combined on
+  // graphs[0] after all of them are done. A single graph is used for all scorers.
+  Histories search(const std::vector<Ptr<ExpressionGraph>>& graphs, Ptr<data::CorpusBatch> batch);
 };
 
 }  // namespace marian
@@ -0,0 +1,138 @@
+#include "translator/decoder_profiler.h"
+
+#include "common/file_stream.h"
+#include "common/logging.h"
+
+#include <cmath>
+
+namespace marian {
+namespace profiling {
+
+static const char* PHASE_NAMES[NumPhases] = {"encoder", "prepare", "forward", "topk", "tohyps", "purge", "history"};
+
+void Histogram::add(double us) {
+  size_t bucket = us < 1. ? 0 : std::min((size_t)std::log2(us) + 1, NUM_BUCKETS - 1);
+  buckets_[bucket]++;
+  count_++;
+  total_ += us;
+  max_ = std::max(max_, us);
+}
+
+void Histogram::merge(const Histogram& other) {
+  for(size_t i = 0; i < NUM_BUCKETS; ++i)
+    buckets_[i] += other.buckets_[i];
+  count_ += other.count_;
+  total_ += other.total_;
+  max_ = std::max(max_, other.max_);
+}
+
+double Histogram::percentile(double p) const {
+  if(count_ == 0)
+    return 0.;
+  size_t rank = (size_t)std::ceil(p / 100. * count_);
+  size_t seen = 0;
+  for(size_t i = 0; i < NUM_BUCKETS; ++i) {
+    seen += buckets_[i];
+    if(seen >= rank && buckets_[i] > 0)
+      return std::min(std::ldexp(1., (int)i), max_); // 2^i is the upper bound of bucket i
+  }
+  return max_;
+}
+
+Ptr<DecoderProfiler>& DecoderProfiler::global() {
+  static Ptr<DecoderProfiler> profiler;
+  return profiler;
+}
+
+Ptr<DecoderProfiler> DecoderProfiler::create(Ptr<Options> options) {
+  auto path = options->get<std::string>("decoder-profile", "");
+  if(path.empty())
+    return nullptr;
+#ifdef COMPILE_DECODER_PROFILING
+  LOG(info, "[profiling] Collecting timings of the decoder phases");
+  global() = New<DecoderProfiler>(path);
+  return global();
+#else
+  LOG(warn, "[profiling] Ignoring --decoder-profile, Marian has not been compiled with COMPILE_DECODER_PROFILING");
+  return nullptr;
+#endif
+}
+
+UPtr<SearchProfile> DecoderProfiler::startSearch() {
+  return UPtr<SearchProfile>(global() ? new SearchProfile() : nullptr);
+}
+
+void DecoderProfiler::finishSearch(UPtr<SearchProfile>& profile, size_t sentences) {
+  auto profiler = global();
+  if(!profile || !profiler)
+    return;
+  profile->sentences += sentences;
+  profiler->add(*profile);
+  profile.reset();
+}
+
+void DecoderProfiler::add(const SearchProfile& profile) {
+  double elapsed = profile.elapsed();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for(size_t i = 0; i < NumPhases; ++i)
+    phases_[i].merge(profile.phases[i]);
+  batches_.add(elapsed);
+  sentences_ += profile.sentences;
+  steps_ += profile.steps;
+}
+
+const char* DecoderProfiler::phaseName(Phase phase) {
+  return PHASE_NAMES[phase];
+}
+
+std::array<Histogram, NumPhases> DecoderProfiler::phases() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return phases_;
+}
+
+size_t DecoderProfiler::steps() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return steps_;
+}
+
+void DecoderProfiler::report() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(path_ == "log") {
+    LOG(info,
+        "[profiling] {} batches, {} sentences, {} steps, {:.2f} ms per batch (p50 {:.2f} ms, p99 {:.2f} ms)",
+        batches_.count(), sentences_, steps_,
+        batches_.mean() / 1000., batches_.percentile(50) / 1000., batches_.percentile(99) / 1000.);
+    for(size_t i = 0; i < NumPhases; ++i) {
+      const auto& h = phases_[i];
+      if(h.count() == 0)
+        continue;
+      LOG(info,
+          "[profiling] {:>8}: {:.1f} ms total, {} calls, mean {:.1f} us, p50 {:.0f} us, p90 {:.0f} us, p99 {:.0f} us, max {:.0f} us",
+          PHASE_NAMES[i], h.total() / 1000., h.count(), h.mean(),
+          h.percentile(50), h.percentile(90), h.percentile(99), h.max());
+    }
+    return;
+  }
+
+  auto toJson = [](const Histogram& h) {
+    return fmt::format("{{\"count\": {}, \"total_us\": {:.1f}, \"mean_us\": {:.1f}, \"p50_us\": {:.1f}, "
+                       "\"p90_us\": {:.1f}, \"p99_us\": {:.1f}, \"max_us\": {:.1f}}}",
+                       h.count(), h.total(), h.mean(), h.percentile(50), h.percentile(90), h.percentile(99), h.max());
+  };
+
+  io::OutputFileStream out(path_);
+  out << "{\n";
+  out << "  \"batches\": " << batches_.count() << ",\n";
+  out << "  \"sentences\": " << sentences_ << ",\n";
+  out << "  \"steps\": " << steps_ << ",\n";
+  out << "  \"batch\": " << toJson(batches_) << ",\n";
+  out << "  \"phases\": {\n";
+  for(size_t i = 0; i < NumPhases; ++i)
+    out << "    \"" << PHASE_NAMES[i] << "\": " << toJson(phases_[i]) << (i + 1 < NumPhases ? ",\n" : "\n");
+  out << "  }\n";
+  out << "}\n";
+  LOG(info, "[profiling] Decoder timings written to {}", path_);
+}
+
+}  // namespace profiling
+}  // namespace marian
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/options.h"
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+namespace marian {
+namespace profiling {
+
+// Phases of the beam search that are timed separately. Encoder covers building and running the
+// encoders, Forward building and running one decoder step. On GPUs the computation is asynchronous,
+// hence the time of a step is mostly attributed to TopK, which waits for the results.
+enum Phase : size_t { Encoder, Prepare, Forward, TopK, ToHyps, Purge, History, NumPhases };
+
+// Histogram of durations in microseconds with power-of-two buckets
+class Histogram {
+public:
+  static const size_t NUM_BUCKETS = 40;
+
+private:
+  std::array<size_t, NUM_BUCKETS> buckets_{}; // bucket i counts durations in [2^(i-1), 2^i) us
+  size_t count_{0};
+  double total_{0};
+  double max_{0};
+
+public:
+  void add(double us);
+  void merge(const Histogram& other);
+
+  size_t count() const { return count_; }
+  double total() const { return total_; }
+  double mean() const { return count_ > 0 ? total_ / count_ : 0.; }
+  double max() const { return max_; }
+  size_t bucket(size_t i) const { return buckets_[i]; }
+  // upper bound of the bucket holding the p-th percentile, p in [0, 100]
+  double percentile(double p) const;
+};
+
+// Timings and counters of a single call to BeamSearch::search()
+class SearchProfile {
+private:
+  using clock = std::chrono::steady_clock;
+  clock::time_point start_;
+  clock::time_point last_;
+
+public:
+  std::array<Histogram, NumPhases> phases;
+  size_t sentences{0};
+  size_t steps{0};
+
+  SearchProfile() : start_(clock::now()), last_(start_) {}
+
+  // attributes the time since the previous lap to the given phase
+  void lap(Phase phase) {
+    auto now = clock::now();
+    phases[phase].add(std::chrono::duration<double, std::micro>(now - last_).count());
+    last_ = now;
+  }
+
+  double elapsed() const { return std::chrono::duration<double, std::micro>(clock::now() - start_).count(); }
+};
+
+// Collects the profiles of all searches from all threads, see --decoder-profile. Only used if
+// compiled with COMPILE_DECODER_PROFILING, otherwise the macros below expand to nothing.
+class DecoderProfiler {
+private:
+  std::string path_; // "log" or path of a JSON file
+
+  std::mutex mutex_;
+  std::array<Histogram, NumPhases> phases_;
+  Histogram batches_; // time per search call
+  size_t sentences_{0};
+  size_t steps_{0};
+
+  static Ptr<DecoderProfiler>& global();
+
+public:
+  DecoderProfiler(const std::string& path) : path_(path) {}
+
+  // Enables profiling for all searches if requested with --decoder-profile, returns the profiler or nullptr
+  static Ptr<DecoderProfiler> create(Ptr<Options> options);
+
+  // Returns a new profile for a search if profiling is enabled, nullptr otherwise
+  static UPtr<SearchProfile> startSearch();
+  static void finishSearch(UPtr<SearchProfile>& profile, size_t sentences);
+
+  void add(const SearchProfile& profile);
+
+  static const char* phaseName(Phase phase);
+
+  // Copies of the statistics collected so far, e.g. for the metrics of marian-server
+  std::array<Histogram, NumPhases> phases();
+  size_t steps();
+
+  // Logs the collected statistics or writes them as JSON, depending on --decoder-profile
+  void report();
+};
+
+}  // namespace profiling
+}  // namespace marian
+
+#ifdef COMPILE_DECODER_PROFILING
+#define DECODER_PROFILE_START(profile) auto profile = marian::profiling::DecoderProfiler::startSearch()
+#define DECODER_PROFILE_LAP(profile, phase) \
+  if(profile)                               \
+  profile->lap(marian::profiling::phase)
+#define DECODER_PROFILE_COUNT(profile, counter, n) \
+  if(profile)                                      \
+  profile->counter += (n)
+#define DECODER_PROFILE_FINISH(profile, sentences) \
+  marian::profiling::DecoderProfiler::finishSearch(profile, sentences)
+#define DECODER_PROFILE_ENABLED(profile) (profile != nullptr)
+#else
+#define DECODER_PROFILE_START(profile)
+#define DECODER_PROFILE_LAP(profile, phase)
+#define DECODER_PROFILE_COUNT(profile, counter, n)
+#define DECODER_PROFILE_FINISH(profile, sentences)
+#define DECODER_PROFILE_ENABLED(profile) false
+#endif
@@ -2,6 +2,6 @@
 
 namespace marian {
 
-History::History(size_t lineNo, float alpha, float wp)
-    : lineNo_(lineNo), alpha_(alpha), wp_(wp) {}
+History::History(size_t lineNo, float alpha, float wp, Ptr<HypothesisPool> pool)
+    : lineNo_(lineNo), alpha_(alpha), wp_(wp), pool_(pool) {}
 }  // namespace marian
@@ -3,6 +3,7 @@
 #include "data/types.h"
 #include "hypothesis.h"
 
+#include <limits>
 #include <queue>
 
 namespace marian {
@@ -22,7 +23,8 @@ private:
   float lengthPenalty(size_t length) { return std::pow((float)length, alpha_); }
   float wordPenalty(size_t length) { return wp_ * (float)length; }
 public:
-  History(size_t lineNo, float alpha = 1.f, float wp_ = 0.f);
+  // pool owns the hypotheses added to this history, it is shared with the other histories of a search
+  History(size_t lineNo, float alpha = 1.f, float wp_ = 0.f, Ptr<HypothesisPool> pool = nullptr);
 
   void add(const Beam& beam, Word trgEosId, bool last = false) {
     if(beam.back()->getPrevHyp() != nullptr) { // if not start hyp do
@@ -35,8 +37,22 @@ public:
     history_.push_back(beam);
   }
 
+  // Adds a complete sentence hypothesis of the given length (number of target words including
+  // EOS) at once, without the beams of the intermediate time steps, e.g. from greedy search.
+  void addFinal(Hypothesis::PtrType hyp, size_t length) {
+    history_.resize(length); // intermediate time steps stay empty
+    float pathScore = (hyp->getPathScore() - wordPenalty(length)) / lengthPenalty(length);
+    topHyps_.push({length, 0, pathScore});
+    history_.push_back(Beam(1, hyp));
+  }
+
   size_t size() const { return history_.size(); } // number of time steps
 
+  // length-normalized score of the best finished hypothesis, -inf if there is none yet
+  float bestFinalScore() const {
+    return topHyps_.empty() ? -std::numeric_limits<float>::infinity() : topHyps_.top().normalizedPathScore;
+  }
+
   /* return n best hypotheses
    * @param n size of n-best list
    * @param skipEmpty skip empty hypotheses (see also: https://arxiv.org/abs/1908.10090)
@@ -78,6 +94,7 @@ private:
   size_t lineNo_;
   float alpha_;
   float wp_;
+  Ptr<HypothesisPool> pool_; // keeps the hypotheses in history_ alive
 };
 
 typedef std::vector<Ptr<History>> Histories; // [batchDim]
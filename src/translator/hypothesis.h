@@ -1,22 +1,48 @@
 #pragma once
 #include <memory>
+#include <new>
+#include <type_traits>
 
 #include "common/definitions.h"
 #include "data/alignment.h"
 
 namespace marian {
 
+class HypothesisPool;
+
+// Attention weights of one step of the search for all hypotheses of the batch, shared by the
+// hypotheses created in that step. The alignment of a hypothesis is only gathered from them when it
+// is asked for, which usually happens for the final hypotheses only.
+struct StepAttention {
+  std::vector<float> values;  // [beam depth, max src length, current batch size] flattened -> P(s|t)
+  std::vector<float> srcMask; // [max src length, orig batch size] flattened
+  size_t srcLength;
+  size_t currentDimBatch;
+  size_t origDimBatch;
+
+  // P(s|t) over the unmasked source positions of one hypothesis
+  std::vector<float> get(size_t beamHypIdx, size_t currentBatchIdx, size_t origBatchIdx) const {
+    std::vector<float> align;
+    for(size_t srcPos = 0; srcPos < srcLength; ++srcPos)
+      if(srcMask[srcPos * origDimBatch + origBatchIdx] != 0)
+        align.push_back(values[(srcLength * beamHypIdx + srcPos) * currentDimBatch + currentBatchIdx]);
+    return align;
+  }
+};
+
 // one single (partial or full) hypothesis in beam search
 // key elements:
 //  - the word that this hyp ends with
 //  - the aggregate score up to and including the word
 //  - back pointer to previous hypothesis for traceback
+// Hypotheses are owned by a HypothesisPool, pointers to them stay valid as long as the pool lives.
 class Hypothesis {
 public:
-  typedef IPtr<Hypothesis> PtrType;
+  typedef Hypothesis* PtrType;
 
 private:
-  // Constructors are private, use Hypothesis::New(...)
+  friend class HypothesisPool;
+  // Constructors are private, use HypothesisPool::New(...)
 
   Hypothesis() : prevHyp_(nullptr), prevBeamHypIdx_(0), word_(Word::ZERO), pathScore_(0.0) {}
 
@@ -27,13 +53,7 @@ private:
       : prevHyp_(prevHyp), prevBeamHypIdx_(prevBeamHypIdx), word_(word), pathScore_(pathScore) {}
 
 public:
- // Use this whenever creating a pointer to MemoryPiece
- template <class ...Args>
- static PtrType New(Args&& ...args) {
-   return PtrType(new Hypothesis(std::forward<Args>(args)...));
- }
-
-  const PtrType getPrevHyp() const { return prevHyp_; }
+  PtrType getPrevHyp() const { return prevHyp_; }
 
   Word getWord() const { return word_; }
 
@@ -44,13 +64,34 @@ public:
   const std::vector<float>& getScoreBreakdown() { return scoreBreakdown_; }
   void setScoreBreakdown(const std::vector<float>& scoreBreakdown) { scoreBreakdown_ = scoreBreakdown; }
 
-  const std::vector<float>& getAlignment() { return alignment_; }
-  void setAlignment(const std::vector<float>& align) { alignment_ = align; };
+  const std::vector<float>& getAlignment() {
+    if(attention_) { // gathered on first use
+      alignment_ = attention_->get(attentionBeamHypIdx_, attentionBatchIdx_, attentionOrigBatchIdx_);
+      attention_.reset();
+    }
+    return alignment_;
+  }
+  void setAlignment(const std::vector<float>& align) { alignment_ = align; attention_.reset(); };
+  // Defers the alignment to the attention of the step of this hypothesis, see StepAttention
+  void setAlignment(Ptr<const StepAttention> attention, size_t beamHypIdx, size_t currentBatchIdx, size_t origBatchIdx) {
+    attention_ = attention;
+    attentionBeamHypIdx_ = (IndexType)beamHypIdx;
+    attentionBatchIdx_ = (IndexType)currentBatchIdx;
+    attentionOrigBatchIdx_ = (IndexType)origBatchIdx;
+  }
+  // Takes over the alignment of another hypothesis, still deferred if it is
+  void setAlignmentFrom(const Hypothesis& other) {
+    alignment_ = other.alignment_;
+    attention_ = other.attention_;
+    attentionBeamHypIdx_ = other.attentionBeamHypIdx_;
+    attentionBatchIdx_ = other.attentionBatchIdx_;
+    attentionOrigBatchIdx_ = other.attentionOrigBatchIdx_;
+  }
 
   // trace back paths referenced from this hypothesis
   Words tracebackWords() {
     Words targetWords;
-    for(auto hyp = this; hyp->getPrevHyp(); hyp = hyp->getPrevHyp().get()) {
+    for(auto hyp = this; hyp->getPrevHyp(); hyp = hyp->getPrevHyp()) {
       targetWords.push_back(hyp->getWord());
     }
     std::reverse(targetWords.begin(), targetWords.end());
@@ -61,10 +102,10 @@ public:
   std::vector<float> tracebackWordScores() {
     std::vector<float> scores;
     // traverse hypotheses backward
-    for(auto hyp = this; hyp->getPrevHyp(); hyp = hyp->getPrevHyp().get()) {
+    for(auto hyp = this; hyp->getPrevHyp(); hyp = hyp->getPrevHyp()) {
       // a path score is a cumulative score including scores from all preceding hypotheses (words),
       // so calculate a word-level score by subtracting the previous path score from the current path score
-      auto prevPathScore = hyp->getPrevHyp() ? hyp->getPrevHyp().get()->pathScore_ : 0.f;
+      auto prevPathScore = hyp->getPrevHyp() ? hyp->getPrevHyp()->pathScore_ : 0.f;
       scores.push_back(hyp->pathScore_ - prevPathScore);
     }
     std::reverse(scores.begin(), scores.end());
@@ -75,7 +116,7 @@ public:
   typedef data::SoftAlignment SoftAlignment;
   SoftAlignment tracebackAlignment() {
     SoftAlignment align;
-    for(auto hyp = this; hyp->getPrevHyp(); hyp = hyp->getPrevHyp().get()) {
+    for(auto hyp = this; hyp->getPrevHyp(); hyp = hyp->getPrevHyp()) {
       align.push_back(hyp->getAlignment());
     }
     std::reverse(align.begin(), align.end());
@@ -90,12 +131,51 @@ private:
 
   std::vector<float> scoreBreakdown_; // [num scorers]
   std::vector<float> alignment_;
+  Ptr<const StepAttention> attention_; // set while the alignment is deferred
+  IndexType attentionBeamHypIdx_{0}, attentionBatchIdx_{0}, attentionOrigBatchIdx_{0};
+};
+
+// Arena for the hypotheses of one search. Hypotheses are constructed in place in blocks of
+// BLOCK_SIZE entries and are all destroyed together with the pool, so neither a heap allocation
+// nor reference counting happens per hypothesis. The pool is not thread-safe.
+class HypothesisPool {
+private:
+  static const size_t BLOCK_SIZE = 1024;
+  typedef typename std::aligned_storage<sizeof(Hypothesis), alignof(Hypothesis)>::type Storage;
+
+  std::vector<UPtr<Storage[]>> blocks_;
+  size_t used_{BLOCK_SIZE}; // number of constructed hypotheses in the last block
+
+  Hypothesis* at(size_t block, size_t i) { return reinterpret_cast<Hypothesis*>(&blocks_[block][i]); }
+
+public:
+  HypothesisPool() {}
+  HypothesisPool(const HypothesisPool&) = delete;
+
+  ~HypothesisPool() {
+    for(size_t block = 0; block < blocks_.size(); ++block) {
+      size_t size = block + 1 == blocks_.size() ? used_ : BLOCK_SIZE;
+      for(size_t i = 0; i < size; ++i)
+        at(block, i)->~Hypothesis();
+    }
+  }
+
+  template <class... Args>
+  Hypothesis* New(Args&&... args) {
+    if(used_ == BLOCK_SIZE) {
+      blocks_.emplace_back(new Storage[BLOCK_SIZE]);
+      used_ = 0;
+    }
+    auto hyp = new(at(blocks_.size() - 1, used_)) Hypothesis(std::forward<Args>(args)...);
+    ++used_;
+    return hyp;
+  }
 
-  ENABLE_INTRUSIVE_PTR(Hypothesis)
+  size_t size() const { return blocks_.empty() ? 0 : (blocks_.size() - 1) * BLOCK_SIZE + used_; }
 };
 
-typedef std::vector<IPtr<Hypothesis>> Beam;                // Beam = vector [beamSize] of hypotheses
-typedef std::vector<Beam> Beams;                          // Beams = vector [batchDim] of vector [beamSize] of hypotheses
-typedef std::tuple<Words, IPtr<Hypothesis>, float> Result; // (word ids for hyp, hyp, normalized sentence score for hyp)
+typedef std::vector<Hypothesis::PtrType> Beam;                // Beam = vector [beamSize] of hypotheses
+typedef std::vector<Beam> Beams;                             // Beams = vector [batchDim] of vector [beamSize] of hypotheses
+typedef std::tuple<Words, Hypothesis::PtrType, float> Result; // (word ids for hyp, hyp, normalized sentence score for hyp), hyp is owned by the History
 typedef std::vector<Result> NBestList;                    // sorted vector of (word ids, hyp, sent score) tuples
 }  // namespace marian
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "common/file_stream.h"
+#include "common/filesystem.h"
+#include "common/logging.h"
+#include "common/options.h"
+#include "common/timer.h"
+#include "common/utils.h"
+#include "translator/beam_search.h"
+#include "translator/translator.h"
+
+#include "3rd_party/yaml-cpp/yaml.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace marian {
+
+/**
+ * The translation services of the models that marian-server hosts with --server-models NAME=CONFIG,
+ * where CONFIG is a decoder configuration file with at least the models and vocabularies, whose other
+ * options override those of the server. A service is created when its model is first requested. With
+ * --server-memory-budget the least recently used services are released when loading another model
+ * would exceed the budget; requests still running on a released service finish first.
+ */
+class ModelRegistry {
+public:
+  typedef TranslateService<BeamSearch> Service;
+
+private:
+  struct Entry {
+    Ptr<Options> options;
+    Ptr<Service> service;
+    size_t bytes{0};    // estimated memory of the loaded service, see estimateBytes()
+    size_t lastUsed{0}; // value of clock_ at the last request
+    std::mutex loadMutex; // held while the service is created
+  };
+
+  std::map<std::string, UPtr<Entry>> entries_;
+  std::mutex mutex_; // guards the services, sizes and use times of the entries
+  size_t budgetBytes_{0}; // 0 for unlimited
+  size_t usedBytes_{0};
+  size_t clock_{0};
+
+  // Memory the service of the options holds: the model files once per device, or once if they are
+  // shared or mapped, and the work spaces, as reserved or as measured with --workspace auto
+  static size_t estimateBytes(Ptr<Options> options, Ptr<Service> service) {
+    auto devices = Config::getDevices(options);
+    bool shared = devices[0].type == DeviceType::cpu
+                  && (options->get<bool>("cpu-shared-weights", false) || options->get<bool>("cpu-mmap-weights", false));
+    size_t bytes = 0;
+    for(const auto& model : options->get<std::vector<std::string>>("models"))
+      bytes += filesystem::fileSize(filesystem::Path(model)) * (shared ? 1 : devices.size());
+
+    size_t workspaceMB = getWorkspaceMB(options);
+    if(workspaceMB > 0 || !service) {
+      bytes += workspaceMB * 1024 * 1024 * devices.size();
+    } else {
+      for(auto highWater : service->getWorkspaceHighWater())
+        bytes += highWater + highWater / 10; // the margin of fitWorkspace()
+    }
+    return bytes;
+  }
+
+  // Removes the least recently used services other than `keep` until `bytes` more fit into the
+  // budget or no other service is loaded. Requires mutex_. Returns the removed services, which are
+  // to be released without holding mutex_, as they finish their pending requests first.
+  std::vector<Ptr<Service>> evict(size_t bytes, const Entry* keep) {
+    std::vector<Ptr<Service>> evicted;
+    while(budgetBytes_ > 0 && usedBytes_ + bytes > budgetBytes_) {
+      Entry* oldest = nullptr;
+      std::string name;
+      for(auto& it : entries_) {
+        auto entry = it.second.get();
+        if(entry != keep && entry->service && (!oldest || entry->lastUsed < oldest->lastUsed)) {
+          oldest = entry;
+          name = it.first;
+        }
+      }
+      if(!oldest)
+        break;
+      LOG(info, "[server] Releasing model {} ({:.1f} MB) to stay within the memory budget",
+          name, oldest->bytes / (1024.f * 1024.f));
+      evicted.push_back(oldest->service);
+      oldest->service.reset();
+      usedBytes_ -= oldest->bytes;
+      oldest->bytes = 0;
+    }
+    return evicted;
+  }
+
+public:
+  ModelRegistry(Ptr<Options> options)
+    : budgetBytes_(options->get<size_t>("server-memory-budget", 0) * 1024 * 1024) {
+    for(const auto& model : options->get<std::vector<std::string>>("server-models", {})) {
+      auto pos = model.find('=');
+      ABORT_IF(pos == std::string::npos || pos == 0 || pos + 1 == model.size(),
+               "--server-models expects NAME=CONFIG, got '{}'", model);
+      auto name = model.substr(0, pos);
+      auto config = model.substr(pos + 1);
+      ABORT_IF(entries_.count(name), "Model {} is given more than once in --server-models", name);
+      ABORT_IF(!filesystem::exists(filesystem::Path(config)), "Configuration file of model {} does not exist: {}", name, config);
+
+      auto entry = UPtr<Entry>(new Entry());
+      entry->options = New<Options>(options->clone());
+      io::InputFileStream in(config);
+      entry->options->merge(YAML::Load(in), /*overwrite=*/true);
+
+      // check the files now, a model that cannot be loaded would otherwise abort the server later
+      auto models = entry->options->get<std::vector<std::string>>("models", {});
+      auto vocabs = entry->options->get<std::vector<std::string>>("vocabs", {});
+      ABORT_IF(models.empty() || vocabs.empty(),
+               "Configuration file {} of model {} has to give the models and vocabularies", config, name);
+      for(const auto& file : models)
+        ABORT_IF(!filesystem::exists(filesystem::Path(file)), "Model file of model {} does not exist: {}", name, file);
+      for(const auto& file : vocabs)
+        ABORT_IF(!filesystem::exists(filesystem::Path(file)), "Vocabulary file of model {} does not exist: {}", name, file);
+      entries_[name] = std::move(entry);
+    }
+    LOG(info, "[server] Hosting {} models, loaded when first requested", entries_.size());
+  }
+
+  std::vector<std::string> names() const {
+    std::vector<std::string> names;
+    for(const auto& it : entries_)
+      names.push_back(it.first);
+    return names;
+  }
+
+  // Returns the service of the model `name`, created if it is not loaded, or nullptr if there is no
+  // such model
+  Ptr<Service> get(const std::string& name) {
+    auto it = entries_.find(name);
+    if(it == entries_.end())
+      return nullptr;
+    auto entry = it->second.get();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      entry->lastUsed = ++clock_;
+      if(entry->service)
+        return entry->service;
+    }
+
+    // concurrent first requests of one model wait for the same service, other models are served meanwhile
+    std::lock_guard<std::mutex> loadLock(entry->loadMutex);
+    std::vector<Ptr<Service>> evicted;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(entry->service)
+        return entry->service;
+      evicted = evict(estimateBytes(entry->options, nullptr), entry);
+    }
+    evicted.clear(); // released before loading to make room
+
+    LOG(info, "[server] Loading model {}", name);
+    timer::Timer timer;
+    auto service = New<Service>(entry->options);
+    size_t bytes = estimateBytes(entry->options, service);
+    LOG(info, "[server] Loaded model {} ({:.1f} MB) in {:.2f}s", name, bytes / (1024.f * 1024.f), timer.elapsed());
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      evicted = evict(bytes, entry); // the measured work space may be larger than estimated
+      entry->service = service;
+      entry->bytes = bytes;
+      usedBytes_ += bytes;
+    }
+    return service;
+  }
+
+  // Reloads the model `name` with TranslateService::reload() if it is loaded, and keeps the update
+  // of its options for when it is loaded again. Returns an error message, empty on success.
+  std::string reload(const std::string& name, const YAML::Node& update) {
+    auto it = entries_.find(name);
+    if(it == entries_.end())
+      return "Unknown model " + name;
+    auto entry = it->second.get();
+
+    std::lock_guard<std::mutex> loadLock(entry->loadMutex);
+    Ptr<Service> service;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      service = entry->service;
+    }
+    if(service) {
+      auto error = service->reload(update);
+      if(!error.empty())
+        return error;
+    } else if(update.IsDefined() && !update.IsNull() && !update.IsMap()) {
+      return "Reload options have to be a map";
+    }
+    if(update.IsMap())
+      entry->options->merge(update, /*overwrite=*/true);
+    return "";
+  }
+
+  // Returns the metrics of all loaded services in the Prometheus text format, each line labeled with
+  // the name of its model
+  std::string metrics() {
+    std::vector<std::pair<std::string, Ptr<Service>>> loaded;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for(auto& it : entries_)
+        if(it.second->service)
+          loaded.emplace_back(it.first, it.second->service);
+    }
+
+    std::string metrics;
+    std::set<std::string> comments; // the HELP and TYPE lines of every metric once
+    for(auto& it : loaded) {
+      for(const auto& line : utils::split(it.second->metrics(), "\n")) {
+        if(line.empty())
+          continue;
+        if(line[0] == '#') {
+          if(comments.insert(line).second)
+            metrics += line + "\n";
+          continue;
+        }
+        // name{labels} value or name value
+        auto space = line.find(' ');
+        auto brace = line.find('{');
+        std::string label = "model=\"" + it.first + "\"";
+        if(brace != std::string::npos && brace < space)
+          metrics += line.substr(0, brace + 1) + label + "," + line.substr(brace + 1) + "\n";
+        else
+          metrics += line.substr(0, space) + "{" + label + "}" + line.substr(space) + "\n";
+      }
+    }
+    return metrics;
+  }
+};
+
+}  // namespace marian
@@ -0,0 +1,78 @@
+#include "translator/mpi_output.h"
+
+#include "common/logging.h"
+
+namespace marian {
+
+// tag of the messages with translations
+static const int MPI_TAG_TRANSLATIONS = 31;
+
+// A batch is sent as three messages: the number of translations and the size of their text, which
+// is 0 for a process that is done, then the id and the sizes of best1 and bestn of each translation,
+// then their text.
+MPIOutputMerger::MPIOutputMerger(Ptr<IMPIWrapper> mpi, Ptr<OutputCollector> collector, bool nbest)
+    : mpi_(mpi), collector_(collector), nbest_(nbest) {
+  if(mpi_->myMPIRank() == 0 && mpi_->numMPIProcesses() > 1)
+    receiver_ = std::thread([this]() { receive(); });
+}
+
+void MPIOutputMerger::send(const std::vector<Output>& outputs) {
+  if(outputs.empty())
+    return;
+  std::vector<unsigned long long> sizes;
+  std::string text;
+  for(const auto& output : outputs) {
+    sizes.insert(sizes.end(), {(unsigned long long)output.id, output.best1.size(), output.bestn.size()});
+    text += output.best1;
+    text += output.bestn;
+  }
+  unsigned long long header[2] = {outputs.size(), text.size()};
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  mpi_->sSend(header, 2, MPI_UNSIGNED_LONG_LONG, 0, MPI_TAG_TRANSLATIONS);
+  mpi_->sSend(sizes.data(), sizes.size(), MPI_UNSIGNED_LONG_LONG, 0, MPI_TAG_TRANSLATIONS);
+  mpi_->sSend(&text[0], text.size(), MPI_BYTE, 0, MPI_TAG_TRANSLATIONS);
+}
+
+void MPIOutputMerger::receive() {
+  size_t running = mpi_->numMPIProcesses() - 1;
+  std::vector<unsigned long long> sizes;
+  std::vector<char> text;
+  while(running > 0) {
+    unsigned long long header[2];
+    MPI_Status status;
+    mpi_->recv(header, 2, MPI_UNSIGNED_LONG_LONG, IMPIWrapper::RECV_ANY_SOURCE, MPI_TAG_TRANSLATIONS, MPI_COMM_WORLD, &status);
+    if(header[0] == 0) {
+      --running;
+      continue;
+    }
+    size_t source = (size_t)status.MPI_SOURCE;
+    sizes.resize(3 * header[0]);
+    text.resize(header[1]);
+    mpi_->recv(sizes.data(), sizes.size(), MPI_UNSIGNED_LONG_LONG, source, MPI_TAG_TRANSLATIONS);
+    mpi_->recv(text.data(), text.size(), MPI_BYTE, source, MPI_TAG_TRANSLATIONS);
+
+    const char* pos = text.data();
+    for(size_t i = 0; i < header[0]; ++i) {
+      std::string best1(pos, sizes[3 * i + 1]);
+      pos += sizes[3 * i + 1];
+      std::string bestn(pos, sizes[3 * i + 2]);
+      pos += sizes[3 * i + 2];
+      collector_->addPending(1); // the ones of this process are registered by its batches
+      collector_->Write((long)sizes[3 * i], best1, bestn, nbest_);
+    }
+  }
+}
+
+void MPIOutputMerger::finish() {
+  if(mpi_->myMPIRank() == 0) {
+    if(receiver_.joinable())
+      receiver_.join();
+  } else {
+    unsigned long long header[2] = {0, 0};
+    std::lock_guard<std::mutex> lock(mutex_);
+    mpi_->sSend(header, 2, MPI_UNSIGNED_LONG_LONG, 0, MPI_TAG_TRANSLATIONS);
+  }
+}
+
+}  // namespace marian
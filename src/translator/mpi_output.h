@@ -0,0 +1,44 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "training/communicator.h"
+#include "translator/output_collector.h"
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace marian {
+
+// Merges the translations of all MPI processes in the first one, see --mpi-split. The other
+// processes send the translations of each of their batches, which a thread of the first process
+// receives and passes to its collector, so that it writes them in the order of the input together
+// with its own ones.
+class MPIOutputMerger {
+public:
+  struct Output {
+    long id;
+    std::string best1;
+    std::string bestn;
+  };
+
+  MPIOutputMerger(Ptr<IMPIWrapper> mpi, Ptr<OutputCollector> collector, bool nbest);
+
+  // Sends the translations of a batch to the first process, called by the other ones
+  void send(const std::vector<Output>& outputs);
+
+  // Tells the first process that this one is done, or waits for all others in the first process
+  void finish();
+
+private:
+  Ptr<IMPIWrapper> mpi_;
+  Ptr<OutputCollector> collector_;
+  bool nbest_;
+  std::mutex mutex_; // one batch is sent at a time
+  std::thread receiver_;
+
+  void receive();
+};
+
+}  // namespace marian
@@ -4,16 +4,164 @@
  */
 
 #include "translator/nth_element.h"
+#include "functional/functional.h"
+#include "functional/operators.h"
 #include <algorithm>
+#include <functional>
 #include <iterator>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 #include <limits>
 #include <numeric>
 
 namespace marian {
 
+// keeps the N largest entries of a row seen so far, sorted in descending order
+class RowTopN {
+  std::vector<float> vals_;
+  std::vector<int> idxs_;
+  size_t N_{0};
+  size_t size_{0};
+
+public:
+  void reset(size_t N) {
+    N_ = N;
+    size_ = 0;
+    vals_.resize(N);
+    idxs_.resize(N);
+  }
+
+  // candidates need to be larger than this value to be inserted
+  float threshold() const { return size_ < N_ ? std::numeric_limits<float>::lowest() : vals_[N_ - 1]; }
+
+  void insert(float val, int idx) {
+    if(N_ == 0 || val <= threshold())
+      return;
+    size_t pos = std::min(size_, N_ - 1);
+    while(pos > 0 && vals_[pos - 1] < val) { // shift smaller entries down
+      vals_[pos] = vals_[pos - 1];
+      idxs_[pos] = idxs_[pos - 1];
+      --pos;
+    }
+    vals_[pos] = val;
+    idxs_[pos] = idx;
+    size_ = std::min(size_ + 1, N_);
+  }
+
+  size_t size() const { return size_; }
+  float val(size_t i) const { return vals_[i]; }
+  int idx(size_t i) const { return idxs_[i]; }
+};
+
+// Scans n scores for their maximum and their N best entries (excluding suppressedIdx). Entries are
+// compared against the current N-th best score in SIMD blocks and only the few entries above this
+// threshold are inserted into the small sorted buffer of the N best.
+typedef float (*ScanTopNFn)(const float* data, int n, int suppressedIdx, RowTopN& topN);
+
+static float scanTopNScalar(const float* data, int n, int suppressedIdx, RowTopN& topN) {
+  float max = std::numeric_limits<float>::lowest();
+  for(int i = 0; i < n; ++i) {
+    max = std::max(max, data[i]);
+    if(data[i] > topN.threshold() && i != suppressedIdx)
+      topN.insert(data[i], i);
+  }
+  return max;
+}
+
+// The AVX2 and AVX512 variants are compiled with function-level target attributes and chosen at
+// runtime, so that they are also available if Marian is compiled for an older architecture.
+#if defined(__GNUC__) && !defined(__CUDACC__) && (defined(__x86_64__) || defined(__i386__))
+#define NTH_ELEMENT_RUNTIME_DISPATCH 1
+
+__attribute__((target("avx2")))
+static float scanTopNAVX2(const float* data, int n, int suppressedIdx, RowTopN& topN) {
+  __m256 thresholds = _mm256_set1_ps(topN.threshold());
+  __m256 maxs = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(data + i);
+    maxs = _mm256_max_ps(maxs, x);
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(x, thresholds, _CMP_GT_OQ));
+    if(mask) {
+      while(mask) { // insert candidates lane by lane
+        int j = i + __builtin_ctz(mask);
+        if(j != suppressedIdx)
+          topN.insert(data[j], j);
+        mask &= mask - 1;
+      }
+      thresholds = _mm256_set1_ps(topN.threshold());
+    }
+  }
+  alignas(32) float lanes[8];
+  _mm256_store_ps(lanes, maxs);
+  float max = *std::max_element(lanes, lanes + 8);
+  for(; i < n; ++i) {
+    max = std::max(max, data[i]);
+    if(data[i] > topN.threshold() && i != suppressedIdx)
+      topN.insert(data[i], i);
+  }
+  return max;
+}
+
+// false uninitialized warnings of gcc 12.1/12.2 in inlined AVX512 intrinsics, see cpu/softmax.cpp
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f")))
+static float scanTopNAVX512(const float* data, int n, int suppressedIdx, RowTopN& topN) {
+  __m512 thresholds = _mm512_set1_ps(topN.threshold());
+  __m512 maxs = _mm512_set1_ps(std::numeric_limits<float>::lowest());
+  int i = 0;
+  for(; i + 16 <= n; i += 16) {
+    __m512 x = _mm512_loadu_ps(data + i);
+    maxs = _mm512_max_ps(maxs, x);
+    unsigned mask = _mm512_cmp_ps_mask(x, thresholds, _CMP_GT_OQ);
+    if(mask) {
+      while(mask) { // insert candidates lane by lane
+        int j = i + __builtin_ctz(mask);
+        if(j != suppressedIdx)
+          topN.insert(data[j], j);
+        mask &= mask - 1;
+      }
+      thresholds = _mm512_set1_ps(topN.threshold());
+    }
+  }
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, maxs);
+  float max = *std::max_element(lanes, lanes + 16);
+  for(; i < n; ++i) {
+    max = std::max(max, data[i]);
+    if(data[i] > topN.threshold() && i != suppressedIdx)
+      topN.insert(data[i], i);
+  }
+  return max;
+}
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+// selects the fastest variant supported by the CPU we are running on
+static ScanTopNFn getScanTopNFn() {
+#ifdef NTH_ELEMENT_RUNTIME_DISPATCH
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return scanTopNAVX512;
+  if(__builtin_cpu_supports("avx2"))
+    return scanTopNAVX2;
+#endif
+  return scanTopNScalar;
+}
+
+static const ScanTopNFn scanTopN = getScanTopNFn();
+
 class NthElementCPU {
   std::vector<int> h_res_idx;
   std::vector<float> h_res;
+  RowTopN topN_; // re-used for each batch
   //size_t lastN_;
 
 public:
@@ -39,25 +187,20 @@ public:
     size_t pos = 0; // iterates through h_res and h_res_idx
 
     size_t batchOffset = inputN * vocabSize;
-    std::vector<int> idxs(batchOffset); // re-used for each batch
-    std::iota(idxs.begin(), idxs.end(), 0);
+    const float lowest = std::numeric_limits<float>::lowest();
 
     for(size_t batchIdx = 0; batchIdx < dimBatch; ++batchIdx) {
-
-      std::partial_sort( 
-        // sorts the top N (beam size) idxs by score to the front
-        idxs.begin(),
-        idxs.begin() + N,
-        idxs.end(),
-        [&](int a, int b) { return scoresData[a] > scoresData[b]; }
-      );
+      // find top N (beam size) scores over all beam entries of this batch entry
+      topN_.reset(N);
+      scanTopN(scoresData, (int)batchOffset, /*suppressedIdx=*/-1, topN_);
 
       // copy top N idxs and scores to return vectors
       for(size_t i = 0; i < N; ++i) {
-        int idx = idxs[i];
-        // since idxs is re-used for each batch, add batch offset to each idx to get absolute position
+        bool valid = i < topN_.size(); // only fewer than N if the beam has fewer than N entries
+        int idx = valid ? topN_.idx(i) : 0;
+        // add batch offset to each idx to get absolute position
         h_res_idx[pos] = (int) (idx + batchIdx * batchOffset);
-        h_res[pos] = scoresData[idx];
+        h_res[pos] = valid ? topN_.val(i) : lowest;
         ++pos;
       }
 
@@ -83,6 +226,267 @@ private:
   //}
 };
 
+// sum of exp(x - max) over a row
+template <typename ElementType>
+static float sumExpRow(const float* row, int cols, float max) {
+  using namespace functional;
+  const int width = sizeof(ElementType) / sizeof(float);
+  const ElementType* blocks = reinterpret_cast<const ElementType*>(row);
+
+  ElementType sum = 0.f;
+  ElementType maxs = max;
+  for(int b = 0; b < cols / width; ++b)
+    sum = Ops<ElementType>::add(sum, Ops<ElementType>::exp(Ops<ElementType>::sub(blocks[b], maxs)));
+  return Ops<ElementType>::sumReduce(sum);
+}
+
+// log of the softmax denominator of a row with maximum max, vectorized where the row length allows
+static float logSumExpRow(const float* row, int cols, float max) {
+  float sum;
+#ifdef __AVX__
+  if(cols % 8 == 0)
+    sum = sumExpRow<float32x8>(row, cols, max);
+  else
+#endif
+  if(cols % 4 == 0)
+    sum = sumExpRow<float32x4>(row, cols, max);
+  else
+    sum = sumExpRow<float>(row, cols, max);
+  return max + std::log(sum);
+}
+
+void getNBestListFusedLogSoftmax(Tensor logits,
+                                 const std::vector<float>& prevPathScores,
+                                 float weight,
+                                 int suppressedWordIdx,
+                                 size_t N,
+                                 std::vector<float>& outPathScores,
+                                 std::vector<unsigned>& outKeys) {
+  ABORT_IF(logits->getBackend()->getDeviceId().type != DeviceType::cpu,
+           "Fused log-softmax and n-best search is only implemented for the CPU");
+  matchOrAbort<float>(logits->type());
+
+  const int vocabSize = logits->shape()[-1];
+  const int dimBatch  = logits->shape()[-2];
+  const int beamSize  = logits->shape()[-4];
+  ABORT_IF(!prevPathScores.empty() && prevPathScores.size() != (size_t)beamSize * dimBatch,
+           "Previous path scores have wrong size??");
+  const float invalidPathScore = std::numeric_limits<float>::lowest();
+
+  RowTopN topN;
+  std::vector<std::pair<float, unsigned>> candidates; // (path score, key) for one batch entry
+  for(int batchIdx = 0; batchIdx < dimBatch; ++batchIdx) {
+    candidates.clear();
+    for(int beamHypIdx = 0; beamHypIdx < beamSize; ++beamHypIdx) {
+      size_t rowIdx = beamHypIdx * dimBatch + batchIdx;
+      float prevScore = prevPathScores.empty() ? 0.f : prevPathScores[rowIdx];
+      if(prevScore == invalidPathScore) // dummy hypothesis, nothing to expand
+        continue;
+
+      const float* row = logits->data() + rowIdx * vocabSize;
+      topN.reset(N);
+
+      float max = scanTopN(row, vocabSize, suppressedWordIdx, topN);
+      float logSum = logSumExpRow(row, vocabSize, max);
+
+      for(size_t i = 0; i < topN.size(); ++i) {
+        float pathScore = prevScore + weight * (topN.val(i) - logSum);
+        unsigned key = (unsigned)((batchIdx * beamSize + beamHypIdx) * vocabSize + topN.idx(i));
+        candidates.emplace_back(pathScore, key);
+      }
+    }
+
+    size_t numBest = std::min(N, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + numBest, candidates.end(),
+                      [](const std::pair<float, unsigned>& a, const std::pair<float, unsigned>& b) {
+                        return a.first > b.first;
+                      });
+    for(size_t i = 0; i < N; ++i) {
+      if(i < numBest) {
+        outPathScores.push_back(candidates[i].first);
+        outKeys.push_back(candidates[i].second);
+      } else { // pad with invalid entries which are skipped by the search
+        outPathScores.push_back(invalidPathScore);
+        outKeys.push_back((unsigned)(batchIdx * beamSize * vocabSize));
+      }
+    }
+  }
+}
+
+void getBestPerRow(Tensor scores,
+                   int suppressedWordIdx,
+                   std::vector<float>& outScores,
+                   std::vector<unsigned>& outKeys) {
+  ABORT_IF(scores->getBackend()->getDeviceId().type != DeviceType::cpu,
+           "Greedy selection is only implemented for the CPU");
+  matchOrAbort<float>(scores->type());
+
+  const int vocabSize = scores->shape()[-1];
+  const int dimRows   = scores->shape().elements() / vocabSize;
+
+  RowTopN best;
+  for(int rowIdx = 0; rowIdx < dimRows; ++rowIdx) {
+    best.reset(1);
+    scanTopN(scores->data() + (size_t)rowIdx * vocabSize, vocabSize, suppressedWordIdx, best);
+    bool valid = best.size() > 0; // only if all entries are suppressed or lowest
+    outScores.push_back(valid ? best.val(0) : std::numeric_limits<float>::lowest());
+    outKeys.push_back((unsigned)(rowIdx * vocabSize + (valid ? best.idx(0) : 0)));
+  }
+}
+
+// Index of the first of n candidates (sorted by descending value) in the nucleus, the smallest prefix
+// whose probabilities at the temperature add up to `nucleus` of `total`, which is chosen with the
+// uniform random number u. weights holds exp((value - max) / temperature) of the candidates.
+static size_t sampleCandidate(const std::vector<float>& weights, size_t n, float total, float nucleus, float u) {
+  size_t prefix = 0;
+  float mass = 0.f;
+  while(prefix < n && (prefix == 0 || mass < nucleus * total))
+    mass += weights[prefix++];
+  float target = u * mass;
+  float acc = 0.f;
+  for(size_t i = 0; i < prefix; ++i) {
+    acc += weights[i];
+    if(acc > target)
+      return i;
+  }
+  return prefix - 1;
+}
+
+void sampleFromLogits(Tensor logits,
+                      int suppressedWordIdx,
+                      const OutputSampling& sampling,
+                      std::mt19937& rng,
+                      std::vector<float>& outScores,
+                      std::vector<unsigned>& outKeys) {
+  ABORT_IF(logits->getBackend()->getDeviceId().type != DeviceType::cpu,
+           "Sampling from logits is only implemented for the CPU");
+  matchOrAbort<float>(logits->type());
+
+  const int vocabSize = logits->shape()[-1];
+  const int dimRows   = logits->shape().elements() / vocabSize;
+  const float invTemperature = 1.f / sampling.temperature;
+  const bool restricted = sampling.topK > 0 || sampling.nucleus < 1.f;
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+  RowTopN topN;
+  std::vector<float> weights;
+  std::vector<std::pair<float, int>> sorted; // whole rows whose nucleus exceeds the candidates
+  for(int rowIdx = 0; rowIdx < dimRows; ++rowIdx) {
+    const float* row = logits->data() + (size_t)rowIdx * vocabSize;
+    float u = uniform(rng);
+
+    float max = std::numeric_limits<float>::lowest(); // of the words that can be sampled
+    float rowMax = max;
+    for(int i = 0; i < vocabSize; ++i) {
+      rowMax = std::max(rowMax, row[i]);
+      if(i != suppressedWordIdx)
+        max = std::max(max, row[i]);
+    }
+
+    // the distribution at the temperature, without materializing it
+    float total = 0.f;
+    if(sampling.topK == 0)
+      for(int i = 0; i < vocabSize; ++i)
+        if(i != suppressedWordIdx)
+          total += std::exp((row[i] - max) * invTemperature);
+
+    int word = -1;
+    if(!restricted) { // inverse of the cumulative distribution
+      float target = u * total;
+      float acc = 0.f;
+      for(int i = 0; i < vocabSize && word < 0; ++i) {
+        if(i == suppressedWordIdx)
+          continue;
+        acc += std::exp((row[i] - max) * invTemperature);
+        if(acc > target)
+          word = i;
+      }
+      for(int i = vocabSize - 1; i >= 0 && word < 0; --i) // rounding, take the last valid word
+        if(i != suppressedWordIdx)
+          word = i;
+    } else {
+      // the best candidates, more of them until they cover the nucleus, or the whole row sorted
+      size_t candidates = sampling.topK > 0 ? std::min(sampling.topK, (size_t)vocabSize)
+                                            : std::min(SAMPLING_CANDIDATES, (size_t)vocabSize);
+      for(;;) {
+        topN.reset(candidates);
+        scanTopN(row, vocabSize, suppressedWordIdx, topN);
+        if(topN.size() == 0) // all words suppressed
+          break;
+        weights.resize(topN.size());
+        float mass = 0.f;
+        for(size_t i = 0; i < topN.size(); ++i)
+          mass += weights[i] = std::exp((topN.val(i) - max) * invTemperature);
+        if(sampling.topK > 0) {
+          word = topN.idx(sampleCandidate(weights, topN.size(), mass, sampling.nucleus, u));
+          break;
+        }
+        if(mass >= sampling.nucleus * total || candidates == (size_t)vocabSize) {
+          word = topN.idx(sampleCandidate(weights, topN.size(), total, sampling.nucleus, u));
+          break;
+        }
+        if(candidates >= 4 * SAMPLING_CANDIDATES) { // flat distribution, sorting is cheaper than insertion
+          sorted.clear();
+          for(int i = 0; i < vocabSize; ++i)
+            if(i != suppressedWordIdx)
+              sorted.emplace_back(row[i], i);
+          std::sort(sorted.begin(), sorted.end(), std::greater<std::pair<float, int>>());
+          weights.resize(sorted.size());
+          for(size_t i = 0; i < sorted.size(); ++i)
+            weights[i] = std::exp((sorted[i].first - max) * invTemperature);
+          word = sorted[sampleCandidate(weights, sorted.size(), total, sampling.nucleus, u)].second;
+          break;
+        }
+        candidates = std::min(4 * candidates, (size_t)vocabSize);
+      }
+    }
+
+    // the score of the word is its log-probability under the model, independent of the sampling
+    bool valid = word >= 0;
+    outScores.push_back(valid ? row[word] - logSumExpRow(row, vocabSize, rowMax) : std::numeric_limits<float>::lowest());
+    outKeys.push_back((unsigned)((size_t)rowIdx * vocabSize + (valid ? word : 0)));
+  }
+}
+
+void sampleFromNBestList(const std::vector<float>& nBestScores,
+                         const std::vector<unsigned>& nBestKeys,
+                         size_t N,
+                         const std::vector<float>& rowLogTotals,
+                         const OutputSampling& sampling,
+                         std::mt19937& rng,
+                         std::vector<float>& outScores,
+                         std::vector<unsigned>& outKeys) {
+  ABORT_IF(nBestScores.size() != nBestKeys.size() || nBestScores.size() % N != 0, "n-best list has wrong size??");
+  ABORT_IF(!rowLogTotals.empty() && rowLogTotals.size() != nBestScores.size() / N, "Expected one total per n-best list");
+  const float invTemperature = 1.f / sampling.temperature;
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+  std::vector<float> weights;
+  for(size_t rowIdx = 0; rowIdx < nBestScores.size() / N; ++rowIdx) {
+    const float* scores = nBestScores.data() + rowIdx * N;
+    size_t n = 0; // without the padding of rows with fewer than N valid entries
+    while(n < N && scores[n] != std::numeric_limits<float>::lowest())
+      ++n;
+    float u = uniform(rng);
+    if(n == 0) {
+      outScores.push_back(scores[0]);
+      outKeys.push_back(nBestKeys[rowIdx * N]);
+      continue;
+    }
+    weights.resize(n);
+    float mass = 0.f;
+    for(size_t i = 0; i < n; ++i)
+      mass += weights[i] = std::exp((scores[i] - scores[0]) * invTemperature);
+    // the nucleus is a share of the whole row, cut off at the candidates if they do not cover it
+    float total = mass;
+    if(sampling.topK == 0 && !rowLogTotals.empty())
+      total = std::max(mass, std::exp(rowLogTotals[rowIdx] - scores[0] * invTemperature));
+    size_t i = sampleCandidate(weights, n, total, sampling.nucleus, u);
+    outScores.push_back(scores[i]);
+    outKeys.push_back(nBestKeys[rowIdx * N + i]);
+  }
+}
+
 #ifdef CUDA_FOUND
 GetNBestListFn createGetNBestListGPUFn(size_t beamSize, size_t dimBatch, DeviceId deviceId); // in .cu file
 #endif
@@ -9,6 +9,7 @@
 
 #include <cuda.h>
 #include "tensors/gpu/cuda_helpers.h"
+#include "tensors/gpu/radix_topk.h"
 
 namespace marian {
 
@@ -342,6 +343,14 @@ private:
 
     const int numBatches = batchFirstElementIdxs.size() - 1;
 
+    // larger beams are selected by radix select, whose cost does not grow with the beam size. The rows
+    // of all batch entries have the same length, see getNBestList().
+    int N = cumulativeBeamSizes[1];
+    if(N >= gpu::RADIX_TOPK_MIN_K && N <= gpu::RADIX_TOPK_MAX_K) {
+      gpu::radixTopK(probs, numBatches, batchFirstElementIdxs[1], N, /*descending=*/true, d_res_idx, d_res, /*absoluteIndices=*/true);
+      return;
+    }
+
     gMaxElement<<<NUM_BLOCKS,
                   BLOCK_SIZE,
                   BLOCK_SIZE * sizeof(float), // shared memory size
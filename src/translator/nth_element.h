@@ -5,7 +5,9 @@
 
 #pragma once
 
+#include "common/options.h"
 #include "tensors/tensor.h"
+#include <random>
 #include <vector>
 
 namespace marian {
@@ -17,4 +19,71 @@ typedef std::function<void(Tensor logProbs,
                            const bool isFirst)> GetNBestListFn;
 
 GetNBestListFn createGetNBestListFn(size_t beamSize, size_t dimBatch, DeviceId deviceId);
+
+// Fused log-softmax and n-best selection on the CPU. Takes unnormalized logits and computes
+// prevPathScores + weight * logsoftmax(logits) only for the best candidates, without ever
+// materializing the normalized scores. Each row is read twice: once to find its maximum and its N
+// best entries, once to accumulate the softmax denominator.
+// Output keys have the same layout as for the functions returned by createGetNBestListFn(), i.e.
+// (batchIdx, beamHypIdx, word idx) flattened over the beam size logits->shape()[-4].
+void getNBestListFusedLogSoftmax(Tensor logits,  // [beamSize, 1, dimBatch, dimVocab or dimShortlist]
+                                 const std::vector<float>& prevPathScores,  // [beamSize, 1, dimBatch, 1] flattened, or empty for all zeros
+                                 float weight,
+                                 int suppressedWordIdx,  // excluded from the n-best list, -1 for none
+                                 size_t N,
+                                 std::vector<float>& outPathScores,
+                                 std::vector<unsigned>& outKeys);
+
+// Greedy selection on the CPU: appends the best score of each row and its key, i.e. the flattened
+// position row * dimVocab + word idx. suppressedWordIdx is never selected, -1 for none.
+void getBestPerRow(Tensor scores,  // [..., dimRows, dimVocab or dimShortlist]
+                   int suppressedWordIdx,
+                   std::vector<float>& outScores,
+                   std::vector<unsigned>& outKeys);
+
+// Restrictions of the distribution that --output-sampling samples from: the logits are divided by the
+// temperature, then only the topK best words (all for 0) are kept, and of those the smallest set of
+// best words whose probability adds up to at least nucleus (all for 1)
+struct OutputSampling {
+  float temperature{1.f};
+  size_t topK{0};
+  float nucleus{1.f};
+
+  OutputSampling(Ptr<Options> options)
+      : temperature(options->get<float>("output-sampling-temperature", 1.f)),
+        topK(options->get<size_t>("output-sampling-topk", 0)),
+        nucleus(options->get<float>("output-sampling-nucleus", 1.f)) {}
+
+  bool restricted() const { return topK > 0 || nucleus < 1.f; }
+};
+
+// Number of best words considered for a nucleus without --output-sampling-topk. On the CPU more
+// words are scanned if they do not cover the nucleus; on the GPU the nucleus is cut off there.
+const size_t SAMPLING_CANDIDATES = 1024;
+
+// Sampling on the CPU from unnormalized logits, one word per row, without materializing the noised
+// or normalized scores. Appends the log-probability of the sampled word under the model (at
+// temperature 1 and over the whole row) and its key, i.e. row * dimVocab + word idx, as
+// getBestPerRow(). suppressedWordIdx is never sampled, -1 for none.
+void sampleFromLogits(Tensor logits,  // [..., dimRows, dimVocab or dimShortlist]
+                      int suppressedWordIdx,
+                      const OutputSampling& sampling,
+                      std::mt19937& rng,
+                      std::vector<float>& outScores,
+                      std::vector<unsigned>& outKeys);
+
+// Samples one entry of each of the n-best lists of N normalized scores, sorted in descending order
+// as returned by the functions of createGetNBestListFn(), and appends its score and key. For the
+// GPU, where the n-best search restricts the distribution to its best words. Without topK the
+// nucleus is taken of the whole row, whose log(sum(exp(score / temperature))) is given per list in
+// rowLogTotals; if the N entries do not cover it, all of them are sampled from. With topK, or an
+// empty rowLogTotals, the nucleus is taken of the mass of the N entries.
+void sampleFromNBestList(const std::vector<float>& nBestScores,
+                         const std::vector<unsigned>& nBestKeys,
+                         size_t N,
+                         const std::vector<float>& rowLogTotals,
+                         const OutputSampling& sampling,
+                         std::mt19937& rng,
+                         std::vector<float>& outScores,
+                         std::vector<unsigned>& outKeys);
 }  // namespace marian
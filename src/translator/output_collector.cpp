@@ -22,14 +22,28 @@ void OutputCollector::Write(long sourceId,
                             const std::string& best1,
                             const std::string& bestn,
                             bool nbest) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if(sourceId == nextId_) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if(pending_ > 0)
+    --pending_;
+
+  if(unordered_) {
+    if(printing_->shouldBePrinted(sourceId))
+      LOG(info, "Best translation {} : {}", sourceId, best1);
+
+    // n-best lists carry the sentence id already
+    if(outStrm_) {
+      if(nbest)
+        writeNBest(bestn);
+      else
+        *outStrm_ << sourceId << "\t" << best1 << std::endl;
+    }
+  } else if(sourceId == nextId_) {
     if(printing_->shouldBePrinted(sourceId))
       LOG(info, "Best translation {} : {}", sourceId, best1);
 
     if(outStrm_) {
       if(nbest)
-        *outStrm_ << bestn << std::endl;
+        writeNBest(bestn);
       else
         *outStrm_ << best1 << std::endl;
     }
@@ -49,7 +63,7 @@ void OutputCollector::Write(long sourceId,
 
         if(outStrm_) {
           if(nbest)
-            *outStrm_ << currOutput.second << std::endl;
+            writeNBest(currOutput.second);
           else
             *outStrm_ << currOutput.first << std::endl;
         }
@@ -77,6 +91,26 @@ void OutputCollector::Write(long sourceId,
     // save for later
     outputs_[sourceId] = std::make_pair(best1, bestn);
   }
+
+  lock.unlock();
+  written_.notify_all();
+}
+
+void OutputCollector::writeNBest(const std::string& bestn) {
+  if(binaryNBest_)
+    *outStrm_ << bestn;
+  else
+    *outStrm_ << bestn << std::endl;
+}
+
+void OutputCollector::addPending(size_t num) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_ += num;
+}
+
+void OutputCollector::waitForSpace(size_t maxBuffered) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_.wait(lock, [&] { return outputs_.size() <= maxBuffered || pending_ == 0; });
 }
 
 StringCollector::StringCollector(bool quiet /*=false*/) : maxId_(-1), quiet_(quiet) {}
@@ -3,6 +3,7 @@
 #include "common/definitions.h"
 #include "common/file_stream.h"
 
+#include <condition_variable>
 #include <mutex>
 #include <iostream>
 #include <map>
@@ -63,13 +64,34 @@ public:
     printing_ = strategy;
   }
 
+  // Write outputs as soon as they arrive, prefixed with their id and a tab, instead of in order of ids
+  void setUnordered(bool unordered) { unordered_ = unordered; }
+
+  // Write n-best lists without a trailing newline, as binary n-best entries are self-delimiting
+  void setBinaryNBest(bool binary) { binaryNBest_ = binary; }
+
+  // Registers the number of outputs which will be written by tasks that have been dispatched
+  void addPending(size_t num);
+
+  // Blocks while more than maxBuffered outputs are waiting for earlier ids and dispatched tasks are
+  // still pending. Used to apply backpressure onto the producer of the inputs, so that the reorder
+  // buffer does not grow without bounds. Returns immediately if nothing is pending, as the missing
+  // outputs may then only be produced after this call.
+  void waitForSpace(size_t maxBuffered);
+
 protected:
   typedef std::map<long, std::pair<std::string, std::string>> Outputs;
   Outputs outputs_;
   long nextId_;
   UPtr<std::ostream> outStrm_;
   Ptr<PrintingStrategy> printing_;
+  bool unordered_{false};
+  bool binaryNBest_{false};
+  size_t pending_{0};
   std::mutex mutex_;
+  std::condition_variable written_;
+
+  void writeNBest(const std::string& bestn);
 };
 
 class StringCollector {
@@ -4,17 +4,22 @@
 
 namespace marian {
 
-std::string OutputPrinter::getAlignment(const Hypothesis::PtrType& hyp) {
+data::SoftAlignment OutputPrinter::getSoftAlignment(const Hypothesis::PtrType& hyp) {
   data::SoftAlignment align;
   auto last = hyp;
   // get soft alignments for each target word starting from the last one
-  while(last->getPrevHyp().get() != nullptr) {
+  while(last->getPrevHyp() != nullptr) {
     align.push_back(last->getAlignment());
     last = last->getPrevHyp();
   }
 
   // reverse alignments
   std::reverse(align.begin(), align.end());
+  return align;
+}
+
+std::string OutputPrinter::getAlignment(const Hypothesis::PtrType& hyp) {
+  auto align = getSoftAlignment(hyp);
 
   if(alignment_ == "soft") {
     return data::SoftAlignToString(align);
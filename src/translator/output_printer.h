@@ -5,6 +5,7 @@
 #include "common/options.h"
 #include "common/utils.h"
 #include "data/alignment.h"
+#include "data/nbest_binary.h"
 #include "data/vocab.h"
 #include "translator/history.h"
 #include "translator/hypothesis.h"
@@ -21,14 +22,18 @@ public:
                    : 0),
         alignment_(options->get<std::string>("alignment", "")),
         alignmentThreshold_(getAlignmentThreshold(alignment_)),
-        wordScores_(options->get<bool>("word-scores")) {}
+        wordScores_(options->get<bool>("word-scores")),
+        binaryNBest_(options->get<std::string>("n-best-format", "text") == "binary") {}
 
   template <class OStream>
   void print(Ptr<const History> history, OStream& best1, OStream& bestn) {
     const auto& nbl = history->nBest(nbest_);
 
     // prepare n-best list output
-    for(size_t i = 0; i < nbl.size(); ++i) {
+    for(size_t i = 0; i < nbl.size() && binaryNBest_; ++i)
+      printBinary(history->getLineNum(), nbl[i], bestn);
+
+    for(size_t i = 0; i < nbl.size() && !binaryNBest_; ++i) {
       const auto& result = nbl[i];
       const auto& hypo = std::get<1>(result);
       auto words = std::get<0>(result);
@@ -92,7 +97,35 @@ private:
   std::string alignment_;          // A non-empty string indicates the type of word alignment
   float alignmentThreshold_{0.f};  // Threshold for converting attention into hard word alignment
   bool wordScores_{false};         // Whether to print word-level scores or not
+  bool binaryNBest_{false};        // Whether to write n-best lists in the binary format, see data/nbest_binary.h
+
+  template <class OStream>
+  void printBinary(size_t lineNum, const Result& result, OStream& bestn) {
+    const auto& hypo = std::get<1>(result);
+
+    data::NBestEntry entry;
+    entry.lineNum = lineNum;
+    entry.words = std::get<0>(result);
+    if(!entry.words.empty() && entry.words.back() == vocab_->getEosId())
+      entry.words.pop_back();
+    if(reverse_)
+      std::reverse(entry.words.begin(), entry.words.end());
+
+    entry.scores = hypo->getScoreBreakdown();
+    if(entry.scores.empty())
+      entry.scores.push_back(hypo->getPathScore());
+    entry.score = std::get<2>(result);
+
+    if(wordScores_)
+      entry.wordScores = hypo->tracebackWordScores();
+    if(!alignment_.empty())
+      entry.alignment = getSoftAlignment(hypo);
+
+    data::writeNBestEntry(bestn, entry);
+  }
 
+  // Get soft alignment for each target word
+  data::SoftAlignment getSoftAlignment(const Hypothesis::PtrType& hyp);
   // Get word alignment pairs or soft alignment
   std::string getAlignment(const Hypothesis::PtrType& hyp);
   // Get word-level scores
@@ -0,0 +1,299 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace marian {
+
+// Collects translation requests from many concurrent clients (e.g. websocket connections of
+// marian-server) and merges their sentences into shared batches. A background thread waits for the
+// first pending request, then keeps collecting requests until either maxWaitMs milliseconds have
+// passed or the accumulated number of source words reaches maxWords. All collected requests are
+// then translated in one go, so that their sentences end up together in the same CorpusBatches,
+// and each request receives exactly its own translations back.
+//
+// Requests are split into their lines, which are scheduled one by one: the lines of interactive
+// requests are taken before normal ones and those before bulk ones, and within a priority class
+// the lines with the earliest deadline come first, then in order of arrival. A long document thus
+// fills up the batches around short interactive requests instead of delaying them. The wait for
+// other requests ends early at the deadline of a waiting request. While interactive requests keep
+// the batches full, bulk requests wait.
+class RequestBatcher {
+public:
+  // A request consists of one or more streams (more than one for multi-source models with --tsv),
+  // each holding the same number of lines.
+  typedef std::vector<std::vector<std::string>> Streams;
+  // Receives the translation of one line of a request by its index, as soon as its mini-batch
+  // has been translated, from the thread that translated it
+  typedef std::function<void(size_t, const std::string&)> LineCallback;
+  // Translates all lines of the given streams at once and returns one output per line, calling
+  // the line callback, if not null, for each line as it is translated
+  typedef std::function<std::vector<std::string>(const Streams&, const LineCallback&)> TranslateFn;
+  // Receives the translations of a single request, one output per input line
+  typedef std::function<void(std::vector<std::string>&&)> Callback;
+  typedef std::chrono::steady_clock Clock;
+
+  enum class Priority { Interactive = 0, Normal = 1, Bulk = 2 };
+
+
+private:
+  struct Request {
+    Streams streams;
+    std::vector<std::string> outputs;
+    size_t queuedLines;   // lines not taken from the queue yet
+    size_t pendingLines;  // lines not translated yet
+    Clock::time_point deadline;
+    Callback callback;
+    LineCallback onLine; // optional
+  };
+
+  // a line of a request, the unit of scheduling
+  struct Line {
+    Request* request;
+    size_t index;
+    size_t words;
+    Priority priority;
+    Clock::time_point deadline;
+    size_t arrival;
+  };
+
+  struct Earlier {
+    bool operator()(const Line& a, const Line& b) const {
+      if(a.priority != b.priority)
+        return a.priority < b.priority;
+      if(a.deadline != b.deadline)
+        return a.deadline < b.deadline;
+      if(a.arrival != b.arrival)
+        return a.arrival < b.arrival;
+      return a.index < b.index;
+    }
+  };
+
+  TranslateFn translate_;
+  size_t maxWaitMs_;
+  size_t maxWords_;
+
+  std::set<Line, Earlier> queue_;
+  std::vector<UPtr<Request>> requests_; // with lines that have not been translated yet
+  size_t queuedRequests_{0};
+  size_t queuedWords_{0};
+  size_t arrivals_{0};
+  size_t missedDeadlines_{0};
+  bool stop_{false};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread worker_;
+
+  static size_t countWords(const std::string& line) {
+    size_t words = 0;
+    bool inWord = false;
+    for(char c : line) {
+      bool space = (c == ' ' || c == '\t');
+      if(!space && !inWord)
+        words++;
+      inWord = !space;
+    }
+    return words + 1;  // account for EOS
+  }
+
+  // the earliest deadline of the queued lines, Clock::time_point::max() if none has one
+  Clock::time_point earliestDeadline() const {
+    auto deadline = Clock::time_point::max();
+    for(const auto& line : queue_)
+      deadline = std::min(deadline, line.deadline);
+    return deadline;
+  }
+
+  // take lines in schedule order until the word budget is used up, always take at least one line
+  // to guarantee progress for lines which are bigger than the budget
+  std::vector<Line> take() {
+    std::vector<Line> lines;
+    size_t words = 0;
+    while(!queue_.empty()) {
+      const auto& next = *queue_.begin();
+      if(!lines.empty() && maxWords_ > 0 && words + next.words > maxWords_)
+        break;
+      words += next.words;
+      queuedWords_ -= next.words;
+      if(--next.request->queuedLines == 0)
+        queuedRequests_--;
+      lines.push_back(next);
+      queue_.erase(queue_.begin());
+    }
+    return lines;
+  }
+
+  void process(const std::vector<Line>& lines) {
+    size_t numStreams = lines.front().request->streams.size();
+
+    // merge the lines of all requests into a single set of streams
+    Streams merged(numStreams);
+    for(const auto& line : lines) {
+      ABORT_IF(line.request->streams.size() != numStreams,
+               "Requests with a different number of input streams cannot be batched together");
+      for(size_t i = 0; i < numStreams; ++i)
+        merged[i].push_back(line.request->streams[i][line.index]);
+    }
+
+    bool streaming = false;
+    for(const auto& line : lines)
+      streaming |= (bool)line.request->onLine;
+    auto onLine = [&lines](size_t i, const std::string& output) {
+      const auto& line = lines[i];
+      if(line.request->onLine)
+        line.request->onLine(line.index, output);
+    };
+    auto outputs = translate_(merged, streaming ? LineCallback(onLine) : LineCallback());
+    ABORT_IF(outputs.size() < lines.size(), "Missing translations for a batched request");
+
+    // dispatch the outputs back to their requests and answer the requests that are complete
+    std::vector<Request*> done;
+    for(size_t i = 0; i < lines.size(); ++i) {
+      auto request = lines[i].request;
+      request->outputs[lines[i].index] = std::move(outputs[i]);
+      if(--request->pendingLines == 0)
+        done.push_back(request);
+    }
+
+    auto now = Clock::now();
+    for(auto request : done) {
+      request->callback(std::move(request->outputs));
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(now > request->deadline)
+        missedDeadlines_++;
+      for(auto it = requests_.begin(); it != requests_.end(); ++it) {
+        if(it->get() == request) {
+          requests_.erase(it);
+          break;
+        }
+      }
+    }
+  }
+
+  void loop() {
+    for(;;) {
+      std::vector<Line> lines;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if(stop_ && queue_.empty())
+          return;
+
+        // give other clients the chance to join this batch, but not beyond the deadline of a
+        // waiting request
+        auto maxWait = Clock::now() + std::chrono::milliseconds(maxWaitMs_);
+        for(;;) {
+          if(stop_ || (maxWords_ > 0 && queuedWords_ >= maxWords_))
+            break;
+          auto until = std::min(maxWait, earliestDeadline());
+          if(Clock::now() >= until)
+            break;
+          cv_.wait_until(lock, until);
+        }
+
+        lines = take();
+      }
+      process(lines);
+    }
+  }
+
+public:
+  RequestBatcher(TranslateFn translate, size_t maxWaitMs, size_t maxWords)
+      : translate_(translate), maxWaitMs_(maxWaitMs), maxWords_(maxWords) {
+    worker_ = std::thread([this] { loop(); });
+  }
+
+  RequestBatcher(const RequestBatcher&) = delete;
+
+  ~RequestBatcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+  }
+
+  // Enqueues a request, the callback is called from the batcher thread with one translation per
+  // input line once the last batch containing lines of the request has been translated. A request
+  // with a deadline of deadlineMs milliseconds from now (0 for none) is preferred over requests of
+  // the same priority with later deadlines. With onLine, each translation is also passed on as
+  // soon as it is available.
+  void enqueue(Streams streams,
+               Callback callback,
+               Priority priority = Priority::Normal,
+               size_t deadlineMs = 0,
+               LineCallback onLine = nullptr) {
+    size_t numLines = streams.empty() ? 0 : streams.front().size();
+    if(numLines == 0) {
+      callback({});
+      return;
+    }
+
+    UPtr<Request> request(new Request());
+    request->streams = std::move(streams);
+    request->outputs.resize(numLines);
+    request->queuedLines = numLines;
+    request->pendingLines = numLines;
+    request->deadline = deadlineMs > 0 ? Clock::now() + std::chrono::milliseconds(deadlineMs)
+                                       : Clock::time_point::max();
+    request->callback = callback;
+    request->onLine = onLine;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ABORT_IF(stop_, "Enqueuing into a stopped request batcher");
+      size_t arrival = arrivals_++;
+      for(size_t i = 0; i < numLines; ++i) {
+        size_t words = 0;
+        for(const auto& lines : request->streams)
+          words += countWords(lines[i]);
+        queue_.insert({request.get(), i, words, priority, request->deadline, arrival});
+        queuedWords_ += words;
+      }
+      queuedRequests_++;
+      requests_.push_back(std::move(request));
+    }
+    cv_.notify_one();
+  }
+
+  // Number of requests with lines waiting to be translated and their source words
+  size_t pendingRequests() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queuedRequests_;
+  }
+
+  size_t pendingWords() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queuedWords_;
+  }
+
+  // Requests answered after their deadline
+  size_t missedDeadlines() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return missedDeadlines_;
+  }
+
+  // Blocking version of the above
+  std::vector<std::string> enqueue(Streams streams, Priority priority = Priority::Normal, size_t deadlineMs = 0) {
+    auto promise = New<std::promise<std::vector<std::string>>>();
+    auto future = promise->get_future();
+    enqueue(std::move(streams),
+            [promise](std::vector<std::string>&& outputs) { promise->set_value(std::move(outputs)); },
+            priority, deadlineMs);
+    return future.get();
+  }
+};
+
+}  // namespace marian
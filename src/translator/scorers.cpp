@@ -1,8 +1,31 @@
 #include "translator/scorers.h"
+#include "translator/nth_element.h"
 #include "common/io.h"
+#include "common/utils.h"
+
+#include <numeric>
 
 namespace marian {
 
+// The log-softmax can be fused into the n-best search if its output is not needed for anything else,
+// i.e. for a single model without n-best lists (score breakdown) and without sampling
+static bool fuseLogSoftmax(Ptr<Options> options) {
+  return options->get<bool>("fused-softmax-topk", false)
+         && !options->get<bool>("skip-cost", false)
+         && !options->get<bool>("n-best", false)
+         && !options->get<bool>("output-sampling", false)
+         && options->get<std::vector<std::string>>("models", {}).size() == 1;
+}
+
+bool sampleInSearch(Ptr<Options> options) {
+  return options->get<bool>("output-sampling", false)
+         && options->get<size_t>("beam-size", 0) == 1
+         && !options->get<bool>("skip-cost", false)
+         && !options->get<bool>("n-best", false)
+         && !options->hasAndNotEmpty("alignment")
+         && options->get<std::vector<std::string>>("models", {}).size() == 1;
+}
+
 Ptr<Scorer> scorerByType(const std::string& fname,
                          float weight,
                          const std::string& model,
@@ -17,12 +40,20 @@ Ptr<Scorer> scorerByType(const std::string& fname,
   }
 
   bool skipCost = options->get<bool>("skip-cost");
+  bool sample = sampleInSearch(options);
+  bool fuse = fuseLogSoftmax(options) || sample;
   auto encdec = models::createModelFromOptions(
-      options, skipCost ? models::usage::raw : models::usage::translation);
+      options, skipCost || fuse ? models::usage::raw : models::usage::translation);
 
   LOG(info, "Loading scorer of type {} as feature {}", type, fname);
 
-  return New<ScorerWrapper>(encdec, fname, weight, model);
+  auto scorer = New<ScorerWrapper>(encdec, fname, weight, model);
+  scorer->setFuseLogSoftmax(fuse);
+  if(sample) {
+    OutputSampling sampling(options);
+    scorer->setOutputSampling(sampling.temperature, sampling.restricted());
+  }
+  return scorer;
 }
 
 Ptr<Scorer> scorerByType(const std::string& fname,
@@ -39,15 +70,23 @@ Ptr<Scorer> scorerByType(const std::string& fname,
   }
 
   bool skipCost = options->get<bool>("skip-cost");
+  bool sample = sampleInSearch(options);
+  bool fuse = fuseLogSoftmax(options) || sample;
   auto encdec = models::createModelFromOptions(
-      options, skipCost ? models::usage::raw : models::usage::translation);
+      options, skipCost || fuse ? models::usage::raw : models::usage::translation);
 
   LOG(info, "Loading scorer of type {} as feature {}", type, fname);
 
-  return New<ScorerWrapper>(encdec, fname, weight, ptr);
+  auto scorer = New<ScorerWrapper>(encdec, fname, weight, ptr);
+  scorer->setFuseLogSoftmax(fuse);
+  if(sample) {
+    OutputSampling sampling(options);
+    scorer->setOutputSampling(sampling.temperature, sampling.restricted());
+  }
+  return scorer;
 }
 
-std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options) {
+std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, Ptr<const data::VocabSubset> vocabSubset) {
   std::vector<Ptr<Scorer>> scorers;
 
   auto models = options->get<std::vector<std::string>>("models");
@@ -85,7 +124,11 @@ std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options) {
       }
     }
 
+    if(vocabSubset)
+      vocabSubset->restrictOptions(modelOptions);
     scorers.push_back(scorerByType(fname, weights[i], model, modelOptions));
+    if(vocabSubset)
+      scorers.back()->setVocabSubset(vocabSubset);
     i++;
   }
 
@@ -131,4 +174,177 @@ std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, const std::vector<m
   return createScorers(options, ptrs);
 }
 
+std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, const std::vector<Ptr<io::binary::MemoryImage>>& images) {
+  std::vector<const void*> ptrs;
+  for(const auto& image : images)
+    ptrs.push_back(image->data());
+  return createScorers(options, ptrs);
+}
+
+std::vector<Ptr<io::binary::MemoryImage>> loadSharedModels(Ptr<Options> options,
+                                                           const std::vector<DeviceId>& devices) {
+  std::vector<Ptr<io::binary::MemoryImage>> images;
+  if(!options->get<bool>("cpu-shared-weights", false))
+    return images;
+
+  for(auto device : devices) {
+    if(device.type != DeviceType::cpu) {
+      LOG(warn, "[memory] Shared weights are only supported for CPU decoding, loading one model copy per device");
+      return images;
+    }
+  }
+  auto precision = options->get<std::vector<std::string>>("precision", {"float32"});
+  ABORT_IF(typeFromString(precision[0]) != Type::float32,
+           "--cpu-shared-weights requires --precision float32, the shared weights are used as stored");
+
+  for(auto model : options->get<std::vector<std::string>>("models")) {
+    // loading takes care of packing/reordering (e.g. for intgemm), so the image holds the final layout
+    auto items = io::loadItems(model);
+    auto image = New<io::binary::MemoryImage>(items);
+    LOG(info,
+        "[memory] Sharing {:.1f} MB of weights from {} between {} CPU threads",
+        image->size() / (1024.f * 1024.f),
+        model,
+        devices.size());
+    images.push_back(image);
+  }
+  return images;
+}
+
+std::vector<mio::mmap_source> mapModels(Ptr<Options> options, const std::vector<DeviceId>& devices) {
+  std::vector<mio::mmap_source> mmaps;
+  if(!options->get<bool>("cpu-mmap-weights", false))
+    return mmaps;
+
+  for(auto device : devices) {
+    if(device.type != DeviceType::cpu) {
+      LOG(warn, "[memory] Memory-mapped weights are only supported for CPU decoding, loading the models");
+      return mmaps;
+    }
+  }
+  auto precision = options->get<std::vector<std::string>>("precision", {"float32"});
+  ABORT_IF(typeFromString(precision[0]) != Type::float32,
+           "--cpu-mmap-weights requires --precision float32, the mapped weights are used as stored");
+
+  for(auto model : options->get<std::vector<std::string>>("models")) {
+    ABORT_IF(!io::isBin(model), "--cpu-mmap-weights requires binary models (.bin), not {}", model);
+    mmaps.emplace_back(model);
+    LOG(info, "[memory] Mapping {:.1f} MB of weights from {} for {} CPU threads",
+        mmaps.back().size() / (1024.f * 1024.f), model, devices.size());
+  }
+  return mmaps;
+}
+
+size_t getWorkspaceMB(Ptr<Options> options) {
+  auto workspace = options->get<std::string>("workspace");
+  if(workspace == "auto")
+    return 0;
+  try {
+    return std::stoul(workspace);
+  } catch(const std::exception&) {
+    ABORT("--workspace must be a number of MB or 'auto', got '{}'", workspace);
+  }
+}
+
+void fitWorkspace(Ptr<Options> options,
+                  Ptr<ExpressionGraph> graph,
+                  const std::vector<Ptr<Scorer>>& scorers,
+                  const std::vector<Ptr<Vocab>>& srcVocabs) {
+  if(options->get<std::string>("workspace") != "auto")
+    return;
+
+  // worst-case batch according to the batching options, see BatchGenerator
+  size_t srcLength = std::min(options->get<size_t>("workspace-probe-length", 128),
+                              options->get<size_t>("max-length", 1000));
+  srcLength = std::max(srcLength, (size_t)1);
+  size_t dimBatch = options->get<int>("mini-batch");
+  size_t mbWords = options->get<size_t>("mini-batch-words", 0);
+  if(mbWords > 0) {
+    size_t maxSentences = std::max(mbWords / srcLength, (size_t)1);
+    // without length buckets the number of sentences is only bounded by the number of words
+    dimBatch = options->get<size_t>("length-bucket-width", 0) > 0 ? std::min(dimBatch, maxSentences) : maxSentences;
+  }
+  size_t beamSize = options->get<size_t>("beam-size");
+  size_t numSteps = std::max((size_t)(options->get<float>("max-length-factor") * srcLength), (size_t)1);
+
+  LOG(info,
+      "[memory] Measuring work space with a probe batch of {} sentences of length {}, beam size {}, {} steps (device {})",
+      dimBatch, srcLength, beamSize, numSteps, graph->getDeviceId());
+
+  for(auto scorer : scorers)
+    scorer->clear(graph);
+  graph->resetWorkspaceHighWater();
+
+  { // the probe states need to be released before the work space is replaced
+    std::vector<size_t> lengths(srcVocabs.size(), srcLength);
+    auto batch = data::CorpusBatch::fakeBatch(lengths, srcVocabs, dimBatch, /*options=*/nullptr);
+
+    std::vector<Ptr<ScorerState>> states;
+    for(auto scorer : scorers)
+      states.push_back(scorer->startState(graph, batch));
+
+    // step the decoders like the beam search does with full beams, reorder the hypotheses in each
+    // step so that the state gathers are not skipped
+    std::vector<IndexType> batchIndices(dimBatch);
+    std::iota(batchIndices.begin(), batchIndices.end(), 0);
+    std::vector<IndexType> hypIndices;
+    Words prevWords;
+    for(size_t t = 0; t < numSteps; ++t) {
+      size_t currentBeamSize = t == 0 ? 1 : beamSize;
+      if(t > 0) {
+        hypIndices.clear();
+        for(size_t beamHypIdx = 0; beamHypIdx < beamSize; ++beamHypIdx)
+          for(size_t batchIdx = 0; batchIdx < dimBatch; ++batchIdx)
+            hypIndices.push_back((IndexType)((t == 1 ? 0 : beamSize - 1 - beamHypIdx) * dimBatch + batchIdx));
+        prevWords.assign(beamSize * dimBatch, Word::ZERO);
+      }
+
+      auto expandedPathScores = graph->constant({(int)currentBeamSize, 1, (int)dimBatch, 1}, inits::fromValue(0));
+      for(size_t i = 0; i < scorers.size(); ++i) {
+        states[i] = scorers[i]->step(graph, states[i], hypIndices, prevWords, batchIndices, (int)currentBeamSize);
+        expandedPathScores = expandedPathScores + scorers[i]->getWeight() * states[i]->getLogProbs().getLogits();
+      }
+      expandedPathScores = swapAxes(expandedPathScores, 0, 2);
+
+      if(t == 0)
+        graph->forward();
+      else
+        graph->forwardNext();
+    }
+  }
+
+  size_t peak = graph->getWorkspaceHighWater();
+  size_t bytes = peak + peak / 10; // margin for a different fragmentation and batches slightly above the probe
+  graph->resetWorkspace(bytes);
+  LOG(info,
+      "[memory] Measured {:.1f} MB of work space, reserved {:.1f} MB (device {})",
+      peak / (1024.f * 1024.f), bytes / (1024.f * 1024.f), graph->getDeviceId());
+}
+
+std::vector<Ptr<data::CorpusBatch>> createWarmupBatches(Ptr<Options> options,
+                                                        const std::vector<Ptr<Vocab>>& srcVocabs) {
+  std::vector<Ptr<data::CorpusBatch>> batches;
+  for(const auto& shape : options->get<std::vector<std::string>>("warmup", {})) {
+    auto dims = utils::split(shape, "x");
+    size_t dimBatch = 0, length = 0;
+    try {
+      if(dims.size() == 2) {
+        dimBatch = std::stoul(dims[0]);
+        length = std::stoul(dims[1]);
+      }
+    } catch(const std::exception&) {
+      dimBatch = length = 0;
+    }
+    ABORT_IF(dimBatch == 0 || length == 0,
+             "--warmup expects non-empty shapes SENTENCESxLENGTH, e.g. 32x64, got '{}'", shape);
+    std::vector<size_t> lengths(srcVocabs.size(), length);
+    auto batch = data::CorpusBatch::fakeBatch(lengths, srcVocabs, dimBatch, /*options=*/nullptr);
+    std::vector<size_t> sentenceIds(dimBatch);
+    std::iota(sentenceIds.begin(), sentenceIds.end(), 0);
+    batch->setSentenceIds(sentenceIds);
+    batches.push_back(batch);
+  }
+  return batches;
+}
+
 }  // namespace marian
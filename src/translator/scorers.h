@@ -3,7 +3,10 @@
 #include "marian.h"
 
 #include "data/shortlist.h"
+#include "data/vocab_subset.h"
+#include "models/costs.h"
 #include "models/model_factory.h"
+#include "common/binary.h"
 #include "3rd_party/mio/mio.hpp"
 
 namespace marian {
@@ -14,6 +17,9 @@ public:
 
   virtual Logits getLogProbs() const = 0;
 
+  // false if getLogProbs() returns unnormalized logits, which the search needs to normalize itself
+  virtual bool isNormalized() const { return true; }
+
   virtual void blacklist(Expr /*totalCosts*/, Ptr<data::CorpusBatch> /*batch*/){};
 };
 
@@ -42,27 +48,51 @@ public:
                                 const std::vector<IndexType>& batchIndices,
                                 int beamSize)
       = 0;
+  // step from the words of the previous step as indices on the device, see --device-search-sync
+  virtual Ptr<ScorerState> step(Ptr<ExpressionGraph>,
+                                Ptr<ScorerState>,
+                                Expr words,
+                                int dimBatch)
+      = 0;
+
+  // step over several tokens of a single sentence at once and the state after only the first
+  // positions of such a step, see --speculative-tokens
+  virtual Ptr<ScorerState> stepTokens(Ptr<ExpressionGraph>, Ptr<ScorerState>, const Words&) {
+    ABORT("Scorer {} does not support steps over several tokens", name_);
+  }
+  virtual Ptr<ScorerState> truncate(Ptr<ScorerState>, size_t /*positions*/) {
+    ABORT("Scorer {} does not support truncating its state", name_);
+  }
 
   virtual void init(Ptr<ExpressionGraph>) {}
 
   virtual void setShortlistGenerator(Ptr<const data::ShortlistGenerator> /*shortlistGenerator*/){};
   virtual Ptr<data::Shortlist> getShortlist() { return nullptr; };
 
+  // Restricts the target vocabulary of the model when init() loads it, see --output-vocab-subset
+  virtual void setVocabSubset(Ptr<const data::VocabSubset> /*vocabSubset*/) {
+    ABORT("Scorer {} does not support a vocabulary subset", name_);
+  }
+
   virtual std::vector<float> getAlignment() { return {}; };
 };
 
 class ScorerWrapperState : public ScorerState {
 protected:
   Ptr<DecoderState> state_;
+  bool normalized_;
 
 public:
-  ScorerWrapperState(Ptr<DecoderState> state) : state_(state) {}
+  ScorerWrapperState(Ptr<DecoderState> state, bool normalized = true)
+      : state_(state), normalized_(normalized) {}
   virtual ~ScorerWrapperState() {}
 
   virtual Ptr<DecoderState> getState() { return state_; }
 
   virtual Logits getLogProbs() const override { return state_->getLogProbs(); };
 
+  virtual bool isNormalized() const override { return normalized_; }
+
   virtual void blacklist(Expr totalCosts, Ptr<data::CorpusBatch> batch) override {
     state_->blacklist(totalCosts, batch);
   }
@@ -74,6 +104,10 @@ private:
   Ptr<IEncoderDecoder> encdec_;
   std::string fname_;
   const void* ptr_;
+  bool fuseLogSoftmax_{false}; // the model returns raw logits, see setFuseLogSoftmax()
+  Ptr<models::GumbelSoftmaxStep> gumbel_; // with --output-sampling, see setOutputSampling()
+  bool restrictedSampling_{false};
+  Ptr<const data::VocabSubset> vocabSubset_; // trims the model on loading, see setVocabSubset()
 
 public:
   ScorerWrapper(Ptr<models::IModel> encdec,
@@ -97,10 +131,16 @@ public:
 
   virtual void init(Ptr<ExpressionGraph> graph) override {
     graph->switchParams(getName());
-    if(ptr_)
+    if(vocabSubset_) {
+      ABORT_IF(ptr_, "A vocabulary subset cannot be applied to shared or memory-mapped models");
+      auto items = io::loadItems(fname_);
+      vocabSubset_->restrictItems(items);
+      graph->load(items);
+    } else if(ptr_) {
       encdec_->mmap(graph, ptr_);
-    else
+    } else {
       encdec_->load(graph, fname_);
+    }
   }
 
   virtual void clear(Ptr<ExpressionGraph> graph) override {
@@ -123,9 +163,60 @@ public:
     graph->switchParams(getName());
     auto wrapperState = std::dynamic_pointer_cast<ScorerWrapperState>(state);
     auto newState = encdec_->step(graph, wrapperState->getState(), hypIndices, words, batchIndices, beamSize);
+    if(fuseLogSoftmax_) {
+      // the fused search only exists on the CPU and for outputs without factors, normalize here otherwise
+      size_t numFactorGroups = newState->getLogProbs().getNumFactorGroups();
+      if(graph->getDeviceId().type == DeviceType::cpu && numFactorGroups == 1)
+        return New<ScorerWrapperState>(newState, /*normalized=*/false);
+      // the greedy search samples restricted distributions of normalized scores, other sampling is
+      // done by the search taking the best words after Gumbel noise
+      if(gumbel_ && (!restrictedSampling_ || numFactorGroups > 1))
+        return New<ScorerWrapperState>(gumbel_->apply(newState));
+      newState->setLogProbs(newState->getLogProbs().applyUnaryFunction(logsoftmax));
+    }
     return New<ScorerWrapperState>(newState);
   }
 
+  virtual Ptr<ScorerState> step(Ptr<ExpressionGraph> graph,
+                                Ptr<ScorerState> state,
+                                Expr words,
+                                int dimBatch) override {
+    graph->switchParams(getName());
+    auto wrapperState = std::dynamic_pointer_cast<ScorerWrapperState>(state);
+    auto newState = encdec_->step(graph, wrapperState->getState(), words, dimBatch);
+    if(fuseLogSoftmax_)
+      newState->setLogProbs(newState->getLogProbs().applyUnaryFunction(logsoftmax));
+    return New<ScorerWrapperState>(newState);
+  }
+
+  virtual Ptr<ScorerState> stepTokens(Ptr<ExpressionGraph> graph,
+                                      Ptr<ScorerState> state,
+                                      const Words& words) override {
+    graph->switchParams(getName());
+    auto wrapperState = std::dynamic_pointer_cast<ScorerWrapperState>(state);
+    auto newState = encdec_->stepTokens(graph, wrapperState->getState(), words, /*dimBatch=*/1);
+    if(fuseLogSoftmax_)
+      newState->setLogProbs(newState->getLogProbs().applyUnaryFunction(logsoftmax));
+    return New<ScorerWrapperState>(newState);
+  }
+
+  virtual Ptr<ScorerState> truncate(Ptr<ScorerState> state, size_t positions) override {
+    auto wrapperState = std::dynamic_pointer_cast<ScorerWrapperState>(state);
+    return New<ScorerWrapperState>(wrapperState->getState()->truncate(positions), wrapperState->isNormalized());
+  }
+
+  // If set, the wrapped model is expected to return raw logits and the log-softmax is left to the
+  // search, which fuses it with the n-best selection where possible
+  void setFuseLogSoftmax(bool fuse) { fuseLogSoftmax_ = fuse; }
+
+  // With --output-sampling and the log-softmax left to the search (see sampleInSearch()), steps
+  // whose logits are not returned raw get the Gumbel noise of the temperature, unless a restricted
+  // distribution is sampled by the search from the normalized scores
+  void setOutputSampling(float temperature, bool restricted) {
+    gumbel_ = New<models::GumbelSoftmaxStep>(temperature);
+    restrictedSampling_ = restricted;
+  }
+
   virtual void setShortlistGenerator(
       Ptr<const data::ShortlistGenerator> shortlistGenerator) override {
     encdec_->setShortlistGenerator(shortlistGenerator);
@@ -135,6 +226,10 @@ public:
     return encdec_->getShortlist();
   };
 
+  virtual void setVocabSubset(Ptr<const data::VocabSubset> vocabSubset) override {
+    vocabSubset_ = vocabSubset;
+  }
+
   virtual std::vector<float> getAlignment() override {
     // This is called during decoding, where alignments only exist for the last time step. Hence front().
     // This makes as copy. @TODO: It should be OK to return this as a const&.
@@ -142,12 +237,18 @@ public:
   }
 };
 
+// True if --output-sampling samples in the greedy search, from the raw logits on the CPU, instead of
+// the model adding Gumbel noise to its log-probs, i.e. for a single model with a beam size of 1
+bool sampleInSearch(Ptr<Options> options);
+
 Ptr<Scorer> scorerByType(const std::string& fname,
                          float weight,
                          const std::string& model,
                          Ptr<Options> config);
 
-std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options);
+// With a vocabulary subset, the options of each model are restricted to it and the models are
+// trimmed when they are loaded, see data::VocabSubset
+std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, Ptr<const data::VocabSubset> vocabSubset = nullptr);
 
 Ptr<Scorer> scorerByType(const std::string& fname,
                          float weight,
@@ -156,5 +257,33 @@ Ptr<Scorer> scorerByType(const std::string& fname,
 
 std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, const std::vector<const void*>& ptrs);
 std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, const std::vector<mio::mmap_source>& mmaps);
+std::vector<Ptr<Scorer>> createScorers(Ptr<Options> options, const std::vector<Ptr<io::binary::MemoryImage>>& images);
+
+// Loads each model given by --models once into a memory image that all CPU graphs map read-only,
+// see --cpu-shared-weights. Returns an empty vector if shared weights are not enabled.
+std::vector<Ptr<io::binary::MemoryImage>> loadSharedModels(Ptr<Options> options,
+                                                           const std::vector<DeviceId>& devices);
+
+// Memory-maps each model given by --models read-only for all CPU graphs, see --cpu-mmap-weights.
+// Returns an empty vector if mapping is not enabled.
+std::vector<mio::mmap_source> mapModels(Ptr<Options> options, const std::vector<DeviceId>& devices);
+
+// Returns the work space in MB given by --workspace, or 0 for 'auto'
+size_t getWorkspaceMB(Ptr<Options> options);
+
+// For --workspace auto: decodes a worst-case batch of fake source sentences with the initialized
+// scorers, i.e. the largest batch the batching options allow with --workspace-probe-length words per
+// sentence and as many decoder steps as --max-length-factor allows. Then replaces the work space of
+// the graph by the measured peak plus a margin. Does nothing for a fixed --workspace.
+void fitWorkspace(Ptr<Options> options,
+                  Ptr<ExpressionGraph> graph,
+                  const std::vector<Ptr<Scorer>>& scorers,
+                  const std::vector<Ptr<Vocab>>& srcVocabs);
+
+// Batches of random source words in the shapes given by --warmup as SENTENCESxLENGTH, e.g. "1x16 32x64".
+// Decoding them before the first requests runs the lazy initializations of devices, libraries, work
+// space and shortlists, which would otherwise delay the first requests.
+std::vector<Ptr<data::CorpusBatch>> createWarmupBatches(Ptr<Options> options,
+                                                        const std::vector<Ptr<Vocab>>& srcVocabs);
 
 }  // namespace marian
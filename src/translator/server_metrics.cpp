@@ -0,0 +1,165 @@
+#include "translator/server_metrics.h"
+
+#include "common/logging.h"
+#include "graph/expression_graph.h"
+#include "translator/decoder_profiler.h"
+#include "translator/request_batcher.h"
+#include "translator/translation_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace marian {
+
+static const char* PHASE_NAMES[ServerMetrics::NumPhases] = {"tokenize", "search", "detokenize"};
+
+static const std::vector<double> SECONDS_BOUNDS
+    = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 60};
+static const std::vector<double> SENTENCES_BOUNDS = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+
+static std::string joinLabels(const std::string& labels, const std::string& label) {
+  return labels.empty() ? label : labels + "," + label;
+}
+
+static void writeHeader(std::string& out, const std::string& name, const std::string& type, const std::string& help) {
+  out += fmt::format("# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+template <typename T>
+static void writeMetric(std::string& out,
+                        const std::string& name,
+                        const std::string& type,
+                        const std::string& help,
+                        T value) {
+  writeHeader(out, name, type, help);
+  out += fmt::format("{} {}\n", name, value);
+}
+
+void ServerMetrics::Histogram::observe(double value) {
+  size_t bucket = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+  counts_[bucket]++;
+  sum_ += value;
+}
+
+void ServerMetrics::Histogram::write(std::string& out, const std::string& name, const std::string& labels) const {
+  size_t count = 0;
+  for(size_t i = 0; i < bounds_.size(); ++i) {
+    count += counts_[i];
+    out += fmt::format("{}_bucket{{{}}} {}\n", name, joinLabels(labels, fmt::format("le=\"{}\"", bounds_[i])), count);
+  }
+  count += counts_.back();
+  out += fmt::format("{}_bucket{{{}}} {}\n", name, joinLabels(labels, "le=\"+Inf\""), count);
+  std::string braced = labels.empty() ? "" : "{" + labels + "}";
+  out += fmt::format("{}_sum{} {}\n", name, braced, sum_);
+  out += fmt::format("{}_count{} {}\n", name, braced, count);
+}
+
+// the decoder profiler counts durations in [2^(i-1), 2^i) microseconds in bucket i
+static void writeProfile(std::string& out, const std::string& name, const std::string& labels, const profiling::Histogram& h) {
+  size_t count = 0;
+  for(size_t i = 0; i < profiling::Histogram::NUM_BUCKETS; ++i) {
+    count += h.bucket(i);
+    out += fmt::format("{}_bucket{{{},le=\"{}\"}} {}\n", name, labels, std::ldexp(1., (int)i) * 1e-6, count);
+  }
+  out += fmt::format("{}_bucket{{{},le=\"+Inf\"}} {}\n", name, labels, count);
+  out += fmt::format("{}_sum{{{}}} {}\n", name, labels, h.total() * 1e-6);
+  out += fmt::format("{}_count{{{}}} {}\n", name, labels, count);
+}
+
+ServerMetrics::ServerMetrics(size_t numGraphs)
+    : requestSeconds_(SECONDS_BOUNDS),
+      batchSentences_(SENTENCES_BOUNDS),
+      phaseSeconds_(NumPhases, Histogram(SECONDS_BOUNDS)),
+      workspaces_(numGraphs) {}
+
+Ptr<ServerMetrics> ServerMetrics::create(Ptr<Options> options, size_t numGraphs) {
+  if(options->get<size_t>("metrics-port", 0) == 0)
+    return nullptr;
+  return New<ServerMetrics>(numGraphs);
+}
+
+void ServerMetrics::finishRequest(double seconds) {
+  inFlight_--;
+  std::lock_guard<std::mutex> lock(mutex_);
+  requestSeconds_.observe(seconds);
+}
+
+void ServerMetrics::recordBatch(size_t sentences) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  batchSentences_.observe((double)sentences);
+}
+
+void ServerMetrics::recordPhase(Phase phase, double seconds) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  phaseSeconds_[phase].observe(seconds);
+}
+
+void ServerMetrics::recordWorkspace(size_t graphIdx, Ptr<ExpressionGraph> graph) {
+  auto allocator = graph->getTensorAllocator()->allocator();
+  Workspace workspace;
+  workspace.device = std::string(graph->getDeviceId());
+  workspace.bytes = allocator->size();
+  workspace.usedBytes = allocator->size() - allocator->available();
+  workspace.highWaterBytes = allocator->highWater();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  workspaces_[graphIdx] = workspace;
+}
+
+std::string ServerMetrics::render(TranslationCache* cache, RequestBatcher* batcher, profiling::DecoderProfiler* profiler) {
+  std::string out;
+  writeMetric(out, "marian_requests_total", "counter", "Translation requests received", requests_.load());
+  writeMetric(out, "marian_request_lines_total", "counter", "Input lines of all translation requests", lines_.load());
+  writeMetric(out, "marian_requests_in_flight", "gauge", "Translation requests received but not answered yet", inFlight_.load());
+  if(batcher) {
+    writeMetric(out, "marian_queue_requests", "gauge", "Requests waiting to be merged into batches", batcher->pendingRequests());
+    writeMetric(out, "marian_queue_words", "gauge", "Source words of the requests waiting to be merged into batches", batcher->pendingWords());
+    writeMetric(out, "marian_deadline_misses_total", "counter", "Requests answered after their deadline", batcher->missedDeadlines());
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeHeader(out, "marian_request_duration_seconds", "histogram", "Time from receiving a request to its translation");
+    requestSeconds_.write(out, "marian_request_duration_seconds");
+    writeHeader(out, "marian_batch_sentences", "histogram", "Sentences per translated batch, without cached ones");
+    batchSentences_.write(out, "marian_batch_sentences");
+    writeHeader(out, "marian_phase_duration_seconds", "histogram", "Time per batch spent in each phase of the translation");
+    for(size_t i = 0; i < NumPhases; ++i)
+      phaseSeconds_[i].write(out, "marian_phase_duration_seconds", fmt::format("phase=\"{}\"", PHASE_NAMES[i]));
+
+    const std::string names[3] = {"marian_workspace_bytes", "marian_workspace_used_bytes", "marian_workspace_high_water_bytes"};
+    const std::string helps[3] = {"Reserved workspace memory of a graph after the last batch",
+                                  "Allocated workspace memory of a graph after the last batch",
+                                  "Largest workspace memory a graph has needed so far"};
+    for(size_t m = 0; m < 3; ++m) {
+      writeHeader(out, names[m], "gauge", helps[m]);
+      for(size_t i = 0; i < workspaces_.size(); ++i) {
+        const auto& workspace = workspaces_[i];
+        if(workspace.device.empty()) // no batch translated yet
+          continue;
+        size_t value = m == 0 ? workspace.bytes : (m == 1 ? workspace.usedBytes : workspace.highWaterBytes);
+        out += fmt::format("{}{{graph=\"{}\",device=\"{}\"}} {}\n", names[m], i, workspace.device, value);
+      }
+    }
+  }
+
+  if(cache) {
+    writeMetric(out, "marian_cache_lookups_total", "counter", "Sentences looked up in the translation cache", cache->lookups());
+    writeMetric(out, "marian_cache_hits_total", "counter", "Sentences found in the translation cache", cache->hits());
+    writeMetric(out, "marian_cache_entries", "gauge", "Translations in the translation cache", cache->entries());
+    writeMetric(out, "marian_cache_bytes", "gauge", "Memory used by the translation cache", cache->bytes());
+  }
+
+  // the time of the encoders and of the single decoding steps, with --decoder-profile
+  if(profiler) {
+    writeMetric(out, "marian_decoder_steps_total", "counter", "Decoding steps of all batches", profiler->steps());
+    auto phases = profiler->phases();
+    writeHeader(out, "marian_decoder_phase_duration_seconds", "histogram", "Time per call of each phase of the beam search");
+    for(size_t i = 0; i < profiling::NumPhases; ++i)
+      writeProfile(out, "marian_decoder_phase_duration_seconds",
+                   fmt::format("phase=\"{}\"", profiling::DecoderProfiler::phaseName((profiling::Phase)i)), phases[i]);
+  }
+  return out;
+}
+
+}  // namespace marian
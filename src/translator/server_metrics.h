@@ -0,0 +1,86 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/options.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace marian {
+
+class ExpressionGraph;
+class RequestBatcher;
+class TranslationCache;
+
+namespace profiling {
+class DecoderProfiler;
+}
+
+// Metrics of the translation service for monitoring and capacity planning, served by marian-server in
+// the Prometheus text exposition format with --metrics-port. Counters only ever grow, rates such as
+// requests per second are computed by the scraper. Recording is cheap, it happens once per request
+// and once per batch, and not per sentence or decoding step.
+class ServerMetrics {
+public:
+  // Histogram with fixed upper bucket bounds, a value is counted in the first bucket with bound >= value
+  class Histogram {
+  private:
+    std::vector<double> bounds_;
+    std::vector<size_t> counts_; // [bucket], the last one for values above all bounds
+    double sum_{0};
+
+  public:
+    Histogram(const std::vector<double>& bounds) : bounds_(bounds), counts_(bounds.size() + 1, 0) {}
+
+    void observe(double value);
+
+    // Appends the cumulative buckets, the sum and the count of the given metric
+    void write(std::string& out, const std::string& name, const std::string& labels = "") const;
+  };
+
+  enum Phase : size_t { Tokenize, Search, Detokenize, NumPhases };
+
+private:
+  std::atomic<size_t> requests_{0};
+  std::atomic<size_t> lines_{0};
+  std::atomic<size_t> inFlight_{0};
+
+  std::mutex mutex_; // guards the members below
+  Histogram requestSeconds_;
+  Histogram batchSentences_;
+  std::vector<Histogram> phaseSeconds_; // [phase]
+
+  struct Workspace {
+    std::string device;
+    size_t bytes{0};
+    size_t usedBytes{0};
+    size_t highWaterBytes{0};
+  };
+  std::vector<Workspace> workspaces_; // [graph index]
+
+public:
+  ServerMetrics(size_t numGraphs);
+
+  // Creates the metrics if requested with --metrics-port, otherwise returns nullptr
+  static Ptr<ServerMetrics> create(Ptr<Options> options, size_t numGraphs);
+
+  void startRequest(size_t lines) {
+    requests_++;
+    lines_ += lines;
+    inFlight_++;
+  }
+  void finishRequest(double seconds);
+
+  void recordBatch(size_t sentences);
+  void recordPhase(Phase phase, double seconds);
+
+  // Records the workspace usage of the graph after a batch, called from the thread that uses the graph
+  void recordWorkspace(size_t graphIdx, Ptr<ExpressionGraph> graph);
+
+  // Returns all metrics in the Prometheus text format. The other sources are optional, i.e. can be null.
+  std::string render(TranslationCache* cache, RequestBatcher* batcher, profiling::DecoderProfiler* profiler);
+};
+
+}  // namespace marian
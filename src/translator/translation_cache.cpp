@@ -0,0 +1,150 @@
+#include "translator/translation_cache.h"
+
+#include "common/hash.h"
+#include "common/logging.h"
+
+namespace marian {
+
+// rough per-entry overhead of list node, hash map node and vectors
+static const size_t ENTRY_OVERHEAD = 128;
+
+TranslationCache::TranslationCache(Ptr<Options> options, size_t maxBytes, size_t numShards)
+    : seed_(util::hash<std::string>()(options->asYamlString())),
+      maxBytesPerShard_(maxBytes / std::max(numShards, (size_t)1)) {
+  for(size_t i = 0; i < std::max(numShards, (size_t)1); ++i)
+    shards_.emplace_back(new Shard());
+}
+
+Ptr<TranslationCache> TranslationCache::create(Ptr<Options> options) {
+  size_t maxMB = options->get<size_t>("translation-cache", 0);
+  if(maxMB == 0)
+    return nullptr;
+  size_t numShards = options->get<size_t>("translation-cache-shards", 8);
+  LOG(info, "[cache] Caching translations in up to {} MB ({} shards)", maxMB, numShards);
+  // copy the options as they are modified for inference by the caller
+  return New<TranslationCache>(New<Options>(options->clone()), maxMB * 1024 * 1024, numShards);
+}
+
+size_t TranslationCache::hash(const Key& key) const {
+  size_t seed = seed_;
+  for(const auto& words : key) {
+    util::hash_combine(seed, words.size());
+    for(auto word : words)
+      util::hash_combine(seed, word);
+  }
+  return seed;
+}
+
+TranslationCache::Key TranslationCache::getKey(Ptr<data::CorpusBatch> batch, size_t batchIdx) {
+  Key key;
+  for(size_t j = 0; j < batch->sets(); ++j) {
+    auto subBatch = (*batch)[j];
+    Words words;
+    for(size_t s = 0; s < subBatch->batchWidth(); ++s) {
+      auto idx = subBatch->locate(batchIdx, s);
+      if(subBatch->mask()[idx] == 0)
+        break;
+      words.push_back(subBatch->data()[idx]);
+    }
+    key.push_back(words);
+  }
+  return key;
+}
+
+bool TranslationCache::get(const Key& key, Entry& entry) {
+  lookups_++;
+  size_t h = hash(key);
+  auto& shard = *shards_[h % shards_.size()];
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(h);
+  if(it == shard.index.end() || it->second->key != key) // hash collisions count as misses
+    return false;
+
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second); // mark as most recently used
+  entry = it->second->entry;
+  hits_++;
+  return true;
+}
+
+void TranslationCache::put(const Key& key, const Entry& entry) {
+  size_t h = hash(key);
+  auto& shard = *shards_[h % shards_.size()];
+
+  size_t bytes = ENTRY_OVERHEAD + entry.best1.size() + entry.bestn.size();
+  for(const auto& words : key)
+    bytes += words.size() * sizeof(Word);
+  if(bytes > maxBytesPerShard_)
+    return;
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(h);
+  if(it != shard.index.end()) { // replace existing entry, including colliding ones
+    shard.bytes -= it->second->bytes;
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+  }
+
+  // evict least recently used entries until the new entry fits
+  while(!shard.lru.empty() && shard.bytes + bytes > maxBytesPerShard_) {
+    auto& last = shard.lru.back();
+    shard.bytes -= last.bytes;
+    shard.index.erase(hash(last.key));
+    shard.lru.pop_back();
+  }
+
+  shard.lru.push_front(Item{key, entry, bytes});
+  shard.index[h] = shard.lru.begin();
+  shard.bytes += bytes;
+}
+
+Ptr<data::CorpusBatch> TranslationCache::filter(Ptr<data::CorpusBatch> batch,
+                                                const std::function<void(size_t, const Entry&)>& onHit) {
+  std::vector<size_t> misses;
+  for(size_t i = 0; i < batch->size(); ++i) {
+    Entry entry;
+    if(get(getKey(batch, i), entry))
+      onHit(batch->getSentenceIds()[i], entry);
+    else
+      misses.push_back(i);
+  }
+
+  if(misses.empty())
+    return nullptr;
+  else if(misses.size() == batch->size())
+    return batch;
+  else
+    return batch->select(misses);
+}
+
+size_t TranslationCache::entries() {
+  size_t entries = 0;
+  for(auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    entries += shard->lru.size();
+  }
+  return entries;
+}
+
+size_t TranslationCache::bytes() {
+  size_t bytes = 0;
+  for(auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    bytes += shard->bytes;
+  }
+  return bytes;
+}
+
+void TranslationCache::logStats() {
+  size_t lookups = lookups_, hits = hits_;
+  LOG(info,
+      "[cache] {} lookups, {} hits ({:.2f}%), {} entries, {:.2f} MB of {:.2f} MB used",
+      lookups,
+      hits,
+      lookups > 0 ? 100.f * hits / lookups : 0.f,
+      entries(),
+      bytes() / (1024.f * 1024.f),
+      maxBytesPerShard_ * shards_.size() / (1024.f * 1024.f));
+}
+
+}  // namespace marian
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/options.h"
+#include "data/corpus_base.h"
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace marian {
+
+// In-process cache of finished translations, keyed by the source token ids of all input streams.
+// The key is additionally seeded with a hash of the configuration (models, vocabularies, decoding
+// options), so stale entries cannot be returned for a different setup. The cache is split into
+// shards, each with its own LRU list and lock, and bounded by the total memory used by the cached
+// keys and outputs. Sentences found in the cache are removed from a batch before it is decoded.
+class TranslationCache {
+public:
+  struct Entry {
+    std::string best1;
+    std::string bestn;
+  };
+
+  typedef std::vector<Words> Key; // [stream index][step index]
+
+private:
+  struct Item {
+    Key key;
+    Entry entry;
+    size_t bytes;
+  };
+
+  struct Shard {
+    std::list<Item> lru; // most recently used first
+    std::unordered_map<size_t, std::list<Item>::iterator> index;
+    size_t bytes{0};
+    std::mutex mutex;
+  };
+
+  size_t seed_;
+  size_t maxBytesPerShard_;
+  std::vector<UPtr<Shard>> shards_;
+
+  std::atomic<size_t> lookups_{0};
+  std::atomic<size_t> hits_{0};
+
+  size_t hash(const Key& key) const;
+  static Key getKey(Ptr<data::CorpusBatch> batch, size_t batchIdx);
+
+public:
+  TranslationCache(Ptr<Options> options, size_t maxBytes, size_t numShards);
+
+  // Creates a cache if enabled in the options with --translation-cache, otherwise returns nullptr
+  static Ptr<TranslationCache> create(Ptr<Options> options);
+
+  bool get(const Key& key, Entry& entry);
+  void put(const Key& key, const Entry& entry);
+
+  // Calls onHit(sentenceId, entry) for each sentence in the batch with a cached translation and
+  // returns a batch with the remaining sentences, or nullptr if all sentences have been cached.
+  Ptr<data::CorpusBatch> filter(Ptr<data::CorpusBatch> batch,
+                                const std::function<void(size_t, const Entry&)>& onHit);
+
+  // Stores the translation of the batchIdx-th sentence in the batch
+  void put(Ptr<data::CorpusBatch> batch, size_t batchIdx, const Entry& entry) {
+    put(getKey(batch, batchIdx), entry);
+  }
+
+  size_t lookups() const { return lookups_; }
+  size_t hits() const { return hits_; }
+  size_t entries();
+  size_t bytes();
+
+  // Logs hit-rate and memory usage
+  void logStats();
+};
+
+}  // namespace marian
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <mutex>
 #include <string>
 
+#include "common/filesystem.h"
+#include "common/timer.h"
 #include "data/batch_generator.h"
 #include "data/corpus.h"
 #include "data/shortlist.h"
@@ -9,23 +14,86 @@
 
 #include "3rd_party/threadpool.h"
 
+#include "translator/decoder_profiler.h"
 #include "translator/history.h"
+#include "translator/nth_element.h"
 #include "translator/output_collector.h"
 #include "translator/output_printer.h"
+#include "translator/request_batcher.h"
+#include "translator/server_metrics.h"
+#include "translator/translation_cache.h"
 
 #include "models/model_task.h"
+#include "tensors/cpu/integer_common.h"
+#include "tensors/device.h"
+#include "translator/mpi_output.h"
 #include "translator/scorers.h"
 
-// currently for diagnostics only, will try to mmap files ending in *.bin suffix when enabled.
-// @TODO: add this as an actual feature.
-#define MMAP 0
-
-#if MMAP
 #include "3rd_party/mio/mio.hpp"
-#endif
 
 namespace marian {
 
+// With --parallel-ensemble each model of an ensemble is placed on its own device and a worker
+// consists of as many consecutive devices as there are models, which are stepped concurrently.
+// Otherwise a worker is a single device holding all models. Returns the number of devices per worker.
+static inline size_t getDevicesPerWorker(Ptr<Options> options, size_t numDevices) {
+  size_t numModels = options->get<std::vector<std::string>>("models").size();
+  if(!options->get<bool>("parallel-ensemble", false) || numModels < 2)
+    return 1;
+  ABORT_IF(numDevices % numModels != 0,
+           "--parallel-ensemble requires the number of devices ({}) to be a multiple of the number of models ({})",
+           numDevices, numModels);
+  LOG(info, "Stepping the {} models of the ensemble concurrently on {} workers", numModels, numDevices / numModels);
+  return numModels;
+}
+
+// With --output-vocab-subset, restricts the target vocabulary to the words of the given files and
+// returns the subset that the models are trimmed to on loading, otherwise returns nullptr
+static inline Ptr<const data::VocabSubset> restrictTargetVocab(Ptr<Options> options, Ptr<Vocab> trgVocab) {
+  if(!options->hasAndNotEmpty("output-vocab-subset"))
+    return nullptr;
+  ABORT_IF(options->hasAndNotEmpty("shortlist"), "--output-vocab-subset cannot be combined with --shortlist");
+  ABORT_IF(options->get<bool>("cpu-shared-weights", false) || options->get<bool>("cpu-mmap-weights", false),
+           "--output-vocab-subset cannot be combined with --cpu-shared-weights or --cpu-mmap-weights");
+  auto vocabSubset = New<data::VocabSubset>(options->get<std::vector<std::string>>("output-vocab-subset"), trgVocab);
+  trgVocab->restrict(vocabSubset->words());
+  return vocabSubset;
+}
+
+// With --cpu-pin-threads, the thread of each worker on CPU graphs is pinned to its own core and the
+// workers are spread over the NUMA nodes
+static inline bool pinWorkerThreads(Ptr<Options> options) {
+  return options->get<bool>("cpu-pin-threads", false)
+         && Config::getDevices(options)[0].type == DeviceType::cpu;
+}
+
+// With --cpu-pin-threads, the memory of the graph of device id is allocated on the NUMA node of the
+// worker that uses it, see --cpu-numa-memory, also if the calling thread runs on another node
+static inline void allocateForWorkerOf(Ptr<Options> options, size_t id, size_t devicesPerWorker) {
+  if(pinWorkerThreads(options))
+    cpu::setThreadNumaNode(utils::numaNodeOfCore(id / devicesPerWorker));
+}
+
+// With --gpu-memory-pool, the work spaces that have grown for a large batch are shrunk again after
+// it, so that the memory goes back to the pool of the GPU for the other graphs on it
+static inline void releaseGrownWorkspaces(const std::vector<Ptr<ExpressionGraph>>& graphs) {
+#ifdef CUDA_FOUND
+  if(!gpu::usesMemoryPool())
+    return;
+  for(auto graph : graphs)
+    if(graph->getDeviceId().type == DeviceType::gpu)
+      graph->trimWorkspace();
+#else
+  graphs;
+#endif
+}
+
+// Estimated cost of decoding a batch for ThreadPool::enqueueWithCost(), its source words times the
+// beam size, so that the workers get batches of about equal total cost rather than equal numbers
+static inline size_t getBatchCost(Ptr<data::CorpusBatch> batch, Ptr<Options> options) {
+  return std::max<size_t>(1, batch->words() * options->get<size_t>("beam-size", 1));
+}
+
 template <class Search>
 class Translate : public ModelTask {
 private:
@@ -35,13 +103,31 @@ private:
 
   Ptr<data::Corpus> corpus_;
   Ptr<Vocab> trgVocab_;
+  Ptr<const data::VocabSubset> vocabSubset_; // with --output-vocab-subset
   Ptr<const data::ShortlistGenerator> shortlistGenerator_;
+  Ptr<TranslationCache> cache_;
+  Ptr<profiling::DecoderProfiler> profiler_; // with --decoder-profile
 
   size_t numDevices_;
+  size_t devicesPerWorker_; // see getDevicesPerWorker()
+  size_t numGpuDevices_;    // the devices before the CPU devices of --hybrid-cpu-threads
 
-#if MMAP
+  // models memory-mapped by all graphs with --cpu-mmap-weights
   std::vector<mio::mmap_source> mmaps_;
-#endif
+  // models loaded once and mapped by all graphs with --cpu-shared-weights
+  std::vector<Ptr<io::binary::MemoryImage>> sharedModels_;
+
+  // With --hybrid-cpu-threads, appends the CPU devices that decode next to the GPUs
+  void addHybridCpuDevices(std::vector<DeviceId>& devices) {
+    size_t cpuThreads = options_->get<size_t>("hybrid-cpu-threads", 0);
+    if(cpuThreads == 0)
+      return;
+    ABORT_IF(devices[0].type != DeviceType::gpu, "--hybrid-cpu-threads requires GPU devices, not --cpu-threads");
+    ABORT_IF(devicesPerWorker_ > 1, "--hybrid-cpu-threads cannot be combined with --parallel-ensemble");
+    for(size_t i = 0; i < cpuThreads; ++i)
+      devices.push_back({i, DeviceType::cpu});
+    LOG(info, "Decoding on {} GPUs and {} CPU threads", numGpuDevices_, cpuThreads);
+  }
 
 public:
   Translate(Ptr<Options> options)
@@ -52,61 +138,102 @@ public:
     options_->set("inference", true,
                   "shuffle", "none");
 
+    // Startup runs in stages that overlap where they do not depend on each other: the model files
+    // are mapped or loaded while the vocabularies are read, the shortlist is loaded while the graphs
+    // are set up, and the graphs of all devices are set up in parallel.
+    timer::Timer startupTimer;
+    auto devices = Config::getDevices(options_);
+    devicesPerWorker_ = getDevicesPerWorker(options_, devices.size());
+    numGpuDevices_ = devices.size();
+    addHybridCpuDevices(devices);
+    numDevices_ = devices.size();
+
+    // the corpus adds dim-vocabs to options_ meanwhile, so the models are loaded with a copy
+    auto modelOptions = New<Options>(options_->clone());
+    auto modelsLoaded = std::async(std::launch::async, [this, modelOptions, devices]() {
+      timer::Timer timer;
+      mmaps_ = mapModels(modelOptions, devices);
+      if(mmaps_.empty())
+        sharedModels_ = loadSharedModels(modelOptions, devices);
+      if(!mmaps_.empty() || !sharedModels_.empty())
+        LOG(info, "[startup] Prepared the model files in {:.2f}s", timer.elapsed());
+    });
+
+    timer::Timer vocabTimer;
     corpus_ = New<data::Corpus>(options_, true);
 
     auto vocabs = options_->get<std::vector<std::string>>("vocabs");
     trgVocab_ = New<Vocab>(options_, vocabs.size() - 1);
     trgVocab_->load(vocabs.back());
+    vocabSubset_ = restrictTargetVocab(options_, trgVocab_);
     auto srcVocab = corpus_->getVocabs()[0];
+    LOG(info, "[startup] Loaded the vocabularies in {:.2f}s", vocabTimer.elapsed());
 
-    if(options_->hasAndNotEmpty("shortlist"))
-      shortlistGenerator_ = New<data::LexicalShortlistGenerator>(
+    std::shared_future<void> shortlistLoaded = std::async(std::launch::async, [=]() {
+      if(!options_->hasAndNotEmpty("shortlist"))
+        return;
+      timer::Timer timer;
+      shortlistGenerator_ = data::createShortlistGenerator(
           options_, srcVocab, trgVocab_, 0, 1, vocabs.front() == vocabs.back());
+      LOG(info, "[startup] Loaded the shortlist in {:.2f}s", timer.elapsed());
+    });
 
-    auto devices = Config::getDevices(options_);
-    numDevices_ = devices.size();
+    cache_ = TranslationCache::create(options_);
+    profiler_ = profiling::DecoderProfiler::create(options_);
+    if(options_->hasAndNotEmpty("quantize-statistics"))
+      cpu::integer::ActivationStatistics::instance().enable();
 
     ThreadPool threadPool(numDevices_, numDevices_);
     scorers_.resize(numDevices_);
     graphs_.resize(numDevices_);
 
-#if MMAP
-    auto models = options->get<std::vector<std::string>>("models");
-    for(auto model : models) {
-      marian::filesystem::Path modelPath(model);
-      ABORT_IF(modelPath.extension() != marian::filesystem::Path(".bin"),
-              "Non-binarized models cannot be mmapped");
-      mmaps_.push_back(std::move(mio::mmap_source(model)));
-    }
-#endif
+    modelsLoaded.get();
 
     size_t id = 0;
     for(auto device : devices) {
       auto task = [&](DeviceId device, size_t id) {
+        timer::Timer timer;
+        allocateForWorkerOf(options_, id, devicesPerWorker_);
         auto graph = New<ExpressionGraph>(true);
         auto prec = options_->get<std::vector<std::string>>("precision", {"float32"});
+        if(id >= numGpuDevices_) // the CPU graphs of --hybrid-cpu-threads
+          prec = {"float32"};
         graph->setDefaultElementType(typeFromString(prec[0]));
         graph->setDevice(device);
-        graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+        graph->getBackend()->setNumThreads(options_->get<size_t>("cpu-threads-per-graph", 1));
+        graph->setMemoryPlanning(options_->get<bool>("plan-memory", false));
+        graph->setElementwiseFusion(options_->get<bool>("fuse-elementwise", false));
+        graph->setParameterSharing(options_->get<bool>("share-parameters", false));
+        graph->setParameterOffloading(options_->get<bool>("offload-parameters", false));
+        graph->setFloat16Weights(device.type == DeviceType::cpu && options_->get<bool>("cpu-float16-weights", false));
+        if(getWorkspaceMB(options_) > 0) // otherwise measured below with --workspace auto
+          graph->reserveWorkspaceMB(getWorkspaceMB(options_));
         graphs_[id] = graph;
 
-#if MMAP
-        auto scorers = createScorers(options_, mmaps_);
-#else
-        auto scorers = createScorers(options_);
-#endif
-        for(auto scorer : scorers) {
+        auto scorers = !mmaps_.empty()        ? createScorers(options_, mmaps_)
+                       : !sharedModels_.empty() ? createScorers(options_, sharedModels_)
+                                                : createScorers(options_, vocabSubset_);
+        if(devicesPerWorker_ > 1) // one model per device
+          scorers = {scorers[id % devicesPerWorker_]};
+        for(auto scorer : scorers)
           scorer->init(graph);
-          if(shortlistGenerator_)
+        shortlistLoaded.wait();
+        if(shortlistGenerator_)
+          for(auto scorer : scorers)
             scorer->setShortlistGenerator(shortlistGenerator_);
-        }
 
         scorers_[id] = scorers;
         graph->forward();
+        fitWorkspace(options_, graph, scorers, corpus_->getVocabs());
+        graph->setWorkspaceLimitMB(options_->get<size_t>("workspace-limit", 0));
+        cpu::setThreadNumaNode(-1);
+        LOG(info, "[startup] Set up the graph on {} in {:.2f}s", device, timer.elapsed());
       };
 
       threadPool.enqueue(task, device, id++);
     }
+    threadPool.join_all();
+    LOG(info, "[startup] Ready to translate after {:.2f}s", startupTimer.elapsed());
 
     if(options_->get<bool>("output-sampling", false)) {
       if(options_->get<size_t>("beam-size") > 1)
@@ -117,194 +244,618 @@ public:
         LOG(warn,
             "[warning] Output sampling and model ensembling are contradictory methods and using "
             "them together is not recommended. Use a single model");
+      ABORT_IF(options_->get<float>("output-sampling-temperature") <= 0.f,
+               "--output-sampling-temperature has to be positive");
+      ABORT_IF(options_->get<float>("output-sampling-nucleus") <= 0.f || options_->get<float>("output-sampling-nucleus") > 1.f,
+               "--output-sampling-nucleus has to be in (0, 1]");
+      if(OutputSampling(options_).restricted() && !sampleInSearch(options_))
+        LOG(warn,
+            "[warning] --output-sampling-topk and --output-sampling-nucleus are only used by the greedy "
+            "search of a single model (beam-size 1, without n-best lists and alignments) and are ignored");
     }
   }
 
   void run() override {
+    // With --mpi-split, every MPI process translates its stripe of the input. The translations are
+    // written by the first process in order, or by each process to its own file with --mpi-output-shards.
+    Ptr<IMPIWrapper> mpi;
+    size_t rank = 0, numRanks = 1;
+    auto output = options_->get<std::string>("output");
+    if(options_->get<bool>("mpi-split", false)) {
+      mpi = initMPI(/*multiThreaded=*/true);
+      rank = mpi->myMPIRank();
+      numRanks = mpi->numMPIProcesses();
+      for(const auto& input : options_->get<std::vector<std::string>>("input"))
+        ABORT_IF(numRanks > 1 && input == "stdin", "--mpi-split requires --input files, not stdin");
+      corpus_->setStripe(rank, numRanks);
+      if(options_->get<bool>("mpi-output-shards", false)) {
+        ABORT_IF(output == "stdout", "--mpi-output-shards requires an --output file");
+        output += "." + std::to_string(rank);
+      } else if(rank > 0) {
+        output = "stdout"; // unused, the other processes send their translations to the first one
+      }
+      LOG(info, "[mpi] Translating every {}-th line of the input from line {}, written to {}",
+          numRanks, rank, rank == 0 || options_->get<bool>("mpi-output-shards", false) ? output : "the first process");
+    }
+    bool shards = mpi && options_->get<bool>("mpi-output-shards", false);
+
     data::BatchGenerator<data::Corpus> bg(corpus_, options_);
 
-    ThreadPool threadPool(numDevices_, numDevices_);
+    // --output-threads: declared first, so that it finishes the translations of the workers below
+    size_t outputThreads = options_->get<size_t>("output-threads", 0);
+    auto outputPool = outputThreads > 0 ? New<ThreadPool>(outputThreads, 2 * outputThreads) : nullptr;
+
+    size_t numWorkers = numGpuDevices_ / devicesPerWorker_;
+    ThreadPool threadPool(numWorkers, numWorkers, pinWorkerThreads(options_));
+
+    // With --hybrid-cpu-threads, the CPU graphs decode on their own workers. They get the batches that
+    // are short enough while one of them is idle, split into batches of --hybrid-cpu-mini-batch sentences.
+    size_t numCpuWorkers = numDevices_ - numGpuDevices_;
+    auto cpuPool = numCpuWorkers > 0 ? New<ThreadPool>(numCpuWorkers, 0) : nullptr;
+    auto cpuPending = New<std::atomic<size_t>>(0); // batches given to the CPU workers and not yet decoded
+    size_t cpuMiniBatch = std::max<size_t>(1, options_->get<size_t>("hybrid-cpu-mini-batch", 8));
+    size_t cpuMaxLength = options_->get<size_t>("hybrid-cpu-max-length", 0);
 
     size_t batchId = 0;
-    auto collector = New<OutputCollector>(options_->get<std::string>("output"));
+    auto collector = New<OutputCollector>(output);
     auto printer = New<OutputPrinter>(options_, trgVocab_);
     if(options_->get<bool>("quiet-translation"))
       collector->setPrintingStrategy(New<QuietPrinting>());
-
-    bg.prepare();
+    collector->setUnordered(options_->get<bool>("output-unordered", false));
+    collector->setBinaryNBest(options_->get<std::string>("n-best-format", "text") == "binary");
+    size_t maxBuffered = options_->get<size_t>("output-buffer", 0);
 
     bool doNbest = options_->get<bool>("n-best");
-    for(auto batch : bg) {
-      auto task = [=](size_t id) {
-        thread_local Ptr<ExpressionGraph> graph;
-        thread_local std::vector<Ptr<Scorer>> scorers;
-
-        if(!graph) {
-          graph = graphs_[id % numDevices_];
-          scorers = scorers_[id % numDevices_];
+    Ptr<MPIOutputMerger> merger;
+    if(mpi && !shards && numRanks > 1)
+      merger = New<MPIOutputMerger>(mpi, collector, doNbest);
+    bool sendOutputs = merger && rank > 0;
+
+    // the collector of each shard writes the lines of its stripe in the order of their ids in it
+    auto write = [=](long id, const std::string& best1, const std::string& bestn) {
+      collector->Write(shards ? id / (long)numRanks : id, best1, bestn, doNbest);
+    };
+
+    // Formats the translations of a batch, which detokenizes every entry of the n-best lists, and writes them,
+    // or sends them to the first MPI process together with the outputs of the batch found in the cache
+    auto printBatch = [=](Ptr<data::CorpusBatch> input, const Histories& histories, std::vector<MPIOutputMerger::Output> outputs) {
+      for(size_t i = 0; i < histories.size(); ++i) {
+        std::stringstream best1;
+        std::stringstream bestn;
+        printer->print(histories[i], best1, bestn);
+        if(cache_)
+          cache_->put(input, i, {best1.str(), bestn.str()});
+        if(sendOutputs)
+          outputs.push_back({(long)histories[i]->getLineNum(), best1.str(), bestn.str()});
+        else
+          write((long)histories[i]->getLineNum(), best1.str(), bestn.str());
+      }
+      if(sendOutputs)
+        merger->send(outputs);
+    };
+
+    // decodes a batch on the graphs of the calling worker, whose graphs start at firstDevice
+    auto task = [=](size_t id, Ptr<data::CorpusBatch> batch, size_t firstDevice) {
+      thread_local std::vector<Ptr<ExpressionGraph>> graphs;
+      thread_local std::vector<Ptr<Scorer>> scorers;
+
+      if(graphs.empty()) {
+        size_t first = firstDevice + ThreadPool::currentWorker() * devicesPerWorker_;
+        for(size_t i = first; i < first + devicesPerWorker_; ++i) {
+          graphs.push_back(graphs_[i]);
+          scorers.insert(scorers.end(), scorers_[i].begin(), scorers_[i].end());
         }
+      }
 
+      // the translations of the other MPI processes are sent to the first one once per batch
+      std::vector<MPIOutputMerger::Output> outputs;
+      auto addOutput = [&](long id, const std::string& best1, const std::string& bestn) {
+        if(sendOutputs)
+          outputs.push_back({id, best1, bestn});
+        else
+          write(id, best1, bestn);
+      };
+
+      // write out cached translations right away and only decode the remaining sentences
+      auto input = batch;
+      if(cache_)
+        input = cache_->filter(batch, [&](size_t sentId, const TranslationCache::Entry& entry) {
+          addOutput((long)sentId, entry.best1, entry.bestn);
+        });
+
+      Histories histories;
+      if(input) {
         auto search = New<Search>(options_, scorers, trgVocab_);
-        auto histories = search->search(graph, batch);
-
-        for(auto history : histories) {
-          std::stringstream best1;
-          std::stringstream bestn;
-          printer->print(history, best1, bestn);
-          collector->Write((long)history->getLineNum(),
-                           best1.str(),
-                           bestn.str(),
-                           doNbest);
-        }
+        histories = search->search(graphs, input);
+        releaseGrownWorkspaces(graphs);
+      }
 
+      // with --output-threads, this worker goes on with the next batch while the translations are formatted
+      if(outputPool)
+        outputPool->enqueue(printBatch, input, std::move(histories), std::move(outputs));
+      else
+        printBatch(input, histories, std::move(outputs));
+
+
+      // progress heartbeat for MS-internal Philly compute cluster
+      // otherwise this job may be killed prematurely if no log for 4 hrs
+      if (getenv("PHILLY_JOB_ID")   // this environment variable exists when running on the cluster
+          && id % 1000 == 0)  // hard beat once every 1000 batches
+      {
+        auto progress = 0.f; //fake progress for now
+        fprintf(stderr, "PROGRESS: %.2f%%\n", progress);
+        fflush(stderr);
+      }
+    };
 
-        // progress heartbeat for MS-internal Philly compute cluster
-        // otherwise this job may be killed prematurely if no log for 4 hrs
-        if (getenv("PHILLY_JOB_ID")   // this environment variable exists when running on the cluster
-            && id % 1000 == 0)  // hard beat once every 1000 batches
-        {
-          auto progress = 0.f; //fake progress for now
-          fprintf(stderr, "PROGRESS: %.2f%%\n", progress);
-          fflush(stderr);
-        }
-      };
+    auto cpuTask = [=](size_t id, Ptr<data::CorpusBatch> batch) {
+      task(id, batch, numGpuDevices_);
+      (*cpuPending)--;
+    };
+
+    bg.prepare();
 
-      threadPool.enqueue(task, batchId++);
+    for(auto batch : bg) {
+      // do not produce new work while too many translations are waiting to be written in order
+      if(maxBuffered > 0)
+        collector->waitForSpace(maxBuffered);
+      collector->addPending(batch->size());
+
+      bool toCpu = cpuPool && *cpuPending < numCpuWorkers
+                   && (cpuMaxLength == 0 || batch->front()->batchWidth() <= cpuMaxLength);
+      if(toCpu) {
+        size_t pieces = (batch->size() + cpuMiniBatch - 1) / cpuMiniBatch;
+        for(auto piece : batch->split(pieces, SIZE_MAX)) {
+          if(!piece)
+            continue;
+          (*cpuPending)++;
+          auto cpuBatch = std::static_pointer_cast<data::CorpusBatch>(piece);
+          cpuPool->enqueueWithCost(getBatchCost(cpuBatch, options_), cpuTask, batchId, cpuBatch);
+        }
+        batchId++;
+      } else {
+        threadPool.enqueueWithCost(getBatchCost(batch, options_), task, batchId++, batch, (size_t)0);
+      }
+    }
 
+    bool saveStatistics = options_->hasAndNotEmpty("quantize-statistics");
+    if(cache_ || profiler_ || saveStatistics || mpi) {
+      threadPool.join_all(); // wait for all batches before reporting
+      if(cpuPool)
+        cpuPool->join_all();
+      if(outputPool)
+        outputPool->join_all();
     }
+    if(merger)
+      merger->finish();
+    if(cache_)
+      cache_->logStats();
+    if(profiler_)
+      profiler_->report();
+    if(saveStatistics)
+      cpu::integer::ActivationStatistics::instance().save(options_->get<std::string>("quantize-statistics"));
+    if(mpi)
+      finalizeMPI(std::move(mpi));
   }
 };
 
 template <class Search>
 class TranslateService : public ModelServiceTask {
 private:
+  // The loaded models with everything that depends on them. Requests hold on to the models they
+  // started with, so that reload() can replace them while requests are being translated.
+  struct Models {
+    Ptr<Options> options; // the options the models were loaded with
+    // models memory-mapped by all graphs with --cpu-mmap-weights
+    std::vector<mio::mmap_source> mmaps;
+    // models loaded once and mapped by all graphs with --cpu-shared-weights
+    std::vector<Ptr<io::binary::MemoryImage>> sharedModels;
+    std::vector<Ptr<ExpressionGraph>> graphs;
+    std::vector<std::vector<Ptr<Scorer>>> scorers;
+    Ptr<const data::ShortlistGenerator> shortlistGenerator;
+    Ptr<TranslationCache> cache; // translations of these models only
+  };
+
   Ptr<Options> options_;
-  std::vector<Ptr<ExpressionGraph>> graphs_;
-  std::vector<std::vector<Ptr<Scorer>>> scorers_;
+  Ptr<Models> models_;
+  std::mutex modelsMutex_;  // guards models_
+  std::mutex reloadMutex_;  // one reload at a time
 
   std::vector<Ptr<Vocab>> srcVocabs_;
   Ptr<Vocab> trgVocab_;
-  Ptr<const data::ShortlistGenerator> shortlistGenerator_;
+  Ptr<const data::VocabSubset> vocabSubset_; // with --output-vocab-subset
+  Ptr<profiling::DecoderProfiler> profiler_; // with --decoder-profile, reported when the service shuts down
+  Ptr<ServerMetrics> metrics_; // with --metrics-port
 
   size_t numDevices_;
+  size_t devicesPerWorker_; // see getDevicesPerWorker()
+
+  // with --data-threads, the lines of a request are encoded in parallel on these threads
+  UPtr<ThreadPool> encodePool_;
+
+  // declared last so that it is destroyed first, the batcher thread calls translate()
+  UPtr<RequestBatcher> batcher_;
 
 public:
-  virtual ~TranslateService() {}
+  virtual ~TranslateService() {
+    batcher_.reset(); // finish pending requests before reporting
+    if(profiler_)
+      profiler_->report();
+  }
 
   TranslateService(Ptr<Options> options)
     : options_(New<Options>(options->clone())) {
+    ABORT_IF(options_->get<std::string>("n-best-format", "text") == "binary",
+             "Binary n-best lists are not supported by the translation service");
+
     // initialize vocabs
     options_->set("inference", true);
     options_->set("shuffle", "none");
 
+    timer::Timer startupTimer;
     auto vocabPaths = options_->get<std::vector<std::string>>("vocabs");
     std::vector<int> maxVocabs = options_->get<std::vector<int>>("dim-vocabs");
 
-    for(size_t i = 0; i < vocabPaths.size() - 1; ++i) {
-      Ptr<Vocab> vocab = New<Vocab>(options_, i);
-      vocab->load(vocabPaths[i], maxVocabs[i]);
-      srcVocabs_.emplace_back(vocab);
+    // the vocabularies are read in parallel
+    {
+      timer::Timer timer;
+      srcVocabs_.resize(vocabPaths.size() - 1);
+      std::vector<std::future<void>> loaded;
+      for(size_t i = 0; i < vocabPaths.size() - 1; ++i) {
+        loaded.push_back(std::async(std::launch::async, [&, i]() {
+          srcVocabs_[i] = New<Vocab>(options_, i);
+          srcVocabs_[i]->load(vocabPaths[i], maxVocabs[i]);
+        }));
+      }
+      trgVocab_ = New<Vocab>(options_, vocabPaths.size() - 1);
+      trgVocab_->load(vocabPaths.back());
+      for(auto& vocab : loaded)
+        vocab.get();
+      vocabSubset_ = restrictTargetVocab(options_, trgVocab_);
+      LOG(info, "[startup] Loaded the vocabularies in {:.2f}s", timer.elapsed());
     }
 
-    trgVocab_ = New<Vocab>(options_, vocabPaths.size() - 1);
-    trgVocab_->load(vocabPaths.back());
-
-    // load lexical shortlist
-    if(options_->hasAndNotEmpty("shortlist"))
-      shortlistGenerator_ = New<data::LexicalShortlistGenerator>(
-          options_, srcVocabs_.front(), trgVocab_, 0, 1, vocabPaths.front() == vocabPaths.back());
+    profiler_ = profiling::DecoderProfiler::create(options_);
 
     // get device IDs
     auto devices = Config::getDevices(options_);
     numDevices_ = devices.size();
+    devicesPerWorker_ = getDevicesPerWorker(options_, numDevices_);
+    metrics_ = ServerMetrics::create(options_, numDevices_);
+
+    models_ = loadModels(options_);
+
+    auto dataThreads = options_->get<size_t>("data-threads", 1);
+    if(dataThreads > 1)
+      encodePool_.reset(new ThreadPool(dataThreads));
+
+    // merge sentences from concurrent requests into shared batches
+    auto maxWaitMs = options_->get<size_t>("server-batch-wait-ms", 0);
+    auto maxWords = options_->get<size_t>("server-batch-words", 0);
+    if(maxWaitMs > 0 || maxWords > 0) {
+      LOG(info, "Batching concurrent requests (max wait: {}ms, max words: {})", maxWaitMs, maxWords);
+      batcher_.reset(new RequestBatcher(
+          [this](const RequestBatcher::Streams& streams, const RequestBatcher::LineCallback& onLine) {
+            return translate(streams, onLine);
+          },
+          maxWaitMs, maxWords));
+    }
 
-    // initialize scorers
-    for(auto device : devices) {
-      auto graph = New<ExpressionGraph>(true);
+    warmup(models_);
+    LOG(info, "[startup] Ready to translate after {:.2f}s", startupTimer.elapsed());
+  }
 
-      auto precison = options_->get<std::vector<std::string>>("precision", {"float32"});
-      graph->setDefaultElementType(typeFromString(precison[0])); // only use first type, used for parameter type in graph
-      graph->setDevice(device);
-      graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
-      graphs_.push_back(graph);
+  std::string run(const std::string& input) override {
+    timer::Timer timer;
+    auto streams = splitInput(input);
+    if(metrics_)
+      metrics_->startRequest(streams.front().size());
+    auto translations = batcher_ ? batcher_->enqueue(streams) : translate(streams);
+    if(metrics_)
+      metrics_->finishRequest(timer.elapsed());
+    return utils::join(translations, "\n");
+  }
 
-      auto scorers = createScorers(options_);
-      for(auto scorer : scorers) {
-        scorer->init(graph);
-        if(shortlistGenerator_)
-          scorer->setShortlistGenerator(shortlistGenerator_);
+  // Translates the input asynchronously and calls the callback with the joined translations. If
+  // request batching is enabled (--server-batch-wait-ms or --server-batch-words) sentences from
+  // concurrent requests are merged into shared batches, scheduled by priority and deadline (in
+  // milliseconds from now, 0 for none), see RequestBatcher. Otherwise the input is translated
+  // right away in the calling thread. With onLine, the translation of each line is also passed on
+  // with its line number as soon as its mini-batch is done, possibly out of order and from
+  // several threads at once.
+  void runAsync(const std::string& input,
+                std::function<void(const std::string&)> callback,
+                RequestBatcher::Priority priority = RequestBatcher::Priority::Normal,
+                size_t deadlineMs = 0,
+                RequestBatcher::LineCallback onLine = nullptr) {
+    auto timer = New<timer::Timer>();
+    auto streams = splitInput(input);
+    if(metrics_) {
+      metrics_->startRequest(streams.front().size());
+      auto metrics = metrics_;
+      callback = [callback, metrics, timer](const std::string& output) {
+        metrics->finishRequest(timer->elapsed());
+        callback(output);
+      };
+    }
+    if(batcher_)
+      batcher_->enqueue(streams, [callback](std::vector<std::string>&& translations) {
+        callback(utils::join(translations, "\n"));
+      }, priority, deadlineMs, onLine);
+    else
+      callback(utils::join(translate(streams, onLine), "\n"));
+  }
+
+  // Returns the metrics of the service in the Prometheus text format, empty without --metrics-port
+  std::string metrics() {
+    return metrics_ ? metrics_->render(currentModels()->cache.get(), batcher_.get(), profiler_.get()) : "";
+  }
+
+  // Replaces the models without interrupting the service: the models given by `update`, e.g.
+  // "models: [new.npz]" with optionally changed shortlist or precision, or the model files again if
+  // it is empty, are loaded into new graphs on the same devices and warmed up with --warmup while
+  // the current models keep translating. New requests are translated with the new models and the
+  // current models are released once their pending batches are done, so twice the memory of the
+  // models is needed during the reload. The translation cache starts empty. Returns an error
+  // message, empty on success.
+  std::string reload(const YAML::Node& update = YAML::Node()) {
+    std::lock_guard<std::mutex> reloadLock(reloadMutex_);
+    auto options = New<Options>(options_->clone());
+    if(update.IsMap())
+      options->merge(update, /*overwrite=*/true);
+    else if(update.IsDefined() && !update.IsNull())
+      return "Reload options have to be a map";
+
+    // check what would abort the service below
+    if(options->get<std::vector<std::string>>("vocabs") != options_->get<std::vector<std::string>>("vocabs"))
+      return "Vocabularies cannot be changed by a reload";
+    auto models = options->get<std::vector<std::string>>("models", {});
+    if(models.empty())
+      return "No models to load";
+    for(const auto& model : models)
+      if(!filesystem::exists(filesystem::Path(model)))
+        return "Model file does not exist: " + model;
+    if(options->hasAndNotEmpty("shortlist")
+       && !filesystem::exists(filesystem::Path(options->get<std::vector<std::string>>("shortlist")[0])))
+      return "Shortlist file does not exist: " + options->get<std::vector<std::string>>("shortlist")[0];
+
+    timer::Timer timer;
+    LOG(info, "[service] Reloading models {}", utils::join(models, ", "));
+    auto loaded = loadModels(options);
+    warmup(loaded);
+
+    std::lock_guard<std::mutex> lock(modelsMutex_);
+    models_.swap(loaded);
+    LOG(info, "[service] Reloaded models in {:.2f}s, the previous models are released after their pending batches",
+        timer.elapsed());
+    return "";
+  }
+
+  // Changes a decoding option such as beam-size or mini-batch for the following requests, e.g. in
+  // marian-bench. Must not be called while requests are being translated.
+  template <typename T>
+  void setOption(const std::string& key, const T& value) {
+    options_->set(key, value);
+  }
+
+  // Largest workspace memory that the graph of each device has needed so far
+  std::vector<size_t> getWorkspaceHighWater() {
+    std::vector<size_t> highWater;
+    for(auto graph : currentModels()->graphs)
+      highWater.push_back(graph->getWorkspaceHighWater());
+    return highWater;
+  }
+
+private:
+  Ptr<Models> currentModels() {
+    std::lock_guard<std::mutex> lock(modelsMutex_);
+    return models_;
+  }
+
+  // Creates the graphs and scorers of the models given by the options on all devices
+  Ptr<Models> loadModels(Ptr<Options> options) {
+    auto models = New<Models>();
+    models->options = options;
+
+    // the lexical shortlist is loaded while the model files are prepared and the graphs are set up
+    auto vocabPaths = options->get<std::vector<std::string>>("vocabs");
+    std::shared_future<void> shortlistLoaded = std::async(std::launch::async, [=]() {
+      if(!options->hasAndNotEmpty("shortlist"))
+        return;
+      timer::Timer timer;
+      models->shortlistGenerator = data::createShortlistGenerator(
+          options, srcVocabs_.front(), trgVocab_, 0, 1, vocabPaths.front() == vocabPaths.back());
+      LOG(info, "[startup] Loaded the shortlist in {:.2f}s", timer.elapsed());
+    });
+
+    models->cache = TranslationCache::create(options);
+
+    auto devices = Config::getDevices(options);
+    {
+      timer::Timer timer;
+      models->mmaps = mapModels(options, devices);
+      if(models->mmaps.empty())
+        models->sharedModels = loadSharedModels(options, devices);
+      if(!models->mmaps.empty() || !models->sharedModels.empty())
+        LOG(info, "[startup] Prepared the model files in {:.2f}s", timer.elapsed());
+    }
+
+    // initialize scorers, the graphs of all devices in parallel
+    models->graphs.resize(devices.size());
+    models->scorers.resize(devices.size());
+    ThreadPool threadPool(devices.size(), devices.size());
+    for(size_t id = 0; id < devices.size(); ++id) {
+      threadPool.enqueue([&](DeviceId device, size_t id) {
+        timer::Timer timer;
+        allocateForWorkerOf(options, id, devicesPerWorker_);
+        auto graph = New<ExpressionGraph>(true);
+
+        auto precison = options->get<std::vector<std::string>>("precision", {"float32"});
+        graph->setDefaultElementType(typeFromString(precison[0])); // only use first type, used for parameter type in graph
+        graph->setDevice(device);
+        graph->getBackend()->setNumThreads(options->get<size_t>("cpu-threads-per-graph", 1));
+        graph->setMemoryPlanning(options->get<bool>("plan-memory", false));
+        graph->setElementwiseFusion(options->get<bool>("fuse-elementwise", false));
+        graph->setParameterSharing(options->get<bool>("share-parameters", false));
+        graph->setParameterOffloading(options->get<bool>("offload-parameters", false));
+        graph->setFloat16Weights(device.type == DeviceType::cpu && options->get<bool>("cpu-float16-weights", false));
+        if(getWorkspaceMB(options) > 0) // otherwise measured below with --workspace auto
+          graph->reserveWorkspaceMB(getWorkspaceMB(options));
+        models->graphs[id] = graph;
+
+        auto scorers = !models->mmaps.empty()        ? createScorers(options, models->mmaps)
+                       : !models->sharedModels.empty() ? createScorers(options, models->sharedModels)
+                                                       : createScorers(options, vocabSubset_);
+        if(devicesPerWorker_ > 1) // one model per device
+          scorers = {scorers[id % devicesPerWorker_]};
+        for(auto scorer : scorers)
+          scorer->init(graph);
+        shortlistLoaded.wait();
+        if(models->shortlistGenerator)
+          for(auto scorer : scorers)
+            scorer->setShortlistGenerator(models->shortlistGenerator);
+        models->scorers[id] = scorers;
+        graph->forward();
+        fitWorkspace(options, graph, scorers, srcVocabs_);
+        graph->setWorkspaceLimitMB(options->get<size_t>("workspace-limit", 0));
+        cpu::setThreadNumaNode(-1);
+        LOG(info, "[startup] Set up the graph on {} in {:.2f}s", device, timer.elapsed());
+      }, devices[id], id);
+    }
+    threadPool.join_all();
+    return models;
+  }
+
+  // With --warmup, every worker decodes the synthetic batches before the service accepts requests,
+  // bypassing the translation cache and the metrics
+  void warmup(Ptr<Models> models) {
+    auto batches = createWarmupBatches(options_, srcVocabs_);
+    if(batches.empty())
+      return;
+
+    timer::Timer timer;
+    size_t numWorkers = numDevices_ / devicesPerWorker_;
+    {
+      ThreadPool threadPool(numWorkers, numWorkers, pinWorkerThreads(options_));
+      for(size_t worker = 0; worker < numWorkers; ++worker) {
+        threadPool.enqueue([=](size_t worker) {
+          std::vector<Ptr<ExpressionGraph>> graphs;
+          std::vector<Ptr<Scorer>> scorers;
+          for(size_t i = worker * devicesPerWorker_; i < (worker + 1) * devicesPerWorker_; ++i) {
+            graphs.push_back(models->graphs[i]);
+            scorers.insert(scorers.end(), models->scorers[i].begin(), models->scorers[i].end());
+          }
+          for(auto batch : batches)
+            New<Search>(options_, scorers, trgVocab_)->search(graphs, batch);
+        }, worker);
       }
-      scorers_.push_back(scorers);
     }
+    LOG(info, "Warmed up {} workers with {} batches in {:.2f}s", numWorkers, batches.size(), timer.elapsed());
   }
 
-  std::string run(const std::string& input) override {
-    // split tab-separated input into fields if necessary
-    auto inputs = options_->get<bool>("tsv", false)
-                      ? convertTsvToLists(input, options_->get<size_t>("tsv-fields", 1))
-                      : std::vector<std::string>({input});
-    auto corpus_ = New<data::TextInput>(inputs, srcVocabs_, options_);
+  // Translates all lines of the given streams and returns one output per line
+  std::vector<std::string> translate(const RequestBatcher::Streams& streams,
+                                     const RequestBatcher::LineCallback& onLine = nullptr) {
+    auto models = currentModels(); // kept for the whole request if reload() replaces them meanwhile
+    auto cache = models->cache;
+    timer::Timer tokenizeTimer;
+    auto corpus_ = New<data::TextInput>(streams, srcVocabs_, options_, encodePool_.get());
+    if(metrics_)
+      metrics_->recordPhase(ServerMetrics::Tokenize, tokenizeTimer.elapsed());
     data::BatchGenerator<data::TextInput> batchGenerator(corpus_, options_);
 
     auto collector = New<StringCollector>(options_->get<bool>("quiet-translation", false));
+    bool nbest = options_->get<bool>("n-best");
+    auto add = [collector, onLine, nbest](long lineNum, const std::string& best1, const std::string& bestn) {
+      collector->add(lineNum, best1, bestn);
+      if(onLine)
+        onLine((size_t)lineNum, nbest ? bestn : best1);
+    };
     auto printer = New<OutputPrinter>(options_, trgVocab_);
     size_t batchId = 0;
 
     batchGenerator.prepare();
 
     {
-      ThreadPool threadPool_(numDevices_, numDevices_);
+      size_t numWorkers = numDevices_ / devicesPerWorker_;
+      ThreadPool threadPool_(numWorkers, numWorkers, pinWorkerThreads(options_));
 
       for(auto batch : batchGenerator) {
         auto task = [=](size_t id) {
-          thread_local Ptr<ExpressionGraph> graph;
+          thread_local std::vector<Ptr<ExpressionGraph>> graphs;
           thread_local std::vector<Ptr<Scorer>> scorers;
-
-          if(!graph) {
-            graph = graphs_[id % numDevices_];
-            scorers = scorers_[id % numDevices_];
+          thread_local size_t worker;
+
+          if(graphs.empty()) {
+            worker = ThreadPool::currentWorker();
+            for(size_t i = worker * devicesPerWorker_; i < (worker + 1) * devicesPerWorker_; ++i) {
+              graphs.push_back(models->graphs[i]);
+              scorers.insert(scorers.end(), models->scorers[i].begin(), models->scorers[i].end());
+            }
           }
 
+          auto input = batch;
+          if(cache)
+            input = cache->filter(batch, [&](size_t sentId, const TranslationCache::Entry& entry) {
+              add((long)sentId, entry.best1, entry.bestn);
+            });
+          if(!input)
+            return;
+
+          timer::Timer timer;
           auto search = New<Search>(options_, scorers, trgVocab_);
-          auto histories = search->search(graph, batch);
+          auto histories = search->search(graphs, input);
+          if(metrics_) {
+            metrics_->recordBatch(input->size());
+            metrics_->recordPhase(ServerMetrics::Search, timer.elapsed());
+            for(size_t i = 0; i < graphs.size(); ++i)
+              metrics_->recordWorkspace(worker * devicesPerWorker_ + i, graphs[i]);
+            timer.start();
+          }
+          releaseGrownWorkspaces(graphs);
 
-          for(auto history : histories) {
+          for(size_t i = 0; i < histories.size(); ++i) {
             std::stringstream best1;
             std::stringstream bestn;
-            printer->print(history, best1, bestn);
-            collector->add((long)history->getLineNum(), best1.str(), bestn.str());
+            printer->print(histories[i], best1, bestn);
+            if(cache)
+              cache->put(input, i, {best1.str(), bestn.str()});
+            add((long)histories[i]->getLineNum(), best1.str(), bestn.str());
           }
+          if(metrics_)
+            metrics_->recordPhase(ServerMetrics::Detokenize, timer.elapsed());
         };
 
-        threadPool_.enqueue(task, batchId);
+        threadPool_.enqueueWithCost(getBatchCost(batch, options_), task, batchId);
         batchId++;
       }
     }
 
-    auto translations = collector->collect(options_->get<bool>("n-best"));
-    return utils::join(translations, "\n");
+    if(cache)
+      cache->logStats();
+
+    return collector->collect(nbest);
   }
 
-private:
-  // Converts a multi-line input with tab-separated source(s) and target sentences into separate lists
-  // of sentences from source(s) and target sides, e.g.
-  // "src1 \t trg1 \n src2 \t trg2" -> ["src1 \n src2", "trg1 \n trg2"]
-  std::vector<std::string> convertTsvToLists(const std::string& inputText, size_t numFields) {
-    std::vector<std::string> outputFields(numFields);
+  // Splits a multi-line input into lines, with tab-separated source(s) and target sentences into
+  // separate lists of sentences from source(s) and target sides, e.g.
+  // "src1 \t trg1 \n src2 \t trg2" -> [["src1", "src2"], ["trg1", "trg2"]]
+  RequestBatcher::Streams splitInput(const std::string& inputText) {
+    bool tsv = options_->get<bool>("tsv", false);
+    size_t numFields = tsv ? options_->get<size_t>("tsv-fields", 1) : 1;
+    RequestBatcher::Streams outputFields(numFields);
 
     std::string line;
     std::vector<std::string> lineFields(numFields);
     std::istringstream inputStream(inputText);
-    bool first = true;
     while(std::getline(inputStream, line)) {
-      utils::splitTsv(line, lineFields, numFields);
-      for(size_t i = 0; i < numFields; ++i) {
-        if(!first)
-          outputFields[i] += "\n";  // join sentences with a new line sign
-        outputFields[i] += lineFields[i];
+      if(tsv) {
+        utils::splitTsv(line, lineFields, numFields);
+        for(size_t i = 0; i < numFields; ++i)
+          outputFields[i].push_back(lineFields[i]);
+      } else {
+        outputFields[0].push_back(line);
       }
-      if(first)
-        first = false;
     }
 
     return outputFields;